@@ -162,6 +162,35 @@ extern "C" {
 #define SPIM_PROGRAMMING_TIMEOUT         ((uint32_t)0x00100000) /*!< spim program operation timeout */
 #define OPERATION_TIMEOUT                ((uint32_t)0x10000000) /*!< flash common operation timeout */
 
+/**
+  * @}
+  */
+
+/** @defgroup FLASH_buffer_write_definition
+  * @brief flash buffer write definition
+  * @{
+  */
+
+#define FLASH_WRITE_SECTOR_SIZE          ((uint32_t)0x00000800) /*!< internal flash sector size */
+
+/**
+  * define FLASH_WRITE_RUN_IN_SRAM to run the program loop of flash_buffer_write
+  * from sram, instruction fetches then do not stall while a bank is busy and
+  * both banks are kept programming. with mdk the RAMCODE section has to be
+  * placed in sram by the scatter file.
+  */
+#if defined (FLASH_WRITE_RUN_IN_SRAM)
+  #if defined (__ICCARM__)
+    #define FLASH_WRITE_RAM_FUNC         __ramfunc
+  #elif defined (__GNUC__) && !defined (__ARMCC_VERSION)
+    #define FLASH_WRITE_RAM_FUNC         __attribute__((section(".data.ramfunc"), noinline, long_call))
+  #else
+    #define FLASH_WRITE_RAM_FUNC         __attribute__((section("RAMCODE"), noinline))
+  #endif
+#else
+  #define FLASH_WRITE_RAM_FUNC
+#endif
+
 /**
   * @}
   */
@@ -191,6 +220,19 @@ typedef enum
   FLASH_SPIM_MODEL2                      = 0x02  /*!< spim model 2 */
 } flash_spim_model_type;
 
+/**
+  * @brief  flash buffer write statistics type
+  */
+typedef struct
+{
+  uint32_t bytes;                        /*!< bytes requested */
+  uint32_t words_programmed;             /*!< words actually programmed */
+  uint32_t words_skipped;                /*!< words already holding the data */
+  uint32_t sectors_erased;               /*!< sectors erased */
+  uint32_t erases_avoided;               /*!< sectors holding data that were updated without erase */
+  uint32_t cycles;                       /*!< core cycles spent, 0 when the dwt cycle counter is off */
+} flash_write_stats_type;
+
 /**
   * @brief type define flash register all
   */
@@ -700,6 +742,8 @@ void flash_spim_model_select(flash_spim_model_type mode);
 void flash_spim_encryption_range_set(uint32_t decode_address);
 void flash_spim_dummy_read(void);
 flash_status_type flash_spim_mass_program(uint32_t address, uint8_t *buf, uint32_t cnt);
+flash_status_type flash_buffer_write(uint32_t address, const uint8_t *buf, uint32_t cnt,
+                                     uint32_t *sector_buf, flash_write_stats_type *stats);
 flash_status_type flash_slib_enable(uint32_t pwd, uint16_t start_sector, uint16_t data_start_sector, uint16_t end_sector);
 error_status flash_slib_disable(uint32_t pwd);
 uint32_t flash_slib_remaining_count_get(void);
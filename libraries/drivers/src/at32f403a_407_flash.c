@@ -1109,6 +1109,255 @@ flash_status_type flash_spim_mass_program(uint32_t address, uint8_t *buf, uint32
   return status;
 }
 
+/**
+  * @brief  program lane, one per bank
+  */
+typedef struct
+{
+  uint32_t address;
+  const uint8_t *data;
+  uint32_t count;                        /* words left */
+} flash_lane_type;
+
+/**
+  * @brief  program the words of a bank1 lane and a bank2 lane in parallel.
+  * @note   words already holding the data are skipped. a bank gets its next
+  *         word as soon as its busy flag clears, so both banks program at the
+  *         same time. only registers are accessed so that the loop can run
+  *         from sram, see FLASH_WRITE_RUN_IN_SRAM.
+  * @param  lane: lane[0] in bank1, lane[1] in bank2, count 0 when unused.
+  * @param  stats: statistics to update.
+  * @retval status: the returned value can be: FLASH_PROGRAM_ERROR,
+  *         FLASH_EPP_ERROR, FLASH_OPERATE_DONE or FLASH_OPERATE_TIMEOUT.
+  */
+static FLASH_WRITE_RAM_FUNC flash_status_type flash_lane_program(flash_lane_type *lane, flash_write_stats_type *stats)
+{
+  flash_status_type status = FLASH_OPERATE_DONE;
+  uint32_t busy[2] = {0, 0}, timeout[2] = {0, 0};
+  uint32_t data = 0, sts;
+  int32_t index;
+
+  if(lane[0].count)
+    FLASH->ctrl_bit.fprgm = TRUE;
+  if(lane[1].count)
+    FLASH->ctrl2_bit.fprgm = TRUE;
+
+  while(lane[0].count || lane[1].count || busy[0] || busy[1])
+  {
+    /* bank2 first, code usually runs from bank1 */
+    for(index = 1; index >= 0; index--)
+    {
+      if(busy[index])
+      {
+        sts = (index == 0) ? FLASH->sts : FLASH->sts2;
+        if(sts & FLASH_BANK1_OBF_FLAG)
+        {
+          if(--timeout[index] == 0)
+          {
+            status = FLASH_OPERATE_TIMEOUT;
+            break;
+          }
+          continue;
+        }
+        busy[index] = 0;
+        if(sts & FLASH_BANK1_PRGMERR_FLAG)
+        {
+          status = FLASH_PROGRAM_ERROR;
+          break;
+        }
+        if(sts & FLASH_BANK1_EPPERR_FLAG)
+        {
+          status = FLASH_EPP_ERROR;
+          break;
+        }
+      }
+
+      /* skip the words already holding the data */
+      while(lane[index].count)
+      {
+        data = lane[index].data[0] | (lane[index].data[1] << 8) |
+               (lane[index].data[2] << 16) | ((uint32_t)lane[index].data[3] << 24);
+        if(*(__IO uint32_t *)lane[index].address != data)
+          break;
+        lane[index].address += 4;
+        lane[index].data += 4;
+        lane[index].count--;
+        stats->words_skipped++;
+      }
+
+      if(lane[index].count)
+      {
+        *(__IO uint32_t *)lane[index].address = data;
+        lane[index].address += 4;
+        lane[index].data += 4;
+        lane[index].count--;
+        stats->words_programmed++;
+        busy[index] = 1;
+        timeout[index] = PROGRAMMING_TIMEOUT;
+      }
+    }
+    if(status != FLASH_OPERATE_DONE)
+      break;
+  }
+
+  /* disable the fprgm bit */
+  FLASH->ctrl_bit.fprgm = FALSE;
+  FLASH->ctrl2_bit.fprgm = FALSE;
+  return status;
+}
+
+/**
+  * @brief  write a buffer to the internal flash with the least flash operations.
+  * @note   old and new data are compared word by word. unchanged words are not
+  *         programmed. a sector is erased only if a word has to change that is
+  *         not erased, this device family cannot program over a programmed
+  *         word. when the range covers both banks, sectors of bank1 and bank2
+  *         are erased and programmed in parallel. the flash has to be unlocked.
+  * @param  address: start address, word aligned, bank1 or bank2.
+  * @param  buf: data to write, any alignment.
+  * @param  cnt: number of bytes, multiple of 4.
+  * @param  sector_buf: word aligned buffer that keeps the rest of a sector while
+  *         it is erased, one FLASH_WRITE_SECTOR_SIZE, two when the range covers
+  *         both banks. may be null when the target range is known to be erased.
+  * @param  stats: statistics of the call, may be null.
+  * @retval status: the returned value can be: FLASH_PROGRAM_ERROR,
+  *         FLASH_EPP_ERROR, FLASH_OPERATE_DONE or FLASH_OPERATE_TIMEOUT.
+  */
+flash_status_type flash_buffer_write(uint32_t address, const uint8_t *buf, uint32_t cnt,
+                                     uint32_t *sector_buf, flash_write_stats_type *stats)
+{
+  flash_status_type status = FLASH_OPERATE_DONE;
+  flash_write_stats_type stats_local;
+  flash_lane_type lane[2], chunk[2];
+  uint32_t erase[2], sector[2], dual;
+  uint32_t end = address + cnt, index, word, old, data, offset, blank, count;
+  uint32_t *sector_data;
+  uint32_t cycles = DWT->CYCCNT;
+
+  if(stats == 0)
+    stats = &stats_local;
+  stats->bytes = cnt;
+  stats->words_programmed = 0;
+  stats->words_skipped = 0;
+  stats->sectors_erased = 0;
+  stats->erases_avoided = 0;
+  stats->cycles = 0;
+
+  if((address & 3) || (cnt & 3) || (address < FLASH_BANK1_START_ADDR) ||
+     (end > FLASH_BANK2_END_ADDR + 1) || (end < address))
+    return FLASH_PROGRAM_ERROR;
+
+  /* split the range in a bank1 lane and a bank2 lane */
+  lane[0].address = address;
+  lane[0].data = buf;
+  lane[0].count = 0;
+  if(address <= FLASH_BANK1_END_ADDR)
+    lane[0].count = (((end <= FLASH_BANK1_END_ADDR + 1) ? end : FLASH_BANK1_END_ADDR + 1) - address) / 4;
+  lane[1].address = address + lane[0].count * 4;
+  lane[1].data = buf + lane[0].count * 4;
+  lane[1].count = cnt / 4 - lane[0].count;
+  dual = (lane[0].count && lane[1].count) ? 1 : 0;
+
+  flash_flag_clear(FLASH_BANK1_PRGMERR_FLAG | FLASH_BANK1_EPPERR_FLAG | FLASH_BANK1_ODF_FLAG);
+  flash_flag_clear(FLASH_BANK2_PRGMERR_FLAG | FLASH_BANK2_EPPERR_FLAG | FLASH_BANK2_ODF_FLAG);
+
+  while((lane[0].count || lane[1].count) && (status == FLASH_OPERATE_DONE))
+  {
+    for(index = 0; index < 2; index++)
+    {
+      chunk[index] = lane[index];
+      erase[index] = 0;
+      if(lane[index].count == 0)
+        continue;
+
+      /* part of the lane in the current sector */
+      sector[index] = lane[index].address & ~(FLASH_WRITE_SECTOR_SIZE - 1);
+      count = (sector[index] + FLASH_WRITE_SECTOR_SIZE - lane[index].address) / 4;
+      if(count > lane[index].count)
+        count = lane[index].count;
+      chunk[index].count = count;
+
+      blank = 1;
+      for(word = 0; word < count; word++)
+      {
+        old = *(uint32_t *)(lane[index].address + word * 4);
+        data = lane[index].data[word * 4] | (lane[index].data[word * 4 + 1] << 8) |
+               (lane[index].data[word * 4 + 2] << 16) | ((uint32_t)lane[index].data[word * 4 + 3] << 24);
+        if(old != 0xFFFFFFFF)
+          blank = 0;
+        if((old != data) && (old != 0xFFFFFFFF))
+        {
+          erase[index] = 1;
+          break;
+        }
+      }
+
+      if(erase[index])
+      {
+        if(sector_buf == 0)
+          return FLASH_PROGRAM_ERROR;
+        /* keep the sector, merge the new data, program it back after the erase */
+        sector_data = sector_buf + dual * index * FLASH_WRITE_SECTOR_SIZE / 4;
+        offset = lane[index].address - sector[index];
+        for(word = 0; word < FLASH_WRITE_SECTOR_SIZE / 4; word++)
+        {
+          sector_data[word] = *(uint32_t *)(sector[index] + word * 4);
+        }
+        for(word = 0; word < count * 4; word++)
+        {
+          ((uint8_t *)sector_data)[offset + word] = lane[index].data[word];
+        }
+        chunk[index].address = sector[index];
+        chunk[index].data = (uint8_t *)sector_data;
+        chunk[index].count = FLASH_WRITE_SECTOR_SIZE / 4;
+        stats->sectors_erased++;
+      }
+      else if(blank == 0)
+      {
+        stats->erases_avoided++;
+      }
+
+      lane[index].address += count * 4;
+      lane[index].data += count * 4;
+      lane[index].count -= count;
+    }
+
+    /* erase both banks at the same time, bank2 is started first */
+    if(erase[1])
+    {
+      FLASH->ctrl2_bit.secers = TRUE;
+      FLASH->addr2 = sector[1];
+      FLASH->ctrl2_bit.erstr = TRUE;
+    }
+    if(erase[0])
+    {
+      FLASH->ctrl_bit.secers = TRUE;
+      FLASH->addr = sector[0];
+      FLASH->ctrl_bit.erstr = TRUE;
+      status = flash_bank1_operation_wait_for(ERASE_TIMEOUT);
+      FLASH->ctrl_bit.secers = FALSE;
+    }
+    if(erase[1])
+    {
+      if(status == FLASH_OPERATE_DONE)
+        status = flash_bank2_operation_wait_for(ERASE_TIMEOUT);
+      else
+        flash_bank2_operation_wait_for(ERASE_TIMEOUT);
+      FLASH->ctrl2_bit.secers = FALSE;
+    }
+
+    if(status == FLASH_OPERATE_DONE)
+      status = flash_lane_program(chunk, stats);
+  }
+
+  if(CoreDebug->DEMCR & CoreDebug_DEMCR_TRCENA_Msk)
+  {
+    if(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk)
+      stats->cycles = DWT->CYCCNT - cycles;
+  }
+  return status;
+}
+
 /**
   * @brief  enable security library function.
   * @param  pwd: slib password
@@ -0,0 +1,605 @@
+/**
+  **************************************************************************
+  * @file     ab_update.c
+  * @brief    a/b dual-bank firmware update library
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+#include "ab_update.h"
+
+/** @addtogroup AT32F403A_407_middlewares_ab_update_library
+  * @{
+  */
+
+/**
+  * @brief flash size register, unit kbyte
+  */
+#define AB_FLASH_SIZE_REG()              ((*(uint32_t *)0x1FFFF7E0) & 0xFFFF)
+
+#define AB_META_WORDS                    (sizeof(ab_meta_type) / sizeof(uint32_t))
+#define AB_META_END_ADDR                 (AB_META_ADDR + AB_META_SECTOR_NUM * AB_SECTOR_SIZE)
+
+/**
+  * @brief poll count handed to the bank wait functions, keeps ab_update_poll short
+  */
+#define AB_POLL_TIMEOUT                  ((uint32_t)0x00000001)
+
+ab_update_type ab_update;
+
+/**
+  * @brief  crc of a word buffer with the crc unit.
+  * @param  pdata: word buffer
+  * @param  words: number of words
+  * @retval crc value
+  */
+static uint32_t ab_crc_calculate(const uint32_t *pdata, uint32_t words)
+{
+  crm_periph_clock_enable(CRM_CRC_PERIPH_CLOCK, TRUE);
+  crc_data_reset();
+  return crc_block_calculate((uint32_t *)pdata, words);
+}
+
+/**
+  * @brief  check a metadata record.
+  * @param  pmeta: record in flash
+  * @retval TRUE when the record is complete and valid
+  */
+static confirm_state ab_meta_valid(const ab_meta_type *pmeta)
+{
+  if(pmeta->magic != AB_META_MAGIC || pmeta->slot > AB_SLOT_B)
+  {
+    return FALSE;
+  }
+  if(ab_crc_calculate((const uint32_t *)pmeta, AB_META_WORDS - 1) != pmeta->record_crc)
+  {
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/**
+  * @brief  check a metadata record is still erased.
+  * @param  pmeta: record in flash
+  * @retval TRUE when every word reads 0xFFFFFFFF
+  */
+static confirm_state ab_meta_blank(const ab_meta_type *pmeta)
+{
+  const uint32_t *pword = (const uint32_t *)pmeta;
+  uint32_t i_index;
+
+  for(i_index = 0; i_index < AB_META_WORDS; i_index ++)
+  {
+    if(pword[i_index] != 0xFFFFFFFF)
+    {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/**
+  * @brief  unlock the bank holding an address.
+  * @note   each bank is locked on its own so a background erase in one bank is
+  *         not disturbed by programming the other.
+  * @param  address: flash address
+  * @retval none
+  */
+static void ab_bank_unlock(uint32_t address)
+{
+  if(address <= FLASH_BANK1_END_ADDR)
+  {
+    flash_bank1_unlock();
+  }
+  else
+  {
+    flash_bank2_unlock();
+  }
+}
+
+/**
+  * @brief  lock the bank holding an address.
+  * @param  address: flash address
+  * @retval none
+  */
+static void ab_bank_lock(uint32_t address)
+{
+  if(address <= FLASH_BANK1_END_ADDR)
+  {
+    flash_bank1_lock();
+  }
+  else
+  {
+    flash_bank2_lock();
+  }
+}
+
+/**
+  * @brief  start a sector erase without waiting for it.
+  * @note   the cpu keeps running from the other bank while the sector is erased,
+  *         completion is collected by ab_erase_wait.
+  * @param  address: sector address
+  * @retval none
+  */
+static void ab_erase_start(uint32_t address)
+{
+  ab_bank_unlock(address);
+  if(address <= FLASH_BANK1_END_ADDR)
+  {
+    FLASH->ctrl_bit.secers = TRUE;
+    FLASH->addr = address;
+    FLASH->ctrl_bit.erstr = TRUE;
+  }
+  else
+  {
+    FLASH->ctrl2_bit.secers = TRUE;
+    FLASH->addr2 = address;
+    FLASH->ctrl2_bit.erstr = TRUE;
+  }
+}
+
+/**
+  * @brief  wait for the sector erase started by ab_erase_start.
+  * @param  address: sector address
+  * @param  time_out: count handed to the bank wait function
+  * @retval FLASH_OPERATE_TIMEOUT while the erase is still running
+  */
+static flash_status_type ab_erase_wait(uint32_t address, uint32_t time_out)
+{
+  flash_status_type status;
+
+  if(address <= FLASH_BANK1_END_ADDR)
+  {
+    status = flash_bank1_operation_wait_for(time_out);
+    if(status != FLASH_OPERATE_TIMEOUT)
+    {
+      FLASH->ctrl_bit.secers = FALSE;
+    }
+  }
+  else
+  {
+    status = flash_bank2_operation_wait_for(time_out);
+    if(status != FLASH_OPERATE_TIMEOUT)
+    {
+      FLASH->ctrl2_bit.secers = FALSE;
+    }
+  }
+  if(status != FLASH_OPERATE_TIMEOUT)
+  {
+    ab_bank_lock(address);
+  }
+  return status;
+}
+
+/**
+  * @brief  collect the running sector erase.
+  * @param  time_out: count handed to the bank wait function
+  * @retval AB_BUSY while the sector is still being erased
+  */
+static ab_status_type ab_erase_collect(uint32_t time_out)
+{
+  flash_status_type status = ab_erase_wait(ab_update.erase_address, time_out);
+
+  if(status == FLASH_OPERATE_TIMEOUT)
+  {
+    return AB_BUSY;
+  }
+  if(status != FLASH_OPERATE_DONE)
+  {
+    ab_update.state = AB_STATE_ERROR;
+    return AB_ERR_ERASE;
+  }
+
+  ab_update.erase_address += AB_SECTOR_SIZE;
+  if(ab_update.erase_address >= ab_update.erase_end_address)
+  {
+    ab_update.state = AB_STATE_WRITING;
+  }
+  return AB_OK;
+}
+
+/**
+  * @brief  program words and read them back.
+  * @param  address: flash address
+  * @param  pdata: word buffer
+  * @param  words: number of words
+  * @retval TRUE when every word reads back correctly
+  */
+static confirm_state ab_word_program(uint32_t address, const uint32_t *pdata, uint32_t words)
+{
+  confirm_state result = TRUE;
+  uint32_t i_index;
+
+  ab_bank_unlock(address);
+  for(i_index = 0; i_index < words; i_index ++)
+  {
+    /* erased words need no programming */
+    if(pdata[i_index] != 0xFFFFFFFF)
+    {
+      flash_word_program(address, pdata[i_index]);
+    }
+    if(*(uint32_t *)address != pdata[i_index])
+    {
+      result = FALSE;
+      break;
+    }
+    address += sizeof(uint32_t);
+  }
+  ab_bank_lock(address - sizeof(uint32_t));
+  return result;
+}
+
+/**
+  * @brief  append a metadata record.
+  * @note   the record crc is programmed last, a reset in between leaves the previous
+  *         record in charge. a full sector moves the log to the other sector.
+  * @param  pmeta: record to write, record_crc is filled in
+  * @retval operation status
+  */
+static ab_status_type ab_meta_write(ab_meta_type *pmeta)
+{
+  uint32_t address = ab_update.meta_next;
+  flash_status_type status;
+
+  pmeta->record_crc = ab_crc_calculate((const uint32_t *)pmeta, AB_META_WORDS - 1);
+
+  if(address >= AB_META_END_ADDR)
+  {
+    address = AB_META_ADDR;
+  }
+  if((address - AB_META_ADDR) % AB_SECTOR_SIZE == 0)
+  {
+    /* start of a sector, erase it first */
+    ab_bank_unlock(address);
+    status = flash_sector_erase(address);
+    ab_bank_lock(address);
+    if(status != FLASH_OPERATE_DONE)
+    {
+      return AB_ERR_ERASE;
+    }
+  }
+
+  if(ab_word_program(address, (const uint32_t *)pmeta, AB_META_WORDS) != TRUE)
+  {
+    return AB_ERR_PROGRAM;
+  }
+
+  ab_update.meta_next = address + sizeof(ab_meta_type);
+  return AB_OK;
+}
+
+/**
+  * @brief  check the image held by a slot.
+  * @note   a slot without a metadata record, such as a factory image, is only
+  *         checked for its vector table.
+  * @param  address: slot address
+  * @param  image_length: image length from the metadata, 0 without a record
+  * @param  image_crc: image crc from the metadata
+  * @retval TRUE when the slot can be started
+  */
+static confirm_state ab_slot_valid(uint32_t address, uint32_t image_length, uint32_t image_crc)
+{
+  if(((*(uint32_t *)address) & 0xF0000000) != 0x20000000 ||
+     ((*(uint32_t *)(address + 4)) & 0xFF000000) != 0x08000000)
+  {
+    return FALSE;
+  }
+  if(image_length != 0 &&
+     (image_length > ab_update.slot_size ||
+      ab_crc_calculate((const uint32_t *)address, (image_length + 3) / sizeof(uint32_t)) != image_crc))
+  {
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/**
+  * @brief  read the metadata and select the active slot.
+  * @param  none
+  * @retval AB_ERR_NO_BANK2 on single bank devices
+  */
+ab_status_type ab_update_init(void)
+{
+  const ab_meta_type *pmeta, *platest = 0, *pslot[2] = {0, 0};
+  uint32_t flash_size = AB_FLASH_SIZE_REG() << 10;
+  uint32_t bank2_size;
+
+  ab_update.state = AB_STATE_IDLE;
+  ab_update.active_slot = AB_SLOT_A;
+  ab_update.sequence = 0;
+  ab_update.image_length = 0;
+  ab_update.image_crc = 0;
+  ab_update.other_image_length = 0;
+  ab_update.other_image_crc = 0;
+  ab_update.meta_next = AB_META_ADDR;
+
+  if(flash_size <= (FLASH_BANK1_END_ADDR + 1 - FLASH_BANK1_START_ADDR))
+  {
+    ab_update.slot_size = 0;
+    return AB_ERR_NO_BANK2;
+  }
+  bank2_size = flash_size - (FLASH_BANK1_END_ADDR + 1 - FLASH_BANK1_START_ADDR);
+  ab_update.slot_size = (bank2_size < AB_SLOT_SIZE) ? bank2_size : AB_SLOT_SIZE;
+
+  /* the valid record with the highest sequence wins, the latest record of the
+     other slot is kept for the fallback */
+  for(pmeta = (const ab_meta_type *)AB_META_ADDR; (uint32_t)pmeta < AB_META_END_ADDR; pmeta ++)
+  {
+    if(ab_meta_valid(pmeta) != TRUE)
+    {
+      continue;
+    }
+    if(pslot[pmeta->slot] == 0 || (int32_t)(pmeta->sequence - pslot[pmeta->slot]->sequence) > 0)
+    {
+      pslot[pmeta->slot] = pmeta;
+    }
+    if(platest == 0 || (int32_t)(pmeta->sequence - platest->sequence) > 0)
+    {
+      platest = pmeta;
+    }
+  }
+
+  if(platest != 0)
+  {
+    ab_update.active_slot = (ab_slot_type)platest->slot;
+    ab_update.sequence = platest->sequence;
+    ab_update.image_length = platest->image_length;
+    ab_update.image_crc = platest->image_crc;
+    if(pslot[platest->slot ^ 1] != 0)
+    {
+      ab_update.other_image_length = pslot[platest->slot ^ 1]->image_length;
+      ab_update.other_image_crc = pslot[platest->slot ^ 1]->image_crc;
+    }
+
+    /* skip records torn by a reset, they are never reused */
+    pmeta = platest + 1;
+    while((uint32_t)pmeta % AB_SECTOR_SIZE != AB_META_ADDR % AB_SECTOR_SIZE &&
+          ab_meta_blank(pmeta) != TRUE)
+    {
+      pmeta ++;
+    }
+    ab_update.meta_next = (uint32_t)pmeta;
+  }
+
+  return AB_OK;
+}
+
+/**
+  * @brief  start address of a slot.
+  * @param  slot: AB_SLOT_A or AB_SLOT_B
+  * @retval slot address
+  */
+uint32_t ab_update_slot_address(ab_slot_type slot)
+{
+  return (slot == AB_SLOT_A) ? AB_SLOT_A_ADDR : AB_SLOT_B_ADDR;
+}
+
+/**
+  * @brief  slot selected by the metadata.
+  * @param  none
+  * @retval AB_SLOT_A or AB_SLOT_B
+  */
+ab_slot_type ab_update_active_slot_get(void)
+{
+  return ab_update.active_slot;
+}
+
+/**
+  * @brief  address the bootloader should jump to.
+  * @note   the active slot must match the crc of its metadata record, otherwise
+  *         the other slot is checked against its own latest record.
+  * @param  none
+  * @retval slot address, 0 when neither slot holds a valid image
+  */
+uint32_t ab_update_boot_address_get(void)
+{
+  uint32_t address = ab_update_slot_address(ab_update.active_slot);
+
+  if(ab_slot_valid(address, ab_update.image_length, ab_update.image_crc) == TRUE)
+  {
+    return address;
+  }
+  address = ab_update_slot_address((ab_slot_type)(ab_update.active_slot ^ 1));
+  if(ab_slot_valid(address, ab_update.other_image_length, ab_update.other_image_crc) == TRUE)
+  {
+    return address;
+  }
+  return 0;
+}
+
+/**
+  * @brief  prepare the inactive slot for a new image.
+  * @note   starts the background erase, the application keeps running and calls
+  *         ab_update_poll from its main loop. the length is rounded up to a
+  *         word, the last word of the image is written padded.
+  * @param  image_length: image length in byte
+  * @retval operation status
+  */
+ab_status_type ab_update_begin(uint32_t image_length)
+{
+  uint32_t address;
+
+  if(ab_update.slot_size == 0 || ab_update.state == AB_STATE_ERASING)
+  {
+    return AB_ERR_STATE;
+  }
+  if(image_length == 0 || image_length > ab_update.slot_size)
+  {
+    return AB_ERR_PARAM;
+  }
+
+  address = ab_update_slot_address((ab_slot_type)(ab_update.active_slot ^ 1));
+  ab_update.write_length = (image_length + 3) & ~0x3;
+  ab_update.erase_address = address;
+  ab_update.erase_end_address = address + ((image_length + AB_SECTOR_SIZE - 1) & ~(AB_SECTOR_SIZE - 1));
+  ab_update.state = AB_STATE_ERASING;
+
+  ab_erase_start(ab_update.erase_address);
+  return AB_OK;
+}
+
+/**
+  * @brief  advance the background erase.
+  * @param  none
+  * @retval AB_BUSY while erasing, AB_OK when the inactive slot is ready
+  */
+ab_status_type ab_update_poll(void)
+{
+  ab_status_type status;
+
+  switch(ab_update.state)
+  {
+    case AB_STATE_ERASING:
+      status = ab_erase_collect(AB_POLL_TIMEOUT);
+      if(status == AB_OK && ab_update.state == AB_STATE_ERASING)
+      {
+        ab_erase_start(ab_update.erase_address);
+        return AB_BUSY;
+      }
+      return status;
+    case AB_STATE_ERROR:
+      return AB_ERR_ERASE;
+    default:
+      return AB_OK;
+  }
+}
+
+/**
+  * @brief  write image data into the inactive slot.
+  * @note   data may be written as soon as its sectors are erased, an erase
+  *         running in the same bank is completed first.
+  * @param  offset: offset in the image, word aligned
+  * @param  pdata: image data
+  * @param  length: length in byte, multiple of 4, the last word of the image padded
+  * @retval AB_BUSY when the target sectors are not erased yet
+  */
+ab_status_type ab_update_write(uint32_t offset, const uint32_t *pdata, uint32_t length)
+{
+  ab_status_type status;
+  uint32_t address = ab_update_slot_address((ab_slot_type)(ab_update.active_slot ^ 1)) + offset;
+
+  if(ab_update.state != AB_STATE_ERASING && ab_update.state != AB_STATE_WRITING)
+  {
+    return AB_ERR_STATE;
+  }
+  if((offset | length) & 0x3 || offset + length > ab_update.write_length)
+  {
+    return AB_ERR_PARAM;
+  }
+
+  if(ab_update.state == AB_STATE_ERASING)
+  {
+    if(address + length > ab_update.erase_address)
+    {
+      return AB_BUSY;
+    }
+    /* the bank can not program while it erases, finish the running sector first */
+    status = ab_erase_collect(ERASE_TIMEOUT);
+    if(status != AB_OK)
+    {
+      return status;
+    }
+    if(ab_word_program(address, pdata, length / sizeof(uint32_t)) != TRUE)
+    {
+      ab_update.state = AB_STATE_ERROR;
+      return AB_ERR_PROGRAM;
+    }
+    if(ab_update.state == AB_STATE_ERASING)
+    {
+      ab_erase_start(ab_update.erase_address);
+    }
+    return AB_OK;
+  }
+
+  if(ab_word_program(address, pdata, length / sizeof(uint32_t)) != TRUE)
+  {
+    ab_update.state = AB_STATE_ERROR;
+    return AB_ERR_PROGRAM;
+  }
+  return AB_OK;
+}
+
+/**
+  * @brief  verify the new image and switch to it.
+  * @note   the switch is a single metadata record, the new slot runs after the next reset.
+  * @param  image_crc: crc of the image, crc unit algorithm over the image words
+  * @retval operation status
+  */
+ab_status_type ab_update_finish(uint32_t image_crc)
+{
+  ab_meta_type meta;
+  ab_status_type status;
+  ab_slot_type slot = (ab_slot_type)(ab_update.active_slot ^ 1);
+  uint32_t words = ab_update.write_length / sizeof(uint32_t);
+
+  while((status = ab_update_poll()) == AB_BUSY);
+  if(status != AB_OK || ab_update.state != AB_STATE_WRITING)
+  {
+    return (status != AB_OK) ? status : AB_ERR_STATE;
+  }
+
+  if(ab_crc_calculate((const uint32_t *)ab_update_slot_address(slot), words) != image_crc)
+  {
+    ab_update.state = AB_STATE_ERROR;
+    return AB_ERR_VERIFY;
+  }
+
+  meta.magic = AB_META_MAGIC;
+  meta.sequence = ab_update.sequence + 1;
+  meta.slot = slot;
+  meta.image_length = ab_update.write_length;
+  meta.image_crc = image_crc;
+  meta.reserved[0] = 0xFFFFFFFF;
+  meta.reserved[1] = 0xFFFFFFFF;
+
+  status = ab_meta_write(&meta);
+  if(status != AB_OK)
+  {
+    ab_update.state = AB_STATE_ERROR;
+    return status;
+  }
+
+  /* the slot left keeps its record as the fallback */
+  ab_update.other_image_length = ab_update.image_length;
+  ab_update.other_image_crc = ab_update.image_crc;
+  ab_update.active_slot = slot;
+  ab_update.sequence = meta.sequence;
+  ab_update.image_length = meta.image_length;
+  ab_update.image_crc = image_crc;
+  ab_update.state = AB_STATE_IDLE;
+  return AB_OK;
+}
+
+/**
+  * @brief  abandon the update, the active slot is left untouched.
+  * @param  none
+  * @retval none
+  */
+void ab_update_abort(void)
+{
+  if(ab_update.state == AB_STATE_ERASING)
+  {
+    ab_erase_wait(ab_update.erase_address, ERASE_TIMEOUT);
+  }
+  ab_update.state = AB_STATE_IDLE;
+}
+
+/**
+  * @}
+  */
@@ -0,0 +1,180 @@
+/**
+  **************************************************************************
+  * @file     ab_update.h
+  * @brief    a/b dual-bank firmware update library header file
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+/*!< define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AB_UPDATE_H
+#define __AB_UPDATE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* includes ------------------------------------------------------------------*/
+#include "at32f403a_407.h"
+
+/** @addtogroup AT32F403A_407_middlewares_ab_update_library
+  * @{
+  */
+
+/** @defgroup AB_update_layout
+  * @brief    flash layout, every value can be overridden before including this file.
+  *           slot a follows the bootloader and the metadata in bank1, slot b starts
+  *           bank2. an application is linked for the slot it runs from, the running
+  *           application downloads into the other slot while the cpu keeps fetching
+  *           from its own bank.
+  * @{
+  */
+
+#ifndef AB_BOOT_SIZE
+#define AB_BOOT_SIZE                     0x4000     /*!< bootloader size */
+#endif
+
+#define AB_SECTOR_SIZE                   0x800      /*!< dual-bank devices have 2kb sectors */
+
+#ifndef AB_META_ADDR
+#define AB_META_ADDR                     (FLASH_BANK1_START_ADDR + AB_BOOT_SIZE)
+#endif
+
+#define AB_META_SECTOR_NUM               2          /*!< metadata ping-pong sectors */
+
+#ifndef AB_SLOT_A_ADDR
+#define AB_SLOT_A_ADDR                   (AB_META_ADDR + AB_META_SECTOR_NUM * AB_SECTOR_SIZE)
+#endif
+
+#ifndef AB_SLOT_B_ADDR
+#define AB_SLOT_B_ADDR                   FLASH_BANK2_START_ADDR
+#endif
+
+#ifndef AB_SLOT_SIZE
+#define AB_SLOT_SIZE                     (FLASH_BANK1_END_ADDR + 1 - AB_SLOT_A_ADDR)
+#endif
+
+#define AB_META_MAGIC                    0x41424D44 /*!< "ABMD" */
+
+/**
+  * @}
+  */
+
+/** @defgroup AB_update_status_code
+  * @{
+  */
+
+typedef enum
+{
+  AB_OK = 0,           /*!< no error */
+  AB_BUSY,             /*!< background erase still running */
+  AB_ERR_NO_BANK2,     /*!< device has a single flash bank */
+  AB_ERR_PARAM,        /*!< length, offset or alignment out of range */
+  AB_ERR_STATE,        /*!< call not allowed in the current state */
+  AB_ERR_ERASE,        /*!< sector erase failed */
+  AB_ERR_PROGRAM,      /*!< word program or readback failed */
+  AB_ERR_VERIFY,       /*!< image crc does not match */
+} ab_status_type;
+
+/**
+  * @}
+  */
+
+/** @defgroup AB_update_types
+  * @{
+  */
+
+typedef enum
+{
+  AB_SLOT_A = 0,
+  AB_SLOT_B = 1,
+} ab_slot_type;
+
+typedef enum
+{
+  AB_STATE_IDLE = 0,
+  AB_STATE_ERASING,
+  AB_STATE_WRITING,
+  AB_STATE_ERROR,
+} ab_state_type;
+
+/**
+  * @brief metadata record, a record is valid once its last word (record_crc) is programmed
+  */
+typedef struct
+{
+  uint32_t magic;
+  uint32_t sequence;                     /*!< incremented by every slot switch, highest valid record wins */
+  uint32_t slot;                         /*!< active slot */
+  uint32_t image_length;
+  uint32_t image_crc;
+  uint32_t reserved[2];
+  uint32_t record_crc;                   /*!< crc of the words above */
+} ab_meta_type;
+
+typedef struct
+{
+  ab_slot_type active_slot;              /*!< slot selected by the latest metadata record */
+  uint32_t sequence;
+  uint32_t image_length;                 /*!< image length of the active slot */
+  uint32_t image_crc;
+  uint32_t other_image_length;           /*!< image length of the other slot, 0 without a record */
+  uint32_t other_image_crc;
+  uint32_t meta_next;                    /*!< address of the next free metadata record */
+  uint32_t slot_size;
+
+  __IO ab_state_type state;
+  uint32_t erase_address;                /*!< inactive slot is erased up to here */
+  uint32_t erase_end_address;
+  uint32_t write_length;                 /*!< length announced by ab_update_begin, rounded up to a word */
+} ab_update_type;
+
+/**
+  * @}
+  */
+
+/** @defgroup AB_update_exported_functions
+  * @{
+  */
+
+extern ab_update_type ab_update;
+
+ab_status_type ab_update_init(void);
+uint32_t       ab_update_slot_address(ab_slot_type slot);
+ab_slot_type   ab_update_active_slot_get(void);
+uint32_t       ab_update_boot_address_get(void);
+ab_status_type ab_update_begin(uint32_t image_length);
+ab_status_type ab_update_poll(void);
+ab_status_type ab_update_write(uint32_t offset, const uint32_t *pdata, uint32_t length);
+ab_status_type ab_update_finish(uint32_t image_crc);
+void           ab_update_abort(void);
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
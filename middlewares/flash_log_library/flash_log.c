@@ -0,0 +1,578 @@
+/**
+  **************************************************************************
+  * @file     flash_log.c
+  * @brief    power-fail-safe circular log on flash
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+
+#include "flash_log.h"
+
+/** @addtogroup AT32F403A_407_middlewares_flash_log_library
+  * @{
+  */
+
+/**
+  * @brief crc16 ccitt nibble table, polynomial 0x1021
+  */
+static const uint16_t flash_log_crc_table[16] =
+{
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+/**
+  * @brief  crc16 ccitt of a page payload.
+  * @param  pdata: data buffer
+  * @param  len: data length
+  * @retval crc value
+  */
+static uint16_t flash_log_crc16(const uint8_t *pdata, uint32_t len)
+{
+  uint16_t crc = 0xFFFF;
+
+  while(len --)
+  {
+    crc = (crc << 4) ^ flash_log_crc_table[(crc >> 12) ^ (*pdata >> 4)];
+    crc = (crc << 4) ^ flash_log_crc_table[(crc >> 12) ^ (*pdata & 0x0F)];
+    pdata ++;
+  }
+  return crc;
+}
+
+/**
+  * @brief  flash address of a page.
+  * @param  log: log
+  * @param  sector: sector number
+  * @param  page: page in the sector
+  * @retval address
+  */
+static uint32_t flash_log_page_addr(flash_log_type *log, uint32_t sector, uint32_t page)
+{
+  return log->backend->address + sector * log->backend->sector_size + page * log->backend->page_size;
+}
+
+/**
+  * @brief  check the header of a sector.
+  * @param  log: log
+  * @param  sector: sector number
+  * @param  sequence: sequence of a valid sector
+  * @retval 1 when the sector holds a valid header
+  */
+static int flash_log_sector_valid(flash_log_type *log, uint32_t sector, uint32_t *sequence)
+{
+  uint32_t header[FLASH_LOG_SECTOR_HEADER_SIZE / 4];
+
+  if(log->backend->read(flash_log_page_addr(log, sector, 0), (uint8_t *)header, sizeof(header)) != 0 ||
+     header[0] != FLASH_LOG_SECTOR_MAGIC || header[2] != ~header[1])
+  {
+    return 0;
+  }
+  *sequence = header[1];
+  return 1;
+}
+
+/**
+  * @brief  check whether a page was programmed.
+  * @param  log: log
+  * @param  sector: sector number
+  * @param  page: page in the sector
+  * @retval 1 when the page header is not erased
+  */
+static int flash_log_page_used(flash_log_type *log, uint32_t sector, uint32_t page)
+{
+  uint32_t header = 0;
+
+  log->backend->read(flash_log_page_addr(log, sector, page) + (page ? 0 : FLASH_LOG_SECTOR_HEADER_SIZE),
+                     (uint8_t *)&header, 4);
+  return header != 0xFFFFFFFF;
+}
+
+/**
+  * @brief  check whether a sector is erased.
+  * @param  log: log
+  * @param  sector: sector number
+  * @retval 1 when every byte reads 0xff
+  */
+static int flash_log_sector_blank(flash_log_type *log, uint32_t sector)
+{
+  uint32_t buffer[16], address = flash_log_page_addr(log, sector, 0), i, j;
+
+  for(i = 0; i < log->backend->sector_size; i += sizeof(buffer))
+  {
+    if(log->backend->read(address + i, (uint8_t *)buffer, sizeof(buffer)) != 0)
+    {
+      return 0;
+    }
+    for(j = 0; j < 16; j ++)
+    {
+      if(buffer[j] != 0xFFFFFFFF)
+      {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+/**
+  * @brief  erase a sector, the tail moves on when it is dropped.
+  * @param  log: log
+  * @param  sector: sector number
+  * @retval status
+  */
+static flash_log_status_type flash_log_erase(flash_log_type *log, uint32_t sector)
+{
+  log->erases ++;
+  if(log->tail_sector == sector)
+  {
+    log->tail_sector = (sector + 1) % log->backend->sector_num;
+  }
+  if(log->backend->erase(flash_log_page_addr(log, sector, 0)) != 0)
+  {
+    return FLASH_LOG_ERR_FLASH;
+  }
+  return FLASH_LOG_OK;
+}
+
+/**
+  * @brief  find the head, the tail and the write page.
+  * @note   from sector 0 on, the sequence grows by one per sector up to the
+  *         head, the sectors behind it are erased or older. when sector 0 is
+  *         the one erased ahead, the head is the last sector.
+  * @param  log: log
+  * @retval status
+  */
+static flash_log_status_type flash_log_mount(flash_log_type *log)
+{
+  uint32_t num = log->backend->sector_num, low, high, mid, first, sequence;
+  uint8_t valid0;
+
+  log->page_len = 0;
+  log->erased_sector = FLASH_LOG_NONE;
+  log->erase_pending = FLASH_LOG_NONE;
+  log->head_page = 0;
+  log->head_entered = 0;
+
+  valid0 = flash_log_sector_valid(log, 0, &first);
+  if(valid0)
+  {
+    low = 0;
+    high = num - 1;
+    while(low < high)
+    {
+      mid = (low + high + 1) / 2;
+      if(flash_log_sector_valid(log, mid, &sequence) && sequence == first + mid)
+      {
+        low = mid;
+      }
+      else
+      {
+        high = mid - 1;
+      }
+    }
+    log->head_sector = low;
+    log->sequence = first + low;
+  }
+  else if(flash_log_sector_valid(log, num - 1, &sequence))
+  {
+    log->head_sector = num - 1;
+    log->sequence = sequence;
+  }
+  else
+  {
+    /* empty log */
+    log->head_sector = 0;
+    log->tail_sector = FLASH_LOG_NONE;
+    log->sequence = 0;
+    if(flash_log_sector_blank(log, 0))
+    {
+      log->erased_sector = 0;
+    }
+    else
+    {
+      log->erase_pending = 0;
+    }
+    return FLASH_LOG_OK;
+  }
+  log->head_entered = 1;
+
+  /* the oldest sector follows the head, or the one erased ahead of it */
+  if(flash_log_sector_valid(log, (log->head_sector + 1) % num, &sequence))
+  {
+    log->tail_sector = (log->head_sector + 1) % num;
+  }
+  else if(flash_log_sector_valid(log, (log->head_sector + 2) % num, &sequence))
+  {
+    log->tail_sector = (log->head_sector + 2) % num;
+  }
+  else
+  {
+    log->tail_sector = valid0 ? 0 : log->head_sector;
+  }
+
+  /* first erased page of the head sector */
+  low = 1;
+  high = log->page_num;
+  while(low < high)
+  {
+    mid = (low + high) / 2;
+    if(flash_log_page_used(log, log->head_sector, mid))
+    {
+      low = mid + 1;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+  log->head_page = low;
+  mid = (log->head_sector + 1) % num;
+  if(low == log->page_num)
+  {
+    log->head_sector = mid;
+    log->head_page = 0;
+    log->head_entered = 0;
+  }
+
+  /* the next sector to enter is erased ahead unless it already is */
+  if(flash_log_sector_blank(log, mid))
+  {
+    log->erased_sector = mid;
+  }
+  else
+  {
+    log->erase_pending = mid;
+  }
+  return FLASH_LOG_OK;
+}
+
+/**
+  * @brief  start programming the head sector.
+  * @param  log: log
+  * @retval status
+  */
+static flash_log_status_type flash_log_enter(flash_log_type *log)
+{
+  uint32_t sector = log->head_sector;
+
+  if(log->erase_pending == sector)
+  {
+    log->erase_pending = FLASH_LOG_NONE;
+  }
+  if(log->erased_sector != sector)
+  {
+    /* flash_log_idle did not run since the previous sector was entered */
+    log->stall_erases ++;
+    if(flash_log_erase(log, sector) != FLASH_LOG_OK)
+    {
+      return FLASH_LOG_ERR_FLASH;
+    }
+  }
+  if(log->tail_sector == FLASH_LOG_NONE)
+  {
+    log->tail_sector = sector;
+  }
+  log->erased_sector = FLASH_LOG_NONE;
+  log->sequence ++;
+  log->head_entered = 1;
+  log->erase_pending = (sector + 1) % log->backend->sector_num;
+  return FLASH_LOG_OK;
+}
+
+/**
+  * @brief  initialize the log and find its head and tail.
+  * @param  log: log
+  * @param  backend: flash region and access functions
+  * @retval status
+  */
+flash_log_status_type flash_log_init(flash_log_type *log, const flash_log_backend_type *backend)
+{
+  log->backend = backend;
+  log->records = 0;
+  log->pages = 0;
+  log->erases = 0;
+  log->stall_erases = 0;
+
+  if(backend->read == 0 || backend->erase == 0 || backend->program == 0 ||
+     backend->sector_num < 3 || backend->page_size > FLASH_LOG_PAGE_MAX || (backend->page_size & 3) ||
+     backend->page_size <= FLASH_LOG_SECTOR_HEADER_SIZE + FLASH_LOG_PAGE_HEADER_SIZE + FLASH_LOG_RECORD_HEADER_SIZE ||
+     backend->sector_size % backend->page_size)
+  {
+    return FLASH_LOG_ERR_PARAM;
+  }
+  log->page_num = backend->sector_size / backend->page_size;
+  return flash_log_mount(log);
+}
+
+/**
+  * @brief  erase the whole log, staged records are dropped.
+  * @param  log: log
+  * @retval status
+  */
+flash_log_status_type flash_log_format(flash_log_type *log)
+{
+  uint32_t i;
+
+  for(i = 0; i < log->backend->sector_num; i ++)
+  {
+    if(flash_log_erase(log, i) != FLASH_LOG_OK)
+    {
+      return FLASH_LOG_ERR_FLASH;
+    }
+  }
+  return flash_log_mount(log);
+}
+
+/**
+  * @brief  stage a record, the page is programmed once it is full.
+  * @param  log: log
+  * @param  pdata: record
+  * @param  length: record length, FLASH_LOG_RECORD_MAX(page_size) at most
+  * @retval status
+  */
+flash_log_status_type flash_log_write(flash_log_type *log, const void *pdata, uint32_t length)
+{
+  uint8_t *pbuf = (uint8_t *)log->page_buf;
+  uint32_t i;
+
+  if(length > FLASH_LOG_RECORD_MAX(log->backend->page_size))
+  {
+    return FLASH_LOG_ERR_PARAM;
+  }
+  if(log->page_len + FLASH_LOG_RECORD_HEADER_SIZE + length > log->backend->page_size &&
+     flash_log_flush(log) != FLASH_LOG_OK)
+  {
+    return FLASH_LOG_ERR_FLASH;
+  }
+  if(log->page_len == 0)
+  {
+    log->page_len = (log->head_page ? 0 : FLASH_LOG_SECTOR_HEADER_SIZE) + FLASH_LOG_PAGE_HEADER_SIZE;
+  }
+
+  pbuf += log->page_len;
+  pbuf[0] = (uint8_t)length;
+  pbuf[1] = (uint8_t)(length >> 8);
+  for(i = 0; i < length; i ++)
+  {
+    pbuf[FLASH_LOG_RECORD_HEADER_SIZE + i] = ((const uint8_t *)pdata)[i];
+  }
+  log->page_len += FLASH_LOG_RECORD_HEADER_SIZE + length;
+  log->records ++;
+  return FLASH_LOG_OK;
+}
+
+/**
+  * @brief  program the staged page, the next record starts a new page.
+  * @note   the headers lead the page, so a page cut by a power loss is never
+  *         taken for an erased one.
+  * @param  log: log
+  * @retval status
+  */
+flash_log_status_type flash_log_flush(flash_log_type *log)
+{
+  uint8_t *pbuf = (uint8_t *)log->page_buf;
+  uint32_t header = log->head_page ? 0 : FLASH_LOG_SECTOR_HEADER_SIZE, payload, length;
+  flash_log_status_type status = FLASH_LOG_OK;
+
+  if(log->page_len == 0)
+  {
+    return FLASH_LOG_OK;
+  }
+  if(log->head_entered == 0 && flash_log_enter(log) != FLASH_LOG_OK)
+  {
+    status = FLASH_LOG_ERR_FLASH;
+  }
+  else
+  {
+    if(header)
+    {
+      log->page_buf[0] = FLASH_LOG_SECTOR_MAGIC;
+      log->page_buf[1] = log->sequence;
+      log->page_buf[2] = ~log->sequence;
+      log->page_buf[3] = 0xFFFFFFFF;
+    }
+    payload = log->page_len - header - FLASH_LOG_PAGE_HEADER_SIZE;
+    log->page_buf[header / 4] = payload | ((uint32_t)flash_log_crc16(pbuf + header + FLASH_LOG_PAGE_HEADER_SIZE, payload) << 16);
+
+    /* word programming backends need whole words */
+    length = (log->page_len + 3) & ~3u;
+    while(log->page_len < length)
+    {
+      pbuf[log->page_len ++] = 0xFF;
+    }
+    if(log->backend->program(flash_log_page_addr(log, log->head_sector, log->head_page), pbuf, length) != 0)
+    {
+      status = FLASH_LOG_ERR_FLASH;
+    }
+    log->pages ++;
+  }
+
+  /* a failed page is not retried, the records of a staged page are dropped */
+  log->page_len = 0;
+  if(++ log->head_page == log->page_num)
+  {
+    log->head_sector = (log->head_sector + 1) % log->backend->sector_num;
+    log->head_page = 0;
+    log->head_entered = 0;
+  }
+  return status;
+}
+
+/**
+  * @brief  erase the sector after the head ahead of its use, call it when the
+  *         system is idle.
+  * @param  log: log
+  * @retval status
+  */
+flash_log_status_type flash_log_idle(flash_log_type *log)
+{
+  uint32_t sector = log->erase_pending;
+
+  if(sector == FLASH_LOG_NONE)
+  {
+    return FLASH_LOG_OK;
+  }
+  log->erase_pending = FLASH_LOG_NONE;
+  if(flash_log_erase(log, sector) != FLASH_LOG_OK)
+  {
+    return FLASH_LOG_ERR_FLASH;
+  }
+  log->erased_sector = sector;
+  return FLASH_LOG_OK;
+}
+
+/**
+  * @brief  place a cursor on the oldest record.
+  * @param  log: log
+  * @param  cursor: read-out cursor
+  * @retval none
+  */
+void flash_log_read_start(flash_log_type *log, flash_log_cursor_type *cursor)
+{
+  cursor->page = 0;
+  cursor->offset = 0;
+  cursor->length = 0;
+  cursor->lost = 0;
+  if(log->tail_sector == FLASH_LOG_NONE ||
+     flash_log_sector_valid(log, log->tail_sector, &cursor->sequence) == 0)
+  {
+    /* empty log, wait for the first sector */
+    cursor->sector = log->head_sector;
+    cursor->sequence = log->sequence + 1;
+  }
+  else
+  {
+    cursor->sector = log->tail_sector;
+  }
+}
+
+/**
+  * @brief  read the next record, records still staged in ram are not seen.
+  * @note   when the writer overwrote the sector of the cursor, the cursor goes
+  *         on from the tail and lost counts the pages that were skipped.
+  * @param  log: log
+  * @param  cursor: read-out cursor
+  * @param  pbuffer: record buffer
+  * @param  size: buffer size, a longer record is cut
+  * @param  length: record length
+  * @retval FLASH_LOG_EMPTY once the cursor reached the head
+  */
+flash_log_status_type flash_log_read(flash_log_type *log, flash_log_cursor_type *cursor,
+                                     void *pbuffer, uint32_t size, uint32_t *length)
+{
+  uint32_t sequence, header, word, record, i;
+
+  while(1)
+  {
+    if(cursor->offset + FLASH_LOG_RECORD_HEADER_SIZE <= cursor->length)
+    {
+      record = cursor->page_buf[cursor->offset] | (cursor->page_buf[cursor->offset + 1] << 8);
+      cursor->offset += FLASH_LOG_RECORD_HEADER_SIZE;
+      if(cursor->offset + record > cursor->length)
+      {
+        cursor->offset = cursor->length;
+        cursor->lost ++;
+        continue;
+      }
+      for(i = 0; i < record && i < size; i ++)
+      {
+        ((uint8_t *)pbuffer)[i] = cursor->page_buf[cursor->offset + i];
+      }
+      cursor->offset += record;
+      *length = record;
+      return FLASH_LOG_OK;
+    }
+
+    if(cursor->sector == log->head_sector && cursor->page >= log->head_page &&
+       cursor->sequence == log->sequence + (log->head_entered ? 0 : 1))
+    {
+      return FLASH_LOG_EMPTY;
+    }
+    if(cursor->page == log->page_num)
+    {
+      cursor->sector = (cursor->sector + 1) % log->backend->sector_num;
+      cursor->page = 0;
+      cursor->sequence ++;
+      continue;
+    }
+    if(flash_log_sector_valid(log, cursor->sector, &sequence) == 0 || sequence != cursor->sequence)
+    {
+      /* overwritten, go on from the oldest sector */
+      cursor->lost ++;
+      if(log->tail_sector == FLASH_LOG_NONE ||
+         flash_log_sector_valid(log, log->tail_sector, &cursor->sequence) == 0)
+      {
+        return FLASH_LOG_EMPTY;
+      }
+      cursor->sector = log->tail_sector;
+      cursor->page = 0;
+      continue;
+    }
+
+    header = cursor->page ? 0 : FLASH_LOG_SECTOR_HEADER_SIZE;
+    if(log->backend->read(flash_log_page_addr(log, cursor->sector, cursor->page),
+                          cursor->page_buf, log->backend->page_size) != 0)
+    {
+      return FLASH_LOG_ERR_FLASH;
+    }
+    cursor->page ++;
+    word = cursor->page_buf[header] | (cursor->page_buf[header + 1] << 8) |
+           ((uint32_t)cursor->page_buf[header + 2] << 16) | ((uint32_t)cursor->page_buf[header + 3] << 24);
+    if(word == 0xFFFFFFFF)
+    {
+      continue;
+    }
+    cursor->offset = header + FLASH_LOG_PAGE_HEADER_SIZE;
+    if((word & 0xFFFF) > log->backend->page_size - cursor->offset ||
+       flash_log_crc16(cursor->page_buf + cursor->offset, word & 0xFFFF) != (word >> 16))
+    {
+      cursor->lost ++;
+      cursor->offset = 0;
+      cursor->length = 0;
+      continue;
+    }
+    cursor->length = cursor->offset + (word & 0xFFFF);
+  }
+}
+
+/**
+  * @}
+  */
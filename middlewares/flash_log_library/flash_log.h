@@ -0,0 +1,160 @@
+/**
+  **************************************************************************
+  * @file     flash_log.h
+  * @brief    power-fail-safe circular log on flash header file
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+
+/*!< define to prevent recursive inclusion -------------------------------------*/
+#ifndef __FLASH_LOG_H
+#define __FLASH_LOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* includes ------------------------------------------------------------------*/
+/* flash is reached through flash_log_backend_type only, the log builds for the
+   host as well. flash_log_port.h has the internal flash backend */
+#include <stdint.h>
+#include <stddef.h>
+
+/** @addtogroup AT32F403A_407_middlewares_flash_log_library
+  * @{
+  */
+
+/** @defgroup FLASH_log_definition
+  * @brief    records are staged in a ram page and programmed a page at a time.
+  *           a sector starts with a header holding a sequence number that grows
+  *           by one per sector, so the head is found by a binary search over the
+  *           sector headers and the write page by a binary search over the page
+  *           headers of the head sector. a page header holds the payload length
+  *           and its crc16, a page cut by a power loss is skipped on read-out.
+  *           the sector after the head is erased ahead from flash_log_idle, when
+  *           the log wraps its oldest sector is dropped.
+  * @{
+  */
+
+#ifndef FLASH_LOG_PAGE_MAX
+#define FLASH_LOG_PAGE_MAX               256        /*!< largest page size of a backend */
+#endif
+
+#define FLASH_LOG_SECTOR_HEADER_SIZE     16
+#define FLASH_LOG_PAGE_HEADER_SIZE       4
+#define FLASH_LOG_RECORD_HEADER_SIZE     2
+#define FLASH_LOG_SECTOR_MAGIC           0x31474F4C /*!< "LOG1" */
+#define FLASH_LOG_NONE                   0xFFFFFFFF
+
+/* largest record, it fits in the first page of a sector as well */
+#define FLASH_LOG_RECORD_MAX(page_size)  ((page_size) - FLASH_LOG_SECTOR_HEADER_SIZE - \
+                                          FLASH_LOG_PAGE_HEADER_SIZE - FLASH_LOG_RECORD_HEADER_SIZE)
+
+/**
+  * @}
+  */
+
+/** @defgroup FLASH_log_types
+  * @{
+  */
+
+typedef enum
+{
+  FLASH_LOG_OK = 0,        /*!< no error */
+  FLASH_LOG_ERR_PARAM,     /*!< bad backend or record length */
+  FLASH_LOG_ERR_FLASH,     /*!< read, erase or program failed */
+  FLASH_LOG_EMPTY,         /*!< no more records to read */
+} flash_log_status_type;
+
+typedef struct
+{
+  uint32_t                               address;     /*!< first sector */
+  uint32_t                               sector_size;
+  uint32_t                               sector_num;  /*!< 3 or more */
+  uint32_t                               page_size;   /*!< program unit, FLASH_LOG_PAGE_MAX at most */
+  int (*read)(uint32_t address, uint8_t *pbuffer, uint32_t length);     /*!< 0 on success */
+  int (*erase)(uint32_t address);                                       /*!< one sector */
+  int (*program)(uint32_t address, const uint8_t *pbuffer, uint32_t length); /*!< one page */
+} flash_log_backend_type;
+
+typedef struct
+{
+  const flash_log_backend_type           *backend;
+  uint32_t                               page_num;       /*!< pages per sector */
+
+  uint32_t                               head_sector;
+  uint32_t                               head_page;      /*!< next page to program */
+  uint32_t                               sequence;       /*!< of the newest sector with a header */
+  uint8_t                                head_entered;   /*!< head sector has its header */
+  uint32_t                               tail_sector;    /*!< oldest sector, FLASH_LOG_NONE when empty */
+  uint32_t                               erased_sector;  /*!< known to be erased, or FLASH_LOG_NONE */
+  uint32_t                               erase_pending;  /*!< to erase from flash_log_idle */
+
+  uint32_t                               page_buf[FLASH_LOG_PAGE_MAX / 4];
+  uint32_t                               page_len;       /*!< staged bytes, headers included */
+
+  /* statistics */
+  uint32_t                               records;
+  uint32_t                               pages;
+  uint32_t                               erases;
+  uint32_t                               stall_erases;   /*!< erases a flush had to wait for */
+} flash_log_type;
+
+typedef struct
+{
+  uint32_t                               sector;
+  uint32_t                               sequence;       /*!< expected in the sector header */
+  uint32_t                               page;           /*!< next page to read */
+  uint32_t                               offset;         /*!< in page_buf */
+  uint32_t                               length;         /*!< payload end in page_buf */
+  uint32_t                               lost;           /*!< pages skipped or overwritten */
+  uint8_t                                page_buf[FLASH_LOG_PAGE_MAX];
+} flash_log_cursor_type;
+
+/**
+  * @}
+  */
+
+/** @defgroup FLASH_log_exported_functions
+  * @{
+  */
+
+flash_log_status_type flash_log_init(flash_log_type *log, const flash_log_backend_type *backend);
+flash_log_status_type flash_log_format(flash_log_type *log);
+flash_log_status_type flash_log_write(flash_log_type *log, const void *pdata, uint32_t length);
+flash_log_status_type flash_log_flush(flash_log_type *log);
+flash_log_status_type flash_log_idle(flash_log_type *log);
+void                  flash_log_read_start(flash_log_type *log, flash_log_cursor_type *cursor);
+flash_log_status_type flash_log_read(flash_log_type *log, flash_log_cursor_type *cursor,
+                                     void *pbuffer, uint32_t size, uint32_t *length);
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,107 @@
+/**
+  **************************************************************************
+  * @file     flash_log_port.c
+  * @brief    flash log backend for the internal flash
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+
+#include "flash_log_port.h"
+
+/** @addtogroup AT32F403A_407_middlewares_flash_log_library
+  * @{
+  */
+
+/**
+  * @brief  read the internal flash.
+  * @param  address: flash address
+  * @param  pbuffer: data buffer
+  * @param  length: data length
+  * @retval 0
+  */
+static int internal_read(uint32_t address, uint8_t *pbuffer, uint32_t length)
+{
+  const uint8_t *pflash = (const uint8_t *)address;
+
+  while(length --)
+  {
+    *pbuffer ++ = *pflash ++;
+  }
+  return 0;
+}
+
+/**
+  * @brief  erase one sector of the internal flash.
+  * @param  address: sector address
+  * @retval 0 on success
+  */
+static int internal_erase(uint32_t address)
+{
+  flash_status_type status;
+
+  flash_unlock();
+  status = flash_sector_erase(address);
+  flash_lock();
+  return (status == FLASH_OPERATE_DONE) ? 0 : 1;
+}
+
+/**
+  * @brief  program a page of the internal flash a word at a time.
+  * @param  address: page address
+  * @param  pbuffer: data, word aligned
+  * @param  length: data length, a multiple of 4
+  * @retval 0 on success
+  */
+static int internal_program(uint32_t address, const uint8_t *pbuffer, uint32_t length)
+{
+  const uint32_t *pdata = (const uint32_t *)pbuffer;
+  flash_status_type status = FLASH_OPERATE_DONE;
+  uint32_t i;
+
+  flash_unlock();
+  for(i = 0; i < length / 4 && status == FLASH_OPERATE_DONE; i ++)
+  {
+    /* erased words are skipped, the page tail is padding */
+    if(pdata[i] != 0xFFFFFFFF)
+    {
+      status = flash_word_program(address + i * 4, pdata[i]);
+    }
+  }
+  flash_lock();
+  return (status == FLASH_OPERATE_DONE) ? 0 : 1;
+}
+
+/**
+  * @brief internal flash backend
+  */
+const flash_log_backend_type flash_log_internal =
+{
+  FLASH_LOG_INTERNAL_ADDR,
+  0x800,
+  FLASH_LOG_INTERNAL_SECTOR_NUM,
+  256,
+  internal_read,
+  internal_erase,
+  internal_program,
+};
+
+/**
+  * @}
+  */
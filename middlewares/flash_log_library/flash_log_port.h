@@ -0,0 +1,79 @@
+/**
+  **************************************************************************
+  * @file     flash_log_port.h
+  * @brief    flash log backends header file
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+
+/*!< define to prevent recursive inclusion -------------------------------------*/
+#ifndef __FLASH_LOG_PORT_H
+#define __FLASH_LOG_PORT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* includes ------------------------------------------------------------------*/
+#include "at32f403a_407.h"
+#include "flash_log.h"
+
+/** @addtogroup AT32F403A_407_middlewares_flash_log_library
+  * @{
+  */
+
+/** @defgroup FLASH_log_port_layout
+  * @brief    every value can be overridden before including this file. other
+  *           flashes are bound by the application, the flash/flash_log example
+  *           has a w25q backend.
+  * @{
+  */
+
+#ifndef FLASH_LOG_INTERNAL_ADDR
+#define FLASH_LOG_INTERNAL_ADDR          (FLASH_BANK1_START_ADDR + 0x30000)
+#endif
+
+#ifndef FLASH_LOG_INTERNAL_SECTOR_NUM
+#define FLASH_LOG_INTERNAL_SECTOR_NUM    8          /*!< 2kb sectors */
+#endif
+
+/**
+  * @}
+  */
+
+/** @defgroup FLASH_log_port_exported_backends
+  * @{
+  */
+
+extern const flash_log_backend_type flash_log_internal;
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
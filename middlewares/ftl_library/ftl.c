@@ -0,0 +1,626 @@
+/**
+  **************************************************************************
+  * @file     ftl.c
+  * @brief    flash translation layer for spi nor flash
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+#include "ftl.h"
+#include <string.h>
+
+/** @addtogroup AT32F403A_407_middlewares_ftl_library
+  * @{
+  */
+
+/**
+  * @brief  flash address of a block.
+  * @param  ftl: ftl
+  * @param  block: block number
+  * @retval address
+  */
+static uint32_t ftl_block_addr(ftl_type *ftl, uint32_t block)
+{
+  return ftl->backend->address + block * ftl->backend->block_size;
+}
+
+/**
+  * @brief  flash address of the data of a slot, slot 0 follows the summary.
+  * @param  ftl: ftl
+  * @param  slot: slot number over the whole flash
+  * @retval address
+  */
+static uint32_t ftl_slot_addr(ftl_type *ftl, uint32_t slot)
+{
+  return ftl_block_addr(ftl, slot / ftl->slot_num) + (slot % ftl->slot_num + 1) * FTL_SECTOR_SIZE;
+}
+
+/**
+  * @brief  summary entry of a sector, its upper half is the complement so an
+  *         erased or half programmed entry is not taken.
+  * @param  sector: logical sector
+  * @retval entry
+  */
+static uint32_t ftl_entry(uint32_t sector)
+{
+  return sector | ((~sector & 0xFFFF) << 16);
+}
+
+/**
+  * @brief  find the block of a state with the lowest erase count.
+  * @param  ftl: ftl
+  * @param  state: FTL_BLOCK_xxx, FTL_BLOCK_FREE stands for blank blocks as well
+  * @retval block, FTL_NONE when none
+  */
+static uint32_t ftl_block_find(ftl_type *ftl, uint8_t state)
+{
+  uint32_t block, found = FTL_NONE;
+
+  for(block = 0; block < ftl->backend->block_num; block ++)
+  {
+    if((ftl->state[block] == state || (state == FTL_BLOCK_FREE && ftl->state[block] == FTL_BLOCK_BLANK)) &&
+       (found == FTL_NONE || ftl->erase_count[block] < ftl->erase_count[found]))
+    {
+      found = block;
+    }
+  }
+  return found;
+}
+
+/**
+  * @brief  check whether a block is erased.
+  * @param  ftl: ftl
+  * @param  block: block number
+  * @retval 1 when every byte reads 0xff
+  */
+static int ftl_block_blank(ftl_type *ftl, uint32_t block)
+{
+  uint32_t buffer[16], address = ftl_block_addr(ftl, block), i, j;
+
+  for(i = 0; i < ftl->backend->block_size; i += sizeof(buffer))
+  {
+    if(ftl->backend->read(address + i, (uint8_t *)buffer, sizeof(buffer)) != 0)
+    {
+      return 0;
+    }
+    for(j = 0; j < 16; j ++)
+    {
+      if(buffer[j] != 0xFFFFFFFF)
+      {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+/**
+  * @brief  erase a block, it becomes free.
+  * @param  ftl: ftl
+  * @param  block: block number
+  * @retval status
+  */
+static ftl_status_type ftl_block_erase(ftl_type *ftl, uint32_t block)
+{
+  if(ftl->backend->erase(ftl_block_addr(ftl, block)) != 0)
+  {
+    return FTL_ERR_FLASH;
+  }
+  if(ftl->state[block] == FTL_BLOCK_DIRTY)
+  {
+    ftl->dirty_num --;
+    ftl->free_num ++;
+  }
+  ftl->state[block] = FTL_BLOCK_FREE;
+  ftl->erase_count[block] ++;
+  ftl->erases ++;
+  return FTL_OK;
+}
+
+/**
+  * @brief  open the free block with the lowest erase count as active block.
+  * @param  ftl: ftl
+  * @retval status
+  */
+static ftl_status_type ftl_block_open(ftl_type *ftl)
+{
+  uint32_t header[FTL_HEADER_SIZE / 4];
+  uint32_t block = ftl_block_find(ftl, FTL_BLOCK_FREE);
+
+  if(block == FTL_NONE)
+  {
+    return FTL_ERR_FULL;
+  }
+
+  /* an erase cut by a power loss can leave the header blank only */
+  if(ftl->state[block] == FTL_BLOCK_BLANK && ftl_block_blank(ftl, block) == 0 &&
+     ftl_block_erase(ftl, block) != FTL_OK)
+  {
+    return FTL_ERR_FLASH;
+  }
+
+  header[0] = FTL_BLOCK_MAGIC;
+  header[1] = ftl->sequence;
+  header[2] = ftl->erase_count[block];
+  header[3] = ~(header[1] ^ header[2]);
+  ftl->state[block] = FTL_BLOCK_USED;
+  ftl->valid[block] = 0;
+  ftl->free_num --;
+  ftl->sequence ++;
+  ftl->active = block;
+  ftl->active_slot = 0;
+  if(ftl->backend->program(ftl_block_addr(ftl, block), (const uint8_t *)header, FTL_HEADER_SIZE) != 0)
+  {
+    /* the block is left used, a collection drops it */
+    ftl->active_slot = ftl->slot_num;
+    return FTL_ERR_FLASH;
+  }
+  return FTL_OK;
+}
+
+/**
+  * @brief  append a sector to the active block and move the map to it.
+  * @param  ftl: ftl
+  * @param  sector: logical sector
+  * @param  pbuffer: sector data
+  * @retval status
+  */
+static ftl_status_type ftl_append(ftl_type *ftl, uint32_t sector, const uint8_t *pbuffer)
+{
+  uint32_t slot, old, entry = ftl_entry(sector);
+  ftl_status_type status;
+
+  if(ftl->active == FTL_NONE || ftl->active_slot == ftl->slot_num)
+  {
+    status = ftl_block_open(ftl);
+    if(status != FTL_OK)
+    {
+      return status;
+    }
+  }
+
+  /* the slot is consumed even when programming fails */
+  slot = ftl->active * ftl->slot_num + ftl->active_slot;
+  ftl->active_slot ++;
+  ftl->flash_writes ++;
+
+  /* data first, the summary entry marks it complete */
+  if(ftl->backend->program(ftl_slot_addr(ftl, slot), pbuffer, FTL_SECTOR_SIZE) != 0 ||
+     ftl->backend->program(ftl_block_addr(ftl, ftl->active) + FTL_HEADER_SIZE + (slot % ftl->slot_num) * 4,
+                           (const uint8_t *)&entry, 4) != 0)
+  {
+    return FTL_ERR_FLASH;
+  }
+
+  old = ftl->map[sector];
+  if(old != FTL_NONE)
+  {
+    old /= ftl->slot_num;
+    ftl->valid[old] --;
+    if(ftl->valid[old] == 0 && old != ftl->active)
+    {
+      ftl->state[old] = FTL_BLOCK_DIRTY;
+      ftl->dirty_num ++;
+    }
+  }
+  ftl->map[sector] = slot;
+  ftl->valid[ftl->active] ++;
+  return FTL_OK;
+}
+
+/**
+  * @brief  find the used block with the fewest valid sectors, the active
+  *         block only once it is full.
+  * @param  ftl: ftl
+  * @retval block, FTL_NONE when every block is full of valid sectors
+  */
+static uint32_t ftl_victim_find(ftl_type *ftl)
+{
+  uint32_t block, found = FTL_NONE;
+
+  for(block = 0; block < ftl->backend->block_num; block ++)
+  {
+    if(ftl->state[block] == FTL_BLOCK_USED && ftl->valid[block] < ftl->slot_num &&
+       (block != ftl->active || ftl->active_slot == ftl->slot_num) &&
+       (found == FTL_NONE || ftl->valid[block] < ftl->valid[found] ||
+        (ftl->valid[block] == ftl->valid[found] && ftl->erase_count[block] < ftl->erase_count[found])))
+    {
+      found = block;
+    }
+  }
+  return found;
+}
+
+/**
+  * @brief  move the valid sectors of a block to the active block, the block
+  *         becomes dirty.
+  * @param  ftl: ftl
+  * @param  block: block number, the active one only once it is full
+  * @retval status
+  */
+static ftl_status_type ftl_collect(ftl_type *ftl, uint32_t block)
+{
+  uint32_t entry[FTL_SLOT_MAX], slot, sector;
+  ftl_status_type status;
+
+  if(ftl->backend->read(ftl_block_addr(ftl, block) + FTL_HEADER_SIZE, (uint8_t *)entry, ftl->slot_num * 4) != 0)
+  {
+    return FTL_ERR_FLASH;
+  }
+  ftl->collections ++;
+
+  for(slot = 0; slot < ftl->slot_num && ftl->valid[block] != 0; slot ++)
+  {
+    sector = entry[slot] & 0xFFFF;
+    if(entry[slot] != ftl_entry(sector) || sector >= ftl->sector_num ||
+       ftl->map[sector] != block * ftl->slot_num + slot)
+    {
+      continue;
+    }
+    if(ftl->backend->read(ftl_slot_addr(ftl, ftl->map[sector]), (uint8_t *)ftl->buffer, FTL_SECTOR_SIZE) != 0)
+    {
+      return FTL_ERR_FLASH;
+    }
+    status = ftl_append(ftl, sector, (const uint8_t *)ftl->buffer);
+    if(status != FTL_OK)
+    {
+      return status;
+    }
+  }
+
+  /* a block whose header failed to program holds no valid sector */
+  if(ftl->state[block] == FTL_BLOCK_USED)
+  {
+    ftl->state[block] = FTL_BLOCK_DIRTY;
+    ftl->dirty_num ++;
+  }
+  return FTL_OK;
+}
+
+/**
+  * @brief  make sure a free block is left for the collections once the host
+  *         opens the next block.
+  * @param  ftl: ftl
+  * @retval status
+  */
+static ftl_status_type ftl_reserve(ftl_type *ftl)
+{
+  ftl_status_type status;
+  uint32_t block;
+
+  while(ftl->free_num < 2)
+  {
+    if(ftl->dirty_num != 0)
+    {
+      status = ftl_block_erase(ftl, ftl_block_find(ftl, FTL_BLOCK_DIRTY));
+    }
+    else
+    {
+      /* ftl_idle did not run often enough */
+      block = ftl_victim_find(ftl);
+      if(block == FTL_NONE || ftl->free_num == 0)
+      {
+        return FTL_ERR_FULL;
+      }
+      ftl->stall_collections ++;
+      status = ftl_collect(ftl, block);
+    }
+    if(status != FTL_OK)
+    {
+      return status;
+    }
+  }
+  return FTL_OK;
+}
+
+/**
+  * @brief  rebuild the map table from the block summaries.
+  * @param  ftl: ftl
+  * @retval status
+  */
+static ftl_status_type ftl_mount(ftl_type *ftl)
+{
+  uint32_t header[FTL_HEADER_SIZE / 4 + FTL_SLOT_MAX];
+  uint32_t *entry = header + FTL_HEADER_SIZE / 4;
+  uint32_t block, slot, sector, old, known = 0, total = 0, i;
+
+  memset(ftl->map, 0xFF, sizeof(ftl->map));
+  ftl->sequence = 1;
+  ftl->active = FTL_NONE;
+  ftl->active_slot = 0;
+  ftl->free_num = 0;
+  ftl->dirty_num = 0;
+
+  for(block = 0; block < ftl->backend->block_num; block ++)
+  {
+    ftl->valid[block] = 0;
+    ftl->erase_count[block] = 0xFFFFFFFF;
+    if(ftl->backend->read(ftl_block_addr(ftl, block), (uint8_t *)header,
+                          FTL_HEADER_SIZE + ftl->slot_num * 4) != 0)
+    {
+      return FTL_ERR_FLASH;
+    }
+
+    if(header[0] == FTL_BLOCK_MAGIC && header[3] == ~(header[1] ^ header[2]))
+    {
+      ftl->state[block] = FTL_BLOCK_USED;
+      ftl->block_sequence[block] = header[1];
+      ftl->erase_count[block] = header[2];
+      if(header[1] >= ftl->sequence)
+      {
+        ftl->sequence = header[1] + 1;
+      }
+
+      /* a later slot of the same block or a newer block wins */
+      for(slot = 0; slot < ftl->slot_num; slot ++)
+      {
+        sector = entry[slot] & 0xFFFF;
+        if(entry[slot] != ftl_entry(sector) || sector >= ftl->sector_num)
+        {
+          continue;
+        }
+        old = ftl->map[sector];
+        if(old == FTL_NONE || old / ftl->slot_num == block ||
+           ftl->block_sequence[old / ftl->slot_num] < header[1])
+        {
+          ftl->map[sector] = block * ftl->slot_num + slot;
+        }
+      }
+      continue;
+    }
+
+    for(i = 0; i < FTL_HEADER_SIZE / 4 + ftl->slot_num && header[i] == 0xFFFFFFFF; i ++);
+    if(i == FTL_HEADER_SIZE / 4 + ftl->slot_num)
+    {
+      ftl->state[block] = FTL_BLOCK_BLANK;
+      ftl->free_num ++;
+    }
+    else
+    {
+      ftl->state[block] = FTL_BLOCK_DIRTY;
+      ftl->dirty_num ++;
+    }
+  }
+
+  for(sector = 0; sector < ftl->sector_num; sector ++)
+  {
+    if(ftl->map[sector] != FTL_NONE)
+    {
+      ftl->valid[ftl->map[sector] / ftl->slot_num] ++;
+    }
+  }
+
+  for(block = 0; block < ftl->backend->block_num; block ++)
+  {
+    if(ftl->state[block] == FTL_BLOCK_USED && ftl->valid[block] == 0)
+    {
+      ftl->state[block] = FTL_BLOCK_DIRTY;
+      ftl->dirty_num ++;
+    }
+    if(ftl->erase_count[block] != 0xFFFFFFFF)
+    {
+      total += ftl->erase_count[block];
+      known ++;
+    }
+  }
+
+  /* the erase count of a block without header is lost, take the average */
+  for(block = 0; block < ftl->backend->block_num; block ++)
+  {
+    if(ftl->erase_count[block] == 0xFFFFFFFF)
+    {
+      ftl->erase_count[block] = known ? total / known : 0;
+    }
+  }
+  return FTL_OK;
+}
+
+/**
+  * @brief  initialize the ftl and rebuild its map table.
+  * @note   blocks without a valid header are erased later by ftl_idle, a
+  *         flash holding foreign data mounts as an empty disk.
+  * @param  ftl: ftl
+  * @param  backend: flash region and access functions
+  * @retval status
+  */
+ftl_status_type ftl_init(ftl_type *ftl, const ftl_backend_type *backend)
+{
+  ftl->backend = backend;
+  ftl->host_writes = 0;
+  ftl->flash_writes = 0;
+  ftl->erases = 0;
+  ftl->collections = 0;
+  ftl->stall_collections = 0;
+
+  if(backend->read == 0 || backend->erase == 0 || backend->program == 0 ||
+     backend->block_size % FTL_SECTOR_SIZE || backend->block_size / FTL_SECTOR_SIZE < 2 ||
+     backend->block_size / FTL_SECTOR_SIZE - 1 > FTL_SLOT_MAX ||
+     backend->block_num > FTL_BLOCK_MAX || backend->block_num < FTL_SPARE_BLOCKS + 2 ||
+     FTL_SPARE_BLOCKS < 3)
+  {
+    return FTL_ERR_PARAM;
+  }
+  ftl->slot_num = backend->block_size / FTL_SECTOR_SIZE - 1;
+  ftl->sector_num = (backend->block_num - FTL_SPARE_BLOCKS) * ftl->slot_num;
+  return ftl_mount(ftl);
+}
+
+/**
+  * @brief  erase every block, the disk reads 0xff afterwards.
+  * @param  ftl: ftl
+  * @retval status
+  */
+ftl_status_type ftl_format(ftl_type *ftl)
+{
+  uint32_t block;
+
+  for(block = 0; block < ftl->backend->block_num; block ++)
+  {
+    if(ftl->state[block] != FTL_BLOCK_FREE && ftl_block_erase(ftl, block) != FTL_OK)
+    {
+      return FTL_ERR_FLASH;
+    }
+    ftl->valid[block] = 0;
+  }
+  memset(ftl->map, 0xFF, sizeof(ftl->map));
+  ftl->active = FTL_NONE;
+  ftl->free_num = ftl->backend->block_num;
+  ftl->dirty_num = 0;
+  return FTL_OK;
+}
+
+/**
+  * @brief  read sectors, sectors never written read 0xff.
+  * @param  ftl: ftl
+  * @param  sector: first logical sector
+  * @param  pbuffer: data buffer
+  * @param  count: number of sectors
+  * @retval status
+  */
+ftl_status_type ftl_read(ftl_type *ftl, uint32_t sector, uint8_t *pbuffer, uint32_t count)
+{
+  uint32_t slot, run;
+
+  if(sector >= ftl->sector_num || count > ftl->sector_num - sector)
+  {
+    return FTL_ERR_PARAM;
+  }
+
+  while(count)
+  {
+    slot = ftl->map[sector];
+    if(slot == FTL_NONE)
+    {
+      memset(pbuffer, 0xFF, FTL_SECTOR_SIZE);
+      run = 1;
+    }
+    else
+    {
+      /* sectors written in order sit in following slots, read them at once */
+      for(run = 1; run < count && (slot + run) % ftl->slot_num != 0 &&
+          ftl->map[sector + run] == slot + run; run ++);
+      if(ftl->backend->read(ftl_slot_addr(ftl, slot), pbuffer, run * FTL_SECTOR_SIZE) != 0)
+      {
+        return FTL_ERR_FLASH;
+      }
+    }
+    sector += run;
+    pbuffer += run * FTL_SECTOR_SIZE;
+    count -= run;
+  }
+  return FTL_OK;
+}
+
+/**
+  * @brief  write sectors to the active block.
+  * @param  ftl: ftl
+  * @param  sector: first logical sector
+  * @param  pbuffer: data buffer
+  * @param  count: number of sectors
+  * @retval status
+  */
+ftl_status_type ftl_write(ftl_type *ftl, uint32_t sector, const uint8_t *pbuffer, uint32_t count)
+{
+  ftl_status_type status;
+
+  if(sector >= ftl->sector_num || count > ftl->sector_num - sector)
+  {
+    return FTL_ERR_PARAM;
+  }
+
+  while(count --)
+  {
+    if(ftl->active == FTL_NONE || ftl->active_slot == ftl->slot_num)
+    {
+      status = ftl_reserve(ftl);
+      if(status != FTL_OK)
+      {
+        return status;
+      }
+    }
+    status = ftl_append(ftl, sector, pbuffer);
+    if(status != FTL_OK)
+    {
+      return status;
+    }
+    ftl->host_writes ++;
+    sector ++;
+    pbuffer += FTL_SECTOR_SIZE;
+  }
+  return FTL_OK;
+}
+
+/**
+  * @brief  background work, call it when the disk is idle. one step is done
+  *         per call: erase a dirty block, collect a block when erased blocks
+  *         run short, or move the data of the least erased block.
+  * @param  ftl: ftl
+  * @retval FTL_BUSY when a step was done, FTL_OK when nothing is left
+  */
+ftl_status_type ftl_idle(ftl_type *ftl)
+{
+  ftl_status_type status;
+  uint32_t block, cold = FTL_NONE, most = 0;
+
+  if(ftl->dirty_num != 0)
+  {
+    status = ftl_block_erase(ftl, ftl_block_find(ftl, FTL_BLOCK_DIRTY));
+    return (status == FTL_OK) ? FTL_BUSY : status;
+  }
+
+  /* a collection needs room in a free block */
+  if(ftl->free_num < 2)
+  {
+    return FTL_OK;
+  }
+
+  if(ftl->free_num < FTL_GC_FREE_BLOCKS)
+  {
+    block = ftl_victim_find(ftl);
+    if(block != FTL_NONE)
+    {
+      status = ftl_collect(ftl, block);
+      return (status == FTL_OK) ? FTL_BUSY : status;
+    }
+  }
+
+  /* static wear levelling, cold data keeps its block from being erased */
+  for(block = 0; block < ftl->backend->block_num; block ++)
+  {
+    if(ftl->erase_count[block] > most)
+    {
+      most = ftl->erase_count[block];
+    }
+    if(ftl->state[block] == FTL_BLOCK_USED && block != ftl->active &&
+       (cold == FTL_NONE || ftl->erase_count[block] < ftl->erase_count[cold]))
+    {
+      cold = block;
+    }
+  }
+  if(cold != FTL_NONE && most - ftl->erase_count[cold] > FTL_WEAR_LIMIT)
+  {
+    status = ftl_collect(ftl, cold);
+    return (status == FTL_OK) ? FTL_BUSY : status;
+  }
+  return FTL_OK;
+}
+
+/**
+  * @}
+  */
@@ -0,0 +1,174 @@
+/**
+  **************************************************************************
+  * @file     ftl.h
+  * @brief    flash translation layer for spi nor flash header file
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+/*!< define to prevent recursive inclusion -------------------------------------*/
+#ifndef __FTL_H
+#define __FTL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* includes ------------------------------------------------------------------*/
+/* flash is reached through ftl_backend_type only, the ftl builds for the host
+   as well. the spi/w25q_flash example has a w25q backend in ftl_w25q.c */
+#include <stdint.h>
+#include <stddef.h>
+
+/** @addtogroup AT32F403A_407_middlewares_ftl_library
+  * @{
+  */
+
+/** @defgroup FTL_definition
+  * @brief    the flash is split in erase blocks. a block starts with a header
+  *           and a summary entry per data slot, a slot holds one 512 byte
+  *           sector. every sector write is appended to the active block, data
+  *           first and its summary entry after, and the ram map table is
+  *           moved to the new slot, so random writes turn into sequential page
+  *           programs. the header holds a sequence number growing by one per
+  *           block, the newest copy of a sector wins when the map is rebuilt
+  *           at mount. ftl_idle erases the blocks left without valid sectors,
+  *           collects the block with the fewest valid sectors when erased
+  *           blocks run short, and moves the data of the least erased block
+  *           when the erase counts drift apart. ftl_write only collects when
+  *           ftl_idle did not keep up. FTL_SPARE_BLOCKS blocks are not
+  *           exported, so a block holding invalid sectors can always be found.
+  * @{
+  */
+
+#ifndef FTL_BLOCK_MAX
+#define FTL_BLOCK_MAX                    256        /*!< erase blocks of the largest backend */
+#endif
+
+#ifndef FTL_SLOT_MAX
+#define FTL_SLOT_MAX                     7          /*!< data slots per block, block_size / FTL_SECTOR_SIZE - 1 */
+#endif
+
+#ifndef FTL_SPARE_BLOCKS
+#define FTL_SPARE_BLOCKS                 4          /*!< blocks kept for garbage collection, 3 or more */
+#endif
+
+#ifndef FTL_GC_FREE_BLOCKS
+#define FTL_GC_FREE_BLOCKS               4          /*!< ftl_idle collects below this many erased blocks */
+#endif
+
+#ifndef FTL_WEAR_LIMIT
+#define FTL_WEAR_LIMIT                   64         /*!< erase count spread that moves cold data */
+#endif
+
+#define FTL_SECTOR_SIZE                  512
+#define FTL_SECTOR_MAX                   ((FTL_BLOCK_MAX - FTL_SPARE_BLOCKS) * FTL_SLOT_MAX)
+#define FTL_HEADER_SIZE                  16
+#define FTL_BLOCK_MAGIC                  0x314C5446 /*!< "FTL1" */
+#define FTL_NONE                         0xFFFF
+
+/**
+  * @}
+  */
+
+/** @defgroup FTL_types
+  * @{
+  */
+
+typedef enum
+{
+  FTL_OK = 0,          /*!< no error, or nothing left to do for ftl_idle */
+  FTL_BUSY,            /*!< ftl_idle did one step, call again */
+  FTL_ERR_PARAM,       /*!< bad backend or sector range */
+  FTL_ERR_FULL,        /*!< no block can be collected */
+  FTL_ERR_FLASH,       /*!< read, erase or program failed */
+} ftl_status_type;
+
+typedef enum
+{
+  FTL_BLOCK_FREE = 0,  /*!< erased by the ftl */
+  FTL_BLOCK_BLANK,     /*!< header erased at mount, checked before use */
+  FTL_BLOCK_USED,      /*!< holds sectors, or is the active block */
+  FTL_BLOCK_DIRTY,     /*!< no valid sector, to erase */
+} ftl_block_state_type;
+
+typedef struct
+{
+  uint32_t                               address;     /*!< first block */
+  uint32_t                               block_size;  /*!< erase unit, multiple of FTL_SECTOR_SIZE */
+  uint32_t                               block_num;
+  int (*read)(uint32_t address, uint8_t *pbuffer, uint32_t length);     /*!< 0 on success */
+  int (*erase)(uint32_t address);                                       /*!< one block */
+  int (*program)(uint32_t address, const uint8_t *pbuffer, uint32_t length); /*!< erased area, may cross pages */
+} ftl_backend_type;
+
+typedef struct
+{
+  const ftl_backend_type                 *backend;
+  uint32_t                               slot_num;       /*!< data slots per block */
+  uint32_t                               sector_num;     /*!< sectors exported */
+
+  uint32_t                               sequence;       /*!< of the next block opened */
+  uint32_t                               active;         /*!< block written, FTL_NONE before the first write */
+  uint32_t                               active_slot;    /*!< next slot of the active block */
+  uint32_t                               free_num;       /*!< free and blank blocks */
+  uint32_t                               dirty_num;
+
+  uint16_t                               map[FTL_SECTOR_MAX];           /*!< sector to slot, FTL_NONE when unwritten */
+  uint8_t                                state[FTL_BLOCK_MAX];
+  uint8_t                                valid[FTL_BLOCK_MAX];          /*!< valid sectors per block */
+  uint32_t                               erase_count[FTL_BLOCK_MAX];
+  uint32_t                               block_sequence[FTL_BLOCK_MAX]; /*!< read at mount */
+  uint32_t                               buffer[FTL_SECTOR_SIZE / 4];   /*!< sector moved by a collection */
+
+  /* statistics */
+  uint32_t                               host_writes;    /*!< sectors written by ftl_write */
+  uint32_t                               flash_writes;   /*!< sectors programmed, collections included */
+  uint32_t                               erases;
+  uint32_t                               collections;
+  uint32_t                               stall_collections; /*!< collections ftl_write had to wait for */
+} ftl_type;
+
+/**
+  * @}
+  */
+
+/** @defgroup FTL_exported_functions
+  * @{
+  */
+
+ftl_status_type ftl_init(ftl_type *ftl, const ftl_backend_type *backend);
+ftl_status_type ftl_format(ftl_type *ftl);
+ftl_status_type ftl_read(ftl_type *ftl, uint32_t sector, uint8_t *pbuffer, uint32_t count);
+ftl_status_type ftl_write(ftl_type *ftl, uint32_t sector, const uint8_t *pbuffer, uint32_t count);
+ftl_status_type ftl_idle(ftl_type *ftl);
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -92,6 +92,68 @@
 #define I2C_START                        0
 #define I2C_END                          1
 
+/**
+  * @brief i2c timeout, counted down in microseconds from the dwt cycle counter
+  */
+typedef struct
+{
+  uint32_t                               cycle;                   /*!< cycle counter at the last check */
+  uint32_t                               remain;                  /*!< microseconds left               */
+} i2c_timeout_type;
+
+/**
+  * @brief  start a timeout.
+  * @param  ptimeout: the timeout.
+  * @param  timeout: duration in microseconds.
+  * @retval none.
+  */
+static void i2c_timeout_start(i2c_timeout_type* ptimeout, uint32_t timeout)
+{
+  ptimeout->cycle  = DWT->CYCCNT;
+  ptimeout->remain = timeout;
+}
+
+/**
+  * @brief  check a timeout, the elapsed whole microseconds are taken from it
+  *         so any duration is measured without overflow.
+  * @param  ptimeout: the timeout.
+  * @retval SET when the timeout has elapsed.
+  */
+static flag_status i2c_timeout_check(i2c_timeout_type* ptimeout)
+{
+  uint32_t cycles_us = system_core_clock / 1000000;
+  uint32_t elapsed = (DWT->CYCCNT - ptimeout->cycle) / cycles_us;
+
+  if(elapsed != 0)
+  {
+    if(elapsed >= ptimeout->remain)
+    {
+      ptimeout->remain = 0;
+
+      return SET;
+    }
+
+    ptimeout->cycle  += elapsed * cycles_us;
+    ptimeout->remain -= elapsed;
+  }
+
+  return RESET;
+}
+
+/**
+  * @brief  wait for a number of microseconds.
+  * @param  us: microseconds.
+  * @retval none.
+  */
+static void i2c_delay_us(uint32_t us)
+{
+  i2c_timeout_type wait;
+
+  i2c_timeout_start(&wait, us);
+
+  while(i2c_timeout_check(&wait) == RESET);
+}
+
 /**
   * @brief  initializes peripherals used by the i2c.
   * @param  none
@@ -109,6 +171,10 @@ __WEAK void i2c_lowlevel_init(i2c_handle_type* hi2c)
   */
 void i2c_config(i2c_handle_type* hi2c)
 {
+  /* enable the dwt cycle counter, timeouts are measured with it */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
   /* reset i2c peripheral */
   i2c_reset(hi2c->i2cx);
 
@@ -122,16 +188,22 @@ void i2c_config(i2c_handle_type* hi2c)
 /**
   * @brief  wait for the transfer to end.
   * @param  hi2c: the handle points to the operation information.
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds.
   * @retval i2c status.
   */
 i2c_status_type i2c_wait_end(i2c_handle_type* hi2c, uint32_t timeout)
 {
+  i2c_timeout_type wait;
+
+  i2c_timeout_start(&wait, timeout);
+
   while(hi2c->status != I2C_END)
   {
     /* check timeout */
-    if((timeout--) == 0)
+    if(i2c_timeout_check(&wait) != RESET)
     {
+      hi2c->timeout_count++;
+
       return I2C_ERR_TIMEOUT;
     }
   }
@@ -178,18 +250,32 @@ i2c_status_type i2c_wait_end(i2c_handle_type* hi2c, uint32_t timeout)
   *         - I2C_EVENT_CHECK_NONE
   *         - I2C_EVENT_CHECK_ACKFAIL
   *         - I2C_EVENT_CHECK_STOP
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds. a bus still busy
+  *         at the end of it is recovered by i2c_bus_recover when the pins
+  *         are set in the handle.
   * @retval i2c status.
   */
 i2c_status_type i2c_wait_flag(i2c_handle_type* hi2c, uint32_t flag, uint32_t event_check, uint32_t timeout)
 {
+  i2c_timeout_type wait;
+
+  i2c_timeout_start(&wait, timeout);
+
   if(flag == I2C_BUSYF_FLAG)
   {
     while(i2c_flag_get(hi2c->i2cx, flag) != RESET)
     {
       /* check timeout */
-      if((timeout--) == 0)
+      if(i2c_timeout_check(&wait) != RESET)
       {
+        hi2c->timeout_count++;
+
+        /* a slave holds sda or the peripheral is stuck, free the bus */
+        if((hi2c->scl_gpio != 0) && (i2c_bus_recover(hi2c) == I2C_OK))
+        {
+          return I2C_OK;
+        }
+
         hi2c->error_code = I2C_ERR_TIMEOUT;
 
         return I2C_ERR_TIMEOUT;
@@ -211,6 +297,7 @@ i2c_status_type i2c_wait_flag(i2c_handle_type* hi2c, uint32_t flag, uint32_t eve
           /* clear ack fail flag */
           i2c_flag_clear(hi2c->i2cx, I2C_ACKFAIL_FLAG);
 
+          hi2c->error_count++;
           hi2c->error_code = I2C_ERR_ACKFAIL;
 
           return I2C_ERR_ACKFAIL;
@@ -225,6 +312,7 @@ i2c_status_type i2c_wait_flag(i2c_handle_type* hi2c, uint32_t flag, uint32_t eve
           /* clear stop flag */
           i2c_flag_clear(hi2c->i2cx, I2C_STOPF_FLAG);
 
+          hi2c->error_count++;
           hi2c->error_code = I2C_ERR_STOP;
 
           return I2C_ERR_STOP;
@@ -232,8 +320,9 @@ i2c_status_type i2c_wait_flag(i2c_handle_type* hi2c, uint32_t flag, uint32_t eve
       }
 
       /* check timeout */
-      if((timeout--) == 0)
+      if(i2c_timeout_check(&wait) != RESET)
       {
+        hi2c->timeout_count++;
         hi2c->error_code = I2C_ERR_TIMEOUT;
 
         return I2C_ERR_TIMEOUT;
@@ -244,6 +333,78 @@ i2c_status_type i2c_wait_flag(i2c_handle_type* hi2c, uint32_t flag, uint32_t eve
   return I2C_OK;
 }
 
+/**
+  * @brief  free a bus held by a slave and set the peripheral up again.
+  * @note   scl_gpio, scl_pin, sda_gpio and sda_pin of the handle select the
+  *         pins, without them only the peripheral is reset. a slave stopped
+  *         in the middle of a byte holds sda low, up to I2C_RECOVERY_CLOCKS
+  *         clocks let it finish, then a stop condition resets every slave.
+  *         i2c_lowlevel_init gives the pins back to the peripheral.
+  * @param  hi2c: the handle points to the operation information.
+  * @retval i2c status, I2C_ERR_BUS when scl or sda stays low.
+  */
+i2c_status_type i2c_bus_recover(i2c_handle_type* hi2c)
+{
+  gpio_init_type gpio_init_struct;
+  i2c_status_type status = I2C_OK;
+  uint32_t i;
+
+  hi2c->recovery_count++;
+
+  if((hi2c->scl_gpio != 0) && (hi2c->sda_gpio != 0))
+  {
+    /* release the pins, then drive them as open drain outputs */
+    i2c_enable(hi2c->i2cx, FALSE);
+
+    gpio_bits_set(hi2c->scl_gpio, hi2c->scl_pin);
+    gpio_bits_set(hi2c->sda_gpio, hi2c->sda_pin);
+
+    gpio_default_para_init(&gpio_init_struct);
+    gpio_init_struct.gpio_out_type       = GPIO_OUTPUT_OPEN_DRAIN;
+    gpio_init_struct.gpio_pull           = GPIO_PULL_UP;
+    gpio_init_struct.gpio_mode           = GPIO_MODE_OUTPUT;
+    gpio_init_struct.gpio_drive_strength = GPIO_DRIVE_STRENGTH_MODERATE;
+    gpio_init_struct.gpio_pins           = hi2c->scl_pin;
+    gpio_init(hi2c->scl_gpio, &gpio_init_struct);
+    gpio_init_struct.gpio_pins           = hi2c->sda_pin;
+    gpio_init(hi2c->sda_gpio, &gpio_init_struct);
+
+    i2c_delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+
+    /* clock the slave out of the byte it sends */
+    for(i = 0; (i < I2C_RECOVERY_CLOCKS) && (gpio_input_data_bit_read(hi2c->sda_gpio, hi2c->sda_pin) == RESET); i++)
+    {
+      gpio_bits_reset(hi2c->scl_gpio, hi2c->scl_pin);
+      i2c_delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+      gpio_bits_set(hi2c->scl_gpio, hi2c->scl_pin);
+      i2c_delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+    }
+
+    /* stop condition: sda rises while scl is high */
+    gpio_bits_reset(hi2c->scl_gpio, hi2c->scl_pin);
+    i2c_delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+    gpio_bits_reset(hi2c->sda_gpio, hi2c->sda_pin);
+    i2c_delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+    gpio_bits_set(hi2c->scl_gpio, hi2c->scl_pin);
+    i2c_delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+    gpio_bits_set(hi2c->sda_gpio, hi2c->sda_pin);
+    i2c_delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+
+    if((gpio_input_data_bit_read(hi2c->scl_gpio, hi2c->scl_pin) == RESET) ||
+       (gpio_input_data_bit_read(hi2c->sda_gpio, hi2c->sda_pin) == RESET))
+    {
+      status = I2C_ERR_BUS;
+    }
+  }
+
+  /* reset the peripheral, its busy flag may be stuck */
+  i2c_config(hi2c);
+
+  hi2c->error_code = status;
+
+  return status;
+}
+
 /**
   * @brief  dma transfer cofiguration.
   * @param  hi2c: the handle points to the operation information.
@@ -278,7 +439,7 @@ void i2c_dma_config(i2c_handle_type* hi2c, dma_channel_type* dma_channelx, uint8
   * @brief  send address in master transmits mode.
   * @param  hi2c: the handle points to the operation information.
   * @param  address: slave address.
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds.
   * @retval i2c status.
   */
 i2c_status_type i2c_master_write_addr(i2c_handle_type *hi2c, uint16_t address, uint32_t timeout)
@@ -331,7 +492,7 @@ i2c_status_type i2c_master_write_addr(i2c_handle_type *hi2c, uint16_t address, u
   * @brief  send address in master receive mode.
   * @param  hi2c: the handle points to the operation information.
   * @param  address: slave address.
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds.
   * @retval i2c status.
   */
 i2c_status_type i2c_master_read_addr(i2c_handle_type *hi2c, uint16_t address, uint32_t timeout)
@@ -414,7 +575,7 @@ i2c_status_type i2c_master_read_addr(i2c_handle_type *hi2c, uint16_t address, ui
   * @param  address: slave address.
   * @param  pdata: data buffer.
   * @param  size: data size.
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds.
   * @retval i2c status.
   */
 i2c_status_type i2c_master_transmit(i2c_handle_type* hi2c, uint16_t address, uint8_t* pdata, uint16_t size, uint32_t timeout)
@@ -482,7 +643,7 @@ i2c_status_type i2c_master_transmit(i2c_handle_type* hi2c, uint16_t address, uin
   * @param  hi2c: the handle points to the operation information.
   * @param  pdata: data buffer.
   * @param  size: data size.
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds.
   * @retval i2c status.
   */
 i2c_status_type i2c_slave_receive(i2c_handle_type* hi2c, uint8_t* pdata, uint16_t size, uint32_t timeout)
@@ -557,7 +718,7 @@ i2c_status_type i2c_slave_receive(i2c_handle_type* hi2c, uint8_t* pdata, uint16_
   * @param  address: slave address.
   * @param  pdata: data buffer.
   * @param  size: data size.
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds.
   * @retval i2c status.
   */
 i2c_status_type i2c_master_receive(i2c_handle_type* hi2c, uint16_t address, uint8_t* pdata, uint16_t size, uint32_t timeout)
@@ -728,7 +889,7 @@ i2c_status_type i2c_master_receive(i2c_handle_type* hi2c, uint16_t address, uint
   * @param  hi2c: the handle points to the operation information.
   * @param  pdata: data buffer.
   * @param  size: data size.
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds.
   * @retval i2c status.
   */
 i2c_status_type i2c_slave_transmit(i2c_handle_type* hi2c, uint8_t* pdata, uint16_t size, uint32_t timeout)
@@ -815,7 +976,7 @@ i2c_status_type i2c_slave_transmit(i2c_handle_type* hi2c, uint8_t* pdata, uint16
   * @param  address: slave address.
   * @param  pdata: data buffer.
   * @param  size: data size.
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds.
   * @retval i2c status.
   */
 i2c_status_type i2c_master_transmit_int(i2c_handle_type* hi2c, uint16_t address, uint8_t* pdata, uint16_t size, uint32_t timeout)
@@ -862,7 +1023,7 @@ i2c_status_type i2c_master_transmit_int(i2c_handle_type* hi2c, uint16_t address,
   * @param  hi2c: the handle points to the operation information.
   * @param  pdata: data buffer.
   * @param  size: data size.
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds.
   * @retval i2c status.
   */
 i2c_status_type i2c_slave_receive_int(i2c_handle_type* hi2c, uint8_t* pdata, uint16_t size, uint32_t timeout)
@@ -901,7 +1062,7 @@ i2c_status_type i2c_slave_receive_int(i2c_handle_type* hi2c, uint8_t* pdata, uin
   * @param  address: slave address.
   * @param  pdata: data buffer.
   * @param  size: data size.
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds.
   * @retval i2c status.
   */
 i2c_status_type i2c_master_receive_int(i2c_handle_type* hi2c, uint16_t address, uint8_t* pdata, uint16_t size, uint32_t timeout)
@@ -979,7 +1140,7 @@ i2c_status_type i2c_master_receive_int(i2c_handle_type* hi2c, uint16_t address,
   * @param  hi2c: the handle points to the operation information.
   * @param  pdata: data buffer.
   * @param  size: data size.
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds.
   * @retval i2c status.
   */
 i2c_status_type i2c_slave_transmit_int(i2c_handle_type* hi2c, uint8_t* pdata, uint16_t size, uint32_t timeout)
@@ -1018,7 +1179,7 @@ i2c_status_type i2c_slave_transmit_int(i2c_handle_type* hi2c, uint8_t* pdata, ui
   * @param  address: slave address.
   * @param  pdata: data buffer.
   * @param  size: data size.
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds.
   * @retval i2c status.
   */
 i2c_status_type i2c_master_transmit_dma(i2c_handle_type* hi2c, uint16_t address, uint8_t* pdata, uint16_t size, uint32_t timeout)
@@ -1071,7 +1232,7 @@ i2c_status_type i2c_master_transmit_dma(i2c_handle_type* hi2c, uint16_t address,
   * @param  hi2c: the handle points to the operation information.
   * @param  pdata: data buffer.
   * @param  size: data size.
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds.
   * @retval i2c status.
   */
 i2c_status_type i2c_slave_receive_dma(i2c_handle_type* hi2c, uint8_t* pdata, uint16_t size, uint32_t timeout)
@@ -1119,7 +1280,7 @@ i2c_status_type i2c_slave_receive_dma(i2c_handle_type* hi2c, uint8_t* pdata, uin
   * @param  address: slave address.
   * @param  pdata: data buffer.
   * @param  size: data size.
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds.
   * @retval i2c status.
   */
 i2c_status_type i2c_master_receive_dma(i2c_handle_type* hi2c, uint16_t address, uint8_t* pdata, uint16_t size, uint32_t timeout)
@@ -1195,7 +1356,7 @@ i2c_status_type i2c_master_receive_dma(i2c_handle_type* hi2c, uint16_t address,
   * @param  hi2c: the handle points to the operation information.
   * @param  pdata: data buffer.
   * @param  size: data size.
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds.
   * @retval i2c status.
   */
 i2c_status_type i2c_slave_transmit_dma(i2c_handle_type* hi2c, uint8_t* pdata, uint16_t size, uint32_t timeout)
@@ -1246,7 +1407,7 @@ i2c_status_type i2c_slave_transmit_dma(i2c_handle_type* hi2c, uint8_t* pdata, ui
   *         - I2C_MEM_ADDR_WIDIH_16:  memory address is 16 bit
   * @param  address: memory device address.
   * @param  mem_address: memory address.
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds.
   * @retval i2c status.
   */
 i2c_status_type i2c_memory_address_send(i2c_handle_type* hi2c, i2c_mem_address_width_type mem_address_width, uint16_t mem_address, int32_t timeout)
@@ -1292,7 +1453,7 @@ i2c_status_type i2c_memory_address_send(i2c_handle_type* hi2c, i2c_mem_address_w
   * @param  mem_address: memory address.
   * @param  pdata: data buffer.
   * @param  size: data size.
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds.
   * @retval i2c status.
   */
 i2c_status_type i2c_memory_write(i2c_handle_type* hi2c, i2c_mem_address_width_type mem_address_width, uint16_t address, uint16_t mem_address, uint8_t* pdata, uint16_t size, uint32_t timeout)
@@ -1381,7 +1542,7 @@ i2c_status_type i2c_memory_write(i2c_handle_type* hi2c, i2c_mem_address_width_ty
   * @param  mem_address: memory address.
   * @param  pdata: data buffer.
   * @param  size: data size.
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds.
   * @retval i2c status.
   */
 i2c_status_type i2c_memory_read(i2c_handle_type* hi2c, i2c_mem_address_width_type mem_address_width, uint16_t address, uint16_t mem_address, uint8_t* pdata, uint16_t size, uint32_t timeout)
@@ -1594,7 +1755,7 @@ i2c_status_type i2c_memory_read(i2c_handle_type* hi2c, i2c_mem_address_width_typ
   * @param  mem_address: memory address.
   * @param  pdata: data buffer.
   * @param  size: data size.
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds.
   * @retval i2c status.
   */
 i2c_status_type i2c_memory_write_int(i2c_handle_type* hi2c, i2c_mem_address_width_type mem_address_width, uint16_t address, uint16_t mem_address, uint8_t* pdata, uint16_t size, uint32_t timeout)
@@ -1671,7 +1832,7 @@ i2c_status_type i2c_memory_write_int(i2c_handle_type* hi2c, i2c_mem_address_widt
   * @param  mem_address: memory address.
   * @param  pdata: data buffer.
   * @param  size: data size.
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds.
   * @retval i2c status.
   */
 i2c_status_type i2c_memory_read_int(i2c_handle_type* hi2c, i2c_mem_address_width_type mem_address_width, uint16_t address, uint16_t mem_address, uint8_t* pdata, uint16_t size, uint32_t timeout)
@@ -1788,7 +1949,7 @@ i2c_status_type i2c_memory_read_int(i2c_handle_type* hi2c, i2c_mem_address_width
   * @param  mem_address: memory address.
   * @param  pdata: data buffer.
   * @param  size: data size.
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds.
   * @retval i2c status.
   */
 i2c_status_type i2c_memory_write_dma(i2c_handle_type* hi2c, i2c_mem_address_width_type mem_address_width, uint16_t address, uint16_t mem_address, uint8_t* pdata, uint16_t size, uint32_t timeout)
@@ -1871,7 +2032,7 @@ i2c_status_type i2c_memory_write_dma(i2c_handle_type* hi2c, i2c_mem_address_widt
   * @param  mem_address: memory address.
   * @param  pdata: data buffer.
   * @param  size: data size.
-  * @param  timeout: maximum waiting time.
+  * @param  timeout: maximum waiting time in microseconds.
   * @retval i2c status.
   */
 i2c_status_type i2c_memory_read_dma(i2c_handle_type* hi2c, i2c_mem_address_width_type mem_address_width, uint16_t address, uint16_t mem_address, uint8_t* pdata, uint16_t size, uint32_t timeout)
@@ -2214,6 +2375,628 @@ void i2c_slave_tx_rx_isr_dma(i2c_handle_type* hi2c)
   }
 }
 
+/**
+  * @brief i2c queue transaction steps
+  */
+#define I2C_QUEUE_WRITE_START            0
+#define I2C_QUEUE_WRITE_ADDR             1
+#define I2C_QUEUE_WRITE                  2
+#define I2C_QUEUE_WRITE_DMA              3
+#define I2C_QUEUE_WRITE_END              4
+#define I2C_QUEUE_READ_START             5
+#define I2C_QUEUE_READ_ADDR              6
+#define I2C_QUEUE_READ                   7
+#define I2C_QUEUE_READ_DMA               8
+
+static i2c_transaction_type* i2c_queue_end(i2c_handle_type* hi2c, i2c_status_type status);
+static void i2c_queue_start(i2c_handle_type* hi2c);
+static void i2c_queue_complete(i2c_handle_type* hi2c, i2c_status_type status);
+static void i2c_queue_abort(i2c_handle_type* hi2c, i2c_status_type status);
+static void i2c_queue_write_isr(i2c_handle_type* hi2c);
+static void i2c_queue_read_addr_isr(i2c_handle_type* hi2c);
+static void i2c_queue_isr(i2c_handle_type* hi2c);
+
+/**
+  * @brief  end the current transaction and take the next one.
+  * @param  hi2c: the handle points to the operation information.
+  * @param  status: result of the transaction.
+  * @retval the next transaction, now current, 0 when the queue is empty.
+  */
+static i2c_transaction_type* i2c_queue_end(i2c_handle_type* hi2c, i2c_status_type status)
+{
+  i2c_transaction_type* ptrans = hi2c->queue_current;
+  i2c_transaction_type* pnext;
+  uint32_t primask;
+
+  /* disable interrupt and dma requests */
+  i2c_interrupt_enable(hi2c->i2cx, I2C_EVT_INT | I2C_DATA_INT | I2C_ERR_INT, FALSE);
+  i2c_dma_enable(hi2c->i2cx, FALSE);
+  i2c_dma_end_transfer_set(hi2c->i2cx, FALSE);
+
+  hi2c->status = I2C_END;
+
+  /* take the next transaction before the callback, which may submit one */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  pnext = hi2c->queue_head;
+  if(pnext != 0)
+  {
+    hi2c->queue_head = pnext->next;
+    if(hi2c->queue_head == 0)
+    {
+      hi2c->queue_tail = 0;
+    }
+  }
+  hi2c->queue_current = pnext;
+  __set_PRIMASK(primask);
+
+  if(ptrans != 0)
+  {
+    ptrans->status = status;
+    ptrans->state  = I2C_TRANSACTION_DONE;
+
+    if(ptrans->callback != 0)
+    {
+      ptrans->callback(ptrans);
+    }
+  }
+
+  return pnext;
+}
+
+/**
+  * @brief  put the current transaction of the queue on the bus.
+  * @note   runs in the interrupts that end a transaction, the wait for the
+  *         previous stop condition is bounded by I2C_QUEUE_STOP_TIMEOUT.
+  *         a transaction that cannot start ends with I2C_ERR_TIMEOUT and the
+  *         next one is tried, the caller can then free the bus with
+  *         i2c_bus_recover.
+  * @param  hi2c: the handle points to the operation information.
+  * @retval none.
+  */
+static void i2c_queue_start(i2c_handle_type* hi2c)
+{
+  i2c_transaction_type* ptrans = hi2c->queue_current;
+  i2c_timeout_type wait;
+
+  while(ptrans != 0)
+  {
+    hi2c->mode       = I2C_QUEUE_MA;
+    hi2c->status     = I2C_START;
+    hi2c->error_code = I2C_OK;
+    hi2c->queue_index = 0;
+    hi2c->queue_start_cycle = DWT->CYCCNT;
+
+    ptrans->state = I2C_TRANSACTION_ACTIVE;
+
+    if((ptrans->header_size + ptrans->tx_size) != 0 || ptrans->rx_size == 0)
+    {
+      hi2c->queue_phase = I2C_QUEUE_WRITE_START;
+    }
+    else
+    {
+      hi2c->queue_phase = I2C_QUEUE_READ_START;
+    }
+
+    /* ack acts on the current byte */
+    i2c_master_receive_ack_set(hi2c->i2cx, I2C_MASTER_ACK_CURRENT);
+
+    /* the stop condition of the previous transaction goes out first, a slave
+       holding scl low keeps it back */
+    i2c_timeout_start(&wait, I2C_QUEUE_STOP_TIMEOUT);
+
+    while(hi2c->i2cx->ctrl1_bit.genstop && i2c_timeout_check(&wait) == RESET);
+
+    if(hi2c->i2cx->ctrl1_bit.genstop == 0)
+    {
+      /* enable interrupt, the next steps run in i2c_evt_irq_handler */
+      i2c_interrupt_enable(hi2c->i2cx, I2C_EVT_INT | I2C_ERR_INT, TRUE);
+
+      /* generate start condtion */
+      i2c_start_generate(hi2c->i2cx);
+
+      return;
+    }
+
+    hi2c->timeout_count++;
+
+    ptrans = i2c_queue_end(hi2c, I2C_ERR_TIMEOUT);
+  }
+}
+
+/**
+  * @brief  end the current transaction and start the next one.
+  * @param  hi2c: the handle points to the operation information.
+  * @param  status: result of the transaction.
+  * @retval none.
+  */
+static void i2c_queue_complete(i2c_handle_type* hi2c, i2c_status_type status)
+{
+  if(i2c_queue_end(hi2c, status) != 0)
+  {
+    i2c_queue_start(hi2c);
+  }
+}
+
+/**
+  * @brief  end the current transaction on an error.
+  * @param  hi2c: the handle points to the operation information.
+  * @param  status: error of the transaction.
+  * @retval none.
+  */
+static void i2c_queue_abort(i2c_handle_type* hi2c, i2c_status_type status)
+{
+  /* stop the dma channels */
+  if(hi2c->dma_tx_channel != 0)
+  {
+    dma_interrupt_enable(hi2c->dma_tx_channel, DMA_FDT_INT, FALSE);
+    dma_channel_enable(hi2c->dma_tx_channel, FALSE);
+  }
+
+  if(hi2c->dma_rx_channel != 0)
+  {
+    dma_interrupt_enable(hi2c->dma_rx_channel, DMA_FDT_INT, FALSE);
+    dma_channel_enable(hi2c->dma_rx_channel, FALSE);
+  }
+
+  /* generate stop condtion */
+  i2c_stop_generate(hi2c->i2cx);
+
+  i2c_queue_complete(hi2c, status);
+}
+
+/**
+  * @brief  header and tx bytes step, called on the tdbe flag.
+  * @param  hi2c: the handle points to the operation information.
+  * @retval none.
+  */
+static void i2c_queue_write_isr(i2c_handle_type* hi2c)
+{
+  i2c_transaction_type* ptrans = hi2c->queue_current;
+  uint32_t index = hi2c->queue_index, remain;
+
+  if(index < ptrans->header_size)
+  {
+    /* write memory address */
+    i2c_data_send(hi2c->i2cx, ptrans->header[index]);
+    hi2c->queue_index++;
+    return;
+  }
+
+  index -= ptrans->header_size;
+  remain = ptrans->tx_size - index;
+
+  if(remain == 0)
+  {
+    /* wait for the tdc flag, the last byte is on the bus */
+    i2c_interrupt_enable(hi2c->i2cx, I2C_DATA_INT, FALSE);
+
+    hi2c->queue_phase = I2C_QUEUE_WRITE_END;
+  }
+  else if((remain >= I2C_QUEUE_DMA_THRESHOLD) && (hi2c->dma_tx_channel != 0))
+  {
+    /* the dma writes the rest, i2c_dma_tx_irq_handler enables the tdc interrupt */
+    i2c_interrupt_enable(hi2c->i2cx, I2C_EVT_INT | I2C_DATA_INT, FALSE);
+
+    hi2c->queue_phase = I2C_QUEUE_WRITE_DMA;
+    hi2c->queue_index += remain;
+
+    i2c_dma_config(hi2c, hi2c->dma_tx_channel, ptrans->tx_buff + index, remain);
+
+    /* enable dma request */
+    i2c_dma_enable(hi2c->i2cx, TRUE);
+  }
+  else
+  {
+    /* write data */
+    i2c_data_send(hi2c->i2cx, ptrans->tx_buff[index]);
+    hi2c->queue_index++;
+  }
+}
+
+/**
+  * @brief  slave address of the read step is acknowledged.
+  * @param  hi2c: the handle points to the operation information.
+  * @retval none.
+  */
+static void i2c_queue_read_addr_isr(i2c_handle_type* hi2c)
+{
+  i2c_transaction_type* ptrans = hi2c->queue_current;
+
+  hi2c->pbuff  = ptrans->rx_buff;
+  hi2c->pcount = ptrans->rx_size;
+
+  if((ptrans->rx_size >= I2C_QUEUE_DMA_THRESHOLD) && (ptrans->rx_size >= 2) && (hi2c->dma_rx_channel != 0))
+  {
+    hi2c->queue_phase = I2C_QUEUE_READ_DMA;
+
+    /* the dma reads the data, i2c_dma_rx_irq_handler ends the transaction */
+    i2c_interrupt_enable(hi2c->i2cx, I2C_EVT_INT | I2C_DATA_INT, FALSE);
+
+    i2c_dma_config(hi2c, hi2c->dma_rx_channel, ptrans->rx_buff, ptrans->rx_size);
+
+    /* enable dma end transfer */
+    i2c_dma_end_transfer_set(hi2c->i2cx, TRUE);
+
+    /* enable dma request */
+    i2c_dma_enable(hi2c->i2cx, TRUE);
+
+    /* clear addr flag */
+    i2c_flag_clear(hi2c->i2cx, I2C_ADDR7F_FLAG);
+    return;
+  }
+
+  hi2c->queue_phase = I2C_QUEUE_READ;
+
+  if(hi2c->pcount == 1)
+  {
+    /* disable ack */
+    i2c_ack_enable(hi2c->i2cx, FALSE);
+
+    /* clear addr flag */
+    i2c_flag_clear(hi2c->i2cx, I2C_ADDR7F_FLAG);
+
+    /* generate stop condtion */
+    i2c_stop_generate(hi2c->i2cx);
+  }
+  else if(hi2c->pcount == 2)
+  {
+    /* ack acts on the next byte */
+    i2c_master_receive_ack_set(hi2c->i2cx, I2C_MASTER_ACK_NEXT);
+
+    /* clear addr flag */
+    i2c_flag_clear(hi2c->i2cx, I2C_ADDR7F_FLAG);
+
+    /* disable ack */
+    i2c_ack_enable(hi2c->i2cx, FALSE);
+  }
+  else
+  {
+    /* clear addr flag */
+    i2c_flag_clear(hi2c->i2cx, I2C_ADDR7F_FLAG);
+  }
+
+  /* enable rdbf interrupt */
+  i2c_interrupt_enable(hi2c->i2cx, I2C_DATA_INT, TRUE);
+}
+
+/**
+  * @brief  queue interrupt procession function.
+  * @param  hi2c: the handle points to the operation information.
+  * @retval none.
+  */
+static void i2c_queue_isr(i2c_handle_type* hi2c)
+{
+  i2c_transaction_type* ptrans = hi2c->queue_current;
+
+  if(ptrans == 0)
+  {
+    /* disable interrupt */
+    i2c_interrupt_enable(hi2c->i2cx, I2C_EVT_INT | I2C_DATA_INT | I2C_ERR_INT, FALSE);
+    return;
+  }
+
+  switch(hi2c->queue_phase)
+  {
+    case I2C_QUEUE_WRITE_START:
+    case I2C_QUEUE_READ_START:
+      if(i2c_flag_get(hi2c->i2cx, I2C_STARTF_FLAG) != RESET)
+      {
+        if(hi2c->queue_phase == I2C_QUEUE_WRITE_START)
+        {
+          /* send slave address */
+          i2c_7bit_address_send(hi2c->i2cx, ptrans->address, I2C_DIRECTION_TRANSMIT);
+          hi2c->queue_phase = I2C_QUEUE_WRITE_ADDR;
+        }
+        else
+        {
+          /* enable ack */
+          i2c_ack_enable(hi2c->i2cx, TRUE);
+
+          /* send slave address */
+          i2c_7bit_address_send(hi2c->i2cx, ptrans->address, I2C_DIRECTION_RECEIVE);
+          hi2c->queue_phase = I2C_QUEUE_READ_ADDR;
+        }
+      }
+      break;
+
+    case I2C_QUEUE_WRITE_ADDR:
+      if(i2c_flag_get(hi2c->i2cx, I2C_ADDR7F_FLAG) != RESET)
+      {
+        /* clear addr flag */
+        i2c_flag_clear(hi2c->i2cx, I2C_ADDR7F_FLAG);
+
+        if((ptrans->header_size + ptrans->tx_size) == 0)
+        {
+          /* nothing to write, the slave is present */
+          i2c_stop_generate(hi2c->i2cx);
+
+          i2c_queue_complete(hi2c, I2C_OK);
+          break;
+        }
+
+        hi2c->queue_phase = I2C_QUEUE_WRITE;
+
+        /* enable tdbe interrupt */
+        i2c_interrupt_enable(hi2c->i2cx, I2C_DATA_INT, TRUE);
+      }
+      break;
+
+    case I2C_QUEUE_WRITE:
+      if(i2c_flag_get(hi2c->i2cx, I2C_TDBE_FLAG) != RESET)
+      {
+        i2c_queue_write_isr(hi2c);
+      }
+      break;
+
+    case I2C_QUEUE_WRITE_DMA:
+    case I2C_QUEUE_WRITE_END:
+      if(i2c_flag_get(hi2c->i2cx, I2C_TDC_FLAG) != RESET)
+      {
+        if(ptrans->rx_size != 0)
+        {
+          hi2c->queue_phase = I2C_QUEUE_READ_START;
+
+          /* generate restart condtion */
+          i2c_start_generate(hi2c->i2cx);
+        }
+        else
+        {
+          /* generate stop condtion */
+          i2c_stop_generate(hi2c->i2cx);
+
+          i2c_queue_complete(hi2c, I2C_OK);
+        }
+      }
+      break;
+
+    case I2C_QUEUE_READ_ADDR:
+      if(i2c_flag_get(hi2c->i2cx, I2C_ADDR7F_FLAG) != RESET)
+      {
+        i2c_queue_read_addr_isr(hi2c);
+      }
+      break;
+
+    case I2C_QUEUE_READ:
+      i2c_master_rx_isr_int(hi2c);
+
+      if(hi2c->status == I2C_END)
+      {
+        i2c_queue_complete(hi2c, I2C_OK);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  prepare a transaction writing data to a slave.
+  * @note   callback and param are left unchanged.
+  * @param  ptrans: the transaction.
+  * @param  address: slave address.
+  * @param  pdata: data buffer.
+  * @param  size: data size, 0 only checks that the slave acknowledges.
+  * @retval none.
+  */
+void i2c_transaction_write(i2c_transaction_type* ptrans, uint16_t address, uint8_t* pdata, uint16_t size)
+{
+  i2c_transaction_write_read(ptrans, address, pdata, size, 0, 0);
+}
+
+/**
+  * @brief  prepare a transaction reading data from a slave.
+  * @note   callback and param are left unchanged.
+  * @param  ptrans: the transaction.
+  * @param  address: slave address.
+  * @param  pdata: data buffer.
+  * @param  size: data size.
+  * @retval none.
+  */
+void i2c_transaction_read(i2c_transaction_type* ptrans, uint16_t address, uint8_t* pdata, uint16_t size)
+{
+  i2c_transaction_write_read(ptrans, address, 0, 0, pdata, size);
+}
+
+/**
+  * @brief  prepare a transaction writing data, then reading data after a
+  *         restart condition.
+  * @note   callback and param are left unchanged.
+  * @param  ptrans: the transaction.
+  * @param  address: slave address.
+  * @param  ptx: data written.
+  * @param  tx_size: size written.
+  * @param  prx: data read.
+  * @param  rx_size: size read, 0 for a write only.
+  * @retval none.
+  */
+void i2c_transaction_write_read(i2c_transaction_type* ptrans, uint16_t address, uint8_t* ptx, uint16_t tx_size, uint8_t* prx, uint16_t rx_size)
+{
+  ptrans->address     = address;
+  ptrans->header_size = 0;
+  ptrans->tx_buff     = ptx;
+  ptrans->tx_size     = tx_size;
+  ptrans->rx_buff     = prx;
+  ptrans->rx_size     = rx_size;
+}
+
+/**
+  * @brief  prepare a transaction writing data to a memory device.
+  * @note   callback and param are left unchanged.
+  * @param  ptrans: the transaction.
+  * @param  mem_address_width: memory address width.
+  *         this parameter can be one of the following values:
+  *         - I2C_MEM_ADDR_WIDIH_8:  memory address is 8 bit
+  *         - I2C_MEM_ADDR_WIDIH_16:  memory address is 16 bit
+  * @param  address: memory device address.
+  * @param  mem_address: memory address.
+  * @param  pdata: data buffer.
+  * @param  size: data size.
+  * @retval none.
+  */
+void i2c_transaction_memory_write(i2c_transaction_type* ptrans, i2c_mem_address_width_type mem_address_width, uint16_t address, uint16_t mem_address, uint8_t* pdata, uint16_t size)
+{
+  i2c_transaction_write_read(ptrans, address, pdata, size, 0, 0);
+
+  if(mem_address_width == I2C_MEM_ADDR_WIDIH_8)
+  {
+    ptrans->header[0] = mem_address & 0xFF;
+    ptrans->header_size = 1;
+  }
+  else
+  {
+    ptrans->header[0] = (mem_address >> 8) & 0xFF;
+    ptrans->header[1] = mem_address & 0xFF;
+    ptrans->header_size = 2;
+  }
+}
+
+/**
+  * @brief  prepare a transaction reading data from a memory device.
+  * @note   callback and param are left unchanged.
+  * @param  ptrans: the transaction.
+  * @param  mem_address_width: memory address width.
+  *         this parameter can be one of the following values:
+  *         - I2C_MEM_ADDR_WIDIH_8:  memory address is 8 bit
+  *         - I2C_MEM_ADDR_WIDIH_16:  memory address is 16 bit
+  * @param  address: memory device address.
+  * @param  mem_address: memory address.
+  * @param  pdata: data buffer.
+  * @param  size: data size.
+  * @retval none.
+  */
+void i2c_transaction_memory_read(i2c_transaction_type* ptrans, i2c_mem_address_width_type mem_address_width, uint16_t address, uint16_t mem_address, uint8_t* pdata, uint16_t size)
+{
+  i2c_transaction_memory_write(ptrans, mem_address_width, address, mem_address, 0, 0);
+
+  ptrans->rx_buff = pdata;
+  ptrans->rx_size = size;
+}
+
+/**
+  * @brief  queue a transaction, it starts at once when the bus is idle.
+  * @note   the transaction and its buffers must stay valid until its state
+  *         is I2C_TRANSACTION_DONE. may be called from interrupts and from
+  *         the completion callback. the handle must not be used by the
+  *         other transfer functions while transactions are queued.
+  * @param  hi2c: the handle points to the operation information.
+  * @param  ptrans: the transaction.
+  * @retval i2c status.
+  */
+i2c_status_type i2c_queue_submit(i2c_handle_type* hi2c, i2c_transaction_type* ptrans)
+{
+  uint32_t primask;
+  uint8_t start;
+
+  if(hi2c->i2cx->oaddr1_bit.addr1mode != I2C_ADDRESS_MODE_7BIT)
+  {
+    ptrans->status = I2C_ERR_ADDR10;
+    ptrans->state  = I2C_TRANSACTION_DONE;
+
+    return I2C_ERR_ADDR10;
+  }
+
+  ptrans->next   = 0;
+  ptrans->status = I2C_OK;
+  ptrans->state  = I2C_TRANSACTION_QUEUED;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  start = (hi2c->queue_current == 0);
+  if(start)
+  {
+    hi2c->queue_current = ptrans;
+  }
+  else if(hi2c->queue_tail == 0)
+  {
+    hi2c->queue_head = ptrans;
+    hi2c->queue_tail = ptrans;
+  }
+  else
+  {
+    hi2c->queue_tail->next = ptrans;
+    hi2c->queue_tail = ptrans;
+  }
+  __set_PRIMASK(primask);
+
+  if(start)
+  {
+    i2c_queue_start(hi2c);
+  }
+
+  return I2C_OK;
+}
+
+/**
+  * @brief  wait for a submitted transaction to end.
+  * @note   the timeout is counted from the start of the transaction on the
+  *         bus, not from the call. once it elapses the transaction is stuck:
+  *         it ends with I2C_ERR_TIMEOUT, the bus is recovered and the queue
+  *         goes on. the wait continues while ptrans is still queued behind it.
+  * @param  hi2c: the handle points to the operation information.
+  * @param  ptrans: the transaction.
+  * @param  timeout: maximum waiting time in microseconds.
+  * @retval i2c status of the transaction.
+  */
+i2c_status_type i2c_transaction_wait(i2c_handle_type* hi2c, i2c_transaction_type* ptrans, uint32_t timeout)
+{
+  i2c_transaction_type* pstuck;
+  i2c_transaction_type* pcurrent = 0;
+  i2c_timeout_type wait;
+  uint32_t primask;
+
+  while(ptrans->state != I2C_TRANSACTION_DONE)
+  {
+    /* every transaction on the bus gets the timeout from its own start */
+    if(hi2c->queue_current != pcurrent)
+    {
+      pcurrent = hi2c->queue_current;
+      wait.cycle  = hi2c->queue_start_cycle;
+      wait.remain = timeout;
+    }
+
+    if(pcurrent == 0 || i2c_timeout_check(&wait) == RESET)
+    {
+      continue;
+    }
+
+    /* stop the interrupts of the stuck transaction */
+    primask = __get_PRIMASK();
+    __disable_irq();
+    pstuck = hi2c->queue_current;
+    if(pstuck != 0)
+    {
+      i2c_interrupt_enable(hi2c->i2cx, I2C_EVT_INT | I2C_DATA_INT | I2C_ERR_INT, FALSE);
+
+      if(hi2c->dma_tx_channel != 0)
+      {
+        dma_interrupt_enable(hi2c->dma_tx_channel, DMA_FDT_INT, FALSE);
+        dma_channel_enable(hi2c->dma_tx_channel, FALSE);
+      }
+
+      if(hi2c->dma_rx_channel != 0)
+      {
+        dma_interrupt_enable(hi2c->dma_rx_channel, DMA_FDT_INT, FALSE);
+        dma_channel_enable(hi2c->dma_rx_channel, FALSE);
+      }
+    }
+    __set_PRIMASK(primask);
+
+    if(pstuck != 0)
+    {
+      hi2c->timeout_count++;
+
+      /* free the bus, then end the transaction and start the next one */
+      i2c_bus_recover(hi2c);
+
+      i2c_queue_complete(hi2c, I2C_ERR_TIMEOUT);
+    }
+  }
+
+  return ptrans->status;
+}
+
 /**
   * @brief  interrupt procession function.
   * @param  hi2c: the handle points to the operation information.
@@ -2242,6 +3025,9 @@ void i2c_evt_irq_handler(i2c_handle_type* hi2c)
     case I2C_DMA_SLA_RX:
       i2c_slave_tx_rx_isr_dma(hi2c);
       break;
+    case I2C_QUEUE_MA:
+      i2c_queue_isr(hi2c);
+      break;
     default:
       break;
   }
@@ -2271,6 +3057,7 @@ void i2c_dma_tx_irq_handler(i2c_handle_type* hi2c)
     switch(hi2c->mode)
     {
       case I2C_DMA_MA_TX:
+      case I2C_QUEUE_MA:
         /* enable tdc interrupt, generate stop condition in tdc interrupt */
         i2c_interrupt_enable(hi2c->i2cx, I2C_EVT_INT, TRUE);
         break;
@@ -2324,6 +3111,12 @@ void i2c_dma_rx_irq_handler(i2c_handle_type* hi2c)
         /* enable stop interrupt, wait for the stop flag to be set  */
         i2c_interrupt_enable(hi2c->i2cx, I2C_EVT_INT, TRUE);
         break;
+      case I2C_QUEUE_MA:
+        /* generate stop condtion */
+        i2c_stop_generate(hi2c->i2cx);
+
+        i2c_queue_complete(hi2c, I2C_OK);
+        break;
       default:
         break;
     }
@@ -2342,6 +3135,7 @@ void i2c_err_irq_handler(i2c_handle_type* hi2c)
   {
     i2c_flag_clear(hi2c->i2cx, I2C_BUSERR_FLAG);
 
+    hi2c->error_count++;
     hi2c->error_code = I2C_ERR_INTERRUPT;
   }
 
@@ -2350,6 +3144,7 @@ void i2c_err_irq_handler(i2c_handle_type* hi2c)
   {
     i2c_flag_clear(hi2c->i2cx, I2C_ARLOST_FLAG);
 
+    hi2c->error_count++;
     hi2c->error_code = I2C_ERR_INTERRUPT;
   }
 
@@ -2370,7 +3165,13 @@ void i2c_err_irq_handler(i2c_handle_type* hi2c)
         /* transfer complete */
         hi2c->status = I2C_END;
         break;
+      case I2C_QUEUE_MA:
+        /* the slave did not acknowledge */
+        hi2c->error_count++;
+        hi2c->error_code = I2C_ERR_ACKFAIL;
+        break;
       default:
+        hi2c->error_count++;
         hi2c->error_code = I2C_ERR_INTERRUPT;
         break;
     }
@@ -2381,6 +3182,7 @@ void i2c_err_irq_handler(i2c_handle_type* hi2c)
   {
     i2c_flag_clear(hi2c->i2cx, I2C_OUF_FLAG);
 
+    hi2c->error_count++;
     hi2c->error_code = I2C_ERR_INTERRUPT;
   }
 
@@ -2389,6 +3191,7 @@ void i2c_err_irq_handler(i2c_handle_type* hi2c)
   {
     i2c_flag_clear(hi2c->i2cx, I2C_PECERR_FLAG);
 
+    hi2c->error_count++;
     hi2c->error_code = I2C_ERR_INTERRUPT;
   }
 
@@ -2397,6 +3200,7 @@ void i2c_err_irq_handler(i2c_handle_type* hi2c)
   {
     i2c_flag_clear(hi2c->i2cx, I2C_TMOUT_FLAG);
 
+    hi2c->error_count++;
     hi2c->error_code = I2C_ERR_INTERRUPT;
   }
 
@@ -2405,9 +3209,18 @@ void i2c_err_irq_handler(i2c_handle_type* hi2c)
   {
     i2c_flag_clear(hi2c->i2cx, I2C_ALERTF_FLAG);
 
+    hi2c->error_count++;
     hi2c->error_code = I2C_ERR_INTERRUPT;
   }
 
+  /* end the transaction, then run the next one */
+  if((hi2c->mode == I2C_QUEUE_MA) && (hi2c->error_code != I2C_OK) && (hi2c->queue_current != 0))
+  {
+    i2c_queue_abort(hi2c, hi2c->error_code);
+
+    return;
+  }
+
   /* disable all interrupts */
   i2c_interrupt_enable(hi2c->i2cx, I2C_ERR_INT, FALSE);
 }
@@ -46,6 +46,50 @@ extern "C" {
 #define I2C_EVENT_CHECK_ACKFAIL          ((uint32_t)0x00000001)    /*!< check flag ackfail */
 #define I2C_EVENT_CHECK_STOP             ((uint32_t)0x00000002)    /*!< check flag stop */
 
+/**
+  * @}
+  */
+
+/** @defgroup I2C_library_timeout_and_recovery
+  * @brief    the timeout of every function is in microseconds, measured with
+  *           the dwt cycle counter enabled by i2c_config. when scl and sda
+  *           pins are set in the handle, a bus still busy at the end of the
+  *           timeout is recovered: the pins are driven by gpio, up to
+  *           I2C_RECOVERY_CLOCKS clocks let a slave finish the byte holding
+  *           sda low, a stop condition follows and the peripheral is reset
+  *           and set up again by i2c_config.
+  * @{
+  */
+
+#define I2C_RECOVERY_CLOCKS              9
+#define I2C_RECOVERY_HALF_PERIOD_US      5          /*!< 100khz clock */
+
+/**
+  * @}
+  */
+
+/** @defgroup I2C_library_queue_definition
+  * @brief    transactions submitted with i2c_queue_submit run one after the
+  *           other, each one is started from the interrupt that ends the
+  *           previous one. a transaction writes its header and tx bytes,
+  *           then reads its rx bytes after a restart. tx or rx data of
+  *           I2C_QUEUE_DMA_THRESHOLD bytes or more goes through the dma
+  *           channels of the handle when they are set, shorter data is moved
+  *           by the data interrupt. only 7-bit slave addresses are supported.
+  *           a transaction waits I2C_QUEUE_STOP_TIMEOUT microseconds at most
+  *           for the stop condition of the previous one, it ends with
+  *           I2C_ERR_TIMEOUT when a slave holds scl low meanwhile.
+  * @{
+  */
+
+#ifndef I2C_QUEUE_DMA_THRESHOLD
+#define I2C_QUEUE_DMA_THRESHOLD          4
+#endif
+
+#ifndef I2C_QUEUE_STOP_TIMEOUT
+#define I2C_QUEUE_STOP_TIMEOUT           1000
+#endif
+
 /**
   * @}
   */
@@ -78,6 +122,7 @@ typedef enum
   I2C_DMA_MA_RX,
   I2C_DMA_SLA_TX,
   I2C_DMA_SLA_RX,
+  I2C_QUEUE_MA,
 } i2c_mode_type;
 
 
@@ -111,9 +156,52 @@ typedef enum
   I2C_ERR_ACKFAIL,     /*!< ackfail error */
   I2C_ERR_TIMEOUT,     /*!< timeout error */
   I2C_ERR_INTERRUPT,   /*!< interrupt error */
+  I2C_ERR_BUS,         /*!< bus still held low after a recovery */
+  I2C_ERR_PARAM,       /*!< parameter error */
+  I2C_ERR_BUSY,        /*!< an operation is in progress */
 
 } i2c_status_type;
 
+/**
+  * @}
+  */
+
+/** @defgroup I2C_library_transaction
+  * @{
+  */
+
+typedef enum
+{
+  I2C_TRANSACTION_IDLE = 0,            /*!< never submitted */
+  I2C_TRANSACTION_QUEUED,              /*!< waiting for the bus */
+  I2C_TRANSACTION_ACTIVE,              /*!< on the bus */
+  I2C_TRANSACTION_DONE,                /*!< ended, status holds the result */
+} i2c_transaction_state_type;
+
+typedef struct i2c_transaction_struct i2c_transaction_type;
+
+/**
+  * @brief  completion callback, called from the i2c or dma interrupt. it may
+  *         submit transactions, or notify a task in rtos applications.
+  */
+typedef void (*i2c_callback_type)(i2c_transaction_type* ptrans);
+
+struct i2c_transaction_struct
+{
+  uint16_t                               address;                 /*!< 7-bit slave address             */
+  uint8_t                                header[2];               /*!< memory address, sent first      */
+  uint8_t                                header_size;             /*!< 0 to 2                          */
+  uint8_t                                *tx_buff;                /*!< written after the header        */
+  uint16_t                               tx_size;
+  uint8_t                                *rx_buff;                /*!< read after a restart            */
+  uint16_t                               rx_size;
+  i2c_callback_type                      callback;                /*!< may be 0                        */
+  void                                   *param;                  /*!< for the callback                */
+  __IO i2c_transaction_state_type        state;
+  __IO i2c_status_type                   status;                  /*!< result once done                */
+  i2c_transaction_type                   *next;                   /*!< queue link, owned by the handle */
+};
+
 /**
   * @}
   */
@@ -134,6 +222,19 @@ typedef struct
   dma_channel_type                       *dma_tx_channel;         /*!< dma transmit channel            */
   dma_channel_type                       *dma_rx_channel;         /*!< dma receive channel             */
   dma_init_type                          dma_init_struct;         /*!< dma init parameters             */
+  i2c_transaction_type                   *queue_head;             /*!< transactions waiting            */
+  i2c_transaction_type                   *queue_tail;
+  i2c_transaction_type                   *queue_current;          /*!< transaction on the bus          */
+  __IO uint8_t                           queue_phase;             /*!< step of the current transaction */
+  uint32_t                               queue_index;             /*!< header and tx bytes written     */
+  uint32_t                               queue_start_cycle;       /*!< dwt cycle the current one began */
+  gpio_type                              *scl_gpio;               /*!< scl pin, 0 disables recovery    */
+  uint16_t                               scl_pin;
+  gpio_type                              *sda_gpio;               /*!< sda pin                         */
+  uint16_t                               sda_pin;
+  uint32_t                               error_count;             /*!< bus errors, ackfail and stop    */
+  uint32_t                               timeout_count;           /*!< timeouts                        */
+  uint32_t                               recovery_count;          /*!< bus recoveries                  */
 } i2c_handle_type;
 
 /**
@@ -148,6 +249,7 @@ void            i2c_config                (i2c_handle_type* hi2c);
 void            i2c_lowlevel_init         (i2c_handle_type* hi2c);
 i2c_status_type i2c_wait_end              (i2c_handle_type* hi2c, uint32_t timeout);
 i2c_status_type i2c_wait_flag             (i2c_handle_type* hi2c, uint32_t flag, uint32_t event_check, uint32_t timeout);
+i2c_status_type i2c_bus_recover           (i2c_handle_type* hi2c);
 
 i2c_status_type i2c_master_transmit       (i2c_handle_type* hi2c, uint16_t address, uint8_t* pdata, uint16_t size, uint32_t timeout);
 i2c_status_type i2c_master_receive        (i2c_handle_type* hi2c, uint16_t address, uint8_t* pdata, uint16_t size, uint32_t timeout);
@@ -171,6 +273,14 @@ i2c_status_type i2c_memory_read           (i2c_handle_type* hi2c, i2c_mem_addres
 i2c_status_type i2c_memory_read_int       (i2c_handle_type* hi2c, i2c_mem_address_width_type mem_address_width, uint16_t address, uint16_t mem_address, uint8_t* pdata, uint16_t size, uint32_t timeout);
 i2c_status_type i2c_memory_read_dma       (i2c_handle_type* hi2c, i2c_mem_address_width_type mem_address_width, uint16_t address, uint16_t mem_address, uint8_t* pdata, uint16_t size, uint32_t timeout);
 
+void            i2c_transaction_write     (i2c_transaction_type* ptrans, uint16_t address, uint8_t* pdata, uint16_t size);
+void            i2c_transaction_read      (i2c_transaction_type* ptrans, uint16_t address, uint8_t* pdata, uint16_t size);
+void            i2c_transaction_write_read(i2c_transaction_type* ptrans, uint16_t address, uint8_t* ptx, uint16_t tx_size, uint8_t* prx, uint16_t rx_size);
+void            i2c_transaction_memory_write(i2c_transaction_type* ptrans, i2c_mem_address_width_type mem_address_width, uint16_t address, uint16_t mem_address, uint8_t* pdata, uint16_t size);
+void            i2c_transaction_memory_read(i2c_transaction_type* ptrans, i2c_mem_address_width_type mem_address_width, uint16_t address, uint16_t mem_address, uint8_t* pdata, uint16_t size);
+i2c_status_type i2c_queue_submit          (i2c_handle_type* hi2c, i2c_transaction_type* ptrans);
+i2c_status_type i2c_transaction_wait      (i2c_handle_type* hi2c, i2c_transaction_type* ptrans, uint32_t timeout);
+
 void            i2c_evt_irq_handler       (i2c_handle_type* hi2c);
 void            i2c_err_irq_handler       (i2c_handle_type* hi2c);
 void            i2c_dma_tx_irq_handler    (i2c_handle_type* hi2c);
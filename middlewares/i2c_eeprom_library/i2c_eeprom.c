@@ -0,0 +1,401 @@
+/**
+  **************************************************************************
+  * @file     i2c_eeprom.c
+  * @brief    page-aware i2c eeprom driver
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+#include "i2c_eeprom.h"
+
+/** @addtogroup AT32F403A_407_middlewares_i2c_eeprom_library
+  * @{
+  */
+
+/**
+  * @brief eeprom geometry, indexed by eeprom_model_type
+  */
+const eeprom_geometry_type eeprom_geometry[EEPROM_MODEL_NUM] =
+{
+  {256,   8,   I2C_MEM_ADDR_WIDIH_8},   /* 24c02 */
+  {512,   16,  I2C_MEM_ADDR_WIDIH_8},   /* 24c04 */
+  {1024,  16,  I2C_MEM_ADDR_WIDIH_8},   /* 24c08 */
+  {2048,  16,  I2C_MEM_ADDR_WIDIH_8},   /* 24c16 */
+  {4096,  32,  I2C_MEM_ADDR_WIDIH_16},  /* 24c32 */
+  {8192,  32,  I2C_MEM_ADDR_WIDIH_16},  /* 24c64 */
+  {16384, 64,  I2C_MEM_ADDR_WIDIH_16},  /* 24c128 */
+  {32768, 64,  I2C_MEM_ADDR_WIDIH_16},  /* 24c256 */
+  {65536, 128, I2C_MEM_ADDR_WIDIH_16},  /* 24c512 */
+};
+
+static void eeprom_end(eeprom_handle_type* hee, i2c_status_type status);
+static void eeprom_submit(eeprom_handle_type* hee);
+static i2c_transaction_type* eeprom_transaction_next(eeprom_handle_type* hee);
+static void eeprom_step(eeprom_handle_type* hee);
+static void eeprom_poll(eeprom_handle_type* hee);
+static void eeprom_transaction_complete(i2c_transaction_type* ptrans);
+static i2c_status_type eeprom_start(eeprom_handle_type* hee, uint8_t write, uint32_t mem_address, uint8_t* pdata, uint32_t size, eeprom_callback_type callback);
+
+/**
+  * @brief  end the operation.
+  * @param  hee: the eeprom.
+  * @param  status: result of the operation.
+  * @retval none.
+  */
+static void eeprom_end(eeprom_handle_type* hee, i2c_status_type status)
+{
+  hee->status = status;
+  hee->busy = 0;
+
+  if(hee->callback != 0)
+  {
+    hee->callback(hee);
+  }
+}
+
+/**
+  * @brief  submit a transaction prepared in hee->current.
+  * @param  hee: the eeprom.
+  * @retval none.
+  */
+static void eeprom_submit(eeprom_handle_type* hee)
+{
+  i2c_status_type status;
+
+  status = i2c_queue_submit(hee->hi2c, hee->current);
+
+  if(status != I2C_OK)
+  {
+    eeprom_end(hee, status);
+  }
+}
+
+/**
+  * @brief  take the transaction not used by the previous step.
+  * @param  hee: the eeprom.
+  * @retval the transaction.
+  */
+static i2c_transaction_type* eeprom_transaction_next(eeprom_handle_type* hee)
+{
+  hee->current = (hee->current == &hee->trans[0]) ? &hee->trans[1] : &hee->trans[0];
+
+  return hee->current;
+}
+
+/**
+  * @brief  write the next page or read the next block, or end the operation.
+  * @param  hee: the eeprom.
+  * @retval none.
+  */
+static void eeprom_step(eeprom_handle_type* hee)
+{
+  const eeprom_geometry_type* geometry = hee->geometry;
+  i2c_transaction_type* ptrans;
+  uint16_t device = hee->address;
+  uint32_t chunk;
+
+  if(hee->remain == 0)
+  {
+    eeprom_end(hee, I2C_OK);
+    return;
+  }
+
+  if(geometry->address_width == I2C_MEM_ADDR_WIDIH_8)
+  {
+    /* the upper memory address bits select the 256 bytes block */
+    device |= (hee->mem_address >> 7) & 0x0E;
+  }
+
+  if(hee->write)
+  {
+    /* up to the end of the page */
+    chunk = geometry->page_size - (hee->mem_address % geometry->page_size);
+  }
+  else if(geometry->address_width == I2C_MEM_ADDR_WIDIH_8)
+  {
+    /* up to the end of the block */
+    chunk = 256 - (hee->mem_address & 0xFF);
+  }
+  else
+  {
+    chunk = EEPROM_READ_MAX;
+  }
+
+  if(chunk > hee->remain)
+  {
+    chunk = hee->remain;
+  }
+
+  hee->chunk = chunk;
+  ptrans = eeprom_transaction_next(hee);
+
+  if(hee->write)
+  {
+    i2c_transaction_memory_write(ptrans, geometry->address_width, device, (uint16_t)hee->mem_address, hee->pbuff, (uint16_t)chunk);
+  }
+  else
+  {
+    i2c_transaction_memory_read(ptrans, geometry->address_width, device, (uint16_t)hee->mem_address, hee->pbuff, (uint16_t)chunk);
+  }
+
+  eeprom_submit(hee);
+}
+
+/**
+  * @brief  address the eeprom without data, it acknowledges once the write
+  *         cycle is over.
+  * @param  hee: the eeprom.
+  * @retval none.
+  */
+static void eeprom_poll(eeprom_handle_type* hee)
+{
+  hee->polls++;
+
+  i2c_transaction_write(eeprom_transaction_next(hee), hee->address, 0, 0);
+
+  eeprom_submit(hee);
+}
+
+/**
+  * @brief  transaction complete, runs the next step.
+  * @param  ptrans: the transaction, param points to the eeprom.
+  * @retval none.
+  */
+static void eeprom_transaction_complete(i2c_transaction_type* ptrans)
+{
+  eeprom_handle_type* hee = (eeprom_handle_type*)ptrans->param;
+  uint32_t cycles = EEPROM_WRITE_TIME_US * (system_core_clock / 1000000);
+
+  if(hee->polling)
+  {
+    if(ptrans->status == I2C_OK)
+    {
+      /* write cycle over */
+      hee->polling = 0;
+      eeprom_step(hee);
+    }
+    else if((ptrans->status == I2C_ERR_ACKFAIL) && ((DWT->CYCCNT - hee->poll_start) < cycles))
+    {
+      /* still writing */
+      eeprom_poll(hee);
+    }
+    else
+    {
+      hee->polling = 0;
+      eeprom_end(hee, (ptrans->status == I2C_ERR_ACKFAIL) ? I2C_ERR_TIMEOUT : ptrans->status);
+    }
+    return;
+  }
+
+  if(ptrans->status != I2C_OK)
+  {
+    eeprom_end(hee, ptrans->status);
+    return;
+  }
+
+  hee->pbuff       += hee->chunk;
+  hee->mem_address += hee->chunk;
+  hee->remain      -= hee->chunk;
+
+  if(hee->write)
+  {
+    /* the write cycle starts with the stop condition */
+    hee->pages++;
+    hee->polling = 1;
+    hee->poll_start = DWT->CYCCNT;
+    eeprom_poll(hee);
+  }
+  else
+  {
+    eeprom_step(hee);
+  }
+}
+
+/**
+  * @brief  start a write or read operation.
+  * @param  hee: the eeprom.
+  * @param  write: 1 to write.
+  * @param  mem_address: memory address.
+  * @param  pdata: data buffer.
+  * @param  size: data size.
+  * @param  callback: called at the end, may be 0.
+  * @retval i2c status.
+  */
+static i2c_status_type eeprom_start(eeprom_handle_type* hee, uint8_t write, uint32_t mem_address, uint8_t* pdata, uint32_t size, eeprom_callback_type callback)
+{
+  uint32_t primask;
+
+  if((mem_address > hee->geometry->size) || (size > hee->geometry->size - mem_address))
+  {
+    return I2C_ERR_PARAM;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if(hee->busy)
+  {
+    __set_PRIMASK(primask);
+
+    return I2C_ERR_BUSY;
+  }
+  hee->busy = 1;
+  __set_PRIMASK(primask);
+
+  hee->write       = write;
+  hee->polling     = 0;
+  hee->mem_address = mem_address;
+  hee->pbuff       = pdata;
+  hee->remain      = size;
+  hee->callback    = callback;
+  hee->status      = I2C_OK;
+
+  eeprom_step(hee);
+
+  return I2C_OK;
+}
+
+/**
+  * @brief  initializes an eeprom handle.
+  * @param  hee: the eeprom.
+  * @param  hi2c: i2c handle, set up by i2c_config.
+  * @param  model: eeprom model.
+  * @param  address: device address, 0xA0 with the a2 to a0 pins.
+  * @retval i2c status.
+  */
+i2c_status_type eeprom_init(eeprom_handle_type* hee, i2c_handle_type* hi2c, eeprom_model_type model, uint16_t address)
+{
+  uint32_t i;
+
+  if(model >= EEPROM_MODEL_NUM)
+  {
+    return I2C_ERR_PARAM;
+  }
+
+  hee->hi2c     = hi2c;
+  hee->geometry = &eeprom_geometry[model];
+  hee->address  = address;
+  hee->current  = &hee->trans[0];
+  hee->busy     = 0;
+  hee->status   = I2C_OK;
+  hee->pages    = 0;
+  hee->polls    = 0;
+
+  for(i = 0; i < 2; i++)
+  {
+    hee->trans[i].callback = eeprom_transaction_complete;
+    hee->trans[i].param    = hee;
+    hee->trans[i].state    = I2C_TRANSACTION_IDLE;
+  }
+
+  return I2C_OK;
+}
+
+/**
+  * @brief  write data, the operation goes on in the interrupts.
+  * @param  hee: the eeprom.
+  * @param  mem_address: memory address.
+  * @param  pdata: data buffer, kept until the end.
+  * @param  size: data size.
+  * @param  callback: called at the end, may be 0.
+  * @retval i2c status.
+  */
+i2c_status_type eeprom_write_async(eeprom_handle_type* hee, uint32_t mem_address, uint8_t* pdata, uint32_t size, eeprom_callback_type callback)
+{
+  return eeprom_start(hee, 1, mem_address, pdata, size, callback);
+}
+
+/**
+  * @brief  read data, the operation goes on in the interrupts.
+  * @param  hee: the eeprom.
+  * @param  mem_address: memory address.
+  * @param  pdata: data buffer.
+  * @param  size: data size.
+  * @param  callback: called at the end, may be 0.
+  * @retval i2c status.
+  */
+i2c_status_type eeprom_read_async(eeprom_handle_type* hee, uint32_t mem_address, uint8_t* pdata, uint32_t size, eeprom_callback_type callback)
+{
+  return eeprom_start(hee, 0, mem_address, pdata, size, callback);
+}
+
+/**
+  * @brief  wait for the end of the operation.
+  * @param  hee: the eeprom.
+  * @param  timeout: maximum waiting time of each transaction in microseconds.
+  * @retval i2c status of the operation.
+  */
+i2c_status_type eeprom_wait(eeprom_handle_type* hee, uint32_t timeout)
+{
+  while(hee->busy)
+  {
+    i2c_transaction_wait(hee->hi2c, hee->current, timeout);
+  }
+
+  return hee->status;
+}
+
+/**
+  * @brief  write data and wait for the end of the last write cycle.
+  * @param  hee: the eeprom.
+  * @param  mem_address: memory address.
+  * @param  pdata: data buffer.
+  * @param  size: data size.
+  * @param  timeout: maximum waiting time of each transaction in microseconds.
+  * @retval i2c status.
+  */
+i2c_status_type eeprom_write(eeprom_handle_type* hee, uint32_t mem_address, uint8_t* pdata, uint32_t size, uint32_t timeout)
+{
+  i2c_status_type status;
+
+  status = eeprom_write_async(hee, mem_address, pdata, size, 0);
+
+  if(status != I2C_OK)
+  {
+    return status;
+  }
+
+  return eeprom_wait(hee, timeout);
+}
+
+/**
+  * @brief  read data.
+  * @param  hee: the eeprom.
+  * @param  mem_address: memory address.
+  * @param  pdata: data buffer.
+  * @param  size: data size.
+  * @param  timeout: maximum waiting time of each transaction in microseconds.
+  * @retval i2c status.
+  */
+i2c_status_type eeprom_read(eeprom_handle_type* hee, uint32_t mem_address, uint8_t* pdata, uint32_t size, uint32_t timeout)
+{
+  i2c_status_type status;
+
+  status = eeprom_read_async(hee, mem_address, pdata, size, 0);
+
+  if(status != I2C_OK)
+  {
+    return status;
+  }
+
+  return eeprom_wait(hee, timeout);
+}
+
+/**
+  * @}
+  */
@@ -0,0 +1,156 @@
+/**
+  **************************************************************************
+  * @file     i2c_eeprom.h
+  * @brief    page-aware i2c eeprom driver header file
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+/*!< define to prevent recursive inclusion -------------------------------------*/
+#ifndef __I2C_EEPROM_H
+#define __I2C_EEPROM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* includes ------------------------------------------------------------------*/
+#include "i2c_application.h"
+
+/** @addtogroup AT32F403A_407_middlewares_i2c_eeprom_library
+  * @{
+  */
+
+/** @defgroup I2C_eeprom_definition
+  * @brief    24cxx eeproms on the transaction queue of the i2c application
+  *           library. writes are split at page boundaries, each page is one
+  *           transaction and the end of its write cycle is found by
+  *           acknowledge polling. reads are split at the 256 bytes blocks of
+  *           the devices with 8-bit memory addresses only. pages and reads
+  *           use the dma channels of the i2c handle when they are set. every
+  *           step is started from the completion of the previous one, so the
+  *           _async functions return at once.
+  * @{
+  */
+
+#ifndef EEPROM_WRITE_TIME_US
+#define EEPROM_WRITE_TIME_US             10000      /*!< longest write cycle */
+#endif
+
+#define EEPROM_READ_MAX                  0x8000     /*!< bytes per read transaction */
+
+/**
+  * @}
+  */
+
+/** @defgroup I2C_eeprom_types
+  * @{
+  */
+
+typedef enum
+{
+  EEPROM_24C02 = 0,
+  EEPROM_24C04,
+  EEPROM_24C08,
+  EEPROM_24C16,
+  EEPROM_24C32,
+  EEPROM_24C64,
+  EEPROM_24C128,
+  EEPROM_24C256,
+  EEPROM_24C512,
+  EEPROM_MODEL_NUM,
+} eeprom_model_type;
+
+typedef struct
+{
+  uint32_t                               size;                    /*!< bytes                           */
+  uint16_t                               page_size;               /*!< bytes written at once           */
+  i2c_mem_address_width_type             address_width;           /*!< 8-bit parts put the upper bits in the device address */
+} eeprom_geometry_type;
+
+typedef struct eeprom_handle_struct eeprom_handle_type;
+
+/**
+  * @brief  completion callback, called from the i2c or dma interrupt.
+  */
+typedef void (*eeprom_callback_type)(eeprom_handle_type* hee);
+
+struct eeprom_handle_struct
+{
+  i2c_handle_type                        *hi2c;
+  const eeprom_geometry_type             *geometry;
+  uint16_t                               address;                 /*!< device address, a2 to a0 included */
+
+  i2c_transaction_type                   trans[2];                /*!< used in turn, one step each     */
+  i2c_transaction_type                   *current;
+  uint8_t                                *pbuff;
+  uint32_t                               mem_address;
+  uint32_t                               remain;
+  uint32_t                               chunk;                   /*!< bytes of the current step       */
+  uint8_t                                write;
+  uint8_t                                polling;                 /*!< waiting for the write cycle     */
+  uint32_t                               poll_start;              /*!< dwt cycle counter               */
+  eeprom_callback_type                   callback;
+  void                                   *param;                  /*!< for the callback                */
+  __IO uint8_t                           busy;
+  __IO i2c_status_type                   status;                  /*!< result of the last operation    */
+
+  /* statistics */
+  uint32_t                               pages;                   /*!< pages written                   */
+  uint32_t                               polls;                   /*!< acknowledge polls               */
+};
+
+/**
+  * @}
+  */
+
+/** @defgroup I2C_eeprom_exported_variables
+  * @{
+  */
+
+extern const eeprom_geometry_type eeprom_geometry[EEPROM_MODEL_NUM];
+
+/**
+  * @}
+  */
+
+/** @defgroup I2C_eeprom_exported_functions
+  * @{
+  */
+
+i2c_status_type eeprom_init               (eeprom_handle_type* hee, i2c_handle_type* hi2c, eeprom_model_type model, uint16_t address);
+i2c_status_type eeprom_write_async        (eeprom_handle_type* hee, uint32_t mem_address, uint8_t* pdata, uint32_t size, eeprom_callback_type callback);
+i2c_status_type eeprom_read_async         (eeprom_handle_type* hee, uint32_t mem_address, uint8_t* pdata, uint32_t size, eeprom_callback_type callback);
+i2c_status_type eeprom_wait               (eeprom_handle_type* hee, uint32_t timeout);
+i2c_status_type eeprom_write              (eeprom_handle_type* hee, uint32_t mem_address, uint8_t* pdata, uint32_t size, uint32_t timeout);
+i2c_status_type eeprom_read               (eeprom_handle_type* hee, uint32_t mem_address, uint8_t* pdata, uint32_t size, uint32_t timeout);
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,579 @@
+/**
+  **************************************************************************
+  * @file     image_codec.c
+  * @brief    streaming decoder for compressed and delta firmware images
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+#include "image_codec.h"
+
+/** @addtogroup AT32F403A_407_middlewares_image_codec_library
+  * @{
+  */
+
+/**
+  * @brief decoder states
+  */
+#define IMAGE_STATE_HEAD                 0
+#define IMAGE_STATE_RAW                  1
+#define IMAGE_STATE_LZ4_SIZE             2
+#define IMAGE_STATE_LZ4_TOKEN            3
+#define IMAGE_STATE_LZ4_LIT_LEN          4
+#define IMAGE_STATE_LZ4_LIT              5
+#define IMAGE_STATE_LZ4_OFFSET           6
+#define IMAGE_STATE_LZ4_MATCH_LEN        7
+#define IMAGE_STATE_DELTA_HEAD           8
+#define IMAGE_STATE_DELTA_OP             9
+#define IMAGE_STATE_DELTA_LEN            10
+#define IMAGE_STATE_DELTA_OFFSET         11
+#define IMAGE_STATE_DELTA_DATA           12
+#define IMAGE_STATE_END                  13
+
+#define IMAGE_LZ4_MIN_MATCH              4
+
+/**
+  * @brief crc32 nibble table, polynomial 0xedb88320
+  */
+static const uint32_t crc32_nibble_table[16] =
+{
+  0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+  0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+  0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+/**
+  * @brief  crc32 as used by zip and the delta header.
+  * @param  crc: 0 to start, or the previous result to continue
+  * @param  pdata: data buffer
+  * @param  len: data length
+  * @retval crc value
+  */
+uint32_t image_crc32(uint32_t crc, const uint8_t *pdata, uint32_t len)
+{
+  crc = ~crc;
+  while(len --)
+  {
+    crc ^= *pdata ++;
+    crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0F];
+    crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0F];
+  }
+  return ~crc;
+}
+
+/**
+  * @brief  fail the decoder.
+  * @param  pdec: decoder
+  * @param  status: error code
+  * @retval none
+  */
+static void image_error(image_decoder_type *pdec, image_status_type status)
+{
+  if(pdec->status == IMAGE_OK)
+  {
+    pdec->status = status;
+  }
+}
+
+/**
+  * @brief  append one output byte, a full page is handed to the writer.
+  * @param  pdec: decoder
+  * @param  val: output byte
+  * @retval none
+  */
+static void image_put(image_decoder_type *pdec, uint8_t val)
+{
+  if(pdec->output_size != 0 && pdec->out_pos >= pdec->output_size)
+  {
+    image_error(pdec, IMAGE_ERR_RANGE);
+    return;
+  }
+
+  pdec->page_buf[pdec->out_pos - pdec->page_start] = val;
+  pdec->out_pos ++;
+
+  if(pdec->out_pos - pdec->page_start == IMAGE_PAGE_SIZE)
+  {
+    if(pdec->page_write(pdec->page_start, pdec->page_buf) != 0)
+    {
+      image_error(pdec, IMAGE_ERR_WRITE);
+    }
+    pdec->page_start = pdec->out_pos;
+  }
+}
+
+/**
+  * @brief  read back an earlier output byte.
+  * @param  pdec: decoder
+  * @param  pos: output position
+  * @retval output byte
+  */
+static uint8_t image_output_read(image_decoder_type *pdec, uint32_t pos)
+{
+  if(pos >= pdec->page_start)
+  {
+    return pdec->page_buf[pos - pdec->page_start];
+  }
+  if(pdec->output == NULL)
+  {
+    image_error(pdec, IMAGE_ERR_FORMAT);
+    return 0xFF;
+  }
+  return pdec->output[pos];
+}
+
+/**
+  * @brief  read a byte of the delta base image.
+  * @param  pdec: decoder
+  * @param  pos: base position
+  * @retval base byte
+  */
+static uint8_t image_base_read(image_decoder_type *pdec, uint32_t pos)
+{
+  /* pages before page_start are already overwritten when patching in place */
+  if(pos >= pdec->base_length || (pdec->in_place && pos < pdec->page_start))
+  {
+    image_error(pdec, IMAGE_ERR_BASE);
+    return 0xFF;
+  }
+  return pdec->base[pos];
+}
+
+/**
+  * @brief  copy an lz4 match from the output history.
+  * @param  pdec: decoder
+  * @retval none
+  */
+static void image_lz4_match(image_decoder_type *pdec)
+{
+  uint32_t i_index;
+
+  if(pdec->offset == 0 || pdec->offset > pdec->out_pos)
+  {
+    image_error(pdec, IMAGE_ERR_FORMAT);
+    return;
+  }
+
+  /* byte by byte, overlapping matches repeat the pattern */
+  for(i_index = 0; i_index < pdec->match_length && pdec->status == IMAGE_OK; i_index ++)
+  {
+    image_put(pdec, image_output_read(pdec, pdec->out_pos - pdec->offset));
+  }
+  pdec->state = (pdec->block_remain == 0) ? IMAGE_STATE_LZ4_SIZE : IMAGE_STATE_LZ4_TOKEN;
+  pdec->count = 0;
+  pdec->value = 0;
+}
+
+/**
+  * @brief  continue after the literals of an lz4 sequence.
+  * @param  pdec: decoder
+  * @retval none
+  */
+static void image_lz4_literal_done(image_decoder_type *pdec)
+{
+  pdec->count = 0;
+  pdec->value = 0;
+  /* the last sequence of a block has no match */
+  pdec->state = (pdec->block_remain == 0) ? IMAGE_STATE_LZ4_SIZE : IMAGE_STATE_LZ4_OFFSET;
+}
+
+/**
+  * @brief  decode one byte of an lz4 legacy frame.
+  * @param  pdec: decoder
+  * @param  val: input byte
+  * @retval none
+  */
+static void image_lz4_byte(image_decoder_type *pdec, uint8_t val)
+{
+  if(pdec->state == IMAGE_STATE_LZ4_SIZE)
+  {
+    pdec->value |= (uint32_t)val << (8 * pdec->count);
+    if(++ pdec->count == 4)
+    {
+      pdec->count = 0;
+      /* a magic word starts a concatenated frame, a zero size is padding,
+         erased flash padding of the transport ends the stream */
+      if(pdec->value == 0xFFFFFFFF)
+      {
+        pdec->state = IMAGE_STATE_END;
+      }
+      else if(pdec->value != IMAGE_LZ4_MAGIC && pdec->value != 0)
+      {
+        pdec->block_remain = pdec->value;
+        pdec->state = IMAGE_STATE_LZ4_TOKEN;
+      }
+      pdec->value = 0;
+    }
+    return;
+  }
+
+  if(pdec->block_remain == 0)
+  {
+    image_error(pdec, IMAGE_ERR_FORMAT);
+    return;
+  }
+  pdec->block_remain --;
+
+  switch(pdec->state)
+  {
+    case IMAGE_STATE_LZ4_TOKEN:
+      pdec->length = val >> 4;
+      pdec->match_length = val & 0x0F;
+      if(pdec->length == 15)
+      {
+        pdec->state = IMAGE_STATE_LZ4_LIT_LEN;
+      }
+      else if(pdec->length != 0)
+      {
+        pdec->state = IMAGE_STATE_LZ4_LIT;
+      }
+      else
+      {
+        image_lz4_literal_done(pdec);
+      }
+      break;
+    case IMAGE_STATE_LZ4_LIT_LEN:
+      pdec->length += val;
+      if(val != 255)
+      {
+        pdec->state = IMAGE_STATE_LZ4_LIT;
+      }
+      break;
+    case IMAGE_STATE_LZ4_LIT:
+      image_put(pdec, val);
+      if(-- pdec->length == 0)
+      {
+        image_lz4_literal_done(pdec);
+      }
+      break;
+    case IMAGE_STATE_LZ4_OFFSET:
+      pdec->value |= (uint32_t)val << (8 * pdec->count);
+      if(++ pdec->count == 2)
+      {
+        pdec->offset = pdec->value;
+        if(pdec->match_length == 15)
+        {
+          pdec->state = IMAGE_STATE_LZ4_MATCH_LEN;
+        }
+        else
+        {
+          pdec->match_length += IMAGE_LZ4_MIN_MATCH;
+          image_lz4_match(pdec);
+        }
+      }
+      break;
+    case IMAGE_STATE_LZ4_MATCH_LEN:
+      pdec->match_length += val;
+      if(val != 255)
+      {
+        pdec->match_length += IMAGE_LZ4_MIN_MATCH;
+        image_lz4_match(pdec);
+      }
+      break;
+    default:
+      image_error(pdec, IMAGE_ERR_FORMAT);
+      break;
+  }
+}
+
+/**
+  * @brief  accumulate a leb128 value.
+  * @param  pdec: decoder
+  * @param  val: input byte
+  * @retval 1 when the value is complete
+  */
+static uint8_t image_varint(image_decoder_type *pdec, uint8_t val)
+{
+  if(pdec->count >= 5)
+  {
+    image_error(pdec, IMAGE_ERR_FORMAT);
+    return 0;
+  }
+  pdec->value |= (uint32_t)(val & 0x7F) << (7 * pdec->count);
+  pdec->count ++;
+  return (val & 0x80) ? 0 : 1;
+}
+
+/**
+  * @brief  decode one byte of a delta patch.
+  * @param  pdec: decoder
+  * @param  val: input byte
+  * @retval none
+  */
+static void image_delta_byte(image_decoder_type *pdec, uint8_t val)
+{
+  uint32_t i_index;
+
+  switch(pdec->state)
+  {
+    case IMAGE_STATE_DELTA_HEAD:
+      pdec->value |= (uint32_t)val << (8 * (pdec->count & 3));
+      if((++ pdec->count & 3) != 0)
+      {
+        break;
+      }
+      if(pdec->count == 4)
+      {
+        pdec->base_length = pdec->value;
+      }
+      else if(pdec->count == 8)
+      {
+        /* the patch only applies to the image it was made from */
+        if(pdec->base == NULL || pdec->base_length > pdec->base_size ||
+           image_crc32(0, pdec->base, pdec->base_length) != pdec->value)
+        {
+          image_error(pdec, IMAGE_ERR_BASE);
+        }
+      }
+      else
+      {
+        pdec->new_length = pdec->value;
+        pdec->state = IMAGE_STATE_DELTA_OP;
+      }
+      pdec->value = 0;
+      break;
+    case IMAGE_STATE_DELTA_OP:
+      if(val > IMAGE_DELTA_OP_ADD)
+      {
+        image_error(pdec, IMAGE_ERR_FORMAT);
+        break;
+      }
+      pdec->op = val;
+      pdec->count = 0;
+      pdec->value = 0;
+      pdec->state = IMAGE_STATE_DELTA_LEN;
+      break;
+    case IMAGE_STATE_DELTA_LEN:
+      if(image_varint(pdec, val))
+      {
+        pdec->length = pdec->value;
+        pdec->count = 0;
+        pdec->value = 0;
+        if(pdec->op != IMAGE_DELTA_OP_LITERAL)
+        {
+          pdec->state = IMAGE_STATE_DELTA_OFFSET;
+        }
+        else
+        {
+          pdec->state = (pdec->length != 0) ? IMAGE_STATE_DELTA_DATA : IMAGE_STATE_DELTA_OP;
+        }
+      }
+      break;
+    case IMAGE_STATE_DELTA_OFFSET:
+      if(image_varint(pdec, val))
+      {
+        pdec->offset = pdec->value;
+        if(pdec->op == IMAGE_DELTA_OP_COPY)
+        {
+          for(i_index = 0; i_index < pdec->length && pdec->status == IMAGE_OK; i_index ++)
+          {
+            image_put(pdec, image_base_read(pdec, pdec->offset ++));
+          }
+          pdec->state = IMAGE_STATE_DELTA_OP;
+        }
+        else
+        {
+          pdec->state = (pdec->length != 0) ? IMAGE_STATE_DELTA_DATA : IMAGE_STATE_DELTA_OP;
+        }
+      }
+      break;
+    case IMAGE_STATE_DELTA_DATA:
+      if(pdec->op == IMAGE_DELTA_OP_ADD)
+      {
+        val += image_base_read(pdec, pdec->offset ++);
+      }
+      image_put(pdec, val);
+      if(-- pdec->length == 0)
+      {
+        pdec->state = IMAGE_STATE_DELTA_OP;
+      }
+      break;
+    default:
+      image_error(pdec, IMAGE_ERR_FORMAT);
+      break;
+  }
+}
+
+/**
+  * @brief  select the format from the first word.
+  * @param  pdec: decoder
+  * @retval none
+  */
+static void image_format_detect(image_decoder_type *pdec)
+{
+  uint32_t magic = pdec->head[0] | (pdec->head[1] << 8) |
+                   (pdec->head[2] << 16) | ((uint32_t)pdec->head[3] << 24);
+  uint32_t i_index;
+
+  pdec->count = 0;
+  pdec->value = 0;
+  if(magic == IMAGE_LZ4_MAGIC)
+  {
+    pdec->format = IMAGE_FORMAT_LZ4;
+    pdec->state = IMAGE_STATE_LZ4_SIZE;
+  }
+  else if(magic == IMAGE_DELTA_MAGIC)
+  {
+    pdec->format = IMAGE_FORMAT_DELTA;
+    pdec->state = IMAGE_STATE_DELTA_HEAD;
+  }
+  else
+  {
+    pdec->format = IMAGE_FORMAT_RAW;
+    pdec->state = IMAGE_STATE_RAW;
+    for(i_index = 0; i_index < 4; i_index ++)
+    {
+      image_put(pdec, pdec->head[i_index]);
+    }
+  }
+}
+
+/**
+  * @brief  prepare a decoder.
+  * @param  pdec: decoder
+  * @param  page_write: output page writer
+  * @param  output: memory the written pages can be read back from, NULL when not readable
+  * @param  output_size: destination size, 0 for no limit
+  * @param  base: old image for delta patches, NULL when not available
+  * @param  base_size: old image area size
+  * @retval none
+  */
+void image_decode_init(image_decoder_type *pdec, image_page_write_type page_write,
+                       const uint8_t *output, uint32_t output_size,
+                       const uint8_t *base, uint32_t base_size)
+{
+  pdec->page_write = page_write;
+  pdec->output = output;
+  pdec->output_size = output_size;
+  pdec->base = base;
+  pdec->base_size = base_size;
+  pdec->in_place = (base != NULL && base == output) ? 1 : 0;
+
+  pdec->format = IMAGE_FORMAT_UNKNOWN;
+  pdec->status = IMAGE_OK;
+  pdec->state = IMAGE_STATE_HEAD;
+  pdec->count = 0;
+  pdec->value = 0;
+  pdec->block_remain = 0;
+  pdec->base_length = 0;
+  pdec->new_length = 0;
+  pdec->out_pos = 0;
+  pdec->page_start = 0;
+}
+
+/**
+  * @brief  feed a piece of the update image, any split of the stream is accepted.
+  * @param  pdec: decoder
+  * @param  pdata: input data
+  * @param  len: input length
+  * @retval IMAGE_OK or the first error met
+  */
+image_status_type image_decode_feed(image_decoder_type *pdec, const uint8_t *pdata, uint32_t len)
+{
+  uint8_t val;
+
+  while(len -- && pdec->status == IMAGE_OK)
+  {
+    val = *pdata ++;
+    if(pdec->state == IMAGE_STATE_END)
+    {
+      break;
+    }
+    switch(pdec->format)
+    {
+      case IMAGE_FORMAT_UNKNOWN:
+        pdec->head[pdec->count ++] = val;
+        if(pdec->count == 4)
+        {
+          image_format_detect(pdec);
+        }
+        break;
+      case IMAGE_FORMAT_LZ4:
+        image_lz4_byte(pdec, val);
+        break;
+      case IMAGE_FORMAT_DELTA:
+        image_delta_byte(pdec, val);
+        /* bytes after the complete image are transport padding */
+        if(pdec->state == IMAGE_STATE_DELTA_OP && pdec->out_pos == pdec->new_length)
+        {
+          pdec->state = IMAGE_STATE_END;
+        }
+        break;
+      default:
+        image_put(pdec, val);
+        break;
+    }
+  }
+  return pdec->status;
+}
+
+/**
+  * @brief  end of the update image, the last page is padded and written.
+  * @param  pdec: decoder
+  * @param  out_length: output length, may be NULL
+  * @retval IMAGE_OK or the first error met
+  */
+image_status_type image_decode_finish(image_decoder_type *pdec, uint32_t *out_length)
+{
+  uint32_t i_index, fill;
+
+  /* shorter than a header, it can only be raw */
+  if(pdec->format == IMAGE_FORMAT_UNKNOWN)
+  {
+    pdec->format = IMAGE_FORMAT_RAW;
+    for(i_index = 0; i_index < pdec->count; i_index ++)
+    {
+      image_put(pdec, pdec->head[i_index]);
+    }
+  }
+
+  if(pdec->format == IMAGE_FORMAT_LZ4 && pdec->state != IMAGE_STATE_END &&
+     (pdec->state != IMAGE_STATE_LZ4_SIZE || pdec->count != 0))
+  {
+    image_error(pdec, IMAGE_ERR_FORMAT);
+  }
+  if(pdec->format == IMAGE_FORMAT_DELTA && pdec->state != IMAGE_STATE_END)
+  {
+    image_error(pdec, IMAGE_ERR_LENGTH);
+  }
+
+  fill = pdec->out_pos - pdec->page_start;
+  if(pdec->status == IMAGE_OK && fill != 0)
+  {
+    for(i_index = fill; i_index < IMAGE_PAGE_SIZE; i_index ++)
+    {
+      pdec->page_buf[i_index] = 0xFF;
+    }
+    if(pdec->page_write(pdec->page_start, pdec->page_buf) != 0)
+    {
+      image_error(pdec, IMAGE_ERR_WRITE);
+    }
+  }
+
+  if(out_length != NULL)
+  {
+    *out_length = pdec->out_pos;
+  }
+  return pdec->status;
+}
+
+/**
+  * @}
+  */
@@ -0,0 +1,161 @@
+/**
+  **************************************************************************
+  * @file     image_codec.h
+  * @brief    streaming decoder for compressed and delta firmware images header file
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+/*!< define to prevent recursive inclusion -------------------------------------*/
+#ifndef __IMAGE_CODEC_H
+#define __IMAGE_CODEC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* includes ------------------------------------------------------------------*/
+/* the decoder touches no peripheral, it builds for the host as well */
+#include <stdint.h>
+#include <stddef.h>
+
+/** @addtogroup AT32F403A_407_middlewares_image_codec_library
+  * @{
+  */
+
+/** @defgroup IMAGE_codec_definition
+  * @brief    an update image is detected by its first word:
+  *           - lz4 legacy frame (lz4 -l): 0x184c2102, then blocks of a 4 byte
+  *             little endian size followed by lz4 block data. matches may reach
+  *             the whole output, earlier pages are read back from the output
+  *             memory so only one page of ram is needed.
+  *           - delta patch: "ATD1", old length, old crc32, new length (little
+  *             endian words), then commands made of an op byte and leb128 values:
+  *             0x00 len, literal bytes / 0x01 len offset, copy from the old image /
+  *             0x02 len offset, bytes added to the old image.
+  *             tools/image_delta.c builds patches on the pc. applied in place,
+  *             code moved up by more than a page can only be sent as literals.
+  *           - anything else is a raw image and is passed through.
+  *           0xff padding after a compressed or delta stream is ignored, so
+  *           transports that send whole erased-filled blocks can feed everything.
+  * @{
+  */
+
+#ifndef IMAGE_PAGE_SIZE
+#define IMAGE_PAGE_SIZE                  0x800      /*!< output page, matches flash_2kb_write */
+#endif
+
+#define IMAGE_LZ4_MAGIC                  0x184C2102
+#define IMAGE_DELTA_MAGIC                0x31445441 /*!< "ATD1" */
+
+#define IMAGE_DELTA_OP_LITERAL           0x00
+#define IMAGE_DELTA_OP_COPY              0x01
+#define IMAGE_DELTA_OP_ADD               0x02
+
+/**
+  * @}
+  */
+
+/** @defgroup IMAGE_codec_types
+  * @{
+  */
+
+typedef enum
+{
+  IMAGE_OK = 0,        /*!< no error */
+  IMAGE_ERR_FORMAT,    /*!< malformed stream */
+  IMAGE_ERR_RANGE,     /*!< output larger than the destination */
+  IMAGE_ERR_BASE,      /*!< delta base missing, wrong crc or already overwritten */
+  IMAGE_ERR_LENGTH,    /*!< output length differs from the delta header */
+  IMAGE_ERR_WRITE,     /*!< page write callback failed */
+} image_status_type;
+
+typedef enum
+{
+  IMAGE_FORMAT_UNKNOWN = 0,
+  IMAGE_FORMAT_RAW,
+  IMAGE_FORMAT_LZ4,
+  IMAGE_FORMAT_DELTA,
+} image_format_type;
+
+/**
+  * @brief  page write callback
+  * @param  offset: output offset of the page
+  * @param  pbuffer: IMAGE_PAGE_SIZE bytes, the last page is padded with 0xff
+  * @retval 0 on success
+  */
+typedef int (*image_page_write_type)(uint32_t offset, uint8_t *pbuffer);
+
+typedef struct
+{
+  image_page_write_type                  page_write;
+  const uint8_t                          *output;     /*!< written pages read back from here */
+  uint32_t                               output_size;
+  const uint8_t                          *base;       /*!< old image for delta patches */
+  uint32_t                               base_size;
+  uint8_t                                in_place;    /*!< base is overwritten by the output */
+
+  image_format_type                      format;
+  image_status_type                      status;
+  uint8_t                                state;
+  uint8_t                                op;
+  uint8_t                                count;
+  uint8_t                                head[4];
+  uint32_t                               value;
+  uint32_t                               length;
+  uint32_t                               offset;
+  uint32_t                               match_length;
+  uint32_t                               block_remain;
+
+  uint32_t                               base_length;  /*!< from the delta header */
+  uint32_t                               new_length;
+
+  uint32_t                               out_pos;
+  uint32_t                               page_start;
+  uint8_t                                page_buf[IMAGE_PAGE_SIZE];
+} image_decoder_type;
+
+/**
+  * @}
+  */
+
+/** @defgroup IMAGE_codec_exported_functions
+  * @{
+  */
+
+void              image_decode_init  (image_decoder_type *pdec, image_page_write_type page_write,
+                                      const uint8_t *output, uint32_t output_size,
+                                      const uint8_t *base, uint32_t base_size);
+image_status_type image_decode_feed  (image_decoder_type *pdec, const uint8_t *pdata, uint32_t len);
+image_status_type image_decode_finish(image_decoder_type *pdec, uint32_t *out_length);
+uint32_t          image_crc32        (uint32_t crc, const uint8_t *pdata, uint32_t len);
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
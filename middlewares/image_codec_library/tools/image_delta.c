@@ -0,0 +1,355 @@
+/**
+  **************************************************************************
+  * @file     image_delta.c
+  * @brief    host tool building ATD1 delta patches for image_codec
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+/*
+  builds on the pc:
+    gcc -O2 -I.. -o image_delta image_delta.c ../image_codec.c
+  usage:
+    image_delta old.bin new.bin patch.bin
+
+  the bootloaders apply the patch in place, the old app is overwritten page by
+  page while it is read. copies are therefore only taken from old bytes that
+  are not behind the output page being written, and the patch is decoded once
+  on a ram copy of the old image before it is saved.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "image_codec.h"
+
+#define DELTA_MIN_MATCH                  8
+#define DELTA_HASH_BITS                  16
+#define DELTA_CHAIN_MAX                  256
+
+typedef struct
+{
+  uint8_t                                *data;
+  uint32_t                               len;
+  uint32_t                               size;
+} delta_buffer_type;
+
+static uint8_t *check_image;
+
+/**
+  * @brief  read a whole file.
+  * @param  name: file name
+  * @param  len: file length
+  * @retval file data, NULL on error
+  */
+static uint8_t *file_read(const char *name, uint32_t *len)
+{
+  FILE *fp = fopen(name, "rb");
+  uint8_t *pdata;
+  long size;
+
+  if(fp == NULL)
+  {
+    return NULL;
+  }
+  fseek(fp, 0, SEEK_END);
+  size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  pdata = malloc(size + 1);
+  if(pdata == NULL || fread(pdata, 1, size, fp) != (size_t)size)
+  {
+    free(pdata);
+    fclose(fp);
+    return NULL;
+  }
+  fclose(fp);
+  *len = (uint32_t)size;
+  return pdata;
+}
+
+/**
+  * @brief  append bytes to the patch.
+  * @param  pbuf: patch buffer
+  * @param  pdata: bytes
+  * @param  len: byte count
+  * @retval none
+  */
+static void delta_put(delta_buffer_type *pbuf, const uint8_t *pdata, uint32_t len)
+{
+  if(pbuf->len + len > pbuf->size)
+  {
+    pbuf->size = (pbuf->len + len) * 2;
+    pbuf->data = realloc(pbuf->data, pbuf->size);
+    if(pbuf->data == NULL)
+    {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+    }
+  }
+  memcpy(pbuf->data + pbuf->len, pdata, len);
+  pbuf->len += len;
+}
+
+/**
+  * @brief  append a little endian word.
+  * @param  pbuf: patch buffer
+  * @param  value: word
+  * @retval none
+  */
+static void delta_put_word(delta_buffer_type *pbuf, uint32_t value)
+{
+  uint8_t word[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+  delta_put(pbuf, word, 4);
+}
+
+/**
+  * @brief  append a leb128 value.
+  * @param  pbuf: patch buffer
+  * @param  value: value
+  * @retval none
+  */
+static void delta_put_varint(delta_buffer_type *pbuf, uint32_t value)
+{
+  uint8_t val;
+
+  do
+  {
+    val = value & 0x7F;
+    value >>= 7;
+    if(value != 0)
+    {
+      val |= 0x80;
+    }
+    delta_put(pbuf, &val, 1);
+  } while(value != 0);
+}
+
+/**
+  * @brief  append a literal command.
+  * @param  pbuf: patch buffer
+  * @param  pdata: literal bytes
+  * @param  len: byte count
+  * @retval none
+  */
+static void delta_literal(delta_buffer_type *pbuf, const uint8_t *pdata, uint32_t len)
+{
+  uint8_t op = IMAGE_DELTA_OP_LITERAL;
+
+  if(len == 0)
+  {
+    return;
+  }
+  delta_put(pbuf, &op, 1);
+  delta_put_varint(pbuf, len);
+  delta_put(pbuf, pdata, len);
+}
+
+/**
+  * @brief  longest copy the in-place decoder accepts.
+  * @note   old bytes before the output page being written are already gone,
+  *         a copy from below the output position may not cross a page end.
+  * @param  old_pos: position in the old image
+  * @param  new_pos: position in the new image
+  * @param  len: match length
+  * @retval allowed length
+  */
+static uint32_t delta_in_place_limit(uint32_t old_pos, uint32_t new_pos, uint32_t len)
+{
+  uint32_t in_page = new_pos % IMAGE_PAGE_SIZE;
+
+  if(old_pos >= new_pos)
+  {
+    return len;
+  }
+  if(in_page < new_pos - old_pos)
+  {
+    return 0;
+  }
+  return (len < IMAGE_PAGE_SIZE - in_page) ? len : IMAGE_PAGE_SIZE - in_page;
+}
+
+/**
+  * @brief  hash of the 4 bytes at a position.
+  * @param  pdata: bytes
+  * @retval hash
+  */
+static uint32_t delta_hash(const uint8_t *pdata)
+{
+  uint32_t value = pdata[0] | (pdata[1] << 8) | (pdata[2] << 16) | ((uint32_t)pdata[3] << 24);
+  return (value * 2654435761u) >> (32 - DELTA_HASH_BITS);
+}
+
+/**
+  * @brief  build the patch.
+  * @param  old_image: old image
+  * @param  old_len: old image length
+  * @param  new_image: new image
+  * @param  new_len: new image length
+  * @param  pbuf: patch buffer
+  * @retval none
+  */
+static void delta_build(const uint8_t *old_image, uint32_t old_len,
+                        const uint8_t *new_image, uint32_t new_len, delta_buffer_type *pbuf)
+{
+  int32_t *head = malloc(sizeof(int32_t) << DELTA_HASH_BITS);
+  int32_t *chain = malloc(sizeof(int32_t) * (old_len + 1));
+  uint32_t pos, literal = 0, last_old = 0;
+  uint32_t best_len, best_old, len, limit, depth, i_index;
+  int32_t cand;
+  uint8_t op = IMAGE_DELTA_OP_COPY;
+
+  if(head == NULL || chain == NULL)
+  {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  memset(head, 0xFF, sizeof(int32_t) << DELTA_HASH_BITS);
+  for(i_index = 0; i_index + 4 <= old_len; i_index ++)
+  {
+    uint32_t h = delta_hash(old_image + i_index);
+    chain[i_index] = head[h];
+    head[h] = (int32_t)i_index;
+  }
+
+  delta_put_word(pbuf, IMAGE_DELTA_MAGIC);
+  delta_put_word(pbuf, old_len);
+  delta_put_word(pbuf, image_crc32(0, old_image, old_len));
+  delta_put_word(pbuf, new_len);
+
+  pos = 0;
+  while(pos < new_len)
+  {
+    best_len = 0;
+    best_old = 0;
+
+    /* the old image continued where the previous copy stopped */
+    if(last_old < old_len)
+    {
+      for(len = 0; pos + len < new_len && last_old + len < old_len &&
+                   new_image[pos + len] == old_image[last_old + len]; len ++);
+      best_len = delta_in_place_limit(last_old, pos, len);
+      best_old = last_old;
+    }
+
+    if(pos + 4 <= new_len)
+    {
+      cand = head[delta_hash(new_image + pos)];
+      for(depth = 0; cand >= 0 && depth < DELTA_CHAIN_MAX; depth ++, cand = chain[cand])
+      {
+        for(len = 0; pos + len < new_len && (uint32_t)cand + len < old_len &&
+                     new_image[pos + len] == old_image[cand + len]; len ++);
+        limit = delta_in_place_limit((uint32_t)cand, pos, len);
+        if(limit > best_len)
+        {
+          best_len = limit;
+          best_old = (uint32_t)cand;
+        }
+      }
+    }
+
+    if(best_len < DELTA_MIN_MATCH)
+    {
+      literal ++;
+      pos ++;
+      continue;
+    }
+
+    delta_literal(pbuf, new_image + pos - literal, literal);
+    literal = 0;
+    delta_put(pbuf, &op, 1);
+    delta_put_varint(pbuf, best_len);
+    delta_put_varint(pbuf, best_old);
+    pos += best_len;
+    last_old = best_old + best_len;
+  }
+  delta_literal(pbuf, new_image + pos - literal, literal);
+
+  free(head);
+  free(chain);
+}
+
+/**
+  * @brief  page writer of the check decode, works on the ram copy.
+  * @param  offset: output offset
+  * @param  pbuffer: page
+  * @retval 0
+  */
+static int check_page_write(uint32_t offset, uint8_t *pbuffer)
+{
+  memcpy(check_image + offset, pbuffer, IMAGE_PAGE_SIZE);
+  return 0;
+}
+
+/**
+  * @brief  image_delta main.
+  * @param  argc: argument count
+  * @param  argv: arguments
+  * @retval 0 when the patch is written
+  */
+int main(int argc, char *argv[])
+{
+  static image_decoder_type decoder;
+  delta_buffer_type patch = {NULL, 0, 0};
+  uint8_t *old_image, *new_image;
+  uint32_t old_len, new_len, size, out_len = 0;
+  image_status_type status;
+  FILE *fp;
+
+  if(argc != 4)
+  {
+    fprintf(stderr, "usage: %s old.bin new.bin patch.bin\n", argv[0]);
+    return 1;
+  }
+  old_image = file_read(argv[1], &old_len);
+  new_image = file_read(argv[2], &new_len);
+  if(old_image == NULL || new_image == NULL)
+  {
+    fprintf(stderr, "cannot read the images\n");
+    return 1;
+  }
+
+  delta_build(old_image, old_len, new_image, new_len, &patch);
+
+  /* apply the patch in place on a copy of the old image, as the bootloader does */
+  size = ((old_len > new_len ? old_len : new_len) + IMAGE_PAGE_SIZE - 1) & ~(IMAGE_PAGE_SIZE - 1);
+  check_image = malloc(size);
+  memset(check_image, 0xFF, size);
+  memcpy(check_image, old_image, old_len);
+  image_decode_init(&decoder, check_page_write, check_image, size, check_image, size);
+  status = image_decode_feed(&decoder, patch.data, patch.len);
+  if(status == IMAGE_OK)
+  {
+    status = image_decode_finish(&decoder, &out_len);
+  }
+  if(status != IMAGE_OK || out_len != new_len || memcmp(check_image, new_image, new_len) != 0)
+  {
+    fprintf(stderr, "patch check failed (%d)\n", (int)status);
+    return 1;
+  }
+
+  fp = fopen(argv[3], "wb");
+  if(fp == NULL || fwrite(patch.data, 1, patch.len, fp) != patch.len)
+  {
+    fprintf(stderr, "cannot write %s\n", argv[3]);
+    return 1;
+  }
+  fclose(fp);
+  printf("%s: %u bytes, %u%% of %s\n", argv[3], patch.len, (unsigned)(patch.len * 100ull / (new_len ? new_len : 1)), argv[2]);
+  return 0;
+}
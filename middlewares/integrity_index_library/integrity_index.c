@@ -0,0 +1,276 @@
+/**
+  **************************************************************************
+  * @file     integrity_index.c
+  * @brief    per-block crc index of a firmware image
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+
+#include "integrity_index.h"
+
+/** @addtogroup AT32F403A_407_middlewares_integrity_index_library
+  * @{
+  */
+
+/**
+  * @brief flash size register, unit kbyte
+  */
+#define INTEGRITY_FLASH_SIZE_REG()       ((*(uint32_t *)0x1FFFF7E0) & 0xFFFF)
+
+#define INTEGRITY_NO_BLOCK               0xFFFFFFFF
+
+/**
+  * @brief  crc of the index header and of its used block crcs with the crc unit.
+  * @param  pindex: index
+  * @retval crc value
+  */
+static uint32_t integrity_index_crc(const integrity_index_type *pindex)
+{
+  crm_periph_clock_enable(CRM_CRC_PERIPH_CLOCK, TRUE);
+  crc_data_reset();
+  crc_block_calculate((uint32_t *)pindex, INTEGRITY_HEADER_WORDS - 1);
+  return crc_block_calculate((uint32_t *)pindex->block_crc, pindex->block_num);
+}
+
+/**
+  * @brief  check that a range lies in the main flash and starts on a block.
+  * @param  address: start address
+  * @param  length: length in bytes
+  * @retval TRUE when the range is usable
+  */
+static confirm_state integrity_range_valid(uint32_t address, uint32_t length)
+{
+  uint32_t flash_end = FLASH_BANK1_START_ADDR + (INTEGRITY_FLASH_SIZE_REG() << 10);
+
+  if((address % INTEGRITY_BLOCK_SIZE) != 0 || address < FLASH_BANK1_START_ADDR ||
+     address >= flash_end || length > flash_end - address)
+  {
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/**
+  * @brief  check one block against the index and mark it.
+  * @param  pcheck: checking state
+  * @param  block: block number in the image
+  * @retval INTEGRITY_OK or INTEGRITY_ERR_BLOCK
+  */
+static integrity_status_type integrity_block_check(integrity_check_type *pcheck, uint32_t block)
+{
+  const integrity_index_type *pindex = pcheck->pindex;
+  uint32_t mask = 1UL << (block % 32);
+
+  if(pcheck->verified[block / 32] & mask)
+  {
+    return INTEGRITY_OK;
+  }
+  if(integrity_block_crc(pindex->image_addr + block * INTEGRITY_BLOCK_SIZE) != pindex->block_crc[block])
+  {
+    pcheck->failed_block = block;
+    return INTEGRITY_ERR_BLOCK;
+  }
+  pcheck->verified[block / 32] |= mask;
+  pcheck->remain --;
+  return INTEGRITY_OK;
+}
+
+/**
+  * @brief  crc of one block with the flash crc unit.
+  * @note   the crc unit counts sectors from the start of the main flash, a
+  *         block is one 2kb sector or two 1kb sectors on smaller devices.
+  * @param  address: block aligned address in the main flash
+  * @retval crc value
+  */
+uint32_t integrity_block_crc(uint32_t address)
+{
+  uint32_t sector_size = (INTEGRITY_FLASH_SIZE_REG() < 256) ? 0x400 : 0x800;
+
+  return flash_crc_calibrate((address - FLASH_BANK1_START_ADDR) / sector_size,
+                             INTEGRITY_BLOCK_SIZE / sector_size);
+}
+
+/**
+  * @brief  build the index of an image already programmed.
+  * @note   called at update time, the caller writes pindex to flash once the
+  *         image is complete. a partial last block is hashed whole, the bytes
+  *         past the image must stay as programmed (usually erased).
+  * @param  pindex: index to fill, INTEGRITY_BLOCK_SIZE bytes
+  * @param  image_addr: block aligned image address
+  * @param  length: image length in bytes
+  * @retval INTEGRITY_ERR_PARAM when the image does not fit the index
+  */
+integrity_status_type integrity_index_build(integrity_index_type *pindex, uint32_t image_addr, uint32_t length)
+{
+  uint32_t block_num = (length + INTEGRITY_BLOCK_SIZE - 1) / INTEGRITY_BLOCK_SIZE;
+  uint32_t i_index;
+
+  if(length == 0 || block_num > INTEGRITY_BLOCK_MAX ||
+     integrity_range_valid(image_addr, block_num * INTEGRITY_BLOCK_SIZE) != TRUE)
+  {
+    return INTEGRITY_ERR_PARAM;
+  }
+
+  for(i_index = 0; i_index < INTEGRITY_BLOCK_MAX; i_index ++)
+  {
+    pindex->block_crc[i_index] = 0xFFFFFFFF;
+  }
+  pindex->magic = INTEGRITY_INDEX_MAGIC;
+  pindex->image_addr = image_addr;
+  pindex->block_num = block_num;
+  for(i_index = 0; i_index < block_num; i_index ++)
+  {
+    pindex->block_crc[i_index] = integrity_block_crc(image_addr + i_index * INTEGRITY_BLOCK_SIZE);
+  }
+  pindex->index_crc = integrity_index_crc(pindex);
+  return INTEGRITY_OK;
+}
+
+/**
+  * @brief  check the index and clear the checking state.
+  * @param  pcheck: checking state
+  * @param  pindex: index in flash
+  * @retval INTEGRITY_ERR_INDEX when the index is missing or corrupt
+  */
+integrity_status_type integrity_check_init(integrity_check_type *pcheck, const integrity_index_type *pindex)
+{
+  uint32_t i_index;
+
+  pcheck->pindex = 0;
+  pcheck->remain = 0;
+  pcheck->next = 0;
+  pcheck->failed_block = INTEGRITY_NO_BLOCK;
+  for(i_index = 0; i_index < sizeof(pcheck->verified) / sizeof(uint32_t); i_index ++)
+  {
+    pcheck->verified[i_index] = 0;
+  }
+
+  if(pindex->magic != INTEGRITY_INDEX_MAGIC || pindex->block_num == 0 ||
+     pindex->block_num > INTEGRITY_BLOCK_MAX ||
+     integrity_range_valid(pindex->image_addr, pindex->block_num * INTEGRITY_BLOCK_SIZE) != TRUE ||
+     integrity_index_crc(pindex) != pindex->index_crc)
+  {
+    return INTEGRITY_ERR_INDEX;
+  }
+
+  pcheck->pindex = pindex;
+  pcheck->remain = pindex->block_num;
+  return INTEGRITY_OK;
+}
+
+/**
+  * @brief  check the blocks holding a range, blocks already checked are skipped.
+  * @note   call it before code or data in the range is first used, the
+  *         bootloader checks the vector table and the reset handler this way.
+  * @param  pcheck: checking state
+  * @param  address: start address
+  * @param  length: length in bytes
+  * @retval INTEGRITY_OK, INTEGRITY_ERR_PARAM when the range leaves the image
+  */
+integrity_status_type integrity_check_range(integrity_check_type *pcheck, uint32_t address, uint32_t length)
+{
+  const integrity_index_type *pindex = pcheck->pindex;
+  uint32_t block, last;
+
+  if(pindex == 0)
+  {
+    return INTEGRITY_ERR_INDEX;
+  }
+  if(pcheck->failed_block != INTEGRITY_NO_BLOCK)
+  {
+    return INTEGRITY_ERR_BLOCK;
+  }
+  if(length == 0 || address < pindex->image_addr ||
+     address - pindex->image_addr >= pindex->block_num * INTEGRITY_BLOCK_SIZE ||
+     length > pindex->block_num * INTEGRITY_BLOCK_SIZE - (address - pindex->image_addr))
+  {
+    return INTEGRITY_ERR_PARAM;
+  }
+
+  block = (address - pindex->image_addr) / INTEGRITY_BLOCK_SIZE;
+  last = (address - pindex->image_addr + length - 1) / INTEGRITY_BLOCK_SIZE;
+  for(; block <= last; block ++)
+  {
+    if(integrity_block_check(pcheck, block) != INTEGRITY_OK)
+    {
+      return INTEGRITY_ERR_BLOCK;
+    }
+  }
+  return INTEGRITY_OK;
+}
+
+/**
+  * @brief  check the next block not checked yet.
+  * @note   meant for the idle loop or a low priority task, one call costs one
+  *         block of the flash crc unit.
+  * @param  pcheck: checking state
+  * @retval INTEGRITY_BUSY while blocks remain, INTEGRITY_OK once all match
+  */
+integrity_status_type integrity_check_poll(integrity_check_type *pcheck)
+{
+  const integrity_index_type *pindex = pcheck->pindex;
+
+  if(pindex == 0)
+  {
+    return INTEGRITY_ERR_INDEX;
+  }
+  if(pcheck->failed_block != INTEGRITY_NO_BLOCK)
+  {
+    return INTEGRITY_ERR_BLOCK;
+  }
+  while(pcheck->remain != 0)
+  {
+    if(pcheck->next >= pindex->block_num)
+    {
+      pcheck->next = 0;
+    }
+    if((pcheck->verified[pcheck->next / 32] & (1UL << (pcheck->next % 32))) == 0)
+    {
+      if(integrity_block_check(pcheck, pcheck->next) != INTEGRITY_OK)
+      {
+        return INTEGRITY_ERR_BLOCK;
+      }
+      pcheck->next ++;
+      return (pcheck->remain != 0) ? INTEGRITY_BUSY : INTEGRITY_OK;
+    }
+    pcheck->next ++;
+  }
+  return INTEGRITY_OK;
+}
+
+/**
+  * @brief  check every block not checked yet.
+  * @param  pcheck: checking state
+  * @retval INTEGRITY_OK when the whole image matches
+  */
+integrity_status_type integrity_check_all(integrity_check_type *pcheck)
+{
+  integrity_status_type status;
+
+  do
+  {
+    status = integrity_check_poll(pcheck);
+  } while(status == INTEGRITY_BUSY);
+  return status;
+}
+
+/**
+  * @}
+  */
@@ -0,0 +1,132 @@
+/**
+  **************************************************************************
+  * @file     integrity_index.h
+  * @brief    per-block crc index of a firmware image header file
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+
+/*!< define to prevent recursive inclusion -------------------------------------*/
+#ifndef __INTEGRITY_INDEX_H
+#define __INTEGRITY_INDEX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* includes ------------------------------------------------------------------*/
+#include "at32f403a_407.h"
+
+/** @addtogroup AT32F403A_407_middlewares_integrity_index_library
+  * @{
+  */
+
+/** @defgroup INTEGRITY_index_definition
+  * @brief    the index holds the crc of every 2kb block of an image, computed by
+  *           the flash crc unit (flash_crc_calibrate) when the image is written.
+  *           at boot only the index itself and the blocks needed to start the
+  *           image are checked, the other blocks are checked later a few at a
+  *           time or all at once. the index fills one block and is written
+  *           after the image, so an interrupted update leaves no valid index.
+  * @{
+  */
+
+#define INTEGRITY_BLOCK_SIZE             0x800      /*!< one sector, two on 1kb sector devices */
+#define INTEGRITY_INDEX_MAGIC            0x31584449 /*!< "IDX1" */
+#define INTEGRITY_HEADER_WORDS           4
+#define INTEGRITY_BLOCK_MAX              (INTEGRITY_BLOCK_SIZE / 4 - INTEGRITY_HEADER_WORDS)
+
+/**
+  * @}
+  */
+
+/** @defgroup INTEGRITY_index_status_code
+  * @{
+  */
+
+typedef enum
+{
+  INTEGRITY_OK = 0,           /*!< no error, every requested block matches */
+  INTEGRITY_BUSY,             /*!< blocks remain to be checked */
+  INTEGRITY_ERR_PARAM,        /*!< address or length out of the flash or not block aligned */
+  INTEGRITY_ERR_INDEX,        /*!< index missing or corrupt */
+  INTEGRITY_ERR_BLOCK,        /*!< a block does not match its crc */
+} integrity_status_type;
+
+/**
+  * @}
+  */
+
+/** @defgroup INTEGRITY_index_types
+  * @{
+  */
+
+/**
+  * @brief index as stored in flash, one block
+  */
+typedef struct
+{
+  uint32_t magic;
+  uint32_t image_addr;                   /*!< block aligned */
+  uint32_t block_num;
+  uint32_t index_crc;                    /*!< crc unit over the words above and block_crc[0..block_num-1] */
+  uint32_t block_crc[INTEGRITY_BLOCK_MAX];
+} integrity_index_type;
+
+/**
+  * @brief checking state, kept in ram by the code running the image
+  */
+typedef struct
+{
+  const integrity_index_type *pindex;
+  uint32_t verified[(INTEGRITY_BLOCK_MAX + 31) / 32]; /*!< one bit per checked block */
+  uint32_t remain;                       /*!< blocks not checked yet */
+  uint32_t next;                         /*!< next block for integrity_check_poll */
+  uint32_t failed_block;                 /*!< first bad block, 0xFFFFFFFF when none */
+} integrity_check_type;
+
+/**
+  * @}
+  */
+
+/** @defgroup INTEGRITY_index_exported_functions
+  * @{
+  */
+
+uint32_t              integrity_block_crc(uint32_t address);
+integrity_status_type integrity_index_build(integrity_index_type *pindex, uint32_t image_addr, uint32_t length);
+integrity_status_type integrity_check_init(integrity_check_type *pcheck, const integrity_index_type *pindex);
+integrity_status_type integrity_check_range(integrity_check_type *pcheck, uint32_t address, uint32_t length);
+integrity_status_type integrity_check_poll(integrity_check_type *pcheck);
+integrity_status_type integrity_check_all(integrity_check_type *pcheck);
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
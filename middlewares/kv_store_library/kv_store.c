@@ -0,0 +1,901 @@
+/**
+  **************************************************************************
+  * @file     kv_store.c
+  * @brief    wear-levelled key/value store on flash
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+#include "kv_store.h"
+
+/** @addtogroup AT32F403A_407_middlewares_kv_store_library
+  * @{
+  */
+
+#if (KV_INDEX_SIZE & (KV_INDEX_SIZE - 1)) || (KV_INDEX_SIZE <= KV_KEY_MAX)
+#error "KV_INDEX_SIZE must be a power of 2 larger than KV_KEY_MAX"
+#endif
+
+#if (KV_BATCH_SIZE & 3) || (KV_KEY_MAX > 1023)
+#error "KV_BATCH_SIZE must be a multiple of 4 and KV_KEY_MAX below 1024"
+#endif
+
+/**
+  * @brief record layout, word 0: type (31:28), length (27:16), key (15:0),
+  *        word 1: crc32 of word 0 and the data, then the data padded to a word.
+  *        a checkpoint keeps the entry count in the key field, a commit the
+  *        word offset of its batch in the sector.
+  */
+#define KV_TYPE_DATA                     0xA
+#define KV_TYPE_COMMIT                   0xB
+#define KV_TYPE_CHECKPOINT               0xC
+#define KV_TYPE_DELETE                   0xD
+
+#define KV_WORD_FREE                     0xFFFFFFFF
+#define KV_LENGTH_MAX                    0x0FFF
+#define KV_VALUE_MAX                     (KV_BATCH_SIZE - KV_RECORD_HEADER_SIZE)
+
+#define KV_RECORD_WORD(type, len, key)   (((uint32_t)(type) << 28) | ((uint32_t)(len) << 16) | (key))
+#define KV_RECORD_TYPE(word)             ((word) >> 28)
+#define KV_RECORD_LEN(word)              (((word) >> 16) & KV_LENGTH_MAX)
+#define KV_RECORD_KEY(word)              ((word) & 0xFFFF)
+#define KV_RECORD_SIZE(len)              (KV_RECORD_HEADER_SIZE + (((len) + 3) & ~3u))
+
+/**
+  * @brief crc32 nibble table, polynomial 0xedb88320
+  */
+static const uint32_t kv_crc_table[16] =
+{
+  0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+  0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+  0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+/**
+  * @brief  crc32 of a record.
+  * @param  word: record word 0
+  * @param  pdata: record data
+  * @param  len: data length
+  * @retval crc value
+  */
+static uint32_t kv_crc(uint32_t word, const uint8_t *pdata, uint32_t len)
+{
+  uint32_t crc = ~0u, i;
+
+  for(i = 0; i < 4; i ++)
+  {
+    crc ^= (word >> (i * 8)) & 0xFF;
+    crc = (crc >> 4) ^ kv_crc_table[crc & 0x0F];
+    crc = (crc >> 4) ^ kv_crc_table[crc & 0x0F];
+  }
+  while(len --)
+  {
+    crc ^= *pdata ++;
+    crc = (crc >> 4) ^ kv_crc_table[crc & 0x0F];
+    crc = (crc >> 4) ^ kv_crc_table[crc & 0x0F];
+  }
+  return ~crc;
+}
+
+/**
+  * @brief  read one word of the store.
+  * @param  kv: store
+  * @param  offset: word aligned offset
+  * @retval word
+  */
+static uint32_t kv_word(kv_store_type *kv, uint32_t offset)
+{
+  return *(const uint32_t *)(kv->config.base + offset);
+}
+
+/**
+  * @brief  program one word, erased words are left alone.
+  * @param  kv: store
+  * @param  offset: word aligned offset
+  * @param  data: word
+  * @retval status
+  */
+static kv_status_type kv_program(kv_store_type *kv, uint32_t offset, uint32_t data)
+{
+  if(data == KV_WORD_FREE)
+  {
+    return KV_OK;
+  }
+  if(kv->config.program(offset, data) != 0 || kv_word(kv, offset) != data)
+  {
+    return KV_ERR_FLASH;
+  }
+  return KV_OK;
+}
+
+/**
+  * @brief  erase one sector.
+  * @param  kv: store
+  * @param  sector: sector number
+  * @retval status
+  */
+static kv_status_type kv_erase(kv_store_type *kv, uint32_t sector)
+{
+  kv->erase_count ++;
+  if(kv->config.erase(sector * kv->config.sector_size) != 0)
+  {
+    return KV_ERR_FLASH;
+  }
+  return KV_OK;
+}
+
+/**
+  * @brief  check the header of a sector.
+  * @param  kv: store
+  * @param  sector: sector number
+  * @param  sequence: sequence of a valid sector
+  * @retval 1 when the sector holds a valid header
+  */
+static int kv_sector_valid(kv_store_type *kv, uint32_t sector, uint32_t *sequence)
+{
+  uint32_t offset = sector * kv->config.sector_size;
+
+  if(kv_word(kv, offset) != KV_SECTOR_MAGIC ||
+     kv_word(kv, offset + 8) != ~kv_word(kv, offset + 4))
+  {
+    return 0;
+  }
+  *sequence = kv_word(kv, offset + 4);
+  return 1;
+}
+
+/**
+  * @brief  hash slot of a key.
+  * @param  key: key
+  * @retval slot
+  */
+static uint32_t kv_hash(uint16_t key)
+{
+  return ((key * 0x9E3779B1u) >> 16) & (KV_INDEX_SIZE - 1);
+}
+
+/**
+  * @brief  find the index entry of a key.
+  * @param  kv: store
+  * @param  key: key
+  * @retval entry or 0
+  */
+static kv_index_type *kv_index_find(kv_store_type *kv, uint16_t key)
+{
+  uint32_t slot = kv_hash(key);
+
+  while(kv->index[slot].used)
+  {
+    if(kv->index[slot].key == key)
+    {
+      return &kv->index[slot];
+    }
+    slot = (slot + 1) & (KV_INDEX_SIZE - 1);
+  }
+  return 0;
+}
+
+/**
+  * @brief  insert or update the index entry of a key.
+  * @param  kv: store
+  * @param  key: key
+  * @param  offset: record offset
+  * @retval none
+  */
+static void kv_index_put(kv_store_type *kv, uint16_t key, uint32_t offset)
+{
+  uint32_t slot = kv_hash(key);
+
+  while(kv->index[slot].used && kv->index[slot].key != key)
+  {
+    slot = (slot + 1) & (KV_INDEX_SIZE - 1);
+  }
+  if(kv->index[slot].used == 0)
+  {
+    /* the stage never lets the keys pass KV_KEY_MAX, a damaged log may */
+    if(kv->key_count >= KV_KEY_MAX)
+    {
+      return;
+    }
+    kv->key_count ++;
+  }
+  kv->index[slot].key = key;
+  kv->index[slot].offset = offset;
+  kv->index[slot].used = 1;
+}
+
+/**
+  * @brief  remove the index entry of a key, the entries behind it are shifted
+  *         back so lookups need no tombstones.
+  * @param  kv: store
+  * @param  key: key
+  * @retval none
+  */
+static void kv_index_remove(kv_store_type *kv, uint16_t key)
+{
+  kv_index_type *entry = kv_index_find(kv, key);
+  uint32_t hole, slot, home;
+
+  if(entry == 0)
+  {
+    return;
+  }
+  hole = entry - kv->index;
+  slot = hole;
+  while(1)
+  {
+    slot = (slot + 1) & (KV_INDEX_SIZE - 1);
+    if(kv->index[slot].used == 0)
+    {
+      break;
+    }
+    home = kv_hash(kv->index[slot].key);
+    /* move the entry when its home is not between the hole and its slot */
+    if(((slot - home) & (KV_INDEX_SIZE - 1)) >= ((slot - hole) & (KV_INDEX_SIZE - 1)))
+    {
+      kv->index[hole] = kv->index[slot];
+      hole = slot;
+    }
+  }
+  kv->index[hole].used = 0;
+  kv->key_count --;
+}
+
+/**
+  * @brief  apply the records of a committed batch to the index.
+  * @param  kv: store
+  * @param  offset: first record
+  * @param  end: commit record
+  * @retval none
+  */
+static void kv_batch_apply(kv_store_type *kv, uint32_t offset, uint32_t end)
+{
+  uint32_t word, len;
+
+  while(offset < end)
+  {
+    word = kv_word(kv, offset);
+    len = KV_RECORD_LEN(word);
+    if(kv_crc(word, kv->config.base + offset + KV_RECORD_HEADER_SIZE, len) == kv_word(kv, offset + 4))
+    {
+      if(KV_RECORD_TYPE(word) == KV_TYPE_DATA)
+      {
+        kv_index_put(kv, KV_RECORD_KEY(word), offset);
+      }
+      else if(KV_RECORD_TYPE(word) == KV_TYPE_DELETE)
+      {
+        kv_index_remove(kv, KV_RECORD_KEY(word));
+      }
+    }
+    offset += KV_RECORD_SIZE(len);
+  }
+}
+
+/**
+  * @brief  scan the records of a sector and apply the committed batches.
+  * @note   a record with a bad crc is skipped, its length is still used. a
+  *         header that leads past the sector ends the scan and the rest of the
+  *         sector is left unused. records behind the last commit belong to a
+  *         batch cut by a power loss, the next commit points past them.
+  * @param  kv: store
+  * @param  offset: first record
+  * @param  end: end of the sector
+  * @param  committed: set when a commit record is found
+  * @retval offset of the next record to write
+  */
+static uint32_t kv_sector_scan(kv_store_type *kv, uint32_t offset, uint32_t end, uint8_t *committed)
+{
+  uint32_t sector_start = end - kv->config.sector_size;
+  uint32_t first = offset, last = offset, word, size, batch;
+
+  while(offset + KV_RECORD_HEADER_SIZE <= end)
+  {
+    word = kv_word(kv, offset);
+    if(word == KV_WORD_FREE)
+    {
+      break;
+    }
+    size = KV_RECORD_SIZE(KV_RECORD_LEN(word));
+    if(offset + size > end || KV_RECORD_TYPE(word) < KV_TYPE_DATA || KV_RECORD_TYPE(word) > KV_TYPE_DELETE)
+    {
+      offset = end;
+      break;
+    }
+    if(KV_RECORD_TYPE(word) == KV_TYPE_COMMIT &&
+       kv_crc(word, 0, 0) == kv_word(kv, offset + 4))
+    {
+      batch = sector_start + KV_RECORD_KEY(word) * 4;
+      if(batch >= last && batch <= offset)
+      {
+        kv_batch_apply(kv, batch, offset);
+        *committed = 1;
+      }
+      last = offset + size;
+    }
+    offset += size;
+  }
+  kv->mount_scan_bytes += offset - first;
+  return offset;
+}
+
+/**
+  * @brief  load the index from the checkpoint at the start of a sector.
+  * @param  kv: store
+  * @param  offset: checkpoint record
+  * @param  end: end of the sector
+  * @retval size of the checkpoint record, 0 when there is no valid checkpoint
+  */
+static uint32_t kv_checkpoint_load(kv_store_type *kv, uint32_t offset, uint32_t end)
+{
+  uint32_t word = kv_word(kv, offset), len = KV_RECORD_LEN(word), entry, record, i;
+  const uint8_t *pdata = kv->config.base + offset + KV_RECORD_HEADER_SIZE;
+
+  if(KV_RECORD_TYPE(word) != KV_TYPE_CHECKPOINT || len != KV_RECORD_KEY(word) * 4 ||
+     offset + KV_RECORD_SIZE(len) > end || kv_crc(word, pdata, len) != kv_word(kv, offset + 4))
+  {
+    return 0;
+  }
+  for(i = 0; i < len; i += 4)
+  {
+    entry = *(const uint32_t *)(pdata + i);
+    record = (entry >> 16) * 4;
+    /* the record was checked when the checkpoint was written */
+    if(KV_RECORD_TYPE(kv_word(kv, record)) == KV_TYPE_DATA &&
+       KV_RECORD_KEY(kv_word(kv, record)) == (entry & 0xFFFF))
+    {
+      kv_index_put(kv, entry & 0xFFFF, record);
+    }
+  }
+  kv->mount_scan_bytes += KV_RECORD_SIZE(len);
+  return KV_RECORD_SIZE(len);
+}
+
+/**
+  * @brief  write a record made of a word 0 and data.
+  * @param  kv: store
+  * @param  offset: record offset
+  * @param  word: record word 0
+  * @param  pdata: data, word aligned
+  * @param  len: data length
+  * @retval status
+  */
+static kv_status_type kv_record_write(kv_store_type *kv, uint32_t offset, uint32_t word,
+                                      const uint32_t *pdata, uint32_t len)
+{
+  uint32_t i;
+
+  /* word 0 goes first, a cut record still tells its length to the scan */
+  if(kv_program(kv, offset, word) != KV_OK ||
+     kv_program(kv, offset + 4, kv_crc(word, (const uint8_t *)pdata, len)) != KV_OK)
+  {
+    return KV_ERR_FLASH;
+  }
+  for(i = 0; i < (len + 3) / 4; i ++)
+  {
+    if(kv_program(kv, offset + KV_RECORD_HEADER_SIZE + i * 4, pdata[i]) != KV_OK)
+    {
+      return KV_ERR_FLASH;
+    }
+  }
+  return KV_OK;
+}
+
+/**
+  * @brief  move the head to the next sector of the ring.
+  * @note   when it is the last erased sector, all live records are copied in
+  *         as one batch and every other sector is erased. otherwise the sector
+  *         starts with a checkpoint of the index.
+  * @param  kv: store
+  * @retval status
+  */
+static kv_status_type kv_sector_next(kv_store_type *kv)
+{
+  uint32_t size = kv->config.sector_size, num = kv->config.sector_num;
+  uint32_t next = (kv->head_sector + 1) % num, start = next * size;
+  uint32_t offset = start + KV_SECTOR_HEADER_SIZE, used = 0, sequence, other, word, len, i;
+  uint32_t checkpoint[KV_KEY_MAX];
+  kv_index_type *entry;
+
+  for(i = 0; i < num; i ++)
+  {
+    used += kv_sector_valid(kv, i, &other);
+  }
+
+  /* a sector cut while it was set up is erased before its use */
+  for(i = 0; i < size; i += 4)
+  {
+    if(kv_word(kv, start + i) != KV_WORD_FREE)
+    {
+      if(kv_erase(kv, next) != KV_OK)
+      {
+        return KV_ERR_FLASH;
+      }
+      break;
+    }
+  }
+
+  sequence = kv->sequence + 1;
+  if(kv_program(kv, start + 4, sequence) != KV_OK ||
+     kv_program(kv, start + 8, ~sequence) != KV_OK ||
+     kv_program(kv, start, KV_SECTOR_MAGIC) != KV_OK)
+  {
+    return KV_ERR_FLASH;
+  }
+
+  if(used + 1 >= num)
+  {
+    /* compaction, the old sectors stay until the commit record is written */
+    for(i = 0; i < KV_INDEX_SIZE; i ++)
+    {
+      entry = &kv->index[i];
+      if(entry->used)
+      {
+        word = kv_word(kv, entry->offset);
+        len = KV_RECORD_LEN(word);
+        if(kv_record_write(kv, offset, word,
+                           (const uint32_t *)(kv->config.base + entry->offset + KV_RECORD_HEADER_SIZE), len) != KV_OK)
+        {
+          return KV_ERR_FLASH;
+        }
+        entry->offset = offset;
+        offset += KV_RECORD_SIZE(len);
+      }
+    }
+    word = KV_RECORD_WORD(KV_TYPE_COMMIT, 0, KV_SECTOR_HEADER_SIZE / 4);
+    if(kv_record_write(kv, offset, word, 0, 0) != KV_OK)
+    {
+      return KV_ERR_FLASH;
+    }
+    offset += KV_RECORD_HEADER_SIZE;
+
+    for(i = 0; i < num; i ++)
+    {
+      if(i != next && kv_sector_valid(kv, i, &other) && kv_erase(kv, i) != KV_OK)
+      {
+        return KV_ERR_FLASH;
+      }
+    }
+    kv->compact_count ++;
+  }
+  else
+  {
+    len = 0;
+    for(i = 0; i < KV_INDEX_SIZE; i ++)
+    {
+      entry = &kv->index[i];
+      if(entry->used)
+      {
+        checkpoint[len ++] = entry->key | ((entry->offset / 4) << 16);
+      }
+    }
+    word = KV_RECORD_WORD(KV_TYPE_CHECKPOINT, len * 4, len);
+    if(kv_record_write(kv, offset, word, checkpoint, len * 4) != KV_OK)
+    {
+      return KV_ERR_FLASH;
+    }
+    offset += KV_RECORD_SIZE(len * 4);
+  }
+
+  kv->head_sector = next;
+  kv->head = offset;
+  kv->sequence = sequence;
+  return KV_OK;
+}
+
+/**
+  * @brief  rebuild the index from the newest sector.
+  * @note   a sector starting with a checkpoint is scanned from there. a sector
+  *         without one is a compaction: finished once its first batch is
+  *         committed, then the older sectors are erased, otherwise it is erased
+  *         and the previous sector is mounted.
+  * @param  kv: store
+  * @retval status
+  */
+static kv_status_type kv_mount(kv_store_type *kv)
+{
+  uint32_t size = kv->config.sector_size, num = kv->config.sector_num;
+  uint32_t newest, sequence, start, offset, i;
+  uint8_t found, committed;
+  kv_index_type *entry;
+
+  while(1)
+  {
+    for(i = 0; i < KV_INDEX_SIZE; i ++)
+    {
+      kv->index[i].used = 0;
+    }
+    kv->key_count = 0;
+    kv->mount_scan_bytes = 0;
+
+    found = 0;
+    newest = 0;
+    kv->sequence = 0;
+    for(i = 0; i < num; i ++)
+    {
+      if(kv_sector_valid(kv, i, &sequence) && (found == 0 || sequence > kv->sequence))
+      {
+        found = 1;
+        newest = i;
+        kv->sequence = sequence;
+      }
+    }
+    if(found == 0)
+    {
+      /* empty store, the first commit sets up sector 0 */
+      kv->head_sector = num - 1;
+      kv->head = num * size;
+      break;
+    }
+
+    start = newest * size;
+    offset = start + KV_SECTOR_HEADER_SIZE;
+    committed = 0;
+    i = kv_checkpoint_load(kv, offset, start + size);
+    if(i)
+    {
+      offset = kv_sector_scan(kv, offset + i, start + size, &committed);
+    }
+    else
+    {
+      offset = kv_sector_scan(kv, offset, start + size, &committed);
+      if(committed == 0)
+      {
+        if(kv_erase(kv, newest) != KV_OK)
+        {
+          return KV_ERR_FLASH;
+        }
+        continue;
+      }
+      for(i = 0; i < num; i ++)
+      {
+        if(i != newest && kv_sector_valid(kv, i, &sequence) && kv_erase(kv, i) != KV_OK)
+        {
+          return KV_ERR_FLASH;
+        }
+      }
+    }
+    kv->head_sector = newest;
+    kv->head = offset;
+    break;
+  }
+
+  kv->live_bytes = 0;
+  for(i = 0; i < KV_INDEX_SIZE; i ++)
+  {
+    entry = &kv->index[i];
+    if(entry->used)
+    {
+      kv->live_bytes += KV_RECORD_SIZE(KV_RECORD_LEN(kv_word(kv, entry->offset)));
+    }
+  }
+  kv->mounted = 1;
+  kv_discard(kv);
+  return KV_OK;
+}
+
+/**
+  * @brief  find the newest staged record of a key.
+  * @param  kv: store
+  * @param  key: key
+  * @retval byte offset in the stage, or KV_BATCH_SIZE when not staged
+  */
+static uint32_t kv_stage_find(kv_store_type *kv, uint16_t key)
+{
+  uint32_t offset = 0, found = KV_BATCH_SIZE, word;
+
+  while(offset < kv->stage_len)
+  {
+    word = kv->stage[offset / 4];
+    if(KV_RECORD_KEY(word) == key)
+    {
+      found = offset;
+    }
+    offset += KV_RECORD_SIZE(KV_RECORD_LEN(word));
+  }
+  return found;
+}
+
+/**
+  * @brief  record size of a key once the stage is committed.
+  * @param  kv: store
+  * @param  key: key
+  * @retval record size, 0 when the key is not stored
+  */
+static uint32_t kv_stage_size(kv_store_type *kv, uint16_t key)
+{
+  uint32_t offset = kv_stage_find(kv, key), word;
+  kv_index_type *entry;
+
+  if(offset != KV_BATCH_SIZE)
+  {
+    word = kv->stage[offset / 4];
+    return KV_RECORD_TYPE(word) == KV_TYPE_DATA ? KV_RECORD_SIZE(KV_RECORD_LEN(word)) : 0;
+  }
+  entry = kv_index_find(kv, key);
+  if(entry == 0)
+  {
+    return 0;
+  }
+  return KV_RECORD_SIZE(KV_RECORD_LEN(kv_word(kv, entry->offset)));
+}
+
+/**
+  * @brief  add a record to the stage.
+  * @param  kv: store
+  * @param  word: record word 0
+  * @param  pdata: data
+  * @param  len: data length
+  * @retval none
+  */
+static void kv_stage_add(kv_store_type *kv, uint32_t word, const uint8_t *pdata, uint32_t len)
+{
+  uint8_t *pstage = (uint8_t *)kv->stage + kv->stage_len;
+  uint32_t i;
+
+  for(i = 0; i < KV_RECORD_SIZE(len) - KV_RECORD_HEADER_SIZE; i ++)
+  {
+    pstage[KV_RECORD_HEADER_SIZE + i] = (i < len) ? pdata[i] : 0xFF;
+  }
+  kv->stage[kv->stage_len / 4] = word;
+  kv->stage[kv->stage_len / 4 + 1] = kv_crc(word, pstage + KV_RECORD_HEADER_SIZE, len);
+  kv->stage_len += KV_RECORD_SIZE(len);
+}
+
+/**
+  * @brief  initialize the store and mount it.
+  * @param  kv: store
+  * @param  config: flash region and access functions
+  * @retval status
+  */
+kv_status_type kv_init(kv_store_type *kv, const kv_config_type *config)
+{
+  kv->mounted = 0;
+  kv->erase_count = 0;
+  kv->compact_count = 0;
+  kv->config = *config;
+
+  /* a fresh sector takes a checkpoint of all keys and a full batch */
+  if(config->base == 0 || config->erase == 0 || config->program == 0 ||
+     config->sector_num < 3 || (config->sector_size & 3) ||
+     config->sector_num * config->sector_size > 0x40000 ||
+     config->sector_size < KV_SECTOR_HEADER_SIZE + KV_RECORD_SIZE(KV_KEY_MAX * 4) +
+                           KV_BATCH_SIZE + KV_RECORD_HEADER_SIZE)
+  {
+    return KV_ERR_PARAM;
+  }
+  return kv_mount(kv);
+}
+
+/**
+  * @brief  erase the whole store.
+  * @param  kv: store
+  * @retval status
+  */
+kv_status_type kv_format(kv_store_type *kv)
+{
+  uint32_t i;
+
+  if(kv->config.erase == 0)
+  {
+    return KV_ERR_PARAM;
+  }
+  for(i = 0; i < kv->config.sector_num; i ++)
+  {
+    if(kv_erase(kv, i) != KV_OK)
+    {
+      return KV_ERR_FLASH;
+    }
+  }
+  return kv_mount(kv);
+}
+
+/**
+  * @brief  read the value of a key, staged values included.
+  * @param  kv: store
+  * @param  key: key
+  * @param  pbuffer: value buffer
+  * @param  size: buffer size, a longer value is cut
+  * @param  length: value length, may be 0
+  * @retval status
+  */
+kv_status_type kv_get(kv_store_type *kv, uint16_t key, void *pbuffer, uint32_t size, uint32_t *length)
+{
+  uint32_t offset, word, i;
+  const uint8_t *pdata;
+  kv_index_type *entry;
+
+  if(kv->mounted == 0)
+  {
+    return KV_ERR_PARAM;
+  }
+
+  offset = kv_stage_find(kv, key);
+  if(offset != KV_BATCH_SIZE)
+  {
+    word = kv->stage[offset / 4];
+    if(KV_RECORD_TYPE(word) != KV_TYPE_DATA)
+    {
+      return KV_ERR_NOT_FOUND;
+    }
+    pdata = (const uint8_t *)kv->stage + offset + KV_RECORD_HEADER_SIZE;
+  }
+  else
+  {
+    entry = kv_index_find(kv, key);
+    if(entry == 0)
+    {
+      return KV_ERR_NOT_FOUND;
+    }
+    word = kv_word(kv, entry->offset);
+    pdata = kv->config.base + entry->offset + KV_RECORD_HEADER_SIZE;
+  }
+
+  for(i = 0; i < KV_RECORD_LEN(word) && i < size; i ++)
+  {
+    ((uint8_t *)pbuffer)[i] = pdata[i];
+  }
+  if(length != 0)
+  {
+    *length = KV_RECORD_LEN(word);
+  }
+  return KV_OK;
+}
+
+/**
+  * @brief  stage the value of a key, written by the next kv_commit.
+  * @param  kv: store
+  * @param  key: key
+  * @param  pdata: value
+  * @param  length: value length
+  * @retval KV_ERR_FULL when the stage, the keys or the live size would overflow
+  */
+kv_status_type kv_set(kv_store_type *kv, uint16_t key, const void *pdata, uint32_t length)
+{
+  uint32_t size = KV_RECORD_SIZE(length), old, live;
+
+  if(kv->mounted == 0 || length > KV_VALUE_MAX || length > KV_LENGTH_MAX)
+  {
+    return KV_ERR_PARAM;
+  }
+  old = kv_stage_size(kv, key);
+  live = kv->stage_live - old + size;
+  if(kv->stage_len + size > KV_BATCH_SIZE ||
+     (old == 0 && kv->stage_keys >= KV_KEY_MAX) ||
+     live > kv->config.sector_size - KV_SECTOR_HEADER_SIZE - KV_RECORD_HEADER_SIZE)
+  {
+    return KV_ERR_FULL;
+  }
+  kv_stage_add(kv, KV_RECORD_WORD(KV_TYPE_DATA, length, key), (const uint8_t *)pdata, length);
+  kv->stage_live = live;
+  if(old == 0)
+  {
+    kv->stage_keys ++;
+  }
+  return KV_OK;
+}
+
+/**
+  * @brief  stage the removal of a key, written by the next kv_commit.
+  * @param  kv: store
+  * @param  key: key
+  * @retval status
+  */
+kv_status_type kv_delete(kv_store_type *kv, uint16_t key)
+{
+  uint32_t old;
+
+  if(kv->mounted == 0)
+  {
+    return KV_ERR_PARAM;
+  }
+  old = kv_stage_size(kv, key);
+  if(old == 0)
+  {
+    return KV_ERR_NOT_FOUND;
+  }
+  if(kv->stage_len + KV_RECORD_HEADER_SIZE > KV_BATCH_SIZE)
+  {
+    return KV_ERR_FULL;
+  }
+  kv_stage_add(kv, KV_RECORD_WORD(KV_TYPE_DELETE, 0, key), 0, 0);
+  kv->stage_live -= old;
+  kv->stage_keys --;
+  return KV_OK;
+}
+
+/**
+  * @brief  write the staged records as one batch.
+  * @note   the batch never spans two sectors, so the checkpoint of a sector
+  *         never holds half of a batch.
+  * @param  kv: store
+  * @retval status, the stage is kept on an error
+  */
+kv_status_type kv_commit(kv_store_type *kv)
+{
+  uint32_t end, batch, offset, word, i;
+
+  if(kv->mounted == 0)
+  {
+    return KV_ERR_PARAM;
+  }
+  if(kv->stage_len == 0)
+  {
+    return KV_OK;
+  }
+
+  /* a compaction may leave too little room, the sector after it will not */
+  for(i = 0; ; i ++)
+  {
+    end = (kv->head_sector + 1) * kv->config.sector_size;
+    if(kv->head + kv->stage_len + KV_RECORD_HEADER_SIZE <= end)
+    {
+      break;
+    }
+    if(i == kv->config.sector_num)
+    {
+      return KV_ERR_FULL;
+    }
+    if(kv_sector_next(kv) != KV_OK)
+    {
+      /* the head sector is not trusted anymore */
+      kv->head = (kv->head_sector + 1) * kv->config.sector_size;
+      return KV_ERR_FLASH;
+    }
+  }
+
+  batch = kv->head;
+  for(i = 0; i < kv->stage_len / 4; i ++)
+  {
+    if(kv_program(kv, batch + i * 4, kv->stage[i]) != KV_OK)
+    {
+      kv->head = (kv->head_sector + 1) * kv->config.sector_size;
+      return KV_ERR_FLASH;
+    }
+  }
+  offset = batch + kv->stage_len;
+  word = KV_RECORD_WORD(KV_TYPE_COMMIT, 0, (batch - kv->head_sector * kv->config.sector_size) / 4);
+  if(kv_record_write(kv, offset, word, 0, 0) != KV_OK)
+  {
+    kv->head = (kv->head_sector + 1) * kv->config.sector_size;
+    return KV_ERR_FLASH;
+  }
+  kv->head = offset + KV_RECORD_HEADER_SIZE;
+
+  kv_batch_apply(kv, batch, offset);
+  kv->live_bytes = kv->stage_live;
+  kv_discard(kv);
+  return KV_OK;
+}
+
+/**
+  * @brief  drop the staged records.
+  * @param  kv: store
+  * @retval none
+  */
+void kv_discard(kv_store_type *kv)
+{
+  kv->stage_len = 0;
+  kv->stage_live = kv->live_bytes;
+  kv->stage_keys = kv->key_count;
+}
+
+/**
+  * @}
+  */
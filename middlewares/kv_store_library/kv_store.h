@@ -0,0 +1,175 @@
+/**
+  **************************************************************************
+  * @file     kv_store.h
+  * @brief    wear-levelled key/value store on flash header file
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+/*!< define to prevent recursive inclusion -------------------------------------*/
+#ifndef __KV_STORE_H
+#define __KV_STORE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* includes ------------------------------------------------------------------*/
+/* flash is reached through the callbacks of kv_config_type only, the store
+   builds for the host as well. kv_store_port.h binds it to the internal flash */
+#include <stdint.h>
+#include <stddef.h>
+
+/** @addtogroup AT32F403A_407_middlewares_kv_store_library
+  * @{
+  */
+
+/** @defgroup KV_store_definition
+  * @brief    the store is a log of records over config.sector_num sectors used as
+  *           a ring. a sector starts with a header and, except after a compaction,
+  *           a checkpoint record holding the whole index, so mounting reads the
+  *           newest sector only. kv_set and kv_delete are staged in ram and
+  *           written by kv_commit as one batch closed by a commit record, a batch
+  *           without its commit record is ignored after a power loss. when only
+  *           one sector is left, the live records are compacted into it and the
+  *           other sectors are erased, so every sector is erased once per turn.
+  *           the checkpoint keeps word offsets in 16 bits, the store is 256KB at
+  *           most, and the live records must fit in one sector.
+  * @{
+  */
+
+#ifndef KV_KEY_MAX
+#define KV_KEY_MAX                       64         /*!< keys held by the index */
+#endif
+
+#ifndef KV_INDEX_SIZE
+#define KV_INDEX_SIZE                    128        /*!< hash slots, power of 2 and larger than KV_KEY_MAX */
+#endif
+
+#ifndef KV_BATCH_SIZE
+#define KV_BATCH_SIZE                    512        /*!< staging buffer for one commit */
+#endif
+
+#define KV_SECTOR_HEADER_SIZE            16
+#define KV_RECORD_HEADER_SIZE            8
+#define KV_SECTOR_MAGIC                  0x3153564B /*!< "KVS1" */
+
+/**
+  * @}
+  */
+
+/** @defgroup KV_store_status_code
+  * @{
+  */
+
+typedef enum
+{
+  KV_OK = 0,           /*!< no error */
+  KV_ERR_PARAM,        /*!< bad configuration, key or length */
+  KV_ERR_NOT_FOUND,    /*!< key not stored */
+  KV_ERR_FULL,         /*!< no room for the live data, the keys or the batch */
+  KV_ERR_FLASH,        /*!< erase or program failed */
+} kv_status_type;
+
+/**
+  * @}
+  */
+
+/** @defgroup KV_store_types
+  * @{
+  */
+
+/**
+  * @brief  erase one sector, offset from the start of the store, 0 on success
+  */
+typedef int (*kv_erase_type)(uint32_t offset);
+
+/**
+  * @brief  program one word, offset from the start of the store, 0 on success
+  */
+typedef int (*kv_program_type)(uint32_t offset, uint32_t data);
+
+typedef struct
+{
+  const uint8_t                          *base;       /*!< store contents, read directly */
+  uint32_t                               sector_size;
+  uint32_t                               sector_num;  /*!< 3 or more */
+  kv_erase_type                          erase;
+  kv_program_type                        program;
+} kv_config_type;
+
+typedef struct
+{
+  uint32_t                               offset;      /*!< record of the key */
+  uint16_t                               key;
+  uint16_t                               used;
+} kv_index_type;
+
+typedef struct
+{
+  kv_config_type                         config;
+  kv_index_type                          index[KV_INDEX_SIZE];
+  uint32_t                               key_count;
+  uint32_t                               live_bytes;  /*!< size of the live records */
+
+  uint32_t                               head;        /*!< next record offset */
+  uint32_t                               head_sector;
+  uint32_t                               sequence;    /*!< of the head sector */
+  uint8_t                                mounted;
+
+  uint32_t                               stage[KV_BATCH_SIZE / 4];
+  uint32_t                               stage_len;
+  uint32_t                               stage_live;  /*!< live_bytes once the batch is committed */
+  uint32_t                               stage_keys;
+
+  /* statistics */
+  uint32_t                               erase_count;
+  uint32_t                               compact_count;
+  uint32_t                               mount_scan_bytes; /*!< bytes read by the last mount */
+} kv_store_type;
+
+/**
+  * @}
+  */
+
+/** @defgroup KV_store_exported_functions
+  * @{
+  */
+
+kv_status_type kv_init(kv_store_type *kv, const kv_config_type *config);
+kv_status_type kv_format(kv_store_type *kv);
+kv_status_type kv_get(kv_store_type *kv, uint16_t key, void *pbuffer, uint32_t size, uint32_t *length);
+kv_status_type kv_set(kv_store_type *kv, uint16_t key, const void *pdata, uint32_t length);
+kv_status_type kv_delete(kv_store_type *kv, uint16_t key);
+kv_status_type kv_commit(kv_store_type *kv);
+void           kv_discard(kv_store_type *kv);
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,77 @@
+/**
+  **************************************************************************
+  * @file     kv_store_port.c
+  * @brief    kv store on the internal flash
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+
+#include "kv_store_port.h"
+
+/** @addtogroup AT32F403A_407_middlewares_kv_store_library
+  * @{
+  */
+
+/**
+  * @brief kv store on KV_PORT_SECTOR_NUM sectors at KV_PORT_ADDR
+  */
+const kv_config_type kv_port_config =
+{
+  (const uint8_t *)KV_PORT_ADDR,
+  KV_PORT_SECTOR_SIZE,
+  KV_PORT_SECTOR_NUM,
+  kv_port_erase,
+  kv_port_program,
+};
+
+/**
+  * @brief  erase one sector of the store.
+  * @param  offset: sector offset in the store
+  * @retval 0 on success
+  */
+int kv_port_erase(uint32_t offset)
+{
+  flash_status_type status;
+
+  flash_unlock();
+  status = flash_sector_erase(KV_PORT_ADDR + offset);
+  flash_lock();
+  return (status == FLASH_OPERATE_DONE) ? 0 : 1;
+}
+
+/**
+  * @brief  program one word of the store.
+  * @param  offset: word offset in the store
+  * @param  data: word
+  * @retval 0 on success
+  */
+int kv_port_program(uint32_t offset, uint32_t data)
+{
+  flash_status_type status;
+
+  flash_unlock();
+  status = flash_word_program(KV_PORT_ADDR + offset, data);
+  flash_lock();
+  return (status == FLASH_OPERATE_DONE) ? 0 : 1;
+}
+
+/**
+  * @}
+  */
@@ -0,0 +1,83 @@
+/**
+  **************************************************************************
+  * @file     kv_store_port.h
+  * @brief    kv store on the internal flash header file
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+
+/*!< define to prevent recursive inclusion -------------------------------------*/
+#ifndef __KV_STORE_PORT_H
+#define __KV_STORE_PORT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* includes ------------------------------------------------------------------*/
+#include "at32f403a_407.h"
+#include "kv_store.h"
+
+/** @addtogroup AT32F403A_407_middlewares_kv_store_library
+  * @{
+  */
+
+/** @defgroup KV_store_port_layout
+  * @brief    the default region is the top of the smallest 256KB device, every
+  *           value can be overridden before including this file.
+  * @{
+  */
+
+#define KV_PORT_SECTOR_SIZE              0x800      /*!< dual-bank devices have 2kb sectors */
+
+#ifndef KV_PORT_SECTOR_NUM
+#define KV_PORT_SECTOR_NUM               4
+#endif
+
+#ifndef KV_PORT_ADDR
+#define KV_PORT_ADDR                     (FLASH_BANK1_START_ADDR + 0x40000 - KV_PORT_SECTOR_NUM * KV_PORT_SECTOR_SIZE)
+#endif
+
+/**
+  * @}
+  */
+
+/** @defgroup KV_store_port_exported_functions
+  * @{
+  */
+
+extern const kv_config_type kv_port_config;
+
+int kv_port_erase(uint32_t offset);
+int kv_port_program(uint32_t offset, uint32_t data);
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
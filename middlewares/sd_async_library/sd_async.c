@@ -0,0 +1,916 @@
+/**
+  **************************************************************************
+  * @file     sd_async.c
+  * @brief    interrupt driven sd card driver
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+#include "sd_async.h"
+
+/** @addtogroup AT32F403A_407_middlewares_sd_async_library
+  * @{
+  */
+
+/**
+  * @brief sd commands
+  */
+#define SD_CMD_GO_IDLE_STATE             0
+#define SD_CMD_ALL_SEND_CID              2
+#define SD_CMD_SET_REL_ADDR              3
+#define SD_CMD_SEL_DESEL_CARD            7
+#define SD_CMD_SEND_IF_COND              8
+#define SD_CMD_SEND_CSD                  9
+#define SD_CMD_STOP_TRANSMISSION         12
+#define SD_CMD_SEND_STATUS               13
+#define SD_CMD_SET_BLOCKLEN              16
+#define SD_CMD_READ_SINGLE_BLOCK         17
+#define SD_CMD_READ_MULT_BLOCK           18
+#define SD_CMD_WRITE_SINGLE_BLOCK        24
+#define SD_CMD_WRITE_MULT_BLOCK          25
+#define SD_CMD_APP_CMD                   55
+#define SD_ACMD_SET_BUS_WIDTH            6
+#define SD_ACMD_SET_WR_BLK_ERASE_COUNT   23
+#define SD_ACMD_SD_SEND_OP_COND          41
+
+#define SD_R1_ERRORS                     0xFDFFE008 /*!< error bits of the card status */
+#define SD_CHECK_PATTERN                 0x000001AA
+#define SD_VOLTAGE_WINDOW                0x80100000
+#define SD_HIGH_CAPACITY                 0x40000000
+#define SD_STATE_RECEIVING               6
+#define SD_STATE_PROGRAMMING             7
+
+#define SD_COMMAND_FLAGS                 (SDIO_CMDFAIL_FLAG | SDIO_CMDTIMEOUT_FLAG | SDIO_CMDRSPCMPL_FLAG | SDIO_CMDCMPL_FLAG)
+#define SD_COMMAND_INTS                  (SDIO_CMDFAIL_INT | SDIO_CMDTIMEOUT_INT | SDIO_CMDRSPCMPL_INT)
+#define SD_DATA_INTS                     (SDIO_DTFAIL_INT | SDIO_DTTIMEOUT_INT | SDIO_TXERRU_INT | \
+                                          SDIO_RXERRO_INT | SDIO_DTCMP_INT | SDIO_SBITERR_INT)
+#define SD_STATIC_FLAGS                  0x000005FF
+
+/**
+  * @brief request phases, each one ends in the sdio interrupt
+  */
+#define SD_PHASE_IDLE                    0
+#define SD_PHASE_APP                     1          /*!< cmd55 of acmd23 */
+#define SD_PHASE_PRE_ERASE               2          /*!< acmd23 */
+#define SD_PHASE_CMD                     3          /*!< read or write command */
+#define SD_PHASE_DATA                    4
+#define SD_PHASE_DMA                     5          /*!< last words of a read left in the sdio buffer */
+#define SD_PHASE_STOP                    6          /*!< cmd12 */
+#define SD_PHASE_BUSY                    7          /*!< cmd13 until the card is programmed */
+
+/**
+  * @brief  initializes the pins, clocks, dma mapping and interrupts of a slot,
+  *         the timer clock included.
+  * @param  sd: the slot to set up.
+  * @retval none
+  */
+__WEAK void sd_async_lowlevel_init(sd_async_type *sd)
+{
+
+}
+
+/**
+  * @brief  clock division for a sdio_ck frequency, sdio_ck = hclk / (div + 2).
+  * @param  clock: sdio_ck in hz, the next lower frequency is taken
+  * @retval clock division
+  */
+static uint16_t sd_async_clock_division(uint32_t clock)
+{
+  uint32_t div = (system_core_clock + clock - 1) / clock;
+
+  div = (div > 2) ? div - 2 : 0;
+  return (div > 0x3FF) ? 0x3FF : (uint16_t)div;
+}
+
+/**
+  * @brief  wait some microseconds on the dwt cycle counter.
+  * @param  us: microseconds
+  * @retval none
+  */
+static void sd_async_delay_us(uint32_t us)
+{
+  uint32_t start = DWT->CYCCNT, cycles = us * (system_core_clock / 1000000);
+
+  while(DWT->CYCCNT - start < cycles);
+}
+
+/**
+  * @brief  send a command without waiting.
+  * @param  sd: slot
+  * @param  index: command index
+  * @param  argument: command argument
+  * @param  rsp_type: response type
+  * @retval none
+  */
+static void sd_async_command_send(sd_async_type *sd, uint8_t index, uint32_t argument, sdio_reponse_type rsp_type)
+{
+  sdio_command_struct_type command_struct;
+
+  command_struct.argument = argument;
+  command_struct.cmd_index = index;
+  command_struct.rsp_type = rsp_type;
+  command_struct.wait_type = SDIO_WAIT_FOR_NO;
+  sdio_command_config(sd->sdio_x, &command_struct);
+  sdio_command_state_machine_enable(sd->sdio_x, TRUE);
+}
+
+/**
+  * @brief  send a command and poll for its end, used by the identification.
+  * @param  sd: slot
+  * @param  index: command index
+  * @param  argument: command argument
+  * @param  rsp_type: response type
+  * @retval SD_ASYNC_ERR_CMD_CRC also for the r3 response, which has no crc
+  */
+static sd_async_status_type sd_async_command(sd_async_type *sd, uint8_t index, uint32_t argument, sdio_reponse_type rsp_type)
+{
+  uint32_t sts, timeout = 0x00FFFFFF;
+
+  sd_async_command_send(sd, index, argument, rsp_type);
+
+  do
+  {
+    sts = sd->sdio_x->sts;
+  } while(((sts & SD_COMMAND_FLAGS) == 0) && --timeout);
+
+  sdio_flag_clear(sd->sdio_x, SD_COMMAND_FLAGS);
+
+  if((timeout == 0) || (sts & SDIO_CMDTIMEOUT_FLAG))
+  {
+    return SD_ASYNC_ERR_CMD_TIMEOUT;
+  }
+  if(sts & SDIO_CMDFAIL_FLAG)
+  {
+    return SD_ASYNC_ERR_CMD_CRC;
+  }
+  return SD_ASYNC_OK;
+}
+
+/**
+  * @brief  send a command with a r1 response and check the card status.
+  * @param  sd: slot
+  * @param  index: command index
+  * @param  argument: command argument
+  * @retval status
+  */
+static sd_async_status_type sd_async_command_r1(sd_async_type *sd, uint8_t index, uint32_t argument)
+{
+  sd_async_status_type status = sd_async_command(sd, index, argument, SDIO_RESPONSE_SHORT);
+
+  if(status == SD_ASYNC_OK && (sdio_response_get(sd->sdio_x, SDIO_RSP1_INDEX) & SD_R1_ERRORS))
+  {
+    status = SD_ASYNC_ERR_CARD;
+  }
+  return status;
+}
+
+/**
+  * @brief  number of blocks from the csd register.
+  * @param  csd: csd, bits 127 to 96 first
+  * @retval blocks of 512 bytes
+  */
+static uint32_t sd_async_csd_blocks(const uint32_t *csd)
+{
+  uint32_t c_size, mult, read_bl_len;
+
+  if((csd[0] >> 30) == 1)
+  {
+    /* csd version 2.0, c_size is bits 69 to 48 */
+    c_size = ((csd[1] & 0x3F) << 16) | (csd[2] >> 16);
+    return (c_size + 1) * 1024;
+  }
+
+  /* csd version 1.0 */
+  read_bl_len = (csd[1] >> 16) & 0x0F;
+  c_size = ((csd[1] & 0x3FF) << 2) | (csd[2] >> 30);
+  mult = (csd[2] >> 15) & 0x07;
+  return ((c_size + 1) << (mult + 2)) << read_bl_len >> 9;
+}
+
+/**
+  * @brief  set the dma channel up for the data phase of the current request.
+  * @param  sd: slot
+  * @param  dir: DMA_DIR_MEMORY_TO_PERIPHERAL to write
+  * @retval none
+  */
+static void sd_async_dma_start(sd_async_type *sd, dma_dir_type dir)
+{
+  dma_init_type dma_init_struct;
+
+  dma_channel_enable(sd->dma_channel, FALSE);
+
+  dma_default_para_init(&dma_init_struct);
+  dma_init_struct.peripheral_base_addr = (uint32_t)&sd->sdio_x->buf;
+  dma_init_struct.memory_base_addr = (uint32_t)sd->current->buffer;
+  dma_init_struct.direction = dir;
+  dma_init_struct.buffer_size = sd->current->count * (SD_ASYNC_BLOCK_SIZE / 4);
+  dma_init_struct.peripheral_inc_enable = FALSE;
+  dma_init_struct.memory_inc_enable = TRUE;
+  dma_init_struct.peripheral_data_width = DMA_PERIPHERAL_DATA_WIDTH_WORD;
+  dma_init_struct.memory_data_width = DMA_MEMORY_DATA_WIDTH_WORD;
+  dma_init_struct.loop_mode_enable = FALSE;
+  dma_init_struct.priority = DMA_PRIORITY_HIGH;
+  dma_init(sd->dma_channel, &dma_init_struct);
+
+  /* a read ends when the dma has emptied the sdio buffer */
+  dma_interrupt_enable(sd->dma_channel, DMA_FDT_INT, (dir == DMA_DIR_PERIPHERAL_TO_MEMORY) ? TRUE : FALSE);
+
+  dma_channel_enable(sd->dma_channel, TRUE);
+}
+
+/**
+  * @brief  start the data path of the current request.
+  * @param  sd: slot
+  * @param  direction: data direction
+  * @retval none
+  */
+static void sd_async_data_start(sd_async_type *sd, sdio_transfer_direction_type direction)
+{
+  sdio_data_struct_type data_struct;
+
+  data_struct.block_size = SDIO_DATA_BLOCK_SIZE_512B;
+  data_struct.data_length = sd->current->count * SD_ASYNC_BLOCK_SIZE;
+  data_struct.timeout = 0xFFFFFFFF;
+  data_struct.transfer_mode = SDIO_DATA_BLOCK_TRANSFER;
+  data_struct.transfer_direction = direction;
+  sdio_data_config(sd->sdio_x, &data_struct);
+
+  sdio_dma_enable(sd->sdio_x, TRUE);
+  sdio_interrupt_enable(sd->sdio_x, SD_DATA_INTS, TRUE);
+  sdio_data_state_machine_enable(sd->sdio_x, TRUE);
+}
+
+/**
+  * @brief  stop the data path and the dma channel.
+  * @param  sd: slot
+  * @retval none
+  */
+static void sd_async_data_stop(sd_async_type *sd)
+{
+  sdio_interrupt_enable(sd->sdio_x, SD_DATA_INTS, FALSE);
+  sdio_data_state_machine_enable(sd->sdio_x, FALSE);
+  sdio_dma_enable(sd->sdio_x, FALSE);
+  dma_interrupt_enable(sd->dma_channel, DMA_FDT_INT, FALSE);
+  dma_channel_enable(sd->dma_channel, FALSE);
+}
+
+/**
+  * @brief  send the first cmd13 of the programming after a write.
+  * @param  sd: slot
+  * @retval none
+  */
+static void sd_async_busy_start(sd_async_type *sd)
+{
+  sd->phase = SD_PHASE_BUSY;
+  sd->busy_left = SD_ASYNC_BUSY_TIMEOUT_MS * 1000 / SD_ASYNC_BUSY_POLL_US;
+  sd_async_command_send(sd, SD_CMD_SEND_STATUS, (uint32_t)sd->rca << 16, SDIO_RESPONSE_SHORT);
+}
+
+/**
+  * @brief  send the read or write command of the current request, the data
+  *         path of a read is started first so no data is lost.
+  * @param  sd: slot
+  * @retval none
+  */
+static void sd_async_transfer_command(sd_async_type *sd)
+{
+  sd_request_type *preq = sd->current;
+  uint32_t address = sd->high_capacity ? preq->block : preq->block * SD_ASYNC_BLOCK_SIZE;
+  uint8_t index;
+
+  sd->phase = SD_PHASE_CMD;
+
+  if(preq->write)
+  {
+    /* the data follows the response */
+    sd_async_dma_start(sd, DMA_DIR_MEMORY_TO_PERIPHERAL);
+    index = (preq->count > 1) ? SD_CMD_WRITE_MULT_BLOCK : SD_CMD_WRITE_SINGLE_BLOCK;
+  }
+  else
+  {
+    sd_async_dma_start(sd, DMA_DIR_PERIPHERAL_TO_MEMORY);
+    sd_async_data_start(sd, SDIO_DATA_TRANSFER_TO_CONTROLLER);
+    index = (preq->count > 1) ? SD_CMD_READ_MULT_BLOCK : SD_CMD_READ_SINGLE_BLOCK;
+  }
+
+  sd_async_command_send(sd, index, address, SDIO_RESPONSE_SHORT);
+}
+
+/**
+  * @brief  start the current request.
+  * @param  sd: slot, its current request set
+  * @retval none
+  */
+static void sd_async_start(sd_async_type *sd)
+{
+  sd_request_type *preq = sd->current;
+
+  preq->state = SD_REQUEST_ACTIVE;
+  sd->error = SD_ASYNC_OK;
+  sd->requests++;
+
+  sdio_flag_clear(sd->sdio_x, SD_STATIC_FLAGS);
+  sdio_interrupt_enable(sd->sdio_x, SD_COMMAND_INTS, TRUE);
+
+  if(preq->write && (preq->count > 1))
+  {
+    /* acmd23 lets the card pre-erase the blocks */
+    sd->phase = SD_PHASE_APP;
+    sd_async_command_send(sd, SD_CMD_APP_CMD, (uint32_t)sd->rca << 16, SDIO_RESPONSE_SHORT);
+  }
+  else
+  {
+    sd_async_transfer_command(sd);
+  }
+}
+
+/**
+  * @brief  end the current request and start the next one.
+  * @param  sd: slot
+  * @param  status: result of the request
+  * @retval none
+  */
+static void sd_async_complete(sd_async_type *sd, sd_async_status_type status)
+{
+  sd_request_type *preq = sd->current;
+  uint32_t primask;
+#ifdef SD_ASYNC_USE_FREERTOS
+  TaskHandle_t task = preq->task;
+  BaseType_t woken = pdFALSE;
+#endif
+
+  sd_async_data_stop(sd);
+  sdio_interrupt_enable(sd->sdio_x, SD_COMMAND_INTS, FALSE);
+  sdio_flag_clear(sd->sdio_x, SD_STATIC_FLAGS);
+  sd->phase = SD_PHASE_IDLE;
+
+  if(status == SD_ASYNC_OK)
+  {
+    sd->blocks += preq->count;
+  }
+  else
+  {
+    sd->errors++;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  sd->current = sd->head;
+  if(sd->head != 0)
+  {
+    sd->head = sd->head->next;
+    if(sd->head == 0)
+    {
+      sd->tail = 0;
+    }
+  }
+  __set_PRIMASK(primask);
+
+  preq->status = status;
+  preq->state = SD_REQUEST_DONE;
+
+  if(sd->current != 0)
+  {
+    sd_async_start(sd);
+  }
+
+  if(preq->callback != 0)
+  {
+    preq->callback(preq);
+  }
+
+#ifdef SD_ASYNC_USE_FREERTOS
+  if(task != 0)
+  {
+    vTaskNotifyGiveFromISR(task, &woken);
+    portYIELD_FROM_ISR(woken);
+  }
+#endif
+}
+
+/**
+  * @brief  a command of the current request is over.
+  * @param  sd: slot
+  * @param  sts: sdio status
+  * @retval none
+  */
+static void sd_async_command_done(sd_async_type *sd, uint32_t sts)
+{
+  sd_request_type *preq = sd->current;
+  sd_async_status_type status = SD_ASYNC_OK;
+  uint32_t response = sdio_response_get(sd->sdio_x, SDIO_RSP1_INDEX);
+  uint32_t state;
+
+  if(sts & SDIO_CMDTIMEOUT_FLAG)
+  {
+    status = SD_ASYNC_ERR_CMD_TIMEOUT;
+  }
+  else if(sts & SDIO_CMDFAIL_FLAG)
+  {
+    status = SD_ASYNC_ERR_CMD_CRC;
+  }
+  else if(response & SD_R1_ERRORS)
+  {
+    status = SD_ASYNC_ERR_CARD;
+  }
+
+  switch(sd->phase)
+  {
+    case SD_PHASE_APP:
+      if(status != SD_ASYNC_OK)
+      {
+        sd_async_complete(sd, status);
+        break;
+      }
+      sd->phase = SD_PHASE_PRE_ERASE;
+      sd_async_command_send(sd, SD_ACMD_SET_WR_BLK_ERASE_COUNT, preq->count, SDIO_RESPONSE_SHORT);
+      break;
+
+    case SD_PHASE_PRE_ERASE:
+      if(status != SD_ASYNC_OK)
+      {
+        sd_async_complete(sd, status);
+        break;
+      }
+      sd_async_transfer_command(sd);
+      break;
+
+    case SD_PHASE_CMD:
+      if(status != SD_ASYNC_OK)
+      {
+        sd_async_complete(sd, status);
+        break;
+      }
+      sd->phase = SD_PHASE_DATA;
+      if(preq->write)
+      {
+        sd_async_data_start(sd, SDIO_DATA_TRANSFER_TO_CARD);
+      }
+      break;
+
+    case SD_PHASE_STOP:
+      if(sd->error != SD_ASYNC_OK)
+      {
+        status = sd->error;
+      }
+      if((status != SD_ASYNC_OK) || (preq->write == 0))
+      {
+        sd_async_complete(sd, status);
+        break;
+      }
+      sd_async_busy_start(sd);
+      break;
+
+    case SD_PHASE_BUSY:
+      state = (response >> 9) & 0x0F;
+      if((status == SD_ASYNC_OK) && ((state == SD_STATE_PROGRAMMING) || (state == SD_STATE_RECEIVING)))
+      {
+        if(sd->busy_left == 0)
+        {
+          sd_async_complete(sd, SD_ASYNC_ERR_DATA_TIMEOUT);
+          break;
+        }
+
+        /* the timer sends the next cmd13 */
+        sd->busy_left--;
+        sd->busy_polls++;
+        tmr_counter_value_set(sd->tmr_x, 0);
+        tmr_counter_enable(sd->tmr_x, TRUE);
+        break;
+      }
+      sd_async_complete(sd, status);
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  the data of the current request is moved, stop the transfer.
+  * @param  sd: slot
+  * @param  status: result of the data phase
+  * @retval none
+  */
+static void sd_async_data_end(sd_async_type *sd, sd_async_status_type status)
+{
+  sd_request_type *preq = sd->current;
+
+  sd_async_data_stop(sd);
+
+  if(preq->count > 1)
+  {
+    /* the stop command also ends a failed transfer, the error is reported
+       after its response */
+    sd->error = status;
+    sd->phase = SD_PHASE_STOP;
+    sd_async_command_send(sd, SD_CMD_STOP_TRANSMISSION, 0, SDIO_RESPONSE_SHORT);
+  }
+  else if((status == SD_ASYNC_OK) && preq->write)
+  {
+    sd_async_busy_start(sd);
+  }
+  else
+  {
+    sd_async_complete(sd, status);
+  }
+}
+
+/**
+  * @brief  the data phase of the current request is over.
+  * @param  sd: slot
+  * @param  sts: sdio status
+  * @retval none
+  */
+static void sd_async_data_done(sd_async_type *sd, uint32_t sts)
+{
+  sd_request_type *preq = sd->current;
+  sd_async_status_type status = SD_ASYNC_OK;
+
+  if(sts & SDIO_DTFAIL_FLAG)
+  {
+    status = SD_ASYNC_ERR_DATA_CRC;
+  }
+  else if(sts & SDIO_DTTIMEOUT_FLAG)
+  {
+    status = SD_ASYNC_ERR_DATA_TIMEOUT;
+  }
+  else if(sts & (SDIO_TXERRU_FLAG | SDIO_RXERRO_FLAG))
+  {
+    status = SD_ASYNC_ERR_FIFO;
+  }
+  else if(sts & SDIO_SBITERR_FLAG)
+  {
+    status = SD_ASYNC_ERR_START_BIT;
+  }
+  else if((preq->write == 0) && (sd->dma_channel->dtcnt != 0))
+  {
+    /* the last words are still in the sdio buffer, the dma transfer
+       complete interrupt goes on */
+    sdio_interrupt_enable(sd->sdio_x, SD_DATA_INTS, FALSE);
+    sd->phase = SD_PHASE_DMA;
+    return;
+  }
+
+  sd_async_data_end(sd, status);
+}
+
+/**
+  * @brief  identify the card of a slot and set it up for 4-bit transfers.
+  *         requests may be submitted once it returns SD_ASYNC_OK.
+  * @param  sd: slot, sdio_x, dma_channel, tmr_x and clock set
+  * @retval status
+  */
+sd_async_status_type sd_async_init(sd_async_type *sd)
+{
+  sd_async_status_type status;
+  uint32_t response = 0, csd[4], trial, capacity = 0;
+
+  sd->head = 0;
+  sd->tail = 0;
+  sd->current = 0;
+  sd->phase = SD_PHASE_IDLE;
+  sd->requests = 0;
+  sd->blocks = 0;
+  sd->errors = 0;
+  sd->busy_polls = 0;
+
+  sd_async_lowlevel_init(sd);
+
+  /* one cycle of SD_ASYNC_BUSY_POLL_US between two cmd13 */
+  tmr_counter_enable(sd->tmr_x, FALSE);
+  tmr_base_init(sd->tmr_x, SD_ASYNC_BUSY_POLL_US - 1, system_core_clock / 1000000 - 1);
+  tmr_cnt_dir_set(sd->tmr_x, TMR_COUNT_UP);
+  tmr_one_cycle_mode_enable(sd->tmr_x, TRUE);
+  tmr_flag_clear(sd->tmr_x, TMR_OVF_FLAG);
+  tmr_interrupt_enable(sd->tmr_x, TMR_OVF_INT, TRUE);
+
+  /* the dwt cycle counter paces the identification */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  sdio_reset(sd->sdio_x);
+  sdio_clock_config(sd->sdio_x, sd_async_clock_division(SD_ASYNC_INIT_CLOCK), SDIO_CLOCK_EDGE_FALLING);
+  sdio_bus_width_config(sd->sdio_x, SDIO_BUS_WIDTH_D1);
+  sdio_flow_control_enable(sd->sdio_x, FALSE);
+  sdio_clock_bypass(sd->sdio_x, FALSE);
+  sdio_power_saving_mode_enable(sd->sdio_x, FALSE);
+  sdio_power_set(sd->sdio_x, SDIO_POWER_ON);
+  sdio_clock_enable(sd->sdio_x, TRUE);
+
+  /* at least 74 clocks before the first command */
+  sd_async_delay_us(1000);
+
+  sd_async_command(sd, SD_CMD_GO_IDLE_STATE, 0, SDIO_RESPONSE_NO);
+
+  /* version 2.00 cards answer cmd8 with the check pattern */
+  if((sd_async_command(sd, SD_CMD_SEND_IF_COND, SD_CHECK_PATTERN, SDIO_RESPONSE_SHORT) == SD_ASYNC_OK) &&
+     ((sdio_response_get(sd->sdio_x, SDIO_RSP1_INDEX) & 0xFFF) == SD_CHECK_PATTERN))
+  {
+    capacity = SD_HIGH_CAPACITY;
+  }
+
+  for(trial = 0; trial < SD_ASYNC_OP_COND_TRIALS; trial++)
+  {
+    /* a mmc card does not know cmd55 */
+    if(sd_async_command_r1(sd, SD_CMD_APP_CMD, 0) != SD_ASYNC_OK)
+    {
+      return SD_ASYNC_ERR_UNSUPPORTED;
+    }
+
+    status = sd_async_command(sd, SD_ACMD_SD_SEND_OP_COND, SD_VOLTAGE_WINDOW | capacity, SDIO_RESPONSE_SHORT);
+    if(status == SD_ASYNC_ERR_CMD_TIMEOUT)
+    {
+      return status;
+    }
+
+    response = sdio_response_get(sd->sdio_x, SDIO_RSP1_INDEX);
+    if(response & 0x80000000)
+    {
+      break;
+    }
+    sd_async_delay_us(5000);
+  }
+
+  if(trial == SD_ASYNC_OP_COND_TRIALS)
+  {
+    return SD_ASYNC_ERR_CMD_TIMEOUT;
+  }
+
+  sd->high_capacity = (response & SD_HIGH_CAPACITY) ? 1 : 0;
+
+  if((status = sd_async_command(sd, SD_CMD_ALL_SEND_CID, 0, SDIO_RESPONSE_LONG)) != SD_ASYNC_OK)
+  {
+    return status;
+  }
+
+  if((status = sd_async_command(sd, SD_CMD_SET_REL_ADDR, 0, SDIO_RESPONSE_SHORT)) != SD_ASYNC_OK)
+  {
+    return status;
+  }
+  sd->rca = (uint16_t)(sdio_response_get(sd->sdio_x, SDIO_RSP1_INDEX) >> 16);
+
+  if((status = sd_async_command(sd, SD_CMD_SEND_CSD, (uint32_t)sd->rca << 16, SDIO_RESPONSE_LONG)) != SD_ASYNC_OK)
+  {
+    return status;
+  }
+  csd[0] = sdio_response_get(sd->sdio_x, SDIO_RSP1_INDEX);
+  csd[1] = sdio_response_get(sd->sdio_x, SDIO_RSP2_INDEX);
+  csd[2] = sdio_response_get(sd->sdio_x, SDIO_RSP3_INDEX);
+  csd[3] = sdio_response_get(sd->sdio_x, SDIO_RSP4_INDEX);
+  sd->block_num = sd_async_csd_blocks(csd);
+
+  if((status = sd_async_command_r1(sd, SD_CMD_SEL_DESEL_CARD, (uint32_t)sd->rca << 16)) != SD_ASYNC_OK)
+  {
+    return status;
+  }
+
+  if((status = sd_async_command_r1(sd, SD_CMD_SET_BLOCKLEN, SD_ASYNC_BLOCK_SIZE)) != SD_ASYNC_OK)
+  {
+    return status;
+  }
+
+  /* 4-bit bus */
+  if((status = sd_async_command_r1(sd, SD_CMD_APP_CMD, (uint32_t)sd->rca << 16)) != SD_ASYNC_OK)
+  {
+    return status;
+  }
+  if((status = sd_async_command_r1(sd, SD_ACMD_SET_BUS_WIDTH, 2)) != SD_ASYNC_OK)
+  {
+    return status;
+  }
+  sdio_bus_width_config(sd->sdio_x, SDIO_BUS_WIDTH_D4);
+
+  sdio_clock_config(sd->sdio_x, sd_async_clock_division(sd->clock), SDIO_CLOCK_EDGE_FALLING);
+  sdio_flag_clear(sd->sdio_x, SD_STATIC_FLAGS);
+
+  return SD_ASYNC_OK;
+}
+
+/**
+  * @brief  queue a request, it starts at once when the slot is idle.
+  * @note   the request and its buffer must stay valid until its state is
+  *         SD_REQUEST_DONE. may be called from interrupts and from the
+  *         completion callback.
+  * @param  sd: slot
+  * @param  preq: request, buffer, block, count, write, callback and param set
+  * @retval SD_ASYNC_ERR_PARAM when the request is rejected, it is then done
+  *         unless it was still queued or active
+  */
+sd_async_status_type sd_async_submit(sd_async_type *sd, sd_request_type *preq)
+{
+  uint32_t primask;
+  uint8_t start = 0;
+
+  if((preq->state == SD_REQUEST_QUEUED) || (preq->state == SD_REQUEST_ACTIVE))
+  {
+    /* still owned by the slot */
+    return SD_ASYNC_ERR_PARAM;
+  }
+
+  if((preq->buffer == 0) || ((uint32_t)preq->buffer & 3) || (preq->count == 0) ||
+     (preq->count > SD_ASYNC_BLOCKS_MAX) || (preq->block >= sd->block_num) ||
+     (preq->count > sd->block_num - preq->block))
+  {
+    preq->status = SD_ASYNC_ERR_PARAM;
+    preq->state = SD_REQUEST_DONE;
+    return SD_ASYNC_ERR_PARAM;
+  }
+
+  preq->next = 0;
+  preq->status = SD_ASYNC_OK;
+  preq->state = SD_REQUEST_QUEUED;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if(sd->current == 0)
+  {
+    sd->current = preq;
+    start = 1;
+  }
+  else if(sd->tail == 0)
+  {
+    sd->head = preq;
+    sd->tail = preq;
+  }
+  else
+  {
+    sd->tail->next = preq;
+    sd->tail = preq;
+  }
+  __set_PRIMASK(primask);
+
+  /* the caller starts an idle slot, the sdio interrupt the queued requests */
+  if(start)
+  {
+    sd_async_start(sd);
+  }
+  return SD_ASYNC_OK;
+}
+
+/**
+  * @brief  wait for a submitted request, the task sleeps on its notification
+  *         when SD_ASYNC_USE_FREERTOS is defined and preq->task is set.
+  * @param  preq: request
+  * @retval status of the request
+  */
+sd_async_status_type sd_async_wait(sd_request_type *preq)
+{
+  while((preq->state == SD_REQUEST_QUEUED) || (preq->state == SD_REQUEST_ACTIVE))
+  {
+#ifdef SD_ASYNC_USE_FREERTOS
+    if(preq->task != 0)
+    {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+#endif
+  }
+  return preq->status;
+}
+
+/**
+  * @brief  read blocks and wait for the end, a task sleeps meanwhile when
+  *         SD_ASYNC_USE_FREERTOS is defined.
+  * @param  sd: slot
+  * @param  preq: request to use
+  * @param  buffer: word aligned buffer
+  * @param  block: first block
+  * @param  count: number of blocks
+  * @retval status
+  */
+sd_async_status_type sd_async_read(sd_async_type *sd, sd_request_type *preq, uint8_t *buffer, uint32_t block, uint32_t count)
+{
+  preq->buffer = buffer;
+  preq->block = block;
+  preq->count = count;
+  preq->write = 0;
+  preq->callback = 0;
+#ifdef SD_ASYNC_USE_FREERTOS
+  preq->task = xTaskGetCurrentTaskHandle();
+#endif
+
+  if(sd_async_submit(sd, preq) != SD_ASYNC_OK)
+  {
+    return SD_ASYNC_ERR_PARAM;
+  }
+  return sd_async_wait(preq);
+}
+
+/**
+  * @brief  write blocks and wait until the card has programmed them.
+  * @param  sd: slot
+  * @param  preq: request to use
+  * @param  buffer: word aligned buffer
+  * @param  block: first block
+  * @param  count: number of blocks
+  * @retval status
+  */
+sd_async_status_type sd_async_write(sd_async_type *sd, sd_request_type *preq, const uint8_t *buffer, uint32_t block, uint32_t count)
+{
+  preq->buffer = (uint8_t *)buffer;
+  preq->block = block;
+  preq->count = count;
+  preq->write = 1;
+  preq->callback = 0;
+#ifdef SD_ASYNC_USE_FREERTOS
+  preq->task = xTaskGetCurrentTaskHandle();
+#endif
+
+  if(sd_async_submit(sd, preq) != SD_ASYNC_OK)
+  {
+    return SD_ASYNC_ERR_PARAM;
+  }
+  return sd_async_wait(preq);
+}
+
+/**
+  * @brief  run the next step of the current request, call it from the
+  *         interrupt of the slot sdio.
+  * @param  sd: slot
+  * @retval none
+  */
+void sd_async_irq_handler(sd_async_type *sd)
+{
+  sd_request_type *preq = sd->current;
+  uint32_t sts = sd->sdio_x->sts & sd->sdio_x->inten;
+
+  if(preq == 0)
+  {
+    sdio_interrupt_enable(sd->sdio_x, SD_COMMAND_INTS | SD_DATA_INTS, FALSE);
+    sdio_flag_clear(sd->sdio_x, SD_STATIC_FLAGS);
+    return;
+  }
+
+  if(sts & SD_COMMAND_INTS)
+  {
+    sdio_flag_clear(sd->sdio_x, SD_COMMAND_FLAGS);
+    sd_async_command_done(sd, sts);
+
+    /* the data flags belong to the request only while it runs */
+    if(sd->current != preq)
+    {
+      return;
+    }
+    sts = sd->sdio_x->sts & sd->sdio_x->inten;
+  }
+
+  if((sts & SD_DATA_INTS) && (sd->phase == SD_PHASE_DATA))
+  {
+    sdio_flag_clear(sd->sdio_x, SD_DATA_INTS);
+    sd_async_data_done(sd, sts);
+  }
+}
+
+/**
+  * @brief  the dma channel of the slot has moved all the data, call it from
+  *         the dma interrupt once the full data transfer flag is cleared, at
+  *         the priority of the sdio interrupt.
+  * @param  sd: slot
+  * @retval none
+  */
+void sd_async_dma_irq_handler(sd_async_type *sd)
+{
+  if((sd->current != 0) && (sd->phase == SD_PHASE_DMA))
+  {
+    sd_async_data_end(sd, SD_ASYNC_OK);
+  }
+}
+
+/**
+  * @brief  send the next cmd13 of the programming, call it from the interrupt
+  *         of the slot timer, at the priority of the sdio interrupt.
+  * @param  sd: slot
+  * @retval none
+  */
+void sd_async_tmr_irq_handler(sd_async_type *sd)
+{
+  if(tmr_interrupt_flag_get(sd->tmr_x, TMR_OVF_FLAG) != RESET)
+  {
+    tmr_flag_clear(sd->tmr_x, TMR_OVF_FLAG);
+
+    if((sd->current != 0) && (sd->phase == SD_PHASE_BUSY))
+    {
+      sd_async_command_send(sd, SD_CMD_SEND_STATUS, (uint32_t)sd->rca << 16, SDIO_RESPONSE_SHORT);
+    }
+  }
+}
+
+/**
+  * @}
+  */
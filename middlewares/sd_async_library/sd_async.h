@@ -0,0 +1,189 @@
+/**
+  **************************************************************************
+  * @file     sd_async.h
+  * @brief    interrupt driven sd card driver header file
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+/*!< define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SD_ASYNC_H
+#define __SD_ASYNC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* includes ------------------------------------------------------------------*/
+#include "at32f403a_407.h"
+
+#ifdef SD_ASYNC_USE_FREERTOS
+#include "FreeRTOS.h"
+#include "task.h"
+#endif
+
+/** @addtogroup AT32F403A_407_middlewares_sd_async_library
+  * @{
+  */
+
+/** @defgroup SD_async_definition
+  * @brief    one handle per sdio slot, sd cards in 4-bit mode with 512 bytes
+  *           blocks. requests are queued per slot and run by interrupts:
+  *           every command response, the end of the data phase, the dma
+  *           transfer complete of a read, the stop command and the cmd13
+  *           polls of the programming after a write start the next step, so
+  *           the cpu only runs a few interrupts per request. the cmd13 polls
+  *           are paced by a one cycle timer of the slot. the slots share
+  *           nothing but the dma controller and run in parallel. define
+  *           SD_ASYNC_USE_FREERTOS in the project to notify a waiting task at
+  *           the end of a request.
+  * @{
+  */
+
+#define SD_ASYNC_BLOCK_SIZE              512
+#define SD_ASYNC_BLOCKS_MAX              (0xFFFF * 4 / SD_ASYNC_BLOCK_SIZE) /*!< dma counter in words */
+
+#ifndef SD_ASYNC_INIT_CLOCK
+#define SD_ASYNC_INIT_CLOCK              400000     /*!< sdio_ck during the identification */
+#endif
+
+#ifndef SD_ASYNC_OP_COND_TRIALS
+#define SD_ASYNC_OP_COND_TRIALS          200        /*!< acmd41 every 5ms */
+#endif
+
+#ifndef SD_ASYNC_BUSY_POLL_US
+#define SD_ASYNC_BUSY_POLL_US            200        /*!< cmd13 interval while the card programs */
+#endif
+
+#ifndef SD_ASYNC_BUSY_TIMEOUT_MS
+#define SD_ASYNC_BUSY_TIMEOUT_MS         500        /*!< longest write busy of sdxc cards */
+#endif
+
+/**
+  * @}
+  */
+
+/** @defgroup SD_async_types
+  * @{
+  */
+
+typedef enum
+{
+  SD_ASYNC_OK = 0,
+  SD_ASYNC_ERR_PARAM,                    /*!< bad block range or buffer */
+  SD_ASYNC_ERR_CMD_TIMEOUT,              /*!< no command response */
+  SD_ASYNC_ERR_CMD_CRC,                  /*!< command response crc */
+  SD_ASYNC_ERR_CARD,                     /*!< error bits set in the card status */
+  SD_ASYNC_ERR_DATA_CRC,                 /*!< data block crc */
+  SD_ASYNC_ERR_DATA_TIMEOUT,             /*!< data timeout */
+  SD_ASYNC_ERR_FIFO,                     /*!< buffer underrun or overrun */
+  SD_ASYNC_ERR_START_BIT,                /*!< start bit missing in 4-bit mode */
+  SD_ASYNC_ERR_UNSUPPORTED,              /*!< no sd card, or a mmc card */
+} sd_async_status_type;
+
+typedef enum
+{
+  SD_REQUEST_IDLE,
+  SD_REQUEST_QUEUED,
+  SD_REQUEST_ACTIVE,
+  SD_REQUEST_DONE,
+} sd_request_state_type;
+
+typedef struct sd_request_struct sd_request_type;
+
+/**
+  * @brief  completion callback, called from the sdio interrupt. it may submit
+  *         the next request.
+  */
+typedef void (*sd_request_callback_type)(sd_request_type *preq);
+
+struct sd_request_struct
+{
+  uint8_t                                *buffer;        /*!< word aligned */
+  uint32_t                               block;          /*!< first block */
+  uint32_t                               count;          /*!< 1 to SD_ASYNC_BLOCKS_MAX */
+  uint8_t                                write;
+  sd_request_callback_type               callback;       /*!< may be 0 */
+  void                                   *param;         /*!< for the callback */
+#ifdef SD_ASYNC_USE_FREERTOS
+  TaskHandle_t                           task;           /*!< notified at the end, may be 0 */
+#endif
+  __IO sd_request_state_type             state;
+  __IO sd_async_status_type              status;
+  sd_request_type                        *next;          /*!< queue link, owned by the slot */
+};
+
+typedef struct
+{
+  sdio_type                              *sdio_x;
+  dma_channel_type                       *dma_channel;   /*!< mapped to the sdio request */
+  tmr_type                               *tmr_x;         /*!< paces the cmd13 polls, counts at hclk */
+  uint32_t                               clock;          /*!< sdio_ck in transfer, hz */
+
+  /* card */
+  uint8_t                                high_capacity;  /*!< block addressed */
+  uint16_t                               rca;
+  uint32_t                               block_num;
+
+  /* queue */
+  sd_request_type                        *head;
+  sd_request_type                        *tail;
+  sd_request_type                        *current;
+  uint8_t                                phase;
+  sd_async_status_type                   error;          /*!< data error, reported after the stop command */
+  uint32_t                               busy_left;      /*!< cmd13 left before the programming times out */
+
+  /* statistics */
+  uint32_t                               requests;
+  uint32_t                               blocks;
+  uint32_t                               errors;
+  uint32_t                               busy_polls;     /*!< cmd13 sent while the card programs */
+} sd_async_type;
+
+/**
+  * @}
+  */
+
+/** @defgroup SD_async_exported_functions
+  * @{
+  */
+
+void                 sd_async_lowlevel_init   (sd_async_type *sd);
+sd_async_status_type sd_async_init            (sd_async_type *sd);
+sd_async_status_type sd_async_submit          (sd_async_type *sd, sd_request_type *preq);
+sd_async_status_type sd_async_wait            (sd_request_type *preq);
+sd_async_status_type sd_async_read            (sd_async_type *sd, sd_request_type *preq, uint8_t *buffer, uint32_t block, uint32_t count);
+sd_async_status_type sd_async_write           (sd_async_type *sd, sd_request_type *preq, const uint8_t *buffer, uint32_t block, uint32_t count);
+void                 sd_async_irq_handler     (sd_async_type *sd);
+void                 sd_async_dma_irq_handler (sd_async_type *sd);
+void                 sd_async_tmr_irq_handler (sd_async_type *sd);
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
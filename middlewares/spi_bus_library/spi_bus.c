@@ -0,0 +1,504 @@
+/**
+  **************************************************************************
+  * @file     spi_bus.c
+  * @brief    shared spi bus manager
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+#include "spi_bus.h"
+
+/** @addtogroup AT32F403A_407_middlewares_spi_bus_library
+  * @{
+  */
+
+/**
+  * @brief get the dma transfer complete flag through the channel
+  */
+#define DMA_GET_TC_FLAG(DMA_CHANNEL) \
+(((uint32_t)(DMA_CHANNEL) == ((uint32_t)DMA1_CHANNEL1))? DMA1_FDT1_FLAG : \
+ ((uint32_t)(DMA_CHANNEL) == ((uint32_t)DMA1_CHANNEL2))? DMA1_FDT2_FLAG : \
+ ((uint32_t)(DMA_CHANNEL) == ((uint32_t)DMA1_CHANNEL3))? DMA1_FDT3_FLAG : \
+ ((uint32_t)(DMA_CHANNEL) == ((uint32_t)DMA1_CHANNEL4))? DMA1_FDT4_FLAG : \
+ ((uint32_t)(DMA_CHANNEL) == ((uint32_t)DMA1_CHANNEL5))? DMA1_FDT5_FLAG : \
+ ((uint32_t)(DMA_CHANNEL) == ((uint32_t)DMA1_CHANNEL6))? DMA1_FDT6_FLAG : \
+ ((uint32_t)(DMA_CHANNEL) == ((uint32_t)DMA1_CHANNEL7))? DMA1_FDT7_FLAG : \
+ ((uint32_t)(DMA_CHANNEL) == ((uint32_t)DMA2_CHANNEL1))? DMA2_FDT1_FLAG : \
+ ((uint32_t)(DMA_CHANNEL) == ((uint32_t)DMA2_CHANNEL2))? DMA2_FDT2_FLAG : \
+ ((uint32_t)(DMA_CHANNEL) == ((uint32_t)DMA2_CHANNEL3))? DMA2_FDT3_FLAG : \
+ ((uint32_t)(DMA_CHANNEL) == ((uint32_t)DMA2_CHANNEL4))? DMA2_FDT4_FLAG : \
+ ((uint32_t)(DMA_CHANNEL) == ((uint32_t)DMA2_CHANNEL5))? DMA2_FDT5_FLAG : \
+ ((uint32_t)(DMA_CHANNEL) == ((uint32_t)DMA2_CHANNEL6))? DMA2_FDT6_FLAG : \
+                                                         DMA2_FDT7_FLAG)
+
+/**
+  * @brief transfer phases
+  */
+#define SPI_BUS_PHASE_CMD                0
+#define SPI_BUS_PHASE_DATA               1
+
+/**
+  * @brief  initializes the pins, clocks and dma interrupt of the bus.
+  * @param  bus: the bus to set up.
+  * @retval none
+  */
+__WEAK void spi_bus_lowlevel_init(spi_bus_type *bus)
+{
+
+}
+
+/**
+  * @brief  set the spi up for a device when it differs from the last one.
+  * @param  bus: bus, idle
+  * @param  device: device of the next transfer
+  * @retval none
+  */
+static void spi_bus_configure(spi_bus_type *bus, const spi_bus_device_type *device)
+{
+  const spi_bus_device_type *last = bus->configured;
+  spi_init_type spi_init_struct;
+
+  if(last != 0 && last->mclk_freq_division == device->mclk_freq_division &&
+     last->clock_polarity == device->clock_polarity && last->clock_phase == device->clock_phase &&
+     last->first_bit_transmission == device->first_bit_transmission)
+  {
+    bus->configured = device;
+    return;
+  }
+
+  spi_default_para_init(&spi_init_struct);
+  spi_init_struct.transmission_mode = SPI_TRANSMIT_FULL_DUPLEX;
+  spi_init_struct.master_slave_mode = SPI_MODE_MASTER;
+  spi_init_struct.mclk_freq_division = device->mclk_freq_division;
+  spi_init_struct.first_bit_transmission = device->first_bit_transmission;
+  spi_init_struct.frame_bit_num = SPI_FRAME_8BIT;
+  spi_init_struct.clock_polarity = device->clock_polarity;
+  spi_init_struct.clock_phase = device->clock_phase;
+  spi_init_struct.cs_mode_selection = SPI_CS_SOFTWARE_MODE;
+
+  /* the clock idle level changes with the spi disabled */
+  spi_enable(bus->spi_x, FALSE);
+  spi_init(bus->spi_x, &spi_init_struct);
+  spi_enable(bus->spi_x, TRUE);
+  bus->configured = device;
+  bus->reconfigs ++;
+}
+
+/**
+  * @brief  start a transfer on the rx and tx dma channels.
+  * @param  bus: bus
+  * @param  ptx: bytes to send, 0 repeats SPI_BUS_DUMMY_BYTE
+  * @param  prx: received bytes, 0 drops them
+  * @param  length: 1 to SPI_BUS_DMA_MAX_LEN
+  * @retval none
+  */
+static void spi_bus_dma_start(spi_bus_type *bus, const uint8_t *ptx, uint8_t *prx, uint16_t length)
+{
+  dma_channel_type *rx = bus->dma_rx_channel, *tx = bus->dma_tx_channel;
+
+  rx->ctrl_bit.chen = FALSE;
+  tx->ctrl_bit.chen = FALSE;
+  dma_flag_clear(DMA_GET_TC_FLAG(rx));
+
+  rx->maddr = (prx != 0) ? (uint32_t)prx : (uint32_t)&bus->dummy_rx;
+  rx->ctrl_bit.mincm = (prx != 0);
+  rx->dtcnt = length;
+  tx->maddr = (ptx != 0) ? (uint32_t)ptx : (uint32_t)&bus->dummy_tx;
+  tx->ctrl_bit.mincm = (ptx != 0);
+  tx->dtcnt = length;
+
+  rx->ctrl_bit.chen = TRUE;
+  tx->ctrl_bit.chen = TRUE;
+  spi_i2s_dma_receiver_enable(bus->spi_x, TRUE);
+  spi_i2s_dma_transmitter_enable(bus->spi_x, TRUE);
+}
+
+/**
+  * @brief  move bytes by polling, used for short phases.
+  * @param  bus: bus
+  * @param  ptx: bytes to send, 0 repeats SPI_BUS_DUMMY_BYTE
+  * @param  prx: received bytes, 0 drops them
+  * @param  length: number of bytes
+  * @retval none
+  */
+static void spi_bus_poll(spi_bus_type *bus, const uint8_t *ptx, uint8_t *prx, uint32_t length)
+{
+  uint8_t data;
+
+  while(length --)
+  {
+    while(spi_i2s_flag_get(bus->spi_x, SPI_I2S_TDBE_FLAG) == RESET);
+    spi_i2s_data_transmit(bus->spi_x, (ptx != 0) ? *ptx ++ : SPI_BUS_DUMMY_BYTE);
+    while(spi_i2s_flag_get(bus->spi_x, SPI_I2S_RDBF_FLAG) == RESET);
+    data = (uint8_t)spi_i2s_data_receive(bus->spi_x);
+    if(prx != 0)
+    {
+      *prx ++ = data;
+    }
+  }
+}
+
+/**
+  * @brief  take the first transfer of the highest priority queue, or mark
+  *         the bus idle.
+  * @param  bus: bus
+  * @retval the transfer, 0 when every queue is empty
+  */
+static spi_bus_transfer_type *spi_bus_next(spi_bus_type *bus)
+{
+  spi_bus_transfer_type *ptransfer = 0;
+  uint32_t primask, priority;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  for(priority = 0; priority < SPI_BUS_PRIORITY_NUM; priority ++)
+  {
+    ptransfer = bus->head[priority];
+    if(ptransfer != 0)
+    {
+      bus->head[priority] = ptransfer->next;
+      if(bus->head[priority] == 0)
+      {
+        bus->tail[priority] = 0;
+      }
+      break;
+    }
+  }
+  bus->current = ptransfer;
+  bus->running = (ptransfer != 0);
+  __set_PRIMASK(primask);
+  return ptransfer;
+}
+
+/**
+  * @brief  run the phases of the current transfer until a dma transfer is
+  *         started or the transfer is over.
+  * @param  bus: bus
+  * @retval TRUE when the dma interrupt continues the transfer
+  */
+static confirm_state spi_bus_step(spi_bus_type *bus)
+{
+  spi_bus_transfer_type *ptransfer = bus->current;
+  const uint8_t *ptx;
+  uint8_t *prx;
+  uint32_t remain;
+
+  while(1)
+  {
+    if(bus->phase == SPI_BUS_PHASE_CMD)
+    {
+      ptx = ptransfer->cmd;
+      prx = 0;
+      remain = ptransfer->cmd_length - bus->count;
+    }
+    else
+    {
+      ptx = ptransfer->tx_buffer;
+      prx = ptransfer->rx_buffer;
+      remain = ptransfer->length - bus->count;
+    }
+
+    if(remain == 0)
+    {
+      if(bus->phase == SPI_BUS_PHASE_DATA)
+      {
+        return FALSE;
+      }
+      bus->phase = SPI_BUS_PHASE_DATA;
+      bus->count = 0;
+      continue;
+    }
+
+    if(ptx != 0)
+    {
+      ptx += bus->count;
+    }
+    if(prx != 0)
+    {
+      prx += bus->count;
+    }
+
+    if(remain >= bus->dma_threshold)
+    {
+      if(remain > SPI_BUS_DMA_MAX_LEN)
+      {
+        remain = SPI_BUS_DMA_MAX_LEN;
+      }
+      bus->count += remain;
+      bus->dma_phases ++;
+      spi_bus_dma_start(bus, ptx, prx, remain);
+      return TRUE;
+    }
+
+    spi_bus_poll(bus, ptx, prx, remain);
+    bus->count += remain;
+    bus->polled_phases ++;
+  }
+}
+
+/**
+  * @brief  run transfers back to back until one waits for the dma or the
+  *         queues are empty.
+  * @param  bus: bus, bus->current is continued when set
+  * @retval none
+  */
+static void spi_bus_run(spi_bus_type *bus)
+{
+  spi_bus_transfer_type *ptransfer = bus->current;
+
+  while(1)
+  {
+    if(ptransfer == 0)
+    {
+      ptransfer = spi_bus_next(bus);
+      if(ptransfer == 0)
+      {
+        return;
+      }
+      spi_bus_configure(bus, ptransfer->device);
+      ptransfer->state = SPI_BUS_TRANSFER_ACTIVE;
+      bus->phase = SPI_BUS_PHASE_CMD;
+      bus->count = 0;
+      bus->start_cycle = DWT->CYCCNT;
+      gpio_bits_reset(ptransfer->device->cs_gpio, ptransfer->device->cs_pins);
+    }
+
+    if(spi_bus_step(bus) == TRUE)
+    {
+      return;
+    }
+
+    /* the last byte is received, so the spi is idle */
+    gpio_bits_set(ptransfer->device->cs_gpio, ptransfer->device->cs_pins);
+    bus->busy_cycles += DWT->CYCCNT - bus->start_cycle;
+    bus->transfers ++;
+    bus->bytes += ptransfer->cmd_length + ptransfer->length;
+    bus->current = 0;
+    ptransfer->state = SPI_BUS_TRANSFER_DONE;
+    if(ptransfer->callback != 0)
+    {
+      ptransfer->callback(ptransfer);
+    }
+    ptransfer = 0;
+  }
+}
+
+/**
+  * @brief  initializes the bus, spi_x, dma_rx_channel, dma_tx_channel and
+  *         dma_threshold set. spi_bus_lowlevel_init is called for the pins,
+  *         the clocks and the dma interrupt.
+  * @param  bus: the bus to set up.
+  * @retval none
+  */
+void spi_bus_init(spi_bus_type *bus)
+{
+  dma_init_type dma_init_struct;
+  uint32_t priority;
+
+  for(priority = 0; priority < SPI_BUS_PRIORITY_NUM; priority ++)
+  {
+    bus->head[priority] = 0;
+    bus->tail[priority] = 0;
+  }
+  bus->current = 0;
+  bus->configured = 0;
+  bus->running = 0;
+  bus->dummy_tx = SPI_BUS_DUMMY_BYTE;
+  bus->busy_cycles = 0;
+  bus->transfers = 0;
+  bus->bytes = 0;
+  bus->dma_phases = 0;
+  bus->polled_phases = 0;
+  bus->reconfigs = 0;
+  if(bus->dma_threshold == 0)
+  {
+    bus->dma_threshold = SPI_BUS_DMA_THRESHOLD;
+  }
+
+  spi_bus_lowlevel_init(bus);
+
+  /* the channels are set up once, a transfer loads the address and count */
+  dma_reset(bus->dma_rx_channel);
+  dma_reset(bus->dma_tx_channel);
+  dma_default_para_init(&dma_init_struct);
+  dma_init_struct.buffer_size = 1;
+  dma_init_struct.direction = DMA_DIR_PERIPHERAL_TO_MEMORY;
+  dma_init_struct.memory_base_addr = (uint32_t)&bus->dummy_rx;
+  dma_init_struct.memory_data_width = DMA_MEMORY_DATA_WIDTH_BYTE;
+  dma_init_struct.memory_inc_enable = TRUE;
+  dma_init_struct.peripheral_base_addr = (uint32_t)&bus->spi_x->dt;
+  dma_init_struct.peripheral_data_width = DMA_PERIPHERAL_DATA_WIDTH_BYTE;
+  dma_init_struct.peripheral_inc_enable = FALSE;
+  dma_init_struct.priority = DMA_PRIORITY_VERY_HIGH;
+  dma_init_struct.loop_mode_enable = FALSE;
+  dma_init(bus->dma_rx_channel, &dma_init_struct);
+  dma_init_struct.direction = DMA_DIR_MEMORY_TO_PERIPHERAL;
+  dma_init_struct.memory_base_addr = (uint32_t)&bus->dummy_tx;
+  dma_init_struct.priority = DMA_PRIORITY_HIGH;
+  dma_init(bus->dma_tx_channel, &dma_init_struct);
+  dma_interrupt_enable(bus->dma_rx_channel, DMA_FDT_INT, TRUE);
+
+  /* the dwt cycle counter measures the bus load */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  bus->load_busy = 0;
+  bus->load_cycle = DWT->CYCCNT;
+}
+
+/**
+  * @brief  set the cs pins of a device as outputs, released.
+  * @param  device: the device, its gpio clock enabled
+  * @retval none
+  */
+void spi_bus_device_init(const spi_bus_device_type *device)
+{
+  gpio_init_type gpio_init_struct;
+
+  gpio_bits_set(device->cs_gpio, device->cs_pins);
+  gpio_default_para_init(&gpio_init_struct);
+  gpio_init_struct.gpio_drive_strength = GPIO_DRIVE_STRENGTH_STRONGER;
+  gpio_init_struct.gpio_out_type = GPIO_OUTPUT_PUSH_PULL;
+  gpio_init_struct.gpio_mode = GPIO_MODE_OUTPUT;
+  gpio_init_struct.gpio_pins = device->cs_pins;
+  gpio_init_struct.gpio_pull = GPIO_PULL_NONE;
+  gpio_init(device->cs_gpio, &gpio_init_struct);
+}
+
+/**
+  * @brief  queue a transfer behind the ones of the same priority, it starts
+  *         at once when the bus is idle.
+  * @note   the transfer and its buffers must stay valid until its state is
+  *         SPI_BUS_TRANSFER_DONE. may be called from interrupts and from the
+  *         completion callback.
+  * @param  bus: bus
+  * @param  ptransfer: transfer, every field but state and next set
+  * @retval ERROR when the device is missing or the priority is out of range
+  */
+error_status spi_bus_submit(spi_bus_type *bus, spi_bus_transfer_type *ptransfer)
+{
+  uint32_t primask;
+  uint8_t start;
+
+  if(ptransfer->device == 0 || ptransfer->priority >= SPI_BUS_PRIORITY_NUM ||
+     (ptransfer->cmd == 0 && ptransfer->cmd_length != 0))
+  {
+    ptransfer->state = SPI_BUS_TRANSFER_ERROR;
+    return ERROR;
+  }
+
+  ptransfer->next = 0;
+  ptransfer->state = SPI_BUS_TRANSFER_QUEUED;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if(bus->tail[ptransfer->priority] == 0)
+  {
+    bus->head[ptransfer->priority] = ptransfer;
+  }
+  else
+  {
+    bus->tail[ptransfer->priority]->next = ptransfer;
+  }
+  bus->tail[ptransfer->priority] = ptransfer;
+
+  /* the caller runs the bus when it is idle, the dma interrupt otherwise */
+  start = (bus->running == 0);
+  bus->running = 1;
+  __set_PRIMASK(primask);
+
+  if(start)
+  {
+    spi_bus_run(bus);
+  }
+  return SUCCESS;
+}
+
+/**
+  * @brief  wait for a submitted transfer.
+  * @param  ptransfer: transfer
+  * @retval none
+  */
+void spi_bus_transfer_wait(spi_bus_transfer_type *ptransfer)
+{
+  while(ptransfer->state == SPI_BUS_TRANSFER_QUEUED || ptransfer->state == SPI_BUS_TRANSFER_ACTIVE);
+}
+
+/**
+  * @brief  submit a transfer and wait for it.
+  * @param  bus: bus
+  * @param  ptransfer: transfer
+  * @retval ERROR when the transfer is rejected
+  */
+error_status spi_bus_transfer(spi_bus_type *bus, spi_bus_transfer_type *ptransfer)
+{
+  if(spi_bus_submit(bus, ptransfer) != SUCCESS)
+  {
+    return ERROR;
+  }
+  spi_bus_transfer_wait(ptransfer);
+  return SUCCESS;
+}
+
+/**
+  * @brief  bus load since the previous call.
+  * @param  bus: bus
+  * @retval cs low time in per mille of the elapsed time
+  */
+uint32_t spi_bus_load_get(spi_bus_type *bus)
+{
+  uint32_t busy = bus->busy_cycles - bus->load_busy;
+  uint32_t elapsed = DWT->CYCCNT - bus->load_cycle;
+
+  bus->load_busy += busy;
+  bus->load_cycle += elapsed;
+  if(elapsed == 0)
+  {
+    return 0;
+  }
+  return (uint32_t)((uint64_t)busy * 1000 / elapsed);
+}
+
+/**
+  * @brief  continue the current transfer, call it from the interrupt of
+  *         dma_rx_channel.
+  * @param  bus: bus
+  * @retval none
+  */
+void spi_bus_dma_irq_handler(spi_bus_type *bus)
+{
+  uint32_t flag = DMA_GET_TC_FLAG(bus->dma_rx_channel);
+
+  if(dma_interrupt_flag_get(flag) == RESET)
+  {
+    return;
+  }
+  dma_flag_clear(flag);
+  bus->dma_rx_channel->ctrl_bit.chen = FALSE;
+  bus->dma_tx_channel->ctrl_bit.chen = FALSE;
+  spi_i2s_dma_transmitter_enable(bus->spi_x, FALSE);
+  spi_i2s_dma_receiver_enable(bus->spi_x, FALSE);
+  if(bus->current != 0)
+  {
+    spi_bus_run(bus);
+  }
+}
+
+/**
+  * @}
+  */
@@ -0,0 +1,176 @@
+/**
+  **************************************************************************
+  * @file     spi_bus.h
+  * @brief    shared spi bus manager header file
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+/*!< define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SPI_BUS_H
+#define __SPI_BUS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* includes ------------------------------------------------------------------*/
+#include "at32f403a_407.h"
+
+/** @addtogroup AT32F403A_407_middlewares_spi_bus_library
+  * @{
+  */
+
+/** @defgroup SPI_bus_definition
+  * @brief    devices share one spi master, each with its own cs pin, clock
+  *           division, mode and bit order. transfers are queued per priority
+  *           and run one after the other, the next one is started from the
+  *           dma full transfer interrupt of the previous one. a phase shorter
+  *           than dma_threshold bytes is polled, longer ones use the rx and tx
+  *           dma channels. the spi is only set up again when the device
+  *           changes. a transfer is not preempted, split long reads into
+  *           several transfers to bound the wait of urgent ones.
+  * @{
+  */
+
+#define SPI_BUS_PRIORITY_NUM             3
+#define SPI_BUS_DMA_MAX_LEN              0xFFFF
+#define SPI_BUS_DUMMY_BYTE               0xFF
+
+#ifndef SPI_BUS_DMA_THRESHOLD
+#define SPI_BUS_DMA_THRESHOLD            16         /*!< default of dma_threshold */
+#endif
+
+/**
+  * @}
+  */
+
+/** @defgroup SPI_bus_types
+  * @{
+  */
+
+typedef enum
+{
+  SPI_BUS_PRIORITY_HIGH = 0,
+  SPI_BUS_PRIORITY_NORMAL,
+  SPI_BUS_PRIORITY_LOW,
+} spi_bus_priority_type;
+
+typedef enum
+{
+  SPI_BUS_TRANSFER_IDLE,
+  SPI_BUS_TRANSFER_QUEUED,
+  SPI_BUS_TRANSFER_ACTIVE,
+  SPI_BUS_TRANSFER_DONE,
+  SPI_BUS_TRANSFER_ERROR,                /*!< rejected by spi_bus_submit */
+} spi_bus_transfer_state_type;
+
+typedef struct
+{
+  gpio_type                              *cs_gpio;
+  uint16_t                               cs_pins;        /*!< driven low during a transfer */
+  spi_mclk_freq_div_type                 mclk_freq_division;
+  spi_clock_polarity_type                clock_polarity;
+  spi_clock_phase_type                   clock_phase;
+  spi_first_bit_type                     first_bit_transmission;
+} spi_bus_device_type;
+
+typedef struct spi_bus_transfer_struct spi_bus_transfer_type;
+
+/**
+  * @brief  completion callback, called from the dma interrupt, or from
+  *         spi_bus_submit when the whole transfer was polled. it may submit
+  *         the next transfer.
+  */
+typedef void (*spi_bus_callback_type)(spi_bus_transfer_type *ptransfer);
+
+struct spi_bus_transfer_struct
+{
+  const spi_bus_device_type              *device;
+  const uint8_t                          *cmd;           /*!< sent first, the received bytes are dropped */
+  uint32_t                               cmd_length;     /*!< may be 0 */
+  const uint8_t                          *tx_buffer;     /*!< data phase, 0 sends SPI_BUS_DUMMY_BYTE */
+  uint8_t                                *rx_buffer;     /*!< data phase, 0 drops the received bytes */
+  uint32_t                               length;         /*!< data phase, may be 0 */
+  spi_bus_priority_type                  priority;
+  spi_bus_callback_type                  callback;       /*!< may be 0 */
+  void                                   *param;         /*!< for the callback */
+  __IO spi_bus_transfer_state_type       state;
+  spi_bus_transfer_type                  *next;          /*!< queue link, owned by the bus */
+};
+
+typedef struct
+{
+  spi_type                               *spi_x;
+  dma_channel_type                       *dma_rx_channel;
+  dma_channel_type                       *dma_tx_channel;
+  uint32_t                               dma_threshold;  /*!< shortest phase moved by dma */
+
+  spi_bus_transfer_type                  *head[SPI_BUS_PRIORITY_NUM];
+  spi_bus_transfer_type                  *tail[SPI_BUS_PRIORITY_NUM];
+  spi_bus_transfer_type                  *current;
+  const spi_bus_device_type              *configured;    /*!< device the spi is set up for */
+  __IO uint8_t                           running;        /*!< a transfer is in progress */
+  uint8_t                                phase;
+  uint32_t                               count;          /*!< bytes of the phase started */
+  uint8_t                                dummy_tx;
+  uint8_t                                dummy_rx;
+  uint32_t                               start_cycle;
+
+  /* statistics, cycles of the dwt cycle counter */
+  uint32_t                               busy_cycles;    /*!< cs low time of every transfer */
+  uint32_t                               transfers;
+  uint32_t                               bytes;
+  uint32_t                               dma_phases;
+  uint32_t                               polled_phases;
+  uint32_t                               reconfigs;      /*!< device changes */
+  uint32_t                               load_busy;      /*!< busy_cycles at the last spi_bus_load_get */
+  uint32_t                               load_cycle;
+} spi_bus_type;
+
+/**
+  * @}
+  */
+
+/** @defgroup SPI_bus_exported_functions
+  * @{
+  */
+
+void         spi_bus_lowlevel_init    (spi_bus_type *bus);
+void         spi_bus_init             (spi_bus_type *bus);
+void         spi_bus_device_init      (const spi_bus_device_type *device);
+error_status spi_bus_submit           (spi_bus_type *bus, spi_bus_transfer_type *ptransfer);
+void         spi_bus_transfer_wait    (spi_bus_transfer_type *ptransfer);
+error_status spi_bus_transfer         (spi_bus_type *bus, spi_bus_transfer_type *ptransfer);
+uint32_t     spi_bus_load_get         (spi_bus_type *bus);
+void         spi_bus_dma_irq_handler  (spi_bus_type *bus);
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,787 @@
+/**
+  **************************************************************************
+  * @file     dfu_class.c
+  * @brief    usb dfu class type
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+#include "usbd_core.h"
+#include "dfu_class.h"
+#include "dfu_desc.h"
+
+/** @addtogroup AT32F403A_407_middlewares_usbd_class
+  * @{
+  */
+
+/** @defgroup USB_dfu_class
+  * @brief usb device class dfu demo
+  * @{
+  */
+
+/** @defgroup USB_dfu_class_private_functions
+  * @{
+  */
+
+
+static usb_sts_type class_init_handler(void *udev);
+static usb_sts_type class_clear_handler(void *udev);
+static usb_sts_type class_setup_handler(void *udev, usb_setup_type *setup);
+static usb_sts_type class_ept0_tx_handler(void *udev);
+static usb_sts_type class_ept0_rx_handler(void *udev);
+static usb_sts_type class_in_handler(void *udev, uint8_t ept_num);
+static usb_sts_type class_out_handler(void *udev, uint8_t ept_num);
+static usb_sts_type class_sof_handler(void *udev);
+static usb_sts_type class_event_handler(void *udev, usbd_event_type event);
+
+static void dfu_session_init(dfu_info_type *pdfu);
+static usb_sts_type dfu_dnload(usbd_core_type *pudev, usb_setup_type *setup);
+static usb_sts_type dfu_upload(usbd_core_type *pudev, usb_setup_type *setup);
+static void dfu_getstatus(usbd_core_type *pudev);
+static uint32_t dfu_busy_time_get(dfu_info_type *pdfu);
+static dfu_status_type dfu_block_program(dfu_info_type *pdfu, dfu_buf_type *pbuf);
+static dfu_status_type dfu_manifest(dfu_info_type *pdfu);
+
+#if defined ( __ICCARM__ ) /* iar compiler */
+  #pragma data_alignment=4
+#endif
+ALIGNED_HEAD dfu_info_type dfu_info ALIGNED_TAIL;
+
+/* usb device class handler */
+usbd_class_handler dfu_class_handler =
+{
+  class_init_handler,
+  class_clear_handler,
+  class_setup_handler,
+  class_ept0_tx_handler,
+  class_ept0_rx_handler,
+  class_in_handler,
+  class_out_handler,
+  class_sof_handler,
+  class_event_handler,
+  &dfu_info
+};
+
+/**
+  * @brief  get the cycle counter, used to measure flash operation time
+  * @param  none
+  * @retval cycle count
+  */
+static uint32_t dfu_cycle_get(void)
+{
+  return DWT->CYCCNT;
+}
+
+/**
+  * @brief  convert elapsed cycles since start to microsecond
+  * @param  start: cycle count at the start of the operation
+  * @retval elapsed time in microsecond
+  */
+static uint32_t dfu_elapsed_us(uint32_t start)
+{
+  return (dfu_cycle_get() - start) / (system_core_clock / 1000000);
+}
+
+/**
+  * @brief  initialize usb dfu class
+  * @param  udev: to the structure of usbd_core_type
+  * @retval status of usb_sts_type
+  */
+static usb_sts_type class_init_handler(void *udev)
+{
+  usb_sts_type status = USB_OK;
+  usbd_core_type *pudev = (usbd_core_type *)udev;
+  dfu_info_type *pdfu = (dfu_info_type *)pudev->class_handler->pdata;
+
+  /* enable the cycle counter for erase and program time measurement */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  crm_periph_clock_enable(CRM_CRC_PERIPH_CLOCK, TRUE);
+
+  pdfu->erase_time_us = DFU_DEFAULT_ERASE_US;
+  pdfu->program_time_us = DFU_DEFAULT_WORD_PROGRAM_US * (USBD_DFU_XFER_SIZE / sizeof(uint32_t));
+  pdfu->dev_state = DFU_STATE_IDLE;
+  pdfu->dev_status = DFU_STATUS_OK;
+  pdfu->rx_index = 0;
+  pdfu->prog_index = 0;
+  pdfu->manifest_done = 0;
+  dfu_session_init(pdfu);
+
+  return status;
+}
+
+/**
+  * @brief  clear endpoint or other state
+  * @param  udev: to the structure of usbd_core_type
+  * @retval status of usb_sts_type
+  */
+static usb_sts_type class_clear_handler(void *udev)
+{
+  usb_sts_type status = USB_OK;
+
+  /* dfu only use the control endpoint */
+
+  return status;
+}
+
+/**
+  * @brief  usb device class setup request handler
+  * @param  udev: to the structure of usbd_core_type
+  * @param  setup: setup packet
+  * @retval status of usb_sts_type
+  */
+static usb_sts_type class_setup_handler(void *udev, usb_setup_type *setup)
+{
+  usb_sts_type status = USB_OK;
+  usbd_core_type *pudev = (usbd_core_type *)udev;
+  dfu_info_type *pdfu = (dfu_info_type *)pudev->class_handler->pdata;
+  uint16_t len;
+  uint8_t *buf;
+
+  switch(setup->bmRequestType & USB_REQ_TYPE_RESERVED)
+  {
+    /* class request */
+    case USB_REQ_TYPE_CLASS:
+      switch(setup->bRequest)
+      {
+        case DFU_REQ_DETACH:
+          break;
+        case DFU_REQ_DNLOAD:
+          status = dfu_dnload(pudev, setup);
+          break;
+        case DFU_REQ_UPLOAD:
+          status = dfu_upload(pudev, setup);
+          break;
+        case DFU_REQ_GETSTATUS:
+          dfu_getstatus(pudev);
+          break;
+        case DFU_REQ_CLRSTATUS:
+          if(pdfu->dev_state == DFU_STATE_ERROR)
+          {
+            pdfu->dev_status = DFU_STATUS_OK;
+            pdfu->dev_state = DFU_STATE_IDLE;
+          }
+          else
+          {
+            /* only valid in dfuERROR, stall it as the dfu 1.1 state table asks */
+            pdfu->dev_status = DFU_STATUS_ERR_STALLEDPKT;
+            pdfu->dev_state = DFU_STATE_ERROR;
+            usbd_ctrl_unsupport(pudev);
+            status = USB_FAIL;
+          }
+          break;
+        case DFU_REQ_GETSTATE:
+          usbd_ctrl_send(pudev, (uint8_t *)&pdfu->dev_state, 1);
+          break;
+        case DFU_REQ_ABORT:
+          switch(pdfu->dev_state)
+          {
+            case DFU_STATE_IDLE:
+            case DFU_STATE_DNLOAD_SYNC:
+            case DFU_STATE_DNLOAD_IDLE:
+            case DFU_STATE_MANIFEST_SYNC:
+            case DFU_STATE_UPLOAD_IDLE:
+              pdfu->dev_state = DFU_STATE_IDLE;
+              break;
+            default:
+              break;
+          }
+          break;
+        default:
+          usbd_ctrl_unsupport(pudev);
+          status = USB_NOT_SUPPORT;
+          break;
+      }
+      break;
+    /* standard request */
+    case USB_REQ_TYPE_STANDARD:
+      switch(setup->bRequest)
+      {
+        case USB_STD_REQ_GET_DESCRIPTOR:
+          if(setup->wValue >> 8 == DFU_DESCRIPTOR_TYPE)
+          {
+            len = MIN(USBD_DFU_FUNC_DESC_LEN, setup->wLength);
+            buf = (uint8_t *)g_dfu_func_desc;
+            usbd_ctrl_send(pudev, (uint8_t *)buf, len);
+          }
+          else
+          {
+            usbd_ctrl_unsupport(pudev);
+          }
+          break;
+        case USB_STD_REQ_GET_INTERFACE:
+          usbd_ctrl_send(pudev, (uint8_t *)&pdfu->alt_setting, 1);
+          break;
+        case USB_STD_REQ_SET_INTERFACE:
+          pdfu->alt_setting = setup->wValue;
+          break;
+        default:
+          usbd_ctrl_unsupport(pudev);
+          break;
+      }
+      break;
+    default:
+      usbd_ctrl_unsupport(pudev);
+      break;
+  }
+  return status;
+}
+
+/**
+  * @brief  usb device endpoint 0 in status stage complete
+  * @param  udev: to the structure of usbd_core_type
+  * @retval status of usb_sts_type
+  */
+static usb_sts_type class_ept0_tx_handler(void *udev)
+{
+  usb_sts_type status = USB_OK;
+
+  /* ...user code... */
+
+  return status;
+}
+
+/**
+  * @brief  usb device endpoint 0 out status stage complete
+  * @param  udev: to the structure of usbd_core_type
+  * @retval status of usb_sts_type
+  */
+static usb_sts_type class_ept0_rx_handler(void *udev)
+{
+  usb_sts_type status = USB_OK;
+  usbd_core_type *pudev = (usbd_core_type *)udev;
+  dfu_info_type *pdfu = (dfu_info_type *)pudev->class_handler->pdata;
+  dfu_buf_type *pbuf = &pdfu->buf[pdfu->rx_index];
+
+  if(pbuf->state == DFU_BUF_RECEIVING)
+  {
+    /* hand the block over to usbd_dfu_loop, the next block goes to the other buffer */
+    pbuf->state = DFU_BUF_READY;
+    pdfu->rx_index = (pdfu->rx_index + 1) % USBD_DFU_BUF_NUM;
+  }
+
+  return status;
+}
+
+/**
+  * @brief  usb device transmision complete handler
+  * @param  udev: to the structure of usbd_core_type
+  * @param  ept_num: endpoint number
+  * @retval status of usb_sts_type
+  */
+static usb_sts_type class_in_handler(void *udev, uint8_t ept_num)
+{
+  usb_sts_type status = USB_OK;
+
+  /* dfu only use the control endpoint */
+
+  return status;
+}
+
+/**
+  * @brief  usb device endpoint receive data
+  * @param  udev: to the structure of usbd_core_type
+  * @param  ept_num: endpoint number
+  * @retval status of usb_sts_type
+  */
+static usb_sts_type class_out_handler(void *udev, uint8_t ept_num)
+{
+  usb_sts_type status = USB_OK;
+
+  /* dfu only use the control endpoint */
+
+  return status;
+}
+
+/**
+  * @brief  usb device sof handler
+  * @param  udev: to the structure of usbd_core_type
+  * @retval status of usb_sts_type
+  */
+static usb_sts_type class_sof_handler(void *udev)
+{
+  usb_sts_type status = USB_OK;
+
+  /* ...user code... */
+
+  return status;
+}
+
+/**
+  * @brief  usb device event handler
+  * @param  udev: to the structure of usbd_core_type
+  * @param  event: usb device event
+  * @retval status of usb_sts_type
+  */
+static usb_sts_type class_event_handler(void *udev, usbd_event_type event)
+{
+  usb_sts_type status = USB_OK;
+  switch(event)
+  {
+    case USBD_RESET_EVENT:
+
+      /* ...user code... */
+
+      break;
+    case USBD_SUSPEND_EVENT:
+
+      /* ...user code... */
+
+      break;
+    case USBD_WAKEUP_EVENT:
+      /* ...user code... */
+
+      break;
+    default:
+      break;
+  }
+  return status;
+}
+
+/**
+  * @brief  init the flash layout and the download session
+  * @param  pdfu: to the structure of dfu_info_type
+  * @retval none
+  */
+static void dfu_session_init(dfu_info_type *pdfu)
+{
+  uint32_t flash_size = DFU_KB_TO_B(DFU_FLASH_SIZE_REG());
+
+  if(flash_size < DFU_KB_TO_B(256))
+  {
+    pdfu->sector_size = DFU_SECTOR_SIZE_1K;
+  }
+  else
+  {
+    pdfu->sector_size = DFU_SECTOR_SIZE_2K;
+  }
+
+  pdfu->app_address = USBD_DFU_APP_ADDRESS;
+  pdfu->flag_address = pdfu->app_address - pdfu->sector_size;
+  pdfu->flash_end_address = FLASH_BASE + flash_size;
+
+  pdfu->erased_address = pdfu->app_address;
+  pdfu->image_length = 0;
+  pdfu->image_crc = 0;
+}
+
+/**
+  * @brief  dfu download request
+  * @param  pudev: to the structure of usbd_core_type
+  * @param  setup: setup packet
+  * @retval status of usb_sts_type
+  */
+static usb_sts_type dfu_dnload(usbd_core_type *pudev, usb_setup_type *setup)
+{
+  dfu_info_type *pdfu = (dfu_info_type *)pudev->class_handler->pdata;
+  dfu_buf_type *pbuf = &pdfu->buf[pdfu->rx_index];
+  uint32_t address = pdfu->app_address + (uint32_t)setup->wValue * USBD_DFU_XFER_SIZE;
+
+  if(setup->wLength > 0)
+  {
+    if(pdfu->dev_state != DFU_STATE_IDLE && pdfu->dev_state != DFU_STATE_DNLOAD_IDLE)
+    {
+      pdfu->dev_status = DFU_STATUS_ERR_STALLEDPKT;
+      pdfu->dev_state = DFU_STATE_ERROR;
+      usbd_ctrl_unsupport(pudev);
+      return USB_FAIL;
+    }
+
+    if(setup->wLength > USBD_DFU_XFER_SIZE || address + setup->wLength > pdfu->flash_end_address)
+    {
+      pdfu->dev_status = DFU_STATUS_ERR_ADDRESS;
+      pdfu->dev_state = DFU_STATE_ERROR;
+      usbd_ctrl_unsupport(pudev);
+      return USB_FAIL;
+    }
+
+    if(pbuf->state != DFU_BUF_FREE)
+    {
+      /* the host did not honor the poll timeout */
+      usbd_ctrl_unsupport(pudev);
+      return USB_FAIL;
+    }
+
+    if(pdfu->dev_state == DFU_STATE_IDLE)
+    {
+      /* first block of a new image: restart the erase tracking and the stream crc */
+      dfu_session_init(pdfu);
+      crc_data_reset();
+    }
+
+    pbuf->address = address;
+    pbuf->length = setup->wLength;
+    pbuf->state = DFU_BUF_RECEIVING;
+    pdfu->dev_state = DFU_STATE_DNLOAD_SYNC;
+    usbd_ctrl_recv(pudev, (uint8_t *)pbuf->data, setup->wLength);
+  }
+  else
+  {
+    /* zero length download ends the transfer */
+    if(pdfu->dev_state != DFU_STATE_DNLOAD_IDLE)
+    {
+      pdfu->dev_status = DFU_STATUS_ERR_NOTDONE;
+      pdfu->dev_state = DFU_STATE_ERROR;
+      usbd_ctrl_unsupport(pudev);
+      return USB_FAIL;
+    }
+    pdfu->manifest_done = 0;
+    pdfu->dev_state = DFU_STATE_MANIFEST_SYNC;
+  }
+  return USB_OK;
+}
+
+/**
+  * @brief  dfu upload request
+  * @param  pudev: to the structure of usbd_core_type
+  * @param  setup: setup packet
+  * @retval status of usb_sts_type
+  */
+static usb_sts_type dfu_upload(usbd_core_type *pudev, usb_setup_type *setup)
+{
+  dfu_info_type *pdfu = (dfu_info_type *)pudev->class_handler->pdata;
+  uint32_t address = pdfu->app_address + (uint32_t)setup->wValue * USBD_DFU_XFER_SIZE;
+  uint16_t len = 0;
+
+  if((pdfu->dev_state != DFU_STATE_IDLE && pdfu->dev_state != DFU_STATE_UPLOAD_IDLE) ||
+     setup->wLength > USBD_DFU_XFER_SIZE)
+  {
+    pdfu->dev_status = DFU_STATUS_ERR_STALLEDPKT;
+    pdfu->dev_state = DFU_STATE_ERROR;
+    usbd_ctrl_unsupport(pudev);
+    return USB_FAIL;
+  }
+
+  if(address < pdfu->flash_end_address)
+  {
+    len = MIN(setup->wLength, pdfu->flash_end_address - address);
+  }
+
+  /* a short frame tells the host that the upload is finished */
+  if(len < setup->wLength)
+  {
+    pdfu->dev_state = DFU_STATE_IDLE;
+  }
+  else
+  {
+    pdfu->dev_state = DFU_STATE_UPLOAD_IDLE;
+  }
+  usbd_ctrl_send(pudev, (uint8_t *)address, len);
+
+  return USB_OK;
+}
+
+/**
+  * @brief  estimate the time until a download buffer is free again
+  * @param  pdfu: to the structure of dfu_info_type
+  * @retval busy time in microsecond
+  */
+static uint32_t dfu_busy_time_get(dfu_info_type *pdfu)
+{
+  uint32_t busy_us = 0, elapsed, erased = pdfu->erased_address;
+  uint8_t i_index;
+  dfu_buf_type *pbuf;
+
+  for(i_index = 0; i_index < USBD_DFU_BUF_NUM; i_index ++)
+  {
+    pbuf = &pdfu->buf[(pdfu->prog_index + i_index) % USBD_DFU_BUF_NUM];
+    if(pbuf->state != DFU_BUF_READY && pbuf->state != DFU_BUF_PROGRAMMING)
+    {
+      continue;
+    }
+
+    /* sectors this block still has to erase */
+    while(erased < pbuf->address + pbuf->length)
+    {
+      busy_us += pdfu->erase_time_us;
+      erased += pdfu->sector_size;
+    }
+    busy_us += pdfu->program_time_us;
+
+    if(pbuf->state == DFU_BUF_PROGRAMMING)
+    {
+      elapsed = dfu_elapsed_us(pdfu->busy_start);
+      busy_us = (busy_us > elapsed) ? (busy_us - elapsed) : 0;
+    }
+  }
+  return busy_us;
+}
+
+/**
+  * @brief  dfu get status request, also advance the download and manifest state
+  * @param  pudev: to the structure of usbd_core_type
+  * @retval none
+  */
+static void dfu_getstatus(usbd_core_type *pudev)
+{
+  dfu_info_type *pdfu = (dfu_info_type *)pudev->class_handler->pdata;
+  uint32_t poll_ms = 0;
+
+  if(pdfu->dev_status != DFU_STATUS_OK)
+  {
+    pdfu->dev_state = DFU_STATE_ERROR;
+  }
+
+  switch(pdfu->dev_state)
+  {
+    case DFU_STATE_DNLOAD_SYNC:
+    case DFU_STATE_DNBUSY:
+      if(pdfu->buf[pdfu->rx_index].state == DFU_BUF_FREE)
+      {
+        /* the other buffer is free: accept the next block while this one is programmed */
+        pdfu->dev_state = DFU_STATE_DNLOAD_IDLE;
+      }
+      else
+      {
+        pdfu->dev_state = DFU_STATE_DNBUSY;
+        poll_ms = (dfu_busy_time_get(pdfu) + 999) / 1000;
+      }
+      break;
+    case DFU_STATE_MANIFEST_SYNC:
+    case DFU_STATE_MANIFEST:
+      if(pdfu->manifest_done)
+      {
+        /* manifestation tolerant, go back to idle and report the verify result */
+        pdfu->dev_state = DFU_STATE_IDLE;
+      }
+      else
+      {
+        pdfu->dev_state = DFU_STATE_MANIFEST;
+        poll_ms = (dfu_busy_time_get(pdfu) + 999) / 1000 + 1;
+      }
+      break;
+    default:
+      break;
+  }
+
+  if(poll_ms == 0 && pdfu->dev_state == DFU_STATE_DNBUSY)
+  {
+    poll_ms = 1;
+  }
+
+  pdfu->status[0] = pdfu->dev_status;
+  pdfu->status[1] = (uint8_t)(poll_ms & 0xFF);
+  pdfu->status[2] = (uint8_t)((poll_ms >> 8) & 0xFF);
+  pdfu->status[3] = (uint8_t)((poll_ms >> 16) & 0xFF);
+  pdfu->status[4] = pdfu->dev_state;
+  pdfu->status[5] = 0;
+
+  usbd_ctrl_send(pudev, pdfu->status, 6);
+}
+
+/**
+  * @brief  erase, program and read back one download block
+  * @param  pdfu: to the structure of dfu_info_type
+  * @param  pbuf: download buffer
+  * @retval status of dfu_status_type
+  */
+static dfu_status_type dfu_block_program(dfu_info_type *pdfu, dfu_buf_type *pbuf)
+{
+  dfu_status_type status = DFU_STATUS_OK;
+  uint32_t address = pbuf->address;
+  uint32_t end_address = pbuf->address + pbuf->length;
+  uint32_t wlen = (pbuf->length + 3) / sizeof(uint32_t);
+  uint32_t start, i_index;
+  uint8_t *pbyte = (uint8_t *)pbuf->data;
+
+  /* pad the last word with the erased value */
+  for(i_index = pbuf->length; i_index < wlen * sizeof(uint32_t); i_index ++)
+  {
+    pbyte[i_index] = 0xFF;
+  }
+
+  flash_unlock();
+
+  /* erase the sectors this block reaches */
+  while(pdfu->erased_address < end_address)
+  {
+    start = dfu_cycle_get();
+    if(flash_sector_erase(pdfu->erased_address) != FLASH_OPERATE_DONE)
+    {
+      status = DFU_STATUS_ERR_ERASE;
+      break;
+    }
+    pdfu->erase_time_us = (pdfu->erase_time_us + dfu_elapsed_us(start)) / 2;
+    pdfu->erased_address += pdfu->sector_size;
+  }
+
+  if(status == DFU_STATUS_OK)
+  {
+    start = dfu_cycle_get();
+    for(i_index = 0; i_index < wlen; i_index ++)
+    {
+      /* the sector is erased, so erased words need no programming */
+      if(pbuf->data[i_index] != 0xFFFFFFFF &&
+         flash_word_program(address + i_index * sizeof(uint32_t), pbuf->data[i_index]) != FLASH_OPERATE_DONE)
+      {
+        status = DFU_STATUS_ERR_PROG;
+        break;
+      }
+    }
+    pdfu->program_time_us = (pdfu->program_time_us + dfu_elapsed_us(start)) / 2;
+  }
+
+  flash_lock();
+
+  if(status == DFU_STATUS_OK)
+  {
+    /* read back only the block just written */
+    for(i_index = 0; i_index < wlen; i_index ++)
+    {
+      if(*(uint32_t *)(address + i_index * sizeof(uint32_t)) != pbuf->data[i_index])
+      {
+        status = DFU_STATUS_ERR_VERIFY;
+        break;
+      }
+    }
+  }
+
+  if(status == DFU_STATUS_OK)
+  {
+    crc_block_calculate(pbuf->data, wlen);
+    if(end_address - pdfu->app_address > pdfu->image_length)
+    {
+      pdfu->image_length = end_address - pdfu->app_address;
+    }
+  }
+
+  return status;
+}
+
+/**
+  * @brief  manifestation: verify the whole image and set the upgrade flag
+  * @param  pdfu: to the structure of dfu_info_type
+  * @retval status of dfu_status_type
+  */
+static dfu_status_type dfu_manifest(dfu_info_type *pdfu)
+{
+  dfu_status_type status = DFU_STATUS_OK;
+  uint32_t flash_crc;
+
+  pdfu->image_crc = crc_data_get();
+
+  crc_data_reset();
+  flash_crc = crc_block_calculate((uint32_t *)pdfu->app_address,
+                                  (pdfu->image_length + 3) / sizeof(uint32_t));
+
+  flash_unlock();
+  if(pdfu->image_length == 0 || flash_crc != pdfu->image_crc)
+  {
+    status = DFU_STATUS_ERR_VERIFY;
+  }
+  else if(flash_word_program(pdfu->flag_address, DFU_UPGRADE_COMPLETE_FLAG) != FLASH_OPERATE_DONE)
+  {
+    status = DFU_STATUS_ERR_WRITE;
+  }
+  flash_lock();
+
+  return status;
+}
+
+/**
+  * @brief  dfu flash loop, program the received blocks while the next one is received.
+  *         must be called from the main loop.
+  * @param  udev: to the structure of usbd_core_type
+  * @retval none
+  */
+void usbd_dfu_loop(void *udev)
+{
+  usbd_core_type *pudev = (usbd_core_type *)udev;
+  dfu_info_type *pdfu = (dfu_info_type *)pudev->class_handler->pdata;
+  dfu_buf_type *pbuf = &pdfu->buf[pdfu->prog_index];
+  dfu_status_type status;
+  uint8_t i_index;
+
+  if(pbuf->state == DFU_BUF_READY)
+  {
+    pdfu->busy_start = dfu_cycle_get();
+    pbuf->state = DFU_BUF_PROGRAMMING;
+
+    if(pdfu->dev_status == DFU_STATUS_OK)
+    {
+      if(pbuf->address == pdfu->app_address)
+      {
+        /* new image, the old one is no longer valid */
+        flash_unlock();
+        flash_sector_erase(pdfu->flag_address);
+        flash_lock();
+      }
+
+      status = dfu_block_program(pdfu, pbuf);
+      if(status != DFU_STATUS_OK)
+      {
+        pdfu->dev_status = status;
+      }
+    }
+
+    pbuf->state = DFU_BUF_FREE;
+    pdfu->prog_index = (pdfu->prog_index + 1) % USBD_DFU_BUF_NUM;
+  }
+  else if((pdfu->dev_state == DFU_STATE_MANIFEST_SYNC || pdfu->dev_state == DFU_STATE_MANIFEST) &&
+          pdfu->manifest_done == 0)
+  {
+    for(i_index = 0; i_index < USBD_DFU_BUF_NUM; i_index ++)
+    {
+      if(pdfu->buf[i_index].state != DFU_BUF_FREE)
+      {
+        return;
+      }
+    }
+
+    if(pdfu->dev_status == DFU_STATUS_OK)
+    {
+      status = dfu_manifest(pdfu);
+      if(status != DFU_STATUS_OK)
+      {
+        pdfu->dev_status = status;
+      }
+    }
+    pdfu->manifest_done = 1;
+  }
+}
+
+/**
+  * @brief  get the dfu upgrade complete flag
+  * @param  none
+  * @retval SET if a verified image is present
+  */
+flag_status usbd_dfu_upgrade_flag_get(void)
+{
+  uint32_t flash_size = DFU_KB_TO_B(DFU_FLASH_SIZE_REG());
+  uint32_t sector_size = (flash_size < DFU_KB_TO_B(256)) ? DFU_SECTOR_SIZE_1K : DFU_SECTOR_SIZE_2K;
+
+  if(*(uint32_t *)(USBD_DFU_APP_ADDRESS - sector_size) == DFU_UPGRADE_COMPLETE_FLAG)
+  {
+    return SET;
+  }
+  return RESET;
+}
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
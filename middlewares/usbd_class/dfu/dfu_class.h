@@ -0,0 +1,219 @@
+/**
+  **************************************************************************
+  * @file     dfu_class.h
+  * @brief    usb dfu class header file
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+ /* define to prevent recursive inclusion -------------------------------------*/
+#ifndef __DFU_CLASS_H
+#define __DFU_CLASS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "usb_std.h"
+#include "usbd_core.h"
+
+
+/** @addtogroup AT32F403A_407_middlewares_usbd_class
+  * @{
+  */
+
+/** @addtogroup USB_dfu_class
+  * @{
+  */
+
+/** @defgroup USB_dfu_class_definition
+  * @{
+  */
+
+/**
+  * @brief dfu application area, can be overridden in usb_conf.h
+  */
+#ifndef USBD_DFU_APP_ADDRESS
+#define USBD_DFU_APP_ADDRESS             0x08005000
+#endif
+
+/**
+  * @brief dfu transfer size (wTransferSize), must be a multiple of 4
+  */
+#ifndef USBD_DFU_XFER_SIZE
+#define USBD_DFU_XFER_SIZE               1024
+#endif
+
+/**
+  * @brief number of download buffers, one is received while the other is programmed
+  */
+#define USBD_DFU_BUF_NUM                 2
+
+#define DFU_FLASH_SIZE_REG()             ((*(uint32_t *)0x1FFFF7E0) & 0xFFFF) /*Get Flash size*/
+#define DFU_KB_TO_B(kb)                  ((kb) << 10)
+
+#define DFU_SECTOR_SIZE_1K               0x400
+#define DFU_SECTOR_SIZE_2K               0x800
+
+#define DFU_UPGRADE_COMPLETE_FLAG        0x41544B38
+
+/**
+  * @brief default erase and program time used before the first measurement (us)
+  */
+#define DFU_DEFAULT_ERASE_US             40000
+#define DFU_DEFAULT_WORD_PROGRAM_US      60
+
+/**
+  * @brief dfu functional descriptor attributes
+  */
+#define DFU_ATTR_CAN_DNLOAD              0x01
+#define DFU_ATTR_CAN_UPLOAD              0x02
+#define DFU_ATTR_MANIFEST_TOLERANT       0x04
+#define DFU_ATTR_WILL_DETACH             0x08
+
+#define DFU_DESCRIPTOR_TYPE              0x21
+#define DFU_DETACH_TIMEOUT               0x00FF
+#define DFU_BCD_VERSION                  0x0110
+
+/**
+  * @brief dfu class request code
+  */
+typedef enum
+{
+  DFU_REQ_DETACH                         = 0x00,
+  DFU_REQ_DNLOAD                         = 0x01,
+  DFU_REQ_UPLOAD                         = 0x02,
+  DFU_REQ_GETSTATUS                      = 0x03,
+  DFU_REQ_CLRSTATUS                      = 0x04,
+  DFU_REQ_GETSTATE                       = 0x05,
+  DFU_REQ_ABORT                          = 0x06
+}dfu_req_type;
+
+/**
+  * @brief dfu device state
+  */
+typedef enum
+{
+  DFU_STATE_APP_IDLE                     = 0x00,
+  DFU_STATE_APP_DETACH                   = 0x01,
+  DFU_STATE_IDLE                         = 0x02,
+  DFU_STATE_DNLOAD_SYNC                  = 0x03,
+  DFU_STATE_DNBUSY                       = 0x04,
+  DFU_STATE_DNLOAD_IDLE                  = 0x05,
+  DFU_STATE_MANIFEST_SYNC                = 0x06,
+  DFU_STATE_MANIFEST                     = 0x07,
+  DFU_STATE_MANIFEST_WAIT_RESET          = 0x08,
+  DFU_STATE_UPLOAD_IDLE                  = 0x09,
+  DFU_STATE_ERROR                        = 0x0A
+}dfu_state_type;
+
+/**
+  * @brief dfu device status
+  */
+typedef enum
+{
+  DFU_STATUS_OK                          = 0x00,
+  DFU_STATUS_ERR_TARGET                  = 0x01,
+  DFU_STATUS_ERR_FILE                    = 0x02,
+  DFU_STATUS_ERR_WRITE                   = 0x03,
+  DFU_STATUS_ERR_ERASE                   = 0x04,
+  DFU_STATUS_ERR_CHECK_ERASED            = 0x05,
+  DFU_STATUS_ERR_PROG                    = 0x06,
+  DFU_STATUS_ERR_VERIFY                  = 0x07,
+  DFU_STATUS_ERR_ADDRESS                 = 0x08,
+  DFU_STATUS_ERR_NOTDONE                 = 0x09,
+  DFU_STATUS_ERR_FIRMWARE                = 0x0A,
+  DFU_STATUS_ERR_VENDOR                  = 0x0B,
+  DFU_STATUS_ERR_USBR                    = 0x0C,
+  DFU_STATUS_ERR_POR                     = 0x0D,
+  DFU_STATUS_ERR_UNKNOWN                 = 0x0E,
+  DFU_STATUS_ERR_STALLEDPKT              = 0x0F
+}dfu_status_type;
+
+/**
+  * @brief dfu download buffer state
+  */
+typedef enum
+{
+  DFU_BUF_FREE,
+  DFU_BUF_RECEIVING,
+  DFU_BUF_READY,
+  DFU_BUF_PROGRAMMING
+}dfu_buf_state_type;
+
+/**
+  * @brief dfu download buffer
+  */
+typedef struct
+{
+  uint32_t data[USBD_DFU_XFER_SIZE / sizeof(uint32_t)];
+  uint32_t address;
+  uint32_t length;
+  __IO dfu_buf_state_type state;
+}dfu_buf_type;
+
+typedef struct
+{
+  dfu_buf_type buf[USBD_DFU_BUF_NUM];
+  uint8_t rx_index;
+  uint8_t prog_index;
+
+  uint8_t status[6];
+  __IO dfu_state_type dev_state;
+  __IO dfu_status_type dev_status;
+  __IO uint8_t manifest_done;
+
+  uint32_t app_address;
+  uint32_t flag_address;
+  uint32_t flash_end_address;
+  uint32_t sector_size;
+
+  uint32_t erased_address;               /*!< flash is erased from the app address up to here */
+  uint32_t image_length;                 /*!< highest address written, relative to app address */
+  uint32_t image_crc;                    /*!< crc of the received stream */
+
+  uint32_t erase_time_us;                /*!< measured sector erase time */
+  uint32_t program_time_us;              /*!< measured full block program time */
+  uint32_t busy_start;                   /*!< cycle count when the current operation started */
+
+  uint32_t alt_setting;
+}dfu_info_type;
+
+extern usbd_class_handler dfu_class_handler;
+extern dfu_info_type dfu_info;
+void usbd_dfu_loop(void *udev);
+flag_status usbd_dfu_upgrade_flag_get(void);
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
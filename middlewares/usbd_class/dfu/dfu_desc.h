@@ -0,0 +1,87 @@
+/**
+  **************************************************************************
+  * @file     dfu_desc.h
+  * @brief    usb dfu descriptor header file
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+/* define to prevent recursive inclusion -------------------------------------*/
+#ifndef __DFU_DESC_H
+#define __DFU_DESC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "dfu_class.h"
+#include "usbd_core.h"
+
+/** @addtogroup AT32F403A_407_middlewares_usbd_class
+  * @{
+  */
+
+/** @addtogroup USB_dfu_desc
+  * @{
+  */
+
+/** @defgroup USB_dfu_desc_definition
+  * @{
+  */
+
+
+#define USBD_DFU_VENDOR_ID               0x2E3C
+#define USBD_DFU_PRODUCT_ID              0xDF12
+
+#define USBD_DFU_CONFIG_DESC_SIZE        27
+#define USBD_DFU_FUNC_DESC_LEN           9
+#define USBD_DFU_SIZ_STRING_LANGID       4
+#define USBD_DFU_SIZ_STRING_SERIAL       0x1A
+
+#define USBD_DFU_DESC_MANUFACTURER_STRING    "Artery"
+#define USBD_DFU_DESC_PRODUCT_STRING         "DFU in FS Mode"
+#define USBD_DFU_DESC_CONFIGURATION_STRING   "DFU Config"
+#define USBD_DFU_DESC_INTERFACE_STRING       "@Internal Flash"
+
+#define         MCU_ID1                   (0x1FFFF7E8)
+#define         MCU_ID2                   (0x1FFFF7EC)
+#define         MCU_ID3                   (0x1FFFF7F0)
+extern uint8_t g_dfu_func_desc[USBD_DFU_FUNC_DESC_LEN];
+
+extern usbd_desc_handler dfu_desc_handler;
+
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+
+/**
+  * @}
+  */
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -73,6 +73,7 @@ extern "C" {
 #define IAP_CMD_GET                      0x5AA7
 
 #define HID_IAP_BUFFER_LEN               1024
+#define HID_IAP_QUEUE_NUM                4       /*!< received blocks buffered ahead of flash programming */
 #define IAP_UPGRADE_COMPLETE_FLAG        0x41544B38
 #define CONVERT_ENDIAN(dwValue)          ((dwValue >> 24) | ((dwValue >> 8) & 0xFF00) | \
                                          ((dwValue << 8) & 0xFF0000) | (dwValue << 24) )
@@ -99,10 +100,21 @@ typedef enum
   IAP_STS_JMP,
 }iap_machine_state_type;
 
+/**
+  * @brief iap received block
+  */
+typedef struct
+{
+  uint32_t data[HID_IAP_BUFFER_LEN / sizeof(uint32_t)];
+  uint32_t address;
+}iap_block_type;
+
 typedef struct
 {
 
-  uint8_t iap_fifo[HID_IAP_BUFFER_LEN];
+  iap_block_type block[HID_IAP_QUEUE_NUM];
+  __IO uint32_t block_head;                /*!< blocks received, moved by the usb interrupt */
+  __IO uint32_t block_tail;                /*!< blocks programmed, moved by iap_loop */
   uint8_t iap_rx[USBD_HIDIAP_OUT_MAXPACKET_SIZE];
   uint8_t iap_tx[USBD_HIDIAP_IN_MAXPACKET_SIZE];
 
@@ -120,6 +132,16 @@ typedef struct
   uint32_t flash_size;
 
   uint32_t respond_flag;
+  __IO uint32_t respond_pending;           /*!< command answered by iap_loop once flash catches up */
+  __IO uint32_t flag_clear_pending;
+  uint32_t erase_start_address;            /*!< erased flash region, [start, end) */
+  uint32_t erase_end_address;
+  uint32_t program_end_address;
+  uint32_t program_error;
+  uint32_t crc_address;
+  uint32_t crc_nk;
+  uint32_t image_start_address;            /*!< first address of the contiguous programmed image */
+  uint32_t image_crc;                      /*!< running crc of the image, fed as each block is programmed */
 
   uint8_t g_rxhid_buff[USBD_HIDIAP_OUT_MAXPACKET_SIZE];
   uint32_t hid_protocol;
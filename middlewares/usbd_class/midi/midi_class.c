@@ -0,0 +1,540 @@
+/**
+  **************************************************************************
+  * @file     midi_class.c
+  * @brief    usb midi class type
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+#include "usbd_core.h"
+#include "midi_class.h"
+#include "midi_desc.h"
+
+/** @addtogroup AT32F403A_407_middlewares_usbd_class
+  * @{
+  */
+
+/** @defgroup USB_midi_class
+  * @brief usb device class midi demo
+  * @{
+  */
+
+/** @defgroup USB_midi_class_private_functions
+  * @{
+  */
+
+
+static usb_sts_type class_init_handler(void *udev);
+static usb_sts_type class_clear_handler(void *udev);
+static usb_sts_type class_setup_handler(void *udev, usb_setup_type *setup);
+static usb_sts_type class_ept0_tx_handler(void *udev);
+static usb_sts_type class_ept0_rx_handler(void *udev);
+static usb_sts_type class_in_handler(void *udev, uint8_t ept_num);
+static usb_sts_type class_out_handler(void *udev, uint8_t ept_num);
+static usb_sts_type class_sof_handler(void *udev);
+static usb_sts_type class_event_handler(void *udev, usbd_event_type event);
+
+static void midi_tx_kick(usbd_core_type *pudev);
+
+#if defined ( __ICCARM__ ) /* iar compiler */
+  #pragma data_alignment=4
+#endif
+ALIGNED_HEAD midi_type midi_struct ALIGNED_TAIL;
+
+/* usb device class handler */
+usbd_class_handler midi_class_handler =
+{
+  class_init_handler,
+  class_clear_handler,
+  class_setup_handler,
+  class_ept0_tx_handler,
+  class_ept0_rx_handler,
+  class_in_handler,
+  class_out_handler,
+  class_sof_handler,
+  class_event_handler,
+  &midi_struct
+};
+
+/**
+  * @brief  initialize usb midi endpoint
+  * @param  udev: to the structure of usbd_core_type
+  * @retval status of usb_sts_type
+  */
+static usb_sts_type class_init_handler(void *udev)
+{
+  usb_sts_type status = USB_OK;
+  usbd_core_type *pudev = (usbd_core_type *)udev;
+  midi_type *pmidi = (midi_type *)pudev->class_handler->pdata;
+
+  /* the cycle counter time stamps events for the latency statistics */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  /* open in endpoint */
+  usbd_ept_open(pudev, USBD_MIDI_BULK_IN_EPT, EPT_BULK_TYPE, USBD_MIDI_IN_MAXPACKET_SIZE);
+
+  /* open out endpoint */
+  usbd_ept_open(pudev, USBD_MIDI_BULK_OUT_EPT, EPT_BULK_TYPE, USBD_MIDI_OUT_MAXPACKET_SIZE);
+
+  /* set out endpoint to receive status */
+  usbd_ept_recv(pudev, USBD_MIDI_BULK_OUT_EPT, (uint8_t *)pmidi->rx_buf, USBD_MIDI_OUT_MAXPACKET_SIZE);
+
+  pmidi->tx_busy = 0;
+
+  return status;
+}
+
+/**
+  * @brief  clear endpoint or other state
+  * @param  udev: to the structure of usbd_core_type
+  * @retval status of usb_sts_type
+  */
+static usb_sts_type class_clear_handler(void *udev)
+{
+  usb_sts_type status = USB_OK;
+  usbd_core_type *pudev = (usbd_core_type *)udev;
+
+  /* close in endpoint */
+  usbd_ept_close(pudev, USBD_MIDI_BULK_IN_EPT);
+
+  /* close out endpoint */
+  usbd_ept_close(pudev, USBD_MIDI_BULK_OUT_EPT);
+
+  return status;
+}
+
+/**
+  * @brief  usb device class setup request handler
+  * @param  udev: to the structure of usbd_core_type
+  * @param  setup: setup packet
+  * @retval status of usb_sts_type
+  */
+static usb_sts_type class_setup_handler(void *udev, usb_setup_type *setup)
+{
+  usb_sts_type status = USB_OK;
+  usbd_core_type *pudev = (usbd_core_type *)udev;
+  midi_type *pmidi = (midi_type *)pudev->class_handler->pdata;
+
+  switch(setup->bmRequestType & USB_REQ_TYPE_RESERVED)
+  {
+    /* class request */
+    case USB_REQ_TYPE_CLASS:
+      usbd_ctrl_unsupport(pudev);
+      break;
+    /* standard request */
+    case USB_REQ_TYPE_STANDARD:
+      switch(setup->bRequest)
+      {
+        case USB_STD_REQ_GET_DESCRIPTOR:
+          usbd_ctrl_unsupport(pudev);
+          break;
+        case USB_STD_REQ_GET_INTERFACE:
+          usbd_ctrl_send(pudev, (uint8_t *)&pmidi->alt_setting, 1);
+          break;
+        case USB_STD_REQ_SET_INTERFACE:
+          pmidi->alt_setting = setup->wValue;
+          break;
+        case USB_STD_REQ_CLEAR_FEATURE:
+          break;
+        case USB_STD_REQ_SET_FEATURE:
+          break;
+        default:
+          usbd_ctrl_unsupport(pudev);
+          break;
+      }
+      break;
+    default:
+      usbd_ctrl_unsupport(pudev);
+      break;
+  }
+  return status;
+}
+
+/**
+  * @brief  usb device endpoint 0 in status stage complete
+  * @param  udev: to the structure of usbd_core_type
+  * @retval status of usb_sts_type
+  */
+static usb_sts_type class_ept0_tx_handler(void *udev)
+{
+  usb_sts_type status = USB_OK;
+
+  /* ...user code... */
+
+  return status;
+}
+
+/**
+  * @brief  usb device endpoint 0 out status stage complete
+  * @param  udev: usb device core handler type
+  * @retval status of usb_sts_type
+  */
+static usb_sts_type class_ept0_rx_handler(void *udev)
+{
+  usb_sts_type status = USB_OK;
+
+  /* ...user code... */
+
+  return status;
+}
+
+/**
+  * @brief  usb device transmision complete handler
+  * @param  udev: to the structure of usbd_core_type
+  * @param  ept_num: endpoint number
+  * @retval status of usb_sts_type
+  */
+static usb_sts_type class_in_handler(void *udev, uint8_t ept_num)
+{
+  usbd_core_type *pudev = (usbd_core_type *)udev;
+  midi_type *pmidi = (midi_type *)pudev->class_handler->pdata;
+  usb_sts_type status = USB_OK;
+  uint32_t latency;
+
+  /* the host has the batch: time from the oldest event in it being queued */
+  latency = (DWT->CYCCNT - pmidi->tx_batch_stamp) / (system_core_clock / 1000000);
+  pmidi->latency_last_us = latency;
+  if(latency > pmidi->latency_max_us)
+  {
+    pmidi->latency_max_us = latency;
+  }
+  if(latency > USBD_MIDI_FRAME_US)
+  {
+    pmidi->latency_over_frame ++;
+  }
+
+  /* chain the next batch without waiting for the next frame */
+  pmidi->tx_busy = 0;
+  midi_tx_kick(pudev);
+
+  return status;
+}
+
+/**
+  * @brief  usb device endpoint receive data
+  * @param  udev: to the structure of usbd_core_type
+  * @param  ept_num: endpoint number
+  * @retval status of usb_sts_type
+  */
+static usb_sts_type class_out_handler(void *udev, uint8_t ept_num)
+{
+  usb_sts_type status = USB_OK;
+  usbd_core_type *pudev = (usbd_core_type *)udev;
+  midi_type *pmidi = (midi_type *)pudev->class_handler->pdata;
+  uint32_t recv_num = usbd_get_recv_len(pudev, ept_num) / sizeof(uint32_t);
+  uint32_t i_index, head = pmidi->rx_head;
+
+  for(i_index = 0; i_index < recv_num; i_index ++)
+  {
+    /* skip padding packets */
+    if(pmidi->rx_buf[i_index] == 0)
+    {
+      continue;
+    }
+    if(head - pmidi->rx_tail >= USBD_MIDI_RX_FIFO_SIZE)
+    {
+      pmidi->rx_overflow ++;
+      break;
+    }
+    pmidi->rx_fifo[head & (USBD_MIDI_RX_FIFO_SIZE - 1)] = pmidi->rx_buf[i_index];
+    head ++;
+  }
+  pmidi->rx_head = head;
+
+  /* start receive next packet */
+  usbd_ept_recv(pudev, USBD_MIDI_BULK_OUT_EPT, (uint8_t *)pmidi->rx_buf, USBD_MIDI_OUT_MAXPACKET_SIZE);
+
+  return status;
+}
+
+/**
+  * @brief  usb device sof handler
+  * @param  udev: to the structure of usbd_core_type
+  * @retval status of usb_sts_type
+  */
+static usb_sts_type class_sof_handler(void *udev)
+{
+  usb_sts_type status = USB_OK;
+
+  /* flush the events queued since the last frame */
+  midi_tx_kick((usbd_core_type *)udev);
+
+  return status;
+}
+
+/**
+  * @brief  usb device event handler
+  * @param  udev: to the structure of usbd_core_type
+  * @param  event: usb device event
+  * @retval status of usb_sts_type
+  */
+static usb_sts_type class_event_handler(void *udev, usbd_event_type event)
+{
+  usb_sts_type status = USB_OK;
+  usbd_core_type *pudev = (usbd_core_type *)udev;
+  midi_type *pmidi = (midi_type *)pudev->class_handler->pdata;
+
+  switch(event)
+  {
+    case USBD_RESET_EVENT:
+      pmidi->tx_busy = 0;
+      break;
+    case USBD_SUSPEND_EVENT:
+
+      /* ...user code... */
+
+      break;
+    case USBD_WAKEUP_EVENT:
+      /* ...user code... */
+
+      break;
+    default:
+      break;
+  }
+  return status;
+}
+
+/**
+  * @brief  send the queued events, as many as fit in one bulk packet.
+  *         only called from the usb interrupt.
+  * @param  pudev: to the structure of usbd_core_type
+  * @retval none
+  */
+static void midi_tx_kick(usbd_core_type *pudev)
+{
+  midi_type *pmidi = (midi_type *)pudev->class_handler->pdata;
+  uint32_t tail = pmidi->tx_tail;
+  uint32_t count = pmidi->tx_head - tail;
+  uint32_t i_index;
+
+  if(pmidi->tx_busy || count == 0 ||
+     usbd_connect_state_get(pudev) != USB_CONN_STATE_CONFIGURED)
+  {
+    return;
+  }
+
+  if(count > USBD_MIDI_IN_MAXPACKET_SIZE / sizeof(uint32_t))
+  {
+    count = USBD_MIDI_IN_MAXPACKET_SIZE / sizeof(uint32_t);
+  }
+
+  pmidi->tx_batch_stamp = pmidi->tx_stamp[tail & (USBD_MIDI_TX_FIFO_SIZE - 1)];
+  for(i_index = 0; i_index < count; i_index ++)
+  {
+    pmidi->tx_buf[i_index] = pmidi->tx_fifo[tail & (USBD_MIDI_TX_FIFO_SIZE - 1)];
+    tail ++;
+  }
+  pmidi->tx_tail = tail;
+
+  pmidi->tx_busy = 1;
+  usbd_ept_send(pudev, USBD_MIDI_BULK_IN_EPT, (uint8_t *)pmidi->tx_buf, count * sizeof(uint32_t));
+}
+
+/**
+  * @brief  queue one usb-midi event packet. can be called from any interrupt,
+  *         the packet is sent at the next usb frame.
+  * @param  udev: to the structure of usbd_core_type
+  * @param  packet: 4-byte usb-midi event packet, see MIDI_PACKET()
+  * @retval status of usb_sts_type
+  */
+usb_sts_type usbd_midi_packet_put(void *udev, uint32_t packet)
+{
+  usbd_core_type *pudev = (usbd_core_type *)udev;
+  midi_type *pmidi = (midi_type *)pudev->class_handler->pdata;
+  usb_sts_type status = USB_OK;
+  uint32_t primask, head;
+
+  /* producers may preempt each other, the usb interrupt only moves the tail */
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  head = pmidi->tx_head;
+  if(head - pmidi->tx_tail >= USBD_MIDI_TX_FIFO_SIZE)
+  {
+    pmidi->tx_overflow ++;
+    status = USB_FAIL;
+  }
+  else
+  {
+    pmidi->tx_fifo[head & (USBD_MIDI_TX_FIFO_SIZE - 1)] = packet;
+    pmidi->tx_stamp[head & (USBD_MIDI_TX_FIFO_SIZE - 1)] = DWT->CYCCNT;
+    pmidi->tx_head = head + 1;
+  }
+
+  __set_PRIMASK(primask);
+
+  return status;
+}
+
+/**
+  * @brief  pack a midi message into a usb-midi event packet and queue it.
+  *         can be called from any interrupt.
+  * @param  udev: to the structure of usbd_core_type
+  * @param  cable: virtual cable number (0 - 15)
+  * @param  status: midi status byte
+  * @param  data1: first data byte, ignored for one byte messages
+  * @param  data2: second data byte, ignored for one and two byte messages
+  * @retval status of usb_sts_type, USB_FAIL for system exclusive (0xf0, 0xf7),
+  *         use usbd_midi_sysex_put, and for undefined status bytes
+  */
+usb_sts_type usbd_midi_event_put(void *udev, uint8_t cable, uint8_t status, uint8_t data1, uint8_t data2)
+{
+  uint8_t cin;
+
+  if(status < 0xF0)
+  {
+    /* channel voice message, the cin is the high nibble */
+    cin = status >> 4;
+    if(cin == MIDI_CIN_PROGRAM_CHANGE || cin == MIDI_CIN_CHANNEL_PRESSURE)
+    {
+      data2 = 0;
+    }
+  }
+  else
+  {
+    switch(status)
+    {
+      case 0xF1:
+      case 0xF3:
+        cin = MIDI_CIN_SYSCOM_2BYTE;
+        data2 = 0;
+        break;
+      case 0xF2:
+        cin = MIDI_CIN_SYSCOM_3BYTE;
+        break;
+      case 0xF6:
+        cin = MIDI_CIN_SYSEX_END_1BYTE;
+        data1 = 0;
+        data2 = 0;
+        break;
+      case 0xF8:
+      case 0xFA:
+      case 0xFB:
+      case 0xFC:
+      case 0xFE:
+      case 0xFF:
+        /* real time message */
+        cin = MIDI_CIN_SINGLE_BYTE;
+        data1 = 0;
+        data2 = 0;
+        break;
+      case 0xF0:
+      case 0xF7:
+        /* system exclusive goes through usbd_midi_sysex_put */
+      default:
+        /* undefined 0xf4, 0xf5, 0xf9 and 0xfd */
+        return USB_FAIL;
+    }
+  }
+  return usbd_midi_packet_put(udev, MIDI_PACKET(cable, cin, status, data1, data2));
+}
+
+/**
+  * @brief  split a system exclusive message (including F0 and F7) into
+  *         usb-midi event packets and queue them.
+  * @param  udev: to the structure of usbd_core_type
+  * @param  cable: virtual cable number (0 - 15)
+  * @param  data: sysex message
+  * @param  len: sysex message length
+  * @retval status of usb_sts_type
+  */
+usb_sts_type usbd_midi_sysex_put(void *udev, uint8_t cable, uint8_t *data, uint16_t len)
+{
+  usb_sts_type status = USB_OK;
+
+  while(len > 3 && status == USB_OK)
+  {
+    status = usbd_midi_packet_put(udev, MIDI_PACKET(cable, MIDI_CIN_SYSEX_START, data[0], data[1], data[2]));
+    data += 3;
+    len -= 3;
+  }
+
+  if(status == USB_OK)
+  {
+    switch(len)
+    {
+      case 1:
+        status = usbd_midi_packet_put(udev, MIDI_PACKET(cable, MIDI_CIN_SYSEX_END_1BYTE, data[0], 0, 0));
+        break;
+      case 2:
+        status = usbd_midi_packet_put(udev, MIDI_PACKET(cable, MIDI_CIN_SYSEX_END_2BYTE, data[0], data[1], 0));
+        break;
+      case 3:
+        status = usbd_midi_packet_put(udev, MIDI_PACKET(cable, MIDI_CIN_SYSEX_END_3BYTE, data[0], data[1], data[2]));
+        break;
+      default:
+        break;
+    }
+  }
+  return status;
+}
+
+/**
+  * @brief  get the usb-midi event packets received from the host
+  * @param  udev: to the structure of usbd_core_type
+  * @param  packet: buffer for the received packets
+  * @param  max_num: maximum number of packets to get
+  * @retval number of packets
+  */
+uint16_t usbd_midi_packet_get(void *udev, uint32_t *packet, uint16_t max_num)
+{
+  usbd_core_type *pudev = (usbd_core_type *)udev;
+  midi_type *pmidi = (midi_type *)pudev->class_handler->pdata;
+  uint32_t tail = pmidi->rx_tail;
+  uint16_t num = 0;
+
+  while(num < max_num && tail != pmidi->rx_head)
+  {
+    packet[num ++] = pmidi->rx_fifo[tail & (USBD_MIDI_RX_FIFO_SIZE - 1)];
+    tail ++;
+  }
+  pmidi->rx_tail = tail;
+
+  return num;
+}
+
+/**
+  * @brief  reset the overflow and latency statistics
+  * @param  udev: to the structure of usbd_core_type
+  * @retval none
+  */
+void usbd_midi_statistics_reset(void *udev)
+{
+  usbd_core_type *pudev = (usbd_core_type *)udev;
+  midi_type *pmidi = (midi_type *)pudev->class_handler->pdata;
+
+  pmidi->tx_overflow = 0;
+  pmidi->rx_overflow = 0;
+  pmidi->latency_last_us = 0;
+  pmidi->latency_max_us = 0;
+  pmidi->latency_over_frame = 0;
+}
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
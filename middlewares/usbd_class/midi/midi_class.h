@@ -0,0 +1,145 @@
+/**
+  **************************************************************************
+  * @file     midi_class.h
+  * @brief    usb midi class header file
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+ /* define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MIDI_CLASS_H
+#define __MIDI_CLASS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "usb_std.h"
+#include "usbd_core.h"
+
+
+/** @addtogroup AT32F403A_407_middlewares_usbd_class
+  * @{
+  */
+
+/** @addtogroup USB_midi_class
+  * @{
+  */
+
+/** @defgroup USB_midi_class_definition
+  * @{
+  */
+
+#define USBD_MIDI_BULK_IN_EPT            0x81
+#define USBD_MIDI_BULK_OUT_EPT           0x01
+
+#define USBD_MIDI_IN_MAXPACKET_SIZE      0x40
+#define USBD_MIDI_OUT_MAXPACKET_SIZE     0x40
+
+/**
+  * @brief event fifo size in 4-byte usb-midi packets, must be a power of 2
+  */
+#ifndef USBD_MIDI_TX_FIFO_SIZE
+#define USBD_MIDI_TX_FIFO_SIZE           256
+#endif
+#ifndef USBD_MIDI_RX_FIFO_SIZE
+#define USBD_MIDI_RX_FIFO_SIZE           64
+#endif
+
+/**
+  * @brief one usb frame in microsecond, used by the latency statistics
+  */
+#define USBD_MIDI_FRAME_US               1000
+
+/**
+  * @brief usb-midi code index number
+  */
+#define MIDI_CIN_MISC                    0x00
+#define MIDI_CIN_CABLE_EVENT             0x01
+#define MIDI_CIN_SYSCOM_2BYTE            0x02
+#define MIDI_CIN_SYSCOM_3BYTE            0x03
+#define MIDI_CIN_SYSEX_START             0x04
+#define MIDI_CIN_SYSEX_END_1BYTE         0x05
+#define MIDI_CIN_SYSEX_END_2BYTE         0x06
+#define MIDI_CIN_SYSEX_END_3BYTE         0x07
+#define MIDI_CIN_NOTE_OFF                0x08
+#define MIDI_CIN_NOTE_ON                 0x09
+#define MIDI_CIN_POLY_KEYPRESS           0x0A
+#define MIDI_CIN_CONTROL_CHANGE          0x0B
+#define MIDI_CIN_PROGRAM_CHANGE          0x0C
+#define MIDI_CIN_CHANNEL_PRESSURE        0x0D
+#define MIDI_CIN_PITCH_BEND              0x0E
+#define MIDI_CIN_SINGLE_BYTE             0x0F
+
+/**
+  * @brief build a 4-byte usb-midi event packet
+  */
+#define MIDI_PACKET(cable, cin, b0, b1, b2) \
+                                         ((uint32_t)((((cable) & 0x0F) << 4) | ((cin) & 0x0F)) | \
+                                         ((uint32_t)(b0) << 8) | ((uint32_t)(b1) << 16) | ((uint32_t)(b2) << 24))
+
+typedef struct
+{
+  uint32_t tx_fifo[USBD_MIDI_TX_FIFO_SIZE];
+  uint32_t tx_stamp[USBD_MIDI_TX_FIFO_SIZE];
+  __IO uint32_t tx_head;
+  __IO uint32_t tx_tail;
+  uint32_t tx_buf[USBD_MIDI_IN_MAXPACKET_SIZE / sizeof(uint32_t)];
+  uint32_t tx_batch_stamp;
+  __IO uint8_t tx_busy;
+
+  uint32_t rx_fifo[USBD_MIDI_RX_FIFO_SIZE];
+  __IO uint32_t rx_head;
+  __IO uint32_t rx_tail;
+  uint32_t rx_buf[USBD_MIDI_OUT_MAXPACKET_SIZE / sizeof(uint32_t)];
+
+  /* statistics */
+  uint32_t tx_overflow;
+  uint32_t rx_overflow;
+  uint32_t latency_last_us;
+  uint32_t latency_max_us;
+  uint32_t latency_over_frame;
+
+  uint32_t alt_setting;
+}midi_type;
+
+extern usbd_class_handler midi_class_handler;
+usb_sts_type usbd_midi_packet_put(void *udev, uint32_t packet);
+usb_sts_type usbd_midi_event_put(void *udev, uint8_t cable, uint8_t status, uint8_t data1, uint8_t data2);
+usb_sts_type usbd_midi_sysex_put(void *udev, uint8_t cable, uint8_t *data, uint16_t len);
+uint16_t usbd_midi_packet_get(void *udev, uint32_t *packet, uint16_t max_num);
+void usbd_midi_statistics_reset(void *udev);
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,107 @@
+/**
+  **************************************************************************
+  * @file     midi_desc.h
+  * @brief    usb midi descriptor header file
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+/* define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MIDI_DESC_H
+#define __MIDI_DESC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "midi_class.h"
+#include "usbd_core.h"
+
+/** @addtogroup AT32F403A_407_middlewares_usbd_class
+  * @{
+  */
+
+/** @addtogroup USB_midi_desc
+  * @{
+  */
+
+/** @defgroup USB_midi_desc_definition
+  * @{
+  */
+
+#define USBD_MIDI_VENDOR_ID              0x2E3C
+#define USBD_MIDI_PRODUCT_ID             0x5740
+
+#define USBD_MIDI_CONFIG_DESC_SIZE       101
+#define USBD_MIDI_MS_TOTAL_LEN           65
+#define USBD_MIDI_SIZ_STRING_LANGID      4
+#define USBD_MIDI_SIZ_STRING_SERIAL      0x1A
+
+#define USBD_MIDI_DESC_MANUFACTURER_STRING    "Artery"
+#define USBD_MIDI_DESC_PRODUCT_STRING         "AT32 MIDI"
+#define USBD_MIDI_DESC_CONFIGURATION_STRING   "MIDI Config"
+#define USBD_MIDI_DESC_INTERFACE_STRING       "MIDI Interface"
+
+/**
+  * @brief audio and midi streaming class descriptor define
+  */
+#define AUDIO_SUBCLASS_AUDIOCONTROL      0x01
+#define AUDIO_SUBCLASS_MIDISTREAMING     0x03
+#define AUDIO_CS_INTERFACE               0x24
+#define AUDIO_CS_ENDPOINT                0x25
+#define AUDIO_AC_HEADER                  0x01
+#define MIDI_MS_HEADER                   0x01
+#define MIDI_MS_IN_JACK                  0x02
+#define MIDI_MS_OUT_JACK                 0x03
+#define MIDI_MS_GENERAL                  0x01
+#define MIDI_JACK_EMBEDDED               0x01
+#define MIDI_JACK_EXTERNAL               0x02
+
+/**
+  * @brief midi jack id
+  */
+#define MIDI_JACK_IN_EMB_ID              0x01
+#define MIDI_JACK_IN_EXT_ID              0x02
+#define MIDI_JACK_OUT_EMB_ID             0x03
+#define MIDI_JACK_OUT_EXT_ID             0x04
+
+
+#define         MCU_ID1                   (0x1FFFF7E8)
+#define         MCU_ID2                   (0x1FFFF7EC)
+#define         MCU_ID3                   (0x1FFFF7F0)
+
+
+extern usbd_desc_handler midi_desc_handler;
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+#ifdef __cplusplus
+}
+#endif
+
+#endif
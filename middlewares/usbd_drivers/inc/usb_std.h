@@ -172,6 +172,7 @@ typedef enum
 #define USB_CLASS_CODE_CDCDATA           0x0A /*!< usb class code cdc data */
 #define USB_CLASS_CODE_CCID              0x0B /*!< usb class code ccid */
 #define USB_CLASS_CODE_VIDEO             0x0E /*!< usb class code video */
+#define USB_CLASS_CODE_APP_SPECIFIC      0xFE /*!< usb class code application specific */
 #define USB_CLASS_CODE_VENDOR            0xFF /*!< usb class code vendor */
 
 /**
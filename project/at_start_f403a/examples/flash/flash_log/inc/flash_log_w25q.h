@@ -0,0 +1,68 @@
+/**
+  **************************************************************************
+  * @file     flash_log_w25q.h
+  * @brief    w25q backend of the flash log
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+/* define to prevent recursive inclusion -------------------------------------*/
+#ifndef __FLASH_LOG_W25Q_H
+#define __FLASH_LOG_W25Q_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "flash_log.h"
+
+/** @addtogroup AT32F403A_periph_examples
+  * @{
+  */
+
+/** @addtogroup 403A_FLASH_flash_log
+  * @{
+  */
+
+/** @defgroup FLASH_log_w25q_layout
+  * @{
+  */
+
+#define FLASH_LOG_W25Q_ADDR              0x000000
+#define FLASH_LOG_W25Q_SECTOR_NUM        16         /*!< 4kb sectors */
+
+/**
+  * @}
+  */
+
+extern const flash_log_backend_type flash_log_w25q;
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,161 @@
+/**
+  **************************************************************************
+  * @file     main.c
+  * @brief    main program
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+#include "at32f403a_407_board.h"
+#include "at32f403a_407_clock.h"
+#include "flash_log_port.h"
+#ifdef FLASH_LOG_USE_W25Q
+#include "spi_flash.h"
+#include "flash_log_w25q.h"
+#endif
+
+/** @addtogroup AT32F403A_periph_examples
+  * @{
+  */
+
+/** @addtogroup 403A_FLASH_flash_log FLASH_flash_log
+  * @{
+  */
+
+#define LOG_EVENT_BOOT                   1
+#define LOG_EVENT_TICK                   2
+#define LOG_EVENT_BUTTON                 3
+
+#define LOG_TICK_MS                      1000
+
+typedef struct
+{
+  uint32_t                               boot;
+  uint32_t                               time_ms;
+  uint16_t                               event;
+  uint16_t                               reserved;
+} log_record_type;
+
+flash_log_type flash_log;
+flash_log_cursor_type cursor;
+log_record_type record;
+uint32_t boot_count = 0;
+uint32_t time_ms = 0;
+
+/**
+  * @brief  stage a record of the current boot.
+  * @param  event: LOG_EVENT_xxx
+  * @retval status of flash_log_write
+  */
+static flash_log_status_type log_event(uint16_t event)
+{
+  record.boot = boot_count;
+  record.time_ms = time_ms;
+  record.event = event;
+  record.reserved = 0;
+  return flash_log_write(&flash_log, &record, sizeof(record));
+}
+
+/**
+  * @brief  main function.
+  * @param  none
+  * @retval none
+  */
+int main(void)
+{
+  const flash_log_backend_type *backend = &flash_log_internal;
+  flash_log_status_type status;
+  uint32_t length, count = 0, tick = 0;
+
+  system_clock_config();
+  at32_board_init();
+  uart_print_init(115200);
+
+#ifdef FLASH_LOG_USE_W25Q
+  spiflash_init();
+  backend = &flash_log_w25q;
+#endif
+
+  if(flash_log_init(&flash_log, backend) != FLASH_LOG_OK)
+  {
+    at32_led_on(LED4);
+    while(1);
+  }
+
+  /* read out the log, the last boot record gives the boot count */
+  flash_log_read_start(&flash_log, &cursor);
+  while((status = flash_log_read(&flash_log, &cursor, &record, sizeof(record), &length)) == FLASH_LOG_OK)
+  {
+    if(length == sizeof(record) && record.event == LOG_EVENT_BOOT)
+    {
+      boot_count = record.boot;
+    }
+    count ++;
+  }
+  printf("flash log: %u records, %u pages lost, last boot %u\r\n",
+         (unsigned)count, (unsigned)cursor.lost, (unsigned)boot_count);
+
+  /* the boot record is flushed at once, the ticks are programmed a page at a time */
+  boot_count ++;
+  status = log_event(LOG_EVENT_BOOT);
+  if(status == FLASH_LOG_OK)
+  {
+    status = flash_log_flush(&flash_log);
+  }
+  at32_led_on((status == FLASH_LOG_OK) ? LED2 : LED4);
+
+  while(1)
+  {
+    if(at32_button_press() == USER_BUTTON)
+    {
+      log_event(LOG_EVENT_BUTTON);
+      status = flash_log_flush(&flash_log);
+      printf("boot %u: %u records, %u pages, %u erases, %u erases stalled a flush, flush %s\r\n",
+             (unsigned)boot_count, (unsigned)flash_log.records, (unsigned)flash_log.pages,
+             (unsigned)flash_log.erases, (unsigned)flash_log.stall_erases,
+             (status == FLASH_LOG_OK) ? "ok" : "failed");
+    }
+
+    /* the sector after the head is erased here, not in the flush that needs it */
+    if(flash_log_idle(&flash_log) != FLASH_LOG_OK)
+    {
+      at32_led_on(LED4);
+    }
+
+    delay_ms(10);
+    time_ms += 10;
+    if(++ tick >= LOG_TICK_MS / 10)
+    {
+      tick = 0;
+      at32_led_toggle(LED3);
+      if(log_event(LOG_EVENT_TICK) != FLASH_LOG_OK)
+      {
+        at32_led_on(LED4);
+      }
+    }
+  }
+}
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
@@ -45,6 +45,8 @@ extern "C" {
   * @{
   */
 
+extern flash_write_stats_type flash_write_stats;
+
 void flash_read(uint32_t read_addr, uint16_t *p_buffer, uint16_t num_read);
 error_status flash_write_nocheck(uint32_t write_addr, uint16_t *p_buffer, uint16_t num_write);
 error_status flash_write(uint32_t write_addr,uint16_t *p_Buffer, uint16_t num_write);
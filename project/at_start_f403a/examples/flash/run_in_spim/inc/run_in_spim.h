@@ -30,6 +30,8 @@
 extern "C" {
 #endif
 
+#include "at32f403a_407.h"
+
 /** @addtogroup AT32F403A_periph_examples
   * @{
   */
@@ -38,8 +40,47 @@ extern "C" {
   * @{
   */
 
+/** @defgroup FLASH_run_in_spim_code_placement
+  * @brief    a RAM_CODE function is placed in the RAMCODE section, the scatter
+  *           file puts it in sram and __scatterload copies it there before main.
+  *           with gcc the .data.ramfunc section is copied with the .data.
+  *           interrupt handlers and dsp kernels of an application that spills
+  *           into the spim are kept in the internal flash or sram this way.
+  * @{
+  */
+
+#if defined (__ICCARM__)
+  #define RAM_CODE                       __ramfunc
+#elif defined (__GNUC__) && !defined (__ARMCC_VERSION)
+  #define RAM_CODE                       __attribute__((section(".data.ramfunc"), noinline, long_call))
+#else
+  #define RAM_CODE                       __attribute__((section("RAMCODE"), noinline))
+#endif
+
+/* the benchmark loop, built once per memory it runs from */
+#define CHECKSUM_LOOP(pdata, count, sum)                                    \
+  while(count --)                                                           \
+  {                                                                         \
+    sum = ((sum << 5) | (sum >> 27)) ^ (*pdata ++ * 0x9E3779B1u);           \
+  }
+
+#define CHECKSUM_WORDS                   1024
+#define CHECKSUM_ROUNDS                  64
+
+/**
+  * @}
+  */
+
+/** @defgroup FLASH_run_in_spim_functions
+  * @{
+  */
 
 void spim_run(void);
+uint32_t spim_checksum(const uint32_t *pdata, uint32_t count);
+
+/**
+  * @}
+  */
 
 /**
   * @}
@@ -0,0 +1,107 @@
+/**
+  **************************************************************************
+  * @file     spim_profile.h
+  * @brief    spim_profile.header file
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SPIM_PROFILE_H
+#define __SPIM_PROFILE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "at32f403a_407.h"
+
+/** @addtogroup AT32F403A_periph_examples
+  * @{
+  */
+
+/** @addtogroup 403A_FLASH_run_in_spim
+  * @{
+  */
+
+/** @defgroup FLASH_run_in_spim_profile_definition
+  * @brief    tmr7 interrupts PROFILE_RATE_HZ times a second and counts the
+  *           interrupted pc in bins of 1 << PROFILE_BIN_SHIFT bytes over the
+  *           spim code. the report lists the hottest bins, look them up in the
+  *           map file and move those functions to sram, see run_in_spim.sct.
+  *           this file must not be placed in the spim.
+  * @{
+  */
+
+#define PROFILE_RATE_HZ                  10000
+#define PROFILE_BASE                     0x08400000
+#define PROFILE_BIN_SHIFT                6          /*!< 64 byte bins */
+#define PROFILE_BIN_NUM                  1024       /*!< 64kb of spim code */
+
+/**
+  * @}
+  */
+
+/** @defgroup FLASH_run_in_spim_profile_types
+  * @{
+  */
+
+typedef struct
+{
+  uint32_t                               total;
+  uint32_t                               spim;        /*!< in the profiled range */
+  uint32_t                               spim_other;  /*!< spim past the range */
+  uint32_t                               flash;
+  uint32_t                               sram;
+  uint16_t                               bin[PROFILE_BIN_NUM];
+} spim_profile_type;
+
+/**
+  * @}
+  */
+
+/** @defgroup FLASH_run_in_spim_profile_functions
+  * @{
+  */
+
+extern spim_profile_type spim_profile;
+
+void spim_profile_start(void);
+void spim_profile_stop(void);
+void spim_profile_report(uint32_t count);
+void spim_profile_sample(uint32_t pc);
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SPIM_PROFILE_H */
@@ -0,0 +1,100 @@
+/**
+  **************************************************************************
+  * @file     spim_program.h
+  * @brief    spim_program.header file
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SPIM_PROGRAM_H
+#define __SPIM_PROGRAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "at32f403a_407.h"
+
+/** @addtogroup AT32F403A_periph_examples
+  * @{
+  */
+
+/** @addtogroup 403A_FLASH_run_in_spim
+  * @{
+  */
+
+/** @defgroup FLASH_run_in_spim_program_definition
+  * @brief    spim_program erases the sectors of a range that are not blank and
+  *           programs it with flash_spim_mass_program, the time of both steps is
+  *           taken with the dwt cycle counter. the range must not hold running
+  *           code and this file must not be placed in the spim.
+  * @{
+  */
+
+#define SPIM_SECTOR_SIZE                 4096
+
+/**
+  * @}
+  */
+
+/** @defgroup FLASH_run_in_spim_program_types
+  * @{
+  */
+
+typedef struct
+{
+  uint32_t                               bytes;
+  uint32_t                               sectors_erased;
+  uint32_t                               sectors_skipped;  /*!< already blank */
+  uint32_t                               erase_cycles;
+  uint32_t                               program_cycles;
+  uint32_t                               program_speed;    /*!< bytes per second */
+} spim_program_stats_type;
+
+/**
+  * @}
+  */
+
+/** @defgroup FLASH_run_in_spim_program_functions
+  * @{
+  */
+
+flash_status_type spim_program(uint32_t address, const uint8_t *buf, uint32_t length,
+                               spim_program_stats_type *stats);
+void spim_program_report(spim_program_stats_type *stats);
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SPIM_PROGRAM_H */
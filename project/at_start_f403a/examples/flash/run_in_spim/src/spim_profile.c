@@ -0,0 +1,192 @@
+/**
+  **************************************************************************
+  * @file     spim_profile.c
+  * @brief    pc sampling profiler for code running in spim
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+
+#include "spim_profile.h"
+#include <stdio.h>
+#include <string.h>
+
+/** @addtogroup AT32F403A_periph_examples
+  * @{
+  */
+
+/** @addtogroup 403A_FLASH_run_in_spim
+  * @{
+  */
+
+spim_profile_type spim_profile;
+
+/**
+  * @brief  take the interrupted pc from the exception frame and pass it to
+  *         spim_profile_sample, the frame is on the stack the lr bit 2 selects.
+  * @param  none
+  * @retval none
+  */
+#if defined (__CC_ARM)
+__asm void TMR7_GLOBAL_IRQHandler(void)
+{
+  IMPORT spim_profile_sample
+  TST   LR, #4
+  ITE   EQ
+  MRSEQ R0, MSP
+  MRSNE R0, PSP
+  LDR   R0, [R0, #24]
+  B     spim_profile_sample
+}
+#elif defined (__GNUC__)
+__attribute__((naked)) void TMR7_GLOBAL_IRQHandler(void)
+{
+  __asm volatile(
+    "tst   lr, #4                \n"
+    "ite   eq                    \n"
+    "mrseq r0, msp               \n"
+    "mrsne r0, psp               \n"
+    "ldr   r0, [r0, #24]         \n"
+    "b     spim_profile_sample   \n");
+}
+#endif
+
+/**
+  * @brief  count one pc sample.
+  * @param  pc: interrupted pc
+  * @retval none
+  */
+void spim_profile_sample(uint32_t pc)
+{
+  uint32_t offset = pc - PROFILE_BASE;
+
+  tmr_flag_clear(TMR7, TMR_OVF_FLAG);
+
+  spim_profile.total ++;
+  if(offset < (PROFILE_BIN_NUM << PROFILE_BIN_SHIFT))
+  {
+    spim_profile.spim ++;
+    if(spim_profile.bin[offset >> PROFILE_BIN_SHIFT] != 0xFFFF)
+    {
+      spim_profile.bin[offset >> PROFILE_BIN_SHIFT] ++;
+    }
+  }
+  else if(pc >= FLASH_SPIM_START_ADDR)
+  {
+    spim_profile.spim_other ++;
+  }
+  else if(pc >= FLASH_BANK1_START_ADDR && pc < FLASH_BANK1_START_ADDR + 0x100000)
+  {
+    spim_profile.flash ++;
+  }
+  else
+  {
+    spim_profile.sram ++;
+  }
+}
+
+/**
+  * @brief  clear the counters and start sampling.
+  * @param  none
+  * @retval none
+  */
+void spim_profile_start(void)
+{
+  crm_clocks_freq_type crm_clocks_freq_struct = {0};
+
+  memset(&spim_profile, 0, sizeof(spim_profile));
+
+  crm_periph_clock_enable(CRM_TMR7_PERIPH_CLOCK, TRUE);
+  crm_clocks_freq_get(&crm_clocks_freq_struct);
+
+  /* apb1 runs at half the ahb, its timers at the ahb clock */
+  tmr_base_init(TMR7, (1000000 / PROFILE_RATE_HZ) - 1, (crm_clocks_freq_struct.ahb_freq / 1000000) - 1);
+  tmr_flag_clear(TMR7, TMR_OVF_FLAG);
+  tmr_interrupt_enable(TMR7, TMR_OVF_INT, TRUE);
+
+  /* highest priority, so the pc of other interrupt handlers is seen as well */
+  nvic_irq_enable(TMR7_GLOBAL_IRQn, 0, 0);
+  tmr_counter_enable(TMR7, TRUE);
+}
+
+/**
+  * @brief  stop sampling.
+  * @param  none
+  * @retval none
+  */
+void spim_profile_stop(void)
+{
+  tmr_counter_enable(TMR7, FALSE);
+  tmr_interrupt_enable(TMR7, TMR_OVF_INT, FALSE);
+  nvic_irq_disable(TMR7_GLOBAL_IRQn);
+}
+
+/**
+  * @brief  print where the time went and the hottest spim bins, hottest first.
+  * @param  count: number of bins to print
+  * @retval none
+  */
+void spim_profile_report(uint32_t count)
+{
+  uint32_t i, best, last = 0xFFFFFFFF, last_bin = 0, found;
+
+  if(spim_profile.total == 0)
+  {
+    return;
+  }
+  printf("samples %u: spim %u%%, internal flash %u%%, sram %u%%\r\n",
+         (unsigned)spim_profile.total,
+         (unsigned)((spim_profile.spim + spim_profile.spim_other) * 100 / spim_profile.total),
+         (unsigned)(spim_profile.flash * 100 / spim_profile.total),
+         (unsigned)(spim_profile.sram * 100 / spim_profile.total));
+
+  /* repeated selection keeps the bins in place, count is small */
+  while(count --)
+  {
+    best = 0;
+    found = 0;
+    for(i = 0; i < PROFILE_BIN_NUM; i ++)
+    {
+      if((spim_profile.bin[i] < last || (spim_profile.bin[i] == last && i > last_bin)) &&
+         spim_profile.bin[i] > best)
+      {
+        best = spim_profile.bin[i];
+        found = i;
+      }
+    }
+    if(best == 0)
+    {
+      break;
+    }
+    printf("  0x%08x-0x%08x %u%%\r\n",
+           (unsigned)(PROFILE_BASE + (found << PROFILE_BIN_SHIFT)),
+           (unsigned)(PROFILE_BASE + ((found + 1) << PROFILE_BIN_SHIFT) - 1),
+           (unsigned)(best * 100 / spim_profile.total));
+    last = best;
+    last_bin = found;
+  }
+}
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
@@ -0,0 +1,207 @@
+/**
+  **************************************************************************
+  * @file     at32f403a_407_int.c
+  * @brief    main interrupt service routines.
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+/* includes ------------------------------------------------------------------*/
+#include "at32f403a_407_int.h"
+#include "at32f403a_407_board.h"
+#include "sd_async.h"
+
+extern sd_async_type sd1;
+extern sd_async_type sd2;
+
+/** @addtogroup AT32F403A_periph_examples
+  * @{
+  */
+
+/** @addtogroup 403A_SDIO_sd_async
+  * @{
+  */
+
+/**
+  * @brief  this function handles nmi exception.
+  * @param  none
+  * @retval none
+  */
+void NMI_Handler(void)
+{
+}
+
+/**
+  * @brief  this function handles hard fault exception.
+  * @param  none
+  * @retval none
+  */
+void HardFault_Handler(void)
+{
+  /* go to infinite loop when hard fault exception occurs */
+  while(1)
+  {
+  }
+}
+
+/**
+  * @brief  this function handles memory manage exception.
+  * @param  none
+  * @retval none
+  */
+void MemManage_Handler(void)
+{
+  /* go to infinite loop when memory manage exception occurs */
+  while(1)
+  {
+  }
+}
+
+/**
+  * @brief  this function handles bus fault exception.
+  * @param  none
+  * @retval none
+  */
+void BusFault_Handler(void)
+{
+  /* go to infinite loop when bus fault exception occurs */
+  while(1)
+  {
+  }
+}
+
+/**
+  * @brief  this function handles usage fault exception.
+  * @param  none
+  * @retval none
+  */
+void UsageFault_Handler(void)
+{
+  /* go to infinite loop when usage fault exception occurs */
+  while(1)
+  {
+  }
+}
+
+/**
+  * @brief  this function handles svcall exception.
+  * @param  none
+  * @retval none
+  */
+void SVC_Handler(void)
+{
+}
+
+/**
+  * @brief  this function handles debug monitor exception.
+  * @param  none
+  * @retval none
+  */
+void DebugMon_Handler(void)
+{
+}
+
+/**
+  * @brief  this function handles pendsv_handler exception.
+  * @param  none
+  * @retval none
+  */
+void PendSV_Handler(void)
+{
+}
+
+/**
+  * @brief  this function handles systick handler.
+  * @param  none
+  * @retval none
+  */
+void SysTick_Handler(void)
+{
+}
+
+/**
+  * @brief  this function handles sdio1 handler.
+  * @param  none
+  * @retval none
+  */
+void SDIO1_IRQHandler(void)
+{
+  sd_async_irq_handler(&sd1);
+}
+
+/**
+  * @brief  this function handles sdio2 handler.
+  * @param  none
+  * @retval none
+  */
+void SDIO2_IRQHandler(void)
+{
+  sd_async_irq_handler(&sd2);
+}
+
+/**
+  * @brief  this function handles dma2 channel4 and channel5 handler.
+  * @param  none
+  * @retval none
+  */
+void DMA2_Channel4_5_IRQHandler(void)
+{
+  if(dma_interrupt_flag_get(DMA2_FDT4_FLAG) != RESET)
+  {
+    dma_flag_clear(DMA2_FDT4_FLAG);
+    sd_async_dma_irq_handler(&sd1);
+  }
+
+  if(dma_interrupt_flag_get(DMA2_FDT5_FLAG) != RESET)
+  {
+    dma_flag_clear(DMA2_FDT5_FLAG);
+    sd_async_dma_irq_handler(&sd2);
+  }
+}
+
+/**
+  * @brief  this function handles timer6 handler.
+  * @param  none
+  * @retval none
+  */
+void TMR6_GLOBAL_IRQHandler(void)
+{
+  sd_async_tmr_irq_handler(&sd1);
+}
+
+/**
+  * @brief  this function handles timer7 handler.
+  * @param  none
+  * @retval none
+  */
+void TMR7_GLOBAL_IRQHandler(void)
+{
+  sd_async_tmr_irq_handler(&sd2);
+}
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+
+
@@ -0,0 +1,300 @@
+/**
+  **************************************************************************
+  * @file     main.c
+  * @brief    main program
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+#include "at32f403a_407_board.h"
+#include "at32f403a_407_clock.h"
+#include "sd_async.h"
+
+/** @addtogroup AT32F403A_periph_examples
+  * @{
+  */
+
+/** @addtogroup 403A_SDIO_sd_async SDIO_sd_async
+  * @{
+  */
+
+#define TEST_START_BLOCK                 0x4000     /*!< overwritten by the test */
+#define TEST_BLOCKS                      32         /*!< per request */
+#define TEST_REQUESTS                    8          /*!< queued at once per slot */
+#define TEST_SIZE                        (TEST_BLOCKS * SD_ASYNC_BLOCK_SIZE)
+
+#define SDIO_IRQ_PRIORITY                1
+
+sd_async_type sd1 =
+{
+  .sdio_x      = SDIO1,
+  .dma_channel = DMA2_CHANNEL4,
+  .tmr_x       = TMR6,
+  .clock       = 24000000,
+};
+
+sd_async_type sd2 =
+{
+  .sdio_x      = SDIO2,
+  .dma_channel = DMA2_CHANNEL5,
+  .tmr_x       = TMR7,
+  .clock       = 24000000,
+};
+
+sd_request_type sd1_request[TEST_REQUESTS];
+sd_request_type sd2_request[TEST_REQUESTS];
+uint32_t tx_buffer[TEST_SIZE / 4];
+uint32_t sd1_rx_buffer[TEST_SIZE / 4];
+uint32_t sd2_rx_buffer[TEST_SIZE / 4];
+__IO uint32_t requests_done;
+
+void sd_async_lowlevel_init(sd_async_type *sd);
+void request_complete(sd_request_type *preq);
+uint32_t test_run(sd_async_type **slots, uint32_t slot_num, uint8_t write, uint32_t *idle_loops);
+uint8_t test_check(uint32_t *rx_buffer);
+
+/**
+  * @brief  sdio pins, clocks, dma mapping and interrupts of a slot, called by
+  *         sd_async_init. the sdio, dma and timer interrupts of a slot share
+  *         one priority.
+  * @param  sd: sd1 or sd2
+  * @retval none
+  */
+void sd_async_lowlevel_init(sd_async_type *sd)
+{
+  gpio_init_type gpio_init_struct;
+
+  crm_periph_clock_enable(CRM_DMA2_PERIPH_CLOCK, TRUE);
+  crm_periph_clock_enable(CRM_GPIOA_PERIPH_CLOCK, TRUE);
+  crm_periph_clock_enable(CRM_GPIOC_PERIPH_CLOCK, TRUE);
+  crm_periph_clock_enable(CRM_GPIOD_PERIPH_CLOCK, TRUE);
+
+  gpio_default_para_init(&gpio_init_struct);
+  gpio_init_struct.gpio_out_type       = GPIO_OUTPUT_PUSH_PULL;
+  gpio_init_struct.gpio_pull           = GPIO_PULL_NONE;
+  gpio_init_struct.gpio_mode           = GPIO_MODE_MUX;
+  gpio_init_struct.gpio_drive_strength = GPIO_DRIVE_STRENGTH_STRONGER;
+
+  /* both channels take their request from the flexible mapping */
+  if(sd->sdio_x == SDIO1)
+  {
+    crm_periph_clock_enable(CRM_SDIO1_PERIPH_CLOCK, TRUE);
+
+    /* d0 to d3 and ck on pc8 to pc12, cmd on pd2 */
+    gpio_init_struct.gpio_pins = GPIO_PINS_8 | GPIO_PINS_9 | GPIO_PINS_10 | GPIO_PINS_11 | GPIO_PINS_12;
+    gpio_init(GPIOC, &gpio_init_struct);
+    gpio_init_struct.gpio_pins = GPIO_PINS_2;
+    gpio_init(GPIOD, &gpio_init_struct);
+
+    dma_flexible_config(DMA2, FLEX_CHANNEL4, DMA_FLEXIBLE_SDIO1);
+    nvic_irq_enable(SDIO1_IRQn, SDIO_IRQ_PRIORITY, 0);
+
+    /* tmr6 paces the cmd13 polls */
+    crm_periph_clock_enable(CRM_TMR6_PERIPH_CLOCK, TRUE);
+    nvic_irq_enable(TMR6_GLOBAL_IRQn, SDIO_IRQ_PRIORITY, 0);
+  }
+  else
+  {
+    crm_periph_clock_enable(CRM_SDIO2_PERIPH_CLOCK, TRUE);
+    crm_periph_clock_enable(CRM_IOMUX_PERIPH_CLOCK, TRUE);
+    gpio_pin_remap_config(SDIO2_MUX01, TRUE);
+
+    /* ck on pc4, cmd on pc5, d0 to d3 on pa4 to pa7 */
+    gpio_init_struct.gpio_pins = GPIO_PINS_4 | GPIO_PINS_5;
+    gpio_init(GPIOC, &gpio_init_struct);
+    gpio_init_struct.gpio_pins = GPIO_PINS_4 | GPIO_PINS_5 | GPIO_PINS_6 | GPIO_PINS_7;
+    gpio_init(GPIOA, &gpio_init_struct);
+
+    dma_flexible_config(DMA2, FLEX_CHANNEL5, DMA_FLEXIBLE_SDIO2);
+    nvic_irq_enable(SDIO2_IRQn, SDIO_IRQ_PRIORITY, 0);
+
+    /* tmr7 paces the cmd13 polls */
+    crm_periph_clock_enable(CRM_TMR7_PERIPH_CLOCK, TRUE);
+    nvic_irq_enable(TMR7_GLOBAL_IRQn, SDIO_IRQ_PRIORITY, 0);
+  }
+
+  /* channel4 and channel5 share one interrupt */
+  nvic_irq_enable(DMA2_Channel4_5_IRQn, SDIO_IRQ_PRIORITY, 0);
+}
+
+/**
+  * @brief  request done, called from the sdio interrupt.
+  * @param  preq: finished request
+  * @retval none
+  */
+void request_complete(sd_request_type *preq)
+{
+  requests_done ++;
+}
+
+/**
+  * @brief  queue TEST_REQUESTS requests on every slot at once and count the
+  *         loops the cpu is free for until they are all done.
+  * @param  slots: slots to run
+  * @param  slot_num: number of slots
+  * @param  write: 1 to write tx_buffer, 0 to read into the rx buffer of the slot
+  * @param  idle_loops: loops of the cpu while waiting
+  * @retval cycles taken, 0 on error
+  */
+uint32_t test_run(sd_async_type **slots, uint32_t slot_num, uint8_t write, uint32_t *idle_loops)
+{
+  sd_request_type *preq;
+  uint32_t start, cycles, slot, index, loops = 0;
+
+  requests_done = 0;
+  start = DWT->CYCCNT;
+
+  for(slot = 0; slot < slot_num; slot ++)
+  {
+    for(index = 0; index < TEST_REQUESTS; index ++)
+    {
+      preq = (slots[slot] == &sd1) ? &sd1_request[index] : &sd2_request[index];
+      preq->buffer = write ? (uint8_t *)tx_buffer :
+                     (uint8_t *)((slots[slot] == &sd1) ? sd1_rx_buffer : sd2_rx_buffer);
+      preq->block = TEST_START_BLOCK + index * TEST_BLOCKS;
+      preq->count = TEST_BLOCKS;
+      preq->write = write;
+      preq->callback = request_complete;
+      preq->param = 0;
+      sd_async_submit(slots[slot], preq);
+    }
+  }
+
+  /* the whole run goes on in the sdio interrupts */
+  while(requests_done < slot_num * TEST_REQUESTS)
+  {
+    loops ++;
+  }
+  cycles = DWT->CYCCNT - start;
+  *idle_loops = loops;
+
+  for(slot = 0; slot < slot_num; slot ++)
+  {
+    for(index = 0; index < TEST_REQUESTS; index ++)
+    {
+      preq = (slots[slot] == &sd1) ? &sd1_request[index] : &sd2_request[index];
+      if(preq->status != SD_ASYNC_OK)
+      {
+        printf("slot %d request %d error %d\r\n", (slots[slot] == &sd1) ? 1 : 2, index, preq->status);
+        return 0;
+      }
+    }
+  }
+  return cycles;
+}
+
+/**
+  * @brief  compare the data read with tx_buffer.
+  * @param  rx_buffer: data read
+  * @retval 1 when equal
+  */
+uint8_t test_check(uint32_t *rx_buffer)
+{
+  uint32_t index;
+
+  for(index = 0; index < TEST_SIZE / 4; index ++)
+  {
+    if(rx_buffer[index] != tx_buffer[index])
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+  * @brief  main function.
+  * @param  none
+  * @retval none
+  */
+int main(void)
+{
+  sd_async_type *slots[2] = {&sd1, &sd2};
+  const char *name[2] = {"write", "read "};
+  uint32_t index, run, slot_num, cycles, loops, ahb_mhz;
+  sd_async_status_type status;
+
+  system_clock_config();
+  at32_board_init();
+  uart_print_init(115200);
+  ahb_mhz = system_core_clock / 1000000;
+
+  for(index = 0; index < TEST_SIZE / 4; index ++)
+  {
+    tx_buffer[index] = index * 0x01010101 + 0x5A;
+  }
+
+  status = sd_async_init(&sd1);
+  printf("sdio1 card: status %d, %d blocks\r\n", status, sd1.block_num);
+  if(status != SD_ASYNC_OK)
+  {
+    while(1)
+    {
+      at32_led_toggle(LED4);
+      delay_ms(200);
+    }
+  }
+
+  /* the second card is optional */
+  status = sd_async_init(&sd2);
+  printf("sdio2 card: status %d, %d blocks\r\n", status, sd2.block_num);
+  slot_num = (status == SD_ASYNC_OK) ? 2 : 1;
+
+  while(1)
+  {
+    /* sdio1 alone, then both slots in parallel */
+    for(run = 1; run <= slot_num; run ++)
+    {
+      for(index = 0; index < 2; index ++)
+      {
+        cycles = test_run(slots, run, (index == 0) ? 1 : 0, &loops);
+        if(cycles == 0)
+        {
+          at32_led_on(LED4);
+          break;
+        }
+        printf("%d slot %s: %d KB/s, cpu loops while waiting %d\r\n", run, name[index],
+               (run * TEST_REQUESTS * TEST_SIZE / 1024) * ahb_mhz * 1000 / (cycles / 1000), loops);
+      }
+      if(test_check(sd1_rx_buffer) == 0 || (run == 2 && test_check(sd2_rx_buffer) == 0))
+      {
+        printf("data mismatch\r\n");
+        at32_led_on(LED4);
+      }
+    }
+    printf("sdio1 requests %d, blocks %d, errors %d, busy polls %d\r\n",
+           sd1.requests, sd1.blocks, sd1.errors, sd1.busy_polls);
+    if(slot_num == 2)
+    {
+      printf("sdio2 requests %d, blocks %d, errors %d, busy polls %d\r\n",
+             sd2.requests, sd2.blocks, sd2.errors, sd2.busy_polls);
+    }
+    printf("\r\n");
+    at32_led_toggle(LED2);
+    delay_ms(1000);
+  }
+}
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
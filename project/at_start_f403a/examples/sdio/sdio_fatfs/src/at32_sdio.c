@@ -44,6 +44,9 @@ static sd_data_transfer_mode_type device_mode = SD_TRANSFER_POLLING_MODE; /* wor
 static uint8_t stop_flag = 0; /* transmit stop flag */
 volatile sd_error_status_type transfer_error = SD_OK; /* transmit error flag */
 volatile uint8_t transfer_end = 0; /* transmit end flag */
+volatile uint8_t card_busy = 0; /* card programming after a write, polled by the sdio interrupt */
+volatile sd_error_status_type busy_error = SD_OK; /* result of the busy polling */
+volatile uint32_t busy_polls = 0; /* cmd13 left before the busy polling gives up */
 sd_card_info_struct_type sd_card_info; /* sd card information */
 
 sd_error_status_type command_error(void);
@@ -61,6 +64,9 @@ sd_error_status_type check_card_programming(uint8_t *p_status);
 sd_error_status_type speed_change(uint8_t speed);
 sd_error_status_type scr_find(void);
 uint8_t convert_from_bytes_to_power_of_two(uint16_t number_of_bytes);
+void card_status_request(void);
+void card_busy_timer_init(void);
+sd_error_status_type card_busy_poll_start(void);
 
 /**
   * @brief  initializes the sd card and put it into standby state (ready for data
@@ -75,6 +81,10 @@ sd_error_status_type sd_init(void)
   gpio_init_type gpio_init_struct = {0};
   uint8_t retry = 0;
 
+  /* sdio_reset drops a busy polling in progress */
+  card_busy = 0;
+  card_busy_timer_init();
+
   /* gpioc and gpiod periph clock enable */
   crm_periph_clock_enable(CRM_GPIOC_PERIPH_CLOCK, TRUE);
   crm_periph_clock_enable(CRM_GPIOD_PERIPH_CLOCK, TRUE);
@@ -857,6 +867,12 @@ sd_error_status_type sdio_command_data_send(sdio_command_struct_type *sdio_cmd_i
       transfer_end = 0;
       sdio_dma_enable(SDIOx, TRUE);
     }
+    else
+    {
+      /* set the channel up while the command is sent, the sdio requests
+         start once its dma is enabled after the response */
+      sd_dma_config(buf, length, DMA_DIR_MEMORY_TO_PERIPHERAL);
+    }
   }
 
   /* sdio command config */
@@ -987,7 +1003,6 @@ sd_error_status_type sdio_command_data_send(sdio_command_struct_type *sdio_cmd_i
   {
     if(sdio_data_init_t->transfer_direction == SDIO_DATA_TRANSFER_TO_CARD)
     {
-      sd_dma_config(buf, length, DMA_DIR_MEMORY_TO_PERIPHERAL);
       SDIOx->inten |= SDIO_INTR_STS_WRITE_MASK;
       transfer_error = SD_OK;
       transfer_end = 0;
@@ -1031,6 +1046,14 @@ sd_error_status_type sd_blocks_erase(long long addr, uint32_t nblks)
   uint32_t start_addr = 0, end_addr = 0, response = 0;
   uint8_t card_state;
 
+  /* the previous write must be programmed */
+  status = sd_busy_wait();
+
+  if(status != SD_OK)
+  {
+    return status;
+  }
+
   /* high capacity sd card */
   if(card_type == SDIO_HIGH_CAPACITY_SD_CARD)
   {
@@ -1189,6 +1212,14 @@ sd_error_status_type sd_block_read(uint8_t *buf, long long addr, uint16_t blk_si
   uint32_t response = 0;
   uint8_t power;
 
+  /* the previous write must be programmed */
+  status = sd_busy_wait();
+
+  if(status != SD_OK)
+  {
+    return status;
+  }
+
   if(NULL == buf)
   {
     return SD_INVALID_PARAMETER;
@@ -1278,6 +1309,14 @@ sd_error_status_type sd_mult_blocks_read(uint8_t *buf, long long addr, uint16_t
   uint32_t response = 0;
   uint8_t power;
 
+  /* the previous write must be programmed */
+  status = sd_busy_wait();
+
+  if(status != SD_OK)
+  {
+    return status;
+  }
+
   SDIOx->dtctrl = 0x0;
 
   if(card_type == SDIO_HIGH_CAPACITY_SD_CARD)
@@ -1356,7 +1395,9 @@ sd_error_status_type sd_mult_blocks_read(uint8_t *buf, long long addr, uint16_t
 
 /**
   * @brief  allows to write one block starting from a specified address in a card.
-  *         the data transfer can be managed by dma mode or polling mode.
+  *         the data transfer can be managed by dma mode or polling mode. returns
+  *         once the data is sent, the next access or sd_busy_wait waits for
+  *         the end of the programming.
   * @param  buf: pointer to the buffer that contain the data to be transferred.
   * @param  addr: address from where data are to be read.
   * @param  blk_size: the sd card data block size. the block size should be 512.
@@ -1365,9 +1406,17 @@ sd_error_status_type sd_mult_blocks_read(uint8_t *buf, long long addr, uint16_t
 sd_error_status_type sd_block_write(const uint8_t *buf, long long addr, uint16_t blk_size)
 {
   sd_error_status_type status = SD_OK;
-  uint8_t  power = 0, card_state = 0;
+  uint8_t  power = 0;
   uint32_t timeout = 0, card_status = 0, response = 0;
 
+  /* the previous write must be programmed */
+  status = sd_busy_wait();
+
+  if(status != SD_OK)
+  {
+    return status;
+  }
+
   if(buf == NULL)
   {
     return SD_INVALID_PARAMETER;
@@ -1465,19 +1514,15 @@ sd_error_status_type sd_block_write(const uint8_t *buf, long long addr, uint16_t
 
   sdio_flag_clear(SDIOx, SDIO_STATIC_FLAGS);
 
-  status = check_card_programming(&card_state);
-
-  while((status == SD_OK) && ((card_state == SD_CARD_PROGRAMMING) || (card_state == SD_CARD_RECEIVING)))
-  {
-    status = check_card_programming(&card_state);
-  }
-
-  return status;
+  /* the card programs the data while the caller goes on */
+  return card_busy_poll_start();
 }
 
 /**
   * @brief  allows to write blocks starting from a specified address in a card.
-  *         the data transfer can be managed by dma mode only.
+  *         the data transfer can be managed by dma mode only. the blocks are
+  *         pre-erased by acmd23 on sd cards. returns once the data is sent, the
+  *         next access or sd_busy_wait waits for the end of the programming.
   * @param  buf: pointer to the buffer that contain the data to be transferred.
   * @param  addr: address from where data are to be read.
   * @param  blk_size: the sd card data block size. the block size should be 512.
@@ -1487,9 +1532,17 @@ sd_error_status_type sd_block_write(const uint8_t *buf, long long addr, uint16_t
 sd_error_status_type sd_mult_blocks_write(const uint8_t *buf, long long addr, uint16_t blk_size, uint32_t nblks)
 {
   sd_error_status_type status = SD_OK;
-  uint8_t  power = 0, card_state = 0;
+  uint8_t  power = 0;
   uint32_t timeout = 0, card_status = 0, response = 0;;
 
+  /* the previous write must be programmed */
+  status = sd_busy_wait();
+
+  if(status != SD_OK)
+  {
+    return status;
+  }
+
   if(buf == NULL)
   {
     return SD_INVALID_PARAMETER;
@@ -1589,8 +1642,8 @@ sd_error_status_type sd_mult_blocks_write(const uint8_t *buf, long long addr, ui
       return status;
     }
 
-    /* send cmd23, set block count */
-    sdio_command_init_struct.argument = blk_size;
+    /* send acmd23, pre-erase the blocks about to be written */
+    sdio_command_init_struct.argument = nblks;
     sdio_command_init_struct.cmd_index = SD_CMD_SET_BLOCK_COUNT;
     sdio_command_init_struct.rsp_type = SDIO_RESPONSE_SHORT;
     sdio_command_init_struct.wait_type = SDIO_WAIT_FOR_NO;
@@ -1631,14 +1684,8 @@ sd_error_status_type sd_mult_blocks_write(const uint8_t *buf, long long addr, ui
 
   sdio_flag_clear(SDIOx, SDIO_STATIC_FLAGS);
 
-  status = check_card_programming(&card_state);
-
-  while((status == SD_OK) && ((card_state == SD_CARD_PROGRAMMING) || (card_state == SD_CARD_RECEIVING)))
-  {
-    status = check_card_programming(&card_state);
-  }
-
-  return status;
+  /* the card programs the data while the caller goes on */
+  return card_busy_poll_start();
 }
 
 /**
@@ -1650,8 +1697,17 @@ sd_error_status_type sd_mult_blocks_write(const uint8_t *buf, long long addr, ui
   */
 sd_error_status_type mmc_stream_read(uint8_t *buf, long long addr, uint32_t len)
 {
+  sd_error_status_type status = SD_OK;
   uint32_t response = 0;
 
+  /* the previous write must be programmed */
+  status = sd_busy_wait();
+
+  if(status != SD_OK)
+  {
+    return status;
+  }
+
   SDIOx->dtctrl = 0x0;
 
   /* clear dcsm configuration */
@@ -1706,6 +1762,14 @@ sd_error_status_type mmc_stream_write(uint8_t *buf, long long addr, uint32_t len
     return SD_INVALID_PARAMETER;
   }
 
+  /* the previous write must be programmed */
+  status = sd_busy_wait();
+
+  if(status != SD_OK)
+  {
+    return status;
+  }
+
   SDIOx->dtctrl = 0x0;
 
   /* clear dcsm configuration */
@@ -1779,6 +1843,24 @@ void SDIO2_IRQHandler(void)
   sd_irq_service();
 }
 
+/**
+  * @brief  busy poll timer isr, sends the next cmd13.
+  * @param  none.
+  * @retval none.
+  */
+void SD_BUSY_TMR_IRQHandler(void)
+{
+  if(tmr_interrupt_flag_get(SD_BUSY_TMR, TMR_OVF_FLAG) != RESET)
+  {
+    tmr_flag_clear(SD_BUSY_TMR, TMR_OVF_FLAG);
+
+    if(card_busy)
+    {
+      card_status_request();
+    }
+  }
+}
+
 /**
   * @brief  allows to process all the interrupts that are high.
   * @param  none
@@ -1786,6 +1868,55 @@ void SDIO2_IRQHandler(void)
   */
 sd_error_status_type sd_irq_service(void)
 {
+  uint32_t sts_reg = 0;
+  uint8_t card_state = 0;
+
+  if(card_busy)
+  {
+    sts_reg = SDIOx->sts;
+
+    if(sts_reg & (SDIO_CMDFAIL_FLAG | SDIO_CMDTIMEOUT_FLAG | SDIO_CMDRSPCMPL_FLAG))
+    {
+      sdio_flag_clear(SDIOx, SDIO_CMDFAIL_FLAG | SDIO_CMDTIMEOUT_FLAG | SDIO_CMDRSPCMPL_FLAG);
+
+      if(sts_reg & SDIO_CMDRSPCMPL_FLAG)
+      {
+        card_state = (uint8_t)((sdio_response_get(SDIOx, SDIO_RSP1_INDEX) >> 9) & 0x0000000F);
+
+        if((card_state == SD_CARD_PROGRAMMING) || (card_state == SD_CARD_RECEIVING))
+        {
+          if(busy_polls == 0)
+          {
+            busy_error = SD_DATA_TIMEOUT;
+            sdio_interrupt_enable(SDIOx, SDIO_CMDFAIL_INT | SDIO_CMDTIMEOUT_INT | SDIO_CMDRSPCMPL_INT, FALSE);
+            card_busy = 0;
+            return busy_error;
+          }
+
+          /* still programming, the timer sends cmd13 again */
+          busy_polls--;
+          tmr_counter_value_set(SD_BUSY_TMR, 0);
+          tmr_counter_enable(SD_BUSY_TMR, TRUE);
+          return SD_OK;
+        }
+
+        busy_error = SD_OK;
+      }
+      else if(sts_reg & SDIO_CMDTIMEOUT_FLAG)
+      {
+        busy_error = SD_CMD_RSP_TIMEOUT;
+      }
+      else
+      {
+        busy_error = SD_CMD_FAIL;
+      }
+
+      sdio_interrupt_enable(SDIOx, SDIO_CMDFAIL_INT | SDIO_CMDTIMEOUT_INT | SDIO_CMDRSPCMPL_INT, FALSE);
+      card_busy = 0;
+      return busy_error;
+    }
+  }
+
   if(sdio_interrupt_flag_get(SDIOx, SDIO_DTCMPL_FLAG) != RESET)
   {
     if(stop_flag == 1)
@@ -2442,6 +2573,99 @@ sd_error_status_type check_card_programming(uint8_t *p_status)
   return SD_OK;
 }
 
+/**
+  * @brief  send cmd13 without waiting for the response.
+  * @param  none
+  * @retval none
+  */
+void card_status_request(void)
+{
+  sdio_command_init_struct.argument = (uint32_t)(rca << 16);
+  sdio_command_init_struct.cmd_index = SD_CMD_SEND_STATUS;
+  sdio_command_init_struct.rsp_type = SDIO_RESPONSE_SHORT;
+  sdio_command_init_struct.wait_type = SDIO_WAIT_FOR_NO;
+
+  /* sdio command config */
+  sdio_command_config(SDIOx, &sdio_command_init_struct);
+  /* enable ccsm */
+  sdio_command_state_machine_enable(SDIOx, TRUE);
+}
+
+/**
+  * @brief  configure the one cycle timer pacing the busy polling.
+  * @param  none
+  * @retval none
+  */
+void card_busy_timer_init(void)
+{
+  crm_clocks_freq_type crm_clocks_freq_struct = {0};
+
+  crm_periph_clock_enable(SD_BUSY_TMR_CLOCK, TRUE);
+  crm_clocks_freq_get(&crm_clocks_freq_struct);
+
+  /* 1 us tick, one cycle of SD_BUSY_POLL_US */
+  tmr_counter_enable(SD_BUSY_TMR, FALSE);
+  tmr_base_init(SD_BUSY_TMR, SD_BUSY_POLL_US - 1, crm_clocks_freq_struct.ahb_freq / 1000000 - 1);
+  tmr_cnt_dir_set(SD_BUSY_TMR, TMR_COUNT_UP);
+  tmr_one_cycle_mode_enable(SD_BUSY_TMR, TRUE);
+  tmr_flag_clear(SD_BUSY_TMR, TMR_OVF_FLAG);
+  tmr_interrupt_enable(SD_BUSY_TMR, TMR_OVF_INT, TRUE);
+  nvic_irq_enable(SD_BUSY_TMR_IRQn, 0, 0);
+}
+
+/**
+  * @brief  start polling the card state from the sdio interrupt, each cmd13
+  *         response that still shows the programming state starts the timer,
+  *         which sends the next one SD_BUSY_POLL_US later.
+  * @param  none
+  * @retval sd_error_status_type: sd card error code.
+  */
+sd_error_status_type card_busy_poll_start(void)
+{
+  busy_error = SD_OK;
+  busy_polls = SD_BUSY_TIMEOUT_MS * 1000 / SD_BUSY_POLL_US;
+  card_busy = 1;
+
+  sdio_flag_clear(SDIOx, SDIO_CMDFAIL_FLAG | SDIO_CMDTIMEOUT_FLAG | SDIO_CMDRSPCMPL_FLAG);
+  sdio_interrupt_enable(SDIOx, SDIO_CMDFAIL_INT | SDIO_CMDTIMEOUT_INT | SDIO_CMDRSPCMPL_INT, TRUE);
+
+  card_status_request();
+
+  return SD_OK;
+}
+
+/**
+  * @brief  wait for the end of the programming started by the last write.
+  * @param  none
+  * @retval sd_error_status_type: result of the busy polling, reported once.
+  */
+sd_error_status_type sd_busy_wait(void)
+{
+  sd_error_status_type status;
+  /* the polling gives up after SD_BUSY_TIMEOUT_MS, wait twice that in 100 us
+     steps in case the interrupts stop */
+  uint32_t timeout = SD_BUSY_TIMEOUT_MS * 20;
+
+  while(card_busy && timeout)
+  {
+    delay_us(100);
+    timeout--;
+  }
+
+  if(card_busy)
+  {
+    sdio_interrupt_enable(SDIOx, SDIO_CMDFAIL_INT | SDIO_CMDTIMEOUT_INT | SDIO_CMDRSPCMPL_INT, FALSE);
+    tmr_counter_enable(SD_BUSY_TMR, FALSE);
+    card_busy = 0;
+    return SD_DATA_TIMEOUT;
+  }
+
+  status = busy_error;
+  busy_error = SD_OK;
+
+  return status;
+}
+
 /**
   * @brief  read current card status.
   * @param  p_card_status: card status.
@@ -2457,6 +2681,14 @@ sd_error_status_type sd_status_send(uint32_t *p_card_status)
     return status;
   }
 
+  /* cmd13 of the busy polling must be over */
+  status = sd_busy_wait();
+
+  if(status != SD_OK)
+  {
+    return status;
+  }
+
   sdio_command_init_struct.argument = (uint32_t)(rca << 16);
   sdio_command_init_struct.cmd_index = SD_CMD_SEND_STATUS;
   sdio_command_init_struct.rsp_type = SDIO_RESPONSE_SHORT;
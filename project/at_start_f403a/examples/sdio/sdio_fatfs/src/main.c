@@ -41,6 +41,8 @@ FATFS fs;
 FIL file;
 BYTE work[FF_MAX_SS];
 
+extern uint32_t sd_cache_hits, sd_cache_misses, sd_cache_prefetches;
+
 uint8_t buffer_compare(uint8_t* pbuffer1, uint8_t* pbuffer2, uint16_t buffer_length);
 static void sd_test_error(void);
 static void nvic_configuration(void);
@@ -183,6 +185,8 @@ static error_status fatfs_test(void)
 
   ret = f_mount(NULL, "1:", 1);
 
+  printf("sector cache: %u hits, %u misses, %u sectors read ahead.\r\n", sd_cache_hits, sd_cache_misses, sd_cache_prefetches);
+
   if(1 == buffer_compare((uint8_t*)rbuf, (uint8_t*)wbuf, sizeof(wbuf))){
     printf("r/w file data test ok.\r\n");
   }
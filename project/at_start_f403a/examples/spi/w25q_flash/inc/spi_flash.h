@@ -106,6 +106,75 @@ extern "C" {
 #define SPIF_JEDECDEVICEID               0x9F
 #define FLASH_SPI_DUMMY_BYTE             0xA5
 
+/**
+  * @}
+  */
+
+/** @defgroup SPI_flash_async_definition
+  * @brief    requests are queued and run one after the other by the dma1
+  *           channel4 (spi2 rx) full transfer interrupt. dma1 channel4 and
+  *           channel5 are configured once by spiflash_init, a transfer only
+  *           loads the memory address, the count and the increment. while
+  *           the flash is busy, the status register is read again each time
+  *           the one cycle timer SPIF_POLL_TMR expires, the bus and the cpu
+  *           are free in between.
+  * @{
+  */
+
+#define SPIF_DMA_MAX_LEN                 0xFFFF
+#define SPIF_DMA_IRQ_PRIORITY            1
+
+#define SPIF_POLL_TMR                    TMR6
+#define SPIF_POLL_TMR_CLOCK              CRM_TMR6_PERIPH_CLOCK
+#define SPIF_POLL_TMR_IRQn               TMR6_GLOBAL_IRQn
+#define SPIF_PROGRAM_POLL_US             100        /*!< page program takes 0.7ms typical */
+#define SPIF_ERASE_POLL_US               2000       /*!< sector erase takes 45ms typical */
+
+/**
+  * @}
+  */
+
+/** @defgroup SPI_flash_async_types
+  * @{
+  */
+
+typedef enum
+{
+  SPIF_OP_READ,                          /*!< read length bytes */
+  SPIF_OP_PAGE_PROGRAM,                  /*!< program within one page, then wait */
+  SPIF_OP_SECTOR_ERASE,                  /*!< erase the sector holding address, then wait */
+  SPIF_OP_WAIT_BUSY,                     /*!< wait for the busy bit to clear */
+} spiflash_op_type;
+
+typedef enum
+{
+  SPIF_REQ_IDLE,
+  SPIF_REQ_QUEUED,
+  SPIF_REQ_ACTIVE,
+  SPIF_REQ_DONE,
+  SPIF_REQ_ERROR,                        /*!< rejected by spiflash_submit */
+} spiflash_req_state_type;
+
+typedef struct spiflash_request_struct spiflash_request_type;
+
+/**
+  * @brief  completion callback, called from the dma interrupt. it may submit
+  *         the next request or notify a task (xTaskNotifyFromISR with param).
+  */
+typedef void (*spiflash_callback_type)(spiflash_request_type *preq);
+
+struct spiflash_request_struct
+{
+  spiflash_op_type                       op;
+  uint32_t                               address;
+  uint8_t                                *pbuffer;
+  uint32_t                               length;
+  spiflash_callback_type                 callback;    /*!< may be 0 */
+  void                                   *param;      /*!< for the callback */
+  __IO spiflash_req_state_type           state;
+  spiflash_request_type                  *next;       /*!< queue link, owned by the driver */
+};
+
 /**
   * @}
   */
@@ -128,6 +197,11 @@ void spiflash_write_enable(void);
 uint16_t spiflash_read_id(void);
 uint8_t spi_byte_write(uint8_t data);
 uint8_t spi_byte_read(void);
+error_status spiflash_submit(spiflash_request_type *preq);
+flag_status spiflash_async_busy(void);
+void spiflash_request_wait(spiflash_request_type *preq);
+void spiflash_dma_irq_handler(void);
+void spiflash_tmr_irq_handler(void);
 
 /**
   * @}
@@ -25,6 +25,7 @@
 /* includes ------------------------------------------------------------------*/
 #include "at32f403a_407_int.h"
 #include "at32f403a_407_board.h"
+#include "spi_flash.h"
 
 /** @addtogroup AT32F403A_periph_examples
   * @{
@@ -131,6 +132,26 @@ void SysTick_Handler(void)
 {
 }
 
+/**
+  * @brief  this function handles dma1 channel4 handler.
+  * @param  none
+  * @retval none
+  */
+void DMA1_Channel4_IRQHandler(void)
+{
+  spiflash_dma_irq_handler();
+}
+
+/**
+  * @brief  this function handles tmr6 handler.
+  * @param  none
+  * @retval none
+  */
+void TMR6_GLOBAL_IRQHandler(void)
+{
+  spiflash_tmr_irq_handler();
+}
+
 /**
   * @}
   */
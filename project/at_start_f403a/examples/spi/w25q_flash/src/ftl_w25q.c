@@ -0,0 +1,92 @@
+/**
+  **************************************************************************
+  * @file     ftl_w25q.c
+  * @brief    w25q backend of the flash translation layer, on spi_flash.c
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+#include "ftl_w25q.h"
+#include "spi_flash.h"
+
+/** @addtogroup AT32F403A_periph_examples
+  * @{
+  */
+
+/** @addtogroup 403A_SPI_w25q_flash
+  * @{
+  */
+
+/**
+  * @brief  read the w25q.
+  * @param  address: flash address
+  * @param  pbuffer: data buffer
+  * @param  length: data length
+  * @retval 0
+  */
+static int w25q_read(uint32_t address, uint8_t *pbuffer, uint32_t length)
+{
+  spiflash_read(pbuffer, address, length);
+  return 0;
+}
+
+/**
+  * @brief  erase one sector of the w25q.
+  * @param  address: sector address
+  * @retval 0
+  */
+static int w25q_erase(uint32_t address)
+{
+  spiflash_sector_erase(address / SPIF_SECTOR_SIZE);
+  return 0;
+}
+
+/**
+  * @brief  program erased bytes of the w25q, the pages are queued back to back.
+  * @param  address: flash address
+  * @param  pbuffer: data
+  * @param  length: data length
+  * @retval 0
+  */
+static int w25q_program(uint32_t address, const uint8_t *pbuffer, uint32_t length)
+{
+  spiflash_write_nocheck((uint8_t *)pbuffer, address, length);
+  return 0;
+}
+
+/**
+  * @brief w25q backend
+  */
+const ftl_backend_type ftl_w25q =
+{
+  FTL_W25Q_ADDR,
+  SPIF_SECTOR_SIZE,
+  FTL_W25Q_BLOCK_NUM,
+  w25q_read,
+  w25q_erase,
+  w25q_program,
+};
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
@@ -0,0 +1,263 @@
+/**
+  **************************************************************************
+  * @file     main.c
+  * @brief    main program
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+#include "at32f403a_407_board.h"
+#include "at32f403a_407_clock.h"
+#include "usbd_core.h"
+#include "dfu_class.h"
+#include "dfu_desc.h"
+#include "usbd_int.h"
+
+/** @addtogroup AT32F403A_periph_examples
+  * @{
+  */
+
+/** @addtogroup 403A_USB_device_dfu_iap USB_device_dfu_iap
+  * @{
+  */
+
+usbd_core_type usb_core_dev;
+
+void (*pftarget)(void);
+
+void jump_to_app(uint32_t address);
+void dfu_loop_status(void);
+
+
+/**
+  * @brief  usb 48M clock select
+  * @param  clk_s:USB_CLK_HICK, USB_CLK_HEXT
+  * @retval none
+  */
+void usb_clock48m_select(usb_clk48_s clk_s)
+{
+  if(clk_s == USB_CLK_HICK)
+  {
+    crm_usb_clock_source_select(CRM_USB_CLOCK_SOURCE_HICK);
+
+    /* enable the acc calibration ready interrupt */
+    crm_periph_clock_enable(CRM_ACC_PERIPH_CLOCK, TRUE);
+
+    /* update the c1\c2\c3 value */
+    acc_write_c1(7980);
+    acc_write_c2(8000);
+    acc_write_c3(8020);
+
+    /* open acc calibration */
+    acc_calibration_mode_enable(ACC_CAL_HICKTRIM, TRUE);
+  }
+  else
+  {
+    switch(system_core_clock)
+    {
+      /* 48MHz */
+      case 48000000:
+        crm_usb_clock_div_set(CRM_USB_DIV_1);
+        break;
+
+      /* 72MHz */
+      case 72000000:
+        crm_usb_clock_div_set(CRM_USB_DIV_1_5);
+        break;
+
+      /* 96MHz */
+      case 96000000:
+        crm_usb_clock_div_set(CRM_USB_DIV_2);
+        break;
+
+      /* 120MHz */
+      case 120000000:
+        crm_usb_clock_div_set(CRM_USB_DIV_2_5);
+        break;
+
+      /* 144MHz */
+      case 144000000:
+        crm_usb_clock_div_set(CRM_USB_DIV_3);
+        break;
+
+      /* 168MHz */
+      case 168000000:
+        crm_usb_clock_div_set(CRM_USB_DIV_3_5);
+        break;
+
+      /* 192MHz */
+      case 192000000:
+        crm_usb_clock_div_set(CRM_USB_DIV_4);
+        break;
+
+      default:
+        break;
+
+    }
+  }
+}
+
+/**
+  * @brief  main function.
+  * @param  none
+  * @retval none
+  */
+int main(void)
+{
+  /* config nvic priority group */
+  nvic_priority_group_config(NVIC_PRIORITY_GROUP_4);
+
+  system_clock_config();
+
+  at32_board_init();
+
+  /* a verified image starts at once, hold the user button to stay in dfu */
+  if(usbd_dfu_upgrade_flag_get() == SET &&
+    (at32_button_press() == NO_BUTTON))
+  {
+    jump_to_app(USBD_DFU_APP_ADDRESS);
+  }
+
+  /* select usb 48m clcok source */
+  usb_clock48m_select(USB_CLK_HEXT);
+
+  /* enable usb clock */
+  crm_periph_clock_enable(CRM_USB_PERIPH_CLOCK, TRUE);
+
+  /* enable usb interrupt */
+  nvic_irq_enable(USBFS_L_CAN1_RX0_IRQn, 0, 0);
+
+  /* usb core init */
+  usbd_core_init(&usb_core_dev, USB, &dfu_class_handler, &dfu_desc_handler, 0);
+
+  /* enable usb pull-up */
+  usbd_connect(&usb_core_dev);
+
+  while(1)
+  {
+    /* program the received blocks while the host sends the next one */
+    usbd_dfu_loop(&usb_core_dev);
+    dfu_loop_status();
+  }
+}
+
+/**
+  * @brief  loop status
+  * @note   led2 shows a download, led3 a verified image and led4 an error. the
+  *         verified image is started once the host has read its final status.
+  * @param  none
+  * @retval none
+  */
+void dfu_loop_status(void)
+{
+  static dfu_state_type state = DFU_STATE_IDLE;
+
+  if(state == dfu_info.dev_state)
+  {
+    return;
+  }
+  state = dfu_info.dev_state;
+
+  switch(state)
+  {
+    case DFU_STATE_DNLOAD_SYNC:
+    case DFU_STATE_DNBUSY:
+    case DFU_STATE_DNLOAD_IDLE:
+      at32_led_on(LED2);
+      break;
+    case DFU_STATE_IDLE:
+      at32_led_off(LED2);
+      at32_led_off(LED4);
+      if(dfu_info.manifest_done && dfu_info.dev_status == DFU_STATUS_OK)
+      {
+        at32_led_on(LED3);
+        delay_ms(1000);
+        usbd_disconnect(&usb_core_dev);
+        jump_to_app(USBD_DFU_APP_ADDRESS);
+      }
+      break;
+    case DFU_STATE_ERROR:
+      at32_led_on(LED4);
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  jump to app
+  * @param  none
+  * @retval none
+  */
+void jump_to_app(uint32_t address)
+{
+  uint32_t stkptr, jumpaddr;
+  stkptr = *(uint32_t *)address;
+  jumpaddr = *(uint32_t *)(address + sizeof(uint32_t));
+
+  /* clear usb crm */
+  crm_periph_clock_enable(CRM_USB_PERIPH_CLOCK, FALSE);
+  crm_periph_clock_enable(CRM_USB_PERIPH_CLOCK, FALSE);
+
+  crm_periph_reset(CRM_USB_PERIPH_RESET, TRUE);
+  crm_periph_reset(CRM_USB_PERIPH_RESET, FALSE);
+
+  __set_MSP(stkptr);
+  pftarget = (void (*) (void))jumpaddr;
+  pftarget();
+}
+
+/**
+  * @brief  this function handles usb interrupt.
+  * @param  none
+  * @retval none
+  */
+void USBFS_L_CAN1_RX0_IRQHandler(void)
+{
+  usbd_irq_handler(&usb_core_dev);
+}
+
+/**
+  * @brief  usb delay millisecond function.
+  * @param  ms: number of millisecond delay
+  * @retval none
+  */
+void usb_delay_ms(uint32_t ms)
+{
+  /* user can define self delay function */
+  delay_ms(ms);
+}
+
+/**
+  * @brief  usb delay microsecond function.
+  * @param  us: number of microsecond delay
+  * @retval none
+  */
+void usb_delay_us(uint32_t us)
+{
+  delay_us(us);
+}
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
@@ -47,6 +47,10 @@ void SVC_Handler(void);
 void DebugMon_Handler(void);
 void PendSV_Handler(void);
 void SysTick_Handler(void);
+#ifdef MSC_USE_W25Q_FTL
+void DMA1_Channel4_IRQHandler(void);
+void TMR6_GLOBAL_IRQHandler(void);
+#endif
 
 #ifdef __cplusplus
 }
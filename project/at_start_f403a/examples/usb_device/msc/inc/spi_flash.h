@@ -0,0 +1,223 @@
+/**
+  **************************************************************************
+  * @file     spi_flash.h
+  * @brief    header file of spi_flash
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+#ifndef __SPI_FLASH_H
+#define __SPI_FLASH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "at32f403a_407.h"
+
+/** @addtogroup AT32F403A_periph_examples
+  * @{
+  */
+
+/** @addtogroup 403A_USB_device_msc
+  * @{
+  */
+
+
+ /* use dma transfer spi data */
+#define SPI_TRANS_DMA
+
+/** @defgroup SPI_flash_cs_pin_definition
+  * @{
+  */
+
+#define FLASH_CS_HIGH()                  gpio_bits_set(GPIOB, GPIO_PINS_12)
+#define FLASH_CS_LOW()                   gpio_bits_reset(GPIOB, GPIO_PINS_12)
+
+/**
+  * @}
+  */
+
+/** @defgroup SPI_flash_id_definition
+  * @{
+  */
+
+/*
+ * flash define
+ */
+#define W25Q80                           0xEF13
+#define W25Q16                           0xEF14
+#define W25Q32                           0xEF15
+#define W25Q64                           0xEF16
+/* 16mb, the range of address:0~0xFFFFFF */
+#define W25Q128                          0xEF17
+
+/**
+  * @}
+  */
+
+/** @defgroup SPI_flash_operation_definition
+  * @{
+  */
+
+#define SPIF_CHIP_SIZE                   0x1000000
+#define SPIF_SECTOR_SIZE                 4096
+#define SPIF_PAGE_SIZE                   256
+
+#define SPIF_WRITEENABLE                 0x06
+#define SPIF_WRITEDISABLE                0x04
+/* s7-s0 */
+#define SPIF_READSTATUSREG1              0x05
+#define SPIF_WRITESTATUSREG1             0x01
+/* s15-s8 */
+#define SPIF_READSTATUSREG2              0x35
+#define SPIF_WRITESTATUSREG2             0x31
+/* s23-s16 */
+#define SPIF_READSTATUSREG3              0x15
+#define SPIF_WRITESTATUSREG3             0x11
+#define SPIF_READDATA                    0x03
+#define SPIF_FASTREADDATA                0x0B
+#define SPIF_FASTREADDUAL                0x3B
+#define SPIF_PAGEPROGRAM                 0x02
+/* block size:64kb */
+#define SPIF_BLOCKERASE                  0xD8
+#define SPIF_SECTORERASE                 0x20
+#define SPIF_CHIPERASE                   0xC7
+#define SPIF_POWERDOWN                   0xB9
+#define SPIF_RELEASEPOWERDOWN            0xAB
+#define SPIF_DEVICEID                    0xAB
+#define SPIF_MANUFACTDEVICEID            0x90
+#define SPIF_JEDECDEVICEID               0x9F
+#define FLASH_SPI_DUMMY_BYTE             0xA5
+
+/**
+  * @}
+  */
+
+/** @defgroup SPI_flash_async_definition
+  * @brief    requests are queued and run one after the other by the dma1
+  *           channel4 (spi2 rx) full transfer interrupt. dma1 channel4 and
+  *           channel5 are configured once by spiflash_init, a transfer only
+  *           loads the memory address, the count and the increment. while
+  *           the flash is busy, the status register is read again each time
+  *           the one cycle timer SPIF_POLL_TMR expires, the bus and the cpu
+  *           are free in between.
+  * @{
+  */
+
+#define SPIF_DMA_MAX_LEN                 0xFFFF
+#define SPIF_DMA_IRQ_PRIORITY            1
+
+#define SPIF_POLL_TMR                    TMR6
+#define SPIF_POLL_TMR_CLOCK              CRM_TMR6_PERIPH_CLOCK
+#define SPIF_POLL_TMR_IRQn               TMR6_GLOBAL_IRQn
+#define SPIF_PROGRAM_POLL_US             100        /*!< page program takes 0.7ms typical */
+#define SPIF_ERASE_POLL_US               2000       /*!< sector erase takes 45ms typical */
+
+/**
+  * @}
+  */
+
+/** @defgroup SPI_flash_async_types
+  * @{
+  */
+
+typedef enum
+{
+  SPIF_OP_READ,                          /*!< read length bytes */
+  SPIF_OP_PAGE_PROGRAM,                  /*!< program within one page, then wait */
+  SPIF_OP_SECTOR_ERASE,                  /*!< erase the sector holding address, then wait */
+  SPIF_OP_WAIT_BUSY,                     /*!< wait for the busy bit to clear */
+} spiflash_op_type;
+
+typedef enum
+{
+  SPIF_REQ_IDLE,
+  SPIF_REQ_QUEUED,
+  SPIF_REQ_ACTIVE,
+  SPIF_REQ_DONE,
+  SPIF_REQ_ERROR,                        /*!< rejected by spiflash_submit */
+} spiflash_req_state_type;
+
+typedef struct spiflash_request_struct spiflash_request_type;
+
+/**
+  * @brief  completion callback, called from the dma interrupt. it may submit
+  *         the next request or notify a task (xTaskNotifyFromISR with param).
+  */
+typedef void (*spiflash_callback_type)(spiflash_request_type *preq);
+
+struct spiflash_request_struct
+{
+  spiflash_op_type                       op;
+  uint32_t                               address;
+  uint8_t                                *pbuffer;
+  uint32_t                               length;
+  spiflash_callback_type                 callback;    /*!< may be 0 */
+  void                                   *param;      /*!< for the callback */
+  __IO spiflash_req_state_type           state;
+  spiflash_request_type                  *next;       /*!< queue link, owned by the driver */
+};
+
+/**
+  * @}
+  */
+
+/** @defgroup SPI_flash_exported_functions
+  * @{
+  */
+
+void spiflash_init(void);
+void spiflash_write(uint8_t *pbuffer, uint32_t write_addr, uint32_t length);
+void spiflash_read(uint8_t *pbuffer, uint32_t read_addr, uint32_t length);
+void spiflash_sector_erase(uint32_t erase_addr);
+void spiflash_write_nocheck(uint8_t *pbuffer, uint32_t write_addr, uint32_t length);
+void spiflash_page_write(uint8_t *pbuffer, uint32_t write_addr, uint32_t length);
+void spi_bytes_write(uint8_t *pbuffer, uint32_t length);
+void spi_bytes_read(uint8_t *pbuffer, uint32_t length);
+void spiflash_wait_busy(void);
+uint8_t spiflash_read_sr1(void);
+void spiflash_write_enable(void);
+uint16_t spiflash_read_id(void);
+uint8_t spi_byte_write(uint8_t data);
+uint8_t spi_byte_read(void);
+error_status spiflash_submit(spiflash_request_type *preq);
+flag_status spiflash_async_busy(void);
+void spiflash_request_wait(spiflash_request_type *preq);
+void spiflash_dma_irq_handler(void);
+void spiflash_tmr_irq_handler(void);
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
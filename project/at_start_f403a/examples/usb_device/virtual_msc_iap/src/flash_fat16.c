@@ -536,6 +536,10 @@ uint32_t flash_fat16_sector_write(uint32_t fat_lbk, uint8_t *data, uint32_t len)
       /* clear upgrade flag */
       flash_fat16_clear_upgrade_flag();
 
+      /* restart the running image crc */
+      flash_iap.firmware_length = 0;
+      flash_iap.write_crc = 0xFFFFFFFF;
+
       flash_iap.msc_up_status = UPGRAGE_ONGOING;
     }
 
@@ -554,8 +558,9 @@ uint32_t flash_fat16_sector_write(uint32_t fat_lbk, uint8_t *data, uint32_t len)
       {
         if(flash_iap.file_write_nr >= file_size)
         {
-          /* upgrade finish */
+          /* upgrade finish, write_crc already holds the image digest */
           flash_iap.file_write_nr = 0;
+          flash_iap.read_crc = flash_iap.write_crc;
           flash_iap.msc_up_status = UPGRADE_SUCCESS;
           s_bin_sp = 0;
           s_bin_pc = 0;
@@ -592,16 +597,14 @@ uint32_t flash_fat16_sector_write(uint32_t fat_lbk, uint8_t *data, uint32_t len)
 }
 
 /**
-  * @brief  crc check
+  * @brief  verify the block just written and feed it into the image crc
   * @param  address: flash address
   * @param  data: pointer to array to store data
   * @param  len: data length
-  * @retval crc result
+  * @retval check result, 0 when flash matches the data
   */
 uint32_t flash_crc_check(uint32_t address, uint8_t *data, uint32_t len)
 {
-  uint32_t flash_crc = 0;
-  uint32_t data_crc = 0;
   uint32_t i_index = 0;
   uint32_t wlen = len / sizeof(uint32_t);
   uint32_t remain_len = len % sizeof(uint32_t);
@@ -620,23 +623,24 @@ uint32_t flash_crc_check(uint32_t address, uint8_t *data, uint32_t len)
     }
   }
 
-  /* calculate write buffer */
-  crc_data_reset();
+  /* read back only this block, the image is not read again at the end */
   for(i_index = 0; i_index < wlen; i_index ++)
   {
-    data_crc = crc_one_word_calculate(u32data[i_index]);
+    if(flash_addr[i_index] != u32data[i_index])
+    {
+      crm_periph_clock_enable(CRM_CRC_PERIPH_CLOCK, FALSE);
+      return 1;
+    }
   }
 
-  /* calculate flash data */
+  /* resume the crc unit from the running value */
+  crc_init_data_set(flash_iap.write_crc);
   crc_data_reset();
-  for(i_index = 0; i_index < wlen; i_index ++)
-  {
-    flash_crc = crc_one_word_calculate(*flash_addr++);
-  }
+  flash_iap.write_crc = crc_block_calculate(u32data, wlen);
+  crc_init_data_set(0xFFFFFFFF);
   crm_periph_clock_enable(CRM_CRC_PERIPH_CLOCK, FALSE);
 
-  if(data_crc != flash_crc)
-    return 1;
+  flash_iap.firmware_length += len;
 
   return 0;
 
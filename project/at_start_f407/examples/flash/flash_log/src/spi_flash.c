@@ -0,0 +1,832 @@
+/**
+  **************************************************************************
+  * @file     spi_flash.c
+  * @brief    spi_flash source code
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+#include "spi_flash.h"
+
+/** @addtogroup AT32F407_periph_examples
+  * @{
+  */
+
+/** @addtogroup 407_FLASH_flash_log
+  * @{
+  */
+
+#define SPIF_PHASE_WREN                  0
+#define SPIF_PHASE_CMD                   1
+#define SPIF_PHASE_DATA                  2
+#define SPIF_PHASE_POLL                  3
+#define SPIF_PHASE_DELAY                 4
+
+/* page programs and the erase of one sector can be queued by spiflash_write */
+#define SPIF_PIPE_NUM                    (SPIF_SECTOR_SIZE / SPIF_PAGE_SIZE + 1)
+
+uint8_t spiflash_sector_buf[SPIF_SECTOR_SIZE];
+
+/* request queue, the head is the request on the bus */
+static spiflash_request_type *spif_head = 0;
+static spiflash_request_type *spif_tail = 0;
+static uint8_t spif_phase;
+static uint8_t spif_cmd[4];
+static uint32_t spif_count;
+static const uint8_t spif_dummy_tx = FLASH_SPI_DUMMY_BYTE;
+static uint8_t spif_dummy_rx;
+static uint8_t spif_status[2];
+static spiflash_request_type spif_pipe[SPIF_PIPE_NUM];
+static uint32_t spif_pipe_index = 0;
+
+/**
+  * @brief  start a transfer on the preconfigured dma channels
+  * @param  ptx: bytes to send
+  * @param  tx_inc: TRUE to step through ptx, FALSE to repeat *ptx
+  * @param  prx: received bytes
+  * @param  rx_inc: TRUE to step through prx, FALSE to keep the last byte in *prx
+  * @param  length: 1 to SPIF_DMA_MAX_LEN
+  * @param  interrupt: TRUE to end with the dma1 channel4 interrupt
+  * @retval none
+  */
+static void spi_dma_start(const uint8_t *ptx, confirm_state tx_inc, uint8_t *prx, confirm_state rx_inc,
+                          uint16_t length, confirm_state interrupt)
+{
+  DMA1_CHANNEL4->ctrl_bit.chen = FALSE;
+  DMA1_CHANNEL5->ctrl_bit.chen = FALSE;
+  dma_flag_clear(DMA1_GL4_FLAG);
+
+  DMA1_CHANNEL4->maddr = (uint32_t)prx;
+  DMA1_CHANNEL4->ctrl_bit.mincm = rx_inc;
+  DMA1_CHANNEL4->ctrl_bit.fdtien = interrupt;
+  DMA1_CHANNEL4->dtcnt = length;
+  DMA1_CHANNEL5->maddr = (uint32_t)ptx;
+  DMA1_CHANNEL5->ctrl_bit.mincm = tx_inc;
+  DMA1_CHANNEL5->dtcnt = length;
+
+  DMA1_CHANNEL4->ctrl_bit.chen = TRUE;
+  DMA1_CHANNEL5->ctrl_bit.chen = TRUE;
+  spi_i2s_dma_receiver_enable(SPI2, TRUE);
+  spi_i2s_dma_transmitter_enable(SPI2, TRUE);
+}
+
+/**
+  * @brief  stop the dma channels once the receive channel is done
+  * @param  none
+  * @retval none
+  */
+static void spi_dma_stop(void)
+{
+  DMA1_CHANNEL4->ctrl_bit.chen = FALSE;
+  DMA1_CHANNEL5->ctrl_bit.chen = FALSE;
+  spi_i2s_dma_transmitter_enable(SPI2, FALSE);
+  spi_i2s_dma_receiver_enable(SPI2, FALSE);
+}
+
+/**
+  * @brief  start a phase of the request at the head of the queue
+  * @param  phase: SPIF_PHASE_xxx
+  * @retval none
+  */
+static void spif_phase_start(uint8_t phase)
+{
+  spiflash_request_type *preq = spif_head;
+  uint32_t length;
+
+  spif_phase = phase;
+  switch(phase)
+  {
+    case SPIF_PHASE_WREN:
+      spif_cmd[0] = SPIF_WRITEENABLE;
+      FLASH_CS_LOW();
+      spi_dma_start(spif_cmd, TRUE, &spif_dummy_rx, FALSE, 1, TRUE);
+      break;
+    case SPIF_PHASE_CMD:
+      if(preq->op == SPIF_OP_READ)
+        spif_cmd[0] = SPIF_READDATA;
+      else if(preq->op == SPIF_OP_PAGE_PROGRAM)
+        spif_cmd[0] = SPIF_PAGEPROGRAM;
+      else
+        spif_cmd[0] = SPIF_SECTORERASE;
+      spif_cmd[1] = (uint8_t)(preq->address >> 16);
+      spif_cmd[2] = (uint8_t)(preq->address >> 8);
+      spif_cmd[3] = (uint8_t)preq->address;
+      FLASH_CS_LOW();
+      spi_dma_start(spif_cmd, TRUE, &spif_dummy_rx, FALSE, 4, TRUE);
+      break;
+    case SPIF_PHASE_DATA:
+      length = preq->length - spif_count;
+      if(length > SPIF_DMA_MAX_LEN)
+      {
+        length = SPIF_DMA_MAX_LEN;
+      }
+      if(preq->op == SPIF_OP_READ)
+        spi_dma_start(&spif_dummy_tx, FALSE, preq->pbuffer + spif_count, TRUE, length, TRUE);
+      else
+        spi_dma_start(preq->pbuffer + spif_count, TRUE, &spif_dummy_rx, FALSE, length, TRUE);
+      spif_count += length;
+      break;
+    case SPIF_PHASE_POLL:
+      spif_cmd[0] = SPIF_READSTATUSREG1;
+      spif_cmd[1] = FLASH_SPI_DUMMY_BYTE;
+      FLASH_CS_LOW();
+      spi_dma_start(spif_cmd, TRUE, spif_status, TRUE, 2, TRUE);
+      break;
+    default:
+      /* bus idle until the timer asks for the next poll */
+      length = (preq->op == SPIF_OP_SECTOR_ERASE) ? SPIF_ERASE_POLL_US : SPIF_PROGRAM_POLL_US;
+      tmr_period_value_set(SPIF_POLL_TMR, length - 1);
+      tmr_counter_value_set(SPIF_POLL_TMR, 0);
+      tmr_counter_enable(SPIF_POLL_TMR, TRUE);
+      break;
+  }
+}
+
+/**
+  * @brief  start the request at the head of the queue
+  * @param  none
+  * @retval none
+  */
+static void spif_request_start(void)
+{
+  spif_head->state = SPIF_REQ_ACTIVE;
+  spif_count = 0;
+  if(spif_head->op == SPIF_OP_READ)
+    spif_phase_start(SPIF_PHASE_CMD);
+  else if(spif_head->op == SPIF_OP_WAIT_BUSY)
+    spif_phase_start(SPIF_PHASE_POLL);
+  else
+    spif_phase_start(SPIF_PHASE_WREN);
+}
+
+/**
+  * @brief  take the oldest request of the write pipeline once it is done
+  * @param  none
+  * @retval request to fill
+  */
+static spiflash_request_type *spif_pipe_get(void)
+{
+  spiflash_request_type *preq = &spif_pipe[spif_pipe_index];
+
+  spif_pipe_index = (spif_pipe_index + 1) % SPIF_PIPE_NUM;
+  spiflash_request_wait(preq);
+  return preq;
+}
+
+/**
+  * @brief  wait for every request of the write pipeline
+  * @param  none
+  * @retval none
+  */
+static void spif_pipe_wait(void)
+{
+  uint32_t index;
+
+  for(index = 0; index < SPIF_PIPE_NUM; index++)
+  {
+    spiflash_request_wait(&spif_pipe[index]);
+  }
+}
+
+/**
+  * @brief  fill a request without callback
+  * @param  preq: request
+  * @param  op: SPIF_OP_xxx
+  * @param  address: flash address
+  * @param  pbuffer: data buffer
+  * @param  length: data length
+  * @retval none
+  */
+static void spif_request_fill(spiflash_request_type *preq, spiflash_op_type op, uint32_t address,
+                              uint8_t *pbuffer, uint32_t length)
+{
+  preq->op = op;
+  preq->address = address;
+  preq->pbuffer = pbuffer;
+  preq->length = length;
+  preq->callback = 0;
+}
+
+/**
+  * @brief  wait until every queued request is done, before a polled access
+  * @param  none
+  * @retval none
+  */
+static void spif_idle_wait(void)
+{
+  while(spif_head != 0);
+}
+
+/**
+  * @brief  spi configuration.
+  * @param  none
+  * @retval none
+  */
+void spiflash_init(void)
+{
+  gpio_init_type gpio_initstructure;
+  spi_init_type spi_init_struct;
+  dma_init_type dma_init_struct;
+  crm_clocks_freq_type crm_clocks_freq_struct = {0};
+
+  crm_periph_clock_enable(CRM_GPIOB_PERIPH_CLOCK, TRUE);
+  crm_periph_clock_enable(CRM_DMA1_PERIPH_CLOCK, TRUE);
+  /* software cs, pb12 as a general io to control flash cs */
+  gpio_initstructure.gpio_out_type       = GPIO_OUTPUT_PUSH_PULL;
+  gpio_initstructure.gpio_pull           = GPIO_PULL_UP;
+  gpio_initstructure.gpio_mode           = GPIO_MODE_OUTPUT;
+  gpio_initstructure.gpio_drive_strength = GPIO_DRIVE_STRENGTH_STRONGER;
+  gpio_initstructure.gpio_pins           = GPIO_PINS_12;
+  gpio_init(GPIOB, &gpio_initstructure);
+
+  /* sck */
+  gpio_initstructure.gpio_pull           = GPIO_PULL_UP;
+  gpio_initstructure.gpio_mode           = GPIO_MODE_MUX;
+  gpio_initstructure.gpio_pins           = GPIO_PINS_13;
+  gpio_init(GPIOB, &gpio_initstructure);
+
+  /* miso */
+  gpio_initstructure.gpio_pull           = GPIO_PULL_UP;
+  gpio_initstructure.gpio_mode           = GPIO_MODE_MUX;
+  gpio_initstructure.gpio_pins           = GPIO_PINS_14;
+  gpio_init(GPIOB, &gpio_initstructure);
+
+  /* mosi */
+  gpio_initstructure.gpio_pull           = GPIO_PULL_UP;
+  gpio_initstructure.gpio_mode           = GPIO_MODE_MUX;
+  gpio_initstructure.gpio_pins           = GPIO_PINS_15;
+  gpio_init(GPIOB, &gpio_initstructure);
+
+  FLASH_CS_HIGH();
+  crm_periph_clock_enable(CRM_SPI2_PERIPH_CLOCK, TRUE);
+  spi_default_para_init(&spi_init_struct);
+  spi_init_struct.transmission_mode = SPI_TRANSMIT_FULL_DUPLEX;
+  spi_init_struct.master_slave_mode = SPI_MODE_MASTER;
+  spi_init_struct.mclk_freq_division = SPI_MCLK_DIV_8;
+  spi_init_struct.first_bit_transmission = SPI_FIRST_BIT_MSB;
+  spi_init_struct.frame_bit_num = SPI_FRAME_8BIT;
+  spi_init_struct.clock_polarity = SPI_CLOCK_POLARITY_HIGH;
+  spi_init_struct.clock_phase = SPI_CLOCK_PHASE_2EDGE;
+  spi_init_struct.cs_mode_selection = SPI_CS_SOFTWARE_MODE;
+  spi_init(SPI2, &spi_init_struct);
+  spi_enable(SPI2, TRUE);
+
+  /* dma1 channel4 spi2 rx and channel5 spi2 tx, set up once */
+  dma_reset(DMA1_CHANNEL4);
+  dma_reset(DMA1_CHANNEL5);
+  dma_default_para_init(&dma_init_struct);
+  dma_init_struct.buffer_size = 0;
+  dma_init_struct.direction = DMA_DIR_PERIPHERAL_TO_MEMORY;
+  dma_init_struct.memory_base_addr = (uint32_t)&spif_dummy_rx;
+  dma_init_struct.memory_data_width = DMA_MEMORY_DATA_WIDTH_BYTE;
+  dma_init_struct.memory_inc_enable = FALSE;
+  dma_init_struct.peripheral_base_addr = (uint32_t)(&SPI2->dt);
+  dma_init_struct.peripheral_data_width = DMA_PERIPHERAL_DATA_WIDTH_BYTE;
+  dma_init_struct.peripheral_inc_enable = FALSE;
+  dma_init_struct.priority = DMA_PRIORITY_VERY_HIGH;
+  dma_init_struct.loop_mode_enable = FALSE;
+  dma_init(DMA1_CHANNEL4, &dma_init_struct);
+
+  dma_init_struct.direction = DMA_DIR_MEMORY_TO_PERIPHERAL;
+  dma_init_struct.memory_base_addr = (uint32_t)&spif_dummy_tx;
+  dma_init(DMA1_CHANNEL5, &dma_init_struct);
+
+  nvic_irq_enable(DMA1_Channel4_IRQn, SPIF_DMA_IRQ_PRIORITY, 0);
+
+  /* one cycle timer counting microseconds between busy polls, apb1 timers run
+     at the ahb clock */
+  crm_periph_clock_enable(SPIF_POLL_TMR_CLOCK, TRUE);
+  crm_clocks_freq_get(&crm_clocks_freq_struct);
+  tmr_base_init(SPIF_POLL_TMR, SPIF_PROGRAM_POLL_US - 1, (crm_clocks_freq_struct.ahb_freq / 1000000) - 1);
+  tmr_one_cycle_mode_enable(SPIF_POLL_TMR, TRUE);
+  tmr_flag_clear(SPIF_POLL_TMR, TMR_OVF_FLAG);
+  tmr_interrupt_enable(SPIF_POLL_TMR, TMR_OVF_INT, TRUE);
+  nvic_irq_enable(SPIF_POLL_TMR_IRQn, SPIF_DMA_IRQ_PRIORITY, 0);
+}
+
+/**
+  * @brief  write data to flash
+  * @note   only the target range is read. when its bits only have to go from
+  *         1 to 0, the pages that change are programmed in place. otherwise
+  *         the rest of the sector is read, the sector is erased, and the pages
+  *         that are not blank are programmed. erase and programs are queued,
+  *         the next page is prepared while the flash is busy.
+  * @param  pbuffer: the pointer for data buffer
+  * @param  write_addr: the address where the data is written
+  * @param  length: buffer length
+  * @retval none
+  */
+void spiflash_write(uint8_t *pbuffer, uint32_t write_addr, uint32_t length)
+{
+  spiflash_request_type *preq;
+  uint32_t sector_addr, sector_offset, sector_remain;
+  uint32_t index, page, first, last;
+  uint8_t *spiflash_buf = spiflash_sector_buf;
+
+  while(length)
+  {
+    sector_addr = write_addr - (write_addr % SPIF_SECTOR_SIZE);
+    sector_offset = write_addr - sector_addr;
+    sector_remain = SPIF_SECTOR_SIZE - sector_offset;
+    if(length < sector_remain)
+    {
+      sector_remain = length;
+    }
+
+    /* read the target range, queued after the programs of the previous sector */
+    spiflash_read(spiflash_buf + sector_offset, write_addr, sector_remain);
+    for(index = 0; index < sector_remain; index++)
+    {
+      if((spiflash_buf[sector_offset + index] & pbuffer[index]) != pbuffer[index])
+      {
+        /* a bit must go from 0 to 1, this sector needs erased */
+        break;
+      }
+    }
+
+    if(index == sector_remain)
+    {
+      /* program in place the part of each page that changes */
+      for(page = 0; page < sector_remain; page = last)
+      {
+        last = page + SPIF_PAGE_SIZE - ((write_addr + page) % SPIF_PAGE_SIZE);
+        if(last > sector_remain)
+        {
+          last = sector_remain;
+        }
+        for(first = page; first < last && spiflash_buf[sector_offset + first] == pbuffer[first]; first++);
+        for(index = last; index > first && spiflash_buf[sector_offset + index - 1] == pbuffer[index - 1]; index--);
+        if(first < index)
+        {
+          preq = spif_pipe_get();
+          spif_request_fill(preq, SPIF_OP_PAGE_PROGRAM, write_addr + first, pbuffer + first, index - first);
+          spiflash_submit(preq);
+        }
+      }
+    }
+    else
+    {
+      /* keep the rest of the sector */
+      if(sector_offset)
+      {
+        spiflash_read(spiflash_buf, sector_addr, sector_offset);
+      }
+      if(sector_offset + sector_remain < SPIF_SECTOR_SIZE)
+      {
+        spiflash_read(spiflash_buf + sector_offset + sector_remain, write_addr + sector_remain,
+                      SPIF_SECTOR_SIZE - sector_offset - sector_remain);
+      }
+
+      preq = spif_pipe_get();
+      spif_request_fill(preq, SPIF_OP_SECTOR_ERASE, sector_addr, 0, 0);
+      spiflash_submit(preq);
+
+      /* merge the new data while the sector is erased */
+      for(index = 0; index < sector_remain; index++)
+      {
+        spiflash_buf[sector_offset + index] = pbuffer[index];
+      }
+
+      /* blank pages stay erased */
+      for(page = 0; page < SPIF_SECTOR_SIZE; page += SPIF_PAGE_SIZE)
+      {
+        for(index = 0; index < SPIF_PAGE_SIZE && spiflash_buf[page + index] == 0xFF; index++);
+        if(index < SPIF_PAGE_SIZE)
+        {
+          preq = spif_pipe_get();
+          spif_request_fill(preq, SPIF_OP_PAGE_PROGRAM, sector_addr + page, spiflash_buf + page, SPIF_PAGE_SIZE);
+          spiflash_submit(preq);
+        }
+      }
+    }
+
+    pbuffer += sector_remain;
+    write_addr += sector_remain;
+    length -= sector_remain;
+  }
+
+  /* pbuffer is used by the queued programs */
+  spif_pipe_wait();
+}
+
+/**
+  * @brief  read data from flash
+  * @param  pbuffer: the pointer for data buffer
+  * @param  read_addr: the address where the data is read
+  * @param  length: buffer length
+  * @retval none
+  */
+void spiflash_read(uint8_t *pbuffer, uint32_t read_addr, uint32_t length)
+{
+  spiflash_request_type request;
+
+  spif_request_fill(&request, SPIF_OP_READ, read_addr, pbuffer, length);
+  if(spiflash_submit(&request) == SUCCESS)
+  {
+    spiflash_request_wait(&request);
+  }
+}
+
+/**
+  * @brief  erase a sector data
+  * @param  erase_addr: sector address to erase
+  * @retval none
+  */
+void spiflash_sector_erase(uint32_t erase_addr)
+{
+  spiflash_request_type request;
+
+  /* translate sector address to byte address */
+  spif_request_fill(&request, SPIF_OP_SECTOR_ERASE, erase_addr * SPIF_SECTOR_SIZE, 0, 0);
+  if(spiflash_submit(&request) == SUCCESS)
+  {
+    spiflash_request_wait(&request);
+  }
+}
+
+/**
+  * @brief  write data without check
+  * @note   the page programs are queued, the last one is waited for.
+  * @param  pbuffer: the pointer for data buffer
+  * @param  write_addr: the address where the data is written
+  * @param  length: buffer length
+  * @retval none
+  */
+void spiflash_write_nocheck(uint8_t *pbuffer, uint32_t write_addr, uint32_t length)
+{
+  spiflash_request_type *preq;
+  uint32_t page_remain;
+
+  while(length)
+  {
+    /* remain bytes in a page */
+    page_remain = SPIF_PAGE_SIZE - write_addr % SPIF_PAGE_SIZE;
+    if(length < page_remain)
+    {
+      page_remain = length;
+    }
+    preq = spif_pipe_get();
+    spif_request_fill(preq, SPIF_OP_PAGE_PROGRAM, write_addr, pbuffer, page_remain);
+    spiflash_submit(preq);
+
+    pbuffer += page_remain;
+    write_addr += page_remain;
+    length -= page_remain;
+  }
+  spif_pipe_wait();
+}
+
+/**
+  * @brief  write a page data
+  * @param  pbuffer: the pointer for data buffer
+  * @param  write_addr: the address where the data is written
+  * @param  length: buffer length
+  * @retval none
+  */
+void spiflash_page_write(uint8_t *pbuffer, uint32_t write_addr, uint32_t length)
+{
+  spiflash_request_type request;
+
+  spif_request_fill(&request, SPIF_OP_PAGE_PROGRAM, write_addr, pbuffer, length);
+
+  /* returns at once when the length is 0 or crosses the page */
+  if(spiflash_submit(&request) == SUCCESS)
+  {
+    spiflash_request_wait(&request);
+  }
+}
+
+/**
+  * @brief  write data continuously
+  * @param  pbuffer: the pointer for data buffer
+  * @param  length: buffer length
+  * @retval none
+  */
+void spi_bytes_write(uint8_t *pbuffer, uint32_t length)
+{
+  volatile uint8_t dummy_data;
+
+#if defined(SPI_TRANS_DMA)
+  uint16_t count;
+
+  spif_idle_wait();
+  while(length)
+  {
+    count = (length > SPIF_DMA_MAX_LEN) ? SPIF_DMA_MAX_LEN : length;
+    spi_dma_start(pbuffer, TRUE, (uint8_t *)&dummy_data, FALSE, count, FALSE);
+    while(dma_flag_get(DMA1_FDT4_FLAG) == RESET);
+    dma_flag_clear(DMA1_FDT4_FLAG);
+    spi_dma_stop();
+    pbuffer += count;
+    length -= count;
+  }
+#else
+  while(length--)
+  {
+    while(spi_i2s_flag_get(SPI2, SPI_I2S_TDBE_FLAG) == RESET);
+    spi_i2s_data_transmit(SPI2, *pbuffer);
+    while(spi_i2s_flag_get(SPI2, SPI_I2S_RDBF_FLAG) == RESET);
+    dummy_data = spi_i2s_data_receive(SPI2);
+    pbuffer++;
+  }
+#endif
+}
+
+/**
+  * @brief  read data continuously
+  * @param  pbuffer: buffer to save data
+  * @param  length: buffer length
+  * @retval none
+  */
+void spi_bytes_read(uint8_t *pbuffer, uint32_t length)
+{
+  uint8_t write_value = FLASH_SPI_DUMMY_BYTE;
+
+#if defined(SPI_TRANS_DMA)
+  uint16_t count;
+
+  spif_idle_wait();
+  while(length)
+  {
+    count = (length > SPIF_DMA_MAX_LEN) ? SPIF_DMA_MAX_LEN : length;
+    spi_dma_start(&write_value, FALSE, pbuffer, TRUE, count, FALSE);
+    while(dma_flag_get(DMA1_FDT4_FLAG) == RESET);
+    dma_flag_clear(DMA1_FDT4_FLAG);
+    spi_dma_stop();
+    pbuffer += count;
+    length -= count;
+  }
+#else
+  while(length--)
+  {
+    while(spi_i2s_flag_get(SPI2, SPI_I2S_TDBE_FLAG) == RESET);
+    spi_i2s_data_transmit(SPI2, write_value);
+    while(spi_i2s_flag_get(SPI2, SPI_I2S_RDBF_FLAG) == RESET);
+    *pbuffer = spi_i2s_data_receive(SPI2);
+    pbuffer++;
+  }
+#endif
+}
+
+/**
+  * @brief  wait program done
+  * @param  none
+  * @retval none
+  */
+void spiflash_wait_busy(void)
+{
+  while((spiflash_read_sr1() & 0x01) == 0x01);
+}
+
+/**
+  * @brief  read sr1 register
+  * @param  none
+  * @retval none
+  */
+uint8_t spiflash_read_sr1(void)
+{
+  uint8_t breadbyte = 0;
+  FLASH_CS_LOW();
+  spi_byte_write(SPIF_READSTATUSREG1);
+  breadbyte = (uint8_t)spi_byte_read();
+  FLASH_CS_HIGH();
+  return (breadbyte);
+}
+
+/**
+  * @brief  enable write operation
+  * @param  none
+  * @retval none
+  */
+void spiflash_write_enable(void)
+{
+  FLASH_CS_LOW();
+  spi_byte_write(SPIF_WRITEENABLE);
+  FLASH_CS_HIGH();
+}
+
+/**
+  * @brief  read device id
+  * @param  none
+  * @retval device id
+  */
+uint16_t spiflash_read_id(void)
+{
+  uint16_t wreceivedata = 0;
+  FLASH_CS_LOW();
+  spi_byte_write(SPIF_MANUFACTDEVICEID);
+  spi_byte_write(0x00);
+  spi_byte_write(0x00);
+  spi_byte_write(0x00);
+  wreceivedata |= spi_byte_read() << 8;
+  wreceivedata |= spi_byte_read();
+  FLASH_CS_HIGH();
+  return wreceivedata;
+}
+
+/**
+  * @brief  write a byte to flash
+  * @param  data: data to write
+  * @retval flash return data
+  */
+uint8_t spi_byte_write(uint8_t data)
+{
+  uint8_t brxbuff;
+  spif_idle_wait();
+  spi_i2s_dma_transmitter_enable(SPI2, FALSE);
+  spi_i2s_dma_receiver_enable(SPI2, FALSE);
+  spi_i2s_data_transmit(SPI2, data);
+  while(spi_i2s_flag_get(SPI2, SPI_I2S_RDBF_FLAG) == RESET);
+  brxbuff = spi_i2s_data_receive(SPI2);
+  while(spi_i2s_flag_get(SPI2, SPI_I2S_BF_FLAG) != RESET);
+  return brxbuff;
+}
+
+/**
+  * @brief  read a byte to flash
+  * @param  none
+  * @retval flash return data
+  */
+uint8_t spi_byte_read(void)
+{
+  return (spi_byte_write(FLASH_SPI_DUMMY_BYTE));
+}
+
+/**
+  * @brief  queue a request, it starts at once when the bus is free
+  * @note   the request and its buffer must stay valid until its state is
+  *         SPIF_REQ_DONE. may be called from the completion callback.
+  * @param  preq: request, op, address, pbuffer, length, callback and param set
+  * @retval ERROR when a length is 0 or a page program crosses the page
+  */
+error_status spiflash_submit(spiflash_request_type *preq)
+{
+  uint32_t primask;
+
+  if(preq->op > SPIF_OP_WAIT_BUSY ||
+     ((preq->op == SPIF_OP_READ || preq->op == SPIF_OP_PAGE_PROGRAM) && preq->length == 0) ||
+     (preq->op == SPIF_OP_PAGE_PROGRAM && (preq->address % SPIF_PAGE_SIZE) + preq->length > SPIF_PAGE_SIZE))
+  {
+    preq->state = SPIF_REQ_ERROR;
+    return ERROR;
+  }
+
+  preq->next = 0;
+  preq->state = SPIF_REQ_QUEUED;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if(spif_head == 0)
+  {
+    spif_head = preq;
+    spif_tail = preq;
+    spif_request_start();
+  }
+  else
+  {
+    spif_tail->next = preq;
+    spif_tail = preq;
+  }
+  __set_PRIMASK(primask);
+  return SUCCESS;
+}
+
+/**
+  * @brief  check whether requests are queued
+  * @param  none
+  * @retval SET while the driver owns the bus
+  */
+flag_status spiflash_async_busy(void)
+{
+  return (spif_head != 0) ? SET : RESET;
+}
+
+/**
+  * @brief  wait for a request, the dma interrupt must be able to preempt the caller
+  * @param  preq: request given to spiflash_submit
+  * @retval none
+  */
+void spiflash_request_wait(spiflash_request_type *preq)
+{
+  while(preq->state == SPIF_REQ_QUEUED || preq->state == SPIF_REQ_ACTIVE);
+}
+
+/**
+  * @brief  run the request queue, called by DMA1_Channel4_IRQHandler
+  * @param  none
+  * @retval none
+  */
+void spiflash_dma_irq_handler(void)
+{
+  spiflash_request_type *preq = spif_head;
+
+  if(dma_interrupt_flag_get(DMA1_FDT4_FLAG) == RESET)
+  {
+    return;
+  }
+  dma_flag_clear(DMA1_FDT4_FLAG);
+  spi_dma_stop();
+  if(preq == 0)
+  {
+    return;
+  }
+
+  switch(spif_phase)
+  {
+    case SPIF_PHASE_WREN:
+      FLASH_CS_HIGH();
+      spif_phase_start(SPIF_PHASE_CMD);
+      return;
+    case SPIF_PHASE_CMD:
+      if(preq->op != SPIF_OP_SECTOR_ERASE)
+      {
+        spif_phase_start(SPIF_PHASE_DATA);
+        return;
+      }
+      FLASH_CS_HIGH();
+      spif_phase_start(SPIF_PHASE_DELAY);
+      return;
+    case SPIF_PHASE_DATA:
+      if(spif_count < preq->length)
+      {
+        spif_phase_start(SPIF_PHASE_DATA);
+        return;
+      }
+      FLASH_CS_HIGH();
+      if(preq->op == SPIF_OP_PAGE_PROGRAM)
+      {
+        spif_phase_start(SPIF_PHASE_DELAY);
+        return;
+      }
+      break;
+    case SPIF_PHASE_POLL:
+      FLASH_CS_HIGH();
+      if(spif_status[1] & 0x01)
+      {
+        spif_phase_start(SPIF_PHASE_DELAY);
+        return;
+      }
+      break;
+    default:
+      return;
+  }
+
+  /* the request is done, keep the bus busy before calling back */
+  spif_head = preq->next;
+  if(spif_head == 0)
+  {
+    spif_tail = 0;
+  }
+  else
+  {
+    spif_request_start();
+  }
+  preq->state = SPIF_REQ_DONE;
+  if(preq->callback != 0)
+  {
+    preq->callback(preq);
+  }
+}
+
+/**
+  * @brief  start the next busy poll, called by the SPIF_POLL_TMR interrupt handler
+  * @param  none
+  * @retval none
+  */
+void spiflash_tmr_irq_handler(void)
+{
+  if(tmr_interrupt_flag_get(SPIF_POLL_TMR, TMR_OVF_FLAG) == RESET)
+  {
+    return;
+  }
+  tmr_flag_clear(SPIF_POLL_TMR, TMR_OVF_FLAG);
+  if(spif_head != 0 && spif_phase == SPIF_PHASE_DELAY)
+  {
+    spif_phase_start(SPIF_PHASE_POLL);
+  }
+}
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
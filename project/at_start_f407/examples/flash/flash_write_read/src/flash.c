@@ -33,9 +33,10 @@
   * @{
   */
 
-#define SECTOR_SIZE                      2048   /* this parameter depends on the specific model of the chip */
-
-uint16_t flash_buf[SECTOR_SIZE / 2];
+/* one sector per bank, flash_buffer_write erases a sector of bank1 and one of
+   bank2 at the same time when the range crosses FLASH_BANK1_END_ADDR */
+uint32_t flash_buf[2 * FLASH_WRITE_SECTOR_SIZE / 4];
+flash_write_stats_type flash_write_stats;
 
 /**
   * @brief  read data using halfword mode
@@ -77,6 +78,10 @@ error_status flash_write_nocheck(uint32_t write_addr, uint16_t *p_buffer, uint16
 
 /**
   * @brief  write data using halfword mode with checking
+  * @note   only the words that change are programmed, a sector is erased only
+  *         when a programmed word has to change. write_addr must be halfword
+  *         aligned, a halfword head or tail is merged with the flash content
+  *         into a word. flash_write_stats covers the words in between.
   * @param  write_addr: the address of writing
   * @param  p_buffer: the buffer of writing data
   * @param  num_write: the number of writing data
@@ -84,73 +89,36 @@ error_status flash_write_nocheck(uint32_t write_addr, uint16_t *p_buffer, uint16
   */
 error_status flash_write(uint32_t write_addr, uint16_t *p_buffer, uint16_t num_write)
 {
-  uint32_t offset_addr;
-  uint32_t sector_position;
-  uint16_t sector_offset;
-  uint16_t sector_remain;
-  uint16_t i;
   flash_status_type status = FLASH_OPERATE_DONE;
- 
+  uint32_t word;
+
+  if(write_addr & 1)
+    return ERROR;
+
   flash_unlock();
-  offset_addr = write_addr - FLASH_BASE;
-  sector_position = offset_addr / SECTOR_SIZE;
-  sector_offset = (offset_addr % SECTOR_SIZE) / 2;
-  sector_remain = SECTOR_SIZE / 2 - sector_offset;
-  if(num_write <= sector_remain)
-    sector_remain = num_write;
-  while(1)
+  if((write_addr & 2) && num_write)
   {
-    flash_read(sector_position * SECTOR_SIZE + FLASH_BASE, flash_buf, SECTOR_SIZE / 2);
-    for(i = 0; i < sector_remain; i++)
-    {
-      if(flash_buf[sector_offset + i] != 0xFFFF)
-        break;
-    }
-    if(i < sector_remain)
-    {
-      /* wait for operation to be completed */
-      status = flash_operation_wait_for(ERASE_TIMEOUT);
-     
-      if((status == FLASH_PROGRAM_ERROR) || (status == FLASH_EPP_ERROR))
-        flash_flag_clear(FLASH_PRGMERR_FLAG | FLASH_EPPERR_FLAG);
-      else if(status == FLASH_OPERATE_TIMEOUT)
-        return ERROR;
-      status = flash_sector_erase(sector_position * SECTOR_SIZE + FLASH_BASE);
-      if(status != FLASH_OPERATE_DONE)
-        return ERROR;
-      for(i = 0; i < sector_remain; i++)
-      {
-        flash_buf[i + sector_offset] = p_buffer[i];
-      }
-      if(flash_write_nocheck(sector_position * SECTOR_SIZE + FLASH_BASE, flash_buf, SECTOR_SIZE / 2) != SUCCESS)
-        return ERROR;
-    }
-    else
-    {
-      if(flash_write_nocheck(write_addr, p_buffer, sector_remain) != SUCCESS)
-        return ERROR;
-    }
-    if(num_write == sector_remain)
-      break;
-    else
-    {
-      sector_position++;
-      sector_offset = 0;
-      p_buffer += sector_remain;
-      write_addr += (sector_remain * 2);
-      num_write -= sector_remain;
-      if(num_write > (SECTOR_SIZE / 2))
-        sector_remain = SECTOR_SIZE / 2;
-      else
-        sector_remain = num_write;
-    }
+    word = (*(uint32_t *)(write_addr - 2) & 0x0000FFFF) | ((uint32_t)p_buffer[0] << 16);
+    status = flash_buffer_write(write_addr - 2, (uint8_t *)&word, 4, flash_buf, 0);
+    write_addr += 2;
+    p_buffer++;
+    num_write--;
+  }
+  if(status == FLASH_OPERATE_DONE)
+    status = flash_buffer_write(write_addr, (uint8_t *)p_buffer, (num_write & ~1) * 2, flash_buf, &flash_write_stats);
+  if((status == FLASH_OPERATE_DONE) && (num_write & 1))
+  {
+    write_addr += (num_write & ~1) * 2;
+    word = (*(uint32_t *)write_addr & 0xFFFF0000) | p_buffer[num_write - 1];
+    status = flash_buffer_write(write_addr, (uint8_t *)&word, 4, flash_buf, 0);
   }
   flash_lock();
+  if(status != FLASH_OPERATE_DONE)
+    return ERROR;
   return SUCCESS;
 }
 
 
-
 /**
   * @}
   */
@@ -39,6 +39,7 @@
 
 uint16_t buffer_write[TEST_BUFEER_SIZE];
 uint16_t buffer_read[TEST_BUFEER_SIZE];
+uint32_t write_speed = 0; /* bytes per second of the last flash_write */
 
 error_status buffer_compare(uint16_t* p_buffer1, uint16_t* p_buffer2, uint16_t buffer_length);
 
@@ -74,6 +75,11 @@ int main(void)
   error_status err_status;
   system_clock_config();
   at32_board_init();
+
+  /* enable the cycle counter used by the write statistics */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
   /* fill buffer_write data to test */
   for(index = 0; index < TEST_BUFEER_SIZE; index++)
   {
@@ -82,6 +88,10 @@ int main(void)
 
   /* write data to flash */
   err_status = flash_write(TEST_FLASH_ADDRESS_START, buffer_write, TEST_BUFEER_SIZE);
+  if(flash_write_stats.cycles)
+  {
+    write_speed = (uint32_t)((uint64_t)flash_write_stats.bytes * system_core_clock / flash_write_stats.cycles);
+  }
 
   /* read data from flash */
   flash_read(TEST_FLASH_ADDRESS_START, buffer_read, TEST_BUFEER_SIZE);
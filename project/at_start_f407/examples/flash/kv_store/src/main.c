@@ -0,0 +1,142 @@
+/**
+  **************************************************************************
+  * @file     main.c
+  * @brief    main program
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+
+#include "at32f403a_407_board.h"
+#include "at32f403a_407_clock.h"
+#include "kv_store_port.h"
+
+/** @addtogroup AT32F407_periph_examples
+  * @{
+  */
+
+/** @addtogroup 407_FLASH_kv_store FLASH_kv_store
+  * @{
+  */
+
+#define KEY_BOOT_COUNT                   1
+#define KEY_PRESS_COUNT                  2
+#define KEY_SETTINGS                     3
+
+typedef struct
+{
+  uint32_t                               baudrate;
+  uint16_t                               blink_ms;
+  uint16_t                               reserved;
+} settings_type;
+
+kv_store_type kv;
+settings_type settings;
+uint32_t boot_count = 0;
+uint32_t press_count = 0;
+
+/**
+  * @brief  read a counter, 0 when it is not stored yet.
+  * @param  key: key of the counter
+  * @retval counter
+  */
+static uint32_t counter_get(uint16_t key)
+{
+  uint32_t value = 0;
+
+  kv_get(&kv, key, &value, sizeof(value), 0);
+  return value;
+}
+
+/**
+  * @brief  main function.
+  * @param  none
+  * @retval none
+  */
+int main(void)
+{
+  kv_status_type status;
+  uint32_t tick = 0;
+
+  system_clock_config();
+  at32_board_init();
+  uart_print_init(115200);
+
+  /* mount the store, a store that cannot be mounted is formatted */
+  status = kv_init(&kv, &kv_port_config);
+  if(status == KV_ERR_FLASH)
+  {
+    status = kv_format(&kv);
+  }
+  if(status != KV_OK)
+  {
+    at32_led_on(LED4);
+    while(1);
+  }
+
+  /* the boot count and the default settings go in one batch */
+  boot_count = counter_get(KEY_BOOT_COUNT) + 1;
+  press_count = counter_get(KEY_PRESS_COUNT);
+  kv_set(&kv, KEY_BOOT_COUNT, &boot_count, sizeof(boot_count));
+  if(kv_get(&kv, KEY_SETTINGS, &settings, sizeof(settings), 0) != KV_OK)
+  {
+    settings.baudrate = 115200;
+    settings.blink_ms = 500;
+    settings.reserved = 0;
+    kv_set(&kv, KEY_SETTINGS, &settings, sizeof(settings));
+  }
+  status = kv_commit(&kv);
+
+  printf("kv store: boot %u, button pressed %u times, mount read %u bytes, commit %s\r\n",
+         (unsigned)boot_count, (unsigned)press_count, (unsigned)kv.mount_scan_bytes,
+         (status == KV_OK) ? "ok" : "failed");
+  at32_led_on((status == KV_OK) ? LED2 : LED4);
+
+  while(1)
+  {
+    if(at32_button_press() == USER_BUTTON)
+    {
+      /* a power cut at any time keeps the last committed count */
+      press_count ++;
+      kv_set(&kv, KEY_PRESS_COUNT, &press_count, sizeof(press_count));
+      status = kv_commit(&kv);
+      printf("button pressed %u times, %u sector erases, %u compactions, commit %s\r\n",
+             (unsigned)press_count, (unsigned)kv.erase_count, (unsigned)kv.compact_count,
+             (status == KV_OK) ? "ok" : "failed");
+      if(status != KV_OK)
+      {
+        at32_led_on(LED4);
+      }
+    }
+    delay_ms(10);
+    if(++ tick >= settings.blink_ms / 10)
+    {
+      tick = 0;
+      at32_led_toggle(LED3);
+    }
+  }
+}
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
@@ -25,7 +25,9 @@
 #include "at32f403a_407_board.h"
 #include "at32f403a_407_clock.h"
 #include "run_in_spim.h"
-
+#include "spim_profile.h"
+#include "spim_program.h"
+#include <stdio.h>
 
 /** @addtogroup AT32F407_periph_examples
   * @{
@@ -35,6 +37,56 @@
   * @{
   */
 
+#define SPIM_TEST_ADDR                   0x08500000 /*!< past the code in the spim */
+#define SPIM_TEST_SIZE                   0x10000
+
+uint32_t checksum_data[CHECKSUM_WORDS];
+spim_program_stats_type spim_program_stats;
+
+/**
+  * @brief  benchmark loop running from sram
+  * @param  pdata: words to mix
+  * @param  count: number of words
+  * @retval checksum
+  */
+RAM_CODE uint32_t sram_checksum(const uint32_t *pdata, uint32_t count)
+{
+  uint32_t sum = 0;
+
+  CHECKSUM_LOOP(pdata, count, sum);
+  return sum;
+}
+
+/**
+  * @brief  benchmark loop running from the internal flash
+  * @param  pdata: words to mix
+  * @param  count: number of words
+  * @retval checksum
+  */
+uint32_t flash_checksum(const uint32_t *pdata, uint32_t count)
+{
+  uint32_t sum = 0;
+
+  CHECKSUM_LOOP(pdata, count, sum);
+  return sum;
+}
+
+/**
+  * @brief  time CHECKSUM_ROUNDS runs of a benchmark loop
+  * @param  checksum: benchmark loop
+  * @retval cycles per run
+  */
+uint32_t checksum_cycles(uint32_t (*checksum)(const uint32_t *, uint32_t))
+{
+  uint32_t start = DWT->CYCCNT, i;
+
+  for(i = 0; i < CHECKSUM_ROUNDS; i++)
+  {
+    checksum(checksum_data, CHECKSUM_WORDS);
+  }
+  return (DWT->CYCCNT - start) / CHECKSUM_ROUNDS;
+}
+
 /**
   * @brief  init the spim flash
   * @param  none
@@ -84,12 +136,41 @@ void spim_init(void)
   */
 int main(void)
 {
+  uint32_t i;
+
   system_clock_config();
   at32_board_init();
 
+  uart_print_init(115200);
+
   /* configures the spim flash */
   spim_init();
 
+  for(i = 0; i < CHECKSUM_WORDS; i++)
+  {
+    checksum_data[i] = i;
+  }
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  /* the same loop from each memory */
+  printf("checksum of %u words: spim %u, flash %u, sram %u cycles\r\n", CHECKSUM_WORDS,
+         (unsigned)checksum_cycles(spim_checksum), (unsigned)checksum_cycles(flash_checksum),
+         (unsigned)checksum_cycles(sram_checksum));
+
+  /* sample where the time goes, the hottest spim bins are the functions to
+     move to sram */
+  spim_profile_start();
+  checksum_cycles(spim_checksum);
+  checksum_cycles(sram_checksum);
+  spim_profile_stop();
+  spim_profile_report(8);
+
+  /* bulk program a copy of the internal flash image */
+  spim_program(SPIM_TEST_ADDR, (const uint8_t *)FLASH_BANK1_START_ADDR, SPIM_TEST_SIZE, &spim_program_stats);
+  spim_program_report(&spim_program_stats);
+
   /* check the led toggle in spim */
   spim_run();
 
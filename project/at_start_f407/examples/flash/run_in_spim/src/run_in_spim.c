@@ -35,6 +35,20 @@
   */
 
 
+/**
+  * @brief  benchmark loop running from the spim
+  * @param  pdata: words to mix
+  * @param  count: number of words
+  * @retval checksum
+  */
+uint32_t spim_checksum(const uint32_t *pdata, uint32_t count)
+{
+  uint32_t sum = 0;
+
+  CHECKSUM_LOOP(pdata, count, sum);
+  return sum;
+}
+
 /**
   * @brief  check the led toggle in spim
   * @param  none
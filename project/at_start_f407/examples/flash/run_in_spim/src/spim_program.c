@@ -0,0 +1,157 @@
+/**
+  **************************************************************************
+  * @file     spim_program.c
+  * @brief    bulk spim programming with throughput report
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+
+#include "spim_program.h"
+#include <stdio.h>
+
+/** @addtogroup AT32F407_periph_examples
+  * @{
+  */
+
+/** @addtogroup 407_FLASH_run_in_spim
+  * @{
+  */
+
+/**
+  * @brief  check whether a spim sector is erased.
+  * @param  address: sector address
+  * @retval 1 when every word reads 0xffffffff
+  */
+static uint32_t spim_sector_blank(uint32_t address)
+{
+  uint32_t i;
+
+  for(i = 0; i < SPIM_SECTOR_SIZE; i += 4)
+  {
+    if(*(__IO uint32_t *)(address + i) != 0xFFFFFFFF)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+  * @brief  erase and program a range of the spim flash.
+  * @param  address: sector aligned spim address
+  * @param  buf: data
+  * @param  length: data length, an odd tail is padded with 0xff
+  * @param  stats: filled with the counters and the time of both steps
+  * @retval status: FLASH_OPERATE_DONE or the error of the failing step
+  */
+flash_status_type spim_program(uint32_t address, const uint8_t *buf, uint32_t length,
+                               spim_program_stats_type *stats)
+{
+  flash_status_type status = FLASH_OPERATE_DONE;
+  uint32_t sector, offset, chunk, word, start;
+
+  stats->bytes = length;
+  stats->sectors_erased = 0;
+  stats->sectors_skipped = 0;
+  stats->erase_cycles = 0;
+  stats->program_cycles = 0;
+  stats->program_speed = 0;
+
+  if(address < FLASH_SPIM_START_ADDR || (address % SPIM_SECTOR_SIZE))
+  {
+    return FLASH_PROGRAM_ERROR;
+  }
+
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  /* erase the sectors that are not blank already */
+  start = DWT->CYCCNT;
+  for(sector = address; sector < address + length; sector += SPIM_SECTOR_SIZE)
+  {
+    if(spim_sector_blank(sector))
+    {
+      stats->sectors_skipped ++;
+      continue;
+    }
+    status = flash_sector_erase(sector);
+    if(status != FLASH_OPERATE_DONE)
+    {
+      return status;
+    }
+    stats->sectors_erased ++;
+  }
+  stats->erase_cycles = DWT->CYCCNT - start;
+
+  /* whole words a sector at a time, the tail word is padded */
+  start = DWT->CYCCNT;
+  for(offset = 0; offset < (length & ~3u); offset += chunk)
+  {
+    chunk = (length & ~3u) - offset;
+    if(chunk > SPIM_SECTOR_SIZE)
+    {
+      chunk = SPIM_SECTOR_SIZE;
+    }
+    status = flash_spim_mass_program(address + offset, (uint8_t *)buf + offset, chunk);
+    if(status != FLASH_OPERATE_DONE)
+    {
+      return status;
+    }
+  }
+  if(length & 3)
+  {
+    word = 0xFFFFFFFF;
+    for(chunk = 0; chunk < (length & 3); chunk ++)
+    {
+      ((uint8_t *)&word)[chunk] = buf[offset + chunk];
+    }
+    status = flash_word_program(address + offset, word);
+  }
+  stats->program_cycles = DWT->CYCCNT - start;
+
+  if(stats->program_cycles)
+  {
+    stats->program_speed = (uint32_t)((uint64_t)length * system_core_clock / stats->program_cycles);
+  }
+  return status;
+}
+
+/**
+  * @brief  print the result of spim_program.
+  * @param  stats: spim_program counters
+  * @retval none
+  */
+void spim_program_report(spim_program_stats_type *stats)
+{
+  uint32_t cycles_per_ms = system_core_clock / 1000;
+
+  printf("spim program %u bytes: %u sectors erased (%u blank) in %u ms, programmed in %u ms, %u kb/s\r\n",
+         (unsigned)stats->bytes, (unsigned)stats->sectors_erased, (unsigned)stats->sectors_skipped,
+         (unsigned)(stats->erase_cycles / cycles_per_ms), (unsigned)(stats->program_cycles / cycles_per_ms),
+         (unsigned)(stats->program_speed / 1024));
+}
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
@@ -0,0 +1,298 @@
+/**
+  **************************************************************************
+  * @file     main.c
+  * @brief    main program
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+#include "at32f403a_407_board.h"
+#include "at32f403a_407_clock.h"
+#include "i2c_application.h"
+
+/** @addtogroup AT32F407_periph_examples
+  * @{
+  */
+
+/** @addtogroup 407_I2C_queue I2C_queue
+  * @{
+  */
+
+#define I2C_TIMEOUT                      10000      /* us */
+
+#define I2Cx_SPEED                       100000
+#define I2Cx_ADDRESS                     0xA0
+
+#define I2Cx_PORT                        I2C2
+#define I2Cx_CLK                         CRM_I2C2_PERIPH_CLOCK
+
+#define I2Cx_SCL_PIN                     GPIO_PINS_10
+#define I2Cx_SCL_GPIO_PORT               GPIOB
+#define I2Cx_SCL_GPIO_CLK                CRM_GPIOB_PERIPH_CLOCK
+
+#define I2Cx_SDA_PIN                     GPIO_PINS_11
+#define I2Cx_SDA_GPIO_PORT               GPIOB
+#define I2Cx_SDA_GPIO_CLK                CRM_GPIOB_PERIPH_CLOCK
+
+#define I2Cx_DMA_CLK                     CRM_DMA1_PERIPH_CLOCK
+#define I2Cx_DMA_TX_CHANNEL              DMA1_CHANNEL4
+#define I2Cx_DMA_TX_IRQn                 DMA1_Channel4_IRQn
+
+#define I2Cx_DMA_RX_CHANNEL              DMA1_CHANNEL5
+#define I2Cx_DMA_RX_IRQn                 DMA1_Channel5_IRQn
+
+#define I2Cx_EVT_IRQn                    I2C2_EVT_IRQn
+#define I2Cx_ERR_IRQn                    I2C2_ERR_IRQn
+
+#define BUF_SIZE                         8
+#define READ_NUM                         3
+#define LOOPS_MAX                        1000000
+
+uint8_t tx_buf[BUF_SIZE] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08};
+uint8_t rx_buf[READ_NUM][BUF_SIZE] = {0};
+
+/* memory address and size of each read, the first one is read by dma */
+const uint16_t read_address[READ_NUM] = {0x00, 0x02, 0x07};
+const uint16_t read_size[READ_NUM] = {BUF_SIZE, 2, 1};
+
+i2c_handle_type hi2cx;
+i2c_transaction_type write_trans;
+i2c_transaction_type read_trans[READ_NUM];
+__IO uint32_t read_done;
+
+void error_handler(uint32_t error_code);
+uint32_t buffer_compare(uint8_t* buffer1, uint8_t* buffer2, uint32_t len);
+void i2c_lowlevel_init(i2c_handle_type* hi2c);
+void read_complete(i2c_transaction_type* ptrans);
+
+/**
+  * @brief  error handler program
+  * @param  i2c_status
+  * @retval none
+  */
+void error_handler(uint32_t error_code)
+{
+  while(1)
+  {
+    at32_led_toggle(LED2);
+    delay_ms(500);
+  }
+}
+
+/**
+  * @brief  compare whether the valus of buffer 1 and buffer 2 are equal.
+  * @param  buffer1: buffer 1 address.
+            buffer2: buffer 2 address.
+  * @retval 0: equal.
+  *         1: unequal.
+  */
+uint32_t buffer_compare(uint8_t* buffer1, uint8_t* buffer2, uint32_t len)
+{
+  uint32_t i;
+
+  for(i = 0; i < len; i++)
+  {
+    if(buffer1[i] != buffer2[i])
+    {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+  * @brief  read transaction complete, called from the i2c or dma interrupt.
+  * @param  ptrans: the transaction.
+  * @retval none
+  */
+void read_complete(i2c_transaction_type* ptrans)
+{
+  read_done++;
+}
+
+/**
+  * @brief  initializes peripherals used by the i2c.
+  * @param  none
+  * @retval none
+  */
+void i2c_lowlevel_init(i2c_handle_type* hi2c)
+{
+  gpio_init_type gpio_initstructure;
+
+  if(hi2c->i2cx == I2Cx_PORT)
+  {
+    /* i2c periph clock enable */
+    crm_periph_clock_enable(I2Cx_CLK, TRUE);
+    crm_periph_clock_enable(I2Cx_SCL_GPIO_CLK, TRUE);
+    crm_periph_clock_enable(I2Cx_SDA_GPIO_CLK, TRUE);
+
+    /* gpio configuration */
+    gpio_initstructure.gpio_out_type       = GPIO_OUTPUT_OPEN_DRAIN;
+    gpio_initstructure.gpio_pull           = GPIO_PULL_UP;
+    gpio_initstructure.gpio_mode           = GPIO_MODE_MUX;
+    gpio_initstructure.gpio_drive_strength = GPIO_DRIVE_STRENGTH_MODERATE;
+
+    /* configure i2c pins: scl */
+    gpio_initstructure.gpio_pins = I2Cx_SCL_PIN;
+    gpio_init(I2Cx_SCL_GPIO_PORT, &gpio_initstructure);
+
+    /* configure i2c pins: sda */
+    gpio_initstructure.gpio_pins = I2Cx_SDA_PIN;
+    gpio_init(I2Cx_SDA_GPIO_PORT, &gpio_initstructure);
+
+    /* configure and enable i2c dma channel interrupt */
+    nvic_irq_enable(I2Cx_DMA_TX_IRQn, 0, 0);
+    nvic_irq_enable(I2Cx_DMA_RX_IRQn, 0, 0);
+
+    /* configure and enable i2c interrupt */
+    nvic_irq_enable(I2Cx_EVT_IRQn, 0, 0);
+    nvic_irq_enable(I2Cx_ERR_IRQn, 0, 0);
+
+    /* i2c dma tx and rx channels configuration */
+    /* enable the dma clock */
+    crm_periph_clock_enable(I2Cx_DMA_CLK, TRUE);
+
+    /* i2c dma channel configuration */
+    dma_reset(hi2c->dma_tx_channel);
+    dma_reset(hi2c->dma_rx_channel);
+
+    hi2c->dma_tx_channel = I2Cx_DMA_TX_CHANNEL;
+    hi2c->dma_rx_channel = I2Cx_DMA_RX_CHANNEL;
+
+    dma_default_para_init(&hi2c->dma_init_struct);
+    hi2c->dma_init_struct.peripheral_inc_enable    = FALSE;
+    hi2c->dma_init_struct.memory_inc_enable        = TRUE;
+    hi2c->dma_init_struct.peripheral_data_width    = DMA_PERIPHERAL_DATA_WIDTH_BYTE;
+    hi2c->dma_init_struct.memory_data_width        = DMA_MEMORY_DATA_WIDTH_BYTE;
+    hi2c->dma_init_struct.loop_mode_enable         = FALSE;
+    hi2c->dma_init_struct.priority                 = DMA_PRIORITY_LOW;
+    hi2c->dma_init_struct.direction                = DMA_DIR_MEMORY_TO_PERIPHERAL;
+
+    dma_init(hi2c->dma_tx_channel, &hi2c->dma_init_struct);
+    dma_init(hi2c->dma_rx_channel, &hi2c->dma_init_struct);
+
+    i2c_init(hi2c->i2cx, I2C_FSMODE_DUTY_2_1, I2Cx_SPEED);
+
+    i2c_own_address1_set(hi2c->i2cx, I2C_ADDRESS_MODE_7BIT, I2Cx_ADDRESS);
+
+    /* pins driven by i2c_bus_recover when a slave holds the bus */
+    hi2c->scl_gpio = I2Cx_SCL_GPIO_PORT;
+    hi2c->scl_pin  = I2Cx_SCL_PIN;
+    hi2c->sda_gpio = I2Cx_SDA_GPIO_PORT;
+    hi2c->sda_pin  = I2Cx_SDA_PIN;
+  }
+}
+
+/**
+  * @brief  main function.
+  * @param  none
+  * @retval none
+  */
+int main(void)
+{
+  i2c_status_type i2c_status;
+  uint32_t i, loops;
+
+  /* config nvic priority group */
+  nvic_priority_group_config(NVIC_PRIORITY_GROUP_4);
+
+  system_clock_config();
+
+  at32_board_init();
+
+  uart_print_init(115200);
+
+  hi2cx.i2cx = I2Cx_PORT;
+
+  i2c_config(&hi2cx);
+
+  for(i = 0; i < READ_NUM; i++)
+  {
+    read_trans[i].callback = read_complete;
+  }
+
+  while(1)
+  {
+    /* wait for key USER_BUTTON press before starting the communication */
+    while(at32_button_press() != USER_BUTTON)
+    {
+    }
+
+    /* write data to memory device */
+    i2c_transaction_memory_write(&write_trans, I2C_MEM_ADDR_WIDIH_8, I2Cx_ADDRESS, 0x00, tx_buf, BUF_SIZE);
+
+    i2c_queue_submit(&hi2cx, &write_trans);
+
+    /* wait for the communication to end */
+    if((i2c_status = i2c_transaction_wait(&hi2cx, &write_trans, I2C_TIMEOUT)) != I2C_OK)
+    {
+      error_handler(i2c_status);
+    }
+
+    delay_ms(5);
+
+    /* queue the reads at once, each one is started by the end of the previous one */
+    read_done = 0;
+
+    for(i = 0; i < READ_NUM; i++)
+    {
+      i2c_transaction_memory_read(&read_trans[i], I2C_MEM_ADDR_WIDIH_8, I2Cx_ADDRESS, read_address[i], rx_buf[i], read_size[i]);
+
+      i2c_queue_submit(&hi2cx, &read_trans[i]);
+    }
+
+    /* the cpu is free while the reads run */
+    loops = 0;
+
+    while((read_done < READ_NUM) && (loops < LOOPS_MAX))
+    {
+      loops++;
+    }
+
+    /* a stuck read ends with a timeout error after the bus is recovered */
+    i2c_transaction_wait(&hi2cx, &read_trans[READ_NUM - 1], I2C_TIMEOUT);
+
+    printf("%d reads done, %d loops run meanwhile\r\n", READ_NUM, loops);
+    printf("errors %d, timeouts %d, recoveries %d\r\n", hi2cx.error_count, hi2cx.timeout_count, hi2cx.recovery_count);
+
+    for(i = 0; i < READ_NUM; i++)
+    {
+      if(read_trans[i].status != I2C_OK)
+      {
+        error_handler(read_trans[i].status);
+      }
+
+      if(buffer_compare(&tx_buf[read_address[i]], rx_buf[i], read_size[i]) != 0)
+      {
+        error_handler(i2c_status);
+      }
+    }
+
+    at32_led_on(LED3);
+  }
+}
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
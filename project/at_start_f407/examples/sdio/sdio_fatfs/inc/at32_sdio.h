@@ -48,6 +48,14 @@ extern "C" {
 
 #define SDIOx                            SDIO1
 
+/* the cmd13 polls while the card programs a write are paced by this timer */
+#define SD_BUSY_TMR                      TMR7
+#define SD_BUSY_TMR_CLOCK                CRM_TMR7_PERIPH_CLOCK
+#define SD_BUSY_TMR_IRQn                 TMR7_GLOBAL_IRQn
+#define SD_BUSY_TMR_IRQHandler           TMR7_GLOBAL_IRQHandler
+#define SD_BUSY_POLL_US                  200 /* interval between two cmd13 */
+#define SD_BUSY_TIMEOUT_MS               500 /* longest write busy of sdxc cards */
+
 /**
   * @}
   */
@@ -503,6 +511,7 @@ sd_error_status_type sd_mult_blocks_write(const uint8_t *buf, long long addr, ui
 sd_error_status_type mmc_stream_read(uint8_t *buf, long long addr, uint32_t len);
 sd_error_status_type mmc_stream_write(uint8_t *buf, long long addr, uint32_t len);
 sd_error_status_type sd_irq_service(void);
+sd_error_status_type sd_busy_wait(void);
 void sd_dma_config(uint32_t *mbuf, uint32_t buf_size, dma_dir_type dir);
 
 /**
@@ -19,10 +19,52 @@
 #define DEV_MMC    1  /* Example: Map MMC/SD card to physical drive 1 */
 #define DEV_USB    2  /* Example: Map USB MSD to physical drive 2 */
 
-__align(4) uint8_t sdio_data_buffer[512]; /* buf for sd_read_disk/sd_write_disk function used. */
+/* sectors of the bounce buffer, an unaligned request is moved by one
+   multi-block command per SD_BOUNCE_BLOCKS sectors */
+#ifndef SD_BOUNCE_BLOCKS
+#define SD_BOUNCE_BLOCKS    8
+#endif
+
+/* sectors held by the cache of single sector reads, fat and directory
+   sectors mostly */
+#ifndef SD_CACHE_LINES
+#define SD_CACHE_LINES      16
+#endif
+
+/* sectors read by one cmd18 on a miss following the previous read, 1 turns
+   the read-ahead off */
+#ifndef SD_READ_AHEAD
+#define SD_READ_AHEAD       SD_BOUNCE_BLOCKS
+#endif
 
-sd_error_status_type sd_read_disk(uint8_t *buf, uint32_t sector, uint8_t cnt);
-sd_error_status_type sd_write_disk(const uint8_t *buf, uint32_t sector, uint8_t cnt);
+#if (SD_READ_AHEAD > SD_BOUNCE_BLOCKS) || (SD_READ_AHEAD > SD_CACHE_LINES)
+#error "SD_READ_AHEAD is larger than the bounce buffer or the cache"
+#endif
+
+typedef struct
+{
+  uint32_t sector;
+  uint32_t stamp;   /* last use, the oldest line is replaced */
+  uint8_t  valid;
+  uint8_t  hot;     /* asked for, lines only read ahead are replaced first */
+} sd_cache_line_type;
+
+__align(4) uint8_t sdio_data_buffer[512 * SD_BOUNCE_BLOCKS]; /* buf for sd_read_disk/sd_write_disk function used. */
+__align(4) uint8_t sd_cache_data[SD_CACHE_LINES][512];
+sd_cache_line_type sd_cache_line[SD_CACHE_LINES];
+uint32_t sd_cache_clock = 0;
+uint32_t sd_cache_next = 0xFFFFFFFF; /* sector following the previous read */
+
+/* statistics */
+uint32_t sd_cache_hits = 0;
+uint32_t sd_cache_misses = 0;
+uint32_t sd_cache_prefetches = 0; /* sectors read ahead */
+
+sd_error_status_type sd_read_disk(uint8_t *buf, uint32_t sector, uint32_t cnt);
+sd_error_status_type sd_write_disk(const uint8_t *buf, uint32_t sector, uint32_t cnt);
+void sd_cache_invalidate(uint32_t sector, uint32_t cnt);
+void sd_cache_fill(uint32_t sector, const uint8_t *data, uint8_t hot);
+sd_error_status_type sd_cache_read(uint8_t *buf, uint32_t sector, uint32_t cnt);
 
 /**
   * @brief  read sd card sector
@@ -31,22 +73,34 @@ sd_error_status_type sd_write_disk(const uint8_t *buf, uint32_t sector, uint8_t
   * @param  cnt: sector count
   * @retval sd_error_status_type: sd card error code.
   */
-sd_error_status_type sd_read_disk(uint8_t *buf, uint32_t sector, uint8_t cnt)
+sd_error_status_type sd_read_disk(uint8_t *buf, uint32_t sector, uint32_t cnt)
 {
   sd_error_status_type sta = SD_OK;
   long long lsector = sector;
-  uint8_t n;
+  uint32_t n;
 
   /* data address is in block (512 byte) units. */
   lsector <<= 9;
 
   if((uint32_t)buf % 4 != 0)
   {
-    for(n = 0; n < cnt; n++)
+    while((cnt > 0) && (sta == SD_OK))
     {
-      sta = sd_block_read(sdio_data_buffer, lsector + 512 * n, 512);
-      memcpy(buf, sdio_data_buffer, 512);
-      buf += 512;
+      n = (cnt > SD_BOUNCE_BLOCKS) ? SD_BOUNCE_BLOCKS : cnt;
+
+      if(n == 1)
+      {
+        sta = sd_block_read(sdio_data_buffer, lsector, 512);
+      }
+      else
+      {
+        sta = sd_mult_blocks_read(sdio_data_buffer, lsector, 512, n);
+      }
+
+      memcpy(buf, sdio_data_buffer, 512 * n);
+      buf += 512 * n;
+      lsector += 512 * n;
+      cnt -= n;
     }
   }
   else
@@ -71,22 +125,36 @@ sd_error_status_type sd_read_disk(uint8_t *buf, uint32_t sector, uint8_t cnt)
   * @param  cnt: sector count
   * @retval sd_error_status_type: sd card error code.
   */
-sd_error_status_type sd_write_disk(const uint8_t *buf, uint32_t sector, uint8_t cnt)
+sd_error_status_type sd_write_disk(const uint8_t *buf, uint32_t sector, uint32_t cnt)
 {
   sd_error_status_type sta = SD_OK;
-  uint8_t n;
   long long lsector = sector;
+  uint32_t n;
 
   /* data address is in block (512 byte) units. */
   lsector <<= 9;
 
   if((uint32_t)buf % 4 != 0)
   {
-    for(n = 0; n < cnt; n++)
+    while((cnt > 0) && (sta == SD_OK))
     {
-      memcpy(sdio_data_buffer, buf, 512);
-      sta = sd_block_write(sdio_data_buffer, lsector + 512*n, 512);
-      buf += 512;
+      n = (cnt > SD_BOUNCE_BLOCKS) ? SD_BOUNCE_BLOCKS : cnt;
+
+      /* the card programs the previous batch meanwhile, its dma is over */
+      memcpy(sdio_data_buffer, buf, 512 * n);
+
+      if(n == 1)
+      {
+        sta = sd_block_write(sdio_data_buffer, lsector, 512);
+      }
+      else
+      {
+        sta = sd_mult_blocks_write(sdio_data_buffer, lsector, 512, n);
+      }
+
+      buf += 512 * n;
+      lsector += 512 * n;
+      cnt -= n;
     }
   }
   else
@@ -104,6 +172,149 @@ sd_error_status_type sd_write_disk(const uint8_t *buf, uint32_t sector, uint8_t
   return sta;
 }
 
+/**
+  * @brief  drop the cached copies of sectors
+  * @param  sector: first sector
+  * @param  cnt: sector count, 0 drops every line
+  * @retval none
+  */
+void sd_cache_invalidate(uint32_t sector, uint32_t cnt)
+{
+  uint32_t i;
+
+  for(i = 0; i < SD_CACHE_LINES; i++)
+  {
+    if((cnt == 0) || (sd_cache_line[i].sector - sector < cnt))
+    {
+      sd_cache_line[i].valid = 0;
+    }
+  }
+}
+
+/**
+  * @brief  store a sector in the cache
+  * @param  sector: sector address
+  * @param  data: sector data
+  * @param  hot: 1 when the sector was asked for, 0 when read ahead
+  * @retval none
+  */
+void sd_cache_fill(uint32_t sector, const uint8_t *data, uint8_t hot)
+{
+  uint32_t i, victim = 0, victim_cold = 0;
+  uint8_t cold_found = 0;
+
+  for(i = 0; i < SD_CACHE_LINES; i++)
+  {
+    if(sd_cache_line[i].valid && (sd_cache_line[i].sector == sector))
+    {
+      /* already held, the contents are the same */
+      if(hot)
+      {
+        sd_cache_line[i].stamp = ++sd_cache_clock;
+        sd_cache_line[i].hot = 1;
+      }
+      return;
+    }
+  }
+
+  for(i = 0; i < SD_CACHE_LINES; i++)
+  {
+    if(sd_cache_line[i].valid == 0)
+    {
+      victim = victim_cold = i;
+      cold_found = 1;
+      break;
+    }
+
+    if(sd_cache_line[i].stamp - sd_cache_line[victim].stamp > 0x7FFFFFFF)
+    {
+      victim = i;
+    }
+
+    if((sd_cache_line[i].hot == 0) &&
+       ((cold_found == 0) || (sd_cache_line[i].stamp - sd_cache_line[victim_cold].stamp > 0x7FFFFFFF)))
+    {
+      victim_cold = i;
+      cold_found = 1;
+    }
+  }
+
+  /* read ahead lines never used go first, so a stream does not push the
+     fat and directory sectors out */
+  if(cold_found)
+  {
+    victim = victim_cold;
+  }
+
+  memcpy(sd_cache_data[victim], data, 512);
+  sd_cache_line[victim].sector = sector;
+  sd_cache_line[victim].stamp = ++sd_cache_clock;
+  sd_cache_line[victim].valid = 1;
+  sd_cache_line[victim].hot = hot;
+}
+
+/**
+  * @brief  read sd card sector through the cache
+  * @param  buf: read data buf
+  * @param  sector: sector address
+  * @param  cnt: sector count, reads of several sectors are file data and
+  *              bypass the cache
+  * @retval sd_error_status_type: sd card error code.
+  */
+sd_error_status_type sd_cache_read(uint8_t *buf, uint32_t sector, uint32_t cnt)
+{
+  sd_error_status_type sta = SD_OK;
+  uint32_t i, n = 1, total;
+  uint8_t sequential = (sector == sd_cache_next);
+
+  sd_cache_next = sector + cnt;
+
+  if(cnt != 1)
+  {
+    return sd_read_disk(buf, sector, cnt);
+  }
+
+  for(i = 0; i < SD_CACHE_LINES; i++)
+  {
+    if(sd_cache_line[i].valid && (sd_cache_line[i].sector == sector))
+    {
+      sd_cache_hits++;
+      sd_cache_line[i].stamp = ++sd_cache_clock;
+      sd_cache_line[i].hot = 1;
+      memcpy(buf, sd_cache_data[i], 512);
+      return SD_OK;
+    }
+  }
+
+  sd_cache_misses++;
+
+  if(sequential)
+  {
+    /* a fat or directory scan, read the following sectors with it */
+    total = (uint32_t)(sd_card_info.card_capacity / 512);
+    n = (total - sector < SD_READ_AHEAD) ? (total - sector) : SD_READ_AHEAD;
+  }
+
+  sta = sd_read_disk(sdio_data_buffer, sector, n);
+
+  if(sta != SD_OK)
+  {
+    return sta;
+  }
+
+  sd_cache_prefetches += n - 1;
+
+  /* the sector asked for is stored last, as the newest line */
+  for(i = n; i > 0; i--)
+  {
+    sd_cache_fill(sector + i - 1, sdio_data_buffer + 512 * (i - 1), (i == 1));
+  }
+
+  memcpy(buf, sdio_data_buffer, 512);
+
+  return SD_OK;
+}
+
 /*-----------------------------------------------------------------------*/
 /* Get Drive Status                                                      */
 /*-----------------------------------------------------------------------*/
@@ -152,6 +363,9 @@ DSTATUS disk_initialize (
     return stat;
 
   case DEV_MMC :
+    /* the card may have been changed */
+    sd_cache_invalidate(0, 0);
+    sd_cache_next = 0xFFFFFFFF;
     result = sd_init();
     stat = (DSTATUS)result;
     return stat;
@@ -186,7 +400,7 @@ DRESULT disk_read (
     return res;
 
   case DEV_MMC :
-    result = sd_read_disk(buff, sector, count);
+    result = sd_cache_read(buff, sector, count);
     res = (DRESULT)result;
     return res;
 
@@ -223,6 +437,7 @@ DRESULT disk_write (
     return res;
 
   case DEV_MMC :
+    sd_cache_invalidate(sector, count);
     result = sd_write_disk(buff, sector, count);
     res = (DRESULT)result;
     return res;
@@ -260,7 +475,8 @@ DRESULT disk_ioctl (
   case DEV_MMC :
     switch(cmd){
       case CTRL_SYNC:
-        result = RES_OK;
+        /* writes return before the card has programmed the data */
+        result = (sd_busy_wait() == SD_OK) ? RES_OK : RES_ERROR;
         break;
       case GET_SECTOR_SIZE:
         *(DWORD*)buff = 512;
@@ -0,0 +1,282 @@
+/**
+  **************************************************************************
+  * @file     main.c
+  * @brief    main program
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+#include "at32f403a_407_board.h"
+#include "at32f403a_407_clock.h"
+#include "spi_bus.h"
+
+/** @addtogroup AT32F407_periph_examples
+  * @{
+  */
+
+/** @addtogroup 407_SPI_bus_manager SPI_bus_manager
+  * @{
+  */
+
+#define FLASH_READ_ADDR                  0x000000
+#define FLASH_READ_SIZE                  0x4000
+#define FLASH_CHUNK_SIZE                 0x400
+#define SENSOR_READ_SIZE                 6
+
+#define SPI_BUS_DMA_IRQ_PRIORITY         1
+#define SENSOR_TMR_IRQ_PRIORITY          2
+
+/* the queue and the statistics start at zero */
+spi_bus_type spi2_bus =
+{
+  .spi_x = SPI2,
+  .dma_rx_channel = DMA1_CHANNEL4,
+  .dma_tx_channel = DMA1_CHANNEL5,
+  .dma_threshold = SPI_BUS_DMA_THRESHOLD,
+};
+
+/* w25q flash, mode 0 */
+const spi_bus_device_type flash_device =
+{
+  .cs_gpio = GPIOB,
+  .cs_pins = GPIO_PINS_12,
+  .mclk_freq_division = SPI_MCLK_DIV_4,
+  .clock_polarity = SPI_CLOCK_POLARITY_LOW,
+  .clock_phase = SPI_CLOCK_PHASE_1EDGE,
+  .first_bit_transmission = SPI_FIRST_BIT_MSB,
+};
+
+/* register sensor, mode 3 and a slower clock */
+const spi_bus_device_type sensor_device =
+{
+  .cs_gpio = GPIOB,
+  .cs_pins = GPIO_PINS_11,
+  .mclk_freq_division = SPI_MCLK_DIV_32,
+  .clock_polarity = SPI_CLOCK_POLARITY_HIGH,
+  .clock_phase = SPI_CLOCK_PHASE_2EDGE,
+  .first_bit_transmission = SPI_FIRST_BIT_MSB,
+};
+
+const uint8_t sensor_cmd[1] = {0x80 | 0x28};
+uint8_t sensor_data[SENSOR_READ_SIZE];
+spi_bus_transfer_type sensor_transfer;
+uint32_t sensor_submit_cycle;
+__IO uint32_t sensor_latency_max;
+__IO uint32_t sensor_reads;
+__IO uint32_t sensor_skips;
+
+uint8_t flash_cmd[4];
+uint8_t flash_buffer[FLASH_READ_SIZE];
+spi_bus_transfer_type flash_transfer;
+
+void spi_bus_lowlevel_init(spi_bus_type *bus);
+void sensor_init(void);
+void sensor_transfer_complete(spi_bus_transfer_type *ptransfer);
+void sensor_tmr_irq_handler(void);
+uint32_t flash_read(uint32_t address, uint8_t *pbuffer, uint32_t length, uint32_t chunk);
+
+/**
+  * @brief  spi2 pins, clocks and dma interrupt, called by spi_bus_init.
+  * @param  bus: spi2_bus
+  * @retval none
+  */
+void spi_bus_lowlevel_init(spi_bus_type *bus)
+{
+  gpio_init_type gpio_init_struct;
+
+  crm_periph_clock_enable(CRM_GPIOB_PERIPH_CLOCK, TRUE);
+  crm_periph_clock_enable(CRM_DMA1_PERIPH_CLOCK, TRUE);
+  crm_periph_clock_enable(CRM_SPI2_PERIPH_CLOCK, TRUE);
+
+  /* sck, miso and mosi */
+  gpio_default_para_init(&gpio_init_struct);
+  gpio_init_struct.gpio_out_type       = GPIO_OUTPUT_PUSH_PULL;
+  gpio_init_struct.gpio_pull           = GPIO_PULL_UP;
+  gpio_init_struct.gpio_mode           = GPIO_MODE_MUX;
+  gpio_init_struct.gpio_drive_strength = GPIO_DRIVE_STRENGTH_STRONGER;
+  gpio_init_struct.gpio_pins           = GPIO_PINS_13 | GPIO_PINS_14 | GPIO_PINS_15;
+  gpio_init(GPIOB, &gpio_init_struct);
+
+  nvic_irq_enable(DMA1_Channel4_IRQn, SPI_BUS_DMA_IRQ_PRIORITY, 0);
+}
+
+/**
+  * @brief  sensor reads start from tmr6 at 1khz.
+  * @param  none
+  * @retval none
+  */
+void sensor_init(void)
+{
+  crm_clocks_freq_type crm_clocks_freq_struct = {0};
+
+  sensor_transfer.device = &sensor_device;
+  sensor_transfer.cmd = sensor_cmd;
+  sensor_transfer.cmd_length = sizeof(sensor_cmd);
+  sensor_transfer.tx_buffer = 0;
+  sensor_transfer.rx_buffer = sensor_data;
+  sensor_transfer.length = SENSOR_READ_SIZE;
+  sensor_transfer.priority = SPI_BUS_PRIORITY_HIGH;
+  sensor_transfer.callback = sensor_transfer_complete;
+  sensor_transfer.param = 0;
+  sensor_transfer.state = SPI_BUS_TRANSFER_IDLE;
+
+  crm_clocks_freq_get(&crm_clocks_freq_struct);
+  crm_periph_clock_enable(CRM_TMR6_PERIPH_CLOCK, TRUE);
+  tmr_base_init(TMR6, 1000 - 1, (crm_clocks_freq_struct.ahb_freq / 1000000) - 1);
+  tmr_interrupt_enable(TMR6, TMR_OVF_INT, TRUE);
+  nvic_irq_enable(TMR6_GLOBAL_IRQn, SENSOR_TMR_IRQ_PRIORITY, 0);
+  tmr_counter_enable(TMR6, TRUE);
+}
+
+/**
+  * @brief  sensor read done, keeps the longest time from submit to done.
+  * @param  ptransfer: sensor_transfer
+  * @retval none
+  */
+void sensor_transfer_complete(spi_bus_transfer_type *ptransfer)
+{
+  uint32_t latency = DWT->CYCCNT - sensor_submit_cycle;
+
+  if(latency > sensor_latency_max)
+  {
+    sensor_latency_max = latency;
+  }
+  sensor_reads ++;
+}
+
+/**
+  * @brief  submit a sensor read, a read still queued is counted as skipped.
+  * @param  none
+  * @retval none
+  */
+void sensor_tmr_irq_handler(void)
+{
+  if(tmr_interrupt_flag_get(TMR6, TMR_OVF_FLAG) == RESET)
+  {
+    return;
+  }
+  tmr_flag_clear(TMR6, TMR_OVF_FLAG);
+
+  if(sensor_transfer.state == SPI_BUS_TRANSFER_QUEUED || sensor_transfer.state == SPI_BUS_TRANSFER_ACTIVE)
+  {
+    sensor_skips ++;
+    return;
+  }
+  sensor_submit_cycle = DWT->CYCCNT;
+  spi_bus_submit(&spi2_bus, &sensor_transfer);
+}
+
+/**
+  * @brief  read the flash through the bus with low priority.
+  * @param  address: flash address
+  * @param  pbuffer: data read
+  * @param  length: bytes to read
+  * @param  chunk: bytes per transfer, a sensor read waits for one chunk at most
+  * @retval cycles taken
+  */
+uint32_t flash_read(uint32_t address, uint8_t *pbuffer, uint32_t length, uint32_t chunk)
+{
+  uint32_t start = DWT->CYCCNT, size;
+
+  while(length)
+  {
+    size = (length > chunk) ? chunk : length;
+    flash_cmd[0] = 0x03;
+    flash_cmd[1] = (uint8_t)(address >> 16);
+    flash_cmd[2] = (uint8_t)(address >> 8);
+    flash_cmd[3] = (uint8_t)address;
+
+    flash_transfer.device = &flash_device;
+    flash_transfer.cmd = flash_cmd;
+    flash_transfer.cmd_length = sizeof(flash_cmd);
+    flash_transfer.tx_buffer = 0;
+    flash_transfer.rx_buffer = pbuffer;
+    flash_transfer.length = size;
+    flash_transfer.priority = SPI_BUS_PRIORITY_LOW;
+    flash_transfer.callback = 0;
+    spi_bus_transfer(&spi2_bus, &flash_transfer);
+
+    address += size;
+    pbuffer += size;
+    length -= size;
+  }
+  return DWT->CYCCNT - start;
+}
+
+/**
+  * @brief  main function.
+  * @param  none
+  * @retval none
+  */
+int main(void)
+{
+  const uint32_t chunk_size[2] = {FLASH_READ_SIZE, FLASH_CHUNK_SIZE};
+  uint32_t index, cycles, ahb_mhz;
+  uint8_t flash_id[3];
+
+  system_clock_config();
+  at32_board_init();
+  uart_print_init(115200);
+  ahb_mhz = system_core_clock / 1000000;
+
+  spi_bus_init(&spi2_bus);
+  spi_bus_device_init(&flash_device);
+  spi_bus_device_init(&sensor_device);
+
+  /* jedec id */
+  flash_cmd[0] = 0x9F;
+  flash_transfer.device = &flash_device;
+  flash_transfer.cmd = flash_cmd;
+  flash_transfer.cmd_length = 1;
+  flash_transfer.tx_buffer = 0;
+  flash_transfer.rx_buffer = flash_id;
+  flash_transfer.length = sizeof(flash_id);
+  flash_transfer.priority = SPI_BUS_PRIORITY_NORMAL;
+  flash_transfer.callback = 0;
+  spi_bus_transfer(&spi2_bus, &flash_transfer);
+  printf("flash id: %x %x %x\r\n", flash_id[0], flash_id[1], flash_id[2]);
+
+  sensor_init();
+
+  while(1)
+  {
+    /* the whole read as one transfer, then split into chunks */
+    for(index = 0; index < 2; index ++)
+    {
+      spi_bus_load_get(&spi2_bus);
+      sensor_latency_max = 0;
+      cycles = flash_read(FLASH_READ_ADDR, flash_buffer, FLASH_READ_SIZE, chunk_size[index]);
+      printf("chunk %5d: %d KB/s, sensor latency max %d us, bus load %d permille\r\n",
+             chunk_size[index], (FLASH_READ_SIZE * ahb_mhz / 1024) * 1000 / (cycles / 1000),
+             sensor_latency_max / ahb_mhz, spi_bus_load_get(&spi2_bus));
+    }
+    printf("sensor reads %d, skipped %d, dma phases %d, polled phases %d, reconfigs %d\r\n\r\n",
+           sensor_reads, sensor_skips, spi2_bus.dma_phases, spi2_bus.polled_phases, spi2_bus.reconfigs);
+    at32_led_toggle(LED2);
+    delay_ms(1000);
+  }
+}
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
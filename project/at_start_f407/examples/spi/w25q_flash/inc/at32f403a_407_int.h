@@ -47,6 +47,8 @@ void SVC_Handler(void);
 void DebugMon_Handler(void);
 void PendSV_Handler(void);
 void SysTick_Handler(void);
+void DMA1_Channel4_IRQHandler(void);
+void TMR6_GLOBAL_IRQHandler(void);
 
 #ifdef __cplusplus
 }
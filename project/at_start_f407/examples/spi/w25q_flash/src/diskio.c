@@ -0,0 +1,146 @@
+/*-----------------------------------------------------------------------*/
+/* Low level disk I/O module SKELETON for FatFs     (C)ChaN, 2019        */
+/*-----------------------------------------------------------------------*/
+/* If a working storage control module is available, it should be        */
+/* attached to the FatFs via a glue function rather than modifying it.   */
+/* This is an example of glue functions to attach various exsisting      */
+/* storage control modules to the FatFs module with a defined API.       */
+/*-----------------------------------------------------------------------*/
+
+
+#include "ff.h"      /* Obtains integer types */
+#include "diskio.h"    /* Declarations of disk functions */
+
+#include "ftl_w25q.h"    /* flash translation layer over spi_flash.c */
+
+/* Definitions of physical drive number for each drive */
+#define DEV_FLASH  0  /* w25q through the flash translation layer */
+
+/* sectors are remapped by the ftl, a 512 byte write programs two pages and
+   never erases a 4kb sector in the foreground */
+ftl_type flash_ftl;
+static DSTATUS flash_stat = STA_NOINIT;
+
+/*-----------------------------------------------------------------------*/
+/* Get Drive Status                                                      */
+/*-----------------------------------------------------------------------*/
+DSTATUS disk_status (
+  BYTE pdrv    /* Physical drive nmuber to identify the drive */
+)
+{
+  if (pdrv == DEV_FLASH) {
+    return flash_stat;
+  }
+  return STA_NOINIT;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Inidialize a Drive                                                    */
+/*-----------------------------------------------------------------------*/
+DSTATUS disk_initialize (
+  BYTE pdrv        /* Physical drive nmuber to identify the drive */
+)
+{
+  if (pdrv == DEV_FLASH) {
+    /* spiflash_init is called by main, the map table is rebuilt here */
+    if (flash_stat & STA_NOINIT) {
+      if (ftl_init(&flash_ftl, &ftl_w25q) == FTL_OK) {
+        flash_stat = 0;
+      }
+    }
+    return flash_stat;
+  }
+  return STA_NOINIT;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read Sector(s)                                                        */
+/*-----------------------------------------------------------------------*/
+DRESULT disk_read (
+  BYTE pdrv,    /* Physical drive nmuber to identify the drive */
+  BYTE *buff,    /* Data buffer to store read data */
+  LBA_t sector,  /* Start sector in LBA */
+  UINT count    /* Number of sectors to read */
+)
+{
+  if (pdrv != DEV_FLASH) {
+    return RES_PARERR;
+  }
+  if (flash_stat & STA_NOINIT) {
+    return RES_NOTRDY;
+  }
+  return (ftl_read(&flash_ftl, sector, buff, count) == FTL_OK) ? RES_OK : RES_ERROR;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Write Sector(s)                                                       */
+/*-----------------------------------------------------------------------*/
+#if FF_FS_READONLY == 0
+
+DRESULT disk_write (
+  BYTE pdrv,      /* Physical drive nmuber to identify the drive */
+  const BYTE *buff,  /* Data to be written */
+  LBA_t sector,    /* Start sector in LBA */
+  UINT count      /* Number of sectors to write */
+)
+{
+  if (pdrv != DEV_FLASH) {
+    return RES_PARERR;
+  }
+  if (flash_stat & STA_NOINIT) {
+    return RES_NOTRDY;
+  }
+  return (ftl_write(&flash_ftl, sector, buff, count) == FTL_OK) ? RES_OK : RES_ERROR;
+}
+
+#endif
+
+
+/*-----------------------------------------------------------------------*/
+/* Miscellaneous Functions                                               */
+/*-----------------------------------------------------------------------*/
+DRESULT disk_ioctl (
+  BYTE pdrv,    /* Physical drive nmuber (0..) */
+  BYTE cmd,    /* Control code */
+  void *buff    /* Buffer to send/receive control data */
+)
+{
+  DRESULT res;
+
+  if (pdrv != DEV_FLASH) {
+    return RES_PARERR;
+  }
+  if (flash_stat & STA_NOINIT) {
+    return RES_NOTRDY;
+  }
+
+  switch(cmd){
+    case CTRL_SYNC:
+      /* sectors are in flash once disk_write returns */
+      res = RES_OK;
+      break;
+    case GET_SECTOR_SIZE:
+      *(WORD*)buff = FTL_SECTOR_SIZE;
+      res = RES_OK;
+      break;
+    case GET_SECTOR_COUNT:
+      *(LBA_t*)buff = flash_ftl.sector_num;
+      res = RES_OK;
+      break;
+    case GET_BLOCK_SIZE:
+      /* the erase block is hidden by the ftl */
+      *(DWORD*)buff = 1;
+      res = RES_OK;
+      break;
+    default:
+      res = RES_PARERR;
+      break;
+  }
+  return res;
+}
@@ -25,6 +25,8 @@
 #include "at32f403a_407_board.h"
 #include "at32f403a_407_clock.h"
 #include "spi_flash.h"
+#include "ftl_w25q.h"
+#include "ff.h"
 
 /** @addtogroup AT32F407_periph_examples
   * @{
@@ -37,9 +39,27 @@
 #define FLASH_TEST_ADDR                  0x1000
 #define BUF_SIZE                         0x256
 
+#define ASYNC_TEST_ADDR                  0x2000
+#define ASYNC_BUF_SIZE                   0x1000
+
+/* random 512 byte writes, raw ones go to the area after the ftl region */
+#define RANDOM_WRITE_NUM                 64
+#define RANDOM_FILE_SIZE                 0x10000
+#define RAW_TEST_ADDR                    (FTL_W25Q_ADDR + FTL_W25Q_BLOCK_NUM * SPIF_SECTOR_SIZE)
+
 uint8_t tx_buffer[BUF_SIZE];
 uint8_t rx_buffer[BUF_SIZE];
+uint8_t async_buffer[ASYNC_BUF_SIZE];
 volatile error_status transfer_status = ERROR;
+spiflash_request_type async_request[3];
+__IO uint32_t async_done = 0;
+FATFS fs;
+FIL file;
+BYTE work[FF_MAX_SS];
+uint32_t random_seed = 1;
+
+/* mounted by disk_initialize */
+extern ftl_type flash_ftl;
 
 void tx_data_fill(void);
 error_status buffer_compare(uint8_t* pbuffer1, uint8_t* pbuffer2, uint16_t buffer_length);
@@ -79,6 +99,167 @@ error_status buffer_compare(uint8_t* pbuffer1, uint8_t* pbuffer2, uint16_t buffe
   return SUCCESS;
 }
 
+/**
+  * @brief  completion callback, called from the dma interrupt.
+  * @param  preq: finished request
+  * @retval none
+  */
+void async_callback(spiflash_request_type *preq)
+{
+  async_done++;
+}
+
+/**
+  * @brief  queue an erase, a page program and a 4kb read at once and count the
+  *         loop passes the cpu runs until the read is done.
+  * @param  none
+  * @retval none
+  */
+void async_test(void)
+{
+  uint32_t idle_count = 0;
+
+  async_request[0].op = SPIF_OP_SECTOR_ERASE;
+  async_request[0].address = ASYNC_TEST_ADDR;
+  async_request[0].callback = async_callback;
+
+  async_request[1].op = SPIF_OP_PAGE_PROGRAM;
+  async_request[1].address = ASYNC_TEST_ADDR;
+  async_request[1].pbuffer = tx_buffer;
+  async_request[1].length = SPIF_PAGE_SIZE;
+  async_request[1].callback = async_callback;
+
+  async_request[2].op = SPIF_OP_READ;
+  async_request[2].address = ASYNC_TEST_ADDR;
+  async_request[2].pbuffer = async_buffer;
+  async_request[2].length = ASYNC_BUF_SIZE;
+  async_request[2].callback = async_callback;
+
+  async_done = 0;
+  spiflash_submit(&async_request[0]);
+  spiflash_submit(&async_request[1]);
+  spiflash_submit(&async_request[2]);
+
+  /* the cpu is free while the requests run */
+  while(async_done < 3)
+  {
+    idle_count++;
+  }
+
+  if(buffer_compare(async_buffer, tx_buffer, SPIF_PAGE_SIZE) == SUCCESS && async_buffer[SPIF_PAGE_SIZE] == 0xFF)
+  {
+    printf("async erase, program and read success, %u idle loop passes meanwhile\r\n", (unsigned)idle_count);
+  }
+  else
+  {
+    printf("async erase, program and read ERROR!\r\n");
+    transfer_status = ERROR;
+  }
+}
+
+/**
+  * @brief  pseudo random number.
+  * @param  none
+  * @retval value
+  */
+uint32_t random_get(void)
+{
+  random_seed = random_seed * 1103515245 + 12345;
+  return random_seed >> 8;
+}
+
+/**
+  * @brief  write random 512 byte sectors of a file through fatfs and the ftl,
+  *         then the same number of 512 byte writes straight to the flash, each
+  *         of these erases a 4kb sector.
+  * @param  none
+  * @retval none
+  */
+void ftl_test(void)
+{
+  FRESULT ret;
+  UINT bytes = 0;
+  uint32_t index, start, ftl_cycles, raw_cycles;
+
+  ret = f_mount(&fs, "0:", 1);
+  if(ret == FR_NO_FILESYSTEM)
+  {
+    printf("create fatfs..\r\n");
+    ret = f_mkfs("0:", 0, work, sizeof(work));
+    if(ret == FR_OK)
+    {
+      ret = f_mount(&fs, "0:", 1);
+    }
+  }
+  if(ret == FR_OK)
+  {
+    ret = f_open(&file, "0:/random.bin", FA_READ | FA_WRITE | FA_OPEN_ALWAYS);
+  }
+  if(ret != FR_OK)
+  {
+    printf("fatfs on ftl ERROR %d!\r\n", ret);
+    transfer_status = ERROR;
+    return;
+  }
+
+  /* the file is laid out once, later writes keep the fat untouched */
+  if(f_size(&file) < RANDOM_FILE_SIZE)
+  {
+    for(index = 0; index < RANDOM_FILE_SIZE && ret == FR_OK; index += ASYNC_BUF_SIZE)
+    {
+      ret = f_write(&file, async_buffer, ASYNC_BUF_SIZE, &bytes);
+    }
+    f_sync(&file);
+  }
+
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  start = DWT->CYCCNT;
+  for(index = 0; index < RANDOM_WRITE_NUM && ret == FR_OK; index++)
+  {
+    tx_buffer[0] = index;
+    ret = f_lseek(&file, (random_get() % (RANDOM_FILE_SIZE / FTL_SECTOR_SIZE)) * FTL_SECTOR_SIZE);
+    if(ret == FR_OK)
+    {
+      ret = f_write(&file, tx_buffer, FTL_SECTOR_SIZE, &bytes);
+    }
+  }
+  ftl_cycles = DWT->CYCCNT - start;
+
+  /* read back the last sector written */
+  if(ret == FR_OK)
+  {
+    f_lseek(&file, f_tell(&file) - FTL_SECTOR_SIZE);
+    ret = f_read(&file, rx_buffer, FTL_SECTOR_SIZE, &bytes);
+  }
+  f_close(&file);
+  f_mount(NULL, "0:", 1);
+  if(ret != FR_OK || buffer_compare(rx_buffer, tx_buffer, FTL_SECTOR_SIZE) != SUCCESS)
+  {
+    printf("fatfs on ftl ERROR!\r\n");
+    transfer_status = ERROR;
+    return;
+  }
+
+  start = DWT->CYCCNT;
+  for(index = 0; index < RANDOM_WRITE_NUM; index++)
+  {
+    tx_buffer[0] = index;
+    spiflash_write(tx_buffer, RAW_TEST_ADDR + (random_get() % (RANDOM_FILE_SIZE / FTL_SECTOR_SIZE)) * FTL_SECTOR_SIZE,
+                   FTL_SECTOR_SIZE);
+  }
+  raw_cycles = DWT->CYCCNT - start;
+
+  printf("random 512 byte writes per second: ftl %u, raw %u\r\n",
+         (unsigned)((uint64_t)RANDOM_WRITE_NUM * system_core_clock / ftl_cycles),
+         (unsigned)((uint64_t)RANDOM_WRITE_NUM * system_core_clock / raw_cycles));
+  printf("ftl sectors programmed %u for %u written, %u erases, %u collections\r\n",
+         (unsigned)flash_ftl.flash_writes, (unsigned)flash_ftl.host_writes,
+         (unsigned)flash_ftl.erases, (unsigned)flash_ftl.collections);
+}
+
 /**
   * @brief  main function.
   * @param  none
@@ -90,6 +271,7 @@ int main(void)
   __IO uint32_t flash_id_index = 0;
   system_clock_config();
   at32_board_init();
+  nvic_priority_group_config(NVIC_PRIORITY_GROUP_4);
   tx_data_fill();
   uart_print_init(115200);
   spiflash_init();
@@ -129,6 +311,12 @@ int main(void)
   /* test result:the data check */
   transfer_status = buffer_compare(rx_buffer, tx_buffer, BUF_SIZE);
 
+  /* queued requests run from the dma interrupt */
+  async_test();
+
+  /* fatfs mounted on the flash translation layer */
+  ftl_test();
+
   /* test result indicate:if SUCCESS ,led2 lights */
   if(transfer_status == SUCCESS)
   {
@@ -143,6 +331,8 @@ int main(void)
 
   while(1)
   {
+    /* erase and collect ftl blocks while the disk is idle */
+    ftl_idle(&flash_ftl);
   }
 }
 
@@ -0,0 +1,317 @@
+/**
+  **************************************************************************
+  * @file     main.c
+  * @brief    main program
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+#include "at32f403a_407_board.h"
+#include "at32f403a_407_clock.h"
+#include "usbd_core.h"
+#include "midi_class.h"
+#include "midi_desc.h"
+#include "usbd_int.h"
+
+/** @addtogroup AT32F407_periph_examples
+  * @{
+  */
+
+/** @addtogroup 407_USB_device_midi USB_device_midi
+  * @{
+  */
+
+#define MIDI_TMR_PERIOD_MS               250        /*!< tmr3 plays a note step every 250ms */
+#define MIDI_PRINT_TICKS                 4          /*!< statistics printed every 4 steps */
+#define MIDI_CHANNEL                     0
+
+usbd_core_type usb_core_dev;
+__IO uint32_t midi_ticks = 0;
+
+void button_exint_init(void);
+void midi_tmr_init(void);
+
+
+/**
+  * @brief  usb 48M clock select
+  * @param  clk_s:USB_CLK_HICK, USB_CLK_HEXT
+  * @retval none
+  */
+void usb_clock48m_select(usb_clk48_s clk_s)
+{
+  if(clk_s == USB_CLK_HICK)
+  {
+    crm_usb_clock_source_select(CRM_USB_CLOCK_SOURCE_HICK);
+
+    /* enable the acc calibration ready interrupt */
+    crm_periph_clock_enable(CRM_ACC_PERIPH_CLOCK, TRUE);
+
+    /* update the c1\c2\c3 value */
+    acc_write_c1(7980);
+    acc_write_c2(8000);
+    acc_write_c3(8020);
+
+    /* open acc calibration */
+    acc_calibration_mode_enable(ACC_CAL_HICKTRIM, TRUE);
+  }
+  else
+  {
+    switch(system_core_clock)
+    {
+      /* 48MHz */
+      case 48000000:
+        crm_usb_clock_div_set(CRM_USB_DIV_1);
+        break;
+
+      /* 72MHz */
+      case 72000000:
+        crm_usb_clock_div_set(CRM_USB_DIV_1_5);
+        break;
+
+      /* 96MHz */
+      case 96000000:
+        crm_usb_clock_div_set(CRM_USB_DIV_2);
+        break;
+
+      /* 120MHz */
+      case 120000000:
+        crm_usb_clock_div_set(CRM_USB_DIV_2_5);
+        break;
+
+      /* 144MHz */
+      case 144000000:
+        crm_usb_clock_div_set(CRM_USB_DIV_3);
+        break;
+
+      /* 168MHz */
+      case 168000000:
+        crm_usb_clock_div_set(CRM_USB_DIV_3_5);
+        break;
+
+      /* 192MHz */
+      case 192000000:
+        crm_usb_clock_div_set(CRM_USB_DIV_4);
+        break;
+
+      default:
+        break;
+
+    }
+  }
+}
+
+/**
+  * @brief  main function.
+  * @param  none
+  * @retval none
+  */
+int main(void)
+{
+  midi_type *pmidi = (midi_type *)midi_class_handler.pdata;
+  uint32_t packet[USBD_MIDI_OUT_MAXPACKET_SIZE / sizeof(uint32_t)];
+  uint32_t print_ticks = 0;
+  uint16_t num, i_index;
+
+  /* config nvic priority group */
+  nvic_priority_group_config(NVIC_PRIORITY_GROUP_4);
+
+  system_clock_config();
+
+  at32_board_init();
+
+  uart_print_init(115200);
+
+  /* select usb 48m clcok source */
+  usb_clock48m_select(USB_CLK_HEXT);
+
+  /* enable usb clock */
+  crm_periph_clock_enable(CRM_USB_PERIPH_CLOCK, TRUE);
+
+  /* enable usb interrupt */
+  nvic_irq_enable(USBFS_L_CAN1_RX0_IRQn, 0, 0);
+
+  /* usb core init */
+  usbd_core_init(&usb_core_dev, USB, &midi_class_handler, &midi_desc_handler, 0);
+
+  /* enable usb pull-up */
+  usbd_connect(&usb_core_dev);
+
+  /* the events are queued from the interrupts, the usb sends them at the next frame */
+  button_exint_init();
+  midi_tmr_init();
+
+  while(1)
+  {
+    /* note on from the host lights led4, note off turns it off */
+    num = usbd_midi_packet_get(&usb_core_dev, packet, sizeof(packet) / sizeof(uint32_t));
+    for(i_index = 0; i_index < num; i_index ++)
+    {
+      switch(packet[i_index] & 0x0F)
+      {
+        case MIDI_CIN_NOTE_ON:
+          at32_led_on(LED4);
+          break;
+        case MIDI_CIN_NOTE_OFF:
+          at32_led_off(LED4);
+          break;
+        default:
+          break;
+      }
+    }
+
+    if(midi_ticks - print_ticks >= MIDI_PRINT_TICKS)
+    {
+      print_ticks = midi_ticks;
+      printf("latency last %u us, max %u us, %u over a frame, %u overflows\r\n",
+             pmidi->latency_last_us, pmidi->latency_max_us,
+             pmidi->latency_over_frame, pmidi->tx_overflow);
+    }
+  }
+}
+
+/**
+  * @brief  tmr3 steps through the notes every MIDI_TMR_PERIOD_MS
+  * @param  none
+  * @retval none
+  */
+void midi_tmr_init(void)
+{
+  crm_clocks_freq_type crm_clocks_freq_struct;
+
+  crm_clocks_freq_get(&crm_clocks_freq_struct);
+  crm_periph_clock_enable(CRM_TMR3_PERIPH_CLOCK, TRUE);
+
+  /* 10khz counter clock */
+  tmr_base_init(TMR3, MIDI_TMR_PERIOD_MS * 10 - 1, (crm_clocks_freq_struct.ahb_freq / 10000) - 1);
+  tmr_cnt_dir_set(TMR3, TMR_COUNT_UP);
+  tmr_interrupt_enable(TMR3, TMR_OVF_INT, TRUE);
+
+  /* below the usb interrupt, so the latency includes the wait for the frame only */
+  nvic_irq_enable(TMR3_GLOBAL_IRQn, 1, 0);
+  tmr_counter_enable(TMR3, TRUE);
+}
+
+/**
+  * @brief  tmr3 interrupt handler, plays a c major arpeggio
+  * @param  none
+  * @retval none
+  */
+void TMR3_GLOBAL_IRQHandler(void)
+{
+  static const uint8_t note[4] = {60, 64, 67, 72};
+  uint8_t step;
+
+  if(tmr_flag_get(TMR3, TMR_OVF_FLAG) != RESET)
+  {
+    tmr_flag_clear(TMR3, TMR_OVF_FLAG);
+
+    step = midi_ticks % 4;
+    usbd_midi_event_put(&usb_core_dev, 0, 0x80 | MIDI_CHANNEL, note[(step + 3) % 4], 0);
+    usbd_midi_event_put(&usb_core_dev, 0, 0x90 | MIDI_CHANNEL, note[step], 100);
+    midi_ticks ++;
+    at32_led_toggle(LED2);
+  }
+}
+
+/**
+  * @brief  button exint init
+  * @param  none
+  * @retval none
+  */
+void button_exint_init(void)
+{
+  exint_init_type exint_init_struct;
+
+  crm_periph_clock_enable(CRM_IOMUX_PERIPH_CLOCK, TRUE);
+  gpio_exint_line_config(GPIO_PORT_SOURCE_GPIOA, GPIO_PINS_SOURCE0);
+
+  exint_default_para_init(&exint_init_struct);
+  exint_init_struct.line_enable = TRUE;
+  exint_init_struct.line_mode = EXINT_LINE_INTERRUPUT;
+  exint_init_struct.line_select = EXINT_LINE_0;
+  exint_init_struct.line_polarity = EXINT_TRIGGER_BOTH_EDGE;
+  exint_init(&exint_init_struct);
+
+  nvic_irq_enable(EXINT0_IRQn, 1, 0);
+}
+
+/**
+  * @brief  exint0 interrupt handler, the user button holds the sustain pedal
+  * @param  none
+  * @retval none
+  */
+void EXINT0_IRQHandler(void)
+{
+  uint8_t pressed;
+
+  if(exint_flag_get(EXINT_LINE_0) != RESET)
+  {
+    exint_flag_clear(EXINT_LINE_0);
+
+    pressed = (gpio_input_data_bit_read(USER_BUTTON_PORT, USER_BUTTON_PIN) != RESET);
+    usbd_midi_event_put(&usb_core_dev, 0, 0xB0 | MIDI_CHANNEL, 64, pressed ? 127 : 0);
+    if(pressed)
+    {
+      at32_led_on(LED3);
+    }
+    else
+    {
+      at32_led_off(LED3);
+    }
+  }
+}
+
+/**
+  * @brief  this function handles usb interrupt.
+  * @param  none
+  * @retval none
+  */
+void USBFS_L_CAN1_RX0_IRQHandler(void)
+{
+  usbd_irq_handler(&usb_core_dev);
+}
+
+/**
+  * @brief  usb delay millisecond function.
+  * @param  ms: number of millisecond delay
+  * @retval none
+  */
+void usb_delay_ms(uint32_t ms)
+{
+  /* user can define self delay function */
+  delay_ms(ms);
+}
+
+/**
+  * @brief  usb delay microsecond function.
+  * @param  us: number of microsecond delay
+  * @retval none
+  */
+void usb_delay_us(uint32_t us)
+{
+  delay_us(us);
+}
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
@@ -0,0 +1,76 @@
+/**
+  **************************************************************************
+  * @file     ftl_w25q.h
+  * @brief    w25q backend of the flash translation layer
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+/* define to prevent recursive inclusion -------------------------------------*/
+#ifndef __FTL_W25Q_H
+#define __FTL_W25Q_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ftl.h"
+
+/** @addtogroup AT32F407_periph_examples
+  * @{
+  */
+
+/** @addtogroup 407_USB_device_msc
+  * @{
+  */
+
+/** @defgroup FTL_w25q_layout
+  * @brief    the region starts after the one of the flash/flash_log example and
+  *           fits the 1mb w25q80, every value can be overridden before
+  *           including this file.
+  * @{
+  */
+
+#ifndef FTL_W25Q_ADDR
+#define FTL_W25Q_ADDR                    0x010000
+#endif
+
+#ifndef FTL_W25Q_BLOCK_NUM
+#define FTL_W25Q_BLOCK_NUM               192        /*!< 4kb sectors, FTL_BLOCK_MAX at most */
+#endif
+
+/**
+  * @}
+  */
+
+extern const ftl_backend_type ftl_w25q;
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
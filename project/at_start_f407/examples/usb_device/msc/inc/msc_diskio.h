@@ -50,6 +50,18 @@ extern "C" {
 #define SECTOR_SIZE_2K                   2048
 #define SECTOR_SIZE_4K                   4096
 
+/* MSC_USE_W25Q_FTL, set by the msc_w25q_ftl target, exports a w25q as lun 0
+   through middlewares/ftl_library */
+#ifdef MSC_USE_W25Q_FTL
+#include "ftl_w25q.h"
+
+/* below the spi dma and tmr6 interrupts the disk waits for */
+#define MSC_FTL_USB_IRQ_PRIORITY         2
+
+void msc_disk_init(void);
+void msc_disk_idle(void);
+#endif
+
 uint8_t *get_inquiry(uint8_t lun);
 usb_sts_type msc_disk_read(uint8_t lun, uint64_t addr, uint8_t *read_buf, uint32_t len);
 usb_sts_type msc_disk_write(uint8_t lun, uint64_t addr, uint8_t *buf, uint32_t len);
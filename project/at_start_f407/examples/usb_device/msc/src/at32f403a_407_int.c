@@ -24,6 +24,9 @@
 
 /* includes ------------------------------------------------------------------*/
 #include "at32f403a_407_int.h"
+#ifdef MSC_USE_W25Q_FTL
+#include "spi_flash.h"
+#endif
 
 /** @addtogroup AT32F407_periph_examples
   * @{
@@ -130,6 +133,28 @@ void SysTick_Handler(void)
 {
 }
 
+#ifdef MSC_USE_W25Q_FTL
+/**
+  * @brief  this function handles dma1 channel4 handler.
+  * @param  none
+  * @retval none
+  */
+void DMA1_Channel4_IRQHandler(void)
+{
+  spiflash_dma_irq_handler();
+}
+
+/**
+  * @brief  this function handles tmr6 handler.
+  * @param  none
+  * @retval none
+  */
+void TMR6_GLOBAL_IRQHandler(void)
+{
+  spiflash_tmr_irq_handler();
+}
+#endif
+
 /**
   * @}
   */
@@ -28,6 +28,9 @@
 #include "msc_class.h"
 #include "msc_desc.h"
 #include "usbd_int.h"
+#ifdef MSC_USE_W25Q_FTL
+#include "msc_diskio.h"
+#endif
 
 
 /** @addtogroup AT32F407_periph_examples
@@ -129,8 +132,15 @@ int main(void)
   /* enable usb clock */
   crm_periph_clock_enable(CRM_USB_PERIPH_CLOCK, TRUE);
 
+#ifdef MSC_USE_W25Q_FTL
+  msc_disk_init();
+
+  /* enable usb interrupt */
+  nvic_irq_enable(USBFS_L_CAN1_RX0_IRQn, MSC_FTL_USB_IRQ_PRIORITY, 0);
+#else
   /* enable usb interrupt */
   nvic_irq_enable(USBFS_L_CAN1_RX0_IRQn, 0, 0);
+#endif
 
   /* usb core init */
   usbd_core_init(&usb_core_dev, USB, &msc_class_handler, &msc_desc_handler, 0);
@@ -140,6 +150,9 @@ int main(void)
 
   while(1)
   {
+#ifdef MSC_USE_W25Q_FTL
+    msc_disk_idle();
+#endif
   }
 }
 
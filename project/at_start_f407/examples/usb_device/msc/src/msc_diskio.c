@@ -23,6 +23,9 @@
   */
 #include "msc_diskio.h"
 #include "msc_bot_scsi.h"
+#ifdef MSC_USE_W25Q_FTL
+#include "spi_flash.h"
+#endif
 
 /** @addtogroup AT32F407_periph_examples
   * @{
@@ -33,6 +36,10 @@
   */
 uint32_t sector_size = 2048;
 uint32_t msc_flash_size;
+#ifdef MSC_USE_W25Q_FTL
+ftl_type msc_ftl;
+static __IO uint8_t msc_ftl_pending = 0;
+#endif
 uint8_t scsi_inquiry[MSC_SUPPORT_MAX_LUN][SCSI_INQUIRY_DATA_LENGTH] =
 {
   /* lun = 0 */
@@ -62,6 +69,44 @@ uint8_t *get_inquiry(uint8_t lun)
     return NULL;
 }
 
+#ifdef MSC_USE_W25Q_FTL
+/**
+  * @brief  mount the flash translation layer on the w25q
+  * @param  none
+  * @retval none
+  */
+void msc_disk_init(void)
+{
+  spiflash_init();
+  ftl_init(&msc_ftl, &ftl_w25q);
+
+  /* the mount may leave blocks to erase */
+  msc_ftl_pending = 1;
+}
+
+/**
+  * @brief  erase and collect ftl blocks, called from the main loop
+  * @note   the disk is written from the usb interrupt, which is held off
+  *         for the one erase or collection done by a call. once ftl_idle has
+  *         nothing left the interrupt is not touched until the next write.
+  * @param  none
+  * @retval none
+  */
+void msc_disk_idle(void)
+{
+  if(msc_ftl_pending == 0)
+  {
+    return;
+  }
+  nvic_irq_disable(USBFS_L_CAN1_RX0_IRQn);
+  if(ftl_idle(&msc_ftl) != FTL_BUSY)
+  {
+    msc_ftl_pending = 0;
+  }
+  nvic_irq_enable(USBFS_L_CAN1_RX0_IRQn, MSC_FTL_USB_IRQ_PRIORITY, 0);
+}
+#endif
+
 /**
   * @brief  disk read
   * @param  lun: logical units number
@@ -77,11 +122,18 @@ usb_sts_type msc_disk_read(uint8_t lun, uint64_t addr, uint8_t *read_buf, uint32
   switch(lun)
   {
     case 0:
+#ifdef MSC_USE_W25Q_FTL
+      if(ftl_read(&msc_ftl, (uint32_t)addr / FTL_SECTOR_SIZE, read_buf, len / FTL_SECTOR_SIZE) != FTL_OK)
+      {
+        return USB_FAIL;
+      }
+#else
       for(i = 0; i < len; i ++)
       {
         read_buf[i] = *((uint8_t *)flash_addr);
         flash_addr += 1;
       }
+#endif
       break;
     case 1:
       break;
@@ -105,6 +157,14 @@ usb_sts_type msc_disk_write(uint8_t lun, uint64_t addr, uint8_t *buf, uint32_t l
   switch(lun)
   {
     case 0:
+#ifdef MSC_USE_W25Q_FTL
+      /* sectors are appended to the active block, no erase in the foreground */
+      msc_ftl_pending = 1;
+      if(ftl_write(&msc_ftl, (uint32_t)addr / FTL_SECTOR_SIZE, buf, len / FTL_SECTOR_SIZE) != FTL_OK)
+      {
+        return USB_FAIL;
+      }
+#else
       flash_unlock();
       while(tolen >= page_len)
       {
@@ -117,6 +177,7 @@ usb_sts_type msc_disk_write(uint8_t lun, uint64_t addr, uint8_t *buf, uint32_t l
         flash_byte_program(flash_addr+i, buf[i]);
       }
       flash_lock();
+#endif
       break;
     case 1:
       break;
@@ -148,8 +209,13 @@ usb_sts_type msc_disk_capacity(uint8_t lun, uint32_t *blk_nbr, uint32_t *blk_siz
   switch(lun)
   {
     case INTERNAL_FLASH_LUN:
+#ifdef MSC_USE_W25Q_FTL
+      *blk_nbr = msc_ftl.sector_num;
+      *blk_size = FTL_SECTOR_SIZE;
+#else
       *blk_nbr = msc_flash_size / sector_size;
       *blk_size = sector_size;
+#endif
       break;
     case SPI_FLASH_LUN:
       break;
@@ -111,8 +111,8 @@ typedef struct
   uint32_t flash_app_size;
   uint32_t sector_size;
   uint32_t sector_mask;
-  uint32_t firmware_length;
-  uint32_t write_crc;
+  uint32_t firmware_length;                /*!< bytes written and verified so far */
+  uint32_t write_crc;                      /*!< running crc of the image, final digest at upgrade success */
   uint32_t read_crc;
 
   uint32_t write_addr;
@@ -0,0 +1,236 @@
+/**
+  **************************************************************************
+  * @file     ab_update_test.c
+  * @brief    a/b update on the simulated dual-bank flash with power cuts and a slot fallback
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+/*
+  the application downloads a new image into the inactive slot while the
+  background erase runs in the other bank: one chunk arrives every CHUNK_US
+  and is written as soon as its sectors are erased. power cuts stop the
+  background erase, the image writes and the metadata switch, and every boot
+  after them must start the slot of the last finished update. a damaged
+  active slot falls back to the other one.
+*/
+
+#include <string.h>
+#include "sim_flash.h"
+#include "ab_update.h"
+#include "iap_image.h"
+
+/** @addtogroup host_test
+  * @{
+  */
+
+#define IMAGE_LEN                        (96 * 1024)
+#define CHUNK_LEN                        1024
+#define CHUNK_US                         1000       /*!< a chunk arrives every ms */
+#define CPU_LOOP_US                      1          /*!< one pass of the main loop */
+#define META_PROGRAMS                    6          /*!< words of a record that are not 0xffffffff, record_crc last */
+
+typedef enum
+{
+  CUT_NONE,
+  CUT_AFTER,                             /*!< after cut_after flash operations */
+  CUT_META,                              /*!< at the record crc of the metadata switch */
+} cut_type;
+
+typedef struct
+{
+  const char                             *name;
+  uint8_t                                image;
+  uint32_t                               len;
+  cut_type                               cut;
+  uint32_t                               cut_after;
+  ab_slot_type                           boot_slot;    /*!< slot started by the next boot */
+  uint8_t                                boot_image;   /*!< image it holds */
+} ab_case_type;
+
+/* v1 factory image in slot a, v2 and v4 for slot b, v3 for slot a */
+static uint8_t image_buf[4][IMAGE_LEN];
+static uint32_t image_len[4];
+
+/**
+  * @brief  download an image into the inactive slot and switch to it.
+  * @param  pimage: image
+  * @param  len: length in byte
+  * @param  cut: where the power is cut
+  * @param  cut_after: flash operations before the cut, for CUT_AFTER
+  * @retval SIM_BOOT_RUN when the update finished, SIM_BOOT_POWER_CUT
+  */
+static int update_run(const uint8_t *pimage, uint32_t len, cut_type cut, uint32_t cut_after)
+{
+  static uint32_t chunk[CHUNK_LEN / sizeof(uint32_t)];
+  uint32_t offset, chunk_len, crc = 0xFFFFFFFF, i_index, meta_next;
+  uint64_t due_us;
+  ab_status_type status;
+  int boot;
+
+  boot = setjmp(sim_boot_jmp);
+  if(boot != SIM_BOOT_RUN)
+  {
+    return boot;
+  }
+
+  SIM_CHECK(ab_update_init() == AB_OK);
+  sim_flash_reset_stats();
+  sim_flash->cut_after = (cut == CUT_AFTER) ? cut_after : 0;
+
+  SIM_CHECK(ab_update_begin(len) == AB_OK);
+  for(offset = 0; offset < len; offset += CHUNK_LEN)
+  {
+    /* the last chunk is padded to a word */
+    chunk_len = (len - offset < CHUNK_LEN) ? len - offset : CHUNK_LEN;
+    memset(chunk, 0xFF, sizeof(chunk));
+    memcpy(chunk, pimage + offset, chunk_len);
+    chunk_len = (chunk_len + 3) & ~0x3;
+    for(i_index = 0; i_index < chunk_len / sizeof(uint32_t); i_index ++)
+    {
+      crc = sim_crc_word(crc, chunk[i_index]);
+    }
+
+    due_us = (uint64_t)(offset / CHUNK_LEN + 1) * CHUNK_US;
+    while(sim_flash->time_us < due_us)
+    {
+      ab_update_poll();
+      sim_time_advance(CPU_LOOP_US);
+    }
+    while((status = ab_update_write(offset, chunk, chunk_len)) == AB_BUSY)
+    {
+      ab_update_poll();
+      sim_time_advance(CPU_LOOP_US);
+    }
+    SIM_CHECK(status == AB_OK);
+  }
+
+  if(cut == CUT_META)
+  {
+    while((status = ab_update_poll()) == AB_BUSY)
+    {
+      sim_time_advance(CPU_LOOP_US);
+    }
+    SIM_CHECK(status == AB_OK);
+    /* a record starting a metadata sector erases it first */
+    meta_next = ab_update.meta_next;
+    if(meta_next >= AB_META_ADDR + AB_META_SECTOR_NUM * AB_SECTOR_SIZE)
+    {
+      meta_next = AB_META_ADDR;
+    }
+    sim_flash->cut_after = META_PROGRAMS + ((meta_next - AB_META_ADDR) % AB_SECTOR_SIZE == 0);
+  }
+  SIM_CHECK(ab_update_finish(crc) == AB_OK);
+  sim_flash->cut_after = 0;
+
+  printf("  %3u kb: time to update %5.2f s (flash busy %5.2f s, %u erases, %u programs)\n",
+         len / 1024, sim_flash->time_us / 1e6, sim_flash->flash_us / 1e6,
+         sim_flash->erase_count, sim_flash->program_count);
+  return SIM_BOOT_RUN;
+}
+
+/**
+  * @brief  one update, or none, then a boot.
+  * @param  arg: ab_case_type
+  * @retval none
+  */
+static void ab_case_run(void *arg)
+{
+  const ab_case_type *pcase = arg;
+  uint32_t boot_address = ab_update_slot_address(pcase->boot_slot);
+  int boot;
+
+  if(pcase->len != 0)
+  {
+    boot = update_run(image_buf[pcase->image], pcase->len, pcase->cut, pcase->cut_after);
+    sim_flash->cut_after = 0;
+    SIM_CHECK(boot == ((pcase->cut == CUT_NONE) ? SIM_BOOT_RUN : SIM_BOOT_POWER_CUT));
+    SIM_CHECK(sim_flash->lock_errors == 0);
+  }
+
+  /* reset, the bootloader picks the slot */
+  SIM_CHECK(ab_update_init() == AB_OK);
+  SIM_CHECK(ab_update_boot_address_get() == boot_address);
+  SIM_CHECK(memcmp((void *)boot_address, image_buf[pcase->boot_image], image_len[pcase->boot_image]) == 0);
+}
+
+/**
+  * @brief  the active slot loses a bit, the bootloader must start the other one.
+  * @param  arg: slot damaged
+  * @retval none
+  */
+static void ab_slot_damage(void *arg)
+{
+  ab_slot_type slot = *(const ab_slot_type *)arg;
+
+  SIM_CHECK(ab_update_init() == AB_OK);
+  SIM_CHECK(ab_update_active_slot_get() == slot);
+  *(uint8_t *)(ab_update_slot_address(slot) + IMAGE_LEN / 2) ^= 0x04;
+}
+
+static const ab_case_type ab_cases[] =
+{
+  /* name                                      image len            cut        after  boot slot   image */
+  {"factory image in slot a",                  0,    0,             CUT_NONE,  0,     AB_SLOT_A,  0},
+  {"update into slot b, odd length",           1,    IMAGE_LEN - 3, CUT_NONE,  0,     AB_SLOT_B,  1},
+  {"power cut in the background erase",        2,    IMAGE_LEN,     CUT_AFTER, 1,     AB_SLOT_B,  1},
+  {"power cut in the image write",             2,    IMAGE_LEN,     CUT_AFTER, 300,   AB_SLOT_B,  1},
+  {"power cut in the metadata switch",         2,    IMAGE_LEN,     CUT_META,  0,     AB_SLOT_B,  1},
+  {"update into slot a after the cuts",        2,    IMAGE_LEN,     CUT_NONE,  0,     AB_SLOT_A,  2},
+  {"update into slot b",                       3,    IMAGE_LEN,     CUT_NONE,  0,     AB_SLOT_B,  3},
+};
+
+/* after the damage of slot b, the boot falls back to v3 in slot a */
+static const ab_case_type ab_fallback = {"fallback to slot a", 0, 0, CUT_NONE, 0, AB_SLOT_A, 2};
+
+/**
+  * @brief  a/b update host test.
+  * @param  none
+  * @retval 0 when every scenario passed
+  */
+int main(void)
+{
+  static const ab_slot_type damaged = AB_SLOT_B;
+  uint32_t i_index;
+  int failed = 0;
+
+  sim_flash_init();
+  iap_image_make(image_buf[0], IMAGE_LEN, AB_SLOT_A_ADDR, 1);
+  iap_image_make(image_buf[1], IMAGE_LEN, AB_SLOT_B_ADDR, 2);
+  iap_image_make(image_buf[2], IMAGE_LEN, AB_SLOT_A_ADDR, 3);
+  iap_image_make(image_buf[3], IMAGE_LEN, AB_SLOT_B_ADDR, 4);
+  for(i_index = 0; i_index < 4; i_index ++)
+  {
+    image_len[i_index] = IMAGE_LEN;
+  }
+  image_len[1] = IMAGE_LEN - 3;
+  sim_flash_load(AB_SLOT_A_ADDR, image_buf[0], IMAGE_LEN);
+
+  for(i_index = 0; i_index < sizeof(ab_cases) / sizeof(ab_cases[0]); i_index ++)
+  {
+    failed |= sim_run(ab_cases[i_index].name, ab_case_run, (void *)&ab_cases[i_index]);
+  }
+  failed |= sim_run("active slot b damaged", ab_slot_damage, (void *)&damaged);
+  failed |= sim_run(ab_fallback.name, ab_case_run, (void *)&ab_fallback);
+  return failed;
+}
+
+/**
+  * @}
+  */
@@ -0,0 +1,444 @@
+/**
+  **************************************************************************
+  * @file     flash_log_test.c
+  * @brief    flash log on a ram flash, wrap-around, remounts and cut pages
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+/*
+  the log runs on ram copies shaped like the internal flash (2kb sectors) and
+  the w25q (4kb sectors), both with 256 byte pages. the backend follows the
+  flash: programming only clears bits and a byte is programmed once after its
+  erase. every record carries its number, the backend notes which records a
+  page holds and which erases dropped them, so after any remount the read-out
+  must return exactly the records still in the flash, in order.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+#include "flash_log.h"
+
+/** @addtogroup host_test
+  * @{
+  */
+
+#define RAM_SIZE_MAX                     0x8000
+#define RECORD_NUM_MAX                   400000
+#define RECORD_LEN_MAX                   60
+
+typedef struct
+{
+  uint32_t                               time;        /*!< program of its page, 0 never programmed */
+  uint16_t                               sector;
+  uint8_t                                cut_page;    /*!< in a page cut by a power loss */
+} record_state_type;
+
+static uint8_t ram[RAM_SIZE_MAX];
+static const flash_log_backend_type *backend;
+static record_state_type record[RECORD_NUM_MAX];
+static uint32_t erased_at[16];           /*!< program time of the last erase per sector */
+static uint32_t cut_erase_at[16];        /*!< program time of the last cut erase per sector */
+static uint32_t program_time;
+static uint32_t ops;                     /*!< erase and program calls */
+static uint32_t cut_at;                  /*!< op to cut, 0 none */
+static uint32_t overwrites;              /*!< bytes programmed twice */
+static uint32_t cut_count[2];            /*!< erases and programs cut */
+static jmp_buf cut_jmp;
+static uint32_t rand_state = 1;
+static int failed;
+
+#define CHECK(cond)                      do { if(!(cond)) { printf("  check failed: %s (%s:%d)\n", #cond, __FILE__, __LINE__); failed = 1; return; } } while(0)
+
+/**
+  * @brief  xorshift random numbers, the same sequence on every run.
+  * @param  none
+  * @retval random number
+  */
+static uint32_t rand_next(void)
+{
+  rand_state ^= rand_state << 13;
+  rand_state ^= rand_state >> 17;
+  rand_state ^= rand_state << 5;
+  return rand_state;
+}
+
+/**
+  * @brief  read callback.
+  * @param  address: offset in the ram
+  * @param  pbuffer: data buffer
+  * @param  length: data length
+  * @retval 0
+  */
+static int ram_read(uint32_t address, uint8_t *pbuffer, uint32_t length)
+{
+  memcpy(pbuffer, ram + address, length);
+  return 0;
+}
+
+/**
+  * @brief  erase callback, a cut leaves half of the sector.
+  * @param  address: sector offset
+  * @retval 0
+  */
+static int ram_erase(uint32_t address)
+{
+  uint32_t size = backend->sector_size, sector = address / size;
+
+  if(cut_at != 0 && ++ ops == cut_at)
+  {
+    memset(ram + address + ((cut_at & 1) ? size / 2 : 0), 0xFF, size / 2);
+    cut_erase_at[sector] = program_time;
+    cut_count[0] ++;
+    longjmp(cut_jmp, 1);
+  }
+  memset(ram + address, 0xFF, size);
+  erased_at[sector] = program_time;
+  return 0;
+}
+
+/**
+  * @brief  program callback, the records of the page are noted.
+  * @note   a cut programs the first half of the page.
+  * @param  address: page offset
+  * @param  pbuffer: data
+  * @param  length: data length
+  * @retval 0
+  */
+static int ram_program(uint32_t address, const uint8_t *pbuffer, uint32_t length)
+{
+  uint32_t header = (address % backend->sector_size) ? 0 : FLASH_LOG_SECTOR_HEADER_SIZE;
+  uint32_t payload, offset, len, number, i;
+  uint8_t cut = (cut_at != 0 && ++ ops == cut_at);
+
+  program_time ++;
+  payload = pbuffer[header] | (pbuffer[header + 1] << 8);
+  for(offset = header + FLASH_LOG_PAGE_HEADER_SIZE; offset < header + FLASH_LOG_PAGE_HEADER_SIZE + payload;
+      offset += FLASH_LOG_RECORD_HEADER_SIZE + len)
+  {
+    len = pbuffer[offset] | (pbuffer[offset + 1] << 8);
+    memcpy(&number, pbuffer + offset + FLASH_LOG_RECORD_HEADER_SIZE, 4);
+    if(number < RECORD_NUM_MAX)
+    {
+      record[number].time = program_time;
+      record[number].sector = (uint16_t)(address / backend->sector_size);
+      record[number].cut_page = cut;
+    }
+  }
+
+  for(i = 0; i < (cut ? length / 2 : length); i ++)
+  {
+    if(ram[address + i] != 0xFF)
+    {
+      overwrites ++;
+    }
+    ram[address + i] &= pbuffer[i];
+  }
+  if(cut)
+  {
+    cut_count[1] ++;
+    longjmp(cut_jmp, 1);
+  }
+  return 0;
+}
+
+static const flash_log_backend_type ram_internal =
+{
+  0,
+  0x800,
+  8,
+  256,
+  ram_read,
+  ram_erase,
+  ram_program,
+};
+
+static const flash_log_backend_type ram_w25q =
+{
+  0,
+  0x1000,
+  5,
+  256,
+  ram_read,
+  ram_erase,
+  ram_program,
+};
+
+/**
+  * @brief  record contents, derived from its number.
+  * @param  number: record number
+  * @param  pdata: record buffer
+  * @retval record length
+  */
+static uint32_t record_make(uint32_t number, uint8_t *pdata)
+{
+  uint32_t len = 4 + number % (RECORD_LEN_MAX - 3), i;
+
+  memcpy(pdata, &number, 4);
+  for(i = 4; i < len; i ++)
+  {
+    pdata[i] = (uint8_t)(number * 7 + i);
+  }
+  return len;
+}
+
+/**
+  * @brief  a record that is still in the flash.
+  * @param  number: record number
+  * @retval 1 when its page was programmed and its sector not erased since
+  */
+static int record_alive(uint32_t number)
+{
+  record_state_type *prec = &record[number];
+
+  return prec->time != 0 && prec->cut_page == 0 && prec->time > erased_at[prec->sector] &&
+         prec->time > cut_erase_at[prec->sector];
+}
+
+/**
+  * @brief  a record the read-out may return: alive, or in a page or sector cut
+  *         half way.
+  * @param  number: record number
+  * @retval 1 when allowed
+  */
+static int record_allowed(uint32_t number)
+{
+  record_state_type *prec = &record[number];
+
+  return record_alive(number) ||
+         (prec->time != 0 && prec->time > erased_at[prec->sector] &&
+          (prec->cut_page || prec->time <= cut_erase_at[prec->sector]));
+}
+
+/**
+  * @brief  read the whole log and compare it with the records in the flash.
+  * @param  log: log
+  * @param  written: records written so far
+  * @param  count: records read
+  * @retval none
+  */
+static void log_check(flash_log_type *log, uint32_t written, uint32_t *count)
+{
+  static flash_log_cursor_type cursor;
+  uint8_t data[RECORD_LEN_MAX], expect[RECORD_LEN_MAX];
+  uint32_t len, number, last = 0, alive = 0, i;
+  uint8_t first = 1;
+
+  *count = 0;
+  flash_log_read_start(log, &cursor);
+  while(flash_log_read(log, &cursor, data, sizeof(data), &len) == FLASH_LOG_OK)
+  {
+    memcpy(&number, data, 4);
+    CHECK(number < written && (first || number > last));
+    CHECK(len == record_make(number, expect) && memcmp(data, expect, len) == 0);
+    CHECK(record_allowed(number));
+    alive += record_alive(number);
+    first = 0;
+    last = number;
+    (*count) ++;
+  }
+  /* every record still in the flash was returned */
+  for(i = 0; i < written; i ++)
+  {
+    alive -= record_alive(i);
+  }
+  CHECK(alive == 0);
+}
+
+/**
+  * @brief  start a test on an erased ram flash.
+  * @param  pbackend: flash shape
+  * @retval none
+  */
+static void ram_reset(const flash_log_backend_type *pbackend)
+{
+  backend = pbackend;
+  memset(ram, 0xFF, sizeof(ram));
+  memset(record, 0, sizeof(record));
+  memset(erased_at, 0, sizeof(erased_at));
+  memset(cut_erase_at, 0, sizeof(cut_erase_at));
+  program_time = 0;
+  ops = 0;
+  cut_at = 0;
+  overwrites = 0;
+  rand_state = 1;
+}
+
+/**
+  * @brief  the log wraps many times, with and without idle erases.
+  * @param  pbackend: flash shape
+  * @param  name: flash name
+  * @retval none
+  */
+static void test_wrap(const flash_log_backend_type *pbackend, const char *name)
+{
+  static flash_log_type log;
+  static flash_log_cursor_type cursor;
+  uint8_t data[RECORD_LEN_MAX];
+  uint32_t number, count, len, capacity, old_first, last;
+
+  ram_reset(pbackend);
+  CHECK(flash_log_init(&log, backend) == FLASH_LOG_OK);
+  capacity = backend->sector_num * backend->sector_size;
+
+  /* a cursor on the first records, overtaken by the writer */
+  for(number = 0; number < 20; number ++)
+  {
+    CHECK(flash_log_write(&log, data, record_make(number, data)) == FLASH_LOG_OK);
+  }
+  CHECK(flash_log_flush(&log) == FLASH_LOG_OK);
+  flash_log_read_start(&log, &cursor);
+  CHECK(flash_log_read(&log, &cursor, data, sizeof(data), &len) == FLASH_LOG_OK);
+  memcpy(&old_first, data, 4);
+  CHECK(old_first == 0);
+
+  for(; number < 20 * capacity / RECORD_LEN_MAX; number ++)
+  {
+    CHECK(flash_log_write(&log, data, record_make(number, data)) == FLASH_LOG_OK);
+    /* idle most of the time, in the busy stretches the flushes wait for the erases */
+    if(((number / 300) % 3) != 0)
+    {
+      CHECK(flash_log_idle(&log) == FLASH_LOG_OK);
+    }
+  }
+  CHECK(flash_log_flush(&log) == FLASH_LOG_OK);
+  CHECK(overwrites == 0 && log.stall_erases > 0);
+
+  log_check(&log, number, &count);
+  if(failed)
+  {
+    return;
+  }
+  /* the newest sectors are kept, the sector erased ahead is lost */
+  CHECK(count * RECORD_LEN_MAX / 2 > (backend->sector_num - 2) * backend->sector_size / 2);
+
+  /* the overtaken cursor ends the page it holds and goes on from the oldest sector */
+  do
+  {
+    last = old_first;
+    CHECK(flash_log_read(&log, &cursor, data, sizeof(data), &len) == FLASH_LOG_OK);
+    memcpy(&old_first, data, 4);
+  } while(old_first == last + 1);
+  CHECK(cursor.lost > 0 && old_first > 20);
+
+  printf("  %s: %u records written, %u kept, %u erases, %u erases a flush waited for\n",
+         name, number, count, log.erases, log.stall_erases);
+}
+
+/**
+  * @brief  the log is mounted again between writes, with and without power
+  *         cuts, and the read-out is checked after every mount.
+  * @param  pbackend: flash shape
+  * @param  name: flash name
+  * @param  cut_mean: mean ops between cuts, 0 none
+  * @retval none
+  */
+static void test_remount(const flash_log_backend_type *pbackend, const char *name, uint32_t cut_mean)
+{
+  static flash_log_type log;
+  static volatile uint32_t number, mounts;
+  uint8_t data[RECORD_LEN_MAX];
+  uint32_t count = 0, burst, i;
+
+  ram_reset(pbackend);
+  cut_count[0] = 0;
+  cut_count[1] = 0;
+  number = 0;
+  mounts = 0;
+  CHECK(flash_log_init(&log, backend) == FLASH_LOG_OK);
+  if(cut_mean)
+  {
+    cut_at = 1 + rand_next() % (2 * cut_mean);
+  }
+
+  while(number < 30000)
+  {
+    if(setjmp(cut_jmp) == 0)
+    {
+      burst = rand_next() % 200;
+      for(i = 0; i < burst; i ++, number ++)
+      {
+        CHECK(flash_log_write(&log, data, record_make(number, data)) == FLASH_LOG_OK);
+        if((rand_next() % 4) == 0)
+        {
+          CHECK(flash_log_idle(&log) == FLASH_LOG_OK);
+        }
+      }
+      /* records still staged are lost by the remount unless flushed */
+      if(rand_next() & 1)
+      {
+        CHECK(flash_log_flush(&log) == FLASH_LOG_OK);
+      }
+    }
+    else
+    {
+      /* the record being written when the power went is not counted */
+      number ++;
+      cut_at = ops + 1 + rand_next() % (2 * cut_mean);
+    }
+
+    /* the mount itself may be cut */
+    while(setjmp(cut_jmp) != 0)
+    {
+      cut_at = ops + 1 + rand_next() % (2 * cut_mean);
+    }
+    CHECK(flash_log_init(&log, backend) == FLASH_LOG_OK);
+    mounts ++;
+    log_check(&log, number, &count);
+    if(failed)
+    {
+      return;
+    }
+  }
+  CHECK(overwrites == 0);
+  cut_at = 0;
+
+  printf("  %s: %u records, %u mounts, %u kept by the last one", name, number, mounts, count);
+  if(cut_mean)
+  {
+    printf(", %u erases and %u pages cut", cut_count[0], cut_count[1]);
+    CHECK(cut_count[0] > 0 && cut_count[1] > 0);
+  }
+  printf("\n");
+}
+
+/**
+  * @brief  flash log host test.
+  * @param  none
+  * @retval 0 when every scenario passed
+  */
+int main(void)
+{
+  printf("wrap-around\n");
+  test_wrap(&ram_internal, "internal flash");
+  test_wrap(&ram_w25q, "w25q");
+  printf("remount\n");
+  test_remount(&ram_internal, "internal flash", 0);
+  test_remount(&ram_w25q, "w25q", 0);
+  printf("remount after power cuts\n");
+  test_remount(&ram_internal, "internal flash", 40);
+  test_remount(&ram_w25q, "w25q", 40);
+  printf(failed ? "FAILED\n" : "all scenarios passed\n");
+  return failed;
+}
+
+/**
+  * @}
+  */
@@ -0,0 +1,194 @@
+/**
+  **************************************************************************
+  * @file     at32f403a_407.h
+  * @brief    host stand-in for the device header, used by the host tests
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+/*!< define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AT32F403A_407_H
+#define __AT32F403A_407_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+
+/** @addtogroup host_test
+  * @{
+  */
+
+/** @defgroup host_device_definition
+  * @brief    only what the code under test uses. the main flash is mapped at
+  *           FLASH_BASE by sim_flash_init, so the code reads it directly, and
+  *           the drivers below are implemented by sim_device.c.
+  * @{
+  */
+
+#define __IO                             volatile
+
+typedef uint32_t u32;
+typedef uint16_t u16;
+typedef uint8_t  u8;
+
+typedef enum {RESET = 0, SET = !RESET} flag_status;
+typedef enum {FALSE = 0, TRUE = !FALSE} confirm_state;
+typedef enum {ERROR = 0, SUCCESS = !ERROR} error_status;
+
+#define FLASH_BASE                       ((uint32_t)0x08000000)
+#define FLASH_BANK1_START_ADDR           ((uint32_t)0x08000000)
+#define FLASH_BANK1_END_ADDR             ((uint32_t)0x0807FFFF)
+#define FLASH_BANK2_START_ADDR           ((uint32_t)0x08080000)
+#define FLASH_SIZE_REG_ADDR              ((uint32_t)0x1FFFF7E0)
+#define ERASE_TIMEOUT                    ((uint32_t)0x40000000)
+
+typedef enum
+{
+  FLASH_OPERATE_BUSY                     = 0x00,
+  FLASH_PROGRAM_ERROR                    = 0x01,
+  FLASH_EPP_ERROR                        = 0x02,
+  FLASH_OPERATE_DONE                     = 0x03,
+  FLASH_OPERATE_TIMEOUT                  = 0x04
+} flash_status_type;
+
+typedef enum
+{
+  USART1_IRQn,
+  TMR3_GLOBAL_IRQn,
+  EMAC_IRQn,
+  USBFS_L_CAN1_RX0_IRQn,
+} IRQn_Type;
+
+typedef enum
+{
+  CRM_CRC_PERIPH_CLOCK,
+  CRM_DMA1_PERIPH_CLOCK,
+  CRM_GPIOA_PERIPH_CLOCK,
+  CRM_TMR3_PERIPH_CLOCK,
+  CRM_USART1_PERIPH_CLOCK,
+  CRM_EMAC_PERIPH_CLOCK,
+  CRM_EMACTX_PERIPH_CLOCK,
+  CRM_EMACRX_PERIPH_CLOCK,
+  CRM_USB_PERIPH_CLOCK,
+} crm_periph_clock_type;
+
+typedef enum
+{
+  CRM_USB_PERIPH_RESET,
+} crm_periph_reset_type;
+
+typedef struct
+{
+  uint32_t                               id;
+} usart_type;
+
+typedef struct
+{
+  uint32_t                               id;
+} dma_channel_type;
+
+/* the sector erase bits of both banks, an erase started here runs in the
+   background until the bank wait function collects it */
+typedef struct
+{
+  struct
+  {
+    __IO uint32_t secers;
+    __IO uint32_t erstr;
+  } ctrl_bit;
+  __IO uint32_t addr;
+  struct
+  {
+    __IO uint32_t secers;
+    __IO uint32_t erstr;
+  } ctrl2_bit;
+  __IO uint32_t addr2;
+} flash_type;
+
+extern flash_type                        host_flash;
+extern usart_type                        host_usart1;
+extern dma_channel_type                  host_dma1_channel5;
+
+#define FLASH                            (&host_flash)
+#define USART1                           (&host_usart1)
+#define DMA1_CHANNEL5                    (&host_dma1_channel5)
+#define USART_TDC_FLAG                   ((uint32_t)0x00000040)
+#define USART_RDBF_INT                   ((uint32_t)0x00000C05)
+
+/**
+  * @}
+  */
+
+/** @defgroup host_device_exported_functions
+  * @{
+  */
+
+void              flash_unlock(void);
+void              flash_lock(void);
+void              flash_bank1_unlock(void);
+void              flash_bank1_lock(void);
+void              flash_bank2_unlock(void);
+void              flash_bank2_lock(void);
+flash_status_type flash_bank1_operation_wait_for(uint32_t time_out);
+flash_status_type flash_bank2_operation_wait_for(uint32_t time_out);
+flash_status_type flash_sector_erase(uint32_t sector_address);
+flash_status_type flash_word_program(uint32_t address, uint32_t data);
+flash_status_type flash_halfword_program(uint32_t address, uint16_t data);
+uint32_t          flash_crc_calibrate(uint32_t start_sector, uint32_t sector_cnt);
+
+void              crc_data_reset(void);
+uint32_t          crc_one_word_calculate(uint32_t data);
+uint32_t          crc_block_calculate(uint32_t *pbuffer, uint32_t length);
+uint32_t          crc_data_get(void);
+void              crc_init_data_set(uint32_t value);
+
+void              crm_periph_clock_enable(crm_periph_clock_type value, confirm_state new_state);
+void              crm_periph_reset(crm_periph_reset_type value, confirm_state new_state);
+void              crm_reset(void);
+void              dma_reset(dma_channel_type *dmax_channely);
+void              nvic_irq_disable(IRQn_Type irqn);
+void              __NVIC_ClearPendingIRQ(IRQn_Type irqn);
+void              __set_MSP(uint32_t top_of_main_stack);
+uint32_t          __get_PRIMASK(void);
+void              __set_PRIMASK(uint32_t pri_mask);
+void              __disable_irq(void);
+void              NVIC_SystemReset(void);
+
+/* implemented by the usart transport of the test */
+void              usart_data_transmit(usart_type *usart_x, uint16_t data);
+flag_status       usart_flag_get(usart_type *usart_x, uint32_t flag);
+void              usart_interrupt_enable(usart_type *usart_x, uint32_t usart_int, confirm_state new_state);
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,233 @@
+/**
+  **************************************************************************
+  * @file     sim_device.c
+  * @brief    host drivers for the code under test, backed by sim_flash
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+#include "at32f403a_407_board.h"
+#include "sim_flash.h"
+
+/** @addtogroup host_test
+  * @{
+  */
+
+flash_type host_flash;
+usart_type host_usart1 = {1};
+dma_channel_type host_dma1_channel5 = {5};
+
+static uint32_t crc_init = 0xFFFFFFFF;
+static uint32_t crc_value = 0xFFFFFFFF;
+static uint32_t primask = 0;
+
+void flash_unlock(void)
+{
+  sim_flash->locked = 0;
+  sim_flash->locked_bank2 = 0;
+}
+
+void flash_lock(void)
+{
+  sim_flash->locked = 1;
+  sim_flash->locked_bank2 = 1;
+}
+
+void flash_bank1_unlock(void)
+{
+  sim_flash->locked = 0;
+}
+
+void flash_bank1_lock(void)
+{
+  sim_flash->locked = 1;
+}
+
+void flash_bank2_unlock(void)
+{
+  sim_flash->locked_bank2 = 0;
+}
+
+void flash_bank2_lock(void)
+{
+  sim_flash->locked_bank2 = 1;
+}
+
+flash_status_type flash_bank1_operation_wait_for(uint32_t time_out)
+{
+  return sim_flash_bank_wait(0, time_out);
+}
+
+flash_status_type flash_bank2_operation_wait_for(uint32_t time_out)
+{
+  return sim_flash_bank_wait(1, time_out);
+}
+
+flash_status_type flash_sector_erase(uint32_t sector_address)
+{
+  return sim_flash_erase(sector_address);
+}
+
+flash_status_type flash_word_program(uint32_t address, uint32_t data)
+{
+  return sim_flash_program(address, data, 4);
+}
+
+flash_status_type flash_halfword_program(uint32_t address, uint16_t data)
+{
+  return sim_flash_program(address, data, 2);
+}
+
+/**
+  * @brief  flash crc unit, counts sectors from the start of the main flash.
+  * @param  start_sector: first sector
+  * @param  sector_cnt: sector count
+  * @retval crc value
+  */
+uint32_t flash_crc_calibrate(uint32_t start_sector, uint32_t sector_cnt)
+{
+  uint32_t size = sim_flash_sector_size();
+  const uint32_t *pdata = (const uint32_t *)(uintptr_t)(FLASH_BASE + start_sector * size);
+  uint32_t words = sector_cnt * size / 4, crc = 0xFFFFFFFF, i_index;
+
+  for(i_index = 0; i_index < words; i_index ++)
+  {
+    crc = sim_crc_word(crc, pdata[i_index]);
+  }
+  sim_time_advance((uint64_t)words * SIM_FLASH_CRC_NS_PER_WORD / 1000);
+  return crc;
+}
+
+void crc_data_reset(void)
+{
+  crc_value = crc_init;
+}
+
+uint32_t crc_one_word_calculate(uint32_t data)
+{
+  crc_value = sim_crc_word(crc_value, data);
+  return crc_value;
+}
+
+uint32_t crc_block_calculate(uint32_t *pbuffer, uint32_t length)
+{
+  uint32_t i_index;
+
+  for(i_index = 0; i_index < length; i_index ++)
+  {
+    crc_value = sim_crc_word(crc_value, pbuffer[i_index]);
+  }
+  return crc_value;
+}
+
+uint32_t crc_data_get(void)
+{
+  return crc_value;
+}
+
+void crc_init_data_set(uint32_t value)
+{
+  crc_init = value;
+}
+
+void crm_periph_clock_enable(crm_periph_clock_type value, confirm_state new_state)
+{
+  (void)value;
+  (void)new_state;
+}
+
+void crm_periph_reset(crm_periph_reset_type value, confirm_state new_state)
+{
+  (void)value;
+  (void)new_state;
+}
+
+void crm_reset(void)
+{
+}
+
+void dma_reset(dma_channel_type *dmax_channely)
+{
+  (void)dmax_channely;
+}
+
+void nvic_irq_disable(IRQn_Type irqn)
+{
+  (void)irqn;
+}
+
+void __NVIC_ClearPendingIRQ(IRQn_Type irqn)
+{
+  (void)irqn;
+}
+
+/**
+  * @brief  the last step of app_load before the jump, the app is started.
+  * @param  top_of_main_stack: app stack pointer
+  * @retval none
+  */
+void __set_MSP(uint32_t top_of_main_stack)
+{
+  sim_flash->app_sp = top_of_main_stack;
+  longjmp(sim_boot_jmp, SIM_BOOT_APP);
+}
+
+/**
+  * @brief  interrupt mask, the tests hold their interrupts while it is set.
+  * @param  none
+  * @retval mask
+  */
+uint32_t __get_PRIMASK(void)
+{
+  return primask;
+}
+
+void __set_PRIMASK(uint32_t pri_mask)
+{
+  primask = pri_mask;
+}
+
+void __disable_irq(void)
+{
+  primask = 1;
+}
+
+void NVIC_SystemReset(void)
+{
+  longjmp(sim_boot_jmp, SIM_BOOT_RESET);
+}
+
+void delay_us(uint32_t nus)
+{
+  sim_time_advance(nus);
+}
+
+void delay_ms(uint16_t nms)
+{
+  sim_time_advance((uint64_t)nms * 1000);
+}
+
+void at32_led_toggle(uint32_t led)
+{
+  (void)led;
+}
+
+/**
+  * @}
+  */
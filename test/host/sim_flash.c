@@ -0,0 +1,424 @@
+/**
+  **************************************************************************
+  * @file     sim_flash.c
+  * @brief    simulated internal flash with timing and fault injection
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "sim_flash.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE              0
+#endif
+
+/** @addtogroup host_test
+  * @{
+  */
+
+#define SIM_SYSTEM_PAGE                  0x1FFFF000
+
+/* a sector erase started through the flash registers */
+typedef struct
+{
+  uint32_t                               address;
+  uint64_t                               done_us;
+  uint8_t                                busy;
+  flash_status_type                      status;        /*!< of the last erase */
+} sim_bank_erase_type;
+
+sim_flash_state_type *sim_flash;
+jmp_buf sim_boot_jmp;
+void (*sim_time_hook)(void);
+
+static sim_bank_erase_type sim_bank_erase[2] = {{0, 0, 0, FLASH_OPERATE_DONE}, {0, 0, 0, FLASH_OPERATE_DONE}};
+
+/**
+  * @brief  map shared memory at a fixed address.
+  * @param  address: address
+  * @param  len: length
+  * @retval none
+  */
+static void sim_map(uint32_t address, uint32_t len)
+{
+  void *p = mmap((void *)(uintptr_t)address, len, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+  if(p != (void *)(uintptr_t)address)
+  {
+    fprintf(stderr, "cannot map 0x%08x\n", (unsigned)address);
+    exit(2);
+  }
+}
+
+/**
+  * @brief  map the main flash at FLASH_BASE, erased, and the flash size register.
+  * @note   call once before the first scenario.
+  * @param  none
+  * @retval none
+  */
+void sim_flash_init(void)
+{
+  sim_map(FLASH_BASE, SIM_FLASH_SIZE_KB * 1024);
+  sim_map(SIM_SYSTEM_PAGE, 0x1000);
+  *(uint32_t *)(uintptr_t)FLASH_SIZE_REG_ADDR = SIM_FLASH_SIZE_KB;
+
+  sim_flash = mmap(NULL, sizeof(sim_flash_state_type), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if(sim_flash == MAP_FAILED)
+  {
+    exit(2);
+  }
+  memset(sim_flash, 0, sizeof(sim_flash_state_type));
+  sim_flash->locked = 1;
+  sim_flash->locked_bank2 = 1;
+  sim_flash_fill(FLASH_BASE, SIM_FLASH_SIZE_KB * 1024, 0xFF);
+}
+
+/**
+  * @brief  set flash content directly, without timing.
+  * @param  address: start address
+  * @param  len: length
+  * @param  value: byte value
+  * @retval none
+  */
+void sim_flash_fill(uint32_t address, uint32_t len, uint8_t value)
+{
+  memset((void *)(uintptr_t)address, value, len);
+}
+
+/**
+  * @brief  set flash content directly, without timing.
+  * @param  address: start address
+  * @param  pdata: content
+  * @param  len: length
+  * @retval none
+  */
+void sim_flash_load(uint32_t address, const void *pdata, uint32_t len)
+{
+  memcpy((void *)(uintptr_t)address, pdata, len);
+}
+
+/**
+  * @brief  sector size, 1kb below 256kb of flash.
+  * @param  none
+  * @retval sector size
+  */
+uint32_t sim_flash_sector_size(void)
+{
+  return (SIM_FLASH_SIZE_KB < 256) ? 0x400 : 0x800;
+}
+
+/**
+  * @brief  clear the counters and the time, the faults stay armed.
+  * @param  none
+  * @retval none
+  */
+void sim_flash_reset_stats(void)
+{
+  sim_flash->time_us = 0;
+  sim_flash->flash_us = 0;
+  sim_flash->erase_count = 0;
+  sim_flash->program_count = 0;
+  sim_flash->lock_errors = 0;
+}
+
+/**
+  * @brief  count one flash operation towards the power cut.
+  * @param  none
+  * @retval 1 when the power is cut during this operation
+  */
+static uint8_t sim_flash_cut(void)
+{
+  if(sim_flash->cut_after == 0)
+  {
+    return 0;
+  }
+  return (-- sim_flash->cut_after == 0);
+}
+
+/**
+  * @brief  lock state of the bank holding an address.
+  * @param  address: flash address
+  * @retval 1 when the bank is locked
+  */
+static uint8_t sim_flash_locked(uint32_t address)
+{
+  return (address > FLASH_BANK1_END_ADDR) ? sim_flash->locked_bank2 : sim_flash->locked;
+}
+
+/**
+  * @brief  start the erases set up in the flash registers and end the ones
+  *         whose time has passed.
+  * @note   a cut erase leaves the second half of the sector untouched.
+  * @param  none
+  * @retval none
+  */
+static void sim_flash_background(void)
+{
+  uint32_t size = sim_flash_sector_size();
+  sim_bank_erase_type *perase;
+  uint32_t bank, address;
+
+  for(bank = 0; bank < 2; bank ++)
+  {
+    perase = &sim_bank_erase[bank];
+    if(bank == 0 && FLASH->ctrl_bit.erstr && FLASH->ctrl_bit.secers)
+    {
+      FLASH->ctrl_bit.erstr = 0;
+      address = FLASH->addr;
+    }
+    else if(bank == 1 && FLASH->ctrl2_bit.erstr && FLASH->ctrl2_bit.secers)
+    {
+      FLASH->ctrl2_bit.erstr = 0;
+      address = FLASH->addr2;
+    }
+    else
+    {
+      address = 0;
+    }
+
+    if(address != 0 && perase->busy == 0)
+    {
+      perase->address = address & ~(size - 1);
+      perase->status = FLASH_OPERATE_DONE;
+      if(sim_flash_locked(address))
+      {
+        sim_flash->lock_errors ++;
+        perase->status = FLASH_PROGRAM_ERROR;
+      }
+      else
+      {
+        perase->busy = 1;
+        perase->done_us = sim_flash->time_us + SIM_FLASH_ERASE_US;
+        sim_flash->erase_count ++;
+        sim_flash->flash_us += SIM_FLASH_ERASE_US;
+      }
+    }
+
+    if(perase->busy && sim_flash->time_us >= perase->done_us)
+    {
+      perase->busy = 0;
+      if(sim_flash_cut())
+      {
+        sim_flash_fill(perase->address, size / 2, 0xFF);
+        longjmp(sim_boot_jmp, SIM_BOOT_POWER_CUT);
+      }
+      sim_flash_fill(perase->address, size, 0xFF);
+    }
+  }
+}
+
+/**
+  * @brief  advance the simulated time.
+  * @note   sim_time_hook runs the interrupts that became due, background
+  *         erases run on.
+  * @param  us: microseconds
+  * @retval none
+  */
+void sim_time_advance(uint64_t us)
+{
+  sim_flash_background();
+  sim_flash->time_us += us;
+  sim_flash_background();
+  if(sim_time_hook != NULL)
+  {
+    sim_time_hook();
+  }
+}
+
+/**
+  * @brief  wait for the background erase of a bank.
+  * @note   one count of time_out is taken as 1us.
+  * @param  bank: 0 bank1, 1 bank2
+  * @param  time_out: count
+  * @retval FLASH_OPERATE_TIMEOUT while the erase still runs
+  */
+flash_status_type sim_flash_bank_wait(uint32_t bank, uint32_t time_out)
+{
+  sim_bank_erase_type *perase = &sim_bank_erase[bank];
+
+  sim_flash_background();
+  if(perase->busy)
+  {
+    if(perase->done_us - sim_flash->time_us > time_out)
+    {
+      sim_time_advance(time_out);
+      return FLASH_OPERATE_TIMEOUT;
+    }
+    sim_time_advance(perase->done_us - sim_flash->time_us);
+  }
+  return perase->status;
+}
+
+/**
+  * @brief  erase the sector holding an address.
+  * @note   a cut erase leaves the second half of the sector untouched.
+  * @param  address: address in the sector
+  * @retval flash status
+  */
+flash_status_type sim_flash_erase(uint32_t address)
+{
+  uint32_t size = sim_flash_sector_size();
+  uint32_t start = address & ~(size - 1);
+
+  if(address < FLASH_BASE || address >= FLASH_BASE + SIM_FLASH_SIZE_KB * 1024)
+  {
+    return FLASH_PROGRAM_ERROR;
+  }
+  if(sim_flash_locked(address))
+  {
+    sim_flash->lock_errors ++;
+    return FLASH_PROGRAM_ERROR;
+  }
+
+  sim_flash->erase_count ++;
+  sim_flash->flash_us += SIM_FLASH_ERASE_US;
+  sim_time_advance(SIM_FLASH_ERASE_US);
+  if(sim_flash_cut())
+  {
+    sim_flash_fill(start, size / 2, 0xFF);
+    longjmp(sim_boot_jmp, SIM_BOOT_POWER_CUT);
+  }
+  sim_flash_fill(start, size, 0xFF);
+  return FLASH_OPERATE_DONE;
+}
+
+/**
+  * @brief  program a halfword or a word.
+  * @note   a cut operation programs the low byte only.
+  * @param  address: aligned address
+  * @param  data: value
+  * @param  width: 2 or 4
+  * @retval flash status
+  */
+flash_status_type sim_flash_program(uint32_t address, uint32_t data, uint32_t width)
+{
+  uint32_t mask = (width == 2) ? 0xFFFF : 0xFFFFFFFF;
+  uint32_t us = (width == 2) ? SIM_FLASH_HALFWORD_US : SIM_FLASH_WORD_US;
+  uint32_t old, value;
+  uint8_t cut;
+
+  if(address < FLASH_BASE || address + width > FLASH_BASE + SIM_FLASH_SIZE_KB * 1024 ||
+     (address & (width - 1)) != 0)
+  {
+    return FLASH_PROGRAM_ERROR;
+  }
+  if(sim_flash_locked(address))
+  {
+    sim_flash->lock_errors ++;
+    return FLASH_PROGRAM_ERROR;
+  }
+
+  sim_flash->program_count ++;
+  sim_flash->flash_us += us;
+  sim_time_advance(us);
+
+  old = (width == 2) ? *(uint16_t *)(uintptr_t)address : *(uint32_t *)(uintptr_t)address;
+  if((old & mask) != mask)
+  {
+    /* the target is not erased */
+    return FLASH_PROGRAM_ERROR;
+  }
+  value = data & mask;
+  if((address & ~3) == sim_flash->stuck_addr && sim_flash->stuck_addr != 0)
+  {
+    value |= (sim_flash->stuck_mask >> (8 * (address & 3))) & mask;
+  }
+  cut = sim_flash_cut();
+  if(cut)
+  {
+    value |= mask & ~0xFF;
+  }
+
+  if(width == 2)
+  {
+    *(uint16_t *)(uintptr_t)address = (uint16_t)value;
+  }
+  else
+  {
+    *(uint32_t *)(uintptr_t)address = value;
+  }
+  if(cut)
+  {
+    longjmp(sim_boot_jmp, SIM_BOOT_POWER_CUT);
+  }
+  return FLASH_OPERATE_DONE;
+}
+
+/**
+  * @brief  one word through the crc unit: crc-32, polynomial 0x04c11db7, msb first.
+  * @param  crc: running value
+  * @param  data: word
+  * @retval new value
+  */
+uint32_t sim_crc_word(uint32_t crc, uint32_t data)
+{
+  uint32_t i_index;
+
+  crc ^= data;
+  for(i_index = 0; i_index < 32; i_index ++)
+  {
+    crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : (crc << 1);
+  }
+  return crc;
+}
+
+/**
+  * @brief  run a scenario in its own process.
+  * @note   the flash and sim_flash are shared, so a following scenario sees
+  *         what the previous one left, like a board after a reset.
+  * @param  name: scenario name
+  * @param  scenario: scenario function
+  * @param  arg: argument
+  * @retval 0 when the scenario passed
+  */
+int sim_run(const char *name, void (*scenario)(void *), void *arg)
+{
+  pid_t pid;
+  int status = 0;
+
+  printf("%s\n", name);
+  fflush(stdout);
+  pid = fork();
+  if(pid == 0)
+  {
+    scenario(arg);
+    fflush(stdout);
+    _exit(0);
+  }
+  waitpid(pid, &status, 0);
+  if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+  {
+    printf("  FAILED\n");
+    return 1;
+  }
+  return 0;
+}
+
+/**
+  * @}
+  */
@@ -0,0 +1,127 @@
+/**
+  **************************************************************************
+  * @file     sim_flash.h
+  * @brief    simulated internal flash with timing and fault injection header file
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+/*!< define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SIM_FLASH_H
+#define __SIM_FLASH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* includes ------------------------------------------------------------------*/
+#include <setjmp.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "at32f403a_407.h"
+
+/** @addtogroup host_test
+  * @{
+  */
+
+/** @defgroup sim_flash_definition
+  * @brief    the flash is nor: erase sets a sector to 0xff, programming only
+  *           clears bits and fails on a halfword that is not erased. the
+  *           timing is a model, set it from the datasheet of the part.
+  * @{
+  */
+
+#define SIM_FLASH_SIZE_KB                1024
+#define SIM_FLASH_ERASE_US               20000      /*!< one sector */
+#define SIM_FLASH_HALFWORD_US            40
+#define SIM_FLASH_WORD_US                50
+#define SIM_FLASH_CRC_NS_PER_WORD        10         /*!< flash crc unit */
+
+/* setjmp(sim_boot_jmp) values, the code under test never returns there by itself */
+#define SIM_BOOT_RUN                     0
+#define SIM_BOOT_APP                     1          /*!< __set_MSP, the app is started */
+#define SIM_BOOT_POWER_CUT               2          /*!< a flash operation was cut */
+#define SIM_BOOT_RESET                   3          /*!< NVIC_SystemReset */
+
+/**
+  * @}
+  */
+
+/** @defgroup sim_flash_types
+  * @{
+  */
+
+typedef struct
+{
+  uint64_t                               time_us;       /*!< simulated time */
+  uint64_t                               flash_us;      /*!< time spent in flash operations */
+  uint32_t                               erase_count;
+  uint32_t                               program_count;
+  uint32_t                               lock_errors;   /*!< operations on a locked flash */
+  uint32_t                               cut_after;     /*!< operations left before the power cut, 0 none */
+  uint32_t                               stuck_addr;    /*!< word holding bits stuck at 1, 0 none */
+  uint32_t                               stuck_mask;
+  uint8_t                                locked;        /*!< bank1 */
+  uint8_t                                locked_bank2;
+  uint32_t                               app_sp;        /*!< stack pointer given to the app */
+} sim_flash_state_type;
+
+/**
+  * @}
+  */
+
+/** @defgroup sim_flash_exported_functions
+  * @{
+  */
+
+/* shared by the scenario processes, so it survives a power cut */
+extern sim_flash_state_type *sim_flash;
+extern jmp_buf sim_boot_jmp;
+/* called whenever the simulated time moves, the test runs its interrupts there */
+extern void (*sim_time_hook)(void);
+
+void              sim_flash_init(void);
+void              sim_flash_fill(uint32_t address, uint32_t len, uint8_t value);
+void              sim_flash_load(uint32_t address, const void *pdata, uint32_t len);
+uint32_t          sim_flash_sector_size(void);
+flash_status_type sim_flash_erase(uint32_t address);
+flash_status_type sim_flash_program(uint32_t address, uint32_t data, uint32_t width);
+flash_status_type sim_flash_bank_wait(uint32_t bank, uint32_t time_out);
+void              sim_flash_reset_stats(void);
+void              sim_time_advance(uint64_t us);
+uint32_t          sim_crc_word(uint32_t crc, uint32_t data);
+int               sim_run(const char *name, void (*scenario)(void *), void *arg);
+
+/**
+  * @}
+  */
+
+/* a failed check ends the scenario process */
+#define SIM_CHECK(cond)                  do { if(!(cond)) { printf("  check failed: %s (%s:%d)\n", #cond, __FILE__, __LINE__); \
+                                              fflush(stdout); _exit(1); } } while(0)
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
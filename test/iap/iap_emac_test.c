@@ -0,0 +1,1190 @@
+/**
+  **************************************************************************
+  * @file     iap_emac_test.c
+  * @brief    emac iap bootloader on the host, tftp and http uploads against the simulated flash
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+/*
+  the bootloader sources (iap.c, flash.c, tftpserver.c, httpserver.c,
+  fsdata.c) are built unchanged with the real lwip headers. this file stands
+  in for the lwip udp, tcp and pbuf calls and for the ethernet:
+  - frames of the pc cross a 100 mbit/s link and wait in the EMAC_RXBUFNB
+    receive descriptors of ethernetif.c until the main loop takes them, a
+    frame finding every descriptor busy is lost.
+  - the pc tftp client sends windows of blocks (rfc7440) and resends from
+    the last ack after PC_TFTP_TIMEOUT_US.
+  - the pc http client posts the login and then the multipart upload as tcp
+    segments, no more than the receive window the bootloader advertises.
+  the decoder is wrapped (-Wl,--wrap=image_decode_feed) to charge the cpu
+  time of every byte it expands.
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "sim_flash.h"
+#include "iap.h"
+#include "flash.h"
+#include "tftpserver.h"
+#include "httpserver.h"
+#include "lwip/tcp.h"
+#include "lwip/udp.h"
+#include "lwip/pbuf.h"
+#include "image_codec.h"
+#include "iap_image.h"
+
+/** @addtogroup host_test
+  * @{
+  */
+
+#define IMAGE_LEN                        (96 * 1024)
+#define NET_BIT_NS                       10         /*!< 100 mbit/s */
+#define NET_UDP_OVERHEAD                 66         /*!< preamble, ethernet, ip, udp, gap */
+#define NET_TCP_OVERHEAD                 78
+#define NET_RXBUFNB                      6          /*!< EMAC_RXBUFNB of ethernetif.c */
+#define NET_WIRE_LEN                     512
+#define NET_FRAME_MAX                    1500
+#define NET_FRAME_US                     5          /*!< cpu time of lwip per received frame */
+#define NET_DECODE_NS_PER_BYTE           10         /*!< cpu time of the decoder */
+#define NET_UDP_PCB_MAX                  8
+#define NET_PC_PORT                      50000
+#define PC_LATENCY_US                    100
+#define PC_TFTP_TIMEOUT_US               1000000
+#define PC_TFTP_RETRY_MAX                10
+#define PC_TCP_RTO_US                    250000
+#define PC_RESPONSE_MAX                  0x4000
+#define CPU_LOOP_US                      1
+#define RUN_LIMIT_US                     120000000ull
+#define BOUNDARY                         "----AT32FormBoundary7MA4YWxk"
+
+typedef enum
+{
+  NET_UDP,
+  NET_TCP_SYN,
+  NET_TCP_DATA,
+} net_kind_type;
+
+typedef enum
+{
+  PC_TFTP,
+  PC_HTTP,
+} pc_proto_type;
+
+typedef enum
+{
+  EMAC_DONE,                             /*!< image programmed and accepted */
+  EMAC_REJECTED,                         /*!< tftp error or upload page again */
+  EMAC_CUT,                              /*!< power cut */
+} emac_expect_type;
+
+typedef struct
+{
+  uint64_t                               at_ns;
+  uint8_t                                kind;
+  uint16_t                               port;
+  uint32_t                               seq;
+  uint16_t                               len;
+  uint8_t                                data[NET_FRAME_MAX];
+} net_frame_type;
+
+typedef struct
+{
+  const char                             *name;
+  pc_proto_type                          proto;
+  uint16_t                               blksize;      /*!< tftp block size, 512 without options */
+  uint8_t                                windowsize;   /*!< tftp window size */
+  uint16_t                               segment;      /*!< http segment size */
+  int8_t                                 base;         /*!< image a delta patch is built on, -1 raw */
+  uint8_t                                image;        /*!< image to install */
+  uint16_t                               drop_every;   /*!< lose every n-th data frame, 0 none */
+  uint32_t                               cut_after;    /*!< flash operations before a power cut, 0 none */
+  emac_expect_type                       expect;
+  int                                    result;       /*!< slot in the shared results, -1 none */
+} emac_case_type;
+
+typedef struct
+{
+  /* pc to bootloader, frames on the wire and in the receive descriptors */
+  net_frame_type                         wire[NET_WIRE_LEN];
+  uint32_t                               wire_rd;
+  uint32_t                               wire_wr;
+  uint64_t                               line_free_ns;
+  net_frame_type                         rx[NET_RXBUFNB];
+  uint32_t                               rx_rd;
+  uint32_t                               rx_wr;
+  uint32_t                               rx_lost;
+  uint32_t                               data_frames;
+  uint64_t                               link_ns;
+  /* lwip stand-in */
+  struct udp_pcb                         *udp[NET_UDP_PCB_MAX];
+  uint16_t                               next_port;
+  tcp_accept_fn                          accept;
+  void                                   *accept_arg;
+  struct tcp_pcb                         *tcp;          /*!< the connection, one at a time */
+  uint8_t                                tcp_closed;
+  uint32_t                               rcv_nxt;
+  uint32_t                               rcv_unrecved;
+  uint32_t                               sent_pending;
+  uint64_t                               sent_at_ns;
+  int32_t                                pbufs;         /*!< pbufs not freed */
+  int32_t                                mems;          /*!< mem_malloc blocks not freed */
+  uint32_t                               progress;      /*!< decoder bytes and tcp_recved calls */
+  uint64_t                               decode_ns;
+} net_type;
+
+typedef struct
+{
+  const emac_case_type                   *pcase;
+  uint8_t                                *image;
+  uint32_t                               len;
+  uint8_t                                finished;
+  uint8_t                                failed;
+  uint64_t                               done_us;
+  uint32_t                               resends;
+  /* tftp */
+  uint16_t                               server_port;
+  uint32_t                               blocks;       /*!< the last one is shorter than blksize */
+  uint32_t                               next;         /*!< first block not acknowledged */
+  uint64_t                               last_ns;      /*!< last send or ack */
+  uint32_t                               retries;
+  uint32_t                               windowsize;   /*!< window size the server accepted */
+  uint8_t                                got_error;
+  /* http */
+  uint8_t                                phase;        /*!< 0 login, 1 upload, 2 reset */
+  uint8_t                                *req;
+  uint32_t                               req_len;
+  uint8_t                                connected;
+  uint32_t                               snd_una;
+  uint32_t                               snd_nxt;
+  uint32_t                               wnd;
+  uint8_t                                resp[PC_RESPONSE_MAX];
+  uint32_t                               resp_len;
+} pc_type;
+
+static net_type net;
+static pc_type pc;
+static uint8_t image_buf[3][IMAGE_LEN + 0x1000];
+static uint32_t image_len[3];
+static uint64_t *results;
+static const ip_addr_t pc_addr = IPADDR4_INIT(0x0200A8C0);
+const ip_addr_t ip_addr_any = IPADDR4_INIT(IPADDR_ANY);
+
+static void pc_udp_receive(uint16_t port, const uint8_t *pdata, uint32_t len);
+static void pc_tcp_ack(uint32_t ack, uint32_t wnd);
+static void pc_poll(void);
+
+/**
+  * @brief  current simulated time.
+  * @param  none
+  * @retval nanoseconds
+  */
+static uint64_t now_ns(void)
+{
+  return sim_flash->time_us * 1000;
+}
+
+/* ---------------------------------------------------------------- link --- */
+
+/**
+  * @brief  put a frame of the pc on the wire.
+  * @param  kind: net_kind_type
+  * @param  port: destination udp port
+  * @param  seq: tcp sequence number
+  * @param  pdata: payload
+  * @param  len: payload length
+  * @param  start_ns: earliest start
+  * @param  drop: the frame is lost on the way
+  * @retval none
+  */
+static void net_send(uint8_t kind, uint16_t port, uint32_t seq, const uint8_t *pdata, uint32_t len,
+                     uint64_t start_ns, uint8_t drop)
+{
+  uint64_t frame_ns = (uint64_t)(len + ((kind == NET_UDP) ? NET_UDP_OVERHEAD : NET_TCP_OVERHEAD)) * 8 * NET_BIT_NS;
+  net_frame_type *pframe;
+
+  if(net.line_free_ns < start_ns)
+  {
+    net.line_free_ns = start_ns;
+  }
+  net.line_free_ns += frame_ns;
+  net.link_ns += frame_ns;
+  if(drop)
+  {
+    return;
+  }
+  SIM_CHECK(net.wire_wr - net.wire_rd < NET_WIRE_LEN && len <= NET_FRAME_MAX);
+  pframe = &net.wire[net.wire_wr % NET_WIRE_LEN];
+  pframe->at_ns = net.line_free_ns;
+  pframe->kind = kind;
+  pframe->port = port;
+  pframe->seq = seq;
+  pframe->len = (uint16_t)len;
+  memcpy(pframe->data, pdata, len);
+  net.wire_wr ++;
+}
+
+/**
+  * @brief  the emac dma stores the frames that arrived, runs with the time.
+  * @param  none
+  * @retval none
+  */
+static void net_time_hook(void)
+{
+  while(net.wire_rd != net.wire_wr && net.wire[net.wire_rd % NET_WIRE_LEN].at_ns <= now_ns())
+  {
+    if(net.rx_wr - net.rx_rd < NET_RXBUFNB)
+    {
+      net.rx[net.rx_wr % NET_RXBUFNB] = net.wire[net.wire_rd % NET_WIRE_LEN];
+      net.rx_wr ++;
+    }
+    else
+    {
+      /* no free descriptor */
+      net.rx_lost ++;
+    }
+    net.wire_rd ++;
+  }
+  pc_poll();
+}
+
+/* ---------------------------------------------------------------- pbuf --- */
+
+struct pbuf *pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
+{
+  struct pbuf *p = calloc(1, sizeof(struct pbuf) + length);
+
+  (void)layer;
+  (void)type;
+  if(p != NULL)
+  {
+    p->payload = p + 1;
+    p->len = length;
+    p->tot_len = length;
+    p->ref = 1;
+    net.pbufs ++;
+  }
+  return p;
+}
+
+u8_t pbuf_free(struct pbuf *p)
+{
+  struct pbuf *q;
+  u8_t count = 0;
+
+  while(p != NULL && -- p->ref == 0)
+  {
+    q = p->next;
+    free(p);
+    net.pbufs --;
+    count ++;
+    p = q;
+  }
+  return count;
+}
+
+void pbuf_cat(struct pbuf *head, struct pbuf *tail)
+{
+  struct pbuf *p;
+
+  for(p = head; p->next != NULL; p = p->next)
+  {
+    p->tot_len += tail->tot_len;
+  }
+  p->tot_len += tail->tot_len;
+  p->next = tail;
+}
+
+struct pbuf *pbuf_free_header(struct pbuf *q, u16_t size)
+{
+  struct pbuf *p = q, *f;
+
+  while(size && p != NULL)
+  {
+    if(size >= p->len)
+    {
+      f = p;
+      size -= p->len;
+      p = p->next;
+      f->next = NULL;
+      pbuf_free(f);
+    }
+    else
+    {
+      p->payload = (u8_t *)p->payload + size;
+      p->len -= size;
+      p->tot_len -= size;
+      size = 0;
+    }
+  }
+  return p;
+}
+
+u16_t pbuf_copy_partial(const struct pbuf *buf, void *dataptr, u16_t len, u16_t offset)
+{
+  const struct pbuf *p;
+  u16_t copied = 0, n;
+
+  for(p = buf; len && p != NULL; p = p->next)
+  {
+    if(offset >= p->len)
+    {
+      offset -= p->len;
+      continue;
+    }
+    n = p->len - offset;
+    if(n > len)
+    {
+      n = len;
+    }
+    memcpy((u8_t *)dataptr + copied, (const u8_t *)p->payload + offset, n);
+    copied += n;
+    len -= n;
+    offset = 0;
+  }
+  return copied;
+}
+
+void *mem_malloc(mem_size_t size)
+{
+  net.mems ++;
+  return malloc(size);
+}
+
+void mem_free(void *rmem)
+{
+  if(rmem != NULL)
+  {
+    net.mems --;
+  }
+  free(rmem);
+}
+
+/* ----------------------------------------------------------------- udp --- */
+
+struct udp_pcb *udp_new(void)
+{
+  uint32_t i_index;
+
+  for(i_index = 0; i_index < NET_UDP_PCB_MAX; i_index ++)
+  {
+    if(net.udp[i_index] == NULL)
+    {
+      net.udp[i_index] = calloc(1, sizeof(struct udp_pcb));
+      return net.udp[i_index];
+    }
+  }
+  return NULL;
+}
+
+err_t udp_bind(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
+{
+  (void)ipaddr;
+  pcb->local_port = (port != 0) ? port : net.next_port ++;
+  return ERR_OK;
+}
+
+void udp_recv(struct udp_pcb *pcb, udp_recv_fn recv, void *recv_arg)
+{
+  pcb->recv = recv;
+  pcb->recv_arg = recv_arg;
+}
+
+err_t udp_sendto(struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *dst_ip, u16_t dst_port)
+{
+  uint8_t buf[NET_FRAME_MAX];
+  u16_t len = pbuf_copy_partial(p, buf, sizeof(buf), 0);
+
+  (void)dst_ip;
+  (void)dst_port;
+  pc_udp_receive(pcb->local_port, buf, len);
+  return ERR_OK;
+}
+
+void udp_disconnect(struct udp_pcb *pcb)
+{
+  (void)pcb;
+}
+
+void udp_remove(struct udp_pcb *pcb)
+{
+  uint32_t i_index;
+
+  for(i_index = 0; i_index < NET_UDP_PCB_MAX; i_index ++)
+  {
+    if(net.udp[i_index] == pcb)
+    {
+      net.udp[i_index] = NULL;
+    }
+  }
+  free(pcb);
+}
+
+/* ----------------------------------------------------------------- tcp --- */
+
+struct tcp_pcb *tcp_new(void)
+{
+  return calloc(1, sizeof(struct tcp_pcb));
+}
+
+err_t tcp_bind(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
+{
+  (void)ipaddr;
+  pcb->local_port = port;
+  return ERR_OK;
+}
+
+struct tcp_pcb *tcp_listen_with_backlog(struct tcp_pcb *pcb, u8_t backlog)
+{
+  (void)backlog;
+  return pcb;
+}
+
+void tcp_accept(struct tcp_pcb *pcb, tcp_accept_fn accept)
+{
+  net.accept = accept;
+  net.accept_arg = pcb->callback_arg;
+}
+
+void tcp_arg(struct tcp_pcb *pcb, void *arg)
+{
+  pcb->callback_arg = arg;
+}
+
+void tcp_recv(struct tcp_pcb *pcb, tcp_recv_fn recv)
+{
+  pcb->recv = recv;
+}
+
+void tcp_sent(struct tcp_pcb *pcb, tcp_sent_fn sent)
+{
+  pcb->sent = sent;
+}
+
+void tcp_err(struct tcp_pcb *pcb, tcp_err_fn err)
+{
+  pcb->errf = err;
+}
+
+void tcp_poll(struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interval)
+{
+  pcb->poll = poll;
+  pcb->pollinterval = interval;
+}
+
+err_t tcp_write(struct tcp_pcb *pcb, const void *dataptr, u16_t len, u8_t apiflags)
+{
+  (void)apiflags;
+  SIM_CHECK(len <= pcb->snd_buf && pc.resp_len + len <= PC_RESPONSE_MAX);
+  memcpy(pc.resp + pc.resp_len, dataptr, len);
+  pc.resp_len += len;
+  pcb->snd_buf -= len;
+  /* acknowledged by the pc one round trip later */
+  net.sent_pending += len;
+  net.sent_at_ns = now_ns() + 2 * PC_LATENCY_US * 1000;
+  return ERR_OK;
+}
+
+void tcp_recved(struct tcp_pcb *pcb, u16_t len)
+{
+  (void)pcb;
+  SIM_CHECK(len <= net.rcv_unrecved);
+  net.rcv_unrecved -= len;
+  net.progress ++;
+  pc_tcp_ack(net.rcv_nxt, TCP_WND - net.rcv_unrecved);
+}
+
+err_t tcp_close(struct tcp_pcb *pcb)
+{
+  if(pcb == net.tcp)
+  {
+    net.tcp_closed = 1;
+  }
+  return ERR_OK;
+}
+
+/* ------------------------------------------------------------- decoder --- */
+
+image_status_type __real_image_decode_feed(image_decoder_type *pdec, const uint8_t *pdata, uint32_t len);
+
+/**
+  * @brief  the decoder with its cpu time.
+  * @param  pdec: decoder
+  * @param  pdata: data
+  * @param  len: length
+  * @retval decoder status
+  */
+image_status_type __wrap_image_decode_feed(image_decoder_type *pdec, const uint8_t *pdata, uint32_t len)
+{
+  net.progress += len;
+  net.decode_ns += (uint64_t)len * NET_DECODE_NS_PER_BYTE;
+  if(net.decode_ns >= 1000)
+  {
+    sim_time_advance(net.decode_ns / 1000);
+    net.decode_ns %= 1000;
+  }
+  return __real_image_decode_feed(pdec, pdata, len);
+}
+
+/* ------------------------------------------------------- lwip rx loop --- */
+
+/**
+  * @brief  lwip_rx_loop_handler: every stored frame goes up the stack.
+  * @param  none
+  * @retval frames handled
+  */
+static uint32_t net_poll(void)
+{
+  net_frame_type frame;
+  struct pbuf *p;
+  struct udp_pcb *upcb;
+  uint32_t count = 0, i_index;
+
+  while(net.rx_rd != net.rx_wr)
+  {
+    frame = net.rx[net.rx_rd % NET_RXBUFNB];
+    net.rx_rd ++;
+    count ++;
+    sim_time_advance(NET_FRAME_US);
+
+    if(frame.kind == NET_UDP)
+    {
+      for(i_index = 0, upcb = NULL; i_index < NET_UDP_PCB_MAX; i_index ++)
+      {
+        if(net.udp[i_index] != NULL && net.udp[i_index]->local_port == frame.port)
+        {
+          upcb = net.udp[i_index];
+        }
+      }
+      if(upcb == NULL || upcb->recv == NULL)
+      {
+        continue;
+      }
+      p = pbuf_alloc(PBUF_TRANSPORT, frame.len, PBUF_POOL);
+      memcpy(p->payload, frame.data, frame.len);
+      upcb->recv(upcb->recv_arg, upcb, p, &pc_addr, NET_PC_PORT);
+    }
+    else if(frame.kind == NET_TCP_SYN)
+    {
+      net.tcp = calloc(1, sizeof(struct tcp_pcb));
+      net.tcp->snd_buf = TCP_SND_BUF;
+      net.tcp_closed = 0;
+      net.rcv_nxt = 0;
+      net.rcv_unrecved = 0;
+      net.sent_pending = 0;
+      SIM_CHECK(net.accept(net.accept_arg, net.tcp, ERR_OK) == ERR_OK);
+      pc_tcp_ack(0, TCP_WND);
+    }
+    else if(net.tcp != NULL && !net.tcp_closed)
+    {
+      if(frame.seq != net.rcv_nxt || frame.len > TCP_WND - net.rcv_unrecved)
+      {
+        /* out of order or beyond the window, the pc sends it again */
+        pc_tcp_ack(net.rcv_nxt, TCP_WND - net.rcv_unrecved);
+        continue;
+      }
+      net.rcv_nxt += frame.len;
+      net.rcv_unrecved += frame.len;
+      p = pbuf_alloc(PBUF_TRANSPORT, frame.len, PBUF_POOL);
+      memcpy(p->payload, frame.data, frame.len);
+      net.tcp->recv(net.tcp->callback_arg, net.tcp, p, ERR_OK);
+      pc_tcp_ack(net.rcv_nxt, TCP_WND - net.rcv_unrecved);
+    }
+  }
+
+  /* the pc acknowledged the response */
+  if(net.sent_pending && now_ns() >= net.sent_at_ns && net.tcp != NULL && !net.tcp_closed)
+  {
+    uint32_t len = net.sent_pending;
+
+    net.sent_pending = 0;
+    net.tcp->snd_buf += len;
+    if(net.tcp->sent != NULL)
+    {
+      net.tcp->sent(net.tcp->callback_arg, net.tcp, (u16_t)len);
+    }
+    count ++;
+  }
+  return count;
+}
+
+/* --------------------------------------------------------- pc, tftp --- */
+
+/**
+  * @brief  the pc tftp client ends.
+  * @param  failed: 1 when the transfer failed
+  * @retval none
+  */
+static void pc_finish(uint8_t failed)
+{
+  pc.finished = 1;
+  pc.failed = failed;
+  pc.done_us = sim_flash->time_us;
+}
+
+/**
+  * @brief  send a tftp window starting at pc.next.
+  * @param  start_ns: earliest start
+  * @retval none
+  */
+static void pc_tftp_window(uint64_t start_ns)
+{
+  uint8_t packet[4 + TFTP_BLKSIZE_MAX];
+  uint32_t block, offset, len, count;
+  uint8_t drop;
+
+  for(count = 0, block = pc.next; count < pc.windowsize && block <= pc.blocks; count ++, block ++)
+  {
+    offset = (block - 1) * pc.pcase->blksize;
+    len = (pc.len - offset < pc.pcase->blksize) ? pc.len - offset : pc.pcase->blksize;
+    packet[0] = 0;
+    packet[1] = TFTP_DATA;
+    packet[2] = (uint8_t)(block >> 8);
+    packet[3] = (uint8_t)block;
+    memcpy(packet + 4, pc.image + offset, len);
+    net.data_frames ++;
+    drop = pc.pcase->drop_every && (net.data_frames % pc.pcase->drop_every) == 0;
+    net_send(NET_UDP, pc.server_port, 0, packet, 4 + len, start_ns, drop);
+  }
+  pc.last_ns = start_ns;
+}
+
+/**
+  * @brief  send the write request.
+  * @param  none
+  * @retval none
+  */
+static void pc_tftp_start(void)
+{
+  uint8_t req[64];
+  uint32_t len;
+
+  len = 2 + sprintf((char *)req + 2, "app.bin%coctet%c", 0, 0);
+  req[0] = 0;
+  req[1] = TFTP_WRQ;
+  if(pc.pcase->blksize != TFTP_DATA_LEN_MAX || pc.pcase->windowsize != 1)
+  {
+    len += sprintf((char *)req + len, "blksize%c%u%cwindowsize%c%u%c",
+                   0, pc.pcase->blksize, 0, 0, pc.pcase->windowsize, 0);
+  }
+  pc.blocks = pc.len / pc.pcase->blksize + 1;
+  pc.next = 1;
+  pc.windowsize = 1;
+  pc.server_port = 0;
+  net_send(NET_UDP, 69, 0, req, len, now_ns(), 0);
+  pc.last_ns = now_ns();
+}
+
+/**
+  * @brief  a packet of the bootloader reached the pc.
+  * @param  port: source port
+  * @param  pdata: packet
+  * @param  len: packet length
+  * @retval none
+  */
+static void pc_udp_receive(uint16_t port, const uint8_t *pdata, uint32_t len)
+{
+  uint64_t start_ns = now_ns() + PC_LATENCY_US * 1000;
+  uint32_t ack, i_index;
+
+  if(pc.finished || len < 4)
+  {
+    return;
+  }
+  if(pdata[1] == TFTP_ERROR)
+  {
+    pc.got_error = 1;
+    pc_finish(1);
+    return;
+  }
+  if(pdata[1] == TFTP_OACK)
+  {
+    /* the block size must come back as requested, the window may be smaller */
+    SIM_CHECK(pc.server_port == 0);
+    SIM_CHECK(len > 10 && memcmp(pdata + 2, "blksize", 8) == 0 &&
+              (uint32_t)atoi((const char *)pdata + 10) == pc.pcase->blksize);
+    for(i_index = 2; i_index + 11 < len; i_index ++)
+    {
+      if(memcmp(pdata + i_index, "windowsize", 11) == 0)
+      {
+        pc.windowsize = atoi((const char *)pdata + i_index + 11);
+      }
+    }
+    SIM_CHECK(pc.windowsize >= 1 && pc.windowsize <= pc.pcase->windowsize);
+    pc.server_port = port;
+    pc.retries = 0;
+    pc_tftp_window(start_ns);
+    return;
+  }
+  if(pdata[1] != TFTP_ACK)
+  {
+    return;
+  }
+  ack = (pdata[2] << 8) | pdata[3];
+  if(pc.server_port == 0)
+  {
+    /* ack of the request without options */
+    SIM_CHECK(ack == 0);
+    pc.server_port = port;
+  }
+  /* block numbers of an image below 64k blocks do not wrap */
+  if(ack == pc.blocks)
+  {
+    pc_finish(0);
+    return;
+  }
+  if(ack + 1 < pc.next)
+  {
+    return;
+  }
+  if(ack + 1 != pc.next + pc.windowsize)
+  {
+    /* the window was not received completely */
+    pc.resends ++;
+  }
+  pc.next = ack + 1;
+  pc.retries = 0;
+  pc_tftp_window(start_ns);
+}
+
+/* --------------------------------------------------------- pc, http --- */
+
+/**
+  * @brief  the pc opens the connection of the next request.
+  * @param  start_ns: earliest start
+  * @retval none
+  */
+static void pc_http_request(uint64_t start_ns)
+{
+  static const char login[] = "POST /checklogin.cgi HTTP/1.1\r\nHost: 192.168.0.37\r\n"
+                              "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: 27\r\n\r\n"
+                              "username=user&password=at32";
+  static const char reset[] = "GET /resetmcu.cgi HTTP/1.1\r\nHost: 192.168.0.37\r\n\r\n";
+  char head[512];
+  uint32_t head_len, part_len;
+
+  free(pc.req);
+  if(pc.phase == 0)
+  {
+    pc.req_len = sizeof(login) - 1;
+    pc.req = malloc(pc.req_len);
+    memcpy(pc.req, login, pc.req_len);
+  }
+  else if(pc.phase == 1)
+  {
+    part_len = sprintf(head, "--" BOUNDARY "\r\nContent-Disposition: form-data; name=\"datafile\"; filename=\"app.bin\"\r\n"
+                             "Content-Type: application/octet-stream\r\n\r\n");
+    head_len = sprintf(head + part_len, "POST /upload.cgi HTTP/1.1\r\nHost: 192.168.0.37\r\n"
+                                        "Content-Type: multipart/form-data; boundary=" BOUNDARY "\r\n"
+                                        "Content-Length: %u\r\n\r\n",
+                       (unsigned)(part_len + pc.len + 8 + sizeof(BOUNDARY) - 1));
+    pc.req_len = head_len + part_len + pc.len + 8 + sizeof(BOUNDARY) - 1;
+    pc.req = malloc(pc.req_len);
+    memcpy(pc.req, head + part_len, head_len);
+    memcpy(pc.req + head_len, head, part_len);
+    memcpy(pc.req + head_len + part_len, pc.image, pc.len);
+    memcpy(pc.req + head_len + part_len + pc.len, "\r\n--" BOUNDARY "--\r\n", 8 + sizeof(BOUNDARY) - 1);
+  }
+  else
+  {
+    pc.req_len = sizeof(reset) - 1;
+    pc.req = malloc(pc.req_len);
+    memcpy(pc.req, reset, pc.req_len);
+  }
+  pc.connected = 0;
+  pc.snd_una = 0;
+  pc.snd_nxt = 0;
+  pc.wnd = 0;
+  pc.resp_len = 0;
+  pc.last_ns = start_ns;
+  net_send(NET_TCP_SYN, 80, 0, NULL, 0, start_ns, 0);
+}
+
+/**
+  * @brief  send the segments the window allows.
+  * @param  start_ns: earliest start
+  * @retval none
+  */
+static void pc_tcp_pump(uint64_t start_ns)
+{
+  uint32_t seg, avail;
+  uint8_t drop;
+
+  while(pc.connected && pc.snd_nxt < pc.req_len)
+  {
+    avail = (pc.snd_una + pc.wnd > pc.snd_nxt) ? pc.snd_una + pc.wnd - pc.snd_nxt : 0;
+    seg = pc.req_len - pc.snd_nxt;
+    /* a browser sends the short requests in one segment */
+    if(pc.phase == 1 && seg > pc.pcase->segment)
+    {
+      seg = pc.pcase->segment;
+    }
+    if(avail < seg)
+    {
+      break;
+    }
+    net.data_frames ++;
+    drop = pc.pcase->drop_every && (net.data_frames % pc.pcase->drop_every) == 0;
+    net_send(NET_TCP_DATA, 80, pc.snd_nxt, pc.req + pc.snd_nxt, seg, start_ns, drop);
+    pc.snd_nxt += seg;
+  }
+}
+
+/**
+  * @brief  an ack or window update of the bootloader reached the pc.
+  * @param  ack: next byte expected
+  * @param  wnd: receive window
+  * @retval none
+  */
+static void pc_tcp_ack(uint32_t ack, uint32_t wnd)
+{
+  if(!pc.connected)
+  {
+    pc.connected = 1;
+  }
+  if(ack > pc.snd_una)
+  {
+    pc.snd_una = ack;
+    pc.last_ns = now_ns();
+  }
+  pc.wnd = wnd;
+  pc_tcp_pump(now_ns() + PC_LATENCY_US * 1000);
+}
+
+/**
+  * @brief  the bootloader closed the connection, check its page.
+  * @param  none
+  * @retval none
+  */
+static void pc_http_response(void)
+{
+  const struct fsdata_file *pfile = (pc.phase == 0) ? file_upload_html :
+                                    (pc.phase == 1) ? file_uploaddone_html : file_reset_html;
+
+  net.tcp_closed = 0;
+  free(net.tcp);
+  net.tcp = NULL;
+  if((uint32_t)pfile->len != pc.resp_len || memcmp(pfile->data, pc.resp, pc.resp_len) != 0)
+  {
+    /* the upload page again, the image was refused */
+    SIM_CHECK(pc.phase == 1 && (uint32_t)file_upload_html->len == pc.resp_len &&
+              memcmp(file_upload_html->data, pc.resp, pc.resp_len) == 0);
+    pc_finish(1);
+    return;
+  }
+  if(pc.phase == 1)
+  {
+    pc_finish(0);
+  }
+  if(++ pc.phase < 3)
+  {
+    pc_http_request(now_ns() + PC_LATENCY_US * 1000);
+  }
+}
+
+/**
+  * @brief  time outs of the pc, runs with the time.
+  * @param  none
+  * @retval none
+  */
+static void pc_poll(void)
+{
+  if(pc.pcase == NULL)
+  {
+    return;
+  }
+  if(pc.pcase->proto == PC_TFTP)
+  {
+    if(!pc.finished && pc.server_port != 0 && now_ns() > pc.last_ns + PC_TFTP_TIMEOUT_US * 1000ull)
+    {
+      if(++ pc.retries > PC_TFTP_RETRY_MAX)
+      {
+        pc_finish(1);
+        return;
+      }
+      pc.resends ++;
+      pc_tftp_window(now_ns());
+    }
+    return;
+  }
+  if(net.tcp_closed && pc.phase < 3)
+  {
+    pc_http_response();
+    return;
+  }
+  if(pc.connected && pc.snd_una < pc.snd_nxt && now_ns() > pc.last_ns + PC_TCP_RTO_US * 1000ull)
+  {
+    /* go back to the first byte not acknowledged */
+    pc.resends ++;
+    pc.snd_nxt = pc.snd_una;
+    pc.last_ns = now_ns();
+    pc_tcp_pump(now_ns());
+  }
+}
+
+/* ---------------------------------------------------------- scenarios --- */
+
+/**
+  * @brief  boot the bootloader as main.c does and run its loop.
+  * @param  none
+  * @retval how the run ended, SIM_BOOT_RUN when the pc finished
+  */
+static int device_run(void)
+{
+  uint64_t limit = sim_flash->time_us + RUN_LIMIT_US, before, next;
+  uint32_t progress, frames, idle = 0;
+  int boot;
+
+  boot = setjmp(sim_boot_jmp);
+  if(boot != SIM_BOOT_RUN)
+  {
+    return boot;
+  }
+
+  sim_flash->locked = 1;
+  if(flash_upgrade_flag_read() == RESET)
+  {
+    if(((*(uint32_t*)(APP_START_SECTOR_ADDR + 4)) & 0xFF000000) == 0x08000000)
+      app_load(APP_START_SECTOR_ADDR);
+  }
+  net.next_port = 49152;
+  iap_httpd_init();
+  iap_tftpd_init();
+  sim_time_hook = net_time_hook;
+  if(pc.pcase->proto == PC_TFTP)
+  {
+    pc_tftp_start();
+  }
+  else
+  {
+    pc_http_request(now_ns());
+  }
+
+  while(1)
+  {
+    if(pc.finished && sim_flash->time_us > pc.done_us + 100000)
+    {
+      return SIM_BOOT_RUN;
+    }
+    SIM_CHECK(sim_flash->time_us < limit);
+
+    before = sim_flash->time_us;
+    progress = net.progress;
+    frames = net_poll();
+    iap_http_handle();
+    iap_tftp_handle();
+    sim_time_advance(CPU_LOOP_US);
+
+    if(frames != 0 || net.progress != progress || sim_flash->time_us != before + CPU_LOOP_US)
+    {
+      idle = 0;
+      continue;
+    }
+    if(++ idle < 8)
+    {
+      continue;
+    }
+    /* idle, jump to the next frame or at most 1ms */
+    next = now_ns() + 1000000;
+    if(net.wire_rd != net.wire_wr && net.wire[net.wire_rd % NET_WIRE_LEN].at_ns < next)
+    {
+      next = net.wire[net.wire_rd % NET_WIRE_LEN].at_ns;
+    }
+    if(net.sent_pending && net.sent_at_ns < next)
+    {
+      next = net.sent_at_ns;
+    }
+    if(next > now_ns())
+    {
+      sim_time_advance((next - now_ns() + 999) / 1000);
+    }
+  }
+}
+
+/**
+  * @brief  one upgrade over the network.
+  * @param  arg: emac_case_type
+  * @retval none
+  */
+static void emac_case_run(void *arg)
+{
+  const emac_case_type *pcase = arg;
+  const uint8_t *new_image = image_buf[pcase->image];
+  uint32_t new_len = image_len[pcase->image];
+  static uint8_t before[IMAGE_LEN + 0x1000];
+  int boot;
+
+  memset(&pc, 0, sizeof(pc));
+  pc.pcase = pcase;
+  pc.image = (uint8_t *)new_image;
+  pc.len = new_len;
+  if(pcase->base >= 0)
+  {
+    pc.image = iap_image_delta(image_buf[pcase->base], image_len[pcase->base], new_image, new_len, &pc.len);
+  }
+  memcpy(before, (void *)APP_START_SECTOR_ADDR, sizeof(before));
+
+  /* the app was asked for an upgrade, or the button held at reset */
+  iap_command_handle();
+  sim_flash_reset_stats();
+  sim_flash->cut_after = pcase->cut_after;
+
+  boot = device_run();
+  sim_flash->cut_after = 0;
+  sim_time_hook = NULL;
+
+  printf("  %s %4u x %2u, %3u kb: time to flash %6.2f s (link %5.2f s, flash %5.2f s), "
+         "%u resends, %u frames lost in rx\n",
+         pcase->proto == PC_TFTP ? "tftp" : "http",
+         pcase->proto == PC_TFTP ? pcase->blksize : pcase->segment,
+         pcase->proto == PC_TFTP ? pc.windowsize : 1, (unsigned)((pc.len + 1023) / 1024),
+         sim_flash->time_us / 1e6, net.link_ns / 1e9, sim_flash->flash_us / 1e6, pc.resends, net.rx_lost);
+  SIM_CHECK(sim_flash->lock_errors == 0);
+  /* a tftp window fits the receive descriptors. a tcp window of small
+     segments does not, nor do retransmissions while a delta page is written */
+  SIM_CHECK(pcase->proto != PC_TFTP || net.rx_lost == 0);
+  if(pcase->result >= 0)
+  {
+    results[pcase->result] = sim_flash->time_us;
+  }
+
+  if(pcase->expect == EMAC_CUT)
+  {
+    SIM_CHECK(boot == SIM_BOOT_POWER_CUT);
+    return;
+  }
+  if(pcase->expect == EMAC_REJECTED)
+  {
+    SIM_CHECK(boot == SIM_BOOT_RUN && pc.failed);
+    SIM_CHECK(pcase->proto == PC_HTTP || pc.got_error);
+    /* a delta patch on the wrong base is refused before anything is written */
+    SIM_CHECK(memcmp((void *)APP_START_SECTOR_ADDR, before, sizeof(before)) == 0);
+    SIM_CHECK(flash_upgrade_flag_read() == SET);
+    return;
+  }
+
+  if(pcase->proto == PC_HTTP)
+  {
+    /* the reset page was sent and the bootloader reset itself */
+    SIM_CHECK(boot == SIM_BOOT_RESET && pc.phase == 3);
+  }
+  else
+  {
+    SIM_CHECK(boot == SIM_BOOT_RUN && !pc.failed);
+  }
+  SIM_CHECK(memcmp((void *)APP_START_SECTOR_ADDR, new_image, new_len) == 0);
+  SIM_CHECK(flash_upgrade_flag_read() == RESET);
+  SIM_CHECK(net.pbufs == 0);
+
+  /* the next boot starts the app */
+  boot = setjmp(sim_boot_jmp);
+  if(boot == SIM_BOOT_RUN)
+  {
+    app_load(APP_START_SECTOR_ADDR);
+  }
+  SIM_CHECK(boot == SIM_BOOT_APP && sim_flash->app_sp == IAP_IMAGE_SP);
+}
+
+/**
+  * @brief  boot after the power cut, the bootloader stays in upgrade mode.
+  * @param  arg: unused
+  * @retval none
+  */
+static void emac_cut_check(void *arg)
+{
+  (void)arg;
+  SIM_CHECK(flash_upgrade_flag_read() == SET);
+}
+
+/**
+  * @brief  compare the times of two earlier cases.
+  * @param  arg: two result slots, the first must be faster
+  * @retval none
+  */
+static void emac_faster_check(void *arg)
+{
+  const int *slot = arg;
+
+  printf("  %.2f s against %.2f s\n", results[slot[0]] / 1e6, results[slot[1]] / 1e6);
+  SIM_CHECK(results[slot[0]] < results[slot[1]]);
+}
+
+/* every case installs an image that differs from the one in flash */
+static const emac_case_type emac_cases[] =
+{
+  /* name                                  proto    blksize win segment base image drop cut    expect         result */
+  {"tftp without options",                 PC_TFTP, 512,    1,  0,      -1,  0,    0,   0,     EMAC_DONE,     0},
+  {"tftp windowsize 16 asked, 4 given",      PC_TFTP, 1428,   16, 0,      -1,  2,    0,   0,     EMAC_DONE,     1},
+  {"tftp blksize 1428 windowsize 4",       PC_TFTP, 1428,   4,  0,      -1,  0,    0,   0,     EMAC_DONE,     2},
+  {"tftp with lost frames",                PC_TFTP, 1428,   4,  0,      -1,  2,    23,  0,     EMAC_DONE,    -1},
+  {"tftp delta patch v3 to v1",            PC_TFTP, 1428,   4,  0,      2,   0,    0,   0,     EMAC_DONE,    -1},
+  {"tftp delta patch v1 to v2",            PC_TFTP, 1428,   4,  0,      0,   1,    0,   0,     EMAC_DONE,     3},
+  {"tftp delta patch on the wrong base",   PC_TFTP, 1428,   4,  0,      0,   1,    0,   0,     EMAC_REJECTED, -1},
+  {"http upload",                          PC_HTTP, 0,      0,  1460,   -1,  0,    0,   0,     EMAC_DONE,     4},
+  {"http upload in small segments",        PC_HTTP, 0,      0,  61,     -1,  2,    0,   0,     EMAC_DONE,    -1},
+  {"http upload with lost segments",       PC_HTTP, 0,      0,  1460,   -1,  0,    17,  0,     EMAC_DONE,    -1},
+  {"http delta patch v1 to v2",            PC_HTTP, 0,      0,  1460,   0,   1,    0,   0,     EMAC_DONE,    -1},
+  {"http delta patch on the wrong base",   PC_HTTP, 0,      0,  1460,   0,   2,    0,   0,     EMAC_REJECTED, -1},
+  {"power cut in the middle of an upload", PC_HTTP, 0,      0,  1460,   -1,  2,    0,   20000, EMAC_CUT,      -1},
+  {"http upload after the power cut",      PC_HTTP, 0,      0,  1460,   -1,  2,    0,   0,     EMAC_DONE,    -1},
+};
+
+/**
+  * @brief  emac iap host test.
+  * @param  none
+  * @retval 0 when every scenario passed
+  */
+int main(void)
+{
+  static const int window_lockstep[2] = {2, 0};
+  static const int delta_full[2] = {3, 2};
+  uint32_t i_index;
+  int failed = 0;
+
+  sim_flash_init();
+  results = mmap(NULL, 8 * sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  image_len[0] = IMAGE_LEN;
+  image_len[2] = IMAGE_LEN;
+  iap_image_make(image_buf[0], IMAGE_LEN, APP_START_SECTOR_ADDR, 1);
+  iap_image_edit(image_buf[0], IMAGE_LEN, image_buf[1], &image_len[1], 2);
+  iap_image_make(image_buf[2], IMAGE_LEN, APP_START_SECTOR_ADDR, 3);
+
+  for(i_index = 0; i_index < sizeof(emac_cases) / sizeof(emac_cases[0]); i_index ++)
+  {
+    failed |= sim_run(emac_cases[i_index].name, emac_case_run, (void *)&emac_cases[i_index]);
+    if(i_index == 2)
+    {
+      failed |= sim_run("tftp windows faster than lock-step", emac_faster_check, (void *)window_lockstep);
+    }
+    if(i_index == 5)
+    {
+      failed |= sim_run("delta patch faster than the full image", emac_faster_check, (void *)delta_full);
+    }
+    if(i_index == 12)
+    {
+      failed |= sim_run("bootloader stays in upgrade mode after the power cut", emac_cut_check, NULL);
+    }
+  }
+  return failed;
+}
+
+/**
+  * @}
+  */
@@ -0,0 +1,631 @@
+/**
+  **************************************************************************
+  * @file     iap_hid_test.c
+  * @brief    usb hid iap bootloader on the host against the simulated flash
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+/*
+  the bootloader source (hid_iap_user.c) is built unchanged. this file stands
+  in for hid_iap_class.c and the usb core: the interrupt endpoints of the full
+  speed link move one 64 byte report per 1ms frame in each direction, the out
+  reports run usbd_hid_iap_process from the usb interrupt and the in reports
+  reach the pc tool at the next frame. the pc tool answers after
+  PC_TURNAROUND_US.
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "sim_flash.h"
+#include "hid_iap_user.h"
+#include "iap_image.h"
+
+/** @addtogroup host_test
+  * @{
+  */
+
+#define IMAGE_LEN                        (96 * 1024)
+#define REPORT_LEN                       64
+#define REPORT_DATA_LEN                  (REPORT_LEN - 4)
+#define USB_FRAME_US                     1000       /*!< full speed, binterval 1 */
+#define PC_TURNAROUND_US                 1000
+#define PC_ANSWER_TIMEOUT_US             (30 * IMAGE_LEN / 1024 * 1000) /*!< flash time of the whole app */
+#define PC_RETRY_MAX                     8
+#define CPU_LOOP_US                      1          /*!< one pass of the main loop */
+#define REPORT_QUEUE_LEN                 64
+#define RUN_LIMIT_US                     120000000ull
+#define BLOCK_MAX                        128
+
+typedef enum
+{
+  PC_START,                              /*!< IAP_CMD_START sent */
+  PC_ADDR,                               /*!< IAP_CMD_ADDR of a block sent */
+  PC_DATA,                               /*!< data reports of the block sent */
+  PC_CRC,
+  PC_FINISH,
+  PC_JMP,
+  PC_DONE,
+  PC_FAILED,
+} pc_state_type;
+
+typedef struct
+{
+  const char                             *name;
+  int8_t                                 base;         /*!< image in flash a delta patch is built on, -1 raw */
+  uint16_t                               flip_report;  /*!< data report sent with a bit error, 0 none */
+  uint16_t                               drop_report;  /*!< data report lost, 0 none */
+  uint32_t                               cut_after;    /*!< flash operations before a power cut, 0 none */
+  uint32_t                               stuck_offset; /*!< app offset of a word with a stuck bit, 0 none */
+  uint8_t                                expect;       /*!< SIM_BOOT_APP, SIM_BOOT_POWER_CUT or SIM_BOOT_RUN (failed) */
+  uint8_t                                image;        /*!< image to install */
+  int                                    result;       /*!< slot in the shared results */
+} hid_case_type;
+
+typedef struct
+{
+  uint8_t                                data[REPORT_LEN];
+  uint64_t                               at_us;        /*!< frame the report is moved in */
+  uint8_t                                lost;
+} report_type;
+
+typedef struct
+{
+  report_type                            report[REPORT_QUEUE_LEN];
+  uint32_t                               rd;
+  uint32_t                               wr;
+  uint64_t                               next_frame_us; /*!< first frame still free */
+} endpoint_type;
+
+typedef struct
+{
+  endpoint_type                          out;
+  endpoint_type                          in;
+  uint64_t                               link_us;
+} link_type;
+
+typedef struct
+{
+  const hid_case_type                    *pcase;
+  pc_state_type                          state;
+  const uint8_t                          *image;
+  uint32_t                               blocks;
+  uint32_t                               block;        /*!< block being sent */
+  uint32_t                               crc;          /*!< crc of the image as the device computes it */
+  uint16_t                               wait_cmd;     /*!< command waiting for its answer */
+  uint64_t                               wait_us;      /*!< answer deadline */
+  uint32_t                               retries;      /*!< of the step waited for */
+  uint32_t                               restarts;     /*!< of the whole upgrade */
+  uint32_t                               data_reports;
+  uint32_t                               resends;
+  uint64_t                               done_us;
+} pc_type;
+
+/* stand-in for hid_iap_class.c */
+iap_info_type iap_info;
+
+static uint32_t udev;
+static link_type usb_link;
+static pc_type pc;
+/* v1, v2 edited from v1, v3 unrelated */
+static uint8_t image_buf[3][IMAGE_LEN + 0x1000];
+static uint32_t image_len[3];
+static uint64_t *results;
+
+/**
+  * @brief  queue a report on an endpoint, one per frame.
+  * @param  pept: endpoint
+  * @param  pdata: report
+  * @param  start_us: earliest time
+  * @param  lost: 1 when the report never arrives
+  * @retval none
+  */
+static void endpoint_send(endpoint_type *pept, const uint8_t *pdata, uint64_t start_us, uint8_t lost)
+{
+  report_type *preport;
+  uint64_t frame_us = (start_us + USB_FRAME_US - 1) / USB_FRAME_US * USB_FRAME_US;
+
+  SIM_CHECK(pept->wr - pept->rd < REPORT_QUEUE_LEN);
+  if(frame_us < pept->next_frame_us)
+  {
+    frame_us = pept->next_frame_us;
+  }
+  pept->next_frame_us = frame_us + USB_FRAME_US;
+  usb_link.link_us += USB_FRAME_US;
+
+  preport = &pept->report[pept->wr % REPORT_QUEUE_LEN];
+  memcpy(preport->data, pdata, REPORT_LEN);
+  preport->at_us = frame_us;
+  preport->lost = lost;
+  pept->wr ++;
+}
+
+/**
+  * @brief  the pc tool sends a command report and waits for its answer.
+  * @param  cmd: iap command
+  * @param  arg: address or data length, follows the command
+  * @param  arg2: second argument of IAP_CMD_CRC
+  * @param  start_us: earliest time
+  * @retval none
+  */
+static void pc_command_send(uint16_t cmd, uint32_t arg, uint32_t arg2, uint64_t start_us)
+{
+  uint8_t report[REPORT_LEN] = {(uint8_t)(cmd >> 8), (uint8_t)cmd};
+
+  report[2] = (uint8_t)(arg >> 24);
+  report[3] = (uint8_t)(arg >> 16);
+  report[4] = (uint8_t)(arg >> 8);
+  report[5] = (uint8_t)arg;
+  report[6] = (uint8_t)(arg2 >> 8);
+  report[7] = (uint8_t)arg2;
+  endpoint_send(&usb_link.out, report, start_us, 0);
+  pc.wait_cmd = cmd;
+  pc.wait_us = usb_link.out.next_frame_us + PC_ANSWER_TIMEOUT_US;
+}
+
+/**
+  * @brief  the pc tool sends the address and the data reports of a block.
+  * @param  start_us: earliest time
+  * @retval none
+  */
+static void pc_block_send(uint64_t start_us)
+{
+  uint8_t report[REPORT_LEN];
+  uint32_t offset, len;
+  uint8_t lost;
+
+  pc.state = PC_ADDR;
+  pc_command_send(IAP_CMD_ADDR, FLASH_APP_ADDRESS + pc.block * HID_IAP_BUFFER_LEN, 0, start_us);
+
+  /* the data follows at once, its answer comes when the block is queued */
+  for(offset = 0; offset < HID_IAP_BUFFER_LEN; offset += len)
+  {
+    len = (HID_IAP_BUFFER_LEN - offset < REPORT_DATA_LEN) ? HID_IAP_BUFFER_LEN - offset : REPORT_DATA_LEN;
+    memset(report, 0, sizeof(report));
+    report[0] = (uint8_t)(IAP_CMD_DATA >> 8);
+    report[1] = (uint8_t)IAP_CMD_DATA;
+    report[2] = (uint8_t)(len >> 8);
+    report[3] = (uint8_t)len;
+    memcpy(report + 4, pc.image + pc.block * HID_IAP_BUFFER_LEN + offset, len);
+
+    pc.data_reports ++;
+    if(pc.data_reports == pc.pcase->flip_report)
+    {
+      report[4 + len / 2] ^= 0x10;
+    }
+    lost = (pc.data_reports == pc.pcase->drop_report);
+    endpoint_send(&usb_link.out, report, start_us, lost);
+  }
+}
+
+/**
+  * @brief  the pc tool starts the upgrade over.
+  * @param  start_us: earliest time
+  * @retval none
+  */
+static void pc_start(uint64_t start_us)
+{
+  pc.state = PC_START;
+  pc_command_send(IAP_CMD_START, 0, 0, start_us);
+}
+
+/**
+  * @brief  the pc tool ends the upgrade.
+  * @param  state: PC_DONE or PC_FAILED
+  * @retval none
+  */
+static void pc_finish(pc_state_type state)
+{
+  pc.state = state;
+  pc.done_us = sim_flash->time_us;
+}
+
+/**
+  * @brief  the pc tool retries the step it waits for, then the whole upgrade.
+  * @param  start_us: earliest time
+  * @retval none
+  */
+static void pc_retry(uint64_t start_us)
+{
+  pc.resends ++;
+  if(pc.state == PC_ADDR || pc.state == PC_DATA)
+  {
+    if(++ pc.retries > PC_RETRY_MAX)
+    {
+      pc_finish(PC_FAILED);
+    }
+    else
+    {
+      pc_block_send(start_us);
+    }
+  }
+  else if(++ pc.restarts > PC_RETRY_MAX)
+  {
+    pc_finish(PC_FAILED);
+  }
+  else
+  {
+    pc.block = 0;
+    pc.retries = 0;
+    pc_start(start_us);
+  }
+}
+
+/**
+  * @brief  an in report reached the pc tool.
+  * @param  report: report
+  * @retval none
+  */
+static void pc_receive(const uint8_t *report)
+{
+  uint64_t start_us = sim_flash->time_us + PC_TURNAROUND_US;
+  uint16_t cmd = (report[0] << 8) | report[1];
+  uint16_t result = (report[2] << 8) | report[3];
+  uint32_t crc;
+
+  if(pc.state == PC_DONE || pc.state == PC_FAILED || cmd != pc.wait_cmd)
+  {
+    return;
+  }
+  pc.wait_cmd = 0;
+  if(result != IAP_ACK)
+  {
+    pc_retry(start_us);
+    return;
+  }
+
+  switch(pc.state)
+  {
+    case PC_START:
+      pc.block = 0;
+      pc_block_send(start_us);
+      break;
+    case PC_ADDR:
+      /* the data reports are on their way */
+      pc.state = PC_DATA;
+      pc.wait_cmd = IAP_CMD_DATA;
+      pc.wait_us = usb_link.out.next_frame_us + PC_ANSWER_TIMEOUT_US;
+      break;
+    case PC_DATA:
+      pc.retries = 0;
+      if(++ pc.block < pc.blocks)
+      {
+        pc_block_send(start_us);
+      }
+      else
+      {
+        pc.state = PC_CRC;
+        pc_command_send(IAP_CMD_CRC, FLASH_APP_ADDRESS, pc.blocks * HID_IAP_BUFFER_LEN / 1024, start_us);
+      }
+      break;
+    case PC_CRC:
+      crc = ((uint32_t)report[4] << 24) | (report[5] << 16) | (report[6] << 8) | report[7];
+      if(crc != pc.crc)
+      {
+        /* written with an error, all over again */
+        pc_retry(start_us);
+        break;
+      }
+      pc.state = PC_FINISH;
+      pc_command_send(IAP_CMD_FINISH, 0, 0, start_us);
+      break;
+    case PC_FINISH:
+      pc.state = PC_JMP;
+      pc_command_send(IAP_CMD_JMP, 0, 0, start_us);
+      break;
+    case PC_JMP:
+      pc_finish(PC_DONE);
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  move the reports of the frames that are due, as the usb interrupt.
+  * @param  none
+  * @retval none
+  */
+static void link_poll(void)
+{
+  report_type *preport;
+
+  if(__get_PRIMASK())
+  {
+    return;
+  }
+
+  while(usb_link.out.rd != usb_link.out.wr && usb_link.out.report[usb_link.out.rd % REPORT_QUEUE_LEN].at_us <= sim_flash->time_us)
+  {
+    preport = &usb_link.out.report[usb_link.out.rd % REPORT_QUEUE_LEN];
+    usb_link.out.rd ++;
+    if(!preport->lost)
+    {
+      /* class_out_handler */
+      usbd_hid_iap_process(&udev, preport->data, REPORT_LEN);
+    }
+  }
+
+  while(usb_link.in.rd != usb_link.in.wr && usb_link.in.report[usb_link.in.rd % REPORT_QUEUE_LEN].at_us <= sim_flash->time_us)
+  {
+    preport = &usb_link.in.report[usb_link.in.rd % REPORT_QUEUE_LEN];
+    usb_link.in.rd ++;
+    /* class_in_handler */
+    usbd_hid_iap_in_complete(&udev);
+    pc_receive(preport->data);
+  }
+
+  if(pc.wait_cmd != 0 && sim_flash->time_us > pc.wait_us && pc.state != PC_DONE && pc.state != PC_FAILED)
+  {
+    pc.wait_cmd = 0;
+    pc_retry(sim_flash->time_us);
+  }
+}
+
+usb_sts_type usb_iap_class_send_report(void *udev, uint8_t *report, uint16_t len)
+{
+  (void)udev;
+  SIM_CHECK(len == REPORT_LEN);
+  endpoint_send(&usb_link.in, report, sim_flash->time_us, 0);
+  return USB_OK;
+}
+
+/**
+  * @brief  boot the bootloader as main.c does and run its loop.
+  * @note   the simulated time jumps to the next frame once the loop went idle.
+  * @param  none
+  * @retval how the run ended, SIM_BOOT_RUN when the pc tool failed
+  */
+static int device_run(void)
+{
+  uint64_t limit = sim_flash->time_us + RUN_LIMIT_US, before, next;
+  uint32_t idle = 0;
+  int boot;
+
+  boot = setjmp(sim_boot_jmp);
+  if(boot != SIM_BOOT_RUN)
+  {
+    return boot;
+  }
+
+  sim_flash->locked = 1;
+  sim_time_hook = link_poll;
+  __set_PRIMASK(0);
+  memset(&usb_link, 0, sizeof(usb_link));
+  iap_init();
+  if(iap_get_upgrade_flag() == IAP_SUCCESS)
+  {
+    jump_to_app(FLASH_APP_ADDRESS);
+  }
+
+  /* enumerated, the pc tool starts */
+  pc_start(sim_flash->time_us);
+
+  while(1)
+  {
+    link_poll();
+    if((pc.state == PC_DONE || pc.state == PC_FAILED) && sim_flash->time_us > pc.done_us + 500000)
+    {
+      return SIM_BOOT_RUN;
+    }
+    SIM_CHECK(sim_flash->time_us < limit);
+
+    before = sim_flash->time_us;
+    iap_loop();
+    sim_time_advance(CPU_LOOP_US);
+
+    if(sim_flash->time_us != before + CPU_LOOP_US)
+    {
+      idle = 0;
+      continue;
+    }
+    if(++ idle < 8)
+    {
+      continue;
+    }
+    /* idle, jump to the next frame or time out */
+    next = pc.wait_us + 1;
+    if(usb_link.out.rd != usb_link.out.wr && usb_link.out.report[usb_link.out.rd % REPORT_QUEUE_LEN].at_us < next)
+    {
+      next = usb_link.out.report[usb_link.out.rd % REPORT_QUEUE_LEN].at_us;
+    }
+    if(usb_link.in.rd != usb_link.in.wr && usb_link.in.report[usb_link.in.rd % REPORT_QUEUE_LEN].at_us < next)
+    {
+      next = usb_link.in.report[usb_link.in.rd % REPORT_QUEUE_LEN].at_us;
+    }
+    if(pc.state == PC_DONE || pc.state == PC_FAILED)
+    {
+      next = pc.done_us + 500001;
+    }
+    if(next > sim_flash->time_us)
+    {
+      sim_time_advance(next - sim_flash->time_us);
+    }
+  }
+}
+
+/**
+  * @brief  the app requests an upgrade: it clears the flag and resets.
+  * @param  none
+  * @retval none
+  */
+static void app_request_upgrade(void)
+{
+  flash_unlock();
+  flash_sector_erase(FLASH_APP_ADDRESS - sim_flash_sector_size());
+  flash_lock();
+}
+
+/**
+  * @brief  one upgrade through the usb.
+  * @param  arg: hid_case_type
+  * @retval none
+  */
+static void hid_case_run(void *arg)
+{
+  const hid_case_type *pcase = arg;
+  const uint8_t *new_image = image_buf[pcase->image];
+  uint32_t new_len = image_len[pcase->image];
+  uint8_t *send = (uint8_t *)new_image, *patch = NULL;
+  uint32_t send_len = new_len, value, i_index;
+  int boot;
+
+  if(pcase->base >= 0)
+  {
+    const uint8_t *old_image = image_buf[pcase->base];
+    uint32_t old_len = image_len[pcase->base];
+
+    SIM_CHECK(memcmp((void *)FLASH_APP_ADDRESS, old_image, old_len) == 0);
+    patch = iap_image_delta(old_image, old_len, new_image, new_len, &send_len);
+    send = patch;
+  }
+
+  memset(&pc, 0, sizeof(pc));
+  pc.pcase = pcase;
+  pc.blocks = (send_len + HID_IAP_BUFFER_LEN - 1) / HID_IAP_BUFFER_LEN;
+  SIM_CHECK(pc.blocks <= BLOCK_MAX);
+  pc.image = calloc(pc.blocks, HID_IAP_BUFFER_LEN);
+  memset((uint8_t *)pc.image, 0xFF, pc.blocks * HID_IAP_BUFFER_LEN);
+  memcpy((uint8_t *)pc.image, send, send_len);
+
+  /* the crc unit of the device takes the words byte swapped */
+  pc.crc = 0xFFFFFFFF;
+  for(i_index = 0; i_index < pc.blocks * HID_IAP_BUFFER_LEN; i_index += 4)
+  {
+    memcpy(&value, pc.image + i_index, 4);
+    pc.crc = sim_crc_word(pc.crc, CONVERT_ENDIAN(value));
+  }
+
+  app_request_upgrade();
+  sim_flash_reset_stats();
+  sim_flash->cut_after = pcase->cut_after;
+  if(pcase->stuck_offset != 0)
+  {
+    /* a bit the new image clears stays at 1 */
+    sim_flash->stuck_addr = FLASH_APP_ADDRESS + pcase->stuck_offset;
+    sim_flash->stuck_mask = ~*(const uint32_t *)(new_image + pcase->stuck_offset);
+    sim_flash->stuck_mask &= ~sim_flash->stuck_mask + 1;
+  }
+
+  boot = device_run();
+  sim_flash->cut_after = 0;
+  sim_flash->stuck_addr = 0;
+
+  printf("  hid %3u blocks: time to flash %6.2f s (link %5.2f s, flash %5.2f s), %u resends\n",
+         pc.blocks, sim_flash->time_us / 1e6, usb_link.link_us / 1e6, sim_flash->flash_us / 1e6, pc.resends);
+  SIM_CHECK(sim_flash->lock_errors == 0);
+  SIM_CHECK(boot == pcase->expect);
+  if(pcase->result >= 0)
+  {
+    results[pcase->result] = usb_link.link_us;
+  }
+  if(boot == SIM_BOOT_APP)
+  {
+    SIM_CHECK(pc.state == PC_DONE);
+    SIM_CHECK(sim_flash->app_sp == IAP_IMAGE_SP);
+    SIM_CHECK(memcmp((void *)FLASH_APP_ADDRESS, new_image, new_len) == 0);
+    SIM_CHECK(iap_get_upgrade_flag() == IAP_SUCCESS);
+  }
+  else if(boot == SIM_BOOT_RUN)
+  {
+    SIM_CHECK(pc.state == PC_FAILED);
+    SIM_CHECK(iap_get_upgrade_flag() == IAP_FAILED);
+  }
+  free(patch);
+  free((uint8_t *)pc.image);
+}
+
+/**
+  * @brief  boot after the power cut, the half written app must not start.
+  * @param  arg: unused
+  * @retval none
+  */
+static void hid_cut_check(void *arg)
+{
+  (void)arg;
+  iap_init();
+  SIM_CHECK(iap_get_upgrade_flag() == IAP_FAILED);
+}
+
+/**
+  * @brief  compare the link times of two earlier cases.
+  * @note   the usb link outruns the flash, a delta patch saves link time but
+  *         rewrites the app in place, so the time to flash stays the same.
+  * @param  arg: two result slots, the first must be shorter
+  * @retval none
+  */
+static void hid_link_check(void *arg)
+{
+  const int *slot = arg;
+
+  printf("  %.2f s against %.2f s\n", results[slot[0]] / 1e6, results[slot[1]] / 1e6);
+  SIM_CHECK(results[slot[0]] < results[slot[1]]);
+}
+
+/* every case installs an image that differs from the one in flash */
+static const hid_case_type hid_cases[] =
+{
+  /* name                                      base flip drop cut    stuck   expect              image result */
+  {"full image",                               -1,  0,   0,   0,     0,      SIM_BOOT_APP,       0,    0},
+  {"delta patch v1 to v2",                     0,   0,   0,   0,     0,      SIM_BOOT_APP,       1,    1},
+  {"bit error in a data report",               -1,  300, 0,   0,     0,      SIM_BOOT_APP,       2,   -1},
+  {"lost data report",                         -1,  0,   500, 0,     0,      SIM_BOOT_APP,       0,   -1},
+  {"power cut in the middle of an upgrade",    -1,  0,   0,   12000, 0,      SIM_BOOT_POWER_CUT, 2,   -1},
+  {"upgrade after the power cut",              -1,  0,   0,   0,     0,      SIM_BOOT_APP,       2,   -1},
+  {"stuck flash bit",                          -1,  0,   0,   0,     0x5004, SIM_BOOT_RUN,       0,   -1},
+};
+
+/**
+  * @brief  usb hid iap host test.
+  * @param  none
+  * @retval 0 when every scenario passed
+  */
+int main(void)
+{
+  static const int delta_full[2] = {1, 0};
+  uint32_t i_index;
+  int failed = 0;
+
+  sim_flash_init();
+  results = mmap(NULL, 8 * sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  image_len[0] = IMAGE_LEN;
+  image_len[2] = IMAGE_LEN;
+  iap_image_make(image_buf[0], IMAGE_LEN, FLASH_APP_ADDRESS, 1);
+  iap_image_edit(image_buf[0], IMAGE_LEN, image_buf[1], &image_len[1], 2);
+  iap_image_make(image_buf[2], IMAGE_LEN, FLASH_APP_ADDRESS, 3);
+
+  for(i_index = 0; i_index < sizeof(hid_cases) / sizeof(hid_cases[0]); i_index ++)
+  {
+    failed |= sim_run(hid_cases[i_index].name, hid_case_run, (void *)&hid_cases[i_index]);
+    if(i_index == 1)
+    {
+      failed |= sim_run("delta patch shorter on the link than the full image", hid_link_check, (void *)delta_full);
+    }
+    if(i_index == 4)
+    {
+      failed |= sim_run("app not started after the power cut", hid_cut_check, NULL);
+    }
+  }
+  return failed;
+}
+
+/**
+  * @}
+  */
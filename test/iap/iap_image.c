@@ -0,0 +1,133 @@
+/**
+  **************************************************************************
+  * @file     iap_image.c
+  * @brief    test app images and delta patches for the iap host tests
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+#include <string.h>
+#include <stdlib.h>
+#include "iap_image.h"
+
+/* the patch generator of the pc tool, its main is not used */
+#define main image_delta_main
+#include "../../middlewares/image_codec_library/tools/image_delta.c"
+#undef main
+
+/** @addtogroup host_test
+  * @{
+  */
+
+static uint32_t image_seed;
+
+/**
+  * @brief  deterministic random numbers.
+  * @param  none
+  * @retval next value
+  */
+static uint32_t image_rand(void)
+{
+  image_seed = image_seed * 1103515245 + 12345;
+  return image_seed >> 8;
+}
+
+/**
+  * @brief  fill an app image: vector table, then code-like content made of
+  *         repeated instruction patterns so that it compresses like an app.
+  * @param  image: image buffer
+  * @param  len: image length, multiple of 4
+  * @param  app_addr: address the app is linked at
+  * @param  seed: content seed
+  * @retval none
+  */
+void iap_image_make(uint8_t *image, uint32_t len, uint32_t app_addr, uint32_t seed)
+{
+  uint32_t *pword = (uint32_t *)image;
+  uint32_t i_index, pattern = 0;
+
+  image_seed = seed;
+  for(i_index = 0; i_index < len / 4; i_index ++)
+  {
+    if((i_index & 15) == 0)
+    {
+      pattern = image_rand();
+    }
+    pword[i_index] = ((image_rand() & 3) == 0) ? image_rand() : pattern + (i_index & 15);
+  }
+  pword[0] = IAP_IMAGE_SP;
+  pword[1] = app_addr + 0x101;
+}
+
+/**
+  * @brief  derive the next version of an app: a few patched words, a function
+  *         grown in the middle and a table removed near the end.
+  * @param  old_image: old image
+  * @param  old_len: old image length
+  * @param  new_image: new image buffer, old_len + 0x1000 bytes
+  * @param  new_len: new image length
+  * @param  seed: edit seed
+  * @retval none
+  */
+void iap_image_edit(const uint8_t *old_image, uint32_t old_len, uint8_t *new_image, uint32_t *new_len, uint32_t seed)
+{
+  uint32_t insert_at = (old_len / 2) & ~3, insert_len = 0x300;
+  uint32_t remove_at = (old_len - old_len / 8) & ~3, remove_len = 0x100;
+  uint32_t out = 0, i_index;
+
+  image_seed = seed;
+  memcpy(new_image, old_image, insert_at);
+  out = insert_at;
+  for(i_index = 0; i_index < insert_len; i_index ++)
+  {
+    new_image[out ++] = (uint8_t)image_rand();
+  }
+  memcpy(new_image + out, old_image + insert_at, remove_at - insert_at);
+  out += remove_at - insert_at;
+  memcpy(new_image + out, old_image + remove_at + remove_len, old_len - remove_at - remove_len);
+  out += old_len - remove_at - remove_len;
+  for(i_index = 0; i_index < 16; i_index ++)
+  {
+    new_image[(8 + image_rand() % (out - 8)) & ~3] ^= 0x5A;
+  }
+  *new_len = out;
+}
+
+/**
+  * @brief  build a delta patch the way the pc tool does.
+  * @param  old_image: image in flash
+  * @param  old_len: its length
+  * @param  new_image: image to install
+  * @param  new_len: its length
+  * @param  patch_len: patch length
+  * @retval patch, to be freed
+  */
+uint8_t *iap_image_delta(const uint8_t *old_image, uint32_t old_len,
+                         const uint8_t *new_image, uint32_t new_len, uint32_t *patch_len)
+{
+  delta_buffer_type patch = {NULL, 0, 0};
+
+  delta_build(old_image, old_len, new_image, new_len, &patch);
+  *patch_len = patch.len;
+  return patch.data;
+}
+
+/**
+  * @}
+  */
@@ -0,0 +1,71 @@
+/**
+  **************************************************************************
+  * @file     iap_image.h
+  * @brief    test app images and delta patches for the iap host tests
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+/*!< define to prevent recursive inclusion -------------------------------------*/
+#ifndef __IAP_IMAGE_H
+#define __IAP_IMAGE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/** @addtogroup host_test
+  * @{
+  */
+
+/** @defgroup iap_image_definition
+  * @{
+  */
+
+#define IAP_IMAGE_SP                     0x20008000 /*!< stack pointer of the test apps */
+
+/**
+  * @}
+  */
+
+/** @defgroup iap_image_exported_functions
+  * @{
+  */
+
+void     iap_image_make(uint8_t *image, uint32_t len, uint32_t app_addr, uint32_t seed);
+void     iap_image_edit(const uint8_t *old_image, uint32_t old_len, uint8_t *new_image, uint32_t *new_len, uint32_t seed);
+uint8_t *iap_image_delta(const uint8_t *old_image, uint32_t old_len,
+                         const uint8_t *new_image, uint32_t new_len, uint32_t *patch_len);
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,903 @@
+/**
+  **************************************************************************
+  * @file     iap_usart_test.c
+  * @brief    usart iap bootloader on the host, legacy and window protocols against the simulated flash
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+/*
+  the bootloader sources (iap.c, flash.c) are built unchanged. this file
+  stands in for usart.c and tmr.c: bytes of the pc tool reach the receive
+  ring or the dma ring at the time the line delivers them, and the 10ms timer
+  interrupt runs from the simulated clock. the pc tool answers after
+  PC_TURNAROUND_US like an usb serial adapter.
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "sim_flash.h"
+#include "iap.h"
+#include "usart.h"
+#include "tmr.h"
+#include "flash.h"
+#include "integrity_index.h"
+#include "iap_image.h"
+
+/** @addtogroup host_test
+  * @{
+  */
+
+#define IMAGE_LEN                        (96 * 1024)
+#define PC_TURNAROUND_US                 1000
+#define PC_FRAME_TIMEOUT_US              (30 * IMAGE_LEN / 1024 * 1000) /*!< flash time of the whole app */
+#define PC_RETRY_MAX                     8
+#define CPU_LOOP_US                      1          /*!< one pass of the main loop */
+#define LINK_QUEUE_LEN                   (1 << 21)
+#define RUN_LIMIT_US                     120000000ull
+#define BLOCK_MAX                        128
+
+typedef enum
+{
+  PC_LEGACY,
+  PC_WINDOW,
+} pc_mode_type;
+
+typedef enum
+{
+  PC_HELLO,                              /*!< waiting for the answer sent at boot */
+  PC_START,                              /*!< 0x5a 0x01 or 0x5a 0x03 sent */
+  PC_DATA,
+  PC_END,                                /*!< 0x5a 0x02 sent */
+  PC_DONE,
+  PC_FAILED,
+} pc_state_type;
+
+typedef struct
+{
+  const char                             *name;
+  pc_mode_type                           mode;
+  uint32_t                               baudrate;
+  int8_t                                 base;         /*!< image in flash a delta patch is built on, -1 raw */
+  uint8_t                                flip_frame;   /*!< frame transmission with a bit error, 0 none */
+  uint8_t                                drop_frame;   /*!< frame transmission losing a byte, 0 none */
+  uint32_t                               cut_after;    /*!< flash operations before a power cut, 0 none */
+  uint32_t                               stuck_offset; /*!< app offset of a word with a stuck bit, 0 none */
+  uint8_t                                expect;       /*!< SIM_BOOT_APP, SIM_BOOT_POWER_CUT or SIM_BOOT_RUN (failed) */
+  uint8_t                                image;        /*!< image to install */
+  int                                    result;       /*!< slot in the shared results */
+} usart_case_type;
+
+typedef struct
+{
+  uint8_t                                data[LINK_QUEUE_LEN];
+  uint64_t                               at_ns[LINK_QUEUE_LEN];
+  uint32_t                               rd;
+  uint32_t                               wr;
+  uint64_t                               line_free_ns;
+  uint64_t                               last_rx_ns;
+  uint8_t                                idle_sent;
+  uint32_t                               pc_baudrate;
+  uint32_t                               dev_baudrate;
+  uint8_t                                dma_mode;
+  uint32_t                               dma_head;
+  uint32_t                               dma_overrun;
+  uint64_t                               next_tick_us;
+  uint8_t                                tick_cnt;
+  uint64_t                               bytes;
+  uint64_t                               link_ns;
+} link_type;
+
+typedef struct
+{
+  const usart_case_type                  *pcase;
+  pc_state_type                          state;
+  const uint8_t                          *image;
+  uint32_t                               blocks;
+  uint8_t                                rx[4];
+  uint8_t                                rx_cnt;
+  uint32_t                               block;        /*!< legacy: block waiting for its answer */
+  uint8_t                                sent[BLOCK_MAX];
+  uint8_t                                acked[BLOCK_MAX];
+  uint8_t                                retries[BLOCK_MAX];
+  uint64_t                               sent_ns[BLOCK_MAX];
+  uint64_t                               answer_ns;    /*!< last frame answer */
+  uint32_t                               frames;       /*!< frame transmissions */
+  uint32_t                               resends;
+  uint64_t                               done_us;
+} pc_type;
+
+/* stand-ins for usart.c and tmr.c */
+usart_group_type usart_group_struct;
+usart_dma_group_type usart_dma_group_struct;
+uint8_t time_ira_cnt = 0;
+uint8_t get_data_from_usart_flag = 0;
+__IO uint16_t time_idle_tick = 0;
+__IO uint8_t time_out_flag = 0;
+
+static link_type line;
+static pc_type pc;
+/* v1, v2 edited from v1, v3 unrelated */
+static uint8_t image_buf[3][IMAGE_LEN + 0x1000];
+static uint32_t image_len[3];
+static uint64_t *results;
+
+/**
+  * @brief  time of one byte on the line, 8n1.
+  * @param  baudrate: baudrate
+  * @retval nanoseconds
+  */
+static uint64_t link_byte_ns(uint32_t baudrate)
+{
+  return 10ull * 1000000000ull / baudrate;
+}
+
+/**
+  * @brief  current simulated time.
+  * @param  none
+  * @retval nanoseconds
+  */
+static uint64_t now_ns(void)
+{
+  return sim_flash->time_us * 1000;
+}
+
+/**
+  * @brief  queue bytes of the pc tool on the line.
+  * @param  pdata: bytes
+  * @param  len: byte count
+  * @param  start_ns: earliest start of the first byte
+  * @param  flip: index of a byte sent with a bit error, len for none
+  * @param  drop: index of a byte lost on the line, len for none
+  * @retval time the last byte is received
+  */
+static uint64_t link_send(const uint8_t *pdata, uint32_t len, uint64_t start_ns, uint32_t flip, uint32_t drop)
+{
+  uint64_t byte_ns = link_byte_ns(line.pc_baudrate);
+  uint32_t i_index;
+
+  if(line.line_free_ns < start_ns)
+  {
+    line.line_free_ns = start_ns;
+  }
+  for(i_index = 0; i_index < len; i_index ++)
+  {
+    line.line_free_ns += byte_ns;
+    line.bytes ++;
+    line.link_ns += byte_ns;
+    if(i_index == drop)
+    {
+      continue;
+    }
+    SIM_CHECK(line.wr - line.rd < LINK_QUEUE_LEN);
+    line.data[line.wr % LINK_QUEUE_LEN] = pdata[i_index] ^ ((i_index == flip) ? 0x10 : 0);
+    line.at_ns[line.wr % LINK_QUEUE_LEN] = line.line_free_ns;
+    line.wr ++;
+  }
+  return line.line_free_ns;
+}
+
+/**
+  * @brief  send one window frame of the pc tool.
+  * @param  block: block number
+  * @param  start_ns: earliest start
+  * @retval none
+  */
+static void pc_frame_send(uint32_t block, uint64_t start_ns)
+{
+  static uint8_t frame[IAP_WIN_FRAME_LEN + 1];
+  uint32_t addr = APP_START_ADDR + block * 0x800, crc = 0xFFFFFFFF, i_index;
+  uint32_t flip = sizeof(frame), drop = sizeof(frame);
+
+  frame[0] = IAP_WIN_FRAME_HEAD;
+  frame[1] = (uint8_t)block;
+  frame[2] = (uint8_t)(addr >> 24);
+  frame[3] = (uint8_t)(addr >> 16);
+  frame[4] = (uint8_t)(addr >> 8);
+  frame[5] = (uint8_t)addr;
+  memcpy(frame + 6, pc.image + block * 0x800, 0x800);
+  crc = sim_crc_word(crc, addr);
+  for(i_index = 0; i_index < 0x800; i_index += 4)
+  {
+    crc = sim_crc_word(crc, frame[6 + i_index] | (frame[7 + i_index] << 8) |
+                            (frame[8 + i_index] << 16) | ((uint32_t)frame[9 + i_index] << 24));
+  }
+  frame[6 + 0x800] = (uint8_t)(crc >> 24);
+  frame[7 + 0x800] = (uint8_t)(crc >> 16);
+  frame[8 + 0x800] = (uint8_t)(crc >> 8);
+  frame[9 + 0x800] = (uint8_t)crc;
+
+  pc.frames ++;
+  if(pc.frames == pc.pcase->flip_frame)
+  {
+    flip = 700;
+  }
+  if(pc.frames == pc.pcase->drop_frame)
+  {
+    drop = 1200;
+  }
+  pc.sent[block] = 1;
+  pc.sent_ns[block] = link_send(frame, sizeof(frame), start_ns, flip, drop);
+}
+
+/**
+  * @brief  send one legacy data block of the pc tool.
+  * @param  block: block number
+  * @param  start_ns: earliest start
+  * @retval none
+  */
+static void pc_block_send(uint32_t block, uint64_t start_ns)
+{
+  static uint8_t cmd[1 + 4 + 0x800 + 1];
+  uint32_t addr = APP_START_ADDR + block * 0x800, i_index;
+  uint8_t checksum = 0;
+
+  cmd[0] = 0x31;
+  cmd[1] = (uint8_t)(addr >> 24);
+  cmd[2] = (uint8_t)(addr >> 16);
+  cmd[3] = (uint8_t)(addr >> 8);
+  cmd[4] = (uint8_t)addr;
+  memcpy(cmd + 5, pc.image + block * 0x800, 0x800);
+  for(i_index = 1; i_index < 5 + 0x800; i_index ++)
+  {
+    checksum += cmd[i_index];
+  }
+  cmd[5 + 0x800] = checksum;
+  pc.block = block;
+  link_send(cmd, sizeof(cmd), start_ns, sizeof(cmd), sizeof(cmd));
+}
+
+/**
+  * @brief  send a two byte command of the pc tool.
+  * @param  cmd: second byte
+  * @param  start_ns: earliest start
+  * @retval none
+  */
+static void pc_command_send(uint8_t cmd, uint64_t start_ns)
+{
+  uint8_t buf[6] = {0x5A, cmd};
+  uint32_t len = 2;
+
+  if(cmd == 0x03)
+  {
+    buf[2] = (uint8_t)(pc.pcase->baudrate >> 24);
+    buf[3] = (uint8_t)(pc.pcase->baudrate >> 16);
+    buf[4] = (uint8_t)(pc.pcase->baudrate >> 8);
+    buf[5] = (uint8_t)pc.pcase->baudrate;
+    len = 6;
+  }
+  link_send(buf, len, start_ns, len, len);
+}
+
+/**
+  * @brief  the pc tool sends what its window allows.
+  * @param  start_ns: earliest start
+  * @retval none
+  */
+static void pc_window_fill(uint64_t start_ns)
+{
+  uint32_t block, outstanding = 0;
+
+  for(block = 0; block < pc.blocks; block ++)
+  {
+    if(pc.sent[block] && !pc.acked[block])
+    {
+      outstanding ++;
+    }
+  }
+  for(block = 0; block < pc.blocks && outstanding < IAP_WIN_NUM; block ++)
+  {
+    if(!pc.sent[block] && !pc.acked[block])
+    {
+      pc_frame_send(block, start_ns);
+      outstanding ++;
+    }
+  }
+  for(block = 0; block < pc.blocks && pc.acked[block]; block ++);
+  if(block == pc.blocks && pc.state == PC_DATA)
+  {
+    pc.state = PC_END;
+    pc_command_send(0x02, start_ns);
+  }
+}
+
+/**
+  * @brief  the pc tool ends the upgrade.
+  * @param  state: PC_DONE or PC_FAILED
+  * @retval none
+  */
+static void pc_finish(pc_state_type state)
+{
+  pc.state = state;
+  pc.done_us = sim_flash->time_us;
+}
+
+/**
+  * @brief  a frame answer of the window protocol reached the pc tool.
+  * @param  none
+  * @retval none
+  */
+static void pc_window_answer(void)
+{
+  uint32_t block;
+
+  pc.answer_ns = now_ns();
+  for(block = pc.rx[1]; block < pc.blocks; block += 0x100)
+  {
+    if(!pc.sent[block] || pc.acked[block])
+    {
+      continue;
+    }
+    if(pc.rx[0] == IAP_WIN_ACK && pc.rx[2] == IAP_WIN_ACK_END)
+    {
+      pc.acked[block] = 1;
+    }
+    else if(++ pc.retries[block] > PC_RETRY_MAX)
+    {
+      pc_finish(PC_FAILED);
+      return;
+    }
+    else
+    {
+      /* sent again in order with the frames behind it */
+      pc.sent[block] = 0;
+      pc.resends ++;
+    }
+    break;
+  }
+  pc_window_fill(now_ns() + PC_TURNAROUND_US * 1000);
+}
+
+/**
+  * @brief  one byte sent by the bootloader reached the pc tool.
+  * @param  val: byte
+  * @retval none
+  */
+static void pc_receive(uint8_t val)
+{
+  uint64_t start_ns = now_ns() + PC_TURNAROUND_US * 1000;
+  uint8_t ok;
+
+  if(pc.state == PC_DONE || pc.state == PC_FAILED)
+  {
+    return;
+  }
+  pc.rx[pc.rx_cnt ++] = val;
+  if(pc.pcase->mode == PC_WINDOW && pc.state == PC_DATA)
+  {
+    if(pc.rx_cnt == 3)
+    {
+      pc.rx_cnt = 0;
+      pc_window_answer();
+    }
+    return;
+  }
+  if(pc.rx_cnt < 2)
+  {
+    return;
+  }
+  pc.rx_cnt = 0;
+  ok = (pc.rx[0] == 0xCC && pc.rx[1] == 0xDD);
+  if(!ok)
+  {
+    pc_finish(PC_FAILED);
+    return;
+  }
+
+  switch(pc.state)
+  {
+    case PC_HELLO:
+      pc.state = PC_START;
+      pc_command_send((pc.pcase->mode == PC_WINDOW) ? 0x03 : 0x01, start_ns);
+      break;
+    case PC_START:
+      pc.state = PC_DATA;
+      if(pc.pcase->mode == PC_WINDOW)
+      {
+        line.pc_baudrate = pc.pcase->baudrate;
+        pc_window_fill(start_ns);
+      }
+      else
+      {
+        pc_block_send(0, start_ns);
+      }
+      break;
+    case PC_DATA:
+      if(pc.block + 1 < pc.blocks)
+      {
+        pc_block_send(pc.block + 1, start_ns);
+      }
+      else
+      {
+        pc.state = PC_END;
+        pc_command_send(0x02, start_ns);
+      }
+      break;
+    case PC_END:
+      pc_finish(PC_DONE);
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  frames without an answer are sent again.
+  * @param  none
+  * @retval none
+  */
+static void pc_poll(void)
+{
+  uint32_t block;
+  uint8_t resend = 0;
+
+  if(pc.pcase->mode != PC_WINDOW || pc.state != PC_DATA)
+  {
+    return;
+  }
+  for(block = 0; block < pc.blocks; block ++)
+  {
+    if(pc.sent[block] && !pc.acked[block] && now_ns() > pc.sent_ns[block] + PC_FRAME_TIMEOUT_US * 1000ull &&
+       now_ns() > pc.answer_ns + PC_FRAME_TIMEOUT_US * 1000ull)
+    {
+      pc.sent[block] = 0;
+      pc.resends ++;
+      resend = 1;
+    }
+  }
+  if(resend)
+  {
+    pc_window_fill(now_ns());
+  }
+}
+
+/**
+  * @brief  tmr3 overflow interrupt, same as tmr.c.
+  * @param  none
+  * @retval none
+  */
+static void tmr_tick(void)
+{
+  if(time_idle_tick < 0xFFFF)
+    time_idle_tick++;
+  if(++line.tick_cnt < 1000 / TMR_TICK_MS)
+    return;
+  line.tick_cnt = 0;
+  if(get_data_from_usart_flag)
+  {
+    if((++time_ira_cnt) == 0x00)
+      time_ira_cnt = 0xFF;
+    if(time_ira_cnt > 2)
+      time_out_flag = 1;
+  }
+}
+
+/**
+  * @brief  deliver the bytes and timer ticks that are due.
+  * @param  none
+  * @retval none
+  */
+static void link_poll(void)
+{
+  uint64_t byte_ns = link_byte_ns(line.pc_baudrate);
+  uint32_t count;
+  uint8_t val;
+
+  while(line.rd != line.wr && line.at_ns[line.rd % LINK_QUEUE_LEN] <= now_ns())
+  {
+    val = line.data[line.rd % LINK_QUEUE_LEN];
+    line.last_rx_ns = line.at_ns[line.rd % LINK_QUEUE_LEN];
+    line.idle_sent = 0;
+    line.rd ++;
+    if(line.dma_mode)
+    {
+      count = (line.dma_head + USART_DMA_REC_LEN - usart_dma_group_struct.tail) % USART_DMA_REC_LEN;
+      if(count == USART_DMA_REC_LEN - 1)
+      {
+        line.dma_overrun ++;
+      }
+      usart_dma_group_struct.buf[line.dma_head] = val;
+      line.dma_head = (line.dma_head + 1) % USART_DMA_REC_LEN;
+      continue;
+    }
+    /* USART1_IRQHandler */
+    time_ira_cnt = 0;
+    if(usart_group_struct.count > (USART_REC_LEN - 1))
+    {
+      usart_group_struct.count = 0;
+      usart_group_struct.head = 0;
+      usart_group_struct.tail = 0;
+    }
+    else
+    {
+      usart_group_struct.count++;
+      usart_group_struct.buf[usart_group_struct.head++] = val;
+      if(usart_group_struct.head > (USART_REC_LEN - 1))
+        usart_group_struct.head = 0;
+    }
+  }
+
+  /* idle line one byte time after the last byte */
+  if(!line.idle_sent && line.last_rx_ns != 0 && now_ns() >= line.last_rx_ns + byte_ns &&
+     (line.rd == line.wr || line.at_ns[line.rd % LINK_QUEUE_LEN] > line.last_rx_ns + byte_ns))
+  {
+    line.idle_sent = 1;
+    if(line.dma_mode)
+      usart_dma_group_struct.idle_flag = 1;
+  }
+
+  while(line.next_tick_us <= sim_flash->time_us)
+  {
+    line.next_tick_us += TMR_TICK_MS * 1000;
+    tmr_tick();
+  }
+  pc_poll();
+}
+
+void uart_init(uint32_t baudrate)
+{
+  line.dev_baudrate = baudrate;
+  line.dma_mode = 0;
+}
+
+void uart_dma_rx_start(uint32_t baudrate)
+{
+  line.dev_baudrate = baudrate;
+  line.dma_mode = 1;
+  line.dma_head = 0;
+  usart_dma_group_struct.tail = 0;
+  usart_dma_group_struct.idle_flag = 0;
+}
+
+void uart_dma_rx_stop(uint32_t baudrate)
+{
+  line.dev_baudrate = baudrate;
+  line.dma_mode = 0;
+  usart_group_struct.count = 0;
+  usart_group_struct.head = 0;
+  usart_group_struct.tail = 0;
+}
+
+uint16_t uart_dma_rx_count(void)
+{
+  link_poll();
+  return (line.dma_head + USART_DMA_REC_LEN - usart_dma_group_struct.tail) % USART_DMA_REC_LEN;
+}
+
+uint8_t uart_dma_rx_take(void)
+{
+  uint8_t val = usart_dma_group_struct.buf[usart_dma_group_struct.tail++];
+  if(usart_dma_group_struct.tail > (USART_DMA_REC_LEN - 1))
+    usart_dma_group_struct.tail = 0;
+  return val;
+}
+
+void usart_data_transmit(usart_type *usart_x, uint16_t data)
+{
+  (void)usart_x;
+  sim_time_advance((link_byte_ns(line.dev_baudrate) + 999) / 1000);
+  pc_receive((uint8_t)data);
+}
+
+flag_status usart_flag_get(usart_type *usart_x, uint32_t flag)
+{
+  (void)usart_x;
+  (void)flag;
+  return SET;
+}
+
+void usart_interrupt_enable(usart_type *usart_x, uint32_t usart_int, confirm_state new_state)
+{
+  (void)usart_x;
+  (void)usart_int;
+  (void)new_state;
+}
+
+/**
+  * @brief  received bytes not taken by the bootloader yet.
+  * @param  none
+  * @retval byte count
+  */
+static uint32_t rx_pending(void)
+{
+  if(line.dma_mode)
+    return (line.dma_head + USART_DMA_REC_LEN - usart_dma_group_struct.tail) % USART_DMA_REC_LEN;
+  return usart_group_struct.count;
+}
+
+/**
+  * @brief  boot the bootloader as main.c does and run its loop.
+  * @note   the simulated time jumps to the next byte or timer tick once the
+  *         loop went idle.
+  * @param  none
+  * @retval how the run ended, SIM_BOOT_RUN when the pc tool failed
+  */
+static int device_run(void)
+{
+  uint64_t limit = sim_flash->time_us + RUN_LIMIT_US, before, next;
+  uint32_t pending, idle = 0;
+  int boot;
+
+  boot = setjmp(sim_boot_jmp);
+  if(boot != SIM_BOOT_RUN)
+  {
+    return boot;
+  }
+
+  sim_flash->locked = 1;
+  sim_time_hook = link_poll;
+  if(flash_upgrade_flag_read() == RESET)
+  {
+    if(iap_app_check() == SET)
+      app_load(APP_START_ADDR);
+  }
+  uart_init(IAP_DEFAULT_BAUDRATE);
+  line.pc_baudrate = IAP_DEFAULT_BAUDRATE;
+  line.next_tick_us = sim_flash->time_us + TMR_TICK_MS * 1000;
+  if(flash_upgrade_flag_read() != RESET)
+  {
+    back_ok();
+  }
+  else
+  {
+    /* nothing is announced, the pc tool starts on its own */
+    pc.state = PC_START;
+    pc_command_send((pc.pcase->mode == PC_WINDOW) ? 0x03 : 0x01, now_ns());
+  }
+
+  while(1)
+  {
+    link_poll();
+    if((pc.state == PC_DONE || pc.state == PC_FAILED) && sim_flash->time_us > pc.done_us + 100000)
+    {
+      return SIM_BOOT_RUN;
+    }
+    SIM_CHECK(sim_flash->time_us < limit);
+
+    before = sim_flash->time_us;
+    pending = rx_pending();
+    iap_upgrade_app_handle();
+    sim_time_advance(CPU_LOOP_US);
+    link_poll();
+
+    if(sim_flash->time_us != before + CPU_LOOP_US || rx_pending() != pending || pending != 0)
+    {
+      idle = 0;
+      continue;
+    }
+    if(++ idle < 8)
+    {
+      continue;
+    }
+    /* idle, jump to the next event */
+    next = line.next_tick_us * 1000;
+    if(line.rd != line.wr && line.at_ns[line.rd % LINK_QUEUE_LEN] < next)
+    {
+      next = line.at_ns[line.rd % LINK_QUEUE_LEN];
+    }
+    if(line.last_rx_ns != 0 && !line.idle_sent && line.last_rx_ns + link_byte_ns(line.pc_baudrate) < next)
+    {
+      next = line.last_rx_ns + link_byte_ns(line.pc_baudrate);
+    }
+    if(next > now_ns())
+    {
+      sim_time_advance((next - now_ns() + 999) / 1000);
+    }
+  }
+}
+
+/**
+  * @brief  the started app clears the upgrade flag, as app_led3_toggle does.
+  * @param  none
+  * @retval none
+  */
+static void app_start(void)
+{
+  flash_unlock();
+  flash_sector_erase(IAP_UPGRADE_FLAG_ADDR);
+  flash_lock();
+}
+
+/**
+  * @brief  the app requests an upgrade: it sets the flag and resets.
+  * @param  none
+  * @retval none
+  */
+static void app_request_upgrade(void)
+{
+  flash_unlock();
+  flash_sector_erase(IAP_UPGRADE_FLAG_ADDR);
+  flash_word_program(IAP_UPGRADE_FLAG_ADDR, IAP_UPGRADE_FLAG);
+  flash_lock();
+}
+
+/**
+  * @brief  one upgrade through the usart.
+  * @param  arg: usart_case_type
+  * @retval none
+  */
+static void usart_case_run(void *arg)
+{
+  const usart_case_type *pcase = arg;
+  const uint8_t *new_image = image_buf[pcase->image];
+  uint32_t new_len = image_len[pcase->image];
+  uint8_t *send = (uint8_t *)new_image, *patch = NULL;
+  uint32_t send_len = new_len;
+  int boot;
+
+  if(pcase->base >= 0)
+  {
+    const uint8_t *old_image = image_buf[pcase->base];
+    uint32_t old_len = image_len[pcase->base];
+
+    SIM_CHECK(memcmp((void *)APP_START_ADDR, old_image, old_len) == 0);
+    patch = iap_image_delta(old_image, old_len, new_image, new_len, &send_len);
+    send = patch;
+  }
+
+  memset(&pc, 0, sizeof(pc));
+  pc.pcase = pcase;
+  pc.blocks = (send_len + 0x7FF) / 0x800;
+  SIM_CHECK(pc.blocks <= BLOCK_MAX);
+  pc.image = calloc(pc.blocks, 0x800);
+  memset((uint8_t *)pc.image, 0xFF, pc.blocks * 0x800);
+  memcpy((uint8_t *)pc.image, send, send_len);
+
+  app_request_upgrade();
+  sim_flash_reset_stats();
+  sim_flash->cut_after = pcase->cut_after;
+  if(pcase->stuck_offset != 0)
+  {
+    /* a bit the new image clears stays at 1 */
+    sim_flash->stuck_addr = APP_START_ADDR + pcase->stuck_offset;
+    sim_flash->stuck_mask = ~*(const uint32_t *)(new_image + pcase->stuck_offset);
+    sim_flash->stuck_mask &= ~sim_flash->stuck_mask + 1;
+  }
+
+  boot = device_run();
+  sim_flash->cut_after = 0;
+  sim_flash->stuck_addr = 0;
+
+  printf("  %-6s %7u baud, %3u blocks: time to flash %6.2f s (link %5.2f s, flash %5.2f s), %u resends\n",
+         pcase->mode == PC_WINDOW ? "window" : "legacy", pcase->mode == PC_WINDOW ? pcase->baudrate : IAP_DEFAULT_BAUDRATE,
+         pc.blocks, sim_flash->time_us / 1e6, line.link_ns / 1e9, sim_flash->flash_us / 1e6, pc.resends);
+  SIM_CHECK(line.dma_overrun == 0);
+  SIM_CHECK(sim_flash->lock_errors == 0);
+  SIM_CHECK(boot == pcase->expect);
+  if(pcase->result >= 0)
+  {
+    results[pcase->result] = sim_flash->time_us;
+  }
+  if(boot == SIM_BOOT_APP)
+  {
+    SIM_CHECK(pc.state == PC_DONE);
+    SIM_CHECK(sim_flash->app_sp == IAP_IMAGE_SP);
+    SIM_CHECK(memcmp((void *)APP_START_ADDR, new_image, new_len) == 0);
+    app_start();
+    SIM_CHECK(iap_app_check() == SET);
+  }
+  else if(boot == SIM_BOOT_RUN)
+  {
+    SIM_CHECK(pc.state == PC_FAILED);
+    SIM_CHECK(iap_app_check() == RESET);
+  }
+  free(patch);
+}
+
+/**
+  * @brief  boot after the power cut, the half written app must not start.
+  * @param  arg: unused
+  * @retval none
+  */
+static void usart_cut_check(void *arg)
+{
+  (void)arg;
+  SIM_CHECK(flash_upgrade_flag_read() == SET);
+  SIM_CHECK(iap_app_check() == RESET);
+}
+
+/**
+  * @brief  boot an app written without the bootloader, its index is blank.
+  * @param  arg: unused
+  * @retval none
+  */
+static void usart_legacy_app_check(void *arg)
+{
+  (void)arg;
+  flash_unlock();
+  flash_sector_erase(IAP_INDEX_ADDR);
+  flash_lock();
+  SIM_CHECK(iap_app_check() == (IAP_LEGACY_APP ? SET : RESET));
+}
+
+/**
+  * @brief  compare the times of two earlier cases.
+  * @param  arg: two result slots, the first must be faster
+  * @retval none
+  */
+static void usart_faster_check(void *arg)
+{
+  const int *slot = arg;
+
+  printf("  %.2f s against %.2f s\n", results[slot[0]] / 1e6, results[slot[1]] / 1e6);
+  SIM_CHECK(results[slot[0]] < results[slot[1]]);
+}
+
+/* every case installs an image that differs from the one in flash */
+static const usart_case_type usart_cases[] =
+{
+  /* name                                      mode       baudrate base flip drop cut    stuck   expect              image result */
+  {"legacy protocol 115200",                   PC_LEGACY, 0,       -1,  0,   0,   0,     0,      SIM_BOOT_APP,       0,    0},
+  {"window protocol 115200",                   PC_WINDOW, 115200,  -1,  0,   0,   0,     0,      SIM_BOOT_APP,       2,    1},
+  {"window protocol 921600",                   PC_WINDOW, 921600,  -1,  0,   0,   0,     0,      SIM_BOOT_APP,       0,    2},
+  {"delta patch v1 to v2, window 115200",      PC_WINDOW, 115200,  0,   0,   0,   0,     0,      SIM_BOOT_APP,       1,    3},
+  {"delta patch v2 to v1, legacy",             PC_LEGACY, 0,       1,   0,   0,   0,     0,      SIM_BOOT_APP,       0,   -1},
+  {"window protocol, bit error and lost byte", PC_WINDOW, 921600,  -1,  3,   7,   0,     0,      SIM_BOOT_APP,       2,   -1},
+  {"power cut in the middle of an upgrade",    PC_WINDOW, 921600,  -1,  0,   0,   20000, 0,      SIM_BOOT_POWER_CUT, 0,   -1},
+  {"window upgrade after the power cut",       PC_WINDOW, 921600,  -1,  0,   0,   0,     0,      SIM_BOOT_APP,       0,   -1},
+  {"stuck flash bit, legacy",                  PC_LEGACY, 0,       -1,  0,   0,   0,     0x5004, SIM_BOOT_RUN,       2,   -1},
+  {"stuck flash bit, window",                  PC_WINDOW, 921600,  -1,  0,   0,   0,     0x5004, SIM_BOOT_RUN,       2,   -1},
+};
+
+/**
+  * @brief  usart iap host test.
+  * @param  none
+  * @retval 0 when every scenario passed
+  */
+int main(void)
+{
+  static const int window_legacy[2] = {1, 0};
+  static const int fast_slow[2] = {2, 1};
+  static const int delta_full[2] = {3, 1};
+  uint32_t i_index;
+  int failed = 0;
+
+  sim_flash_init();
+  results = mmap(NULL, 8 * sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  image_len[0] = IMAGE_LEN;
+  image_len[2] = IMAGE_LEN;
+  iap_image_make(image_buf[0], IMAGE_LEN, APP_START_ADDR, 1);
+  iap_image_edit(image_buf[0], IMAGE_LEN, image_buf[1], &image_len[1], 2);
+  iap_image_make(image_buf[2], IMAGE_LEN, APP_START_ADDR, 3);
+
+  for(i_index = 0; i_index < sizeof(usart_cases) / sizeof(usart_cases[0]); i_index ++)
+  {
+    failed |= sim_run(usart_cases[i_index].name, usart_case_run, (void *)&usart_cases[i_index]);
+    if(i_index == 2)
+    {
+      failed |= sim_run("window protocol faster than legacy", usart_faster_check, (void *)window_legacy);
+      failed |= sim_run("921600 faster than 115200", usart_faster_check, (void *)fast_slow);
+    }
+    if(i_index == 3)
+    {
+      failed |= sim_run("delta patch faster than the full image", usart_faster_check, (void *)delta_full);
+    }
+    if(i_index == 6)
+    {
+      failed |= sim_run("app not started after the power cut", usart_cut_check, NULL);
+    }
+  }
+  failed |= sim_run("app with a blank index", usart_legacy_app_check, NULL);
+  return failed;
+}
+
+/**
+  * @}
+  */
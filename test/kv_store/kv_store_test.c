@@ -0,0 +1,432 @@
+/**
+  **************************************************************************
+  * @file     kv_store_test.c
+  * @brief    kv store on a ram flash with power cuts in commits, checkpoints, compactions and mounts
+  **************************************************************************
+  *                       Copyright notice & Disclaimer
+  *
+  * The software Board Support Package (BSP) that is made available to
+  * download from Artery official website is the copyrighted work of Artery.
+  * Artery authorizes customers to use, copy, and distribute the BSP
+  * software and its related documentation for the purpose of design and
+  * development in conjunction with Artery microcontrollers. Use of the
+  * software is governed by this copyright notice and the following disclaimer.
+  *
+  * THIS SOFTWARE IS PROVIDED ON "AS IS" BASIS WITHOUT WARRANTIES,
+  * GUARANTEES OR REPRESENTATIONS OF ANY KIND. ARTERY EXPRESSLY DISCLAIMS,
+  * TO THE FULLEST EXTENT PERMITTED BY LAW, ALL EXPRESS, IMPLIED OR
+  * STATUTORY OR OTHER WARRANTIES, GUARANTEES OR REPRESENTATIONS,
+  * INCLUDING BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE, OR NON-INFRINGEMENT.
+  *
+  **************************************************************************
+  */
+
+/*
+  the store runs on a ram copy of KV_SECTOR_NUM flash sectors. the erase and
+  program callbacks follow the flash: programming only clears bits, a word is
+  programmed once after its erase. a power cut stops a callback half way, an
+  erase leaves half of the sector and a program the low half of the word, and
+  the store is mounted again on what is left. after every cut the store must
+  hold the data of the last commit that returned, or of the commit that was
+  cut if its commit record made it to the flash, and nothing else.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+#include "kv_store.h"
+
+/** @addtogroup host_test
+  * @{
+  */
+
+#define KV_SECTOR_SIZE                   2048
+#define KV_SECTOR_NUM                    4
+#define KV_KEYS                          40         /*!< keys used by the workload */
+#define KV_VALUE_LEN                     48
+#define KV_BATCHES                       3000
+
+typedef enum
+{
+  CUT_IN_BATCH,                          /*!< data or commit record of a batch */
+  CUT_IN_CHECKPOINT,                     /*!< setting up a sector with a checkpoint */
+  CUT_IN_COMPACTION,                     /*!< copying the live records, erasing the old sectors */
+  CUT_IN_MOUNT,                          /*!< a mount finishing or dropping a compaction */
+  CUT_PHASES
+} cut_phase_type;
+
+typedef struct
+{
+  uint8_t                                present;
+  uint8_t                                len;
+  uint8_t                                data[KV_VALUE_LEN];
+} model_value_type;
+
+static uint8_t flash[KV_SECTOR_NUM * KV_SECTOR_SIZE];
+static uint32_t ops;                     /*!< erase and program calls */
+static uint32_t cut_at;                  /*!< op to cut, 0 none */
+static uint32_t cut_mean;                /*!< mean ops from one cut to the next */
+static uint32_t cut_rand = 1;
+static uint32_t overwrites;              /*!< programs over a programmed word */
+static jmp_buf cut_jmp;
+static model_value_type model[KV_KEYS];  /*!< values of the last commit */
+static model_value_type pending[KV_KEYS];/*!< values once the current commit is written */
+static uint32_t rand_state = 1;
+static uint32_t cut_count[CUT_PHASES];
+static const char *cut_name[CUT_PHASES] = {"batches", "checkpoints", "compactions", "mounts"};
+static int failed;
+
+#define CHECK(cond)                      do { if(!(cond)) { printf("  check failed: %s (%s:%d)\n", #cond, __FILE__, __LINE__); failed = 1; return; } } while(0)
+
+/**
+  * @brief  power cut in the current callback when its turn has come.
+  * @param  none
+  * @retval 1 when the power goes now
+  */
+static int cut_now(void)
+{
+  ops ++;
+  return (cut_at != 0 && ops == cut_at);
+}
+
+/**
+  * @brief  erase callback.
+  * @param  offset: sector offset
+  * @retval 0
+  */
+static int ram_erase(uint32_t offset)
+{
+  if(cut_now())
+  {
+    /* half of the sector is erased, which half changes from cut to cut */
+    memset(flash + offset + ((cut_at & 1) ? KV_SECTOR_SIZE / 2 : 0), 0xFF, KV_SECTOR_SIZE / 2);
+    longjmp(cut_jmp, 1);
+  }
+  memset(flash + offset, 0xFF, KV_SECTOR_SIZE);
+  return 0;
+}
+
+/**
+  * @brief  program callback.
+  * @param  offset: word offset
+  * @param  data: word
+  * @retval 0
+  */
+static int ram_program(uint32_t offset, uint32_t data)
+{
+  uint32_t word;
+
+  memcpy(&word, flash + offset, 4);
+  if(word != 0xFFFFFFFF)
+  {
+    overwrites ++;
+  }
+  if(cut_now())
+  {
+    word &= data | 0xFFFF0000;
+    memcpy(flash + offset, &word, 4);
+    longjmp(cut_jmp, 1);
+  }
+  word &= data;
+  memcpy(flash + offset, &word, 4);
+  return 0;
+}
+
+static const kv_config_type ram_config =
+{
+  flash,
+  KV_SECTOR_SIZE,
+  KV_SECTOR_NUM,
+  ram_erase,
+  ram_program,
+};
+
+/**
+  * @brief  xorshift random numbers, the same sequence on every run.
+  * @param  none
+  * @retval random number
+  */
+static uint32_t rand_next(void)
+{
+  rand_state ^= rand_state << 13;
+  rand_state ^= rand_state >> 17;
+  rand_state ^= rand_state << 5;
+  return rand_state;
+}
+
+/**
+  * @brief  sectors holding a valid header, as kv_sector_valid counts them.
+  * @param  none
+  * @retval sector count
+  */
+static uint32_t sectors_valid(void)
+{
+  uint32_t i, count = 0, word[3];
+
+  for(i = 0; i < KV_SECTOR_NUM; i ++)
+  {
+    memcpy(word, flash + i * KV_SECTOR_SIZE, sizeof(word));
+    if(word[0] == KV_SECTOR_MAGIC && word[1] == ~word[2])
+    {
+      count ++;
+    }
+  }
+  return count;
+}
+
+/**
+  * @brief  schedule the next power cut, 1 to 2 * cut_mean operations ahead.
+  * @note   a compaction takes some hundred operations, cuts closer than that
+  *         every time would keep the store from ever finishing one.
+  * @param  none
+  * @retval none
+  */
+static void cut_next(void)
+{
+  cut_rand ^= cut_rand << 13;
+  cut_rand ^= cut_rand >> 17;
+  cut_rand ^= cut_rand << 5;
+  cut_at = ops + 1 + cut_rand % (2 * cut_mean);
+}
+
+/**
+  * @brief  compare the store with a model.
+  * @param  kv: store
+  * @param  pmodel: values
+  * @retval 1 when every key matches
+  */
+static int store_matches(kv_store_type *kv, const model_value_type *pmodel)
+{
+  uint8_t data[KV_VALUE_LEN];
+  uint32_t key, len;
+  kv_status_type status;
+
+  for(key = 0; key < KV_KEYS; key ++)
+  {
+    status = kv_get(kv, (uint16_t)key, data, sizeof(data), &len);
+    if(pmodel[key].present)
+    {
+      if(status != KV_OK || len != pmodel[key].len || memcmp(data, pmodel[key].data, len) != 0)
+      {
+        return 0;
+      }
+    }
+    else if(status != KV_ERR_NOT_FOUND)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+  * @brief  mount after a power cut, the mount itself may be cut.
+  * @param  kv: store
+  * @retval status of the mount that finished
+  */
+static kv_status_type store_mount(kv_store_type *kv)
+{
+  static volatile kv_status_type status;
+
+  while(setjmp(cut_jmp) != 0)
+  {
+    cut_count[CUT_IN_MOUNT] ++;
+    cut_next();
+  }
+  status = kv_init(kv, &ram_config);
+  return status;
+}
+
+/**
+  * @brief  stage one random batch, the commit is left to the caller.
+  * @param  kv: store
+  * @retval none
+  */
+static void batch_stage(kv_store_type *kv)
+{
+  uint32_t count = 1 + rand_next() % 4, i, key, len;
+  uint8_t data[KV_VALUE_LEN];
+
+  memcpy(pending, model, sizeof(model));
+  for(i = 0; i < count; i ++)
+  {
+    key = rand_next() % KV_KEYS;
+    if(pending[key].present && (rand_next() % 5) == 0)
+    {
+      if(kv_delete(kv, (uint16_t)key) == KV_OK)
+      {
+        pending[key].present = 0;
+      }
+      continue;
+    }
+    len = rand_next() % (KV_VALUE_LEN + 1);
+    memset(data, (int)(rand_next() & 0xFF), len);
+    if(len)
+    {
+      data[0] = (uint8_t)key;
+      data[len - 1] = (uint8_t)rand_next();
+    }
+    if(kv_set(kv, (uint16_t)key, data, len) == KV_OK)
+    {
+      pending[key].present = 1;
+      pending[key].len = (uint8_t)len;
+      memcpy(pending[key].data, data, len);
+    }
+  }
+}
+
+/**
+  * @brief  phase of the next commit.
+  * @param  kv: store
+  * @retval cut_phase_type
+  */
+static cut_phase_type commit_phase(kv_store_type *kv)
+{
+  if(kv->head + kv->stage_len + KV_RECORD_HEADER_SIZE <= (kv->head_sector + 1) * KV_SECTOR_SIZE)
+  {
+    return CUT_IN_BATCH;
+  }
+  return (sectors_valid() + 1 >= KV_SECTOR_NUM) ? CUT_IN_COMPACTION : CUT_IN_CHECKPOINT;
+}
+
+/**
+  * @brief  the workload without power cuts, ops and erases are counted.
+  * @param  none
+  * @retval none
+  */
+static void test_no_cut(void)
+{
+  static kv_store_type kv, remount;
+  uint32_t batch, compactions = 0, erases;
+
+  memset(flash, 0xFF, sizeof(flash));
+  memset(model, 0, sizeof(model));
+  rand_state = 1;
+  CHECK(kv_init(&kv, &ram_config) == KV_OK);
+  for(batch = 0; batch < KV_BATCHES; batch ++)
+  {
+    batch_stage(&kv);
+    CHECK(kv_commit(&kv) == KV_OK);
+    memcpy(model, pending, sizeof(model));
+    CHECK(store_matches(&kv, model));
+    compactions = kv.compact_count;
+  }
+  erases = kv.erase_count;
+  CHECK(kv_init(&remount, &ram_config) == KV_OK);
+  CHECK(store_matches(&remount, model));
+  /* mount reads the newest sector only */
+  CHECK(remount.mount_scan_bytes <= KV_SECTOR_SIZE);
+  CHECK(compactions > 0 && overwrites == 0);
+  printf("  %u batches, %u flash operations, %u erases, %u compactions\n",
+         KV_BATCHES, ops, erases, compactions);
+}
+
+/**
+  * @brief  the workload with power cuts, the store is mounted again after
+  *         every cut and the workload goes on.
+  * @param  seed: seed of the cut times
+  * @param  mean: mean ops between cuts
+  * @retval none
+  */
+static void test_cuts(uint32_t seed, uint32_t mean)
+{
+  static kv_store_type kv;
+  static volatile uint32_t batch;
+  static volatile cut_phase_type phase;
+  static volatile uint8_t near;
+  uint32_t cut_before[CUT_PHASES];
+  uint32_t total = 0, compactions = 0, i;
+
+  memcpy(cut_before, cut_count, sizeof(cut_count));
+  memset(flash, 0xFF, sizeof(flash));
+  memset(model, 0, sizeof(model));
+  rand_state = 7 + seed;
+  ops = 0;
+  cut_at = 0;
+  CHECK(kv_init(&kv, &ram_config) == KV_OK);
+  near = 0;
+  cut_mean = mean;
+  cut_rand = seed;
+  cut_next();
+
+  for(batch = 0; batch < KV_BATCHES; batch ++)
+  {
+    batch_stage(&kv);
+    phase = commit_phase(&kv);
+    if(setjmp(cut_jmp) == 0)
+    {
+      CHECK(kv_commit(&kv) == KV_OK);
+      memcpy(model, pending, sizeof(model));
+      CHECK(store_matches(&kv, model));
+      compactions += (phase == CUT_IN_COMPACTION);
+      continue;
+    }
+
+    /* power cut, the next one comes stride operations later */
+    cut_count[phase] ++;
+    cut_next();
+    if(phase == CUT_IN_COMPACTION && near == 0)
+    {
+      /* the mount erases what the compaction left, cut that as well */
+      cut_at = ops + 1 + cut_rand % 2;
+    }
+    near = (phase == CUT_IN_COMPACTION && near == 0);
+    CHECK(store_mount(&kv) == KV_OK);
+    if(store_matches(&kv, pending))
+    {
+      memcpy(model, pending, sizeof(model));
+    }
+    else
+    {
+      CHECK(store_matches(&kv, model));
+    }
+  }
+  cut_at = 0;
+
+  for(i = 0; i < CUT_PHASES; i ++)
+  {
+    total += cut_count[i] - cut_before[i];
+  }
+  printf("  a cut every %u operations: %u cuts", mean, total);
+  for(i = 0; i < CUT_PHASES; i ++)
+  {
+    printf(", %u in %s", cut_count[i] - cut_before[i], cut_name[i]);
+  }
+  printf(", %u compactions done\n", compactions);
+  CHECK(overwrites == 0);
+  CHECK(compactions > 0);
+}
+
+/**
+  * @brief  kv store host test.
+  * @param  none
+  * @retval 0 when every scenario passed
+  */
+int main(void)
+{
+  static const uint32_t mean[] = {1000, 2000, 3000, 5000};
+  uint32_t i;
+
+  printf("kv store without power cuts\n");
+  test_no_cut();
+  for(i = 0; i < sizeof(mean) / sizeof(mean[0]); i ++)
+  {
+    printf("kv store with power cuts\n");
+    test_cuts(i + 1, mean[i]);
+  }
+  for(i = 0; i < CUT_PHASES; i ++)
+  {
+    if(cut_count[i] == 0)
+    {
+      printf("no power cut in %s\n", cut_name[i]);
+      failed = 1;
+    }
+  }
+  printf(failed ? "FAILED\n" : "all scenarios passed\n");
+  return failed;
+}
+
+/**
+  * @}
+  */
@@ -25,6 +25,7 @@
 #include "iap.h"
 #include "usart.h"
 #include "tmr.h"
+#include "integrity_index.h"
 
 /** @addtogroup UTILITIES_examples
   * @{
@@ -34,6 +35,8 @@
   * @{
   */
 
+static integrity_check_type iap_check;
+
 /**
   * @brief  iap command handle handle.
   * @param  none
@@ -64,6 +67,26 @@ void iap_init(void)
     flash_sector_erase(IAP_UPGRADE_FLAG_ADDR);
     flash_lock();
   }
+
+  /* the bootloader checked the index and the blocks needed to start, the
+     others are checked by iap_verify_handle. an app started without a valid
+     index, by a debugger for instance, is not checked */
+  integrity_check_init(&iap_check, (const integrity_index_type *)IAP_INDEX_ADDR);
+}
+
+/**
+  * @brief  check one more app block, called from the idle loop.
+  * @note   a corrupt block sets the upgrade flag and resets, the bootloader
+  *         then waits for a new app.
+  * @param  none
+  * @retval none
+  */
+void iap_verify_handle(void)
+{
+  if(integrity_check_poll(&iap_check) == INTEGRITY_ERR_BLOCK)
+  {
+    iap_flag = IAP_REV_FLAG_DONE;
+  }
 }
 
 /**
@@ -64,6 +64,9 @@ int main(void)
   while(1)
   {
     iap_command_handle();
+
+    /* check the app image in the background */
+    iap_verify_handle();
   }
 }
 
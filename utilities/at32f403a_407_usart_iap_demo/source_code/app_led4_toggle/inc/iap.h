@@ -53,6 +53,9 @@ extern "C" {
 indicates that an app upgrade will follow, see iap application note for more details */
 #define IAP_UPGRADE_FLAG         0x41544B38
 
+/* integrity index written by the bootloader in the last 2kb of the flash */
+#define IAP_INDEX_ADDR           (FLASH_BASE + 1024 * ((*((uint32_t*)0x1FFFF7E0)) & 0xFFFF) - 0x800)
+
 /**
   * @}
   */
@@ -63,6 +66,7 @@ indicates that an app upgrade will follow, see iap application note for more det
 
 void iap_command_handle(void);
 void iap_init(void);
+void iap_verify_handle(void);
 
 /**
   * @}
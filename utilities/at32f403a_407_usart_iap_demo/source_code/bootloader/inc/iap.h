@@ -53,6 +53,43 @@ extern "C" {
 indicates that an app upgrade will follow, see iap application note for more details */
 #define IAP_UPGRADE_FLAG         0x41544B38
 
+/* the last 2kb of the flash holds the integrity index of the app, a crc of
+every 2kb block written at the end of an upgrade, see readme.txt */
+#define IAP_INDEX_ADDR           (FLASH_BASE + 1024 * FLASH_SIZE - 0x800)
+
+/* programmed in place of the index when an upgrade starts, an app found with
+this word was not completely written */
+#define IAP_INDEX_UPGRADING      0x47505549
+
+/* 1: an app with a blank index, programmed by a debugger or by a bootloader
+without the index, is started after the reset handler check only.
+0: such an app is not started */
+#define IAP_LEGACY_APP           1
+
+/* 1: check every app block before the jump.
+0: check the index, the vector table and the reset handler only, the app checks
+the other blocks in its idle loop */
+#define IAP_VERIFY_FULL          0
+
+/* baudrate of the command protocol */
+#define IAP_DEFAULT_BAUDRATE     115200
+
+/* window protocol, entered by cmd 0x5a 0x03 followed by the 4 byte baudrate (msb first).
+data frames: 0xa5, seq, 4 byte address, 2kb data, 4 byte crc32 over address and data.
+every frame is answered by 0xcc seq 0xdd or 0xee seq reason, see readme.txt */
+#define IAP_WIN_MIN_BAUDRATE     9600
+#define IAP_WIN_MAX_BAUDRATE     4000000
+#define IAP_WIN_NUM              4        /* frames the pc-tool may send ahead of the answers */
+#define IAP_WIN_FRAME_HEAD       0xA5
+#define IAP_WIN_FRAME_LEN        (2 + 4 + 0x800 + 4)
+#define IAP_WIN_ACK              0xCC
+#define IAP_WIN_ACK_END          0xDD
+#define IAP_WIN_NAK              0xEE
+#define IAP_WIN_ERR_CRC          0x01
+#define IAP_WIN_ERR_ADDR         0x02
+#define IAP_WIN_ERR_FRAME        0x03
+#define IAP_WIN_IDLE_TIMEOUT     30       /* ms of silence that drop a partial frame */
+
 /**
   * @}
   */
@@ -72,6 +109,17 @@ typedef struct
   uint8_t cmd_check;
 } cmd_data_group_type;
 
+/**
+  * @brief  window protocol data frame type
+  */
+typedef struct
+{
+  uint8_t seq;
+  uint8_t addr[4];
+  uint32_t buf[0x800 / 4];
+  uint8_t check[4];
+} win_frame_type;
+
 /**
   * @brief  cmd data step type
   */
@@ -95,6 +143,8 @@ typedef enum
   CMD_CTR_DONE,
   CMD_CTR_ERR,
   CMD_CTR_APP,
+  CMD_CTR_BAUD,
+  CMD_CTR_WINDOW,
 } cmd_ctr_step_type;
 
 /**
@@ -106,6 +156,7 @@ typedef enum
   UPDATE_CLEAR_FLAG,
   UPDATE_ING,
   UPDATE_DONE,
+  UPDATE_WINDOW,
 } update_status_type;
 
 typedef void (*iapfun)(void);
@@ -128,6 +179,7 @@ void back_err(void);
 void back_ok(void);
 void iap_upgrade_app_handle(void);
 void app_load(uint32_t appxaddr);
+flag_status iap_app_check(void);
 
 /**
   * @}
@@ -31,8 +31,13 @@ extern "C" {
 
 #include "at32f403a_407_board.h"
 
+/* tmr3 period, the upgrade time out still counts in seconds */
+#define TMR_TICK_MS        10
+
 extern uint8_t time_ira_cnt;
 extern uint8_t get_data_from_usart_flag;
+extern __IO uint16_t time_idle_tick;
+extern __IO uint8_t time_out_flag;
 
 /** @addtogroup UTILITIES_examples
   * @{
@@ -45,6 +45,9 @@ extern "C" {
 
 #define USART_REC_LEN      1024
 
+/* dma ring used by the window protocol, holds a full window of data frames */
+#define USART_DMA_REC_LEN  0x2400
+
 /**
   * @}
   */
@@ -64,17 +67,32 @@ typedef struct
   uint16_t count;
 } usart_group_type;
 
+/**
+  * @brief  usart dma group type
+  */
+typedef struct
+{
+  uint8_t buf[USART_DMA_REC_LEN];
+  uint16_t tail;
+  __IO uint8_t idle_flag;
+} usart_dma_group_type;
+
 /**
   * @}
   */
 
 extern usart_group_type usart_group_struct;
+extern usart_dma_group_type usart_dma_group_struct;
 
 /** @defgroup bootloader_exported_functions
   * @{
   */
 
 void uart_init(uint32_t baudrate);
+void uart_dma_rx_start(uint32_t baudrate);
+void uart_dma_rx_stop(uint32_t baudrate);
+uint16_t uart_dma_rx_count(void);
+uint8_t uart_dma_rx_take(void);
 
 /**
   * @}
@@ -22,10 +22,17 @@
   **************************************************************************
   */
 
+#include "string.h"
 #include "iap.h"
 #include "usart.h"
 #include "flash.h"
 #include "tmr.h"
+#include "image_codec.h"
+#include "integrity_index.h"
+
+#if (USART_DMA_REC_LEN < IAP_WIN_NUM * IAP_WIN_FRAME_LEN)
+#error "usart dma ring must hold a full window of frames"
+#endif
 
 /** @addtogroup UTILITIES_examples
   * @{
@@ -41,6 +48,17 @@ cmd_data_group_type cmd_data_group_struct;
 update_status_type update_status = UPDATE_PRE;
 static uint8_t cmd_addr_cnt = 0;
 static uint32_t cmd_data_cnt = 0;
+static uint32_t cmd_baudrate = 0;
+static uint32_t win_cnt = 0;
+static uint8_t win_end = 0;
+static uint8_t win_mode = 0;
+win_frame_type win_frame;
+static image_decoder_type image_decoder;
+static uint8_t image_decoding = 0;
+static uint32_t image_next_addr = 0;
+static uint32_t image_end_addr = 0;
+static integrity_index_type iap_index;
+static integrity_check_type iap_check;
 iapfun jump_to_app;
 
 /* app_load don't optimize */
@@ -67,6 +85,9 @@ void app_load(uint32_t app_addr)
     crm_periph_clock_enable(CRM_TMR3_PERIPH_CLOCK, FALSE);
     crm_periph_clock_enable(CRM_USART1_PERIPH_CLOCK, FALSE);
     crm_periph_clock_enable(CRM_GPIOA_PERIPH_CLOCK, FALSE);
+    dma_reset(DMA1_CHANNEL5);
+    crm_periph_clock_enable(CRM_DMA1_PERIPH_CLOCK, FALSE);
+    crm_periph_clock_enable(CRM_CRC_PERIPH_CLOCK, FALSE);
 
     /* disable nvic irq and clear pending */
     nvic_irq_disable(USART1_IRQn);
@@ -80,6 +101,163 @@ void app_load(uint32_t app_addr)
   }
 }
 
+/**
+  * @brief  decoder page writer.
+  * @note   a frame of a compressed or delta image may expand to many pages,
+  *         every page written counts as activity for the upgrade time out.
+  * @param  offset: offset in the app
+  * @param  pbuffer: 2kb page
+  * @retval 0 when the page reads back as written
+  */
+static int iap_page_write(uint32_t offset, uint8_t *pbuffer)
+{
+  time_ira_cnt = 0;
+  /* pages a delta patch leaves as they are are not erased again */
+  if(memcmp((const void *)(APP_START_ADDR + offset), pbuffer, 0x800) != 0)
+  {
+    flash_2kb_write(APP_START_ADDR + offset, pbuffer);
+  }
+  if(APP_START_ADDR + offset + 0x800 > image_end_addr)
+  {
+    image_end_addr = APP_START_ADDR + offset + 0x800;
+  }
+  return (memcmp((const void *)(APP_START_ADDR + offset), pbuffer, 0x800) == 0) ? 0 : 1;
+}
+
+/**
+  * @brief  write one 2kb block of the update image.
+  * @note   a block at the app starting address carrying the lz4 or delta
+  *         magic starts the decoder, the following blocks must then arrive
+  *         in order. delta patches are applied in place on the current app.
+  * @param  write_addr: block address
+  * @param  pbuffer: 2kb block
+  * @retval 0 when accepted
+  */
+static uint8_t iap_block_write(uint32_t write_addr, uint8_t *pbuffer)
+{
+  uint32_t magic = pbuffer[0] | (pbuffer[1] << 8) | (pbuffer[2] << 16) | ((uint32_t)pbuffer[3] << 24);
+  uint32_t app_size = IAP_INDEX_ADDR - APP_START_ADDR;
+
+  if(write_addr == APP_START_ADDR)
+  {
+    image_decoding = (magic == IMAGE_LZ4_MAGIC || magic == IMAGE_DELTA_MAGIC);
+    if(image_decoding)
+    {
+      image_decode_init(&image_decoder, iap_page_write,
+                        (const uint8_t *)APP_START_ADDR, app_size,
+                        (const uint8_t *)APP_START_ADDR, app_size);
+      image_next_addr = APP_START_ADDR;
+    }
+  }
+
+  if(image_decoding == 0)
+  {
+    return (uint8_t)iap_page_write(write_addr - APP_START_ADDR, pbuffer);
+  }
+
+  if(write_addr != image_next_addr)
+  {
+    return 1;
+  }
+  image_next_addr += 0x800;
+  return (image_decode_feed(&image_decoder, pbuffer, 0x800) == IMAGE_OK) ? 0 : 1;
+}
+
+/**
+  * @brief  flush the decoder at the end of the upgrade.
+  * @param  none
+  * @retval 0 when the image is complete
+  */
+static uint8_t iap_image_finish(void)
+{
+  if(image_decoding == 0)
+  {
+    return 0;
+  }
+  image_decoding = 0;
+  return (image_decode_finish(&image_decoder, 0) == IMAGE_OK) ? 0 : 1;
+}
+
+/**
+  * @brief  drop the integrity index before the app is overwritten.
+  * @note   the upgrading word tells an interrupted upgrade from a legacy app,
+  *         both leave no valid index.
+  * @param  none
+  * @retval none
+  */
+static void iap_index_erase(void)
+{
+  flash_unlock();
+  flash_sector_erase(IAP_INDEX_ADDR);
+  if(FLASH_SIZE < 0x100)  /* less than 256kb, 1kb/sector */
+    flash_sector_erase(IAP_INDEX_ADDR + 0x400);
+  flash_word_program(IAP_INDEX_ADDR, IAP_INDEX_UPGRADING);
+  flash_lock();
+  image_end_addr = 0;
+}
+
+/**
+  * @brief  write the integrity index of the app just programmed.
+  * @param  none
+  * @retval 0 when the index is written
+  */
+static uint8_t iap_index_write(void)
+{
+  if(image_end_addr <= APP_START_ADDR ||
+     integrity_index_build(&iap_index, APP_START_ADDR, image_end_addr - APP_START_ADDR) != INTEGRITY_OK)
+  {
+    return 1;
+  }
+  flash_2kb_write(IAP_INDEX_ADDR, (uint8_t *)&iap_index);
+  return (integrity_check_init(&iap_check, (const integrity_index_type *)IAP_INDEX_ADDR) == INTEGRITY_OK) ? 0 : 1;
+}
+
+/**
+  * @brief  check the app before the jump.
+  * @note   with IAP_VERIFY_FULL at 0 only the blocks holding the vector table
+  *         and the reset handler are checked here, the app checks the rest.
+  *         an interrupted upgrade is not started, an app with a blank index
+  *         is started when IAP_LEGACY_APP is 1.
+  * @param  none
+  * @retval SET when the app may be started
+  */
+flag_status iap_app_check(void)
+{
+  uint32_t reset_handler = *(uint32_t *)(APP_START_ADDR + 4) & ~1UL;
+  integrity_status_type status;
+
+  /* check app starting address whether 0x08xxxxxx */
+  if((reset_handler & 0xFF000000) != 0x08000000)
+    return RESET;
+
+  /* no index at all, the app was not written by this bootloader */
+  if(*(uint32_t *)IAP_INDEX_ADDR == 0xFFFFFFFF)
+  {
+#if IAP_LEGACY_APP
+    return SET;
+#else
+    return RESET;
+#endif
+  }
+
+  /* the upgrading word fails the index check as well */
+  status = integrity_check_init(&iap_check, (const integrity_index_type *)IAP_INDEX_ADDR);
+  if(status == INTEGRITY_OK && iap_check.pindex->image_addr != APP_START_ADDR)
+    status = INTEGRITY_ERR_INDEX;
+#if IAP_VERIFY_FULL
+  if(status == INTEGRITY_OK)
+    status = integrity_check_all(&iap_check);
+#else
+  if(status == INTEGRITY_OK)
+    status = integrity_check_range(&iap_check, APP_START_ADDR, 8);
+  if(status == INTEGRITY_OK)
+    status = integrity_check_range(&iap_check, reset_handler, 2);
+#endif
+  crm_periph_clock_enable(CRM_CRC_PERIPH_CLOCK, FALSE);
+
+  return (status == INTEGRITY_OK) ? SET : RESET;
+}
+
 /**
   * @brief  take data from usart buf.
   * @param  app_addr
@@ -131,11 +309,26 @@ void command_handle(void)
       {
         cmd_ctr_step = CMD_CTR_APP;
       }
+      else if(val == 0x03)
+      {
+        cmd_ctr_step = CMD_CTR_BAUD;
+        cmd_addr_cnt = 0;
+        cmd_baudrate = 0;
+      }
       else
       {
         cmd_ctr_step = CMD_CTR_ERR;
       }
     }
+    else if(cmd_ctr_step == CMD_CTR_BAUD)
+    {
+      cmd_baudrate = (cmd_baudrate << 8) | val;
+      if(++cmd_addr_cnt >= 4)
+      {
+        cmd_addr_cnt = 0;
+        cmd_ctr_step = CMD_CTR_WINDOW;
+      }
+    }
   }
   else if(update_status == UPDATE_ING)
   {
@@ -255,6 +448,219 @@ void back_err(void)
   get_data_from_usart_flag = 0;
 }
 
+/**
+  * @brief  window protocol frame response.
+  * @param  res: IAP_WIN_ACK or IAP_WIN_NAK
+  * @param  seq: frame sequence number
+  * @param  reason: IAP_WIN_ACK_END or error reason
+  * @retval none
+  */
+static void window_respond(uint8_t res, uint8_t seq, uint8_t reason)
+{
+  usart_data_transmit(USART1, res);
+  while(usart_flag_get(USART1, USART_TDC_FLAG) == RESET);
+  usart_data_transmit(USART1, seq);
+  while(usart_flag_get(USART1, USART_TDC_FLAG) == RESET);
+  usart_data_transmit(USART1, reason);
+  while(usart_flag_get(USART1, USART_TDC_FLAG) == RESET);
+}
+
+/**
+  * @brief  store one byte of the window frame being received.
+  * @param  index: byte index after the frame head, 0 is the sequence number
+  * @param  val: byte
+  * @retval none
+  */
+static void window_frame_put(uint32_t index, uint8_t val)
+{
+  if(index == 0)
+  {
+    win_frame.seq = val;
+  }
+  else if(index < 5)
+  {
+    win_frame.addr[index - 1] = val;
+  }
+  else if(index < 5 + 0x800)
+  {
+    ((uint8_t *)win_frame.buf)[index - 5] = val;
+  }
+  else
+  {
+    win_frame.check[index - 5 - 0x800] = val;
+  }
+}
+
+/**
+  * @brief  read back one byte of the window frame received.
+  * @param  index: byte index after the frame head, 0 is the sequence number
+  * @retval byte
+  */
+static uint8_t window_frame_get(uint32_t index)
+{
+  if(index == 0)
+  {
+    return win_frame.seq;
+  }
+  else if(index < 5)
+  {
+    return win_frame.addr[index - 1];
+  }
+  else if(index < 5 + 0x800)
+  {
+    return ((uint8_t *)win_frame.buf)[index - 5];
+  }
+  return win_frame.check[index - 5 - 0x800];
+}
+
+/**
+  * @brief  restart the frame parser at the next head found in a frame whose
+  *         crc failed, so a lost byte only costs the frames it touched.
+  * @param  none
+  * @retval none
+  */
+static void window_resync(void)
+{
+  uint32_t start, index;
+
+  win_cnt = 0;
+  for(start = 0; start < IAP_WIN_FRAME_LEN - 1; start++)
+  {
+    if(window_frame_get(start) == IAP_WIN_FRAME_HEAD)
+    {
+      break;
+    }
+  }
+
+  /* the bytes after the head are moved to the start of the frame, reading
+     always runs ahead of writing */
+  for(index = start + 1; index < IAP_WIN_FRAME_LEN - 1; index++)
+  {
+    window_frame_put(index - start - 1, window_frame_get(index));
+  }
+  if(start < IAP_WIN_FRAME_LEN - 1)
+  {
+    win_cnt = IAP_WIN_FRAME_LEN - 1 - start;
+  }
+}
+
+/**
+  * @brief  check and program one window protocol data frame.
+  * @note   the dma keeps receiving the following frames while flash is busy.
+  * @param  none
+  * @retval 1 when the crc failed
+  */
+static uint8_t window_frame_handle(void)
+{
+  uint32_t write_addr, check;
+
+  write_addr = (win_frame.addr[0] << 24) + (win_frame.addr[1] << 16) + \
+               (win_frame.addr[2] << 8) + win_frame.addr[3];
+  check = (win_frame.check[0] << 24) + (win_frame.check[1] << 16) + \
+          (win_frame.check[2] << 8) + win_frame.check[3];
+
+  crc_data_reset();
+  crc_one_word_calculate(write_addr);
+  if(crc_block_calculate(win_frame.buf, 0x800 / 4) != check)
+  {
+    /* only this frame is sent again */
+    window_respond(IAP_WIN_NAK, win_frame.seq, IAP_WIN_ERR_CRC);
+    return 1;
+  }
+  else if((write_addr >= APP_START_ADDR) && (write_addr < IAP_INDEX_ADDR) &&
+          ((write_addr & 0x7FF) == 0) && iap_block_write(write_addr, (uint8_t *)win_frame.buf) == 0)
+  {
+    window_respond(IAP_WIN_ACK, win_frame.seq, IAP_WIN_ACK_END);
+  }
+  else
+  {
+    window_respond(IAP_WIN_NAK, win_frame.seq, IAP_WIN_ERR_ADDR);
+  }
+  return 0;
+}
+
+/**
+  * @brief  window protocol handle.
+  * @note   data frames are parsed from the dma ring by length. after a crc
+  *         error the parser restarts at the next frame head inside the bad
+  *         frame. when the line went idle in the middle of a frame and stays
+  *         silent for IAP_WIN_IDLE_TIMEOUT, the partial frame is dropped and
+  *         answered with a nak so the pc-tool resends it.
+  * @param  none
+  * @retval none
+  */
+static void window_handle(void)
+{
+  uint8_t val;
+  uint32_t index;
+
+  while(uart_dma_rx_count() > 0)
+  {
+    val = uart_dma_rx_take();
+    time_ira_cnt = 0;
+    time_idle_tick = 0;
+
+    if(win_cnt == 0)
+    {
+      if(win_end)
+      {
+        win_end = 0;
+        if(val == 0x02)
+        {
+          if(iap_image_finish() != 0 || iap_index_write() != 0)
+          {
+            /* same answer as the legacy done command */
+            back_err();
+            return;
+          }
+          back_ok();
+          /* check app starting address whether 0x08xxxxxx */
+          if(((*(uint32_t*)(APP_START_ADDR + 4)) & 0xFF000000) == 0x08000000)
+          {
+            crm_reset();
+            /* jump and run in app */
+            app_load(APP_START_ADDR);
+          }
+          back_err();
+          return;
+        }
+      }
+      if(val == IAP_WIN_FRAME_HEAD)
+      {
+        win_cnt = 1;
+      }
+      else if(val == 0x5A)
+      {
+        win_end = 1;
+      }
+      continue;
+    }
+
+    index = win_cnt - 1;
+    window_frame_put(index, val);
+
+    if(++win_cnt >= IAP_WIN_FRAME_LEN)
+    {
+      win_cnt = 0;
+      if(window_frame_handle())
+      {
+        window_resync();
+      }
+    }
+  }
+
+  if(usart_dma_group_struct.idle_flag && time_idle_tick * TMR_TICK_MS >= IAP_WIN_IDLE_TIMEOUT)
+  {
+    usart_dma_group_struct.idle_flag = 0;
+    if(win_cnt > 1)
+    {
+      window_respond(IAP_WIN_NAK, win_frame.seq, IAP_WIN_ERR_FRAME);
+    }
+    win_cnt = 0;
+    win_end = 0;
+  }
+}
+
 /**
   * @brief  app update flow handle.
   * @param  none
@@ -275,6 +681,28 @@ void app_update_handle(void)
       cmd_ctr_step = CMD_CTR_IDLE;
       back_ok();
     }
+    else if(cmd_ctr_step == CMD_CTR_WINDOW)
+    {
+      cmd_ctr_step = CMD_CTR_IDLE;
+      if((cmd_baudrate >= IAP_WIN_MIN_BAUDRATE) && (cmd_baudrate <= IAP_WIN_MAX_BAUDRATE))
+      {
+        /* erase first, the pc-tool sends frames as soon as the answer arrives.
+           answer at the old baudrate, then switch */
+        crm_periph_clock_enable(CRM_CRC_PERIPH_CLOCK, TRUE);
+        iap_index_erase();
+        back_ok();
+        uart_dma_rx_start(cmd_baudrate);
+        win_cnt = 0;
+        win_end = 0;
+        win_mode = 1;
+        get_data_from_usart_flag = 1;
+        update_status = UPDATE_WINDOW;
+      }
+      else
+      {
+        back_err();
+      }
+    }
     else if(cmd_ctr_step == CMD_CTR_ERR)
     {
       cmd_ctr_step = CMD_CTR_IDLE;
@@ -283,6 +711,7 @@ void app_update_handle(void)
   }
   else if(update_status == UPDATE_CLEAR_FLAG)
   {
+    iap_index_erase();
     get_data_from_usart_flag = 1;
     update_status = UPDATE_ING;
     back_ok();
@@ -293,9 +722,9 @@ void app_update_handle(void)
     {
       write_addr = (cmd_data_group_struct.cmd_addr[0] << 24) + (cmd_data_group_struct.cmd_addr[1] << 16) + \
                    (cmd_data_group_struct.cmd_addr[2] << 8) + cmd_data_group_struct.cmd_addr[3];
-      if((write_addr >= APP_START_ADDR) && (write_addr < FLASH_BASE + 1024 * FLASH_SIZE))
+      if((write_addr >= APP_START_ADDR) && (write_addr < IAP_INDEX_ADDR) &&
+         iap_block_write(write_addr, cmd_data_group_struct.cmd_buf) == 0)
       {
-        flash_2kb_write(write_addr, cmd_data_group_struct.cmd_buf);
         cmd_data_step = CMD_DATA_IDLE;
         back_ok();
       }
@@ -313,7 +742,12 @@ void app_update_handle(void)
   }
   else if(update_status == UPDATE_DONE)
   {
-    if(cmd_ctr_step == CMD_CTR_DONE)
+    if(cmd_ctr_step == CMD_CTR_DONE && (iap_image_finish() != 0 || iap_index_write() != 0))
+    {
+      cmd_ctr_step = CMD_CTR_IDLE;
+      back_err();
+    }
+    else if(cmd_ctr_step == CMD_CTR_DONE)
     {
       cmd_ctr_step = CMD_CTR_IDLE;
       back_ok();
@@ -344,6 +778,26 @@ void app_update_handle(void)
   */
 void iap_upgrade_app_handle(void)
 {
+  /* no data for more than 2s, the upgrade is given up */
+  if(time_out_flag)
+  {
+    back_err();
+    time_out_flag = 0;
+  }
+
+  if(update_status == UPDATE_WINDOW)
+  {
+    window_handle();
+    return;
+  }
+
+  /* window protocol aborted, go back to the command protocol */
+  if(win_mode)
+  {
+    win_mode = 0;
+    uart_dma_rx_stop(IAP_DEFAULT_BAUDRATE);
+  }
+
   command_handle();
   app_update_handle();
 }
@@ -53,13 +53,13 @@ int main(void)
   /* check iap_upgrade_flag flag */
   if(flash_upgrade_flag_read() == RESET)
   {
-    /* check app starting address whether 0x08xxxxxx */
-    if(((*(uint32_t*)(APP_START_ADDR + 4)) & 0xFF000000) == 0x08000000)
+    /* check app starting address and the integrity index */
+    if(iap_app_check() == SET)
       app_load(APP_START_ADDR);
   }
 
   /* init usart used for app update */
-  uart_init(115200);
+  uart_init(IAP_DEFAULT_BAUDRATE);
 
   /* check whether need to upgrade, if yes, response ok to pc-tool */
   if(flash_upgrade_flag_read() != RESET)
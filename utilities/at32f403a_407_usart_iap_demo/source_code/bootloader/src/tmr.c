@@ -36,6 +36,9 @@
 
 uint8_t time_ira_cnt=0;
 uint8_t get_data_from_usart_flag = 0;  /* flag for timer out in upgrade flow */
+__IO uint16_t time_idle_tick = 0;      /* ticks without received data, cleared by the receiver */
+__IO uint8_t time_out_flag = 0;        /* upgrade time out, answered by the main loop */
+static uint8_t time_tick_cnt = 0;
 
 /**
   * @brief  init tmr.
@@ -54,8 +57,8 @@ void tmr_init(void)
   /* get system clock */
   crm_clocks_freq_get(&crm_clocks_freq_struct);
 
-  /* time base configuration */
-  tmr_base_init(TMR3, 10000, crm_clocks_freq_struct.ahb_freq / 10000);
+  /* time base configuration, 10khz counter */
+  tmr_base_init(TMR3, TMR_TICK_MS * 10, crm_clocks_freq_struct.ahb_freq / 10000);
   tmr_cnt_dir_set(TMR3, TMR_COUNT_UP);
 
   /* overflow interrupt enable */
@@ -75,13 +78,20 @@ void TMR3_GLOBAL_IRQHandler(void)
   if(tmr_interrupt_flag_get(TMR3, TMR_OVF_FLAG) == SET)
   {
     tmr_flag_clear(TMR3, TMR_OVF_FLAG);
+    if(time_idle_tick < 0xFFFF)
+      time_idle_tick++;
+    if(++time_tick_cnt < 1000 / TMR_TICK_MS)
+      return;
+    time_tick_cnt = 0;
+
     at32_led_toggle(LED2);
     if(get_data_from_usart_flag)
     {
       if((++time_ira_cnt) == 0x00)
         time_ira_cnt = 0xFF;
+      /* the error is sent by the main loop, never in the middle of a response */
       if(time_ira_cnt > 2)
-        back_err();
+        time_out_flag = 1;
       if(time_ira_cnt > 5)
         crm_periph_clock_enable(LED2_GPIO_CRM_CLK, FALSE);
     }
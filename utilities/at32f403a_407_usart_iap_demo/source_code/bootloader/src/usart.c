@@ -34,6 +34,7 @@
   */
 
 usart_group_type usart_group_struct;
+usart_dma_group_type usart_dma_group_struct;
 
 /**
   * @brief  init usart.
@@ -77,6 +78,104 @@ void uart_init(uint32_t baudrate)
   usart_enable(USART1, TRUE);
 }
 
+/**
+  * @brief  switch usart to circular dma reception.
+  * @note   the usart is reconfigured with the new baudrate, bytes are
+  *         collected by dma1 channel5 and the idle line interrupt marks the
+  *         end of a burst.
+  * @param  baudrate: new baudrate
+  * @retval none
+  */
+void uart_dma_rx_start(uint32_t baudrate)
+{
+  dma_init_type dma_init_struct;
+
+  /* stop byte by byte reception */
+  usart_interrupt_enable(USART1, USART_RDBF_INT, FALSE);
+  usart_enable(USART1, FALSE);
+  usart_init(USART1, baudrate, USART_DATA_8BITS, USART_STOP_1_BIT);
+
+  /* dma1 channel5 for usart1 rx configuration */
+  crm_periph_clock_enable(CRM_DMA1_PERIPH_CLOCK, TRUE);
+  dma_reset(DMA1_CHANNEL5);
+  dma_default_para_init(&dma_init_struct);
+  dma_init_struct.buffer_size = USART_DMA_REC_LEN;
+  dma_init_struct.direction = DMA_DIR_PERIPHERAL_TO_MEMORY;
+  dma_init_struct.memory_base_addr = (uint32_t)usart_dma_group_struct.buf;
+  dma_init_struct.memory_data_width = DMA_MEMORY_DATA_WIDTH_BYTE;
+  dma_init_struct.memory_inc_enable = TRUE;
+  dma_init_struct.peripheral_base_addr = (uint32_t)&USART1->dt;
+  dma_init_struct.peripheral_data_width = DMA_PERIPHERAL_DATA_WIDTH_BYTE;
+  dma_init_struct.peripheral_inc_enable = FALSE;
+  dma_init_struct.priority = DMA_PRIORITY_VERY_HIGH;
+  dma_init_struct.loop_mode_enable = TRUE;
+  dma_init(DMA1_CHANNEL5, &dma_init_struct);
+
+  /* config flexible dma for usart1 rx */
+  dma_flexible_config(DMA1, FLEX_CHANNEL5, DMA_FLEXIBLE_UART1_RX);
+
+  usart_dma_group_struct.tail = 0;
+  usart_dma_group_struct.idle_flag = 0;
+
+  usart_dma_receiver_enable(USART1, TRUE);
+  dma_channel_enable(DMA1_CHANNEL5, TRUE);
+  usart_interrupt_enable(USART1, USART_IDLE_INT, TRUE);
+  usart_enable(USART1, TRUE);
+}
+
+/**
+  * @brief  switch usart back to interrupt reception.
+  * @param  baudrate: new baudrate
+  * @retval none
+  */
+void uart_dma_rx_stop(uint32_t baudrate)
+{
+  usart_interrupt_enable(USART1, USART_IDLE_INT, FALSE);
+  usart_dma_receiver_enable(USART1, FALSE);
+  dma_channel_enable(DMA1_CHANNEL5, FALSE);
+  crm_periph_clock_enable(CRM_DMA1_PERIPH_CLOCK, FALSE);
+
+  usart_enable(USART1, FALSE);
+  usart_init(USART1, baudrate, USART_DATA_8BITS, USART_STOP_1_BIT);
+
+  usart_group_struct.count = 0;
+  usart_group_struct.head = 0;
+  usart_group_struct.tail = 0;
+
+  usart_interrupt_enable(USART1, USART_RDBF_INT, TRUE);
+  usart_enable(USART1, TRUE);
+}
+
+/**
+  * @brief  number of bytes waiting in the dma ring.
+  * @param  none
+  * @retval byte count
+  */
+uint16_t uart_dma_rx_count(void)
+{
+  uint16_t head = USART_DMA_REC_LEN - dma_data_number_get(DMA1_CHANNEL5);
+
+  if(head >= USART_DMA_REC_LEN)
+    head = 0;
+  if(head >= usart_dma_group_struct.tail)
+    return head - usart_dma_group_struct.tail;
+  return USART_DMA_REC_LEN - usart_dma_group_struct.tail + head;
+}
+
+/**
+  * @brief  take one byte from the dma ring.
+  * @param  none
+  * @retval val
+  *         took data
+  */
+uint8_t uart_dma_rx_take(void)
+{
+  uint8_t val = usart_dma_group_struct.buf[usart_dma_group_struct.tail++];
+  if(usart_dma_group_struct.tail > (USART_DMA_REC_LEN - 1))
+    usart_dma_group_struct.tail = 0;
+  return val;
+}
+
 /**
   * @brief  usart1 interrupt handler.
   * @param  none
@@ -105,6 +204,12 @@ void USART1_IRQHandler(void)
       }
     }
   }
+  if(usart_interrupt_flag_get(USART1, USART_IDLEF_FLAG) != RESET)
+  {
+    /* idle line after a burst of dma data */
+    usart_flag_clear(USART1, USART_IDLEF_FLAG);
+    usart_dma_group_struct.idle_flag = 1;
+  }
 }
 
 /**
@@ -24,6 +24,7 @@
 
 #include "hid_iap_user.h"
 #include "hid_iap_class.h"
+#include "image_codec.h"
 #include "string.h"
 
 /** @addtogroup UTILITIES_examples
@@ -38,6 +39,7 @@ void (*pftarget)(void);
 void iap_clear_upgrade_flag(void);
 void iap_set_upgrade_flag(void);
 uint32_t crc_cal(uint32_t addr, uint16_t nk);
+static void iap_block_crc(iap_block_type *pblock);
 
 void iap_idle(void);
 void iap_start(void);
@@ -46,6 +48,16 @@ void iap_finish(void);
 iap_result_type iap_data_write(uint8_t *pdata, uint32_t len);
 void iap_jump(void);
 void iap_respond(uint8_t *res_buf, uint16_t iap_cmd, uint16_t result);
+static void iap_block_program(iap_block_type *pblock);
+static void iap_erase_ahead(void);
+static void iap_pending_respond(void);
+static int iap_page_write(uint32_t offset, uint8_t *pbuffer);
+static uint8_t iap_block_decode(iap_block_type *pblock);
+
+static void *iap_udev;
+static image_decoder_type image_decoder;
+static uint8_t image_decoding = 0;
+static uint32_t image_next_address = 0;
 
 /* app_load don't optimize */
 #if defined (__CC_ARM)
@@ -124,33 +136,48 @@ iap_result_type iap_get_upgrade_flag(void)
 }
 
 /**
-  * @brief  set iap upgrade complete flag
-  * @param  none
-  * @retval none
+  * @brief  make sure the sectors covering [address, address + len) are erased
+  * @param  address: start address
+  * @param  len: length in byte
+  * @retval flash status
   */
-void iap_erase_sector(uint32_t address)
+flash_status_type iap_erase_sector(uint32_t address, uint32_t len)
 {
-  flash_unlock();
-  if(iap_info.sector_size == SECTOR_SIZE_1K)
+  flash_status_type status = FLASH_OPERATE_DONE;
+
+  /* a block outside the erased region starts a new region */
+  if(address < iap_info.erase_start_address || address > iap_info.erase_end_address)
   {
-    flash_sector_erase(address);
+    iap_info.erase_start_address = address & ~(iap_info.sector_size - 1);
+    iap_info.erase_end_address = iap_info.erase_start_address;
   }
-  else if(iap_info.sector_size == SECTOR_SIZE_2K)
+
+  flash_unlock();
+  while(iap_info.erase_end_address < address + len && status == FLASH_OPERATE_DONE)
   {
-    /* check the address is sector align */
-    if((address & (SECTOR_SIZE_2K-1)) == 0)
-    {
-      flash_sector_erase(address);
-    }
+    status = flash_sector_erase(iap_info.erase_end_address);
+    iap_info.erase_end_address += iap_info.sector_size;
   }
-  else if(iap_info.sector_size == SECTOR_SIZE_4K)
+  flash_lock();
+
+  return status;
+}
+
+/**
+  * @brief  erase the sector the next block will need while the usb is busy receiving it
+  * @param  none
+  * @retval none
+  */
+static void iap_erase_ahead(void)
+{
+  if(iap_info.state == IAP_STS_ADDR &&
+     image_decoding == 0 &&
+     iap_info.program_end_address != 0 &&
+     iap_info.program_end_address == iap_info.erase_end_address &&
+     iap_info.erase_end_address < iap_info.flash_end_address)
   {
-    if((address & (SECTOR_SIZE_4K-1)) == 0)
-    {
-      flash_sector_erase(address);
-    }
+    iap_erase_sector(iap_info.erase_end_address, iap_info.sector_size);
   }
-  flash_lock();
 }
 
 /**
@@ -176,6 +203,35 @@ uint32_t crc_cal(uint32_t addr, uint16_t nk)
   return crc_data_get();
 }
 
+/**
+  * @brief  feed one programmed block into the running image crc
+  * @param  pblock: programmed block
+  * @retval none
+  */
+static void iap_block_crc(iap_block_type *pblock)
+{
+  uint32_t i_index;
+
+  /* a block that does not follow the previous one starts a new image */
+  if(iap_info.program_end_address == 0 || pblock->address != iap_info.program_end_address)
+  {
+    iap_info.image_start_address = pblock->address;
+    iap_info.image_crc = 0xFFFFFFFF;
+  }
+
+  /* resume the crc unit from the running value */
+  crm_periph_clock_enable(CRM_CRC_PERIPH_CLOCK, TRUE);
+  crc_init_data_set(iap_info.image_crc);
+  crc_data_reset();
+  for(i_index = 0; i_index < HID_IAP_BUFFER_LEN / sizeof(uint32_t); i_index ++)
+  {
+    crc_one_word_calculate(CONVERT_ENDIAN(pblock->data[i_index]));
+  }
+  iap_info.image_crc = crc_data_get();
+  crc_init_data_set(0xFFFFFFFF);
+  crc_data_reset();
+}
+
 /**
   * @brief  iap init
   * @param  none
@@ -201,6 +257,15 @@ void iap_init(void)
 
   iap_info.fifo_length = 0;
   iap_info.iap_address = 0;
+
+  iap_info.erase_start_address = 0;
+  iap_info.erase_end_address = 0;
+  iap_info.program_end_address = 0;
+  iap_info.program_error = 0;
+  iap_info.image_start_address = 0;
+  iap_info.image_crc = 0xFFFFFFFF;
+
+  image_decoding = 0;
 }
 
 /**
@@ -254,12 +319,14 @@ iap_result_type iap_address(uint8_t *pdata, uint32_t len)
   else
   {
     iap_info.iap_address = address;
+    /* a block sent again after a lost report starts over */
+    iap_info.fifo_length = 0;
 
+    /* flash is erased by iap_loop, just before the block is programmed */
     if(iap_info.state == IAP_STS_START)
     {
-      iap_clear_upgrade_flag();
+      iap_info.flag_clear_pending = 1;
     }
-    iap_erase_sector(iap_info.iap_address);
   }
 
   iap_info.state = IAP_STS_ADDR;
@@ -278,7 +345,8 @@ iap_result_type iap_data_write(uint8_t *pdata, uint32_t len)
 {
   uint32_t data_len = (pdata[2] << 8 | pdata[3]);
   uint8_t *valid_data = pdata + 4;
-  uint32_t *pbuf;
+  iap_block_type *pblock = &iap_info.block[iap_info.block_head % HID_IAP_QUEUE_NUM];
+  uint8_t *pbuf = (uint8_t *)pblock->data;
   uint32_t i_index = 0;
 
   if(iap_info.state == IAP_STS_ADDR)
@@ -287,24 +355,28 @@ iap_result_type iap_data_write(uint8_t *pdata, uint32_t len)
     {
       for(i_index = 0; i_index < data_len; i_index ++)
       {
-        iap_info.iap_fifo[iap_info.fifo_length ++] = valid_data[i_index];
+        pbuf[iap_info.fifo_length ++] = valid_data[i_index];
       }
     }
-    /* buffer full */
+    /* buffer full, queue it for iap_loop */
     if(iap_info.fifo_length == HID_IAP_BUFFER_LEN)
     {
-      flash_unlock();
-      pbuf = (uint32_t *)iap_info.iap_fifo;
-      for(i_index = 0; i_index < iap_info.fifo_length / sizeof(uint32_t); i_index ++)
-      {
-        flash_word_program(iap_info.iap_address, *pbuf ++);
-        iap_info.iap_address += 4;
-      }
-      flash_lock();
+      pblock->address = iap_info.iap_address;
+      iap_info.block_head ++;
 
       iap_info.fifo_length = 0;
       iap_info.iap_address = 0;
-      iap_respond(iap_info.iap_tx, IAP_CMD_DATA, IAP_ACK);
+
+      /* acknowledge at once while there is room for the next block,
+         otherwise iap_loop acknowledges when a block is programmed */
+      if(iap_info.block_head - iap_info.block_tail < HID_IAP_QUEUE_NUM)
+      {
+        iap_respond(iap_info.iap_tx, IAP_CMD_DATA, IAP_ACK);
+      }
+      else
+      {
+        iap_info.respond_pending = IAP_CMD_DATA;
+      }
     }
   }
   else
@@ -314,6 +386,134 @@ iap_result_type iap_data_write(uint8_t *pdata, uint32_t len)
   return IAP_SUCCESS;
 }
 
+/**
+  * @brief  decoder page writer, erases and programs one 2kb page
+  * @param  offset: offset in the app
+  * @param  pbuffer: IMAGE_PAGE_SIZE bytes
+  * @retval 0 when the page reads back correctly
+  */
+static int iap_page_write(uint32_t offset, uint8_t *pbuffer)
+{
+  uint32_t address = iap_info.app_address + offset;
+  flash_status_type status = FLASH_OPERATE_DONE;
+  uint32_t i_index, value;
+
+  flash_unlock();
+  for(i_index = 0; i_index < IMAGE_PAGE_SIZE && status == FLASH_OPERATE_DONE; i_index += iap_info.sector_size)
+  {
+    status = flash_sector_erase(address + i_index);
+  }
+  for(i_index = 0; i_index < IMAGE_PAGE_SIZE && status == FLASH_OPERATE_DONE; i_index += sizeof(uint32_t))
+  {
+    memcpy(&value, pbuffer + i_index, sizeof(uint32_t));
+    if(value != 0xFFFFFFFF)
+    {
+      status = flash_word_program(address + i_index, value);
+    }
+  }
+  flash_lock();
+
+  if(status != FLASH_OPERATE_DONE || memcmp((const void *)address, pbuffer, IMAGE_PAGE_SIZE) != 0)
+  {
+    return 1;
+  }
+  return 0;
+}
+
+/**
+  * @brief  pass one received block to the image decoder when needed
+  * @note   a block at the app address carrying the lz4 or delta magic starts
+  *         the decoder, the following blocks must then arrive in order. delta
+  *         patches are applied in place on the current app.
+  * @param  pblock: received block
+  * @retval 1 when the block was consumed by the decoder
+  */
+static uint8_t iap_block_decode(iap_block_type *pblock)
+{
+  uint32_t app_size = iap_info.flash_end_address - iap_info.app_address;
+  uint32_t magic = pblock->data[0];
+
+  if(pblock->address == iap_info.app_address)
+  {
+    image_decoding = (magic == IMAGE_LZ4_MAGIC || magic == IMAGE_DELTA_MAGIC);
+    if(image_decoding)
+    {
+      image_decode_init(&image_decoder, iap_page_write,
+                        (const uint8_t *)iap_info.app_address, app_size,
+                        (const uint8_t *)iap_info.app_address, app_size);
+      image_next_address = iap_info.app_address;
+      /* the decoder erases its own pages */
+      iap_info.erase_start_address = 0;
+      iap_info.erase_end_address = 0;
+    }
+  }
+
+  if(image_decoding == 0)
+  {
+    return 0;
+  }
+
+  if(pblock->address != image_next_address ||
+     image_decode_feed(&image_decoder, (uint8_t *)pblock->data, HID_IAP_BUFFER_LEN) != IMAGE_OK)
+  {
+    iap_info.program_error = 1;
+  }
+  image_next_address = pblock->address + HID_IAP_BUFFER_LEN;
+
+  iap_block_crc(pblock);
+  iap_info.program_end_address = image_next_address;
+  return 1;
+}
+
+/**
+  * @brief  erase and program one received block
+  * @param  pblock: received block
+  * @retval none
+  */
+static void iap_block_program(iap_block_type *pblock)
+{
+  uint32_t address = pblock->address;
+  uint32_t *pflash = (uint32_t *)pblock->address;
+  uint32_t i_index;
+
+  if(iap_block_decode(pblock))
+  {
+    return;
+  }
+
+  if(iap_erase_sector(address, HID_IAP_BUFFER_LEN) != FLASH_OPERATE_DONE)
+  {
+    iap_info.program_error = 1;
+    return;
+  }
+
+  flash_unlock();
+  for(i_index = 0; i_index < HID_IAP_BUFFER_LEN / sizeof(uint32_t); i_index ++)
+  {
+    /* erased words need no programming */
+    if(pblock->data[i_index] != 0xFFFFFFFF &&
+       flash_word_program(address, pblock->data[i_index]) != FLASH_OPERATE_DONE)
+    {
+      iap_info.program_error = 1;
+    }
+    address += sizeof(uint32_t);
+  }
+  flash_lock();
+
+  /* read back only the block just written */
+  for(i_index = 0; i_index < HID_IAP_BUFFER_LEN / sizeof(uint32_t); i_index ++)
+  {
+    if(pflash[i_index] != pblock->data[i_index])
+    {
+      iap_info.program_error = 1;
+      break;
+    }
+  }
+
+  iap_block_crc(pblock);
+  iap_info.program_end_address = address;
+}
+
 /*
   * @brief  iap finish
   * @param  none
@@ -322,8 +522,9 @@ iap_result_type iap_data_write(uint8_t *pdata, uint32_t len)
 void iap_finish()
 {
   iap_info.state = IAP_STS_FINISH;
-  iap_set_upgrade_flag();
-  iap_respond(iap_info.iap_tx, IAP_CMD_FINISH, IAP_ACK);
+
+  /* answered by iap_loop after the queued blocks are programmed */
+  iap_info.respond_pending = IAP_CMD_FINISH;
 }
 
 /*
@@ -335,24 +536,96 @@ void iap_finish()
 void iap_crc(uint8_t *pdata, uint32_t len)
 {
   uint8_t *paddr = pdata + 2;   /* skip iap cmd */
-  uint16_t crc_nk;
-  uint32_t crc_value;
-  uint32_t address = (paddr[0] << 24) |
-                     (paddr[1] << 16) |
-                     (paddr[2] << 8) |
-                      paddr[3];
+  iap_info.crc_address = (paddr[0] << 24) |
+                         (paddr[1] << 16) |
+                         (paddr[2] << 8) |
+                          paddr[3];
   paddr = pdata + 6;
 
-  crc_nk = (paddr[0] << 16) | paddr[1];
+  iap_info.crc_nk = (paddr[0] << 16) | paddr[1];
+
+  /* answered by iap_loop after the queued blocks are programmed */
+  iap_info.respond_pending = IAP_CMD_CRC;
+}
+
+/**
+  * @brief  answer the command that had to wait for flash programming
+  * @param  none
+  * @retval none
+  */
+static void iap_pending_respond(void)
+{
+  uint32_t crc_value, primask;
+  uint8_t queue_empty = (iap_info.block_head == iap_info.block_tail);
+
+  switch(iap_info.respond_pending)
+  {
+    case IAP_CMD_DATA:
+      if(iap_info.block_head - iap_info.block_tail >= HID_IAP_QUEUE_NUM)
+      {
+        return;
+      }
+      iap_respond(iap_info.iap_tx, IAP_CMD_DATA, IAP_ACK);
+      break;
+    case IAP_CMD_FINISH:
+      if(!queue_empty)
+      {
+        return;
+      }
+      if(image_decoding)
+      {
+        /* flush the last page, a truncated image is refused */
+        image_decoding = 0;
+        if(image_decode_finish(&image_decoder, 0) != IMAGE_OK)
+        {
+          iap_info.program_error = 1;
+        }
+      }
+      if(iap_info.program_error)
+      {
+        iap_respond(iap_info.iap_tx, IAP_CMD_FINISH, IAP_NACK);
+      }
+      else
+      {
+        iap_set_upgrade_flag();
+        iap_respond(iap_info.iap_tx, IAP_CMD_FINISH, IAP_ACK);
+      }
+      break;
+    case IAP_CMD_CRC:
+      if(!queue_empty)
+      {
+        return;
+      }
+      /* the running crc covers the request when it matches the programmed image,
+         otherwise fall back to reading the flash */
+      if(iap_info.crc_address == iap_info.image_start_address &&
+         iap_info.program_end_address - iap_info.image_start_address == iap_info.crc_nk * 1024 &&
+         iap_info.program_error == 0)
+      {
+        crc_value = iap_info.image_crc;
+      }
+      else
+      {
+        crc_value = crc_cal(iap_info.crc_address, iap_info.crc_nk);
+      }
 
-  crc_value = crc_cal(address, crc_nk);
+      iap_respond(iap_info.iap_tx, IAP_CMD_CRC, IAP_ACK);
+      iap_info.iap_tx[4] = (uint8_t)((crc_value >> 24) & 0xFF);
+      iap_info.iap_tx[5] = (uint8_t)((crc_value >> 16) & 0xFF);
+      iap_info.iap_tx[6] = (uint8_t)((crc_value >> 8) & 0xFF);
+      iap_info.iap_tx[7] = (uint8_t)((crc_value) & 0xFF);
+      break;
+    default:
+      return;
+  }
 
-  iap_respond(iap_info.iap_tx, IAP_CMD_CRC, IAP_ACK);
-  iap_info.iap_tx[4] = (uint8_t)((crc_value >> 24) & 0xFF);
-  iap_info.iap_tx[5] = (uint8_t)((crc_value >> 16) & 0xFF);
-  iap_info.iap_tx[6] = (uint8_t)((crc_value >> 8) & 0xFF);
-  iap_info.iap_tx[7] = (uint8_t)((crc_value) & 0xFF);
+  iap_info.respond_pending = 0;
 
+  /* keep the usb interrupt out while the report is loaded */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  usb_iap_class_send_report(iap_udev, iap_info.iap_tx, 64);
+  __set_PRIMASK(primask);
 }
 
 /*
@@ -417,6 +690,7 @@ iap_result_type usbd_hid_iap_process(void *udev, uint8_t *pdata, uint16_t len)
   }
 
   iap_info.respond_flag = 0;
+  iap_udev = udev;
 
   iap_cmd = (pdata[0] << 8) | pdata[1];
 
@@ -479,6 +753,28 @@ void usbd_hid_iap_in_complete(void *udev)
   */
 void iap_loop(void)
 {
+  if(iap_info.flag_clear_pending)
+  {
+    iap_info.flag_clear_pending = 0;
+    iap_clear_upgrade_flag();
+  }
+
+  if(iap_info.block_head != iap_info.block_tail)
+  {
+    /* program the oldest block while the usb keeps receiving */
+    iap_block_program(&iap_info.block[iap_info.block_tail % HID_IAP_QUEUE_NUM]);
+    iap_info.block_tail ++;
+  }
+  else
+  {
+    iap_erase_ahead();
+  }
+
+  if(iap_info.respond_pending)
+  {
+    iap_pending_respond();
+  }
+
   if(iap_info.state == IAP_STS_JMP)
   {
     delay_ms(100);
@@ -34,7 +34,13 @@
 
 #define USERID                           "user"
 #define PASSWORD                         "at32"
-#define LOGIN_SIZE                       (15+ sizeof(USERID) + sizeof(PASSWORD))
+#define LOGIN_SIZE                       (19 + sizeof(USERID) + sizeof(PASSWORD))
+
+/* upload parser: longest boundary allowed by rfc2046, kept start of a header
+   line, and bytes parsed and programmed per iap_http_handle call */
+#define UPLOAD_BOUNDARY_MAX              70
+#define UPLOAD_LINE_MAX                  128
+#define HTTP_UPLOAD_BYTES_PER_POLL       512
 
 struct fs_file {
   char *data;
@@ -42,6 +48,7 @@ struct fs_file {
 };
 
 void iap_httpd_init(void);
+void iap_http_handle(void);
 
 #ifdef __cplusplus
 }
@@ -71,6 +71,9 @@ typedef void (*iapfun)(void);
 void app_load(uint32_t appxaddr);
 void iap_command_handle(void);
 void iap_init(void);
+void iap_image_start(void);
+uint8_t iap_image_write(const uint8_t *pdata, uint32_t len);
+uint8_t iap_image_finish(void);
 
 /**
   * @}
@@ -70,7 +70,7 @@
 #define TCP_SND_QUEUELEN                 (6 * TCP_SND_BUF)/TCP_MSS
 #define MEMP_NUM_TCP_SEG                 TCP_SND_QUEUELEN
 #define TCP_SND_BUF                      (2 * TCP_MSS)
-#define TCP_WND                          (2 * TCP_MSS)
+#define TCP_WND                          (4 * TCP_MSS)  /* http upload segments wait in the window until programmed */
 #define LWIP_WND_SCALE                   0
 #define TCP_RCV_SCALE                    0
 #define PBUF_POOL_SIZE                   10 /* pbuf tests need ~200KByte */
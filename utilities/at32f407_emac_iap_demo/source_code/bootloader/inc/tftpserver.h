@@ -10,6 +10,7 @@
 
 #define TFTP_OPCODE_LEN                  2
 #define TFTP_BLKNUM_LEN                  2
+#define TFTP_ERRCODE_LEN                 2
 #define TFTP_DATA_LEN_MAX                512
 #define TFTP_DATA_PKT_HDR_LEN            (TFTP_OPCODE_LEN + TFTP_BLKNUM_LEN)
 #define TFTP_ERR_PKT_HDR_LEN             (TFTP_OPCODE_LEN + TFTP_ERRCODE_LEN)
@@ -18,6 +19,20 @@
 #define TFTP_MAX_RETRIES                 3
 #define TFTP_TIMEOUT_INTERVAL            5
 
+/* option negotiation (rfc2347), blksize (rfc2348) and windowsize (rfc7440).
+   1428 bytes is the largest block that still fits one ethernet frame. frames
+   are not taken from the emac while a page is written, so a window must fit
+   the EMAC_RXBUFNB (6) receive descriptors of ethernetif.c */
+#define TFTP_BLKSIZE_MIN                 8
+#define TFTP_BLKSIZE_MAX                 1428
+#define TFTP_WINDOWSIZE_MAX              4
+#define TFTP_OACK_PKT_LEN_MAX            64
+
+/* received data is queued here and programmed from the main loop, so the next
+   window is received while the previous one is written. must hold one window */
+#define TFTP_QUEUE_SIZE                  0x6000
+#define TFTP_FLASH_BYTES_PER_POLL        256
+
 typedef struct
 {
   int op;    /*wrq */
@@ -34,6 +49,17 @@ typedef struct
   /* timer interrupt count when last packet was sent */
   /* this should be used to resend packets on timeout */
   unsigned long long last_time;
+  /* negotiated block size and window size */
+  int blksize;
+  int windowsize;
+  /* blocks received since the last ack */
+  int window_count;
+  /* ack waiting for queue space or, after the last block, for the flash */
+  int ack_pending;
+  /* a gap was already answered, further out-of-order blocks are dropped */
+  int gap_acked;
+  /* last block received */
+  int last_block;
 
 }tftp_connection_args;
 
@@ -43,7 +69,8 @@ typedef enum {
   TFTP_WRQ   = 2,
   TFTP_DATA  = 3,
   TFTP_ACK   = 4,
-  TFTP_ERROR = 5
+  TFTP_ERROR = 5,
+  TFTP_OACK  = 6
 } tftp_opcode;
 
 /* tftp error codes as specified in rfc1350  */
@@ -59,6 +86,7 @@ typedef enum {
 } tftp_errorcode;
 
 void iap_tftpd_init(void);
+void iap_tftp_handle(void);
 
 #ifdef __cplusplus
 }
@@ -32,14 +32,7 @@
 
 #ifdef USE_IAP_HTTP
 
-static vu32 dataflag = 0;
-static vu32 size = 0;
-static __IO uint32_t flashwriteaddress;
-static u32 totalreceived = 0;
-static char leftbytestab[4];
-static u8 leftbytes = 0;
 static __IO u8 resetpage = 0;
-static uint32_t contentlengthoffset = 0, browserflag = 0;
 static __IO uint32_t checklogin = 0;
 flag_status http_iap_flag = RESET;
 
@@ -59,23 +52,44 @@ typedef enum
 
 htmlpageState htmlpage;
 
-static const char http_crnl_2[4] =
-/* "\r\n--" */
-{0xd, 0xa,0x2d,0x2d};
-static const char octet_stream[14] =
-/* "octet-stream" */
-{0x6f, 0x63, 0x74, 0x65, 0x74, 0x2d, 0x73, 0x74, 0x72, 0x65, 0x61, 0x6d,0x0d, };
-static const char content_length[17] =
-/* Content Length */
-{0x43, 0x6f, 0x6e, 0x74, 0x65, 0x6e, 0x74, 0x2d, 0x4c, 0x65, 0x6e, 0x67,0x74, 0x68, 0x3a, 0x20, };
-/* Upgrade-Insecure-Requests: 1/r/n */
-static const char upgrade_insecure_request[30] =
-/* Content Length */
-{0x55, 0x70, 0x67, 0x72, 0x61, 0x64, 0x65, 0x2d, 0x49, 0x6e, 0x73, 0x65, 0x63, 0x75, 0x72, 0x65, 0x2d, 0x52, 0x65, 0x71, 0x75, 0x65, 0x73, 0x74, 0x73, 0x3a, 0x20, 0x31, 0x0d, 0x0a,};
-
-
-static uint32_t parse_content_length(char *data, uint32_t len);
-static void iap_http_writedata(char* data, uint32_t len);
+/* multipart/form-data upload, parsed byte by byte so that headers and
+   boundaries may be split anywhere across tcp segments */
+typedef enum
+{
+  UPLOAD_HEADERS = 0,  /* request header lines */
+  UPLOAD_PREAMBLE,     /* body up to the first boundary */
+  UPLOAD_BOUNDARY_END, /* "\r\n" after a boundary, "--" after the last one */
+  UPLOAD_PART_HEADERS, /* part header lines */
+  UPLOAD_PART_DATA,    /* part content up to the next boundary */
+  UPLOAD_DONE,
+  UPLOAD_ERROR
+}upload_state_type;
+
+typedef struct
+{
+  upload_state_type state;
+  struct tcp_pcb *pcb;                   /* null when no upload is running */
+  struct http_state *hs;
+  struct pbuf *queue;                    /* segments not parsed yet, not acknowledged to tcp */
+  char delimiter[UPLOAD_BOUNDARY_MAX + 4]; /* "\r\n--" followed by the boundary */
+  uint8_t delimiter_len;
+  uint8_t match;                         /* delimiter bytes matched so far */
+  char line[UPLOAD_LINE_MAX];
+  uint16_t line_len;
+  uint8_t is_file;                       /* current part is the file */
+  uint8_t file_found;
+}upload_type;
+
+static upload_type upload;
+
+static int upload_header_match(const char *line, const char *name);
+static void upload_start(struct tcp_pcb *pcb, struct http_state *hs);
+static void upload_reset(void);
+static void upload_header_line(void);
+static void upload_body(char *data, uint32_t len, uint32_t *pos);
+static void upload_parse(char *data, uint32_t len);
+static void upload_flash_write(const char *ptr, uint32_t len);
+static void upload_finish(void);
 
 /* file must be allocated by caller and will be filled in
    by the function. */
@@ -92,6 +106,11 @@ static void conn_err(void *arg, err_t err)
   struct http_state *hs;
 
   hs = arg;
+  if ((upload.pcb != NULL) && (upload.hs == hs))
+  {
+    /* the pcb is already freed by lwip */
+    upload_reset();
+  }
   mem_free(hs);
 }
 
@@ -103,6 +122,10 @@ static void conn_err(void *arg, err_t err)
   */
 static void close_conn(struct tcp_pcb *pcb, struct http_state *hs)
 {
+  if (upload.pcb == pcb)
+  {
+    upload_reset();
+  }
   tcp_arg(pcb, NULL);
   tcp_sent(pcb, NULL);
   tcp_recv(pcb, NULL);
@@ -200,25 +223,56 @@ static err_t http_sent(void *arg, struct tcp_pcb *pcb, u16_t len)
 static err_t http_recv(void *arg, struct tcp_pcb *pcb,  struct pbuf *p, err_t err)
 {
   int32_t i, len=0;
-  uint32_t dataoffset, filenameoffset, contentoffsetfirefox;
-  char *data, *ptr, login[LOGIN_SIZE];
-  volatile char filename[19];
+  char *data, login[LOGIN_SIZE];
   struct fs_file file = {0, 0};
   struct http_state *hs;
-  struct pbuf *ptmp = p;
 
   hs = arg;
 
+  if (err == ERR_OK && p != NULL && upload.pcb == pcb)
+  {
+    if (upload.state >= UPLOAD_DONE)
+    {
+      /* rest of a finished or rejected upload */
+      tcp_recved(pcb, p->tot_len);
+      pbuf_free(p);
+    }
+    else
+    {
+      /* parsed and acknowledged by iap_http_handle while flash is written,
+         so the receive window follows the programming speed */
+      if (upload.queue == NULL)
+      {
+        upload.queue = p;
+      }
+      else
+      {
+        pbuf_cat(upload.queue, p);
+      }
+    }
+    return ERR_OK;
+  }
+
   if (err == ERR_OK && p != NULL)
   {
-    /* inform tcp that we have taken the data */
-    tcp_recved(pcb, p->tot_len);
 
     if (hs->file == NULL)
     {
       data = p->payload;
       len = p->tot_len;
 
+      /* process post request for file upload, the segment is kept */
+      if ((p->len >= 16) && (strncmp(data, "POST /upload.cgi",16)==0)&&(htmlpage == FILEUPLOADPAGE))
+      {
+        upload_start(pcb, hs);
+        upload.queue = p;
+        iap_http_handle();
+        return ERR_OK;
+      }
+
+      /* inform tcp that we have taken the data */
+      tcp_recved(pcb, p->tot_len);
+
       /* process http get requests */
       if (strncmp(data, "GET /", 5) == 0)
       {
@@ -281,7 +335,7 @@ static err_t http_recv(void *arg, struct tcp_pcb *pcb,  struct pbuf *p, err_t er
             if (strncmp ((char*)(data+i), "username=", 9)==0)
             {
               sprintf(login,"username=%s&password=%s",USERID,PASSWORD);
-              if (strncmp((char*)(data+i), login ,LOGIN_SIZE)==0)
+              if (strncmp((char*)(data+i), login ,strlen(login))==0)
               {
                 htmlpage = FILEUPLOADPAGE;
                 fs_open("/upload.html", &file);
@@ -309,188 +363,6 @@ static err_t http_recv(void *arg, struct tcp_pcb *pcb,  struct pbuf *p, err_t er
           }
       }
 
-      /* process post request for file upload and incoming data packets after post request*/
-      else if (((strncmp(data, "POST /upload.cgi",16)==0)||(dataflag >=1))&&(htmlpage == FILEUPLOADPAGE))
-      {
-        dataoffset =0;
-        contentoffsetfirefox = 0;
-        http_iap_flag = SET;
-
-        /* post packet received */
-        if (dataflag ==0)
-        {
-          browserflag=0;
-          totalreceived =0;
-
-          /* parse packet for Content-length field */
-          size = parse_content_length(data, p->tot_len);
-
-          /* parse packet for the octet-stream field */
-          for (i=0;i<len;i++)
-          {
-            if (strncmp ((char*)(data+i), octet_stream, 13)==0)
-            {
-              dataoffset = i+16;
-              break;
-            }
-          }
-          /* case of msie8 : we do not receive data in the post packet*/
-          if (dataoffset==0)
-          {
-            dataflag++;
-            browserflag = 1;
-            pbuf_free(p);
-            return ERR_OK;
-          }
-          /* case of mozilla firefox v79.0 : we receive data in the post packet*/
-          else
-          {
-            /* parse packet for the upgrade-insecure-request field */
-            for(i = 0; i < len; i++)
-            {
-              if (strncmp ((char*)(data+i), upgrade_insecure_request, 30)==0)
-              {
-                contentoffsetfirefox = i + 32;
-                break;
-              }
-            }
-            totalreceived = len - contentoffsetfirefox;
-          }
-        }
-
-        if (((dataflag ==1)&&(browserflag==1)) || ((dataflag ==0)&&(browserflag==0)))
-        {
-          if ((dataflag ==0)&&(browserflag==0))
-          {
-            dataflag++;
-          }
-          else if ((dataflag ==1)&&(browserflag==1))
-          {
-             /* parse packet for the octet-stream field */
-            for (i=0;i<len;i++)
-            {
-              if (strncmp ((char*)(data+i), octet_stream, 13)==0)
-              {
-                dataoffset = i+16;
-                break;
-              }
-            }
-            totalreceived+=len;
-            dataflag++;
-          }
-
-          /* parse packet for the filename field */
-          filenameoffset = 0;
-          for (i=0;i<len;i++)
-          {
-            if (strncmp ((char*)(data+i), "filename=", 9)==0)
-            {
-              filenameoffset = i+10;
-              break;
-            }
-          }
-          i =0;
-          if (filenameoffset)
-          {
-            while((*(data+filenameoffset + i) != 0x22 )&&(i<40))
-            {
-              filename[i] = *(data+filenameoffset + i);
-              i++;
-            }
-            filename[i] = 0x0;
-          }
-
-          if (i==0)
-          {
-            htmlpage = FILEUPLOADPAGE;
-            /* no filename, in this case reload upload page */
-            fs_open("/upload.html", &file);
-            hs->file = file.data;
-            hs->left = file.len;
-            pbuf_free(p);
-
-            /* send index.html page */
-            send_data(pcb, hs);
-
-            /* tell tcp that we wish be to informed of data that has been
-               successfully sent by a call to the http_sent() function. */
-            tcp_sent(pcb, http_sent);
-            dataflag=0;
-            return ERR_OK;
-
-          }
-          
-          flashwriteaddress = APP_START_SECTOR_ADDR;
-        }
-         /* dataflag >1 => the packet is data only  */
-        else
-        {
-          totalreceived +=len;
-        }
-
-        ptr = (char*)(data + dataoffset);
-        len-= dataoffset;
-
-        /* update total data received counter */
-        
-        /* check if last data packet */
-        if (totalreceived == size)
-        {
-          /* if last packet need to remove the http boundary tag */
-          /* parse packet for "\r\n--" starting from end of data */
-          i = 4;
-          while (strncmp ((char*)(data+ p->tot_len -i),http_crnl_2 , 4) && (p->tot_len -i > 0))
-          {
-            i++;
-          }
-          len -= i;          
-
-          /* write data in flash */
-          len = ptmp->len;
-          len-= dataoffset;
-          while(ptmp != NULL)
-          {
-            if(len)
-            {
-              iap_http_writedata(ptr,len);
-            }
-            ptmp = ptmp->next;
-            len = ptmp->len;
-            ptr = ptmp->payload;
-          }
-
-          dataflag=0;
-          htmlpage = UPLOADDONEPAGE;
-          /* send uploaddone.html page */
-          fs_open("/uploaddone.html", &file);
-          hs->file = file.data;
-          hs->left = file.len;
-          send_data(pcb, hs);
-
-          /* tell tcp that we wish be to informed of data that has been
-             successfully sent by a call to the http_sent() function. */
-          tcp_sent(pcb, http_sent);
-          http_iap_flag = RESET;
-        }
-        /* not last data packet */
-        else
-        {
-          /* write data in flash */
-          len = ptmp->len;
-          len-= dataoffset;
-          while(ptmp != NULL)
-          {
-            if(len)
-            {
-              iap_http_writedata(ptr,len);
-            }
-            ptmp = ptmp->next;
-            len = ptmp->len;
-            ptr = ptmp->payload;
-          }
-        }
-        pbuf_free(p);
-      }
       else
       {
         /* bad http requests */
@@ -500,6 +372,7 @@ static err_t http_recv(void *arg, struct tcp_pcb *pcb,  struct pbuf *p, err_t er
     }
     else
     {
+      tcp_recved(pcb, p->tot_len);
       pbuf_free(p);
       close_conn(pcb,hs);
     }
@@ -590,102 +463,354 @@ static int fs_open(char *name, struct fs_file *file)
 }
 
 /**
-  * @brief  extract the content_length data from html data
-  * @param  data : pointer on receive packet buffer
-  * @param  len  : buffer length
-  * @retval size : content_length in numeric format
+  * @brief  compares the start of a header line, header names are case insensitive
+  * @param  line: header line
+  * @param  name: lower case name
+  * @retval 1 when the line starts with name
   */
-static uint32_t parse_content_length(char *data, uint32_t len)
+static int upload_header_match(const char *line, const char *name)
 {
-  uint32_t i=0,size=0, S=1;
-  int32_t j=0;
-  char sizestring[6], *ptr;
+  while (*name)
+  {
+    char c = *line++;
+    if (c >= 'A' && c <= 'Z')
+    {
+      c += 'a' - 'A';
+    }
+    if (c != *name++)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
 
-  contentlengthoffset =0;
+/**
+  * @brief  starts parsing an upload request
+  * @param  pcb: pointer to a tcp_pcb struct
+  * @param  hs: pointer to a http_state struct
+  * @retval none
+  */
+static void upload_start(struct tcp_pcb *pcb, struct http_state *hs)
+{
+  memset(&upload, 0, sizeof(upload));
+  upload.state = UPLOAD_HEADERS;
+  upload.pcb = pcb;
+  upload.hs = hs;
+  http_iap_flag = SET;
+}
+
+/**
+  * @brief  drops the upload and the segments still queued
+  * @param  none
+  * @retval none
+  */
+static void upload_reset(void)
+{
+  if (upload.queue != NULL)
+  {
+    pbuf_free(upload.queue);
+    upload.queue = NULL;
+  }
+  upload.pcb = NULL;
+  upload.hs = NULL;
+  http_iap_flag = RESET;
+}
+
+/**
+  * @brief  handles a complete header line of the request or of a part
+  * @param  none
+  * @retval none
+  */
+static void upload_header_line(void)
+{
+  char *value;
+  uint32_t i;
+
+  upload.line[upload.line_len] = 0;
 
-  /* find content-length data in packet buffer */
-  for (i = 0; i < len; i++)
+  if (upload.line_len == 0)
   {
-    if (strncmp ((char*)(data+i), content_length, 16)==0)
+    /* empty line, end of the headers */
+    if (upload.state == UPLOAD_HEADERS)
+    {
+      if (upload.delimiter_len == 0)
+      {
+        upload.state = UPLOAD_ERROR;
+        return;
+      }
+      /* the body starts with the boundary itself, act as if the "\r\n" of
+         the delimiter was already seen */
+      upload.state = UPLOAD_PREAMBLE;
+      upload.match = 2;
+    }
+    else
     {
-      contentlengthoffset = i+16;
-      break;
+      upload.state = UPLOAD_PART_DATA;
     }
+    return;
   }
-  /* read content-length value */
-  if (contentlengthoffset)
+
+  if ((upload.state == UPLOAD_HEADERS) && upload_header_match(upload.line, "content-type:"))
   {
-    i = 0;
-    ptr = (char*)(data + contentlengthoffset);
-    while(*(ptr+i)!=0x0d)
+    for (i = 0; i < upload.line_len; i++)
     {
-      sizestring[i] = *(ptr+i);
-      i++;
-      contentlengthoffset++;
+      if (upload_header_match(upload.line + i, "boundary="))
+      {
+        value = upload.line + i + 9;
+        if (*value == '"')
+        {
+          value++;
+        }
+        memcpy(upload.delimiter, "\r\n--", 4);
+        upload.delimiter_len = 4;
+        while ((*value != 0) && (*value != '"') && (*value != ';') &&
+               (upload.delimiter_len < sizeof(upload.delimiter)))
+        {
+          upload.delimiter[upload.delimiter_len++] = *value++;
+        }
+        break;
+      }
     }
-    if (i>0)
+  }
+  else if ((upload.state == UPLOAD_PART_HEADERS) && upload_header_match(upload.line, "content-disposition:"))
+  {
+    for (i = 0; i < upload.line_len; i++)
     {
-      /* transform string data into numeric format */
-      for(j=i-1;j>=0;j--)
+      if (upload_header_match(upload.line + i, "filename=\""))
       {
-        size += (sizestring[j]-0x30)*S;
-        S=S*10;
+        /* only the first part with a file name is programmed */
+        if ((upload.line[i + 10] != '"') && (upload.file_found == 0))
+        {
+          upload.is_file = 1;
+          upload.file_found = 1;
+          iap_image_start();
+        }
+        break;
       }
     }
   }
-  return size;
 }
 
 /**
-  * @brief  writes received data in flash
-  * @param  ptr: data pointer
-  * @param  len: data length
+  * @brief  parses body bytes up to the next delimiter
+  * @note   content is passed on in runs straight from the segment, only the
+  *         bytes of a partial delimiter match are held back. the boundary
+  *         cannot contain '\r', so after a mismatch a new match can only
+  *         start at the current byte.
+  * @param  data: segment data
+  * @param  len: segment length
+  * @param  pos: position in data, updated
   * @retval none
   */
-static void iap_http_writedata(char * ptr, uint32_t len)
+static void upload_body(char *data, uint32_t len, uint32_t *pos)
 {
-  uint32_t count, i = 0, j = 0;
+  uint32_t i = *pos, run = *pos;
 
-  /* check if any left bytes from previous packet transfer*/
-  /* if it is the case do a concat with new data to create a 32-bit word */
-  if (leftbytes)
+  while (i < len)
   {
-    while(leftbytes <= 3)
+    if (data[i] == upload.delimiter[upload.match])
     {
-      if(len > (j + 1))
+      if (upload.match == 0)
       {
-        leftbytestab[leftbytes++] = *(ptr+j);
+        upload_flash_write(data + run, i - run);
       }
-      else
+      upload.match++;
+      i++;
+      run = i;
+      if (upload.match == upload.delimiter_len)
       {
-        leftbytestab[leftbytes++] = 0xFF;
+        upload.match = 0;
+        upload.line_len = 0;
+        upload.state = UPLOAD_BOUNDARY_END;
+        *pos = i;
+        return;
       }
-      j++;
     }
-    flash_if_write(&flashwriteaddress, (u32*)(leftbytestab), 1);
-    leftbytes = 0;
+    else if (upload.match)
+    {
+      /* the held back bytes were content */
+      upload_flash_write(upload.delimiter, upload.match);
+      upload.match = 0;
+      run = i;
+    }
+    else
+    {
+      i++;
+    }
+  }
 
-    /* update data pointer */
-    ptr = (char*)(ptr + j);
-    len = len - j;
+  if (upload.match == 0)
+  {
+    upload_flash_write(data + run, len - run);
   }
+  *pos = len;
+}
 
-  /* write received bytes into flash */
-  count = len / 4;
+/**
+  * @brief  runs the upload state machine over a piece of a segment
+  * @param  data: segment data
+  * @param  len: data length
+  * @retval none
+  */
+static void upload_parse(char *data, uint32_t len)
+{
+  uint32_t pos = 0;
+  char c;
 
-  /* check if remaining bytes < 4 */
-  i= len % 4;
-  if (i > 0)
+  while ((pos < len) && (upload.state < UPLOAD_DONE))
   {
-    if (totalreceived != size)
+    switch (upload.state)
     {
-      /* store bytes in leftbytestab */
-      leftbytes = 0;
-      for(; i > 0; i--)
-      leftbytestab[leftbytes++] = *(char*)(ptr+ len-i);
+      case UPLOAD_PREAMBLE:
+      case UPLOAD_PART_DATA:
+        upload_body(data, len, &pos);
+        break;
+
+      case UPLOAD_BOUNDARY_END:
+        upload.line[upload.line_len++] = data[pos++];
+        if (upload.line_len == 2)
+        {
+          upload.is_file = 0;
+          upload.line_len = 0;
+          if ((upload.line[0] == '-') && (upload.line[1] == '-'))
+          {
+            upload.state = UPLOAD_DONE;
+          }
+          else if ((upload.line[0] == '\r') && (upload.line[1] == '\n'))
+          {
+            upload.state = UPLOAD_PART_HEADERS;
+          }
+          else
+          {
+            upload.state = UPLOAD_ERROR;
+          }
+        }
+        break;
+
+      default:
+        /* header lines, longer lines are cut, only their start is needed */
+        c = data[pos++];
+        if (c == '\n')
+        {
+          upload_header_line();
+          upload.line_len = 0;
+        }
+        else if ((c != '\r') && (upload.line_len < UPLOAD_LINE_MAX - 1))
+        {
+          upload.line[upload.line_len++] = c;
+        }
+        break;
+    }
+  }
+}
+
+/**
+  * @brief  passes file content to the image decoder, which programs it
+  * @param  ptr: data pointer, any alignment
+  * @param  len: data length
+  * @retval none
+  */
+static void upload_flash_write(const char *ptr, uint32_t len)
+{
+  if ((upload.is_file == 0) || (upload.state == UPLOAD_ERROR) || (len == 0))
+  {
+    return;
+  }
+
+  if (iap_image_write((const uint8_t *)ptr, len) != 0)
+  {
+    upload.state = UPLOAD_ERROR;
+  }
+}
+
+/**
+  * @brief  sends the result page once the upload is parsed or rejected
+  * @param  none
+  * @retval none
+  */
+static void upload_finish(void)
+{
+  struct fs_file file = {0, 0};
+  struct http_state *hs = upload.hs;
+
+  if ((upload.state == UPLOAD_DONE) && upload.file_found && (iap_image_finish() != 0))
+  {
+    /* truncated or corrupted image */
+    upload.state = UPLOAD_ERROR;
+  }
+
+  if ((upload.state == UPLOAD_DONE) && upload.file_found)
+  {
+    htmlpage = UPLOADDONEPAGE;
+    /* send uploaddone.html page */
+    fs_open("/uploaddone.html", &file);
+  }
+  else
+  {
+    /* no file name or bad upload, in this case reload upload page */
+    upload.state = UPLOAD_ERROR;
+    htmlpage = FILEUPLOADPAGE;
+    fs_open("/upload.html", &file);
+  }
+  hs->file = file.data;
+  hs->left = file.len;
+  send_data(upload.pcb, hs);
+
+  /* tell tcp that we wish be to informed of data that has been
+     successfully sent by a call to the http_sent() function. */
+  tcp_sent(upload.pcb, http_sent);
+  http_iap_flag = RESET;
+}
+
+/**
+  * @brief  parses queued upload segments and programs the file, called from
+  *         the main loop
+  * @note   at most HTTP_UPLOAD_BYTES_PER_POLL bytes are handled per call.
+  *         tcp is told about the consumed bytes only then, so the peer keeps
+  *         the window full while the flash is written.
+  * @param  none
+  * @retval none
+  */
+void iap_http_handle(void)
+{
+  struct tcp_pcb *pcb = upload.pcb;
+  uint32_t budget = HTTP_UPLOAD_BYTES_PER_POLL, consumed = 0;
+  u16_t n;
+
+  if ((pcb == NULL) || (upload.state >= UPLOAD_DONE))
+  {
+    return;
+  }
+
+  while ((upload.queue != NULL) && budget && (upload.state < UPLOAD_DONE))
+  {
+    n = upload.queue->len;
+    if (n > budget)
+    {
+      n = budget;
+    }
+    upload_parse((char *)upload.queue->payload, n);
+    upload.queue = pbuf_free_header(upload.queue, n);
+    budget -= n;
+    consumed += n;
+  }
+
+  if (upload.state >= UPLOAD_DONE)
+  {
+    /* the epilogue is not needed */
+    if (upload.queue != NULL)
+    {
+      consumed += upload.queue->tot_len;
+      pbuf_free(upload.queue);
+      upload.queue = NULL;
     }
-    else count++;
+    upload_finish();
+  }
+
+  if (consumed)
+  {
+    tcp_recved(pcb, consumed);
   }
-  flash_if_write(&flashwriteaddress, (u32*)ptr ,count);
 }
 #endif
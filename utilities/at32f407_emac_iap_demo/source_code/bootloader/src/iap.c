@@ -27,6 +27,7 @@
 #include "iap.h"
 #include "flash.h"
 #include "tmr.h"
+#include "image_codec.h"
 
 /** @addtogroup UTILITIES_examples
   * @{
@@ -37,6 +38,7 @@
   */
 
 iapfun jump_to_app;
+static image_decoder_type image_decoder;
 
 /* app_load don't optimize */
 #if defined (__CC_ARM)
@@ -104,6 +106,62 @@ void iap_init(void)
   }
 }
 
+/**
+  * @brief  decoder page writer.
+  * @param  offset: offset in the app
+  * @param  pbuffer: 2kb page
+  * @retval 0 when the page reads back correctly
+  */
+static int iap_page_write(uint32_t offset, uint8_t *pbuffer)
+{
+  uint32_t write_addr = APP_START_SECTOR_ADDR + offset;
+
+  /* pages a delta patch leaves as they are are not erased again */
+  if(memcmp((const void *)write_addr, pbuffer, IMAGE_PAGE_SIZE) != 0)
+  {
+    flash_2kb_write(write_addr, pbuffer);
+  }
+  return memcmp((const void *)write_addr, pbuffer, IMAGE_PAGE_SIZE) != 0;
+}
+
+/**
+  * @brief  start receiving an update image.
+  * @note   the image goes through the decoder: lz4 and delta images are
+  *         expanded, raw images are passed through. pages are erased as they
+  *         are written, delta patches are applied in place on the current app.
+  * @param  none
+  * @retval none
+  */
+void iap_image_start(void)
+{
+  uint32_t app_size = APP_END_ADDR + 1 - APP_START_SECTOR_ADDR;
+
+  image_decode_init(&image_decoder, iap_page_write,
+                    (const uint8_t *)APP_START_SECTOR_ADDR, app_size,
+                    (const uint8_t *)APP_START_SECTOR_ADDR, app_size);
+}
+
+/**
+  * @brief  feed received update image data, any length.
+  * @param  pdata: image data
+  * @param  len: data length
+  * @retval 0 when accepted
+  */
+uint8_t iap_image_write(const uint8_t *pdata, uint32_t len)
+{
+  return (image_decode_feed(&image_decoder, pdata, len) == IMAGE_OK) ? 0 : 1;
+}
+
+/**
+  * @brief  flush the decoder at the end of the upgrade.
+  * @param  none
+  * @retval 0 when the image is complete
+  */
+uint8_t iap_image_finish(void)
+{
+  return (image_decode_finish(&image_decoder, 0) == IMAGE_OK) ? 0 : 1;
+}
+
 /**
   * @}
   */
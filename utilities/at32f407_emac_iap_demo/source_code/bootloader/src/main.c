@@ -52,7 +52,6 @@ volatile uint32_t local_time = 0;
 int main(void)
 {
   error_status status;
-  uint32_t useraddr;
   system_clock_config();
 
   at32_board_init();
@@ -84,13 +83,8 @@ int main(void)
 
   tcpip_stack_init();
 
-  /* init flash */
-  flash_unlock();
-
-  for(useraddr = APP_START_SECTOR_ADDR; useraddr <= APP_LAST_SECTOR_ADDR; useraddr += 2048)
-  {
-    flash_sector_erase(useraddr);
-   }
+  /* the app is not erased here, pages are erased as the update is written
+     and a delta update needs the current app as its base */
 #ifdef USE_IAP_HTTP
   /* initialize the http server */
   iap_httpd_init();
@@ -106,7 +100,17 @@ int main(void)
   while(1)
   {
     lwip_rx_loop_handler();
-    
+
+#ifdef USE_IAP_HTTP
+    /* parse and program the queued http upload */
+    iap_http_handle();
+#endif
+
+#ifdef USE_IAP_TFTP
+    /* program the received tftp data */
+    iap_tftp_handle();
+#endif
+
     lwip_periodic_handle(local_time);
   }
 }
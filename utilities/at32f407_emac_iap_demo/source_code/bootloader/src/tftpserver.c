@@ -27,22 +27,36 @@
 #include "flash.h"
 #include "string.h"
 #include "stdio.h"
+#include "stdlib.h"
 #include "iap.h"
 
 #ifdef USE_IAP_TFTP
 
+#if (TFTP_BLKSIZE_MAX * TFTP_WINDOWSIZE_MAX > TFTP_QUEUE_SIZE) || (TFTP_QUEUE_SIZE % 4)
+#error "TFTP_QUEUE_SIZE must hold one full window and be word aligned"
+#endif
+
 /* Private variables ---------------------------------------------------------*/
-static uint32_t flash_write_address;
 static struct udp_pcb *udppcb;
 static __IO uint32_t total_count=0;
 flag_status tftp_iap_flag = RESET;
 
+/* active write transfer */
+static struct udp_pcb *tftp_data_pcb = NULL;
+static tftp_connection_args *tftp_args = NULL;
+
+/* received data waiting to be programmed, counts are in bytes */
+static uint32_t tftp_queue[TFTP_QUEUE_SIZE / 4];
+static uint32_t queue_head;
+static uint32_t queue_tail;
+static uint32_t queue_count;
+
 /* Private function prototypes -----------------------------------------------*/
 
 static void iap_wrq_recv_callback(void *_args, struct udp_pcb *upcb, struct pbuf *pkt_buf,
                         ip_addr_t *addr, u16_t port);
 
-static int iap_tftp_process_write(struct udp_pcb *upcb, ip_addr_t *to, int to_port);
+static int iap_tftp_process_write(struct udp_pcb *upcb, ip_addr_t *to, int to_port, struct pbuf *pkt_buf);
 
 static void iap_tftp_recv_callback(void *arg, struct udp_pcb *Upcb, struct pbuf *pkt_buf,
                         ip_addr_t *addr, u16_t port);
@@ -52,7 +66,15 @@ static tftp_opcode iap_tftp_decode_op(char *buf);
 static u16_t iap_tftp_extract_block(char *buf);
 static void iap_tftp_set_opcode(char *buffer, tftp_opcode opcode);
 static void iap_tftp_set_block(char* packet, u16_t block);
+static err_t iap_tftp_send_packet(struct udp_pcb *upcb, ip_addr_t *to, int to_port, char *packet, int len);
 static err_t iap_tftp_send_ack_packet(struct udp_pcb *upcb, ip_addr_t *to, int to_port, int block);
+static err_t iap_tftp_send_error_packet(struct udp_pcb *upcb, ip_addr_t *to, int to_port,
+                                        tftp_errorcode err, char *msg);
+static int iap_tftp_option_match(const char *name, const char *option);
+static int iap_tftp_parse_options(char *req, int len, tftp_connection_args *args, char *oack);
+static uint32_t iap_tftp_queue_flush(uint32_t words);
+static void iap_tftp_ack_check(void);
+static void iap_tftp_abort(tftp_errorcode err, char *msg);
 
 /* Private functions ---------------------------------------------------------*/
 
@@ -103,18 +125,49 @@ static void iap_tftp_set_block(char* packet, u16_t block)
 }
 
 /**
-  * @brief  sends tftp ack packet
+  * @brief  sends a tftp packet
   * @param  upcb: pointer on udp_pcb structure
   * @param  to: pointer on the receive ip address structure
   * @param  to_port: receive port number
-  * @param  block: block number
+  * @param  packet: packet data
+  * @param  len: packet length
   * @retval err_t: error code
   */
-static err_t iap_tftp_send_ack_packet(struct udp_pcb *upcb, ip_addr_t *to, int to_port, int block)
+static err_t iap_tftp_send_packet(struct udp_pcb *upcb, ip_addr_t *to, int to_port, char *packet, int len)
 {
   err_t err;
   struct pbuf *pkt_buf; /* chain of pbuf's to be sent */
 
+  /* pbuf_transport - specifies the transport layer */
+  pkt_buf = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_POOL);
+
+  if (!pkt_buf)      /*if the packet pbuf == null exit and endtransfertransmission */
+  {
+    return ERR_MEM;
+  }
+
+  /* copy the original data buffer over to the packet buffer's payload */
+  memcpy(pkt_buf->payload, packet, len);
+
+  /* sending packet by udp protocol */
+  err = udp_sendto(upcb, pkt_buf, to, to_port);
+
+  /* free the buffer pbuf */
+  pbuf_free(pkt_buf);
+
+  return err;
+}
+
+/**
+  * @brief  sends tftp ack packet
+  * @param  upcb: pointer on udp_pcb structure
+  * @param  to: pointer on the receive ip address structure
+  * @param  to_port: receive port number
+  * @param  block: block number
+  * @retval err_t: error code
+  */
+static err_t iap_tftp_send_ack_packet(struct udp_pcb *upcb, ip_addr_t *to, int to_port, int block)
+{
   /* create the maximum possible size packet that a tftp ack packet can be */
   char packet[TFTP_ACK_PKT_LEN];
 
@@ -129,28 +182,206 @@ static err_t iap_tftp_send_ack_packet(struct udp_pcb *upcb, ip_addr_t *to, int t
    * an ack packet and a data packet for rrqs - see rfc1350 for more info.  */
   iap_tftp_set_block(packet, block);
 
-  /* pbuf_transport - specifies the transport layer */
-  pkt_buf = pbuf_alloc(PBUF_TRANSPORT, TFTP_ACK_PKT_LEN, PBUF_POOL);
+  return iap_tftp_send_packet(upcb, to, to_port, packet, TFTP_ACK_PKT_LEN);
+}
 
-  if (!pkt_buf)      /*if the packet pbuf == null exit and endtransfertransmission */
+/**
+  * @brief  sends tftp error packet
+  * @param  upcb: pointer on udp_pcb structure
+  * @param  to: pointer on the receive ip address structure
+  * @param  to_port: receive port number
+  * @param  err: tftp error code
+  * @param  msg: error message
+  * @retval err_t: error code
+  */
+static err_t iap_tftp_send_error_packet(struct udp_pcb *upcb, ip_addr_t *to, int to_port,
+                                        tftp_errorcode err, char *msg)
+{
+  char packet[TFTP_ERR_PKT_HDR_LEN + 32];
+  int len = strlen(msg);
+
+  if (len > 31)
   {
-    return ERR_MEM;
+    len = 31;
   }
+  iap_tftp_set_opcode(packet, TFTP_ERROR);
+  iap_tftp_set_block(packet, err);
+  memcpy(packet + TFTP_ERR_PKT_HDR_LEN, msg, len);
+  packet[TFTP_ERR_PKT_HDR_LEN + len] = 0;
 
-  /* copy the original data buffer over to the packet buffer's payload */
-  memcpy(pkt_buf->payload, packet, TFTP_ACK_PKT_LEN);
+  return iap_tftp_send_packet(upcb, to, to_port, packet, TFTP_ERR_PKT_HDR_LEN + len + 1);
+}
 
-  /* sending packet by udp protocol */
-  err = udp_sendto(upcb, pkt_buf, to, to_port);
+/**
+  * @brief  compares an option name, option names are case insensitive
+  * @param  name: option name from the request
+  * @param  option: lower case option name
+  * @retval 1 when equal
+  */
+static int iap_tftp_option_match(const char *name, const char *option)
+{
+  while (*option)
+  {
+    char c = *name++;
+    if (c >= 'A' && c <= 'Z')
+    {
+      c += 'a' - 'A';
+    }
+    if (c != *option++)
+    {
+      return 0;
+    }
+  }
+  return (*name == 0);
+}
 
-  /* free the buffer pbuf */
-  pbuf_free(pkt_buf);
+/**
+  * @brief  parses the options of a write request and builds the oack
+  * @note   unknown options are ignored.
+  * @param  req: null terminated request
+  * @param  len: request length
+  * @param  args: connection, blksize and windowsize are updated
+  * @param  oack: oack packet, TFTP_OACK_PKT_LEN_MAX bytes
+  * @retval oack length, 0 when no option is acknowledged
+  */
+static int iap_tftp_parse_options(char *req, int len, tftp_connection_args *args, char *oack)
+{
+  int pos = TFTP_OPCODE_LEN, olen = TFTP_OPCODE_LEN, value;
+  char *name;
 
-  return err;
+  /* skip file name and mode */
+  pos += strlen(req + pos) + 1;
+  if (pos < len)
+  {
+    pos += strlen(req + pos) + 1;
+  }
+
+  iap_tftp_set_opcode(oack, TFTP_OACK);
+  /* every accepted option adds at most 18 bytes */
+  while ((pos < len) && (olen + 18 <= TFTP_OACK_PKT_LEN_MAX))
+  {
+    name = req + pos;
+    pos += strlen(name) + 1;
+    if (pos >= len)
+    {
+      break;
+    }
+    value = atoi(req + pos);
+    pos += strlen(req + pos) + 1;
+
+    if (iap_tftp_option_match(name, "blksize") && value >= TFTP_BLKSIZE_MIN)
+    {
+      if (value > TFTP_BLKSIZE_MAX)
+      {
+        value = TFTP_BLKSIZE_MAX;
+      }
+      args->blksize = value;
+      olen += sprintf(oack + olen, "blksize%c%d", 0, args->blksize) + 1;
+    }
+    else if (iap_tftp_option_match(name, "windowsize") && value >= 1)
+    {
+      if (value > TFTP_WINDOWSIZE_MAX)
+      {
+        value = TFTP_WINDOWSIZE_MAX;
+      }
+      args->windowsize = value;
+      olen += sprintf(oack + olen, "windowsize%c%d", 0, args->windowsize) + 1;
+    }
+  }
+
+  return (olen > TFTP_OPCODE_LEN) ? olen : 0;
+}
+
+/**
+  * @brief  passes queued data to the image decoder, which programs it
+  * @param  bytes: maximum number of bytes to pass
+  * @retval 0: ok, else iap_image_write error
+  */
+static uint32_t iap_tftp_queue_flush(uint32_t bytes)
+{
+  uint8_t *queue = (uint8_t *)tftp_queue;
+  uint32_t run;
+
+  while (bytes && queue_count)
+  {
+    run = TFTP_QUEUE_SIZE - queue_tail;
+    if (run > queue_count)
+    {
+      run = queue_count;
+    }
+    if (run > bytes)
+    {
+      run = bytes;
+    }
+
+    if (iap_image_write(queue + queue_tail, run) != 0)
+    {
+      return 1;
+    }
+    queue_tail = (queue_tail + run) % TFTP_QUEUE_SIZE;
+    queue_count -= run;
+    bytes -= run;
+  }
+  return 0;
+}
+
+/**
+  * @brief  sends the pending ack once it is allowed
+  * @note   a window end is acknowledged when the queue can take the next
+  *         window, the last block only when everything is programmed and the
+  *         decoder accepted the image. a bad image gets an error instead.
+  * @param  none
+  * @retval none
+  */
+static void iap_tftp_ack_check(void)
+{
+  tftp_connection_args *args = tftp_args;
+
+  if (args == NULL || args->ack_pending == 0)
+  {
+    return;
+  }
+
+  if (args->last_block)
+  {
+    if (queue_count == 0)
+    {
+      if (iap_image_finish() != 0)
+      {
+        iap_tftp_abort(TFTP_ERR_ACCESS_VIOLATION, "bad image");
+        return;
+      }
+      iap_tftp_send_ack_packet(tftp_data_pcb, &args->to_ip, args->to_port, args->block);
+      iap_init();
+      iap_tftp_cleanup_wr(tftp_data_pcb, args);
+      tftp_iap_flag = RESET;
+    }
+  }
+  else if (TFTP_QUEUE_SIZE - queue_count >= (uint32_t)(args->blksize * args->windowsize))
+  {
+    iap_tftp_send_ack_packet(tftp_data_pcb, &args->to_ip, args->to_port, args->block);
+    args->ack_pending = 0;
+    args->window_count = 0;
+  }
+}
+
+/**
+  * @brief  stops the transfer with an error packet
+  * @param  err: tftp error code
+  * @param  msg: error message
+  * @retval none
+  */
+static void iap_tftp_abort(tftp_errorcode err, char *msg)
+{
+  iap_tftp_send_error_packet(tftp_data_pcb, &tftp_args->to_ip, tftp_args->to_port, err, msg);
+  iap_tftp_cleanup_wr(tftp_data_pcb, tftp_args);
+  tftp_iap_flag = RESET;
 }
 
 /**
   * @brief  processes data transfers after a tftp write request
+  * @note   data is only queued here, iap_tftp_handle programs it while the
+  *         next blocks are received.
   * @param  _args: used as pointer on tftp connection args
   * @param  upcb: pointer on udp_pcb structure
   * @param  pkt_buf: pointer on a pbuf stucture
@@ -161,77 +392,111 @@ static err_t iap_tftp_send_ack_packet(struct udp_pcb *upcb, ip_addr_t *to, int t
 static void iap_wrq_recv_callback(void *_args, struct udp_pcb *upcb, struct pbuf *pkt_buf, ip_addr_t *addr, u16_t port)
 {
   tftp_connection_args *args = (tftp_connection_args *)_args;
-  uint32_t data_buffer[128];
-  u16 count=0;
+  uint8_t *queue = (uint8_t *)tftp_queue;
+  uint32_t len, first;
+  u16_t block;
 
-  if (pkt_buf->len != pkt_buf->tot_len)
+  if ((pkt_buf->len != pkt_buf->tot_len) || (pkt_buf->len < TFTP_DATA_PKT_HDR_LEN) || args->last_block)
   {
+    pbuf_free(pkt_buf);
     return;
   }
 
-  /* does this packet have any valid data to write? */
-  if ((pkt_buf->len > TFTP_DATA_PKT_HDR_LEN) &&
-      (iap_tftp_extract_block(pkt_buf->payload) == (args->block + 1)))
+  if (iap_tftp_decode_op(pkt_buf->payload) == TFTP_ERROR)
   {
-    /* copy packet payload to data_buffer */
-    pbuf_copy_partial(pkt_buf, data_buffer, pkt_buf->len - TFTP_DATA_PKT_HDR_LEN,
-                      TFTP_DATA_PKT_HDR_LEN);
-
-    total_count += pkt_buf->len - TFTP_DATA_PKT_HDR_LEN;
+    /* the client gave up */
+    pbuf_free(pkt_buf);
+    iap_tftp_cleanup_wr(upcb, args);
+    tftp_iap_flag = RESET;
+    return;
+  }
 
-    count = (pkt_buf->len - TFTP_DATA_PKT_HDR_LEN)/4;
-    if (((pkt_buf->len - TFTP_DATA_PKT_HDR_LEN)%4)!=0)
-    count++;
+  block = iap_tftp_extract_block(pkt_buf->payload);
+  len = pkt_buf->len - TFTP_DATA_PKT_HDR_LEN;
 
-    /* write received data in flash */
-    flash_if_write(&flash_write_address, data_buffer ,count);
+  if ((iap_tftp_decode_op(pkt_buf->payload) == TFTP_DATA) &&
+      (block == (u16_t)(args->block + 1)) && (len <= (uint32_t)args->blksize))
+  {
+    if (APP_START_SECTOR_ADDR + args->tot_bytes + len > APP_END_ADDR + 1)
+    {
+      pbuf_free(pkt_buf);
+      iap_tftp_abort(TFTP_ERR_DISKFULL, "image too large");
+      return;
+    }
+
+    if (TFTP_QUEUE_SIZE - queue_count < len)
+    {
+      /* no room, the block is sent again by the client */
+      pbuf_free(pkt_buf);
+      return;
+    }
+
+    /* copy packet payload to the queue */
+    first = TFTP_QUEUE_SIZE - queue_head;
+    if (first > len)
+    {
+      first = len;
+    }
+    pbuf_copy_partial(pkt_buf, queue + queue_head, first, TFTP_DATA_PKT_HDR_LEN);
+    pbuf_copy_partial(pkt_buf, queue, len - first, TFTP_DATA_PKT_HDR_LEN + first);
+    queue_head = (queue_head + len) % TFTP_QUEUE_SIZE;
+    queue_count += len;
+
+    total_count += len;
 
     /* update our block number to match the block number just received */
     args->block++;
     /* update total bytes  */
-    (args->tot_bytes) += (pkt_buf->len - TFTP_DATA_PKT_HDR_LEN);
-
-    /* this is a valid pkt but it has no data.  this would occur if the file being
-       written is an exact multiple of 512 bytes.  in this case, the args->block
-       value must still be updated, but we can skip everything else.    */
+    (args->tot_bytes) += len;
+    args->window_count++;
+    args->gap_acked = 0;
+
+    /* if the block is shorter than the block size we've received the whole
+     * file (this is how tftp signals the end of a transfer!) */
+    if (len < (uint32_t)args->blksize)
+    {
+      args->last_block = 1;
+      args->ack_pending = 1;
+    }
+    else if (args->window_count >= args->windowsize)
+    {
+      args->ack_pending = 1;
+    }
   }
-  else if (iap_tftp_extract_block(pkt_buf->payload) == (args->block + 1))
+  else if (block == (u16_t)args->block)
   {
-    /* update our block number to match the block number just received  */
-    args->block++;
+    /* our ack was lost, the client sends the whole window again */
+    args->ack_pending = 1;
   }
-
-  /* send the appropriate ack pkt*/
-  iap_tftp_send_ack_packet(upcb, addr, port, args->block);
-
-  /* if the last write returned less than the maximum tftp data pkt length,
-   * then we've received the whole file and so we can quit (this is how tftp
-   * signals the endtransferof a transfer!)
-   */
-  if (pkt_buf->len < TFTP_DATA_PKT_LEN_MAX)
+  else if ((args->gap_acked == 0) && ((u16_t)(block - args->block - 1) < 0x8000))
   {
-    iap_init();
-    iap_tftp_cleanup_wr(upcb, args);
-    pbuf_free(pkt_buf);
-    tftp_iap_flag = RESET;
-  }
-  else
-  {
-    pbuf_free(pkt_buf);
-    return;
+    /* a block is missing, the last one in order is acknowledged once so that
+       the client restarts the window from there (rfc7440) */
+    args->gap_acked = 1;
+    args->ack_pending = 1;
   }
+
+  pbuf_free(pkt_buf);
+
+  iap_tftp_ack_check();
 }
 
 
 /**
   * @brief  processes tftp write request
+  * @param  upcb: pointer on the udp pcb of the transfer
   * @param  to: pointer on the receive ip address
   * @param  to_port: receive port number
+  * @param  pkt_buf: write request, parsed for options
   * @retval none
   */
-static int iap_tftp_process_write(struct udp_pcb *upcb, ip_addr_t *to, int to_port)
+static int iap_tftp_process_write(struct udp_pcb *upcb, ip_addr_t *to, int to_port, struct pbuf *pkt_buf)
 {
   tftp_connection_args *args = NULL;
+  char req[TFTP_DATA_PKT_LEN_MAX + 1];
+  char oack[TFTP_OACK_PKT_LEN_MAX];
+  int req_len, oack_len;
+
   /* this function is called from a callback,
   * therefore interrupts are disabled,
   * therefore we can use regular malloc   */
@@ -248,18 +513,41 @@ static int iap_tftp_process_write(struct udp_pcb *upcb, ip_addr_t *to, int to_po
   /* the block # used as a positive response to a wrq is _always_ 0!!! (see rfc1350)  */
   args->block = 0;
   args->tot_bytes = 0;
+  args->blksize = TFTP_DATA_LEN_MAX;
+  args->windowsize = 1;
+  args->window_count = 0;
+  args->ack_pending = 0;
+  args->gap_acked = 0;
+  args->last_block = 0;
+
+  req_len = pbuf_copy_partial(pkt_buf, req, TFTP_DATA_PKT_LEN_MAX, 0);
+  req[req_len] = 0;
+  oack_len = iap_tftp_parse_options(req, req_len, args, oack);
+
+  tftp_data_pcb = upcb;
+  tftp_args = args;
+  queue_head = 0;
+  queue_tail = 0;
+  queue_count = 0;
 
   /* set callback for receives on this udp pcb (protocol control block) */
   udp_recv(upcb, (udp_recv_fn)iap_wrq_recv_callback, args);
 
   total_count =0;
 
-  /* init flash */
-  flash_unlock();
+  /* pages are erased by the decoder as they are written */
+  iap_image_start();
 
-  flash_write_address = APP_START_SECTOR_ADDR;
-  /* initiate the write transaction by sending the first ack */
-  iap_tftp_send_ack_packet(upcb, to, to_port, args->block);
+  /* initiate the write transaction by sending the first ack, or the oack
+     when options were accepted (rfc2347) */
+  if (oack_len)
+  {
+    iap_tftp_send_packet(upcb, to, to_port, oack, oack_len);
+  }
+  else
+  {
+    iap_tftp_send_ack_packet(upcb, to, to_port, args->block);
+  }
 
   return 0;
 }
@@ -286,6 +574,7 @@ static void iap_tftp_recv_callback(void *arg, struct udp_pcb *upcb, struct pbuf
   if (!upcb_tftp_data)
   {
     /* error creating pcb. out of memory  */
+    pbuf_free(pkt_buf);
     return;
   }
 
@@ -297,20 +586,22 @@ static void iap_tftp_recv_callback(void *arg, struct udp_pcb *upcb, struct pbuf
   if (err != ERR_OK)
   {
     /* unable to bind to port */
+    udp_remove(upcb_tftp_data);
+    pbuf_free(pkt_buf);
     return;
   }
 
   op = iap_tftp_decode_op(pkt_buf->payload);
-  if (op != TFTP_WRQ)
+  if ((op != TFTP_WRQ) || (tftp_args != NULL))
   {
-    /* remove pcb */
+    /* remove pcb, a single transfer is served at a time */
     udp_remove(upcb_tftp_data);
   }
   else
   {
     /* start the tftp write mode*/
     tftp_iap_flag = SET;
-    iap_tftp_process_write(upcb_tftp_data, addr, port);
+    iap_tftp_process_write(upcb_tftp_data, addr, port, pkt_buf);
   }
   pbuf_free(pkt_buf);
 }
@@ -326,6 +617,8 @@ static void iap_tftp_cleanup_wr(struct udp_pcb *upcb, tftp_connection_args *args
 {
   /* Free the tftp_connection_args structure */
   mem_free(args);
+  tftp_args = NULL;
+  tftp_data_pcb = NULL;
 
   /* Disconnect the udp_pcb */
   udp_disconnect(upcb);
@@ -367,4 +660,27 @@ void iap_tftpd_init(void)
   }
 }
 
+/**
+  * @brief  programs queued tftp data, called from the main loop
+  * @note   a few words are programmed per call so that received frames keep
+  *         being handled in between.
+  * @param  none
+  * @retval none
+  */
+void iap_tftp_handle(void)
+{
+  if (tftp_args == NULL)
+  {
+    return;
+  }
+
+  if (iap_tftp_queue_flush(TFTP_FLASH_BYTES_PER_POLL) != 0)
+  {
+    iap_tftp_abort(TFTP_ERR_ACCESS_VIOLATION, "bad image or flash error");
+    return;
+  }
+
+  iap_tftp_ack_check();
+}
+
 #endif /* USE_IAP_TFTP */